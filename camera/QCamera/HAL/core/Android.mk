@@ -81,7 +81,10 @@ LOCAL_HAL_FILES := \
         src/QCameraStream.cpp\
         ../usbcamcore/src/QualcommUsbCamera.cpp\
         ../usbcamcore/src/QCameraMjpegDecode.cpp\
-        ../usbcamcore/src/QCameraUsbParm.cpp
+        ../usbcamcore/src/QCameraUsbParm.cpp\
+        ../usbcamcore/src/QCameraUsbConvert.cpp\
+        ../usbcamcore/src/QCameraUsbPipeline.cpp\
+        ../usbcamcore/src/QCameraUsbDmabuf.cpp
 
 LOCAL_HAL_WRAPPER_FILES := ../wrapper/QualcommCamera.cpp
 
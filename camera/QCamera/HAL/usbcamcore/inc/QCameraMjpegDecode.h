@@ -34,10 +34,15 @@ typedef int MJPEGD_ERR;
 #define MJPEGD_ERROR            -1
 #define MJPEGD_INSUFFICIENT_MEM -2
 
+/* Creates a decoder session. The decoder, its buffers and the Huffman
+ * tables are set up here once and reused by every frame decoded on it */
 MJPEGD_ERR mjpegDecoderInit(void**);
 
 MJPEGD_ERR mjpegDecoderDestroy(void* mjpegd);
 
+/* Decodes one frame. Frames without Huffman tables, as most UVC cameras
+ * send them, are decoded with the standard tables. A session decodes one
+ * frame at a time */
 MJPEGD_ERR mjpegDecode(
             void*   mjpegd,
             char*   mjpegBuffer,
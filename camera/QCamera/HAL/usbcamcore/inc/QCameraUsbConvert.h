@@ -0,0 +1,128 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QCAMERA_USB_CONVERT_H
+#define __QCAMERA_USB_CONVERT_H
+
+#include <stdint.h>
+
+/******************************************************************************
+ * Color conversion of packed 4:2:2 UVC frames to 4:2:0 preview and picture
+ * buffers. Every pair of source lines gives two luma lines and one chroma
+ * line; the chroma of the even source line is kept as is, like the original
+ * byte loop did. With downscale 2, luma is the rounded mean of each 2x2
+ * block and chroma the rounded mean of two neighbouring samples of the
+ * first of every four source lines.
+ *
+ * The SIMD kernel is picked at run time and has to produce the same bytes
+ * as the scalar reference. Frames of USBCAM_CONVERT_MT_MIN_PIXELS and more
+ * are split in bands of lines that are converted in parallel.
+ *****************************************************************************/
+
+typedef int USBCAM_CONVERT_ERR;
+#define USBCAM_CONVERT_NO_ERROR         0
+#define USBCAM_CONVERT_ERROR           -1
+#define USBCAM_CONVERT_INSUFFICIENT_MEM -2
+
+/* Maximum number of threads converting one frame */
+#define USBCAM_CONVERT_MAX_THREADS      4
+
+/* Smallest frame, in source pixels, split across threads */
+#define USBCAM_CONVERT_MT_MIN_PIXELS    (1280 * 720)
+
+typedef enum {
+    USBCAM_CONVERT_SRC_YUYV,
+    USBCAM_CONVERT_SRC_UYVY,
+} usbcam_convert_src_fmt_t;
+
+typedef enum {
+    USBCAM_CONVERT_DST_NV12,
+    USBCAM_CONVERT_DST_NV21,
+    USBCAM_CONVERT_DST_YV12,
+} usbcam_convert_dst_fmt_t;
+
+typedef enum {
+    USBCAM_CONVERT_IMPL_AUTO,
+    USBCAM_CONVERT_IMPL_SCALAR,
+    USBCAM_CONVERT_IMPL_SIMD,
+} usbcam_convert_impl_t;
+
+/******************************************************************************
+ * Conversion of one frame
+ *
+ *   src        - packed 4:2:2 source, 2 bytes per pixel
+ *   srcStride  - source line length in bytes, 0 for width * 2
+ *   srcFmt     - byte order of the source
+ *   width      - source width, multiple of 2 (4 when downscaling)
+ *   height     - source height, multiple of 2 (4 when downscaling)
+ *   downscale  - 1 or 2
+ *   dstY       - luma plane
+ *   dstC       - chroma plane for NV12/NV21, Cr plane for YV12. NULL to
+ *                place the chroma right after the luma plane
+ *   dstC2      - Cb plane for YV12. NULL to place it after the Cr plane
+ *   dstYStride - luma line length, 0 for the output width
+ *   dstCStride - chroma line length, 0 for the output width (NV12/NV21) or
+ *                half of it (YV12)
+ *   dstFmt     - layout of the output
+ *****************************************************************************/
+typedef struct {
+    const uint8_t*              src;
+    int                         srcStride;
+    usbcam_convert_src_fmt_t    srcFmt;
+    int                         width;
+    int                         height;
+    int                         downscale;
+    uint8_t*                    dstY;
+    uint8_t*                    dstC;
+    uint8_t*                    dstC2;
+    int                         dstYStride;
+    int                         dstCStride;
+    usbcam_convert_dst_fmt_t    dstFmt;
+} usbcam_convert_params_t;
+
+USBCAM_CONVERT_ERR usbCamConvertInit(void** conv, int numThreads);
+
+USBCAM_CONVERT_ERR usbCamConvertDestroy(void* conv);
+
+USBCAM_CONVERT_ERR usbCamConvertFrame(
+            void*                           conv,
+            const usbcam_convert_params_t*  params);
+
+/* Single threaded scalar conversion, the reference for the SIMD kernel */
+USBCAM_CONVERT_ERR usbCamConvertFrameRef(
+            const usbcam_convert_params_t*  params);
+
+/* Kernel used by usbCamConvertFrame. Selecting a SIMD kernel the CPU does
+ * not support fails. */
+USBCAM_CONVERT_ERR usbCamConvertSetImpl(usbcam_convert_impl_t impl);
+
+usbcam_convert_impl_t usbCamConvertGetImpl(void);
+
+const char* usbCamConvertImplName(void);
+
+#endif /* __QCAMERA_USB_CONVERT_H */
@@ -0,0 +1,78 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QCAMERA_USB_DMABUF_H
+#define __QCAMERA_USB_DMABUF_H
+
+#include <stdint.h>
+
+/******************************************************************************
+ * V4L2 capture queue of DMABUF buffers. The caller owns the buffers, e.g.
+ * display buffers, and queues them by fd; the camera writes the frames
+ * straight into them. Each buffer carries a cookie of the caller, handed
+ * back when the buffer is dequeued.
+ *****************************************************************************/
+
+typedef int USBCAM_DMABUF_ERR;
+#define USBCAM_DMABUF_NO_ERROR          0
+#define USBCAM_DMABUF_ERROR            -1
+#define USBCAM_DMABUF_INSUFFICIENT_MEM -2
+#define USBCAM_DMABUF_AGAIN             1
+
+#define USBCAM_DMABUF_MAX_BUFS          8
+
+/* Requests numBufs DMABUF buffers from the driver. Fails if the driver
+ * does not import DMABUF */
+USBCAM_DMABUF_ERR usbCamDmabufInit(void** queue, int v4l2Fd, int numBufs);
+
+/* Gives the buffers back to the driver. Stream must be off */
+USBCAM_DMABUF_ERR usbCamDmabufDestroy(void* queue);
+
+/* Queues a buffer to be filled. A buffer goes back to the V4L2 index it
+ * used before when that one is free, so the driver can keep it mapped */
+USBCAM_DMABUF_ERR usbCamDmabufQueue(void* queue, int dmabufFd,
+                                    uint32_t length, int cookie);
+
+/* Dequeues a filled buffer. Returns USBCAM_DMABUF_AGAIN when none is
+ * ready yet */
+USBCAM_DMABUF_ERR usbCamDmabufDequeue(void* queue, int *cookie,
+                                      uint32_t *bytesused);
+
+/* Number of buffers the driver holds */
+int usbCamDmabufQueued(void* queue);
+
+/* Forgets the buffers the driver held before stream off, calling release
+ * for each of them */
+void usbCamDmabufFlush(void* queue, void (*release)(void *ctx, int cookie),
+                       void *ctx);
+
+/* Exports a MMAP buffer of the driver as a DMABUF fd, to be closed by the
+ * caller */
+USBCAM_DMABUF_ERR usbCamV4l2ExportBuf(int v4l2Fd, int index, int *dmabufFd);
+
+#endif /* __QCAMERA_USB_DMABUF_H */
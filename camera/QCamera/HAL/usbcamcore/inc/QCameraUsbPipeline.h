@@ -0,0 +1,131 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QCAMERA_USB_PIPELINE_H
+#define __QCAMERA_USB_PIPELINE_H
+
+#include <stdint.h>
+
+/******************************************************************************
+ * Preview pipeline of the usb camera. The capture stage is the preview
+ * thread: it takes a slot, dequeues a capture buffer and submits it.
+ * Process workers turn the capture buffer into a display buffer, and the
+ * display thread hands the display buffers out in capture order. A slot is
+ * held from usbCamPipelineAcquire until the frame has been displayed or
+ * dropped, which bounds the frames in flight and the queues between the
+ * stages. Without workers the frames are processed and displayed on the
+ * submitting thread, like the original preview loop.
+ *****************************************************************************/
+
+typedef int USBCAM_PIPE_ERR;
+#define USBCAM_PIPE_NO_ERROR            0
+#define USBCAM_PIPE_ERROR              -1
+#define USBCAM_PIPE_INSUFFICIENT_MEM   -2
+#define USBCAM_PIPE_TIMEOUT             1
+
+#define USBCAM_PIPE_MAX_WORKERS         4
+#define USBCAM_PIPE_MAX_INFLIGHT        8
+
+/* Frames per second are measured over windows of this length */
+#define USBCAM_PIPE_FPS_WINDOW_US       1000000
+
+/******************************************************************************
+ * Frame travelling through the stages
+ *
+ *   index      - capture buffer index
+ *   bytesused  - bytes of the capture buffer
+ *   dispId     - display buffer index, set by the process stage
+ *   seq        - capture order, set by usbCamPipelineSubmit
+ *   captureUs  - submit time, set by usbCamPipelineSubmit
+ *   err        - set when the process stage failed
+ *****************************************************************************/
+typedef struct {
+    int                 index;
+    int                 bytesused;
+    int                 dispId;
+    uint32_t            seq;
+    uint64_t            captureUs;
+    int                 err;
+} usbcam_pipe_frame_t;
+
+/******************************************************************************
+ * Stage callbacks. process runs on the workers, possibly for several frames
+ * at once, and gives the capture buffer back to the camera once done with
+ * it. display and cancel run on the display thread in capture order; cancel
+ * is called instead of display for frames whose process failed.
+ *****************************************************************************/
+typedef struct {
+    void*   ctx;
+    int     (*process)(void *ctx, usbcam_pipe_frame_t *frame);
+    int     (*display)(void *ctx, usbcam_pipe_frame_t *frame);
+    void    (*cancel)(void *ctx, usbcam_pipe_frame_t *frame);
+} usbcam_pipe_ops_t;
+
+typedef struct {
+    uint32_t            submitted;
+    uint32_t            displayed;
+    uint32_t            dropped;
+    uint32_t            inflight;
+    uint32_t            maxInflight;
+    /* frames per second of the last window, x100 */
+    uint32_t            fpsX100;
+    /* submit to display */
+    uint64_t            latencyAvgUs;
+    uint64_t            latencyMaxUs;
+    uint64_t            processAvgUs;
+    uint64_t            displayAvgUs;
+} usbcam_pipe_stats_t;
+
+USBCAM_PIPE_ERR usbCamPipelineCreate(void** pipe,
+            const usbcam_pipe_ops_t*    ops,
+            int                         numWorkers,
+            int                         maxInflight);
+
+/* Waits for the frames in flight and stops the threads */
+USBCAM_PIPE_ERR usbCamPipelineDestroy(void* pipe);
+
+/* Takes a slot for the next capture. Returns USBCAM_PIPE_TIMEOUT when no
+ * slot got free within timeoutMs or the pipeline is paused. */
+USBCAM_PIPE_ERR usbCamPipelineAcquire(void* pipe, int timeoutMs);
+
+/* Gives back a slot that got no frame */
+void usbCamPipelineAbort(void* pipe);
+
+USBCAM_PIPE_ERR usbCamPipelineSubmit(void* pipe, usbcam_pipe_frame_t *frame);
+
+/* Waits until every submitted frame is displayed or dropped */
+void usbCamPipelineDrain(void* pipe);
+
+/* Stops handing out slots, for changes the stages must not see */
+void usbCamPipelinePause(void* pipe, int pause);
+
+void usbCamPipelineGetStats(void* pipe, usbcam_pipe_stats_t *stats);
+
+void usbCamPipelineDump(void* pipe, int fd);
+
+#endif /* __QCAMERA_USB_PIPELINE_H */
@@ -137,6 +137,8 @@ typedef struct {
     volatile int                        prvwCmd;
     pthread_t                           previewThread;
     pthread_t                           takePictureThread;
+    /* Process and display stages of the preview */
+    void*                               pipeline;
 
     camera_notify_callback              notify_cb;
     camera_data_callback                data_cb;
@@ -157,6 +159,9 @@ typedef struct {
     unsigned int                        n_buffers;
     struct v4l2_buffer                  curCaptureBuf;
     struct bufObj                       *buffers;
+    /* Camera fills the display buffers directly through DMABUF */
+    int                                 dmabufMode;
+    void*                               dmabufq;
 
     /* Display related members */
     preview_stream_ops*                 window;
@@ -169,6 +174,11 @@ typedef struct {
     /* MJPEG decoder related members */
     /* MJPEG decoder object */
     void*                               mjpegd;
+    /* Serializes the MJPEG decodes of the preview workers */
+    Mutex                               mjpegdLock;
+
+    /* YUYV color converter object */
+    void*                               convert;
 
     /* JPEG picture and thumbnail related members */
     int                                 pictFormat;
@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 
 extern "C" {
@@ -46,20 +47,6 @@ extern "C" {
 /* TBDJ: Can be removed */
 #define MIN(a,b)  (((a) < (b)) ? (a) : (b))
 
-// Abstract the return type of the function to be run as a thread
-#define OS_THREAD_FUNC_RET_T            void *
-
-// Abstract the argument type to the thread function
-#define OS_THREAD_FUNC_ARG_T            void *
-
-// Helpful constants for return values in the thread functions
-#define OS_THREAD_FUNC_RET_SUCCEEDED    (OS_THREAD_FUNC_RET_T)0
-#define OS_THREAD_FUNC_RET_FAILED       (OS_THREAD_FUNC_RET_T)1
-
-// Abstract the function modifier placed in the beginning of the thread
-// declaration (empty for Linux)
-#define OS_THREAD_FUNC_MODIFIER
-
 #define os_mutex_init(a) pthread_mutex_init(a, NULL)
 #define os_cond_init(a)  pthread_cond_init(a, NULL)
 #define os_mutex_lock    pthread_mutex_lock
@@ -67,6 +54,19 @@ extern "C" {
 #define os_cond_wait     pthread_cond_wait
 #define os_cond_signal   pthread_cond_signal
 
+/* Size of each of the two input buffers the decoder reads through */
+#define MJPEGD_INPUT_CHUNK_SIZE     0xA000
+
+/* JPEG markers looked at to find out whether a frame has its own
+ * Huffman tables */
+#define MJPEGD_MARKER_SOI           0xD8
+#define MJPEGD_MARKER_DHT           0xC4
+#define MJPEGD_MARKER_SOS           0xDA
+
+/* DHT segment of the 4 standard tables: marker, length and for each table
+ * its class/id, 16 code counts and the values */
+#define MJPEGD_STD_DHT_SIZE         (2 + 2 + 2 * (1 + 16 + 12) + 2 * (1 + 16 + 162))
+
 const char event_to_string[4][14] =
 {
     "EVENT_DONE",
@@ -80,8 +80,6 @@ typedef struct
     uint32_t   height;
     uint32_t   format;
     uint32_t   preference;
-    uint32_t   abort_time;
-    uint16_t   back_to_back_count;
     /* TBDJ: Is this required */
     int32_t    rotation;
     /* TBDJ: Is this required */
@@ -97,21 +95,38 @@ typedef struct
 
 } test_args_t;
 
+/* Decoder session. Everything but the per frame arguments lives from
+ * mjpegDecoderInit to mjpegDecoderDestroy */
 typedef struct
 {
-    int                   tid;
-    pthread_t             thread;
+    test_args_t           args;
     jpegd_obj_t           decoder;
+    uint8_t               decoder_ready;
+    jpegd_src_t           source;
+    jpegd_dst_t           dest;
+    jpegd_cfg_t           config;
+    jpegd_output_buf_t    output_buf;
+
+    /* Set by the event handler when a decode ends */
     uint8_t               decoding;
     uint8_t               decode_success;
     pthread_mutex_t       mutex;
     pthread_cond_t        cond;
-    test_args_t           *p_args;
-    jpegd_output_buf_t    *p_whole_output_buf;
 
-} thread_ctrl_blk_t;
+    /* Standard Huffman tables, spliced in front of the SOS marker of
+     * frames without a DHT segment. dht_offset is -1 for other frames */
+    uint8_t               std_dht[MJPEGD_STD_DHT_SIZE];
+    int                   dht_offset;
+
+    /* Statistics */
+    uint32_t              frames;
+    uint32_t              failures;
+    uint32_t              dht_inserted;
+    uint64_t              total_time_us;
+    uint32_t              max_time_us;
+
+} mjpegd_session_t;
 
-OS_THREAD_FUNC_RET_T OS_THREAD_FUNC_MODIFIER decoder_test(OS_THREAD_FUNC_ARG_T p_thread_args);
 void decoder_event_handler(void        *p_user_data,
                            jpeg_event_t event,
                            void        *p_arg);
@@ -123,35 +138,100 @@ uint32_t decoder_input_req_handler(void           *p_user_data,
                                    jpeg_buffer_t   buffer,
                                    uint32_t        start_offset,
                                    uint32_t        length);
-static void* insertHuffmanTable(void *p, int size);
+
+static int mjpegdSessionStart(mjpegd_session_t *session);
+static void mjpegdSessionStop(mjpegd_session_t *session);
+static int buildHuffmanTable(uint8_t *dht);
+static int findHuffmanTableOffset(const uint8_t *p, int size);
 
 static int mjpegd_timer_start(timespec *p_timer);
-static int mjpegd_timer_get_elapsed(timespec *p_timer, int *elapsed_in_ms, uint8_t reset_start);
-static int mjpegd_cond_timedwait(pthread_cond_t *p_cond, pthread_mutex_t *p_mutex, uint32_t ms);
+static int mjpegd_timer_get_elapsed_us(timespec *p_timer, uint32_t *elapsed_in_us);
+
+/* ITU-T T.81 K.3 tables, which is what UVC MJPEG frames without DHT are
+ * encoded with */
+static const uint8_t std_dc_luma_bits[16] =
+    { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t std_dc_chroma_bits[16] =
+    { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t std_dc_vals[12] =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t std_ac_luma_bits[16] =
+    { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t std_ac_luma_vals[162] =
+{
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+    0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+    0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
 
-// Global variables
-/* TBDJ: can be removed */
-thread_ctrl_blk_t *thread_ctrl_blks = NULL;
+static const uint8_t std_ac_chroma_bits[16] =
+    { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t std_ac_chroma_vals[162] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+    0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+    0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
 
 /*
- * This function initializes the mjpeg decoder and returns the object
+ * This function creates a decoder session: the decoder, its input buffers,
+ * the Huffman tables and the configuration are set up once here and
+ * reused by every mjpegDecode call on the session
  */
 MJPEGD_ERR mjpegDecoderInit(void** mjpegd_obj)
 {
+    mjpegd_session_t* session;
     test_args_t* mjpegd;
 
     ALOGD("%s: E", __func__);
 
-    mjpegd = (test_args_t *)malloc(sizeof(test_args_t));
-    if(!mjpegd)
+    session = (mjpegd_session_t *)malloc(sizeof(mjpegd_session_t));
+    if(!session)
         return MJPEGD_INSUFFICIENT_MEM;
 
-    memset(mjpegd, 0, sizeof(test_args_t));
+    memset(session, 0, sizeof(mjpegd_session_t));
+    mjpegd = &session->args;
 
     /* Defaults */
     /* Due to current limitation, s/w decoder is selected always */
     mjpegd->preference          = JPEG_DECODER_PREF_HW_ACCELERATED_PREFERRED;
-    mjpegd->back_to_back_count  = 1;
     mjpegd->rotation            = 0;
     mjpegd->hw_rotation         = 0;
     mjpegd->scale_factor        = (jpegd_scale_type_t)1;
@@ -159,14 +239,57 @@ MJPEGD_ERR mjpegDecoderInit(void** mjpegd_obj)
     /* TBDJ: can be removed */
     mjpegd->width                 = 640;
     mjpegd->height                = 480;
-    mjpegd->abort_time            = 0;
 
-    *mjpegd_obj = (void *)mjpegd;
+    os_mutex_init(&session->mutex);
+    os_cond_init(&session->cond);
+
+    buildHuffmanTable(session->std_dht);
+    session->dht_offset = -1;
+
+    if(mjpegdSessionStart(session)) {
+        mjpegdSessionStop(session);
+        pthread_mutex_destroy(&session->mutex);
+        pthread_cond_destroy(&session->cond);
+        free(session);
+        return MJPEGD_ERROR;
+    }
+
+    *mjpegd_obj = (void *)session;
 
     ALOGD("%s: X", __func__);
     return  MJPEGD_NO_ERROR;
 }
 
+MJPEGD_ERR mjpegDecoderDestroy(void* mjpegd_obj)
+{
+    mjpegd_session_t* session = (mjpegd_session_t*) mjpegd_obj;
+
+    ALOGD("%s: E", __func__);
+
+    if(!session)
+        return MJPEGD_NO_ERROR;
+
+    if(session->frames) {
+        ALOGI("%s: %d frame(s) decoded, %d failed, %d without DHT, "
+              "avg. decode time = %dus/frame, max = %dus", __func__,
+              session->frames, session->failures, session->dht_inserted,
+              (int)(session->total_time_us / session->frames),
+              session->max_time_us);
+    }
+
+    mjpegdSessionStop(session);
+    pthread_mutex_destroy(&session->mutex);
+    pthread_cond_destroy(&session->cond);
+    free(session);
+
+    ALOGD("%s: X", __func__);
+    return MJPEGD_NO_ERROR;
+}
+
+/*
+ * Decodes one frame on the session. Only the per frame state is reset here;
+ * a session is used by one thread at a time
+ */
 MJPEGD_ERR mjpegDecode(
             void*   mjpegd_obj,
             char*   inputMjpegBuffer,
@@ -175,73 +298,156 @@ MJPEGD_ERR mjpegDecode(
             char*   outputUVptr,
             int     outputFormat)
 {
-    int rc, c, i;
-    test_args_t* mjpegd;
-    test_args_t  test_args;
+    int rc;
+    mjpegd_session_t* session;
+    test_args_t* p_args;
+    jpeg_hdr_t   header;
+    timespec     os_timer;
+    uint32_t     diff = 0;
+    uint32_t     output_buffers_count = 1; // currently only 1 buffer a time is supported
 
     ALOGD("%s: E", __func__);
-    /* store input arguments in the context */
-    mjpegd = (test_args_t*) mjpegd_obj;
-    mjpegd->inputMjpegBuffer        = inputMjpegBuffer;
-    mjpegd->inputMjpegBufferSize    = inputMjpegBufferSize;
-    mjpegd->outputYptr              = outputYptr;
-    mjpegd->outputUVptr             = outputUVptr;
-    mjpegd->format                  = outputFormat;
 
-    /* TBDJ: can be removed */
-    memcpy(&test_args, mjpegd, sizeof(test_args_t));
+    session = (mjpegd_session_t*) mjpegd_obj;
+    if(!session || !inputMjpegBuffer || inputMjpegBufferSize <= 0 ||
+       !outputYptr || !outputUVptr) {
+        ALOGE("%s: Invalid arguments", __func__);
+        return MJPEGD_ERROR;
+    }
+
+    /* store input arguments in the context */
+    p_args = &session->args;
+    p_args->inputMjpegBuffer        = inputMjpegBuffer;
+    p_args->inputMjpegBufferSize    = inputMjpegBufferSize;
+    p_args->outputYptr              = outputYptr;
+    p_args->outputUVptr             = outputUVptr;
+    p_args->format                  = outputFormat;
 
     // check the formats
-    if (((test_args.format == YCRCBLP_H1V2) || (test_args.format == YCBCRLP_H1V2) ||
-      (test_args.format == YCRCBLP_H1V1) || (test_args.format == YCBCRLP_H1V1)) &&
-      !(test_args.preference == JPEG_DECODER_PREF_HW_ACCELERATED_ONLY)) {
-        ALOGE("%s:These formats are not supported by SW format %d", __func__, test_args.format);
-        return 1;
+    if (p_args->format != YCRCBLP_H2V2 && p_args->format != YCBCRLP_H2V2) {
+        ALOGE("%s: unsupported output format %d", __func__, p_args->format);
+        return MJPEGD_ERROR;
     }
 
-    // Create thread control blocks
-    thread_ctrl_blks = (thread_ctrl_blk_t *)malloc( sizeof(thread_ctrl_blk_t));
-    if (!thread_ctrl_blks)
+    if(mjpegd_timer_start(&os_timer) < 0) {
+        ALOGE("%s: failed to get start time", __func__);
+    }
+
+    /* Decoder was torn down by an earlier failure */
+    if(!session->decoder_ready) {
+        mjpegdSessionStop(session);
+        if(mjpegdSessionStart(session))
+            return MJPEGD_ERROR;
+    }
+
+    /* UVC cameras mostly leave the Huffman tables out of the frames */
+    session->dht_offset = findHuffmanTableOffset(
+        (const uint8_t *)inputMjpegBuffer, inputMjpegBufferSize);
+    session->source.total_length = inputMjpegBufferSize & 0xffffffff;
+    if(session->dht_offset >= 0) {
+        session->source.total_length += MJPEGD_STD_DHT_SIZE;
+        session->dht_inserted++;
+    }
+
+    session->decoding       = true;
+    session->decode_success = false;
+
+    rc = jpegd_set_source(session->decoder, &session->source);
+    if (JPEG_FAILED(rc))
+    {
+        ALOGE("%s: jpegd_set_source failed", __func__);
+        goto fail;
+    }
+
+    rc = jpegd_read_header(session->decoder, &header);
+    if (JPEG_FAILED(rc))
+    {
+        ALOGE("%s: jpegd_read_header failed", __func__);
+        goto fail;
+    }
+    p_args->width = header.main.width;
+    p_args->height = header.main.height;
+    ALOGD("%s: main dimension: (%dx%d) subsampling: (%d)", __func__,
+            header.main.width, header.main.height, (int)header.main.subsampling);
+
+    // Set destination information
+    session->dest.width = p_args->width;
+    session->dest.height = p_args->height;
+    session->dest.output_format = (jpeg_color_format_t) p_args->format;
+    session->dest.region = p_args->region;
+    session->dest.back_to_back_count = 1;
+
+    /* The display buffers rotate, point the output at this frame's */
+    rc = jpeg_buffer_use_external_buffer(
+           session->output_buf.data.yuv.luma_buf,
+           (uint8_t*)p_args->outputYptr,
+           p_args->width * p_args->height * SQUARE(p_args->scale_factor),
+           0);
+    if (JPEG_SUCCEEDED(rc)) {
+        rc = jpeg_buffer_use_external_buffer(
+            session->output_buf.data.yuv.chroma_buf,
+            (uint8_t*)p_args->outputUVptr,
+            p_args->width * p_args->height / 2 * SQUARE(p_args->scale_factor),
+            0);
+    }
+    if (JPEG_FAILED(rc)) {
+        ALOGE("%s: failed to set output buffers", __func__);
+        goto fail;
+    }
+    session->output_buf.is_in_q = 0;
+
+    rc = jpegd_start(session->decoder, &session->config, &session->dest,
+                     &session->output_buf, output_buffers_count);
+    if(JPEG_FAILED(rc)) {
+        ALOGE("%s: jpegd_start failed (rc=%d)", __func__, rc);
+        goto fail;
+    }
+
+    // Wait until decoding is done or stopped due to error
+    os_mutex_lock(&session->mutex);
+    while (session->decoding)
     {
-        ALOGE("%s: decoder_test failed: insufficient memory in creating thread control blocks", __func__);
-        return 1;
+        os_cond_wait(&session->cond, &session->mutex);
     }
-    memset(thread_ctrl_blks, 0, sizeof(thread_ctrl_blk_t));
-    // Initialize the blocks and kick off the threads
-        thread_ctrl_blks[i].tid = i;
-        thread_ctrl_blks[i].p_args = &test_args;
-        os_mutex_init(&thread_ctrl_blks[i].mutex);
-        os_cond_init(&thread_ctrl_blks[i].cond);
+    os_mutex_unlock(&session->mutex);
 
-    rc = (int)decoder_test(&thread_ctrl_blks[i]);
+    if(!session->decode_success) {
+        ALOGE("%s: decode failed", __func__);
+        goto fail;
+    }
 
-    if (!rc)
-        ALOGD("%s: decoder_test finished successfully ", __func__);
-    else
-        ALOGE("%s: decoder_test failed",__func__);
+    session->frames++;
+    if(mjpegd_timer_get_elapsed_us(&os_timer, &diff) < 0) {
+        ALOGE("%s: failed to get elapsed time", __func__);
+    } else {
+        session->total_time_us += diff;
+        if(diff > session->max_time_us)
+            session->max_time_us = diff;
+        ALOGD("%s: decode time: %dus (%d frame(s), avg=%dus/frame)", __func__,
+              diff, session->frames,
+              (int)(session->total_time_us / session->frames));
+    }
 
-    ALOGD("%s: X rc: %d", __func__, rc);
+    ALOGD("%s: X", __func__);
+    return MJPEGD_NO_ERROR;
 
-    return rc;
+fail:
+    /* Do not trust the decoder state after an error, the next frame
+     * starts over with a new decoder */
+    session->failures++;
+    session->decoder_ready = false;
+    ALOGD("%s: X", __func__);
+    return MJPEGD_ERROR;
 }
 
-OS_THREAD_FUNC_RET_T OS_THREAD_FUNC_MODIFIER decoder_test(OS_THREAD_FUNC_ARG_T arg)
+/*
+ * Creates the decoder and the buffers it works with
+ */
+static int mjpegdSessionStart(mjpegd_session_t *session)
 {
-    int rc, i;
-    jpegd_obj_t         decoder;
-    jpegd_src_t         source;
-    jpegd_dst_t         dest;
-    jpegd_cfg_t         config;
-    jpeg_hdr_t          header;
-    jpegd_output_buf_t  p_output_buffers;
-    uint32_t            output_buffers_count = 1; // currently only 1 buffer a time is supported
+    int rc;
     uint8_t use_pmem = true;
-    timespec os_timer;
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)arg;
-    test_args_t *p_args = p_thread_arg->p_args;
-    uint32_t            output_width;
-    uint32_t            output_height;
-    uint32_t total_time = 0;
+    test_args_t *p_args = &session->args;
 
     ALOGD("%s: E", __func__);
 
@@ -252,321 +458,170 @@ OS_THREAD_FUNC_RET_T OS_THREAD_FUNC_MODIFIER decoder_test(OS_THREAD_FUNC_ARG_T a
         use_pmem = false;
     }
 
-    if (((jpegd_preference_t)p_args->preference !=
-      JPEG_DECODER_PREF_HW_ACCELERATED_ONLY) &&
-      ((jpegd_preference_t)p_args->scale_factor > 0)) {
-        ALOGI("%s: Setting scale factor to 1x", __func__);
-    }
-
-    ALOGD("%s: before jpegd_init p_thread_arg: %p", __func__, p_thread_arg);
-
     // Initialize decoder
-    rc = jpegd_init(&decoder,
+    rc = jpegd_init(&session->decoder,
                     &decoder_event_handler,
                     &decoder_output_handler,
-                    p_thread_arg);
-
+                    session);
     if (JPEG_FAILED(rc)) {
-        ALOGE("%s: decoder_test: jpegd_init failed", __func__);
-        goto fail;
+        ALOGE("%s: jpegd_init failed", __func__);
+        return -1;
     }
-    p_thread_arg->decoder = decoder;
 
     // Set source information
-    source.p_input_req_handler = &decoder_input_req_handler;
-    source.total_length        = p_args->inputMjpegBufferSize & 0xffffffff;
+    memset(&session->source, 0, sizeof(jpegd_src_t));
+    session->source.p_input_req_handler = &decoder_input_req_handler;
 
-    rc = jpeg_buffer_init(&source.buffers[0]);
+    rc = jpeg_buffer_init(&session->source.buffers[0]);
     if (JPEG_SUCCEEDED(rc)) {
         /* TBDJ: why buffer [1] */
-        rc = jpeg_buffer_init(&source.buffers[1]);
+        rc = jpeg_buffer_init(&session->source.buffers[1]);
+    }
+    if (JPEG_SUCCEEDED(rc)) {
+        rc = jpeg_buffer_allocate(session->source.buffers[0],
+                                  MJPEGD_INPUT_CHUNK_SIZE, use_pmem);
+    }
+    if (JPEG_SUCCEEDED(rc)) {
+        rc = jpeg_buffer_allocate(session->source.buffers[1],
+                                  MJPEGD_INPUT_CHUNK_SIZE, use_pmem);
     }
     if (JPEG_SUCCEEDED(rc)) {
-#if 1
-        rc = jpeg_buffer_allocate(source.buffers[0], 0xA000, use_pmem);
-#else
-        rc = jpeg_buffer_use_external_buffer(source.buffers[0],
-                                             (uint8_t *)p_args->inputMjpegBuffer,
-                                             p_args->inputMjpegBufferSize,
-                                             0);
-#endif
-        ALOGD("%s: source.buffers[0]:%p compressed buffer ptr = %p", __func__,
-              source.buffers[0], p_args->inputMjpegBuffer);
+        rc = jpeg_buffer_init(&session->output_buf.data.yuv.luma_buf);
     }
     if (JPEG_SUCCEEDED(rc)) {
-#if 1
-        rc = jpeg_buffer_allocate(source.buffers[1], 0xA000, use_pmem);
-#else
-         rc = jpeg_buffer_use_external_buffer(source.buffers[1],
-                                             (uint8_t *)p_args->inputMjpegBuffer,
-                                             p_args->inputMjpegBufferSize,
-                                             0);
-#endif
-        ALOGD("%s: source.buffers[1]:%p compressed buffer ptr  = %p", __func__,
-              source.buffers[1], p_args->inputMjpegBuffer);
-   }
+        rc = jpeg_buffer_init(&session->output_buf.data.yuv.chroma_buf);
+    }
     if (JPEG_FAILED(rc)) {
-        jpeg_buffer_destroy(&source.buffers[0]);
-        jpeg_buffer_destroy(&source.buffers[1]);
-        goto fail;
+        ALOGE("%s: failed to set up the decoder buffers", __func__);
+        jpegd_destroy(&session->decoder);
+        jpeg_buffer_destroy(&session->source.buffers[0]);
+        jpeg_buffer_destroy(&session->source.buffers[1]);
+        jpeg_buffer_destroy(&session->output_buf.data.yuv.luma_buf);
+        jpeg_buffer_destroy(&session->output_buf.data.yuv.chroma_buf);
+        return -1;
     }
 
-   ALOGI("%s: *** Starting back-to-back decoding of %d frame(s)***\n",
-                 __func__, p_args->back_to_back_count);
-
-	 // Loop to perform n back-to-back decoding (to the same output file)
-    for(i = 0; i < p_args->back_to_back_count; i++) {
-        if(mjpegd_timer_start(&os_timer) < 0) {
-            ALOGE("%s: failed to get start time", __func__);
-        }
-
-        /* TBDJ: Every frame? */
-        ALOGD("%s: before jpegd_set_source source.p_arg:%p", __func__, source.p_arg);
-        rc = jpegd_set_source(decoder, &source);
-        if (JPEG_FAILED(rc))
-        {
-            ALOGE("%s: jpegd_set_source failed", __func__);
-            goto fail;
-        }
-
-        rc = jpegd_read_header(decoder, &header);
-        if (JPEG_FAILED(rc))
-        {
-            ALOGE("%s: jpegd_read_header failed", __func__);
-            goto fail;
-        }
-        p_args->width = header.main.width;
-        p_args->height = header.main.height;
-        ALOGD("%s: main dimension: (%dx%d) subsampling: (%d)", __func__,
-                header.main.width, header.main.height, (int)header.main.subsampling);
-
-        // main image decoding:
-        // Set destination information
-        dest.width = (p_args->width) ? (p_args->width) : header.main.width;
-        dest.height = (p_args->height) ? (p_args->height) : header.main.height;
-        dest.output_format = (jpeg_color_format_t) p_args->format;
-        dest.region = p_args->region;
-
-        // if region is defined, re-assign the output width/height
-        output_width  = dest.width;
-        output_height = dest.height;
-
-        if (p_args->region.right || p_args->region.bottom)
-        {
-            if (0 == p_args->rotation || 180 == p_args->rotation)
-            {
-                output_width  = MIN((dest.width),
-                        (uint32_t)(dest.region.right  - dest.region.left + 1));
-                output_height = MIN((dest.height),
-                        (uint32_t)(dest.region.bottom - dest.region.top  + 1));
-            }
-            // Swap output width/height for 90/270 rotation cases
-            else if (90 == p_args->rotation || 270 == p_args->rotation)
-            {
-                output_height  = MIN((dest.height),
-                        (uint32_t)(dest.region.right  - dest.region.left + 1));
-                output_width   = MIN((dest.width),
-                        (uint32_t)(dest.region.bottom - dest.region.top  + 1));
-            }
-            // Unsupported rotation cases
-            else
-            {
-                goto fail;
-            }
-        }
-
-        if (dest.output_format == YCRCBLP_H2V2 || dest.output_format == YCBCRLP_H2V2 ||
-            dest.output_format == YCRCBLP_H2V1 || dest.output_format == YCBCRLP_H2V1 ||
-            dest.output_format == YCRCBLP_H1V2 || dest.output_format == YCBCRLP_H1V2 ||
-            dest.output_format == YCRCBLP_H1V1 || dest.output_format == YCBCRLP_H1V1) {
-            jpeg_buffer_init(&p_output_buffers.data.yuv.luma_buf);
-            jpeg_buffer_init(&p_output_buffers.data.yuv.chroma_buf);
-        } else {
-            jpeg_buffer_init(&p_output_buffers.data.rgb.rgb_buf);
-
-        }
+    // Assign 0 to tile width and height
+    // to indicate that no tiling is requested.
+    session->output_buf.tile_width  = 0;
+    session->output_buf.tile_height = 0;
 
-        {
-            // Assign 0 to tile width and height
-            // to indicate that no tiling is requested.
-            p_output_buffers.tile_width  = 0;
-            p_output_buffers.tile_height = 0;
-        }
-        p_output_buffers.is_in_q = 0;
-
-        switch (dest.output_format)
-        {
-        case YCRCBLP_H2V2:
-        case YCBCRLP_H2V2:
-//        case YCRCBLP_H2V1:
-//        case YCBCRLP_H2V1:
-//        case YCRCBLP_H1V2:
-//        case YCBCRLP_H1V2:
-//        case YCRCBLP_H1V1:
-//        case YCBCRLP_H1V1:
-            jpeg_buffer_use_external_buffer(
-               p_output_buffers.data.yuv.luma_buf,
-               (uint8_t*)p_args->outputYptr,
-               p_args->width * p_args->height * SQUARE(p_args->scale_factor),
-               0);
-            jpeg_buffer_use_external_buffer(
-                p_output_buffers.data.yuv.chroma_buf,
-                (uint8_t*)p_args->outputUVptr,
-                p_args->width * p_args->height / 2 * SQUARE(p_args->scale_factor),
-                0);
-            break;
-
-        default:
-            ALOGE("%s: decoder_test: unsupported output format", __func__);
-            goto fail;
-        }
-
-        // Set up configuration
-        memset(&config, 0, sizeof(jpegd_cfg_t));
-        config.preference = (jpegd_preference_t) p_args->preference;
-        config.decode_from = JPEGD_DECODE_FROM_AUTO;
-        config.rotation = p_args->rotation;
-        config.scale_factor = p_args->scale_factor;
-        config.hw_rotation = p_args->hw_rotation;
-        dest.back_to_back_count = p_args->back_to_back_count;
-
-        // Start decoding
-        p_thread_arg->decoding = true;
-
-        rc = jpegd_start(decoder, &config, &dest, &p_output_buffers, output_buffers_count);
-        dest.back_to_back_count--;
-
-        if(JPEG_FAILED(rc)) {
-            ALOGE("%s: decoder_test: jpegd_start failed (rc=%d)\n",
-                    __func__, rc);
-            goto fail;
-        }
+    // Set up configuration
+    memset(&session->config, 0, sizeof(jpegd_cfg_t));
+    session->config.preference = (jpegd_preference_t) p_args->preference;
+    session->config.decode_from = JPEGD_DECODE_FROM_AUTO;
+    session->config.rotation = p_args->rotation;
+    session->config.scale_factor = p_args->scale_factor;
+    session->config.hw_rotation = p_args->hw_rotation;
 
-        ALOGD("%s: decoder_test: jpegd_start succeeded", __func__);
-
-        // Do abort
-        if (p_args->abort_time) {
-            os_mutex_lock(&p_thread_arg->mutex);
-            while (p_thread_arg->decoding)
-            {
-                rc = mjpegd_cond_timedwait(&p_thread_arg->cond, &p_thread_arg->mutex, p_args->abort_time);
-                if (rc == JPEGERR_ETIMEDOUT)
-                {
-                    // Do abort
-                    os_mutex_unlock(&p_thread_arg->mutex);
-                    rc = jpegd_abort(decoder);
-                    if (rc)
-                    {
-                        ALOGE("%s: decoder_test: jpegd_abort failed: %d", __func__, rc);
-                        goto fail;
-                    }
-                    break;
-                }
-            }
-            if (p_thread_arg->decoding)
-                os_mutex_unlock(&p_thread_arg->mutex);
-        } else {
-            // Wait until decoding is done or stopped due to error
-            os_mutex_lock(&p_thread_arg->mutex);
-            while (p_thread_arg->decoding)
-            {
-                os_cond_wait(&p_thread_arg->cond, &p_thread_arg->mutex);
-            }
-            os_mutex_unlock(&p_thread_arg->mutex);
-        }
+    session->decoder_ready = true;
 
-        int diff;
-        // Display the time elapsed
-        if (mjpegd_timer_get_elapsed(&os_timer, &diff, 0) < 0) {
-            ALOGE("%s: decoder_test: failed to get elapsed time", __func__);
-        } else {
-            if(p_args->abort_time) {
-                if(p_thread_arg->decoding) {
-                    ALOGI("%s: decoder_test: decoding aborted successfully after %d ms", __func__, diff);
-                    goto buffer_clean_up;
-                }
-                else
-                {
-                    ALOGI("%s: decoder_test: decoding stopped before abort is issued. "
-                                    "decode time: %d ms", __func__, diff);
-                }
-            }
-            else {
-                if(p_thread_arg->decode_success) {
-                    total_time += diff;
-                    ALOGI("%s: decode time: %d ms (%d frame(s), total=%dms, avg=%dms/frame)",
-                            __func__, diff, i+1, total_time, total_time/(i+1));
-                }
-                else
-                {
-                    fprintf(stderr, "decoder_test: decode failed\n");
-                }
-            }
-        }
-    }
+    ALOGD("%s: X", __func__);
+    return 0;
+}
 
-    if(p_thread_arg->decode_success) {
-        ALOGD("%s: Frame(s) = %d, Total Time = %dms, Avg. decode time = %dms/frame)\n",
-                 __func__, p_args->back_to_back_count, total_time, total_time/p_args->back_to_back_count);
-    }
+/*
+ * Releases what mjpegdSessionStart set up
+ */
+static void mjpegdSessionStop(mjpegd_session_t *session)
+{
+    if(!session->decoder_ready)
+        return;
+
+    jpegd_destroy(&session->decoder);
+    jpeg_buffer_destroy(&session->source.buffers[0]);
+    jpeg_buffer_destroy(&session->source.buffers[1]);
+    jpeg_buffer_destroy(&session->output_buf.data.yuv.luma_buf);
+    jpeg_buffer_destroy(&session->output_buf.data.yuv.chroma_buf);
+    session->decoder_ready = false;
+}
 
-buffer_clean_up:
-    // Clean up decoder and allocate buffers
-    jpeg_buffer_destroy(&source.buffers[0]);
-    jpeg_buffer_destroy(&source.buffers[1]);
-    switch (dest.output_format)
-    {
-    case YCRCBLP_H2V2:
-    case YCBCRLP_H2V2:
-    case YCRCBLP_H2V1:
-    case YCBCRLP_H2V1:
-    case YCRCBLP_H1V2:
-    case YCBCRLP_H1V2:
-    case YCRCBLP_H1V1:
-    case YCBCRLP_H1V1:
-        jpeg_buffer_destroy(&p_output_buffers.data.yuv.luma_buf);
-        jpeg_buffer_destroy(&p_output_buffers.data.yuv.chroma_buf);
-        break;
-    default:
-        break;
+/*
+ * Writes the DHT segment of the standard tables to dht, which must hold
+ * MJPEGD_STD_DHT_SIZE bytes. Returns the bytes written
+ */
+static int buildHuffmanTable(uint8_t *dht)
+{
+    const struct {
+        uint8_t         tc_th;
+        const uint8_t   *bits;
+        const uint8_t   *vals;
+        int             num_vals;
+    } tables[] = {
+        { 0x00, std_dc_luma_bits,   std_dc_vals,        12  },
+        { 0x10, std_ac_luma_bits,   std_ac_luma_vals,   162 },
+        { 0x01, std_dc_chroma_bits, std_dc_vals,        12  },
+        { 0x11, std_ac_chroma_bits, std_ac_chroma_vals, 162 },
+    };
+    int i, len = 0;
+
+    dht[len++] = 0xFF;
+    dht[len++] = MJPEGD_MARKER_DHT;
+    dht[len++] = ((MJPEGD_STD_DHT_SIZE - 2) >> 8) & 0xFF;
+    dht[len++] = (MJPEGD_STD_DHT_SIZE - 2) & 0xFF;
+    for(i = 0; i < (int)(sizeof(tables) / sizeof(tables[0])); i++) {
+        dht[len++] = tables[i].tc_th;
+        memcpy(dht + len, tables[i].bits, 16);
+        len += 16;
+        memcpy(dht + len, tables[i].vals, tables[i].num_vals);
+        len += tables[i].num_vals;
     }
-    jpegd_destroy(&decoder);
+    return len;
+}
 
-    if (!p_thread_arg->decode_success)
-    {
-        goto fail;
+/*
+ * Walks the marker segments of a frame up to its SOS marker. Returns the
+ * offset of the SOS marker when the frame has no DHT segment, otherwise -1.
+ * Frames that cannot be parsed are left to the decoder to reject
+ */
+static int findHuffmanTableOffset(const uint8_t *p, int size)
+{
+    int offset = 2;
+    uint8_t marker;
+
+    if(size < 4 || p[0] != 0xFF || p[1] != MJPEGD_MARKER_SOI)
+        return -1;
+
+    while(offset + 4 <= size) {
+        if(p[offset] != 0xFF)
+            return -1;
+        marker = p[offset + 1];
+        if(marker == 0xFF) {
+            /* fill byte */
+            offset++;
+            continue;
+        }
+        if(marker == MJPEGD_MARKER_DHT)
+            return -1;
+        if(marker == MJPEGD_MARKER_SOS)
+            return offset;
+        offset += 2 + ((p[offset + 2] << 8) | p[offset + 3]);
     }
-
-    ALOGD("%s: X", __func__);
-    return OS_THREAD_FUNC_RET_SUCCEEDED;
-fail:
-
-    ALOGD("%s: X", __func__);
-    return OS_THREAD_FUNC_RET_FAILED;
+    return -1;
 }
 
 void decoder_event_handler(void        *p_user_data,
                            jpeg_event_t event,
                            void        *p_arg)
 {
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)p_user_data;
+    mjpegd_session_t *session = (mjpegd_session_t *)p_user_data;
 
     ALOGD("%s: E", __func__);
 
     ALOGD("%s: Event: %s\n", __func__, event_to_string[event]);
     if (event == JPEG_EVENT_DONE)
     {
-        p_thread_arg->decode_success = true;
-        ALOGD("%s: decode_success: %d\n", __func__, p_thread_arg->decode_success);
+        session->decode_success = true;
+        ALOGD("%s: decode_success: %d\n", __func__, session->decode_success);
     }
     // If it is not a warning event, decoder has stopped; Signal
     // main thread to clean up
     if (event != JPEG_EVENT_WARNING)
     {
-        os_mutex_lock(&p_thread_arg->mutex);
-        p_thread_arg->decoding = false;
-        os_cond_signal(&p_thread_arg->cond);
-        os_mutex_unlock(&p_thread_arg->mutex);
+        os_mutex_lock(&session->mutex);
+        session->decoding = false;
+        os_cond_signal(&session->cond);
+        os_mutex_unlock(&session->mutex);
     }
     ALOGD("%s: X", __func__);
 
@@ -579,28 +634,17 @@ int decoder_output_handler(void *p_user_data,
                            uint32_t first_row_id,
                            uint8_t is_last_buffer)
 {
-    uint8_t* whole_output_buf_ptr, *tiling_buf_ptr;
-
     ALOGD("%s: E", __func__);
 
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)p_user_data;
-
-    jpeg_buffer_get_addr(p_thread_arg->p_whole_output_buf->data.rgb.rgb_buf, &whole_output_buf_ptr);
-    jpeg_buffer_get_addr(p_output_buffer->data.rgb.rgb_buf, &tiling_buf_ptr);
+    mjpegd_session_t *session = (mjpegd_session_t *)p_user_data;
 
     if (p_output_buffer->tile_height != 1)
         return JPEGERR_EUNSUPPORTED;
 
-    // testing purpose only
-    // This is to simulate that the user needs to bail out when error happens
-    // in the middle of decoding
-    //if (first_row_id == 162)
-     //   return JPEGERR_EFAILED;
-
     // do not enqueue any buffer if it reaches the last buffer
     if (!is_last_buffer)
     {
-        jpegd_enqueue_output_buf(p_thread_arg->decoder, p_output_buffer, 1);
+        jpegd_enqueue_output_buf(session->decoder, p_output_buffer, 1);
     }
     ALOGD("%s: X", __func__);
 
@@ -612,6 +656,10 @@ int decoder_output_handler(void *p_user_data,
 //                                    p_reader->next_byte_offset,
 //                                    MAX_BYTES_TO_FETCH);
 
+/*
+ * Feeds the decoder. Frames without a DHT segment are read as if the
+ * standard tables were in front of their SOS marker
+ */
 uint32_t decoder_input_req_handler(void           *p_user_data,
                                    jpeg_buffer_t   buffer,
                                    uint32_t        start_offset,
@@ -619,29 +667,51 @@ uint32_t decoder_input_req_handler(void           *p_user_data,
 {
     uint32_t buf_size;
     uint8_t *buf_ptr;
-    int bytes_to_read, bytes_read, rc;
-    thread_ctrl_blk_t *p_thread_arg = (thread_ctrl_blk_t *)p_user_data;
-    thread_ctrl_blk_t *thread_ctrl_blk = (thread_ctrl_blk_t *)p_user_data;
-    test_args_t*    mjpegd = (test_args_t*) thread_ctrl_blk->p_args;
+    uint32_t bytes_to_read, bytes_read, chunk;
+    uint32_t dht_start, dht_end;
+    mjpegd_session_t *session = (mjpegd_session_t *)p_user_data;
+    test_args_t*    mjpegd = &session->args;
+    const uint8_t  *frame = (const uint8_t *)mjpegd->inputMjpegBuffer;
 
     ALOGD("%s: E", __func__);
 
     jpeg_buffer_get_max_size(buffer, &buf_size);
     jpeg_buffer_get_addr(buffer, &buf_ptr);
     bytes_to_read = (length < buf_size) ? length : buf_size;
+    if (start_offset >= session->source.total_length)
+        bytes_to_read = 0;
+    else if (bytes_to_read > session->source.total_length - start_offset)
+        bytes_to_read = session->source.total_length - start_offset;
     bytes_read = 0;
 
     ALOGD("%s: buf_ptr = %p, start_offset = %d, length = %d buf_size = %d bytes_to_read = %d", __func__, buf_ptr, start_offset, length, buf_size, bytes_to_read);
-    if (bytes_to_read)
-    {
+
+    if (session->dht_offset < 0) {
         /* TBDJ: Should avoid this Mem copy */
-#if 1
-        memcpy(buf_ptr, (char *)mjpegd->inputMjpegBuffer + start_offset, bytes_to_read);
-#else
-        if(JPEGERR_SUCCESS != jpeg_buffer_set_start_offset(buffer, start_offset))
-            ALOGE("%s: jpeg_buffer_set_start_offset failed", __func__);
-#endif
+        if (bytes_to_read)
+            memcpy(buf_ptr, frame + start_offset, bytes_to_read);
         bytes_read = bytes_to_read;
+    } else {
+        dht_start = session->dht_offset;
+        dht_end   = dht_start + MJPEGD_STD_DHT_SIZE;
+        while (bytes_read < bytes_to_read) {
+            uint32_t pos = start_offset + bytes_read;
+            uint32_t left = bytes_to_read - bytes_read;
+
+            if (pos < dht_start) {
+                chunk = MIN(left, dht_start - pos);
+                memcpy(buf_ptr + bytes_read, frame + pos, chunk);
+            } else if (pos < dht_end) {
+                chunk = MIN(left, dht_end - pos);
+                memcpy(buf_ptr + bytes_read,
+                       session->std_dht + (pos - dht_start), chunk);
+            } else {
+                chunk = left;
+                memcpy(buf_ptr + bytes_read,
+                       frame + pos - MJPEGD_STD_DHT_SIZE, chunk);
+            }
+            bytes_read += chunk;
+        }
     }
 
     ALOGD("%s: X", __func__);
@@ -653,13 +723,13 @@ static int mjpegd_timer_start(timespec *p_timer)
     if (!p_timer)
         return JPEGERR_ENULLPTR;
 
-    if (clock_gettime(CLOCK_REALTIME, p_timer))
+    if (clock_gettime(CLOCK_MONOTONIC, p_timer))
         return JPEGERR_EFAILED;
 
     return JPEGERR_SUCCESS;
 }
 
-static int mjpegd_timer_get_elapsed(timespec *p_timer, int *elapsed_in_ms, uint8_t reset_start)
+static int mjpegd_timer_get_elapsed_us(timespec *p_timer, uint32_t *elapsed_in_us)
 {
     timespec now;
     long diff;
@@ -668,34 +738,9 @@ static int mjpegd_timer_get_elapsed(timespec *p_timer, int *elapsed_in_ms, uint8
     if (JPEG_FAILED(rc))
         return rc;
 
-    diff = (long)(now.tv_sec - p_timer->tv_sec) * 1000;
-    diff += (long)(now.tv_nsec - p_timer->tv_nsec) / 1000000;
-    *elapsed_in_ms = (int)diff;
-
-    if (reset_start)
-        *p_timer = now;
+    diff = (long)(now.tv_sec - p_timer->tv_sec) * 1000000;
+    diff += (long)(now.tv_nsec - p_timer->tv_nsec) / 1000;
+    *elapsed_in_us = (uint32_t)diff;
 
     return JPEGERR_SUCCESS;
 }
-
-int mjpegd_cond_timedwait(pthread_cond_t *p_cond, pthread_mutex_t *p_mutex, uint32_t ms)
-{
-    struct timespec ts;
-    int rc = clock_gettime(CLOCK_REALTIME, &ts);
-    if (rc < 0) return rc;
-
-    if (ms >= 1000) {
-       ts.tv_sec += (ms/1000);
-       ts.tv_nsec += ((ms%1000) * 1000000);
-    } else {
-        ts.tv_nsec += (ms * 1000000);
-    }
-
-    rc = pthread_cond_timedwait(p_cond, p_mutex, &ts);
-    if (rc == ETIMEDOUT)
-    {
-        rc = JPEGERR_ETIMEDOUT;
-    }
-    return rc;
-}
-
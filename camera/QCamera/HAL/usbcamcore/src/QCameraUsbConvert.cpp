@@ -0,0 +1,769 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//#define ALOG_NDEBUG 0
+#define LOG_TAG "QCameraUsbConvert"
+
+#include <utils/Log.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+
+#include "QCameraUsbConvert.h"
+
+#if defined(__aarch64__) || defined(__ARM_NEON__)
+#define USBCAM_CONVERT_NEON 1
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+#endif
+#elif defined(__SSE2__)
+#define USBCAM_CONVERT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/******************************************************************************
+ * Frame description shared by the kernels. A unit is one chroma line: two
+ * source lines, or four when downscaling, and two luma lines.
+ *****************************************************************************/
+typedef struct {
+    const uint8_t*              src;
+    int                         srcStride;
+    int                         scale;
+    int                         units;
+    /* chroma samples per line, half of the output width */
+    int                         samples;
+    uint8_t*                    y;
+    int                         yStride;
+    uint8_t*                    c;
+    uint8_t*                    c2;
+    int                         cStride;
+    usbcam_convert_dst_fmt_t    fmt;
+    usbcam_convert_src_fmt_t    srcFmt;
+} convert_frame_t;
+
+typedef void (*convert_unit_fn)(const convert_frame_t *f, int unit,
+                                int x0, int x1);
+
+typedef struct {
+    /* one frame at a time per converter */
+    pthread_mutex_t             frameLock;
+    pthread_mutex_t             lock;
+    pthread_cond_t              startCond;
+    pthread_cond_t              doneCond;
+    pthread_t                   threads[USBCAM_CONVERT_MAX_THREADS - 1];
+    int                         numWorkers;
+    unsigned int                generation;
+    int                         pending;
+    int                         bands;
+    int                         exit;
+    const convert_frame_t*      frame;
+    convert_unit_fn             fn;
+} usbcam_convert_t;
+
+typedef struct {
+    usbcam_convert_t*           conv;
+    int                         index;
+} convert_worker_arg_t;
+
+static volatile int gConvertImpl = USBCAM_CONVERT_IMPL_AUTO;
+
+/******************************************************************************
+ * Function: storeChroma
+ * Description: Writes one Cb/Cr sample pair in the output layout
+ *
+ * Input parameters:
+ *   f                  - frame description
+ *   c, c2              - chroma lines of the unit
+ *   i                  - sample index in the line
+ *   u, v               - Cb and Cr
+ *
+ * Return values:   none
+ *****************************************************************************/
+static inline void storeChroma(const convert_frame_t *f, uint8_t *c,
+                               uint8_t *c2, int i, uint8_t u, uint8_t v)
+{
+    switch(f->fmt) {
+    case USBCAM_CONVERT_DST_NV12:
+        c[2 * i]        = u;
+        c[2 * i + 1]    = v;
+        break;
+    case USBCAM_CONVERT_DST_NV21:
+        c[2 * i]        = v;
+        c[2 * i + 1]    = u;
+        break;
+    case USBCAM_CONVERT_DST_YV12:
+        c[i]            = v;
+        c2[i]           = u;
+        break;
+    }
+}
+
+/******************************************************************************
+ * Function: convertUnitScalar
+ * Description: Reference conversion of chroma samples [x0, x1) of a unit.
+ *              Also converts the tails the SIMD kernels leave.
+ *
+ * Input parameters:
+ *   f                  - frame description
+ *   unit               - chroma line
+ *   x0, x1             - range of chroma samples
+ *
+ * Return values:   none
+ *****************************************************************************/
+static void convertUnitScalar(const convert_frame_t *f, int unit,
+                              int x0, int x1)
+{
+    const int       yo = (USBCAM_CONVERT_SRC_UYVY == f->srcFmt) ? 1 : 0;
+    const int       uo = (USBCAM_CONVERT_SRC_UYVY == f->srcFmt) ? 0 : 1;
+    const int       vo = uo + 2;
+    const uint8_t   *s0 = f->src + (size_t)unit * 2 * f->scale * f->srcStride;
+    uint8_t         *y0 = f->y + (size_t)unit * 2 * f->yStride;
+    uint8_t         *y1 = y0 + f->yStride;
+    uint8_t         *c  = f->c + (size_t)unit * f->cStride;
+    uint8_t         *c2 = f->c2 ? f->c2 + (size_t)unit * f->cStride : NULL;
+    int             i;
+
+    if(1 == f->scale) {
+        const uint8_t *s1 = s0 + f->srcStride;
+
+        for(i = x0; i < x1; i++) {
+            const uint8_t *p0 = s0 + 4 * i;
+            const uint8_t *p1 = s1 + 4 * i;
+
+            y0[2 * i]       = p0[yo];
+            y0[2 * i + 1]   = p0[yo + 2];
+            y1[2 * i]       = p1[yo];
+            y1[2 * i + 1]   = p1[yo + 2];
+            storeChroma(f, c, c2, i, p0[uo], p0[vo]);
+        }
+    } else {
+        const uint8_t *s1 = s0 + f->srcStride;
+        const uint8_t *s2 = s1 + f->srcStride;
+        const uint8_t *s3 = s2 + f->srcStride;
+
+        for(i = x0; i < x1; i++) {
+            const uint8_t *p0 = s0 + 8 * i;
+            const uint8_t *p1 = s1 + 8 * i;
+            const uint8_t *p2 = s2 + 8 * i;
+            const uint8_t *p3 = s3 + 8 * i;
+
+            y0[2 * i]     = (p0[yo] + p0[yo + 2] + p1[yo] + p1[yo + 2] + 2) >> 2;
+            y0[2 * i + 1] = (p0[yo + 4] + p0[yo + 6] +
+                             p1[yo + 4] + p1[yo + 6] + 2) >> 2;
+            y1[2 * i]     = (p2[yo] + p2[yo + 2] + p3[yo] + p3[yo + 2] + 2) >> 2;
+            y1[2 * i + 1] = (p2[yo + 4] + p2[yo + 6] +
+                             p3[yo + 4] + p3[yo + 6] + 2) >> 2;
+            storeChroma(f, c, c2, i,
+                        (p0[uo] + p0[uo + 4] + 1) >> 1,
+                        (p0[vo] + p0[vo + 4] + 1) >> 1);
+        }
+    }
+}
+
+static void convertUnitRef(const convert_frame_t *f, int unit)
+{
+    convertUnitScalar(f, unit, 0, f->samples);
+}
+
+#if USBCAM_CONVERT_NEON
+/* Eight chroma pairs, in the output layout */
+static inline void storeChroma8(const convert_frame_t *f, uint8_t *c,
+                                uint8_t *c2, int i, uint8x8_t u, uint8x8_t v)
+{
+    uint8x8x2_t uv;
+
+    switch(f->fmt) {
+    case USBCAM_CONVERT_DST_NV12:
+        uv.val[0] = u;
+        uv.val[1] = v;
+        vst2_u8(c + 2 * i, uv);
+        break;
+    case USBCAM_CONVERT_DST_NV21:
+        uv.val[0] = v;
+        uv.val[1] = u;
+        vst2_u8(c + 2 * i, uv);
+        break;
+    case USBCAM_CONVERT_DST_YV12:
+        vst1_u8(c + i, v);
+        vst1_u8(c2 + i, u);
+        break;
+    }
+}
+
+/* vld4 splits 8 macro pixels in Y0, U, Y1, V (YUYV) or U, Y0, V, Y1 */
+template <bool UYVY>
+static void convertUnitSimd(const convert_frame_t *f, int unit, int x0, int x1)
+{
+    const int       iy0 = UYVY ? 1 : 0;
+    const int       iy1 = iy0 + 2;
+    const int       iu  = UYVY ? 0 : 1;
+    const int       iv  = iu + 2;
+    const uint8_t   *s0 = f->src + (size_t)unit * 2 * f->scale * f->srcStride;
+    uint8_t         *y0 = f->y + (size_t)unit * 2 * f->yStride;
+    uint8_t         *y1 = y0 + f->yStride;
+    uint8_t         *c  = f->c + (size_t)unit * f->cStride;
+    uint8_t         *c2 = f->c2 ? f->c2 + (size_t)unit * f->cStride : NULL;
+    int             i = x0;
+
+    if(1 == f->scale) {
+        const uint8_t *s1 = s0 + f->srcStride;
+
+        for(; i + 8 <= x1; i += 8) {
+            uint8x8x4_t a = vld4_u8(s0 + 4 * i);
+            uint8x8x4_t b = vld4_u8(s1 + 4 * i);
+            uint8x8x2_t ya, yb;
+
+            ya.val[0] = a.val[iy0];
+            ya.val[1] = a.val[iy1];
+            yb.val[0] = b.val[iy0];
+            yb.val[1] = b.val[iy1];
+            vst2_u8(y0 + 2 * i, ya);
+            vst2_u8(y1 + 2 * i, yb);
+            storeChroma8(f, c, c2, i, a.val[iu], a.val[iv]);
+        }
+    } else {
+        const uint8_t *s1 = s0 + f->srcStride;
+        const uint8_t *s2 = s1 + f->srcStride;
+        const uint8_t *s3 = s2 + f->srcStride;
+
+        for(; i + 8 <= x1; i += 8) {
+            uint8x8x4_t a0 = vld4_u8(s0 + 8 * i);
+            uint8x8x4_t a1 = vld4_u8(s0 + 8 * i + 32);
+            uint8x8x4_t b0 = vld4_u8(s1 + 8 * i);
+            uint8x8x4_t b1 = vld4_u8(s1 + 8 * i + 32);
+            uint8x8x4_t d0 = vld4_u8(s2 + 8 * i);
+            uint8x8x4_t d1 = vld4_u8(s2 + 8 * i + 32);
+            uint8x8x4_t e0 = vld4_u8(s3 + 8 * i);
+            uint8x8x4_t e1 = vld4_u8(s3 + 8 * i + 32);
+            uint16x8_t  t0, t1;
+
+            /* one output pixel per macro pixel of two lines */
+            t0 = vaddq_u16(vaddl_u8(a0.val[iy0], a0.val[iy1]),
+                           vaddl_u8(b0.val[iy0], b0.val[iy1]));
+            t1 = vaddq_u16(vaddl_u8(a1.val[iy0], a1.val[iy1]),
+                           vaddl_u8(b1.val[iy0], b1.val[iy1]));
+            vst1q_u8(y0 + 2 * i,
+                     vcombine_u8(vrshrn_n_u16(t0, 2), vrshrn_n_u16(t1, 2)));
+            t0 = vaddq_u16(vaddl_u8(d0.val[iy0], d0.val[iy1]),
+                           vaddl_u8(e0.val[iy0], e0.val[iy1]));
+            t1 = vaddq_u16(vaddl_u8(d1.val[iy0], d1.val[iy1]),
+                           vaddl_u8(e1.val[iy0], e1.val[iy1]));
+            vst1q_u8(y1 + 2 * i,
+                     vcombine_u8(vrshrn_n_u16(t0, 2), vrshrn_n_u16(t1, 2)));
+
+            /* chroma of neighbouring macro pixels of the first line */
+            storeChroma8(f, c, c2, i,
+                vrshrn_n_u16(vpaddlq_u8(vcombine_u8(a0.val[iu], a1.val[iu])), 1),
+                vrshrn_n_u16(vpaddlq_u8(vcombine_u8(a0.val[iv], a1.val[iv])), 1));
+        }
+    }
+    convertUnitScalar(f, unit, i, x1);
+}
+
+static int simdSupported(void)
+{
+#if defined(__aarch64__)
+    return 1;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) ? 1 : 0;
+#endif
+}
+
+static const char *simdName(void)
+{
+    return "neon";
+}
+#elif USBCAM_CONVERT_SSE2
+/* Eight chroma pairs, interleaved as Cb Cr in uv */
+static inline void storeChroma8(const convert_frame_t *f, uint8_t *c,
+                                uint8_t *c2, int i, __m128i uv)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+
+    switch(f->fmt) {
+    case USBCAM_CONVERT_DST_NV12:
+        _mm_storeu_si128((__m128i *)(c + 2 * i), uv);
+        break;
+    case USBCAM_CONVERT_DST_NV21:
+        _mm_storeu_si128((__m128i *)(c + 2 * i),
+                         _mm_or_si128(_mm_slli_epi16(uv, 8),
+                                      _mm_srli_epi16(uv, 8)));
+        break;
+    case USBCAM_CONVERT_DST_YV12:
+        _mm_storel_epi64((__m128i *)(c + i),
+                         _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+        _mm_storel_epi64((__m128i *)(c2 + i),
+                         _mm_packus_epi16(_mm_and_si128(uv, mask), zero));
+        break;
+    }
+}
+
+/* Luma of 4 macro pixels in the low byte of each 16 bit lane */
+template <bool UYVY>
+static inline __m128i lumaLanes(__m128i p)
+{
+    return UYVY ? _mm_srli_epi16(p, 8) : _mm_and_si128(p, _mm_set1_epi16(0x00FF));
+}
+
+template <bool UYVY>
+static inline __m128i chromaLanes(__m128i p)
+{
+    return UYVY ? _mm_and_si128(p, _mm_set1_epi16(0x00FF)) : _mm_srli_epi16(p, 8);
+}
+
+/* Sums of neighbouring bytes of 16 luma samples, as 16 bit lanes */
+static inline __m128i pairSum(__m128i y)
+{
+    return _mm_add_epi16(_mm_and_si128(y, _mm_set1_epi16(0x00FF)),
+                         _mm_srli_epi16(y, 8));
+}
+
+/* Rounded means of neighbouring Cb Cr pairs, packed in the low 8 bytes */
+static inline __m128i pairMeanUV(__m128i uv)
+{
+    __m128i m = _mm_avg_epu8(uv, _mm_srli_si128(uv, 2));
+
+    m = _mm_shufflelo_epi16(m, _MM_SHUFFLE(3, 1, 2, 0));
+    m = _mm_shufflehi_epi16(m, _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_shuffle_epi32(m, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+template <bool UYVY>
+static void convertUnitSimd(const convert_frame_t *f, int unit, int x0, int x1)
+{
+    const uint8_t   *s0 = f->src + (size_t)unit * 2 * f->scale * f->srcStride;
+    uint8_t         *y0 = f->y + (size_t)unit * 2 * f->yStride;
+    uint8_t         *y1 = y0 + f->yStride;
+    uint8_t         *c  = f->c + (size_t)unit * f->cStride;
+    uint8_t         *c2 = f->c2 ? f->c2 + (size_t)unit * f->cStride : NULL;
+    const __m128i   two = _mm_set1_epi16(2);
+    int             i = x0;
+
+    if(1 == f->scale) {
+        const uint8_t *s1 = s0 + f->srcStride;
+
+        for(; i + 8 <= x1; i += 8) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(s0 + 4 * i));
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(s0 + 4 * i + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(s1 + 4 * i));
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(s1 + 4 * i + 16));
+
+            _mm_storeu_si128((__m128i *)(y0 + 2 * i),
+                _mm_packus_epi16(lumaLanes<UYVY>(a0), lumaLanes<UYVY>(a1)));
+            _mm_storeu_si128((__m128i *)(y1 + 2 * i),
+                _mm_packus_epi16(lumaLanes<UYVY>(b0), lumaLanes<UYVY>(b1)));
+            storeChroma8(f, c, c2, i,
+                _mm_packus_epi16(chromaLanes<UYVY>(a0), chromaLanes<UYVY>(a1)));
+        }
+    } else {
+        const uint8_t *s[4];
+        __m128i       p[4][4];
+        __m128i       lo[4], hi[4];
+        int           r, k;
+
+        s[0] = s0;
+        for(r = 1; r < 4; r++)
+            s[r] = s[r - 1] + f->srcStride;
+
+        for(; i + 8 <= x1; i += 8) {
+            for(r = 0; r < 4; r++) {
+                for(k = 0; k < 4; k++)
+                    p[r][k] = _mm_loadu_si128(
+                                (const __m128i *)(s[r] + 8 * i + 16 * k));
+                lo[r] = pairSum(_mm_packus_epi16(lumaLanes<UYVY>(p[r][0]),
+                                                 lumaLanes<UYVY>(p[r][1])));
+                hi[r] = pairSum(_mm_packus_epi16(lumaLanes<UYVY>(p[r][2]),
+                                                 lumaLanes<UYVY>(p[r][3])));
+            }
+            _mm_storeu_si128((__m128i *)(y0 + 2 * i), _mm_packus_epi16(
+                _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo[0], lo[1]), two), 2),
+                _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi[0], hi[1]), two), 2)));
+            _mm_storeu_si128((__m128i *)(y1 + 2 * i), _mm_packus_epi16(
+                _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo[2], lo[3]), two), 2),
+                _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi[2], hi[3]), two), 2)));
+            storeChroma8(f, c, c2, i, _mm_unpacklo_epi64(
+                pairMeanUV(_mm_packus_epi16(chromaLanes<UYVY>(p[0][0]),
+                                            chromaLanes<UYVY>(p[0][1]))),
+                pairMeanUV(_mm_packus_epi16(chromaLanes<UYVY>(p[0][2]),
+                                            chromaLanes<UYVY>(p[0][3])))));
+        }
+    }
+    convertUnitScalar(f, unit, i, x1);
+}
+
+static int simdSupported(void)
+{
+    /* SSE2 is part of the x86_64 baseline and was asked for otherwise */
+    return 1;
+}
+
+static const char *simdName(void)
+{
+    return "sse2";
+}
+#else
+static int simdSupported(void)
+{
+    return 0;
+}
+
+static const char *simdName(void)
+{
+    return "none";
+}
+#endif
+
+/******************************************************************************
+ * Function: resolveImpl
+ * Description: Returns the kernel selected for the next frames
+ *
+ * Input parameters:   none
+ *
+ * Return values:
+ *   USBCAM_CONVERT_IMPL_SCALAR or USBCAM_CONVERT_IMPL_SIMD
+ *****************************************************************************/
+static usbcam_convert_impl_t resolveImpl(void)
+{
+    int impl = gConvertImpl;
+
+    if(USBCAM_CONVERT_IMPL_AUTO == impl) {
+        impl = simdSupported() ? USBCAM_CONVERT_IMPL_SIMD :
+                                 USBCAM_CONVERT_IMPL_SCALAR;
+        gConvertImpl = impl;
+    }
+    return (usbcam_convert_impl_t)impl;
+}
+
+static convert_unit_fn selectKernel(usbcam_convert_src_fmt_t srcFmt)
+{
+#if USBCAM_CONVERT_NEON || USBCAM_CONVERT_SSE2
+    if(USBCAM_CONVERT_IMPL_SIMD == resolveImpl())
+        return (USBCAM_CONVERT_SRC_UYVY == srcFmt) ?
+            convertUnitSimd<true> : convertUnitSimd<false>;
+#endif
+    return convertUnitScalar;
+}
+
+/******************************************************************************
+ * Function: setupFrame
+ * Description: Validates the parameters and fills in the defaults
+ *
+ * Input parameters:
+ *   params             - conversion parameters
+ *   f                  - frame description to fill
+ *
+ * Return values:
+ *   USBCAM_CONVERT_NO_ERROR    Success
+ *   USBCAM_CONVERT_ERROR       Invalid parameters
+ *****************************************************************************/
+static USBCAM_CONVERT_ERR setupFrame(const usbcam_convert_params_t *params,
+                                     convert_frame_t *f)
+{
+    int outWidth, outHeight;
+
+    if(!params || !params->src || !params->dstY) {
+        ALOGE("%s: Invalid buffers", __func__);
+        return USBCAM_CONVERT_ERROR;
+    }
+    if(params->downscale != 1 && params->downscale != 2) {
+        ALOGE("%s: Unsupported downscale %d", __func__, params->downscale);
+        return USBCAM_CONVERT_ERROR;
+    }
+    if(params->width <= 0 || params->height <= 0 ||
+       params->width % (2 * params->downscale) ||
+       params->height % (2 * params->downscale)) {
+        ALOGE("%s: Unsupported size %dx%d", __func__,
+              params->width, params->height);
+        return USBCAM_CONVERT_ERROR;
+    }
+    if(params->srcStride && params->srcStride < params->width * 2) {
+        ALOGE("%s: Invalid source stride %d", __func__, params->srcStride);
+        return USBCAM_CONVERT_ERROR;
+    }
+
+    outWidth    = params->width / params->downscale;
+    outHeight   = params->height / params->downscale;
+
+    f->src      = params->src;
+    f->srcStride = params->srcStride ? params->srcStride : params->width * 2;
+    f->srcFmt   = params->srcFmt;
+    f->scale    = params->downscale;
+    f->units    = outHeight / 2;
+    f->samples  = outWidth / 2;
+    f->fmt      = params->dstFmt;
+    f->y        = params->dstY;
+    f->yStride  = params->dstYStride ? params->dstYStride : outWidth;
+    if(params->dstCStride)
+        f->cStride = params->dstCStride;
+    else
+        f->cStride = (USBCAM_CONVERT_DST_YV12 == f->fmt) ?
+                      outWidth / 2 : outWidth;
+    f->c        = params->dstC ? params->dstC :
+                  f->y + (size_t)f->yStride * outHeight;
+    f->c2       = NULL;
+    if(USBCAM_CONVERT_DST_YV12 == f->fmt)
+        f->c2   = params->dstC2 ? params->dstC2 :
+                  f->c + (size_t)f->cStride * f->units;
+
+    return USBCAM_CONVERT_NO_ERROR;
+}
+
+static void convertBand(usbcam_convert_t *conv, int band)
+{
+    const convert_frame_t *f = conv->frame;
+    int first = (int)((long long)f->units * band / conv->bands);
+    int last  = (int)((long long)f->units * (band + 1) / conv->bands);
+    int unit;
+
+    for(unit = first; unit < last; unit++)
+        conv->fn(f, unit, 0, f->samples);
+}
+
+static void *convertWorker(void *data)
+{
+    convert_worker_arg_t    *arg = (convert_worker_arg_t *)data;
+    usbcam_convert_t        *conv = arg->conv;
+    int                     index = arg->index;
+    unsigned int            seen = 0;
+
+    free(arg);
+    prctl(PR_SET_NAME, (unsigned long)"CAM_usbconv", 0, 0, 0);
+
+    pthread_mutex_lock(&conv->lock);
+    while(1) {
+        while(!conv->exit && seen == conv->generation)
+            pthread_cond_wait(&conv->startCond, &conv->lock);
+        if(conv->exit)
+            break;
+        seen = conv->generation;
+        if(index >= conv->bands)
+            continue;
+
+        pthread_mutex_unlock(&conv->lock);
+        convertBand(conv, index);
+        pthread_mutex_lock(&conv->lock);
+
+        if(0 == --conv->pending)
+            pthread_cond_signal(&conv->doneCond);
+    }
+    pthread_mutex_unlock(&conv->lock);
+    return NULL;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertInit
+ * Description: Creates a converter and its worker threads
+ *
+ * Input parameters:
+ *   conv               - returns the converter handle
+ *   numThreads         - threads per frame including the caller, 0 for the
+ *                        number of online CPUs
+ *
+ * Return values:
+ *   USBCAM_CONVERT_NO_ERROR            Success
+ *   USBCAM_CONVERT_INSUFFICIENT_MEM    No memory
+ *****************************************************************************/
+USBCAM_CONVERT_ERR usbCamConvertInit(void** conv, int numThreads)
+{
+    usbcam_convert_t        *ctx;
+    convert_worker_arg_t    *arg;
+    int                     i;
+
+    if(!conv)
+        return USBCAM_CONVERT_ERROR;
+    *conv = NULL;
+
+    ctx = (usbcam_convert_t *)calloc(1, sizeof(*ctx));
+    if(!ctx) {
+        ALOGE("%s: No memory", __func__);
+        return USBCAM_CONVERT_INSUFFICIENT_MEM;
+    }
+    pthread_mutex_init(&ctx->frameLock, NULL);
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->startCond, NULL);
+    pthread_cond_init(&ctx->doneCond, NULL);
+
+    if(numThreads <= 0)
+        numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(numThreads > USBCAM_CONVERT_MAX_THREADS)
+        numThreads = USBCAM_CONVERT_MAX_THREADS;
+
+    for(i = 0; i < numThreads - 1; i++) {
+        arg = (convert_worker_arg_t *)malloc(sizeof(*arg));
+        if(!arg)
+            break;
+        arg->conv   = ctx;
+        arg->index  = i + 1;
+        if(pthread_create(&ctx->threads[i], NULL, convertWorker, arg)) {
+            ALOGE("%s: Cannot create worker %d", __func__, i);
+            free(arg);
+            break;
+        }
+        ctx->numWorkers++;
+    }
+
+    ALOGD("%s: %d threads, %s kernel", __func__, ctx->numWorkers + 1,
+          usbCamConvertImplName());
+    *conv = ctx;
+    return USBCAM_CONVERT_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertDestroy
+ * Description: Stops the worker threads and frees the converter
+ *
+ * Input parameters:
+ *   conv               - converter handle
+ *
+ * Return values:
+ *   USBCAM_CONVERT_NO_ERROR    Success
+ *****************************************************************************/
+USBCAM_CONVERT_ERR usbCamConvertDestroy(void* conv)
+{
+    usbcam_convert_t *ctx = (usbcam_convert_t *)conv;
+    int i;
+
+    if(!ctx)
+        return USBCAM_CONVERT_NO_ERROR;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->exit = 1;
+    pthread_cond_broadcast(&ctx->startCond);
+    pthread_mutex_unlock(&ctx->lock);
+    for(i = 0; i < ctx->numWorkers; i++)
+        pthread_join(ctx->threads[i], NULL);
+
+    pthread_cond_destroy(&ctx->doneCond);
+    pthread_cond_destroy(&ctx->startCond);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_mutex_destroy(&ctx->frameLock);
+    free(ctx);
+    return USBCAM_CONVERT_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: usbCamConvertFrame
+ * Description: Converts a frame with the selected kernel. Large frames are
+ *              split in bands of lines converted by the worker threads and
+ *              the caller.
+ *
+ * Input parameters:
+ *   conv               - converter handle, NULL to convert on the caller
+ *   params             - conversion parameters
+ *
+ * Return values:
+ *   USBCAM_CONVERT_NO_ERROR    Success
+ *   USBCAM_CONVERT_ERROR       Invalid parameters
+ *****************************************************************************/
+USBCAM_CONVERT_ERR usbCamConvertFrame(
+            void*                           conv,
+            const usbcam_convert_params_t*  params)
+{
+    usbcam_convert_t    *ctx = (usbcam_convert_t *)conv;
+    convert_frame_t     f;
+    convert_unit_fn     fn;
+    int                 bands = 1;
+    int                 unit;
+
+    if(setupFrame(params, &f))
+        return USBCAM_CONVERT_ERROR;
+    fn = selectKernel(f.srcFmt);
+
+    if(ctx && ctx->numWorkers &&
+       params->width * params->height >= USBCAM_CONVERT_MT_MIN_PIXELS) {
+        bands = ctx->numWorkers + 1;
+        if(bands > f.units)
+            bands = f.units;
+    }
+    if(bands <= 1) {
+        for(unit = 0; unit < f.units; unit++)
+            fn(&f, unit, 0, f.samples);
+        return USBCAM_CONVERT_NO_ERROR;
+    }
+
+    pthread_mutex_lock(&ctx->frameLock);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->frame      = &f;
+    ctx->fn         = fn;
+    ctx->bands      = bands;
+    ctx->pending    = bands - 1;
+    ctx->generation++;
+    pthread_cond_broadcast(&ctx->startCond);
+    pthread_mutex_unlock(&ctx->lock);
+
+    convertBand(ctx, 0);
+
+    pthread_mutex_lock(&ctx->lock);
+    while(ctx->pending)
+        pthread_cond_wait(&ctx->doneCond, &ctx->lock);
+    ctx->frame = NULL;
+    pthread_mutex_unlock(&ctx->lock);
+    pthread_mutex_unlock(&ctx->frameLock);
+
+    return USBCAM_CONVERT_NO_ERROR;
+}
+
+USBCAM_CONVERT_ERR usbCamConvertFrameRef(
+            const usbcam_convert_params_t*  params)
+{
+    convert_frame_t f;
+    int             unit;
+
+    if(setupFrame(params, &f))
+        return USBCAM_CONVERT_ERROR;
+    for(unit = 0; unit < f.units; unit++)
+        convertUnitRef(&f, unit);
+    return USBCAM_CONVERT_NO_ERROR;
+}
+
+USBCAM_CONVERT_ERR usbCamConvertSetImpl(usbcam_convert_impl_t impl)
+{
+    if(USBCAM_CONVERT_IMPL_SIMD == impl && !simdSupported()) {
+        ALOGE("%s: No %s support", __func__, simdName());
+        return USBCAM_CONVERT_ERROR;
+    }
+    gConvertImpl = impl;
+    return USBCAM_CONVERT_NO_ERROR;
+}
+
+usbcam_convert_impl_t usbCamConvertGetImpl(void)
+{
+    return resolveImpl();
+}
+
+const char* usbCamConvertImplName(void)
+{
+    return (USBCAM_CONVERT_IMPL_SIMD == resolveImpl()) ? simdName() : "scalar";
+}
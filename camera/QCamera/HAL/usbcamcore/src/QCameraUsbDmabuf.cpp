@@ -0,0 +1,292 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//#define ALOG_NDEBUG 0
+#define LOG_TAG "QCameraUsbDmabuf"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include "QCameraUsbDmabuf.h"
+
+typedef struct {
+    int                 dmabufFd;
+    int                 cookie;
+    int                 queued;
+} usbcam_dmabuf_buf_t;
+
+typedef struct {
+    int                 v4l2Fd;
+    int                 numBufs;
+    int                 queued;
+    usbcam_dmabuf_buf_t bufs[USBCAM_DMABUF_MAX_BUFS];
+} usbcam_dmabuf_q_t;
+
+static int dmabufIoctl(int fd, int cmd, void *arg)
+{
+    int rc;
+
+    do {
+        rc = ioctl(fd, cmd, arg);
+    } while(-1 == rc && EINTR == errno);
+    return rc;
+}
+
+static int dmabufReqBufs(int v4l2Fd, int count)
+{
+    struct v4l2_requestbuffers reqBufs;
+
+    memset(&reqBufs, 0, sizeof(reqBufs));
+    reqBufs.type    = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    reqBufs.memory  = V4L2_MEMORY_DMABUF;
+    reqBufs.count   = count;
+    if(-1 == dmabufIoctl(v4l2Fd, VIDIOC_REQBUFS, &reqBufs)) {
+        ALOGE("%s: VIDIOC_REQBUFS(%d) failed: %d", __func__, count, errno);
+        return -1;
+    }
+    return reqBufs.count;
+}
+
+/******************************************************************************
+ * Function: usbCamDmabufInit
+ * Description: Requests DMABUF buffers from the driver and creates the queue
+ *
+ * Input parameters:
+ *   queue              - returns the queue handle
+ *   v4l2Fd             - fd of the V4L2 capture device
+ *   numBufs            - buffers to request
+ *
+ * Return values:
+ *   USBCAM_DMABUF_NO_ERROR         Success
+ *   USBCAM_DMABUF_ERROR            Driver does not import DMABUF
+ *   USBCAM_DMABUF_INSUFFICIENT_MEM No memory for the queue
+ *****************************************************************************/
+USBCAM_DMABUF_ERR usbCamDmabufInit(void** queue, int v4l2Fd, int numBufs)
+{
+    usbcam_dmabuf_q_t   *q;
+    int                 count, i;
+
+    if(!queue || numBufs <= 0)
+        return USBCAM_DMABUF_ERROR;
+    if(numBufs > USBCAM_DMABUF_MAX_BUFS)
+        numBufs = USBCAM_DMABUF_MAX_BUFS;
+
+    count = dmabufReqBufs(v4l2Fd, numBufs);
+    if(count <= 0)
+        return USBCAM_DMABUF_ERROR;
+    if(count > USBCAM_DMABUF_MAX_BUFS)
+        count = USBCAM_DMABUF_MAX_BUFS;
+
+    q = (usbcam_dmabuf_q_t *)calloc(1, sizeof(usbcam_dmabuf_q_t));
+    if(!q) {
+        dmabufReqBufs(v4l2Fd, 0);
+        return USBCAM_DMABUF_INSUFFICIENT_MEM;
+    }
+    q->v4l2Fd   = v4l2Fd;
+    q->numBufs  = count;
+    for(i = 0; i < count; i++)
+        q->bufs[i].dmabufFd = -1;
+
+    ALOGI("%s: %d DMABUF buffers", __func__, count);
+    *queue = q;
+    return USBCAM_DMABUF_NO_ERROR;
+}
+
+USBCAM_DMABUF_ERR usbCamDmabufDestroy(void* queue)
+{
+    usbcam_dmabuf_q_t *q = (usbcam_dmabuf_q_t *)queue;
+
+    if(!q)
+        return USBCAM_DMABUF_NO_ERROR;
+
+    if(q->queued)
+        ALOGE("%s: %d buffers still queued", __func__, q->queued);
+    dmabufReqBufs(q->v4l2Fd, 0);
+    free(q);
+    return USBCAM_DMABUF_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: usbCamDmabufQueue
+ * Description: Queues a DMABUF buffer to the driver. The V4L2 index the fd
+ *              was queued on last time is taken when it is free: the driver
+ *              keeps the attachment of an index as long as the same fd
+ *              comes back to it, and re-importing the buffer is skipped.
+ *
+ * Input parameters:
+ *   queue              - queue handle
+ *   dmabufFd           - fd of the buffer
+ *   length             - size of the buffer in bytes
+ *   cookie             - returned by usbCamDmabufDequeue for this buffer
+ *
+ * Return values:
+ *   USBCAM_DMABUF_NO_ERROR     Success
+ *   USBCAM_DMABUF_ERROR        No free index or VIDIOC_QBUF failed
+ *****************************************************************************/
+USBCAM_DMABUF_ERR usbCamDmabufQueue(void* queue, int dmabufFd,
+                                    uint32_t length, int cookie)
+{
+    usbcam_dmabuf_q_t   *q = (usbcam_dmabuf_q_t *)queue;
+    struct v4l2_buffer  buf;
+    int                 i, index = -1;
+
+    for(i = 0; i < q->numBufs; i++) {
+        if(q->bufs[i].queued)
+            continue;
+        if(q->bufs[i].dmabufFd == dmabufFd) {
+            index = i;
+            break;
+        }
+        /* prefer an index no other buffer is attached to yet */
+        if(index < 0 || q->bufs[i].dmabufFd < 0)
+            index = i;
+    }
+    if(index < 0) {
+        ALOGE("%s: no free buffer index", __func__);
+        return USBCAM_DMABUF_ERROR;
+    }
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory      = V4L2_MEMORY_DMABUF;
+    buf.index       = index;
+    buf.m.fd        = dmabufFd;
+    buf.length      = length;
+    if(-1 == dmabufIoctl(q->v4l2Fd, VIDIOC_QBUF, &buf)) {
+        ALOGE("%s: VIDIOC_QBUF of fd %d failed: %d", __func__, dmabufFd, errno);
+        return USBCAM_DMABUF_ERROR;
+    }
+
+    q->bufs[index].dmabufFd = dmabufFd;
+    q->bufs[index].cookie   = cookie;
+    q->bufs[index].queued   = 1;
+    q->queued++;
+    return USBCAM_DMABUF_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: usbCamDmabufDequeue
+ * Description: Dequeues a filled buffer from the driver
+ *
+ * Input parameters:
+ *   queue              - queue handle
+ *   cookie             - returns the cookie the buffer was queued with
+ *   bytesused          - returns the bytes of the frame
+ *
+ * Return values:
+ *   USBCAM_DMABUF_NO_ERROR     Success
+ *   USBCAM_DMABUF_AGAIN        No buffer filled yet
+ *   USBCAM_DMABUF_ERROR        VIDIOC_DQBUF failed
+ *****************************************************************************/
+USBCAM_DMABUF_ERR usbCamDmabufDequeue(void* queue, int *cookie,
+                                      uint32_t *bytesused)
+{
+    usbcam_dmabuf_q_t   *q = (usbcam_dmabuf_q_t *)queue;
+    struct v4l2_buffer  buf;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory      = V4L2_MEMORY_DMABUF;
+    if(-1 == dmabufIoctl(q->v4l2Fd, VIDIOC_DQBUF, &buf)) {
+        if(EAGAIN == errno)
+            return USBCAM_DMABUF_AGAIN;
+        ALOGE("%s: VIDIOC_DQBUF failed: %d", __func__, errno);
+        return USBCAM_DMABUF_ERROR;
+    }
+    if(buf.index >= (uint32_t)q->numBufs || !q->bufs[buf.index].queued) {
+        ALOGE("%s: unexpected buffer index %d", __func__, buf.index);
+        return USBCAM_DMABUF_ERROR;
+    }
+
+    q->bufs[buf.index].queued = 0;
+    q->queued--;
+    *cookie     = q->bufs[buf.index].cookie;
+    *bytesused  = buf.bytesused;
+    return USBCAM_DMABUF_NO_ERROR;
+}
+
+int usbCamDmabufQueued(void* queue)
+{
+    usbcam_dmabuf_q_t *q = (usbcam_dmabuf_q_t *)queue;
+
+    return q ? q->queued : 0;
+}
+
+void usbCamDmabufFlush(void* queue, void (*release)(void *ctx, int cookie),
+                       void *ctx)
+{
+    usbcam_dmabuf_q_t   *q = (usbcam_dmabuf_q_t *)queue;
+    int                 i;
+
+    if(!q)
+        return;
+
+    for(i = 0; i < q->numBufs; i++) {
+        if(!q->bufs[i].queued)
+            continue;
+        q->bufs[i].queued = 0;
+        q->queued--;
+        if(release)
+            release(ctx, q->bufs[i].cookie);
+    }
+}
+
+/******************************************************************************
+ * Function: usbCamV4l2ExportBuf
+ * Description: Exports a MMAP buffer of the driver as DMABUF, so that its
+ *              contents can be handed out without a copy
+ *
+ * Input parameters:
+ *   v4l2Fd             - fd of the V4L2 capture device
+ *   index              - index of the MMAP buffer
+ *   dmabufFd           - returns the exported fd
+ *
+ * Return values:
+ *   USBCAM_DMABUF_NO_ERROR     Success
+ *   USBCAM_DMABUF_ERROR        Driver cannot export
+ *****************************************************************************/
+USBCAM_DMABUF_ERR usbCamV4l2ExportBuf(int v4l2Fd, int index, int *dmabufFd)
+{
+    struct v4l2_exportbuffer expBuf;
+
+    memset(&expBuf, 0, sizeof(expBuf));
+    expBuf.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    expBuf.index    = index;
+    expBuf.flags    = O_RDWR | O_CLOEXEC;
+    if(-1 == dmabufIoctl(v4l2Fd, VIDIOC_EXPBUF, &expBuf)) {
+        ALOGE("%s: VIDIOC_EXPBUF of %d failed: %d", __func__, index, errno);
+        return USBCAM_DMABUF_ERROR;
+    }
+    *dmabufFd = expBuf.fd;
+    return USBCAM_DMABUF_NO_ERROR;
+}
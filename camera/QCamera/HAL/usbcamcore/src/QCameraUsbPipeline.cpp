@@ -0,0 +1,507 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//#define ALOG_NDEBUG 0
+#define LOG_TAG "QCameraUsbPipeline"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+
+#include "QCameraUsbPipeline.h"
+
+/* Life of a slot of the ring */
+#define SLOT_FREE       0
+#define SLOT_QUEUED     1
+#define SLOT_BUSY       2
+#define SLOT_DONE       3
+
+typedef struct {
+    usbcam_pipe_ops_t       ops;
+    pthread_mutex_t         lock;
+    /* a slot got free, or the pause state changed */
+    pthread_cond_t          slotCond;
+    /* a frame got submitted */
+    pthread_cond_t          workCond;
+    /* a frame got processed */
+    pthread_cond_t          doneCond;
+    pthread_t               workers[USBCAM_PIPE_MAX_WORKERS];
+    pthread_t               displayThread;
+    int                     numWorkers;
+    int                     displayStarted;
+    int                     exit;
+    int                     paused;
+
+    /* frames of seq [dispSeq, nextSeq) are in the ring at seq % maxInflight;
+     * those of [procSeq, nextSeq) are still waiting for a worker */
+    usbcam_pipe_frame_t     ring[USBCAM_PIPE_MAX_INFLIGHT];
+    int                     state[USBCAM_PIPE_MAX_INFLIGHT];
+    int                     maxInflight;
+    int                     inflight;
+    uint32_t                nextSeq;
+    uint32_t                procSeq;
+    uint32_t                dispSeq;
+
+    /* statistics */
+    uint32_t                submitted;
+    uint32_t                displayed;
+    uint32_t                dropped;
+    uint32_t                peakInflight;
+    uint32_t                fpsX100;
+    uint64_t                windowStartUs;
+    uint32_t                windowFrames;
+    uint64_t                latencySumUs;
+    uint64_t                latencyMaxUs;
+    uint64_t                processSumUs;
+    uint32_t                processCount;
+    uint64_t                displaySumUs;
+} usbcam_pipe_t;
+
+static uint64_t pipeNowUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/******************************************************************************
+ * Function: pipeFinishLocked
+ * Description: Accounts a frame that left the display stage and frees its
+ *              slot. Called with the pipeline lock held.
+ *
+ * Input parameters:
+ *   p                  - pipeline
+ *   frame              - frame that was displayed or dropped
+ *   displayUs          - time spent in the display stage
+ *
+ * Return values:   none
+ *****************************************************************************/
+static void pipeFinishLocked(usbcam_pipe_t *p, const usbcam_pipe_frame_t *frame,
+                             uint64_t displayUs)
+{
+    uint64_t now = pipeNowUs();
+    uint64_t latency = now - frame->captureUs;
+
+    if(frame->err) {
+        p->dropped++;
+    } else {
+        p->displayed++;
+        p->displaySumUs += displayUs;
+        p->latencySumUs += latency;
+        if(latency > p->latencyMaxUs)
+            p->latencyMaxUs = latency;
+
+        if(!p->windowStartUs) {
+            p->windowStartUs = now;
+        } else {
+            p->windowFrames++;
+            if(now - p->windowStartUs >= USBCAM_PIPE_FPS_WINDOW_US) {
+                p->fpsX100 = (uint32_t)((uint64_t)p->windowFrames * 100 *
+                                        1000000 / (now - p->windowStartUs));
+                p->windowStartUs = now;
+                p->windowFrames = 0;
+            }
+        }
+    }
+
+    p->inflight--;
+    pthread_cond_broadcast(&p->slotCond);
+}
+
+/* Runs the display or cancel callback of a frame, returns the time spent */
+static uint64_t pipeDisplay(usbcam_pipe_t *p, usbcam_pipe_frame_t *frame)
+{
+    uint64_t start = pipeNowUs();
+
+    if(frame->err) {
+        if(p->ops.cancel)
+            p->ops.cancel(p->ops.ctx, frame);
+    } else if(p->ops.display(p->ops.ctx, frame) < 0) {
+        ALOGE("%s: display of frame %u failed", __func__, frame->seq);
+    }
+    return pipeNowUs() - start;
+}
+
+static uint64_t pipeProcess(usbcam_pipe_t *p, usbcam_pipe_frame_t *frame)
+{
+    uint64_t start = pipeNowUs();
+
+    frame->dispId = -1;
+    frame->err = (p->ops.process(p->ops.ctx, frame) < 0) ? 1 : 0;
+    return pipeNowUs() - start;
+}
+
+static void *pipeWorker(void *data)
+{
+    usbcam_pipe_t   *p = (usbcam_pipe_t *)data;
+    uint64_t        us;
+    uint32_t        seq;
+    int             slot;
+
+    prctl(PR_SET_NAME, (unsigned long)"CAM_usbproc", 0, 0, 0);
+
+    pthread_mutex_lock(&p->lock);
+    while(1) {
+        while(!p->exit && p->procSeq == p->nextSeq)
+            pthread_cond_wait(&p->workCond, &p->lock);
+        if(p->procSeq == p->nextSeq)
+            break;
+
+        seq = p->procSeq++;
+        slot = seq % p->maxInflight;
+        p->state[slot] = SLOT_BUSY;
+        pthread_mutex_unlock(&p->lock);
+
+        us = pipeProcess(p, &p->ring[slot]);
+
+        pthread_mutex_lock(&p->lock);
+        p->processSumUs += us;
+        p->processCount++;
+        p->state[slot] = SLOT_DONE;
+        if(seq == p->dispSeq)
+            pthread_cond_signal(&p->doneCond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void *pipeDisplayThread(void *data)
+{
+    usbcam_pipe_t       *p = (usbcam_pipe_t *)data;
+    usbcam_pipe_frame_t frame;
+    uint64_t            us;
+    int                 slot;
+
+    prctl(PR_SET_NAME, (unsigned long)"CAM_usbdisp", 0, 0, 0);
+
+    pthread_mutex_lock(&p->lock);
+    while(1) {
+        slot = p->dispSeq % p->maxInflight;
+        while(!p->exit && SLOT_DONE != p->state[slot])
+            pthread_cond_wait(&p->doneCond, &p->lock);
+        if(SLOT_DONE != p->state[slot])
+            break;
+
+        frame = p->ring[slot];
+        pthread_mutex_unlock(&p->lock);
+
+        us = pipeDisplay(p, &frame);
+
+        pthread_mutex_lock(&p->lock);
+        p->state[slot] = SLOT_FREE;
+        p->dispSeq++;
+        pipeFinishLocked(p, &frame, us);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/******************************************************************************
+ * Function: usbCamPipelineCreate
+ * Description: Creates the pipeline and starts the worker and display
+ *              threads
+ *
+ * Input parameters:
+ *   pipe               - returns the pipeline handle
+ *   ops                - stage callbacks
+ *   numWorkers         - process threads, 0 to run the stages on the
+ *                        submitting thread
+ *   maxInflight        - frames between acquire and display
+ *
+ * Return values:
+ *   USBCAM_PIPE_NO_ERROR           Success
+ *   USBCAM_PIPE_ERROR              Invalid parameters
+ *   USBCAM_PIPE_INSUFFICIENT_MEM   No memory
+ *****************************************************************************/
+USBCAM_PIPE_ERR usbCamPipelineCreate(void** pipe,
+            const usbcam_pipe_ops_t*    ops,
+            int                         numWorkers,
+            int                         maxInflight)
+{
+    usbcam_pipe_t *p;
+    int i;
+
+    if(!pipe || !ops || !ops->process || !ops->display)
+        return USBCAM_PIPE_ERROR;
+    *pipe = NULL;
+
+    p = (usbcam_pipe_t *)calloc(1, sizeof(*p));
+    if(!p) {
+        ALOGE("%s: No memory", __func__);
+        return USBCAM_PIPE_INSUFFICIENT_MEM;
+    }
+    p->ops = *ops;
+    if(maxInflight < 1)
+        maxInflight = 1;
+    if(maxInflight > USBCAM_PIPE_MAX_INFLIGHT)
+        maxInflight = USBCAM_PIPE_MAX_INFLIGHT;
+    p->maxInflight = maxInflight;
+    if(numWorkers > USBCAM_PIPE_MAX_WORKERS)
+        numWorkers = USBCAM_PIPE_MAX_WORKERS;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->slotCond, NULL);
+    pthread_cond_init(&p->workCond, NULL);
+    pthread_cond_init(&p->doneCond, NULL);
+
+    if(numWorkers > 0) {
+        if(pthread_create(&p->displayThread, NULL, pipeDisplayThread, p)) {
+            ALOGE("%s: Cannot create display thread, running serially",
+                  __func__);
+            numWorkers = 0;
+        } else {
+            p->displayStarted = 1;
+        }
+    }
+    for(i = 0; i < numWorkers; i++) {
+        if(pthread_create(&p->workers[i], NULL, pipeWorker, p)) {
+            ALOGE("%s: Cannot create worker %d", __func__, i);
+            break;
+        }
+        p->numWorkers++;
+    }
+    if(p->displayStarted && !p->numWorkers) {
+        pthread_mutex_lock(&p->lock);
+        p->exit = 1;
+        pthread_cond_broadcast(&p->doneCond);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->displayThread, NULL);
+        p->displayStarted = 0;
+        p->exit = 0;
+    }
+
+    ALOGI("%s: %d workers, %d frames in flight", __func__,
+          p->numWorkers, p->maxInflight);
+    *pipe = p;
+    return USBCAM_PIPE_NO_ERROR;
+}
+
+USBCAM_PIPE_ERR usbCamPipelineDestroy(void* pipe)
+{
+    usbcam_pipe_t *p = (usbcam_pipe_t *)pipe;
+    int i;
+
+    if(!p)
+        return USBCAM_PIPE_NO_ERROR;
+
+    usbCamPipelineDrain(p);
+
+    pthread_mutex_lock(&p->lock);
+    p->exit = 1;
+    pthread_cond_broadcast(&p->workCond);
+    pthread_cond_broadcast(&p->doneCond);
+    pthread_mutex_unlock(&p->lock);
+    for(i = 0; i < p->numWorkers; i++)
+        pthread_join(p->workers[i], NULL);
+    if(p->displayStarted)
+        pthread_join(p->displayThread, NULL);
+
+    ALOGI("%s: %u submitted, %u displayed, %u dropped, %u.%02u fps, "
+          "latency %llu us avg %llu us max", __func__,
+          p->submitted, p->displayed, p->dropped,
+          p->fpsX100 / 100, p->fpsX100 % 100,
+          (unsigned long long)(p->displayed ?
+                               p->latencySumUs / p->displayed : 0),
+          (unsigned long long)p->latencyMaxUs);
+
+    pthread_cond_destroy(&p->doneCond);
+    pthread_cond_destroy(&p->workCond);
+    pthread_cond_destroy(&p->slotCond);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+    return USBCAM_PIPE_NO_ERROR;
+}
+
+USBCAM_PIPE_ERR usbCamPipelineAcquire(void* pipe, int timeoutMs)
+{
+    usbcam_pipe_t   *p = (usbcam_pipe_t *)pipe;
+    struct timespec ts;
+    int             rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += timeoutMs / 1000;
+    ts.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+    if(ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    while((p->paused || p->inflight >= p->maxInflight) && ETIMEDOUT != rc)
+        rc = pthread_cond_timedwait(&p->slotCond, &p->lock, &ts);
+    if(p->paused || p->inflight >= p->maxInflight) {
+        pthread_mutex_unlock(&p->lock);
+        return USBCAM_PIPE_TIMEOUT;
+    }
+    p->inflight++;
+    if((uint32_t)p->inflight > p->peakInflight)
+        p->peakInflight = p->inflight;
+    pthread_mutex_unlock(&p->lock);
+    return USBCAM_PIPE_NO_ERROR;
+}
+
+void usbCamPipelineAbort(void* pipe)
+{
+    usbcam_pipe_t *p = (usbcam_pipe_t *)pipe;
+
+    pthread_mutex_lock(&p->lock);
+    p->inflight--;
+    pthread_cond_broadcast(&p->slotCond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/******************************************************************************
+ * Function: usbCamPipelineSubmit
+ * Description: Queues a captured frame for the process stage. The caller
+ *              holds a slot from usbCamPipelineAcquire, which the frame
+ *              keeps until it is displayed or dropped.
+ *
+ * Input parameters:
+ *   pipe               - pipeline handle
+ *   frame              - capture buffer of the frame
+ *
+ * Return values:
+ *   USBCAM_PIPE_NO_ERROR   Success
+ *****************************************************************************/
+USBCAM_PIPE_ERR usbCamPipelineSubmit(void* pipe, usbcam_pipe_frame_t *frame)
+{
+    usbcam_pipe_t   *p = (usbcam_pipe_t *)pipe;
+    uint64_t        processUs, displayUs;
+    int             slot;
+
+    pthread_mutex_lock(&p->lock);
+    frame->seq       = p->nextSeq;
+    frame->captureUs = pipeNowUs();
+    p->submitted++;
+
+    if(!p->numWorkers) {
+        /* serial mode, the frame is done before returning */
+        p->nextSeq++;
+        p->procSeq++;
+        p->dispSeq++;
+        pthread_mutex_unlock(&p->lock);
+
+        processUs = pipeProcess(p, frame);
+        displayUs = pipeDisplay(p, frame);
+
+        pthread_mutex_lock(&p->lock);
+        p->processSumUs += processUs;
+        p->processCount++;
+        pipeFinishLocked(p, frame, displayUs);
+        pthread_mutex_unlock(&p->lock);
+        return USBCAM_PIPE_NO_ERROR;
+    }
+
+    slot = frame->seq % p->maxInflight;
+    p->ring[slot]   = *frame;
+    p->state[slot]  = SLOT_QUEUED;
+    p->nextSeq++;
+    pthread_cond_signal(&p->workCond);
+    pthread_mutex_unlock(&p->lock);
+    return USBCAM_PIPE_NO_ERROR;
+}
+
+void usbCamPipelineDrain(void* pipe)
+{
+    usbcam_pipe_t *p = (usbcam_pipe_t *)pipe;
+
+    pthread_mutex_lock(&p->lock);
+    while(p->inflight)
+        pthread_cond_wait(&p->slotCond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void usbCamPipelinePause(void* pipe, int pause)
+{
+    usbcam_pipe_t *p = (usbcam_pipe_t *)pipe;
+
+    pthread_mutex_lock(&p->lock);
+    p->paused = pause;
+    pthread_cond_broadcast(&p->slotCond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void usbCamPipelineGetStats(void* pipe, usbcam_pipe_stats_t *stats)
+{
+    usbcam_pipe_t *p = (usbcam_pipe_t *)pipe;
+
+    memset(stats, 0, sizeof(*stats));
+    if(!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    stats->submitted    = p->submitted;
+    stats->displayed    = p->displayed;
+    stats->dropped      = p->dropped;
+    stats->inflight     = p->inflight;
+    stats->maxInflight  = p->peakInflight;
+    stats->fpsX100      = p->fpsX100;
+    if(!stats->fpsX100 && p->windowFrames) {
+        /* no complete window yet */
+        stats->fpsX100 = (uint32_t)((uint64_t)p->windowFrames * 100 *
+                                    1000000 / (pipeNowUs() - p->windowStartUs));
+    }
+    stats->latencyMaxUs = p->latencyMaxUs;
+    if(p->displayed) {
+        stats->latencyAvgUs = p->latencySumUs / p->displayed;
+        stats->displayAvgUs = p->displaySumUs / p->displayed;
+    }
+    if(p->processCount)
+        stats->processAvgUs = p->processSumUs / p->processCount;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void usbCamPipelineDump(void* pipe, int fd)
+{
+    usbcam_pipe_stats_t stats;
+
+    if(!pipe) {
+        dprintf(fd, "USB preview pipeline: not running\n");
+        return;
+    }
+    usbCamPipelineGetStats(pipe, &stats);
+    dprintf(fd, "USB preview pipeline: %d workers\n",
+            ((usbcam_pipe_t *)pipe)->numWorkers);
+    dprintf(fd, "  frames: %u submitted, %u displayed, %u dropped\n",
+            stats.submitted, stats.displayed, stats.dropped);
+    dprintf(fd, "  in flight: %u now, %u peak\n",
+            stats.inflight, stats.maxInflight);
+    dprintf(fd, "  fps: %u.%02u\n", stats.fpsX100 / 100, stats.fpsX100 % 100);
+    dprintf(fd, "  latency: %llu us avg, %llu us max\n",
+            (unsigned long long)stats.latencyAvgUs,
+            (unsigned long long)stats.latencyMaxUs);
+    dprintf(fd, "  process: %llu us avg, display: %llu us avg\n",
+            (unsigned long long)stats.processAvgUs,
+            (unsigned long long)stats.displayAvgUs);
+}
@@ -40,11 +40,15 @@
 #include <sys/resource.h>
 #include <pthread.h>
 #include <linux/uvcvideo.h>
+#include <cutils/properties.h>
 
 #include "QCameraHAL.h"
 #include "QualcommUsbCamera.h"
 #include "QCameraUsbPriv.h"
 #include "QCameraMjpegDecode.h"
+#include "QCameraUsbConvert.h"
+#include "QCameraUsbPipeline.h"
+#include "QCameraUsbDmabuf.h"
 #include "QCameraUsbParm.h"
 #include <gralloc_priv.h>
 #include <genlock.h>
@@ -113,10 +117,21 @@ static int put_buf_to_cam(              camera_hardware_t *camHal);
 static int prvwThreadTakePictureInternal(camera_hardware_t *camHal);
 static int get_buf_from_display( camera_hardware_t *camHal, int *buffer_id);
 static int put_buf_to_display(   camera_hardware_t *camHal, int buffer_id);
-static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id);
+static int queue_buf_to_cam(camera_hardware_t *camHal, int index);
+static int feed_disp_bufs_to_cam(camera_hardware_t *camHal);
+static void cancel_disp_buf(void *ctx, int buffer_id);
+static int reclaim_disp_bufs_from_cam(camera_hardware_t *camHal);
+static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal,
+                                        int cap_index, int bytesused,
+                                        int buffer_id);
+static int prvwProcessFrame(void *ctx, usbcam_pipe_frame_t *frame);
+static int prvwDisplayFrame(void *ctx, usbcam_pipe_frame_t *frame);
+static void prvwCancelFrame(void *ctx, usbcam_pipe_frame_t *frame);
 static void * previewloop(void *);
 static void * takePictureThread(void *);
-static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht);
+static int convert_YUYV_to_420_NV12(camera_hardware_t *camHal,
+                                    char *in_buf, char *out_buf, int wd, int ht);
+static void init_converter(camera_hardware_t *camHal);
 static int get_uvc_device(char *devname);
 static int getPreviewCaptureFmt(camera_hardware_t *camHal);
 static int allocate_ion_memory(QCameraHalMemInfo_t *mem_info, int ion_type);
@@ -248,6 +263,10 @@ extern "C"  int usbcam_close_camera_device( hw_device_t *hw_dev)
                 ALOGE("%s: close failed ", __func__);
             }
             camHal->fd = 0;
+            usbCamConvertDestroy(camHal->convert);
+            camHal->convert = NULL;
+            mjpegDecoderDestroy(camHal->mjpegd);
+            camHal->mjpegd = NULL;
             delete camHal;
         }else{
                 ALOGE("%s: camHal is NULL pointer ", __func__);
@@ -267,8 +286,20 @@ int usbcam_set_preview_window(struct camera_device * device,
     VALIDATE_DEVICE_HDL(camHal, device, -1);
     Mutex::Autolock autoLock(camHal->lock);
 
+    /* Display buffers are in use by the preview stages until the frames */
+    /* in flight are displayed. Let the stages run without the lock, the */
+    /* preview callback may need it                                      */
+    if(camHal->pipeline){
+        usbCamPipelinePause(camHal->pipeline, 1);
+        camHal->lock.unlock();
+        usbCamPipelineDrain(camHal->pipeline);
+        camHal->lock.lock();
+    }
+
     /* if window is already set, then de-init previous buffers */
     if(camHal->window){
+        /* the camera may still hold display buffers of this window */
+        reclaim_disp_bufs_from_cam(camHal);
         rc = deInitDisplayBuffers(camHal);
         if(rc < 0) {
             ALOGE("%s: deInitDisplayBuffers returned error", __func__);
@@ -282,6 +313,8 @@ int usbcam_set_preview_window(struct camera_device * device,
             ALOGE("%s: initDisplayBuffers returned error", __func__);
         }
     }
+    if(camHal->pipeline)
+        usbCamPipelinePause(camHal->pipeline, 0);
     ALOGI("%s: X. rc = %d", __func__, rc);
     return rc;
 }
@@ -690,6 +723,12 @@ int usbcam_dump(struct camera_device * device, int fd)
 {
     ALOGI("%s: E", __func__);
     int rc = 0;
+    camera_hardware_t *camHal;
+
+    VALIDATE_DEVICE_HDL(camHal, device, -1);
+    Mutex::Autolock autoLock(camHal->lock);
+
+    usbCamPipelineDump(camHal->pipeline, fd);
 
     ALOGI("%s: X", __func__);
     return rc;
@@ -715,31 +754,55 @@ int usbcam_dump(struct camera_device * device, int fd)
 /************************** VUVU            19 17 23 21            ************/
 /******************************************************************************/
 
-static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht)
+static int convert_YUYV_to_420_NV12(camera_hardware_t *camHal,
+                                    char *in_buf, char *out_buf, int wd, int ht)
 {
     int rc =0;
-    int row, col, uv_row;
+    usbcam_convert_params_t params;
 
     ALOGD("%s: E", __func__);
-    /* Arrange Y */
-    for(row = 0; row < ht; row++)
-        for(col = 0; col < wd * 2; col += 2)
-        {
-            out_buf[row * wd + col / 2] = in_buf[row * wd * 2 + col];
-        }
-
-    /* Arrange UV */
-    for(row = 0, uv_row = ht; row < ht; row += 2, uv_row++)
-        for(col = 1; col < wd * 2; col += 4)
-        {
-            out_buf[uv_row * wd + col / 2]= in_buf[row * wd * 2 + col + 2];
-            out_buf[uv_row * wd + col / 2 + 1]  = in_buf[row * wd * 2 + col];
-        }
+    /* Converter is created before the threads calling this are started, */
+    /* without it the frame is converted on the calling thread           */
+    memset(&params, 0, sizeof(params));
+    params.src          = (const uint8_t *)in_buf;
+    params.srcFmt       = USBCAM_CONVERT_SRC_YUYV;
+    params.width        = wd;
+    params.height       = ht;
+    params.downscale    = 1;
+    params.dstY         = (uint8_t *)out_buf;
+    params.dstFmt       = USBCAM_CONVERT_DST_NV21;
+    rc = usbCamConvertFrame(camHal->convert, &params);
 
     ALOGD("%s: X", __func__);
     return rc;
 }
 
+/******************************************************************************
+ * Function: init_converter
+ * Description: Creates the YUYV converter threads, kept for the life of the
+ *              camera. Called with camHal->lock held before any thread that
+ *              converts frames is started.
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *
+ * Return values:
+ *      None
+ * Notes: frames are converted on the calling thread if this fails
+ *****************************************************************************/
+static void init_converter(camera_hardware_t *camHal)
+{
+    int rc;
+
+    if(camHal->convert)
+        return;
+    rc = usbCamConvertInit(&camHal->convert, 0);
+    if(rc < 0) {
+        ALOGE("%s: usbCamConvertInit Error: %d", __func__, rc);
+        camHal->convert = NULL;
+    }
+}
+
 /******************************************************************************
  * Function: initDisplayBuffers
  * Description: This function initializes the preview buffers
@@ -1061,8 +1124,9 @@ static int deInitDisplayBuffers(camera_hardware_t *camHal)
  *****************************************************************************/
 static int getPreviewCaptureFmt(camera_hardware_t *camHal)
 {
-    int     i = 0, mjpegSupported = 0, h264Supported = 0;
+    int     i = 0, mjpegSupported = 0, h264Supported = 0, nv21Supported = 0;
     struct v4l2_fmtdesc fmtdesc;
+    char    value[PROPERTY_VALUE_MAX];
 
     memset(&fmtdesc, 0, sizeof(v4l2_fmtdesc));
 
@@ -1093,6 +1157,10 @@ static int getPreviewCaptureFmt(camera_hardware_t *camHal)
             h264Supported = 1;
             ALOGI("%s: V4L2_PIX_FMT_H264 is supported", __func__ );
         }
+        if(V4L2_PIX_FMT_NV21 == fmtdesc.pixelformat){
+            nv21Supported = 1;
+            ALOGI("%s: V4L2_PIX_FMT_NV21 is supported", __func__ );
+        }
 
     }
 
@@ -1107,9 +1175,25 @@ static int getPreviewCaptureFmt(camera_hardware_t *camHal)
         else if(1 == h264Supported)
             camHal->captureFormat = V4L2_PIX_FMT_H264;
     }
-    ALOGI("%s: Capture format chosen: 0x%x. 0x%x:YUYV. 0x%x:MJPEG. 0x%x: H264",
+
+    /* Frames already in the display format can be captured straight into */
+    /* the display buffers. The display buffers are laid out as the      */
+    /* conversions write them: chroma right after width x height luma    */
+    property_get("persist.camera.usb.dmabuf", value, "0");
+    camHal->dmabufMode = 0;
+    if(atoi(value) && nv21Supported &&
+       (HAL_PIXEL_FORMAT_YCrCb_420_SP == camHal->dispFormat) &&
+       (camHal->prevWidth == camHal->dispWidth) &&
+       (camHal->prevHeight == camHal->dispHeight) &&
+       !(camHal->prevWidth % 16)) {
+        camHal->captureFormat = V4L2_PIX_FMT_NV21;
+        camHal->dmabufMode = 1;
+    }
+    ALOGI("%s: Capture format chosen: 0x%x. 0x%x:YUYV. 0x%x:MJPEG. 0x%x: H264"
+        " 0x%x: NV21, dmabuf: %d",
         __func__, camHal->captureFormat, V4L2_PIX_FMT_YUYV,
-        V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_H264);
+        V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_H264, V4L2_PIX_FMT_NV21,
+        camHal->dmabufMode);
 
     return camHal->captureFormat;
 }
@@ -1184,6 +1268,21 @@ static int initV4L2mmap(camera_hardware_t *camHal)
     struct v4l2_buffer          tempBuf;
 
     ALOGD("%s: E", __func__);
+
+    /* Display buffers are queued to the camera as they are dequeued from */
+    /* the window, no driver buffers to map                               */
+    if(camHal->dmabufMode) {
+        if(USBCAM_DMABUF_NO_ERROR ==
+           usbCamDmabufInit(&camHal->dmabufq, camHal->fd, PRVW_DISP_BUF_CNT)) {
+            camHal->buffers = NULL;
+            camHal->n_buffers = PRVW_DISP_BUF_CNT;
+            ALOGD("%s: X DMABUF", __func__);
+            return 0;
+        }
+        ALOGE("%s: DMABUF not supported, copying the frames", __func__);
+        camHal->dmabufMode = 0;
+    }
+
     memset(&reqBufs, 0, sizeof(v4l2_requestbuffers));
     reqBufs.type    = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     reqBufs.memory  = V4L2_MEMORY_MMAP;
@@ -1258,6 +1357,14 @@ static int unInitV4L2mmap(camera_hardware_t *camHal)
     int i, rc = 0;
     ALOGD("%s: E", __func__);
 
+    if(camHal->dmabufq) {
+        usbCamDmabufDestroy(camHal->dmabufq);
+        camHal->dmabufq = NULL;
+        camHal->n_buffers = 0;
+        ALOGD("%s: X", __func__);
+        return rc;
+    }
+
     for (i = 0; i < camHal->n_buffers; i++)
         if (-1 == munmap(camHal->buffers[i].data, camHal->buffers[i].len)){
             ALOGE("%s: munmap failed for buffer: %d", __func__, i);
@@ -1396,7 +1503,8 @@ static int startUsbCamCapture(camera_hardware_t *camHal)
     enum        v4l2_buf_type   v4l2BufType;
     ALOGD("%s: E", __func__);
 
-    for (i = 0; i < camHal->n_buffers; ++i) {
+    /* DMABUF buffers are queued by the preview thread */
+    for (i = 0; !camHal->dmabufq && i < camHal->n_buffers; ++i) {
         struct v4l2_buffer tempBuf;
 
         memset(&tempBuf, 0, sizeof(tempBuf));
@@ -1492,14 +1600,24 @@ static int stopPreviewInternal(camera_hardware_t *camHal)
         }
         camHal->lock.lock();
 
+        /* preview thread drained the stages before exiting */
+        usbCamPipelineDestroy(camHal->pipeline);
+        camHal->pipeline = NULL;
+
+        mjpegDecoderDestroy(camHal->mjpegd);
+        camHal->mjpegd = NULL;
+
         if(stopUsbCamCapture(camHal)){
             ALOGE("%s: Error in stopUsbCamCapture", __func__);
             rc = -1;
         }
+        /* stream off gave the display buffers back, return them to window */
+        usbCamDmabufFlush(camHal->dmabufq, cancel_disp_buf, camHal);
         if(unInitV4L2mmap(camHal)){
             ALOGE("%s: Error in stopUsbCamCapture", __func__);
             rc = -1;
         }
+        camHal->dmabufMode = 0;
         camHal->previewEnabledFlag = 0;
     }
 
@@ -1753,6 +1871,141 @@ static int put_buf_to_cam(camera_hardware_t *camHal)
     return 0;
 }
 
+/******************************************************************************
+ * Function: queue_buf_to_cam
+ * Description: This funtion puts/releases the capture buffer of the given
+ *              index back to the camera driver. Unlike put_buf_to_cam it
+ *              does not use curCaptureBuf and can be called by the preview
+ *              stages while the next frame is dequeued
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *   index               - index of the capture buffer
+ *
+ * Return values:
+ *   0      No error
+ *   1      Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int queue_buf_to_cam(camera_hardware_t *camHal, int index)
+{
+    struct v4l2_buffer capBuf;
+
+    memset(&capBuf, 0, sizeof(capBuf));
+    capBuf.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    capBuf.memory   = V4L2_MEMORY_MMAP;
+    capBuf.index    = index;
+
+    if (-1 == ioctlLoop(camHal->fd, VIDIOC_QBUF, &capBuf))
+    {
+        ALOGE("%s: VIDIOC_QBUF of %d failed ", __func__, index);
+        return 1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Function: feed_disp_bufs_to_cam
+ * Description: In DMABUF mode, dequeues display buffers from the window and
+ *              queues them to the camera until the camera holds n_buffers.
+ *              Must be called without the HAL lock, dequeuing from the
+ *              window waits for the display
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int feed_disp_bufs_to_cam(camera_hardware_t *camHal)
+{
+    int                     buffer_id = 0;
+    struct private_handle_t *handle;
+
+    while(usbCamDmabufQueued(camHal->dmabufq) < (int)camHal->n_buffers) {
+        if(get_buf_from_display(camHal, &buffer_id)) {
+            ALOGE("%s: get_buf_from_display failed", __func__);
+            return -1;
+        }
+        handle = camHal->previewMem.private_buffer_handle[buffer_id];
+        if(USBCAM_DMABUF_NO_ERROR != usbCamDmabufQueue(camHal->dmabufq,
+                                        handle->fd, handle->size, buffer_id)) {
+            ALOGE("%s: usbCamDmabufQueue of %d failed", __func__, buffer_id);
+            cancel_disp_buf(camHal, buffer_id);
+            return -1;
+        }
+        ALOGD("%s: display buffer %d queued to camera", __func__, buffer_id);
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Function: cancel_disp_buf
+ * Description: Gives a dequeued display buffer back to the window without
+ *              showing it
+ *
+ * Input parameters:
+ *   ctx                 - camera HAL handle
+ *   buffer_id           - id of the display buffer
+ *
+ * Return values:   none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void cancel_disp_buf(void *ctx, int buffer_id)
+{
+    camera_hardware_t   *camHal     = (camera_hardware_t *)ctx;
+    preview_stream_ops  *mPreviewWindow;
+    buffer_handle_t     *buffer_handle;
+
+    mPreviewWindow  = camHal->window;
+    if(!mPreviewWindow || buffer_id < 0)
+        return;
+    buffer_handle   = camHal->previewMem.buffer_handle[buffer_id];
+
+    if (GENLOCK_FAILURE ==
+        genlock_unlock_buffer((native_handle_t *)(*buffer_handle))) {
+       ALOGE("%s: genlock_unlock_buffer failed: hdl =%p",
+            __func__, (*buffer_handle));
+    }
+    if(mPreviewWindow->cancel_buffer(mPreviewWindow, buffer_handle))
+        ALOGE("%s: cancel_buffer failed: %p", __func__, buffer_handle);
+}
+
+/******************************************************************************
+ * Function: reclaim_disp_bufs_from_cam
+ * Description: In DMABUF mode, takes the display buffers queued to the
+ *              camera back by restarting the stream, and gives them back to
+ *              the window. Called with the preview pipeline drained
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int reclaim_disp_bufs_from_cam(camera_hardware_t *camHal)
+{
+    int rc = 0;
+
+    if(!camHal->dmabufq || !usbCamDmabufQueued(camHal->dmabufq))
+        return 0;
+
+    if(stopUsbCamCapture(camHal))
+        rc = -1;
+    usbCamDmabufFlush(camHal->dmabufq, cancel_disp_buf, camHal);
+    if(startUsbCamCapture(camHal))
+        rc = -1;
+    return rc;
+}
+
 /******************************************************************************
  * Function: put_buf_to_cam
  * Description: This funtion gets/acquires 1 display buffer from the display
@@ -1903,12 +2156,14 @@ static int put_buf_to_display(camera_hardware_t *camHal, int buffer_id)
 }
 
 /******************************************************************************
- * Function: put_buf_to_display
+ * Function: convert_data_frm_cam_to_disp
  * Description: This funtion transfers the content from capture buffer to
  *              preiew display buffer after appropriate conversion
  *
  * Input parameters:
  *  camHal                  - camera HAL handle
+ *  cap_index               - index of the capture buffer
+ *  bytesused               - bytes of the capture buffer
  *  buffer_id               - id of the buffer that needs to be enqueued
  *
  * Return values:
@@ -1917,7 +2172,9 @@ static int put_buf_to_display(camera_hardware_t *camHal, int buffer_id)
  *
  * Notes: none
  *****************************************************************************/
-static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id)
+static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal,
+                                        int cap_index, int bytesused,
+                                        int buffer_id)
 {
     int rc = -1;
 
@@ -1930,32 +2187,39 @@ static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id
     if( (V4L2_PIX_FMT_YUYV == camHal->captureFormat) &&
         (HAL_PIXEL_FORMAT_YCrCb_420_SP == camHal->dispFormat))
     {
-        convert_YUYV_to_420_NV12(
-            (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
+        rc = convert_YUYV_to_420_NV12(camHal,
+            (char *)camHal->buffers[cap_index].data,
             (char *)camHal->previewMem.camera_memory[buffer_id]->data,
             camHal->prevWidth,
             camHal->prevHeight);
         ALOGD("%s: Copied %d bytes from camera buffer %d to display buffer: %d",
-             __func__, camHal->curCaptureBuf.bytesused,
-             camHal->curCaptureBuf.index, buffer_id);
+             __func__, bytesused, cap_index, buffer_id);
+    }
+
+    /* Same format, when DMABUF could not be used */
+    if( (V4L2_PIX_FMT_NV21 == camHal->captureFormat) &&
+        (HAL_PIXEL_FORMAT_YCrCb_420_SP == camHal->dispFormat))
+    {
+        int frameSize = camHal->prevWidth * camHal->prevHeight * 3 / 2;
+
+        memcpy(camHal->previewMem.camera_memory[buffer_id]->data,
+               camHal->buffers[cap_index].data,
+               (bytesused < frameSize) ? bytesused : frameSize);
         rc = 0;
     }
 
     /* If camera buffer is MJPEG encoded, call mjpeg decode call */
     if(V4L2_PIX_FMT_MJPEG == camHal->captureFormat)
     {
-        if(NULL == camHal->mjpegd)
-        {
-            rc = mjpegDecoderInit(&camHal->mjpegd);
-            if(rc < 0)
-                ALOGE("%s: mjpegDecoderInit Error: %d", __func__, rc);
-        }
+        /* The decoder is not reentrant, preview workers take turns */
+        Mutex::Autolock decodeLock(camHal->mjpegdLock);
+
         if(camHal->mjpegd)
         {
             rc = mjpegDecode(
                 (void*)camHal->mjpegd,
-                (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
-                camHal->curCaptureBuf.bytesused,
+                (char *)camHal->buffers[cap_index].data,
+                bytesused,
                 (char *)camHal->previewMem.camera_memory[buffer_id]->data,
                 (char *)camHal->previewMem.camera_memory[buffer_id]->data +
                     camHal->prevWidth * camHal->prevHeight,
@@ -1984,24 +2248,286 @@ static int launch_preview_thread(camera_hardware_t *camHal)
 {
     ALOGD("%s: E", __func__);
     int rc = 0;
+    usbcam_pipe_ops_t   ops;
+    char                value[PROPERTY_VALUE_MAX];
+    int                 workers;
+    int                 inflight;
 
     if(!camHal) {
         ALOGE("%s: camHal is NULL", __func__);
         return -1;
     }
 
+    /************************************************************************/
+    /* - Create the preview stages. One capture buffer stays with the       */
+    /*   driver, the others may be in flight between the stages. With 0    */
+    /*   workers frames are processed on the preview thread                */
+    /************************************************************************/
+    property_get("persist.camera.usb.prvw.workers", value, "2");
+    workers = atoi(value);
+    inflight = (camHal->n_buffers > 1) ? camHal->n_buffers - 1 : 1;
+
+    /************************************************************************/
+    /* - Create the MJPEG decoder session once for the whole preview        */
+    /************************************************************************/
+    if((V4L2_PIX_FMT_MJPEG == camHal->captureFormat) && !camHal->mjpegd) {
+        rc = mjpegDecoderInit(&camHal->mjpegd);
+        if(rc < 0) {
+            ALOGE("%s: mjpegDecoderInit Error: %d", __func__, rc);
+            camHal->mjpegd = NULL;
+            return -1;
+        }
+    }
+
+    /************************************************************************/
+    /* - Create the YUYV converter before the workers may use it           */
+    /************************************************************************/
+    if(V4L2_PIX_FMT_YUYV == camHal->captureFormat)
+        init_converter(camHal);
+
+    memset(&ops, 0, sizeof(ops));
+    ops.ctx     = camHal;
+    ops.process = prvwProcessFrame;
+    ops.display = prvwDisplayFrame;
+    ops.cancel  = prvwCancelFrame;
+    rc = usbCamPipelineCreate(&camHal->pipeline, &ops, workers, inflight);
+    if(rc < 0) {
+        ALOGE("%s: usbCamPipelineCreate Error: %d", __func__, rc);
+        return -1;
+    }
+
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_create(&camHal->previewThread, &attr, previewloop, camHal);
+    if(pthread_create(&camHal->previewThread, &attr, previewloop, camHal)) {
+        ALOGE("%s: Cannot create preview thread", __func__);
+        usbCamPipelineDestroy(camHal->pipeline);
+        camHal->pipeline = NULL;
+        rc = -1;
+    }
 
     ALOGD("%s: X", __func__);
     return rc;
 }
 
 /******************************************************************************
- * Function: launch_preview_thread
- * Description: This is thread funtion for preivew loop
+ * Function: prvwProcessFrame
+ * Description: Process stage of the preview. Dequeues a display buffer,
+ *              converts or decodes the capture buffer into it and gives the
+ *              capture buffer back to the camera. Runs on the preview
+ *              workers, for several frames at a time
+ *
+ * Input parameters:
+ *  ctx                     - camera HAL handle
+ *  frame                   - frame of the pipeline
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int prvwProcessFrame(void *ctx, usbcam_pipe_frame_t *frame)
+{
+    camera_hardware_t   *camHal     = (camera_hardware_t *)ctx;
+    int                 buffer_id   = 0;
+    int                 rc          = 0;
+
+    /* DMABUF mode: the camera wrote the frame into the display buffer */
+    if(camHal->dmabufq) {
+        frame->dispId = frame->index;
+        return 0;
+    }
+
+#if DISPLAY
+    /************************************************************************/
+    /* - Dequeue display buffer from surface                                */
+    /************************************************************************/
+    if(0 == get_buf_from_display(camHal, &buffer_id)) {
+        ALOGD("%s: get_buf_from_display success: %d",
+             __func__, buffer_id);
+        frame->dispId = buffer_id;
+    }else{
+        ALOGE("%s: get_buf_from_display failed. Dropping the frame",
+             __func__);
+        rc = -1;
+    }
+#endif
+
+#if FILE_DUMP_CAMERA
+    /* Debug code to dump frames from camera */
+    if(!rc)
+    {
+        static int frame_cnt = 0;
+        /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
+        fileDump("/data/USBcam.yuv",
+        (char*)camHal->buffers[frame->index].data,
+        camHal->prevWidth * camHal->prevHeight * 1.5,
+        &frame_cnt);
+    }
+#endif
+
+#if MEMSET
+    if(!rc)
+    {
+        static int color = 30;
+        color += 50;
+        if(color > 200) {
+            color = 30;
+        }
+        ALOGE("%s: Setting to the color: %d\n", __func__, color);
+        /* currently hardcoded for format of type Bytes-Per-Pixel = 1.5 */
+        memset(camHal->previewMem.camera_memory[buffer_id]->data,
+               color, camHal->dispWidth * camHal->dispHeight * 1.5 + 2 * 1024);
+    }
+#else
+    if(!rc)
+    {
+        convert_data_frm_cam_to_disp(camHal, frame->index, frame->bytesused,
+                                     buffer_id);
+        ALOGD("%s: Copied data to buffer_id: %d", __func__, buffer_id);
+    }
+#endif
+
+#if FILE_DUMP_B4_DISP
+    /* Debug code to dump display buffers */
+    if(!rc)
+    {
+        static int frame_cnt = 0;
+        /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
+        fileDump("/data/display.yuv",
+            (char*) camHal->previewMem.camera_memory[buffer_id]->data,
+            camHal->dispWidth * camHal->dispHeight * 1.5,
+            &frame_cnt);
+        ALOGD("%s: Written buf_index: %d ", __func__, buffer_id);
+    }
+#endif
+
+#if CAPTURE
+    /************************************************************************/
+    /* - Enqueue capture buffer back to USB camera                          */
+    /************************************************************************/
+    if(0 == queue_buf_to_cam(camHal, frame->index)) {
+        ALOGD("%s: queue_buf_to_cam success", __func__);
+    }
+    else
+        ALOGE("%s: queue_buf_to_cam error", __func__);
+#endif
+
+    return rc;
+}
+
+/******************************************************************************
+ * Function: prvwDisplayFrame
+ * Description: Display stage of the preview. Enqueues the display buffer
+ *              to the surface and does the preview frame callback. Runs on
+ *              the display thread, in capture order
+ *
+ * Input parameters:
+ *  ctx                     - camera HAL handle
+ *  frame                   - frame of the pipeline
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: none
+ *****************************************************************************/
+static int prvwDisplayFrame(void *ctx, usbcam_pipe_frame_t *frame)
+{
+    camera_hardware_t   *camHal     = (camera_hardware_t *)ctx;
+    int                 buffer_id   = (frame->dispId < 0) ? 0 : frame->dispId;
+    int                 rc          = 0;
+
+#if DISPLAY
+    /************************************************************************/
+    /* - Enqueue display buffer back to surface                             */
+    /************************************************************************/
+    if(0 == put_buf_to_display(camHal, buffer_id)) {
+        ALOGD("%s: put_buf_to_display success: %d", __func__, buffer_id);
+    }
+    else {
+        ALOGE("%s: put_buf_to_display error", __func__);
+        rc = -1;
+    }
+#endif
+
+#if CALL_BACK
+    /************************************************************************/
+    /* - If preview frames callback is requested, callback with prvw buffers*/
+    /************************************************************************/
+    /* TBD: change the 1.5 hardcoding to Bytes Per Pixel */
+    int previewBufSize = camHal->prevWidth * camHal->prevHeight * 1.5;
+    int                 msgType     = CAMERA_MSG_PREVIEW_FRAME;
+    camera_memory_t     *data       = NULL;
+    camera_frame_metadata_t *metadata= NULL;
+    camera_memory_t     *previewMem = NULL;
+
+    if(previewBufSize !=
+        camHal->previewMem.private_buffer_handle[buffer_id]->size) {
+
+        previewMem = camHal->get_memory(
+            camHal->previewMem.private_buffer_handle[buffer_id]->fd,
+            previewBufSize,
+            1,
+            camHal->cb_ctxt);
+
+          if (!previewMem || !previewMem->data) {
+              ALOGE("%s: get_memory failed.\n", __func__);
+          }
+          else {
+              data = previewMem;
+              ALOGD("%s: GetMemory successful. data = %p",
+                        __func__, data);
+              ALOGD("%s: previewBufSize = %d, priv_buf_size: %d",
+                __func__, previewBufSize,
+                camHal->previewMem.private_buffer_handle[buffer_id]->size);
+          }
+    }
+    else{
+        data =   camHal->previewMem.camera_memory[buffer_id];
+        ALOGD("%s: No GetMemory, no invalid fmt. data = %p, idx=%d",
+            __func__, data, buffer_id);
+    }
+    /* The HAL lock is not held here. Sometimes 'disable_msg' is issued */
+    /* in the callback context                                          */
+    if((camHal->msgEnabledFlag & CAMERA_MSG_PREVIEW_FRAME) &&
+        camHal->data_cb){
+        ALOGD("%s: before data callback", __func__);
+        camHal->data_cb(msgType, data, 0,metadata, camHal->cb_ctxt);
+        ALOGD("%s: after data callback: %p", __func__, camHal->data_cb);
+    }
+    if (previewMem)
+        previewMem->release(previewMem);
+#endif
+
+    return rc;
+}
+
+/******************************************************************************
+ * Function: prvwCancelFrame
+ * Description: Gives the display buffer of a dropped frame back to the
+ *              surface without showing it
+ *
+ * Input parameters:
+ *  ctx                     - camera HAL handle
+ *  frame                   - frame of the pipeline
+ *
+ * Return values:   none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void prvwCancelFrame(void *ctx, usbcam_pipe_frame_t *frame)
+{
+    cancel_disp_buf(ctx, frame->dispId);
+}
+
+/******************************************************************************
+ * Function: previewloop
+ * Description: This is thread funtion for preivew loop. It is the capture
+ *              stage of the preview: the conversion and the display of a
+ *              frame run on the pipeline stages while the next frame is
+ *              dequeued
  *
  * Input parameters:
  *  hcamHal                 - camera HAL handle
@@ -2015,13 +2541,11 @@ static int launch_preview_thread(camera_hardware_t *camHal)
 static void * previewloop(void *hcamHal)
 {
     int                 rc;
-    int                 buffer_id   = 0;
     pid_t               tid         = 0;
     camera_hardware_t   *camHal     = NULL;
-    int                 msgType     = 0;
-    camera_memory_t     *data       = NULL;
-    camera_frame_metadata_t *metadata= NULL;
-    camera_memory_t     *previewMem = NULL;
+    void                *pipe       = NULL;
+    usbcam_pipe_frame_t frame;
+    int                 slot;
 
     camHal = (camera_hardware_t *)hcamHal;
     ALOGD("%s: E", __func__);
@@ -2030,6 +2554,7 @@ static void * previewloop(void *hcamHal)
         ALOGE("%s: camHal is NULL", __func__);
         return NULL ;
     }
+    pipe = camHal->pipeline;
 
     tid  = gettid();
     /* TBR: Set appropriate thread priority */
@@ -2037,52 +2562,59 @@ static void * previewloop(void *hcamHal)
     prctl(PR_SET_NAME, (unsigned long)"Camera HAL preview thread", 0, 0, 0);
 
     /************************************************************************/
+    /* - Take a slot of the pipeline, bounding the frames in flight         */
     /* - Time wait (select) on camera fd for input read buffer              */
-    /* - Check if any preview thread commands are set. If set, process      */
-    /* - Dequeue display buffer from surface                                */
+    /* - Check if any preview thread commands are set. If set, drain the    */
+    /*   pipeline and process                                               */
     /* - Dequeue capture buffer from USB camera                             */
-    /* - Convert capture format to display format                           */
-    /* - If preview frames callback is requested, callback with prvw buffers*/
-    /* - Enqueue display buffer back to surface                             */
-    /* - Enqueue capture buffer back to USB camera                          */
+    /* - Submit the frame. The process stage dequeues a display buffer,     */
+    /*   converts and enqueues the capture buffer back to USB camera; the   */
+    /*   display stage enqueues the display buffer back to surface and      */
+    /*   calls back with prvw buffers if requested                          */
     /************************************************************************/
     while(1) {
         fd_set fds;
         struct timeval tv;
         int r = 0;
 
-        FD_ZERO(&fds);
+        slot = (USBCAM_PIPE_NO_ERROR == usbCamPipelineAcquire(pipe, 500));
+
+        /* DMABUF mode: give the camera display buffers to fill. The slot */
+        /* keeps the window from changing meanwhile                      */
+        if(slot && camHal->dmabufq && camHal->window)
+            feed_disp_bufs_to_cam(camHal);
+
+        if(slot) {
+            FD_ZERO(&fds);
 #if CAPTURE
-        FD_SET(camHal->fd, &fds);
+            FD_SET(camHal->fd, &fds);
 #endif /* CAPTURE */
 
     /************************************************************************/
     /* - Time wait (select) on camera fd for input read buffer              */
     /************************************************************************/
-        tv.tv_sec = 0;
-        tv.tv_usec = 500000;
+            tv.tv_sec = 0;
+            tv.tv_usec = 500000;
 
-        ALOGD("%s: b4 select on camHal->fd + 1,fd: %d", __func__, camHal->fd);
+            ALOGD("%s: b4 select on camHal->fd + 1,fd: %d", __func__, camHal->fd);
 #if CAPTURE
-        r = select(camHal->fd + 1, &fds, NULL, NULL, &tv);
+            r = select(camHal->fd + 1, &fds, NULL, NULL, &tv);
 #else
-        r = select(1, NULL, NULL, NULL, &tv);
+            r = select(1, NULL, NULL, NULL, &tv);
 #endif /* CAPTURE */
-        ALOGD("%s: after select : %d", __func__, camHal->fd);
+            ALOGD("%s: after select : %d", __func__, camHal->fd);
 
-        if (-1 == r) {
-            if (EINTR == errno)
-                continue;
-            ALOGE("%s: FDSelect error: %d", __func__, errno);
-        }
+            if (-1 == r) {
+                ALOGE("%s: FDSelect error: %d", __func__, errno);
+            }
 
-        if (0 == r) {
-            ALOGD("%s: select timeout\n", __func__);
+            if (0 == r) {
+                ALOGD("%s: select timeout\n", __func__);
+            }
         }
 
-        /* Protect the context for one iteration of preview loop */
-        /* this gets unlocked at the end of the while */
-        Mutex::Autolock autoLock(camHal->lock);
+        /* Protect the context while dequeuing the capture buffer */
+        camHal->lock.lock();
 
     /************************************************************************/
     /* - Check if any preview thread commands are set. If set, process      */
@@ -2091,6 +2623,15 @@ static void * previewloop(void *hcamHal)
         {
             /* command is serviced. Hence command pending = 0  */
             camHal->prvwCmdPending--;
+            if(slot)
+                usbCamPipelineAbort(pipe);
+
+            /* frames in flight use the capture and display buffers. The */
+            /* display stage may need the lock in the preview callback   */
+            camHal->lock.unlock();
+            usbCamPipelineDrain(pipe);
+            camHal->lock.lock();
+
             //sempost(ack)
             if(USB_CAM_PREVIEW_EXIT == camHal->prvwCmd){
                 /* unlock before exiting the thread */
@@ -2103,151 +2644,63 @@ static void * previewloop(void *hcamHal)
                     ALOGE("%s: prvwThreadTakePictureInternal returned error",
                     __func__);
             }
+            camHal->lock.unlock();
+            continue;
+        }
+
+        /* pipeline is full or paused */
+        if(!slot) {
+            camHal->lock.unlock();
+            continue;
         }
 
         /* Null check on preview window. If null, sleep */
         if(!camHal->window) {
             ALOGD("%s: sleeping coz camHal->window = NULL",__func__);
+            usbCamPipelineAbort(pipe);
             camHal->lock.unlock();
             sleep(2);
             continue;
         }
-#if DISPLAY
-    /************************************************************************/
-    /* - Dequeue display buffer from surface                                */
-    /************************************************************************/
-        if(0 == get_buf_from_display(camHal, &buffer_id)) {
-            ALOGD("%s: get_buf_from_display success: %d",
-                 __func__, buffer_id);
-        }else{
-            ALOGE("%s: get_buf_from_display failed. Skipping the loop",
-                 __func__);
+
+        memset(&frame, 0, sizeof(frame));
+#if CAPTURE
+        if(camHal->dmabufq) {
+            uint32_t bytesused = 0;
+
+            /* the frame is in a display buffer, index is its id */
+            if (USBCAM_DMABUF_NO_ERROR != usbCamDmabufDequeue(
+                    camHal->dmabufq, &frame.index, &bytesused)) {
+                usbCamPipelineAbort(pipe);
+                camHal->lock.unlock();
+                continue;
+            }
+            frame.bytesused = bytesused;
+            camHal->lock.unlock();
+            usbCamPipelineSubmit(pipe, &frame);
             continue;
         }
-#endif
 
-#if CAPTURE
     /************************************************************************/
     /* - Dequeue capture buffer from USB camera                             */
     /************************************************************************/
-        if (0 == get_buf_from_cam(camHal))
+        if (0 == get_buf_from_cam(camHal)) {
             ALOGD("%s: get_buf_from_cam success", __func__);
-        else
+        } else {
             ALOGE("%s: get_buf_from_cam error", __func__);
-#endif
-
-#if FILE_DUMP_CAMERA
-        /* Debug code to dump frames from camera */
-        {
-            static int frame_cnt = 0;
-            /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
-            fileDump("/data/USBcam.yuv",
-            (char*)camHal->buffers[camHal->curCaptureBuf.index].data,
-            camHal->prevWidth * camHal->prevHeight * 1.5,
-            &frame_cnt);
-        }
-#endif
-
-#if MEMSET
-        static int color = 30;
-        color += 50;
-        if(color > 200) {
-            color = 30;
-        }
-        ALOGE("%s: Setting to the color: %d\n", __func__, color);
-        /* currently hardcoded for format of type Bytes-Per-Pixel = 1.5 */
-        memset(camHal->previewMem.camera_memory[buffer_id]->data,
-               color, camHal->dispWidth * camHal->dispHeight * 1.5 + 2 * 1024);
-#else
-        convert_data_frm_cam_to_disp(camHal, buffer_id);
-        ALOGD("%s: Copied data to buffer_id: %d", __func__, buffer_id);
-#endif
-
-#if FILE_DUMP_B4_DISP
-        /* Debug code to dump display buffers */
-        {
-            static int frame_cnt = 0;
-            /* currently hardcoded for Bytes-Per-Pixel = 1.5 */
-            fileDump("/data/display.yuv",
-                (char*) camHal->previewMem.camera_memory[buffer_id]->data,
-                camHal->dispWidth * camHal->dispHeight * 1.5,
-                &frame_cnt);
-            ALOGD("%s: Written buf_index: %d ", __func__, buffer_id);
-        }
-#endif
-
-#if DISPLAY
-    /************************************************************************/
-    /* - Enqueue display buffer back to surface                             */
-    /************************************************************************/
-       if(0 == put_buf_to_display(camHal, buffer_id)) {
-            ALOGD("%s: put_buf_to_display success: %d", __func__, buffer_id);
-        }
-        else
-            ALOGE("%s: put_buf_to_display error", __func__);
-#endif
-
-#if CAPTURE
-     /************************************************************************/
-    /* - Enqueue capture buffer back to USB camera                          */
-    /************************************************************************/
-       if(0 == put_buf_to_cam(camHal)) {
-            ALOGD("%s: put_buf_to_cam success", __func__);
+            usbCamPipelineAbort(pipe);
+            camHal->lock.unlock();
+            continue;
         }
-        else
-            ALOGE("%s: put_buf_to_cam error", __func__);
+        frame.index     = camHal->curCaptureBuf.index;
+        frame.bytesused = camHal->curCaptureBuf.bytesused;
 #endif
+        camHal->lock.unlock();
 
-#if CALL_BACK
     /************************************************************************/
-    /* - If preview frames callback is requested, callback with prvw buffers*/
+    /* - Submit the frame to the process and display stages                 */
     /************************************************************************/
-        /* TBD: change the 1.5 hardcoding to Bytes Per Pixel */
-        int previewBufSize = camHal->prevWidth * camHal->prevHeight * 1.5;
-
-        msgType |=  CAMERA_MSG_PREVIEW_FRAME;
-
-        if(previewBufSize !=
-            camHal->previewMem.private_buffer_handle[buffer_id]->size) {
-
-            previewMem = camHal->get_memory(
-                camHal->previewMem.private_buffer_handle[buffer_id]->fd,
-                previewBufSize,
-                1,
-                camHal->cb_ctxt);
-
-              if (!previewMem || !previewMem->data) {
-                  ALOGE("%s: get_memory failed.\n", __func__);
-              }
-              else {
-                  data = previewMem;
-                  ALOGD("%s: GetMemory successful. data = %p",
-                            __func__, data);
-                  ALOGD("%s: previewBufSize = %d, priv_buf_size: %d",
-                    __func__, previewBufSize,
-                    camHal->previewMem.private_buffer_handle[buffer_id]->size);
-              }
-        }
-        else{
-            data =   camHal->previewMem.camera_memory[buffer_id];
-            ALOGD("%s: No GetMemory, no invalid fmt. data = %p, idx=%d",
-                __func__, data, buffer_id);
-        }
-        /* Unlock and lock around the callback. */
-        /* Sometimes 'disable_msg' is issued in the callback context, */
-        /* leading to deadlock */
-        camHal->lock.unlock();
-        if((camHal->msgEnabledFlag & CAMERA_MSG_PREVIEW_FRAME) &&
-            camHal->data_cb){
-            ALOGD("%s: before data callback", __func__);
-            camHal->data_cb(msgType, data, 0,metadata, camHal->cb_ctxt);
-            ALOGD("%s: after data callback: %p", __func__, camHal->data_cb);
-        }
-        camHal->lock.lock();
-        if (previewMem)
-            previewMem->release(previewMem);
-#endif
-
+        usbCamPipelineSubmit(pipe, &frame);
     }//while(1)
     ALOGD("%s: X", __func__);
     return (void *)0;
@@ -2423,6 +2876,8 @@ static int launchTakePictureThread(camera_hardware_t *camHal)
         return -1;
     }
 
+    init_converter(camHal);
+
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     /* create the thread in detatched state, when the thread exits all */
@@ -2456,6 +2911,8 @@ static void * takePictureThread(void *hcamHal)
     int                 msgType     = 0;
     int                 jpegLength  = 0;
     QCameraHalMemInfo_t *mem_info   = NULL;
+    int                 exportFd    = -1;
+    int                 ionAllocated = 0;
 
     camHal = (camera_hardware_t *)hcamHal;
     ALOGI("%s: E", __func__);
@@ -2549,36 +3006,56 @@ static void * takePictureThread(void *hcamHal)
     /* - Send capture buffer to JPEG encoder for JPEG compression           */
     /************************************************************************/
     mem_info = &camHal->pictMem.mem_info[0];
-    mem_info->size = MAX_JPEG_BUFFER_SIZE;
-
-    rc = allocate_ion_memory(mem_info,
-                        ((0x1 << CAMERA_ZSL_ION_HEAP_ID) |
-                        (0x1 << CAMERA_ZSL_ION_FALLBACK_HEAP_ID)));
-    if(rc)
-        ALOGE("%s: ION memory allocation failed", __func__);
+    camHal->pictMem.camera_memory[0] = NULL;
 
-    camHal->pictMem.camera_memory[0] = camHal->get_memory(
-                        mem_info->fd, mem_info->size, 1, camHal->cb_ctxt);
+#if JPEG_ON_USB_CAMERA && !FREAD_JPEG_PICTURE
+    /* The capture buffer already holds the JPEG. Hand it out by reference */
+    /* when the driver can export it                                       */
+    if(USBCAM_DMABUF_NO_ERROR == usbCamV4l2ExportBuf(camHal->fd,
+                            camHal->curCaptureBuf.index, &exportFd)) {
+        camHal->pictMem.camera_memory[0] = camHal->get_memory(
+                            exportFd, camHal->curCaptureBuf.bytesused,
+                            1, camHal->cb_ctxt);
+        if(camHal->pictMem.camera_memory[0]) {
+            jpegLength = camHal->curCaptureBuf.bytesused;
+            ALOGD("%s: JPEG of %d bytes exported", __func__, jpegLength);
+        }
+    }
     if(!camHal->pictMem.camera_memory[0])
-        ALOGE("%s: get_mem failed", __func__);
+#endif
+    {
+        ionAllocated = 1;
+        mem_info->size = MAX_JPEG_BUFFER_SIZE;
+
+        rc = allocate_ion_memory(mem_info,
+                            ((0x1 << CAMERA_ZSL_ION_HEAP_ID) |
+                            (0x1 << CAMERA_ZSL_ION_FALLBACK_HEAP_ID)));
+        if(rc)
+            ALOGE("%s: ION memory allocation failed", __func__);
+
+        camHal->pictMem.camera_memory[0] = camHal->get_memory(
+                            mem_info->fd, mem_info->size, 1, camHal->cb_ctxt);
+        if(!camHal->pictMem.camera_memory[0])
+            ALOGE("%s: get_mem failed", __func__);
 
 #if FREAD_JPEG_PICTURE
-    jpegLength = readFromFile("/data/tempVGA.jpeg",
-                    (char*)camHal->pictMem.camera_memory[0]->data,
-                    camHal->pictMem.camera_memory[0]->size);
-    camHal->pictMem.camera_memory[0]->size = jpegLength;
+        jpegLength = readFromFile("/data/tempVGA.jpeg",
+                        (char*)camHal->pictMem.camera_memory[0]->data,
+                        camHal->pictMem.camera_memory[0]->size);
+        camHal->pictMem.camera_memory[0]->size = jpegLength;
 
 #elif JPEG_ON_USB_CAMERA
-    memcpy((char*)camHal->pictMem.camera_memory[0]->data,
-            (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
-            camHal->curCaptureBuf.bytesused);
-    camHal->pictMem.camera_memory[0]->size = camHal->curCaptureBuf.bytesused;
-    jpegLength = camHal->curCaptureBuf.bytesused;
+        memcpy((char*)camHal->pictMem.camera_memory[0]->data,
+                (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
+                camHal->curCaptureBuf.bytesused);
+        camHal->pictMem.camera_memory[0]->size = camHal->curCaptureBuf.bytesused;
+        jpegLength = camHal->curCaptureBuf.bytesused;
 
 #else
-    rc = encodeJpeg(camHal);
-    ERROR_CHECK_EXIT_THREAD(rc, "jpeg_encode");
+        rc = encodeJpeg(camHal);
+        ERROR_CHECK_EXIT_THREAD(rc, "jpeg_encode");
 #endif
+    }
     if(jpegLength <= 0)
         ALOGI("%s: jpegLength : %d", __func__, jpegLength);
 
@@ -2604,14 +3081,27 @@ static void * takePictureThread(void *hcamHal)
         camHal->pictMem.camera_memory[0]->release(
             camHal->pictMem.camera_memory[0]);
 
-    rc = deallocate_ion_memory(mem_info);
-    if(rc)
-        ALOGE("%s: ION memory de-allocation failed", __func__);
+    if(exportFd >= 0)
+        close(exportFd);
+
+    if(ionAllocated) {
+        rc = deallocate_ion_memory(mem_info);
+        if(rc)
+            ALOGE("%s: ION memory de-allocation failed", __func__);
+    }
 
     /************************************************************************/
     /* - Enqueue capture buffer back to USB camera                          */
     /************************************************************************/
-    if(0 == put_buf_to_cam(camHal)) {
+    /* The data callback is oneway, the app may still be reading an        */
+    /* exported JPEG. Keep its index out of the queue so the driver cannot  */
+    /* write to it, the stream is stopped below and the dma-buf keeps the   */
+    /* memory until the app releases it                                     */
+    if(!ionAllocated) {
+        ALOGD("%s: exported buffer %d not queued", __func__,
+                camHal->curCaptureBuf.index);
+    }
+    else if(0 == put_buf_to_cam(camHal)) {
         ALOGD("%s: put_buf_to_cam success", __func__);
     }
     else
@@ -2827,7 +3317,7 @@ int encodeJpeg(camera_hardware_t *camHal)
         return -1;
     }
 
-    rc = convert_YUYV_to_420_NV12(
+    rc = convert_YUYV_to_420_NV12(camHal,
         (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
         (char *)jpegInMem->data, camHal->pictWidth, camHal->pictHeight);
     ERROR_CHECK_EXIT(rc, "convert_YUYV_to_420_NV12");
@@ -0,0 +1,72 @@
+#usb camera color conversion host test and benchmark
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Werror -Wno-unused-parameter -O2
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../inc
+
+LOCAL_SRC_FILES := usbcam_convert_test.cpp ../src/QCameraUsbConvert.cpp
+
+LOCAL_MODULE := usbcam-convert-test
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#usb camera preview pipeline host test
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Werror -Wno-unused-parameter -O2
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../inc
+
+LOCAL_SRC_FILES := usbcam_pipeline_test.cpp usbcam_fake_uvc.cpp \
+        ../src/QCameraUsbPipeline.cpp ../src/QCameraUsbConvert.cpp
+
+LOCAL_MODULE := usbcam-pipeline-test
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread -lrt
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#usb camera MJPEG decoder benchmark, runs on target
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Werror -Wno-unused-parameter
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../inc
+LOCAL_C_INCLUDES += $(TARGET_OUT_HEADERS)/mm-still/jpeg
+
+LOCAL_SRC_FILES := usbcam_mjpegd_test.cpp ../src/QCameraMjpegDecode.cpp
+
+LOCAL_MODULE := usbcam-mjpegd-test
+LOCAL_SHARED_LIBRARIES := liblog libcutils libmmjpeg
+
+include $(BUILD_EXECUTABLE)
+
+#usb camera DMABUF capture host test, needs a V4L2 device producing NV21
+#and /dev/udmabuf, e.g. vivid on a desktop kernel
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Werror -Wno-unused-parameter -O2
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../inc
+
+LOCAL_SRC_FILES := usbcam_dmabuf_test.cpp ../src/QCameraUsbDmabuf.cpp
+
+LOCAL_MODULE := usbcam-dmabuf-test
+LOCAL_STATIC_LIBRARIES := liblog
+
+include $(BUILD_HOST_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
@@ -0,0 +1,378 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host test of the usb camera color conversion. Checks that the SIMD and
+ * the multi threaded paths give the same bytes as the scalar reference,
+ * and the reference the same bytes as the original YUYV to NV21 loop,
+ * then reports the throughput of each path. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "QCameraUsbConvert.h"
+
+/* untouched bytes of the output buffers */
+#define FILL_BYTE 0xA5
+
+typedef struct {
+    int width;
+    int height;
+    int iterations;
+    int threads;
+} convert_test_input_t;
+
+static const char *srcNames[] = { "yuyv", "uyvy" };
+static const char *dstNames[] = { "nv12", "nv21", "yv12" };
+
+static void usbcam_convert_test_print_usage()
+{
+    fprintf(stderr, "Usage: program_name [options]\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -W WIDTH\t\tbenchmark width, default 1920\n");
+    fprintf(stderr, "  -H HEIGHT\t\tbenchmark height, default 1080\n");
+    fprintf(stderr, "  -n COUNT\t\tbenchmark iterations, default 50\n");
+    fprintf(stderr, "  -t THREADS\t\tconversion threads, default online cpus\n");
+    fprintf(stderr, "\n");
+}
+
+static uint64_t nowUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* The conversion the HAL did before, kept as the oracle for YUYV to NV21 */
+static void legacyConvert(const uint8_t *in_buf, uint8_t *out_buf, int wd, int ht)
+{
+    int row, col, uv_row;
+
+    for(row = 0; row < ht; row++)
+        for(col = 0; col < wd * 2; col += 2)
+            out_buf[row * wd + col / 2] = in_buf[row * wd * 2 + col];
+
+    for(row = 0, uv_row = ht; row < ht; row += 2, uv_row++)
+        for(col = 1; col < wd * 2; col += 4) {
+            out_buf[uv_row * wd + col / 2]     = in_buf[row * wd * 2 + col + 2];
+            out_buf[uv_row * wd + col / 2 + 1] = in_buf[row * wd * 2 + col];
+        }
+}
+
+static void fillSource(uint8_t *buf, size_t len, unsigned int seed)
+{
+    size_t i;
+
+    for(i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+/* Output buffer size for the params, including the stride padding */
+static size_t outputSize(const usbcam_convert_params_t *p)
+{
+    int outHeight = p->height / p->downscale;
+
+    if(USBCAM_CONVERT_DST_YV12 == p->dstFmt)
+        return (size_t)p->dstYStride * outHeight +
+               (size_t)p->dstCStride * outHeight;
+    return (size_t)p->dstYStride * outHeight +
+           (size_t)p->dstCStride * outHeight / 2;
+}
+
+/******************************************************************************
+ * Converts one frame with the reference and with the dispatched kernel on
+ * the converter and compares the whole output buffers.
+ *****************************************************************************/
+static int checkCase(void *conv, int width, int height, int srcPad,
+                     int dstPad, int srcFmt, int dstFmt, int scale)
+{
+    usbcam_convert_params_t p;
+    uint8_t *src, *ref, *out;
+    size_t srcLen, outLen;
+    int outWidth = width / scale;
+    int rc = -1;
+
+    memset(&p, 0, sizeof(p));
+    p.srcStride     = width * 2 + srcPad;
+    p.srcFmt        = (usbcam_convert_src_fmt_t)srcFmt;
+    p.width         = width;
+    p.height        = height;
+    p.downscale     = scale;
+    p.dstYStride    = outWidth + dstPad;
+    p.dstCStride    = (USBCAM_CONVERT_DST_YV12 == dstFmt) ?
+                      outWidth / 2 + dstPad : outWidth + dstPad;
+    p.dstFmt        = (usbcam_convert_dst_fmt_t)dstFmt;
+
+    srcLen = (size_t)p.srcStride * height;
+    outLen = outputSize(&p);
+    src = (uint8_t *)malloc(srcLen);
+    ref = (uint8_t *)malloc(outLen);
+    out = (uint8_t *)malloc(outLen);
+    if(!src || !ref || !out) {
+        fprintf(stderr, "no memory\n");
+        goto exit;
+    }
+    fillSource(src, srcLen, width * 31 + height);
+    memset(ref, FILL_BYTE, outLen);
+    memset(out, FILL_BYTE, outLen);
+
+    p.src = src;
+    p.dstY = ref;
+    if(usbCamConvertFrameRef(&p)) {
+        fprintf(stderr, "reference failed\n");
+        goto exit;
+    }
+    p.dstY = out;
+    if(usbCamConvertFrame(conv, &p)) {
+        fprintf(stderr, "conversion failed\n");
+        goto exit;
+    }
+    if(memcmp(ref, out, outLen)) {
+        size_t i;
+        for(i = 0; i < outLen && ref[i] == out[i]; i++);
+        fprintf(stderr, "%dx%d %s->%s /%d pad %d/%d: mismatch at %zu\n",
+                width, height, srcNames[srcFmt], dstNames[dstFmt], scale,
+                srcPad, dstPad, i);
+        goto exit;
+    }
+    rc = 0;
+
+exit:
+    free(out);
+    free(ref);
+    free(src);
+    return rc;
+}
+
+static int checkLegacy(int width, int height)
+{
+    usbcam_convert_params_t p;
+    size_t srcLen = (size_t)width * height * 2;
+    size_t outLen = (size_t)width * height * 3 / 2;
+    uint8_t *src = (uint8_t *)malloc(srcLen);
+    uint8_t *ref = (uint8_t *)malloc(outLen);
+    uint8_t *out = (uint8_t *)malloc(outLen);
+    int rc = -1;
+
+    if(!src || !ref || !out)
+        goto exit;
+    fillSource(src, srcLen, 7);
+    legacyConvert(src, ref, width, height);
+
+    memset(&p, 0, sizeof(p));
+    p.src       = src;
+    p.srcFmt    = USBCAM_CONVERT_SRC_YUYV;
+    p.width     = width;
+    p.height    = height;
+    p.downscale = 1;
+    p.dstY      = out;
+    p.dstFmt    = USBCAM_CONVERT_DST_NV21;
+    if(usbCamConvertFrameRef(&p) == 0 && memcmp(ref, out, outLen) == 0)
+        rc = 0;
+    else
+        fprintf(stderr, "%dx%d differs from the original loop\n",
+                width, height);
+
+exit:
+    free(out);
+    free(ref);
+    free(src);
+    return rc;
+}
+
+static int runChecks(void *conv)
+{
+    static const int sizes[][2] = {
+        { 4, 4 }, { 12, 4 }, { 36, 8 }, { 68, 12 }, { 100, 20 },
+        { 640, 480 }, { 1284, 724 }, { 1280, 720 },
+    };
+    int s, srcFmt, dstFmt, scale, pad, failed = 0, cases = 0;
+
+    for(s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        failed += checkLegacy(sizes[s][0], sizes[s][1]) ? 1 : 0;
+        cases++;
+        for(srcFmt = 0; srcFmt < 2; srcFmt++)
+        for(dstFmt = 0; dstFmt < 3; dstFmt++)
+        for(scale = 1; scale <= 2; scale++)
+        for(pad = 0; pad <= 6; pad += 6) {
+            failed += checkCase(conv, sizes[s][0], sizes[s][1], pad * 2, pad,
+                                srcFmt, dstFmt, scale) ? 1 : 0;
+            cases++;
+        }
+    }
+    fprintf(stderr, "%-25s%d of %d cases\n", "Bit exact: ",
+            cases - failed, cases);
+    return failed ? -1 : 0;
+}
+
+typedef int (*bench_fn)(void *conv, const usbcam_convert_params_t *p);
+
+static int benchLegacy(void *conv, const usbcam_convert_params_t *p)
+{
+    legacyConvert(p->src, p->dstY, p->width, p->height);
+    return 0;
+}
+
+static int benchRef(void *conv, const usbcam_convert_params_t *p)
+{
+    return usbCamConvertFrameRef(p);
+}
+
+static int benchFrame(void *conv, const usbcam_convert_params_t *p)
+{
+    return usbCamConvertFrame(conv, p);
+}
+
+static void runBench(const char *name, bench_fn fn, void *conv,
+                     const usbcam_convert_params_t *p, int iterations)
+{
+    uint64_t start, us, min_us = (uint64_t)-1, total_us = 0;
+    int i;
+
+    for(i = 0; i < iterations; i++) {
+        start = nowUs();
+        fn(conv, p);
+        us = nowUs() - start;
+        total_us += us;
+        if(us < min_us)
+            min_us = us;
+    }
+    fprintf(stderr, "%-25s%llu us (min %llu us) %.1f MP/s\n", name,
+            (unsigned long long)(total_us / iterations),
+            (unsigned long long)min_us,
+            (double)p->width * p->height * iterations /
+            (total_us ? (double)total_us : 1.0));
+}
+
+static int usbcam_convert_test_get_input(int argc, char *argv[],
+                                         convert_test_input_t *p_test)
+{
+    int c;
+
+    while((c = getopt(argc, argv, "W:H:n:t:")) != -1) {
+        switch(c) {
+        case 'W':
+            p_test->width = atoi(optarg);
+            break;
+        case 'H':
+            p_test->height = atoi(optarg);
+            break;
+        case 'n':
+            p_test->iterations = atoi(optarg);
+            break;
+        case 't':
+            p_test->threads = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if(p_test->width <= 0 || p_test->height <= 0 || p_test->width % 4 ||
+       p_test->height % 4 || p_test->iterations <= 0)
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    convert_test_input_t test;
+    usbcam_convert_params_t p;
+    void *conv = NULL, *single = NULL;
+    uint8_t *src = NULL, *out = NULL;
+    size_t srcLen;
+    int ret = -1;
+
+    memset(&test, 0, sizeof(test));
+    test.width = 1920;
+    test.height = 1080;
+    test.iterations = 50;
+    if(usbcam_convert_test_get_input(argc, argv, &test)) {
+        usbcam_convert_test_print_usage();
+        return 1;
+    }
+
+    if(usbCamConvertInit(&conv, test.threads) ||
+       usbCamConvertInit(&single, 1)) {
+        fprintf(stderr, "converter init failed\n");
+        goto exit;
+    }
+
+    fprintf(stderr, "%-25s%s\n", "Kernel: ", usbCamConvertImplName());
+    if(runChecks(conv) || runChecks(single))
+        goto exit;
+    if(USBCAM_CONVERT_IMPL_SIMD == usbCamConvertGetImpl()) {
+        /* threaded scalar must match as well */
+        usbCamConvertSetImpl(USBCAM_CONVERT_IMPL_SCALAR);
+        if(runChecks(conv))
+            goto exit;
+        usbCamConvertSetImpl(USBCAM_CONVERT_IMPL_AUTO);
+    }
+
+    srcLen = (size_t)test.width * test.height * 2;
+    src = (uint8_t *)malloc(srcLen);
+    out = (uint8_t *)malloc((size_t)test.width * test.height * 3 / 2);
+    if(!src || !out) {
+        fprintf(stderr, "no memory\n");
+        goto exit;
+    }
+    fillSource(src, srcLen, 1);
+
+    memset(&p, 0, sizeof(p));
+    p.src       = src;
+    p.srcFmt    = USBCAM_CONVERT_SRC_YUYV;
+    p.width     = test.width;
+    p.height    = test.height;
+    p.downscale = 1;
+    p.dstY      = out;
+    p.dstFmt    = USBCAM_CONVERT_DST_NV21;
+
+    fprintf(stderr, "%-25s%dx%d yuyv->nv21\n", "Image: ",
+            test.width, test.height);
+    runBench("Original loop: ", benchLegacy, NULL, &p, test.iterations);
+    runBench("Scalar reference: ", benchRef, NULL, &p, test.iterations);
+    runBench("Dispatched, 1 thread: ", benchFrame, single, &p,
+             test.iterations);
+    runBench("Dispatched, threaded: ", benchFrame, conv, &p,
+             test.iterations);
+    p.downscale = 2;
+    runBench("Downscale, threaded: ", benchFrame, conv, &p,
+             test.iterations);
+    ret = 0;
+
+exit:
+    usbCamConvertDestroy(single);
+    usbCamConvertDestroy(conv);
+    free(out);
+    free(src);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret;
+}
@@ -0,0 +1,387 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Test of the DMABUF capture path against a V4L2 capture device that
+ * produces NV21, e.g. the vivid driver on a desktop kernel. Frames are
+ * first captured into MMAP buffers and copied out, as the preview does
+ * when DMABUF is off, then captured straight into udmabuf buffers that
+ * stand in for the display buffers. The MMAP run also checks that an
+ * exported buffer maps the same memory as the driver buffer, which the
+ * snapshot relies on. */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <linux/udmabuf.h>
+#include <linux/videodev2.h>
+#include "QCameraUsbDmabuf.h"
+
+#define DMABUF_TEST_CAP_BUFS    4
+#define DMABUF_TEST_DISP_BUFS   3
+
+typedef struct {
+    const char *device;
+    int width;
+    int height;
+    int frames;
+} dmabuf_test_input_t;
+
+typedef struct {
+    int fd;
+    uint32_t frameSize;
+    uint8_t *copy;
+} dmabuf_test_t;
+
+static void usbcam_dmabuf_test_print_usage()
+{
+    fprintf(stderr, "Usage: program_name [options]\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -d DEVICE\t\tV4L2 capture device, default /dev/video0\n");
+    fprintf(stderr, "  -W WIDTH\t\tframe width, default 640\n");
+    fprintf(stderr, "  -H HEIGHT\t\tframe height, default 480\n");
+    fprintf(stderr, "  -n FRAMES\t\tframes per run, default 100\n");
+    fprintf(stderr, "\n");
+}
+
+static uint64_t nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int xioctl(int fd, unsigned long cmd, void *arg)
+{
+    int rc;
+
+    do {
+        rc = ioctl(fd, cmd, arg);
+    } while(-1 == rc && EINTR == errno);
+    return rc;
+}
+
+static int waitFrame(int fd)
+{
+    fd_set fds;
+    struct timeval tv;
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    return (select(fd + 1, &fds, NULL, NULL, &tv) > 0) ? 0 : -1;
+}
+
+static int streamOn(int fd, int on)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    return xioctl(fd, on ? VIDIOC_STREAMON : VIDIOC_STREAMOFF, &type);
+}
+
+/* Creates a memfd backed dmabuf */
+static int allocDmabuf(int udmabufFd, uint32_t size)
+{
+    struct udmabuf_create create;
+    int memfd, buf;
+
+    memfd = memfd_create("usbcam_dmabuf_test", MFD_ALLOW_SEALING);
+    if(memfd < 0)
+        return -1;
+    if(ftruncate(memfd, size) < 0 ||
+       fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        close(memfd);
+        return -1;
+    }
+    memset(&create, 0, sizeof(create));
+    create.memfd = memfd;
+    create.size = size;
+    buf = ioctl(udmabufFd, UDMABUF_CREATE, &create);
+    close(memfd);
+    return buf;
+}
+
+/* Captures into MMAP buffers and copies each frame out */
+static int runMmap(dmabuf_test_t *t, int frames)
+{
+    struct v4l2_requestbuffers reqBufs;
+    struct v4l2_buffer buf;
+    void *data[DMABUF_TEST_CAP_BUFS];
+    uint32_t len[DMABUF_TEST_CAP_BUFS];
+    uint64_t start, copyUs = 0;
+    int i, n = 0, expFd = -1, ret = -1;
+    void *exp;
+
+    memset(&reqBufs, 0, sizeof(reqBufs));
+    reqBufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    reqBufs.memory = V4L2_MEMORY_MMAP;
+    reqBufs.count = DMABUF_TEST_CAP_BUFS;
+    if(xioctl(t->fd, VIDIOC_REQBUFS, &reqBufs) ||
+       reqBufs.count > DMABUF_TEST_CAP_BUFS) {
+        fprintf(stderr, "MMAP VIDIOC_REQBUFS failed\n");
+        return -1;
+    }
+    for(i = 0; i < (int)reqBufs.count; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        xioctl(t->fd, VIDIOC_QUERYBUF, &buf);
+        len[i] = buf.length;
+        data[i] = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       t->fd, buf.m.offset);
+        xioctl(t->fd, VIDIOC_QBUF, &buf);
+    }
+    streamOn(t->fd, 1);
+
+    while(n < frames && !waitFrame(t->fd)) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if(xioctl(t->fd, VIDIOC_DQBUF, &buf))
+            continue;
+        start = nowUs();
+        memcpy(t->copy, data[buf.index],
+               buf.bytesused < t->frameSize ? buf.bytesused : t->frameSize);
+        copyUs += nowUs() - start;
+
+        /* the snapshot hands out the exported buffer instead of a copy */
+        if(n == 0 &&
+           USBCAM_DMABUF_NO_ERROR == usbCamV4l2ExportBuf(t->fd, buf.index, &expFd)) {
+            exp = mmap(NULL, len[buf.index], PROT_READ, MAP_SHARED, expFd, 0);
+            if(MAP_FAILED == exp ||
+               memcmp(exp, data[buf.index], buf.bytesused)) {
+                fprintf(stderr, "exported buffer differs\n");
+                n = -1;
+            }
+            if(MAP_FAILED != exp)
+                munmap(exp, len[buf.index]);
+            close(expFd);
+            if(n < 0)
+                break;
+        }
+        xioctl(t->fd, VIDIOC_QBUF, &buf);
+        n++;
+    }
+    streamOn(t->fd, 0);
+
+    for(i = 0; i < (int)reqBufs.count; i++)
+        munmap(data[i], len[i]);
+    reqBufs.count = 0;
+    xioctl(t->fd, VIDIOC_REQBUFS, &reqBufs);
+
+    if(n == frames) {
+        fprintf(stderr, "MMAP and copy:\n");
+        fprintf(stderr, "  %-23s%d\n", "Frames: ", n);
+        fprintf(stderr, "  %-23s%llu us/frame\n", "Copy: ",
+                (unsigned long long)(copyUs / n));
+        fprintf(stderr, "  %-23s%s\n", "Export: ",
+                expFd >= 0 ? "same memory" : "not supported");
+        ret = 0;
+    }
+    return ret;
+}
+
+static void releaseDispBuf(void *ctx, int cookie)
+{
+    int *free = (int *)ctx;
+
+    free[cookie] = 1;
+}
+
+/* Captures straight into dmabufs, fed the way the preview feeds display
+ * buffers */
+static int runDmabuf(dmabuf_test_t *t, int frames)
+{
+    void *q = NULL;
+    int bufs[DMABUF_TEST_DISP_BUFS];
+    int isFree[DMABUF_TEST_DISP_BUFS];
+    uint32_t bytesused;
+    uint64_t start, halUs = 0;
+    int udmabufFd, i, cookie, n = 0, ret = -1;
+    uint32_t size = (t->frameSize + 4095) & ~4095;
+
+    for(i = 0; i < DMABUF_TEST_DISP_BUFS; i++)
+        bufs[i] = -1;
+    udmabufFd = open("/dev/udmabuf", O_RDWR);
+    if(udmabufFd < 0) {
+        fprintf(stderr, "cannot open /dev/udmabuf\n");
+        return -1;
+    }
+    for(i = 0; i < DMABUF_TEST_DISP_BUFS; i++) {
+        bufs[i] = allocDmabuf(udmabufFd, size);
+        isFree[i] = 1;
+        if(bufs[i] < 0) {
+            fprintf(stderr, "udmabuf allocation failed\n");
+            goto exit;
+        }
+    }
+    if(usbCamDmabufInit(&q, t->fd, DMABUF_TEST_DISP_BUFS - 1)) {
+        fprintf(stderr, "usbCamDmabufInit failed\n");
+        goto exit;
+    }
+    streamOn(t->fd, 1);
+
+    while(n < frames) {
+        start = nowUs();
+        for(i = 0; i < DMABUF_TEST_DISP_BUFS &&
+                   usbCamDmabufQueued(q) < DMABUF_TEST_DISP_BUFS - 1; i++) {
+            if(isFree[i] && !usbCamDmabufQueue(q, bufs[i], size, i))
+                isFree[i] = 0;
+        }
+        halUs += nowUs() - start;
+        if(waitFrame(t->fd))
+            break;
+        start = nowUs();
+        if(usbCamDmabufDequeue(q, &cookie, &bytesused))
+            continue;
+        halUs += nowUs() - start;
+        if(bytesused < t->frameSize) {
+            fprintf(stderr, "short frame: %u bytes\n", bytesused);
+            break;
+        }
+        /* displayed and back from the window */
+        isFree[cookie] = 1;
+        n++;
+    }
+    streamOn(t->fd, 0);
+    usbCamDmabufFlush(q, releaseDispBuf, isFree);
+    usbCamDmabufDestroy(q);
+
+    if(n == frames) {
+        fprintf(stderr, "DMABUF:\n");
+        fprintf(stderr, "  %-23s%d\n", "Frames: ", n);
+        fprintf(stderr, "  %-23s%llu us/frame\n", "Queue and dequeue: ",
+                (unsigned long long)(halUs / n));
+        ret = 0;
+    }
+
+exit:
+    for(i = 0; i < DMABUF_TEST_DISP_BUFS; i++)
+        if(bufs[i] >= 0)
+            close(bufs[i]);
+    close(udmabufFd);
+    return ret;
+}
+
+static int usbcam_dmabuf_test_get_input(int argc, char *argv[],
+                                        dmabuf_test_input_t *p_test)
+{
+    int c;
+
+    while((c = getopt(argc, argv, "d:W:H:n:")) != -1) {
+        switch(c) {
+        case 'd':
+            p_test->device = optarg;
+            break;
+        case 'W':
+            p_test->width = atoi(optarg);
+            break;
+        case 'H':
+            p_test->height = atoi(optarg);
+            break;
+        case 'n':
+            p_test->frames = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if(p_test->width <= 0 || p_test->height <= 0 || p_test->frames <= 0)
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    dmabuf_test_input_t input;
+    dmabuf_test_t test;
+    struct v4l2_format fmt;
+    int ret = -1;
+
+    memset(&input, 0, sizeof(input));
+    input.device = "/dev/video0";
+    input.width  = 640;
+    input.height = 480;
+    input.frames = 100;
+    if(usbcam_dmabuf_test_get_input(argc, argv, &input)) {
+        usbcam_dmabuf_test_print_usage();
+        return 1;
+    }
+
+    memset(&test, 0, sizeof(test));
+    test.fd = open(input.device, O_RDWR | O_NONBLOCK);
+    if(test.fd < 0) {
+        fprintf(stderr, "cannot open %s\n", input.device);
+        goto exit;
+    }
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = input.width;
+    fmt.fmt.pix.height = input.height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_NV21;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if(xioctl(test.fd, VIDIOC_S_FMT, &fmt) ||
+       fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_NV21) {
+        fprintf(stderr, "%s does not capture NV21\n", input.device);
+        goto exit;
+    }
+    test.frameSize = fmt.fmt.pix.sizeimage;
+    test.copy = (uint8_t *)malloc(test.frameSize);
+    if(!test.copy) {
+        fprintf(stderr, "no memory\n");
+        goto exit;
+    }
+    fprintf(stderr, "%-25s%ux%u NV21, %u bytes\n", "Stream: ",
+            fmt.fmt.pix.width, fmt.fmt.pix.height, test.frameSize);
+
+    if(runMmap(&test, input.frames))
+        goto exit;
+    if(runDmabuf(&test, input.frames))
+        goto exit;
+    ret = 0;
+
+exit:
+    free(test.copy);
+    if(test.fd >= 0)
+        close(test.fd);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret;
+}
@@ -0,0 +1,259 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "usbcam_fake_uvc.h"
+
+#define FAKE_UVC_MAX_BUFFERS 16
+
+/* states of a buffer, as seen by the driver */
+#define BUF_DEQUEUED    0
+#define BUF_QUEUED      1
+#define BUF_FILLED      2
+
+struct usbcam_fake_uvc {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    pthread_t       thread;
+    int             exit;
+    uint8_t         *file;
+    int             fileFrames;
+    int             frameSize;
+    int             periodUs;
+    int             numBuffers;
+    uint8_t         *data[FAKE_UVC_MAX_BUFFERS];
+    int             state[FAKE_UVC_MAX_BUFFERS];
+    /* filled buffers in capture order */
+    int             filled[FAKE_UVC_MAX_BUFFERS];
+    int             filledHead;
+    int             filledCount;
+    uint32_t        frame;
+    uint32_t        lost;
+};
+
+static void addUs(struct timespec *ts, long us)
+{
+    ts->tv_nsec += (us % 1000000) * 1000;
+    ts->tv_sec  += us / 1000000 + ts->tv_nsec / 1000000000;
+    ts->tv_nsec %= 1000000000;
+}
+
+static void fillFrame(usbcam_fake_uvc_t *uvc, uint8_t *buf)
+{
+    int i;
+
+    if(uvc->file) {
+        memcpy(buf, uvc->file +
+               (size_t)(uvc->frame % uvc->fileFrames) * uvc->frameSize,
+               uvc->frameSize);
+        return;
+    }
+    /* luma ramp moving with the frame count, flat chroma */
+    for(i = 0; i + 1 < uvc->frameSize; i += 2) {
+        buf[i]      = (uint8_t)(i / 2 + uvc->frame * 4);
+        buf[i + 1]  = (i & 2) ? 160 : 96;
+    }
+}
+
+static void *producer(void *data)
+{
+    usbcam_fake_uvc_t *uvc = (usbcam_fake_uvc_t *)data;
+    struct timespec next;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while(1) {
+        addUs(&next, uvc->periodUs);
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) ==
+              EINTR);
+
+        pthread_mutex_lock(&uvc->lock);
+        if(uvc->exit) {
+            pthread_mutex_unlock(&uvc->lock);
+            break;
+        }
+        for(i = 0; i < uvc->numBuffers; i++)
+            if(BUF_QUEUED == uvc->state[i])
+                break;
+        if(i == uvc->numBuffers) {
+            uvc->lost++;
+        } else {
+            uvc->state[i] = BUF_FILLED;
+            pthread_mutex_unlock(&uvc->lock);
+            fillFrame(uvc, uvc->data[i]);
+            pthread_mutex_lock(&uvc->lock);
+            uvc->filled[(uvc->filledHead + uvc->filledCount) %
+                        FAKE_UVC_MAX_BUFFERS] = i;
+            uvc->filledCount++;
+            pthread_cond_broadcast(&uvc->cond);
+        }
+        uvc->frame++;
+        pthread_mutex_unlock(&uvc->lock);
+    }
+    return NULL;
+}
+
+usbcam_fake_uvc_t *usbCamFakeUvcOpen(const char *path, int frameSize,
+                                     int numBuffers, int fps)
+{
+    usbcam_fake_uvc_t *uvc;
+    FILE *fp;
+    long len;
+    int i;
+
+    if(frameSize <= 0 || fps <= 0 || numBuffers <= 0 ||
+       numBuffers > FAKE_UVC_MAX_BUFFERS)
+        return NULL;
+    uvc = (usbcam_fake_uvc_t *)calloc(1, sizeof(*uvc));
+    if(!uvc)
+        return NULL;
+    uvc->frameSize  = frameSize;
+    uvc->periodUs   = 1000000 / fps;
+    uvc->numBuffers = numBuffers;
+
+    if(path) {
+        fp = fopen(path, "rb");
+        if(!fp) {
+            fprintf(stderr, "cannot open %s\n", path);
+            goto error;
+        }
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        uvc->fileFrames = (int)(len / frameSize);
+        if(uvc->fileFrames > 0)
+            uvc->file = (uint8_t *)malloc((size_t)uvc->fileFrames * frameSize);
+        if(!uvc->file || fread(uvc->file, frameSize, uvc->fileFrames, fp) !=
+           (size_t)uvc->fileFrames) {
+            fprintf(stderr, "%s holds no complete frame\n", path);
+            fclose(fp);
+            goto error;
+        }
+        fclose(fp);
+    }
+
+    for(i = 0; i < numBuffers; i++) {
+        uvc->data[i] = (uint8_t *)malloc(frameSize);
+        if(!uvc->data[i])
+            goto error;
+        uvc->state[i] = BUF_QUEUED;
+    }
+    pthread_mutex_init(&uvc->lock, NULL);
+    pthread_cond_init(&uvc->cond, NULL);
+    if(pthread_create(&uvc->thread, NULL, producer, uvc)) {
+        pthread_cond_destroy(&uvc->cond);
+        pthread_mutex_destroy(&uvc->lock);
+        goto error;
+    }
+    return uvc;
+
+error:
+    for(i = 0; i < numBuffers; i++)
+        free(uvc->data[i]);
+    free(uvc->file);
+    free(uvc);
+    return NULL;
+}
+
+void usbCamFakeUvcClose(usbcam_fake_uvc_t *uvc)
+{
+    int i;
+
+    if(!uvc)
+        return;
+    pthread_mutex_lock(&uvc->lock);
+    uvc->exit = 1;
+    pthread_mutex_unlock(&uvc->lock);
+    pthread_join(uvc->thread, NULL);
+
+    pthread_cond_destroy(&uvc->cond);
+    pthread_mutex_destroy(&uvc->lock);
+    for(i = 0; i < uvc->numBuffers; i++)
+        free(uvc->data[i]);
+    free(uvc->file);
+    free(uvc);
+}
+
+int usbCamFakeUvcDequeue(usbcam_fake_uvc_t *uvc, int timeoutMs,
+                         int *index, int *bytesused)
+{
+    struct timespec ts;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    addUs(&ts, (long)timeoutMs * 1000);
+
+    pthread_mutex_lock(&uvc->lock);
+    while(!uvc->filledCount && ETIMEDOUT != rc)
+        rc = pthread_cond_timedwait(&uvc->cond, &uvc->lock, &ts);
+    if(!uvc->filledCount) {
+        pthread_mutex_unlock(&uvc->lock);
+        return 1;
+    }
+    *index = uvc->filled[uvc->filledHead];
+    uvc->filledHead = (uvc->filledHead + 1) % FAKE_UVC_MAX_BUFFERS;
+    uvc->filledCount--;
+    uvc->state[*index] = BUF_DEQUEUED;
+    *bytesused = uvc->frameSize;
+    pthread_mutex_unlock(&uvc->lock);
+    return 0;
+}
+
+int usbCamFakeUvcQueue(usbcam_fake_uvc_t *uvc, int index)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&uvc->lock);
+    if(index >= 0 && index < uvc->numBuffers &&
+       BUF_DEQUEUED == uvc->state[index]) {
+        uvc->state[index] = BUF_QUEUED;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&uvc->lock);
+    return rc;
+}
+
+uint8_t *usbCamFakeUvcData(usbcam_fake_uvc_t *uvc, int index)
+{
+    return uvc->data[index];
+}
+
+uint32_t usbCamFakeUvcLost(usbcam_fake_uvc_t *uvc)
+{
+    uint32_t lost;
+
+    pthread_mutex_lock(&uvc->lock);
+    lost = uvc->lost;
+    pthread_mutex_unlock(&uvc->lock);
+    return lost;
+}
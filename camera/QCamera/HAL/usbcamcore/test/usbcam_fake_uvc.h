@@ -0,0 +1,53 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __USBCAM_FAKE_UVC_H
+#define __USBCAM_FAKE_UVC_H
+
+#include <stdint.h>
+
+/* File backed stand-in for a UVC device. A producer thread fills the
+ * queued buffers with the frames of the file, looping over it, at the
+ * requested frame rate. Like the driver, a frame is lost when no buffer
+ * is queued at its time. */
+
+typedef struct usbcam_fake_uvc usbcam_fake_uvc_t;
+
+/* path NULL generates a moving YUYV pattern of frameSize bytes */
+usbcam_fake_uvc_t *usbCamFakeUvcOpen(const char *path, int frameSize,
+                                     int numBuffers, int fps);
+void usbCamFakeUvcClose(usbcam_fake_uvc_t *uvc);
+
+/* 0 with a filled buffer, 1 when none got filled within timeoutMs */
+int usbCamFakeUvcDequeue(usbcam_fake_uvc_t *uvc, int timeoutMs,
+                         int *index, int *bytesused);
+int usbCamFakeUvcQueue(usbcam_fake_uvc_t *uvc, int index);
+uint8_t *usbCamFakeUvcData(usbcam_fake_uvc_t *uvc, int index);
+uint32_t usbCamFakeUvcLost(usbcam_fake_uvc_t *uvc);
+
+#endif /* __USBCAM_FAKE_UVC_H */
@@ -0,0 +1,284 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Benchmark of the MJPEG decoder. A JPEG file is decoded over and over,
+ * first setting up and tearing down the decoder for every frame like the
+ * preview used to, then on one decoder session. Both runs must give the
+ * same picture. With -t the Huffman tables are stripped from the input
+ * first, the way most UVC cameras send their frames, and the picture must
+ * still match the one decoded from the original file. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "jpeg_common.h"
+}
+
+#include "QCameraMjpegDecode.h"
+
+typedef struct {
+    char *filename;
+    int frames;
+    int stripDht;
+} mjpegd_test_input_t;
+
+typedef struct {
+    uint8_t *jpeg;
+    int jpegSize;
+    int width;
+    int height;
+    uint8_t *out;
+    size_t outSize;
+} mjpegd_test_t;
+
+static void usbcam_mjpegd_test_print_usage()
+{
+    fprintf(stderr, "Usage: program_name [options]\n");
+    fprintf(stderr, "Mandatory options:\n");
+    fprintf(stderr, "  -I FILE\t\tbaseline 4:2:0 JPEG file\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -n FRAMES\t\tframes to decode per run, default 100\n");
+    fprintf(stderr, "  -t \t\t\tstrip the Huffman tables from the input\n");
+    fprintf(stderr, "\n");
+}
+
+static uint64_t nowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Reads the frame size from the SOF marker. Returns -1 if there is none */
+static int parseSize(const uint8_t *p, int size, int *width, int *height)
+{
+    int offset = 2;
+
+    while(offset + 9 <= size && p[offset] == 0xFF) {
+        uint8_t marker = p[offset + 1];
+        if(marker >= 0xC0 && marker <= 0xC2) {
+            *height = (p[offset + 5] << 8) | p[offset + 6];
+            *width  = (p[offset + 7] << 8) | p[offset + 8];
+            return 0;
+        }
+        if(marker == 0xDA)
+            break;
+        offset += 2 + ((p[offset + 2] << 8) | p[offset + 3]);
+    }
+    return -1;
+}
+
+/* Removes the DHT segments in front of the SOS marker */
+static int stripHuffmanTables(uint8_t *p, int size)
+{
+    int offset = 2;
+    int segLen;
+
+    while(offset + 4 <= size && p[offset] == 0xFF) {
+        if(p[offset + 1] == 0xDA)
+            break;
+        segLen = 2 + ((p[offset + 2] << 8) | p[offset + 3]);
+        if(p[offset + 1] == 0xC4) {
+            memmove(p + offset, p + offset + segLen, size - offset - segLen);
+            size -= segLen;
+            continue;
+        }
+        offset += segLen;
+    }
+    return size;
+}
+
+static int decodeFrame(void *mjpegd, mjpegd_test_t *t,
+                       const uint8_t *jpeg, int jpegSize)
+{
+    return mjpegDecode(mjpegd, (char *)jpeg, jpegSize, (char *)t->out,
+                       (char *)t->out + t->width * t->height, YCRCBLP_H2V2);
+}
+
+/* Decodes the frames and reports the per frame latency. With perFrame set
+ * every frame gets its own decoder */
+static int runDecode(mjpegd_test_t *t, int frames, int perFrame,
+                     const char *name)
+{
+    void *mjpegd = NULL;
+    uint64_t start, diff, total = 0, max = 0;
+    int i, rc = 0;
+
+    if(!perFrame && mjpegDecoderInit(&mjpegd)) {
+        fprintf(stderr, "mjpegDecoderInit failed\n");
+        return -1;
+    }
+    for(i = 0; i < frames && !rc; i++) {
+        start = nowUs();
+        if(perFrame && mjpegDecoderInit(&mjpegd)) {
+            fprintf(stderr, "mjpegDecoderInit failed\n");
+            return -1;
+        }
+        rc = decodeFrame(mjpegd, t, t->jpeg, t->jpegSize);
+        if(perFrame) {
+            mjpegDecoderDestroy(mjpegd);
+            mjpegd = NULL;
+        }
+        diff = nowUs() - start;
+        total += diff;
+        if(diff > max)
+            max = diff;
+    }
+    mjpegDecoderDestroy(mjpegd);
+    if(rc) {
+        fprintf(stderr, "%s decode of frame %d failed\n", name, i);
+        return -1;
+    }
+
+    fprintf(stderr, "%s\n", name);
+    fprintf(stderr, "  %-23s%llu us avg, %llu us max\n", "Latency: ",
+            (unsigned long long)(total / frames), (unsigned long long)max);
+    return 0;
+}
+
+static int usbcam_mjpegd_test_get_input(int argc, char *argv[],
+                                        mjpegd_test_input_t *p_test)
+{
+    int c;
+
+    while((c = getopt(argc, argv, "I:n:t")) != -1) {
+        switch(c) {
+        case 'I':
+            p_test->filename = optarg;
+            break;
+        case 'n':
+            p_test->frames = atoi(optarg);
+            break;
+        case 't':
+            p_test->stripDht = 1;
+            break;
+        default:
+            return 1;
+        }
+    }
+    if(!p_test->filename || p_test->frames <= 0)
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    mjpegd_test_input_t input;
+    mjpegd_test_t test;
+    uint8_t *ref = NULL;
+    void *mjpegd = NULL;
+    FILE *fp;
+    long size;
+    int rc, ret = -1;
+
+    memset(&input, 0, sizeof(input));
+    input.frames = 100;
+    if(usbcam_mjpegd_test_get_input(argc, argv, &input)) {
+        usbcam_mjpegd_test_print_usage();
+        return 1;
+    }
+
+    memset(&test, 0, sizeof(test));
+    fp = fopen(input.filename, "rb");
+    if(!fp) {
+        fprintf(stderr, "cannot open %s\n", input.filename);
+        goto exit;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    test.jpeg = (uint8_t *)malloc(size > 0 ? size : 1);
+    if(!test.jpeg || size <= 0 || fread(test.jpeg, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "cannot read %s\n", input.filename);
+        fclose(fp);
+        goto exit;
+    }
+    fclose(fp);
+    test.jpegSize = (int)size;
+
+    if(parseSize(test.jpeg, test.jpegSize, &test.width, &test.height) ||
+       test.width % 16 || test.height % 16) {
+        fprintf(stderr, "%s: need a JPEG of 16x16 aligned size\n",
+                input.filename);
+        goto exit;
+    }
+    test.outSize = (size_t)test.width * test.height * 3 / 2;
+    test.out = (uint8_t *)malloc(test.outSize);
+    ref = (uint8_t *)malloc(test.outSize);
+    if(!test.out || !ref) {
+        fprintf(stderr, "no memory\n");
+        goto exit;
+    }
+
+    /* Reference picture, from the file as it is */
+    rc = mjpegDecoderInit(&mjpegd);
+    if(!rc)
+        rc = decodeFrame(mjpegd, &test, test.jpeg, test.jpegSize);
+    mjpegDecoderDestroy(mjpegd);
+    if(rc) {
+        fprintf(stderr, "reference decode failed\n");
+        goto exit;
+    }
+    memcpy(ref, test.out, test.outSize);
+
+    if(input.stripDht)
+        test.jpegSize = stripHuffmanTables(test.jpeg, test.jpegSize);
+
+    fprintf(stderr, "%-25s%dx%d, %d bytes%s\n", "Frame: ", test.width,
+            test.height, test.jpegSize,
+            input.stripDht ? ", no Huffman tables" : "");
+
+    memset(test.out, 0, test.outSize);
+    if(runDecode(&test, input.frames, 1, "Per frame decoder:"))
+        goto exit;
+    if(memcmp(test.out, ref, test.outSize)) {
+        fprintf(stderr, "Per frame decoder output differs\n");
+        goto exit;
+    }
+
+    memset(test.out, 0, test.outSize);
+    if(runDecode(&test, input.frames, 0, "Decoder session:"))
+        goto exit;
+    if(memcmp(test.out, ref, test.outSize)) {
+        fprintf(stderr, "Decoder session output differs\n");
+        goto exit;
+    }
+    ret = 0;
+
+exit:
+    free(test.jpeg);
+    free(test.out);
+    free(ref);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret;
+}
@@ -0,0 +1,335 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Host test of the usb camera preview pipeline. Frames of a fake UVC
+ * device go through the capture, process and display stages, first on
+ * one thread like the original preview loop, then pipelined. A decode
+ * time can be added to the YUYV conversion to stand in for MJPEG, and a
+ * display time for the window and the preview callback. The display
+ * stage checks that frames come out in capture order. */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "QCameraUsbConvert.h"
+#include "QCameraUsbPipeline.h"
+#include "usbcam_fake_uvc.h"
+
+#define PIPE_TEST_CAP_BUFS  4
+#define PIPE_TEST_DISP_BUFS 4
+
+typedef struct {
+    char *filename;
+    int width;
+    int height;
+    int fps;
+    int frames;
+    int workers;
+    int decodeUs;
+    int displayUs;
+} pipe_test_input_t;
+
+typedef struct {
+    const pipe_test_input_t *input;
+    usbcam_fake_uvc_t   *uvc;
+    void                *conv;
+    pthread_mutex_t     decodeLock;
+    /* display buffers not held by the pipeline */
+    pthread_mutex_t     dispLock;
+    pthread_cond_t      dispCond;
+    uint8_t             *disp[PIPE_TEST_DISP_BUFS];
+    int                 dispFree[PIPE_TEST_DISP_BUFS];
+    uint32_t            expectSeq;
+    uint32_t            orderErrors;
+} pipe_test_t;
+
+static void usbcam_pipeline_test_print_usage()
+{
+    fprintf(stderr, "Usage: program_name [options]\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -I FILE\t\tYUYV frames, a pattern is generated if absent\n");
+    fprintf(stderr, "  -W WIDTH\t\tframe width, default 1280\n");
+    fprintf(stderr, "  -H HEIGHT\t\tframe height, default 720\n");
+    fprintf(stderr, "  -f FPS\t\tcamera frame rate, default 30\n");
+    fprintf(stderr, "  -n COUNT\t\tframes per run, default 150\n");
+    fprintf(stderr, "  -w WORKERS\t\tprocess threads of the pipelined run, default 2\n");
+    fprintf(stderr, "  -d USEC\t\tdecode time added per frame, default 25000\n");
+    fprintf(stderr, "  -D USEC\t\tdisplay time per frame, default 10000\n");
+    fprintf(stderr, "\n");
+}
+
+static int getDisplayBuf(pipe_test_t *t)
+{
+    int i;
+
+    pthread_mutex_lock(&t->dispLock);
+    while(1) {
+        for(i = 0; i < PIPE_TEST_DISP_BUFS; i++)
+            if(t->dispFree[i])
+                break;
+        if(i < PIPE_TEST_DISP_BUFS)
+            break;
+        pthread_cond_wait(&t->dispCond, &t->dispLock);
+    }
+    t->dispFree[i] = 0;
+    pthread_mutex_unlock(&t->dispLock);
+    return i;
+}
+
+static void putDisplayBuf(pipe_test_t *t, int id)
+{
+    pthread_mutex_lock(&t->dispLock);
+    t->dispFree[id] = 1;
+    pthread_cond_signal(&t->dispCond);
+    pthread_mutex_unlock(&t->dispLock);
+}
+
+static int testProcess(void *ctx, usbcam_pipe_frame_t *frame)
+{
+    pipe_test_t *t = (pipe_test_t *)ctx;
+    usbcam_convert_params_t p;
+    int rc;
+
+    frame->dispId = getDisplayBuf(t);
+
+    memset(&p, 0, sizeof(p));
+    p.src       = usbCamFakeUvcData(t->uvc, frame->index);
+    p.srcFmt    = USBCAM_CONVERT_SRC_YUYV;
+    p.width     = t->input->width;
+    p.height    = t->input->height;
+    p.downscale = 1;
+    p.dstY      = t->disp[frame->dispId];
+    p.dstFmt    = USBCAM_CONVERT_DST_NV21;
+    rc = usbCamConvertFrame(t->conv, &p);
+
+    /* the decoder is not reentrant, like the MJPEG one of the HAL */
+    if(t->input->decodeUs) {
+        pthread_mutex_lock(&t->decodeLock);
+        usleep(t->input->decodeUs);
+        pthread_mutex_unlock(&t->decodeLock);
+    }
+
+    usbCamFakeUvcQueue(t->uvc, frame->index);
+    return rc;
+}
+
+static void checkOrder(pipe_test_t *t, usbcam_pipe_frame_t *frame)
+{
+    if(frame->seq != t->expectSeq) {
+        fprintf(stderr, "frame %u out of order, expected %u\n",
+                frame->seq, t->expectSeq);
+        t->orderErrors++;
+    }
+    t->expectSeq = frame->seq + 1;
+}
+
+static int testDisplay(void *ctx, usbcam_pipe_frame_t *frame)
+{
+    pipe_test_t *t = (pipe_test_t *)ctx;
+
+    checkOrder(t, frame);
+    if(t->input->displayUs)
+        usleep(t->input->displayUs);
+    putDisplayBuf(t, frame->dispId);
+    return 0;
+}
+
+static void testCancel(void *ctx, usbcam_pipe_frame_t *frame)
+{
+    pipe_test_t *t = (pipe_test_t *)ctx;
+
+    checkOrder(t, frame);
+    if(frame->dispId >= 0)
+        putDisplayBuf(t, frame->dispId);
+}
+
+static int runPipeline(pipe_test_t *t, int workers, const char *name)
+{
+    usbcam_pipe_ops_t ops;
+    usbcam_pipe_stats_t stats;
+    usbcam_pipe_frame_t frame;
+    void *pipe = NULL;
+    uint32_t lost;
+    int i, sent = 0;
+
+    t->uvc = usbCamFakeUvcOpen(t->input->filename,
+                               t->input->width * t->input->height * 2,
+                               PIPE_TEST_CAP_BUFS, t->input->fps);
+    if(!t->uvc) {
+        fprintf(stderr, "cannot open the fake camera\n");
+        return -1;
+    }
+    for(i = 0; i < PIPE_TEST_DISP_BUFS; i++)
+        t->dispFree[i] = 1;
+    t->expectSeq = 0;
+    t->orderErrors = 0;
+
+    memset(&ops, 0, sizeof(ops));
+    ops.ctx     = t;
+    ops.process = testProcess;
+    ops.display = testDisplay;
+    ops.cancel  = testCancel;
+    /* a capture buffer stays queued to the camera */
+    if(usbCamPipelineCreate(&pipe, &ops, workers, PIPE_TEST_CAP_BUFS - 1)) {
+        usbCamFakeUvcClose(t->uvc);
+        return -1;
+    }
+
+    while(sent < t->input->frames) {
+        if(usbCamPipelineAcquire(pipe, 500))
+            continue;
+        memset(&frame, 0, sizeof(frame));
+        if(usbCamFakeUvcDequeue(t->uvc, 500, &frame.index, &frame.bytesused)) {
+            usbCamPipelineAbort(pipe);
+            continue;
+        }
+        usbCamPipelineSubmit(pipe, &frame);
+        sent++;
+    }
+    usbCamPipelineDrain(pipe);
+    usbCamPipelineGetStats(pipe, &stats);
+    usbCamPipelineDestroy(pipe);
+    lost = usbCamFakeUvcLost(t->uvc);
+    usbCamFakeUvcClose(t->uvc);
+    t->uvc = NULL;
+
+    fprintf(stderr, "%s\n", name);
+    fprintf(stderr, "  %-23s%u displayed, %u dropped, %u lost by camera\n",
+            "Frames: ", stats.displayed, stats.dropped, lost);
+    fprintf(stderr, "  %-23s%u.%02u\n", "Fps: ",
+            stats.fpsX100 / 100, stats.fpsX100 % 100);
+    fprintf(stderr, "  %-23s%llu us avg, %llu us max\n", "Latency: ",
+            (unsigned long long)stats.latencyAvgUs,
+            (unsigned long long)stats.latencyMaxUs);
+    fprintf(stderr, "  %-23s%u\n", "Peak in flight: ", stats.maxInflight);
+    if(t->orderErrors)
+        fprintf(stderr, "  %-23s%u\n", "Order errors: ", t->orderErrors);
+    return (t->orderErrors || stats.dropped) ? -1 : 0;
+}
+
+static int usbcam_pipeline_test_get_input(int argc, char *argv[],
+                                          pipe_test_input_t *p_test)
+{
+    int c;
+
+    while((c = getopt(argc, argv, "I:W:H:f:n:w:d:D:")) != -1) {
+        switch(c) {
+        case 'I':
+            p_test->filename = optarg;
+            break;
+        case 'W':
+            p_test->width = atoi(optarg);
+            break;
+        case 'H':
+            p_test->height = atoi(optarg);
+            break;
+        case 'f':
+            p_test->fps = atoi(optarg);
+            break;
+        case 'n':
+            p_test->frames = atoi(optarg);
+            break;
+        case 'w':
+            p_test->workers = atoi(optarg);
+            break;
+        case 'd':
+            p_test->decodeUs = atoi(optarg);
+            break;
+        case 'D':
+            p_test->displayUs = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if(p_test->width <= 0 || p_test->height <= 0 || p_test->width % 2 ||
+       p_test->height % 2 || p_test->fps <= 0 || p_test->frames <= 0 ||
+       p_test->workers < 1 || p_test->decodeUs < 0 ||
+       p_test->displayUs < 0)
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    pipe_test_input_t input;
+    pipe_test_t test;
+    size_t dispSize;
+    int i, ret = -1;
+
+    memset(&input, 0, sizeof(input));
+    input.width     = 1280;
+    input.height    = 720;
+    input.fps       = 30;
+    input.frames    = 150;
+    input.workers   = 2;
+    input.decodeUs  = 25000;
+    input.displayUs = 10000;
+    if(usbcam_pipeline_test_get_input(argc, argv, &input)) {
+        usbcam_pipeline_test_print_usage();
+        return 1;
+    }
+
+    memset(&test, 0, sizeof(test));
+    test.input = &input;
+    pthread_mutex_init(&test.decodeLock, NULL);
+    pthread_mutex_init(&test.dispLock, NULL);
+    pthread_cond_init(&test.dispCond, NULL);
+    dispSize = (size_t)input.width * input.height * 3 / 2;
+    for(i = 0; i < PIPE_TEST_DISP_BUFS; i++) {
+        test.disp[i] = (uint8_t *)malloc(dispSize);
+        if(!test.disp[i]) {
+            fprintf(stderr, "no memory\n");
+            goto exit;
+        }
+    }
+    if(usbCamConvertInit(&test.conv, 0))
+        goto exit;
+
+    fprintf(stderr, "%-25s%dx%d @ %d fps\n", "Stream: ",
+            input.width, input.height, input.fps);
+    fprintf(stderr, "%-25s%d us decode, %d us display\n", "Stage times: ",
+            input.decodeUs, input.displayUs);
+    if(runPipeline(&test, 0, "Serial:"))
+        goto exit;
+    if(runPipeline(&test, input.workers, "Pipelined:"))
+        goto exit;
+    ret = 0;
+
+exit:
+    usbCamConvertDestroy(test.conv);
+    for(i = 0; i < PIPE_TEST_DISP_BUFS; i++)
+        free(test.disp[i]);
+    pthread_cond_destroy(&test.dispCond);
+    pthread_mutex_destroy(&test.dispLock);
+    pthread_mutex_destroy(&test.decodeLock);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret;
+}
@@ -24,6 +24,9 @@ LOCAL_SRC_FILES := \
         util/QCameraCmdThread.cpp \
         util/QCameraQueue.cpp \
         util/QCameraFlash.cpp \
+        util/QCameraDebugConfig.cpp \
+        util/QCameraDumpWriter.cpp \
+        util/QCameraPlaneCopy.cpp \
         QCamera2Hal.cpp \
         QCamera2Factory.cpp
 
@@ -46,7 +49,8 @@ LOCAL_SRC_FILES += \
         HAL/QCameraPostProc.cpp \
         HAL/QCamera2HWICallbacks.cpp \
         HAL/QCameraParameters.cpp \
-        HAL/QCameraThermalAdapter.cpp
+        HAL/QCameraThermalAdapter.cpp \
+        HAL/QCameraThermalController.cpp
 
 LOCAL_CFLAGS := -Wall -Werror
 LOCAL_CFLAGS += -DHAS_MULTIMEDIA_HINTS
@@ -30,10 +30,12 @@
 #define LOG_TAG "QCamera2HWI"
 
 #include <cutils/properties.h>
+#include <fcntl.h>
 #include <hardware/camera.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <utils/Errors.h>
+#include <utils/Timers.h>
 #include <gralloc_priv.h>
 
 #include "QCamera2HWI.h"
@@ -57,6 +59,12 @@ namespace qcamera {
 
 cam_capability_t *gCamCaps[MM_CAMERA_MAX_NUM_SENSORS];
 static pthread_mutex_t g_camlock = PTHREAD_MUTEX_INITIALIZER;
+// buffer configurations of the last captures, they outlive the camera
+// session so that the first shot after open can be prewarmed as well
+static qcamera_buf_config_t g_bufConfigs[MM_CAMERA_MAX_NUM_SENSORS]
+                                        [QCAMERA_PREWARM_MAX_CONFIGS];
+static uint32_t g_bufConfigSeq = 0;
+static pthread_mutex_t g_bufConfigLock = PTHREAD_MUTEX_INITIALIZER;
 volatile uint32_t gCamHalLogLevel = 1;
 
 camera_device_ops_t QCamera2HardwareInterface::mCameraOps = {
@@ -1042,6 +1050,10 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
       mDumpFrmCnt(0),
       mDumpSkipCnt(0),
       mThermalLevel(QCAMERA_THERMAL_NO_ADJUSTMENT),
+      mThermalZoneFd(-1),
+      mThermalLastSampleTime(0),
+      mThermalFrameCnt(0),
+      mThermalFpsScale(1.0f),
       m_HDRSceneEnabled(false),
       mLongshotEnabled(false),
       m_max_pic_width(0),
@@ -1051,11 +1063,17 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
       mCaptureRotation(0),
       mIs3ALocked(false),
       mZoomLevel(0),
+      mPreviewCbCompact(false),
+      mPreviewCbKpi(false),
+      mPreviewCbCount(0),
+      mPreviewCbTime(0),
       mSnapshotJob(-1),
       mPostviewJob(-1),
       mMetadataJob(-1),
       mReprocJob(-1),
-      mRawdataJob(-1)
+      mRawdataJob(-1),
+      mPrewarmJob(-1),
+      mPrewarmAbort(false)
 {
     getLogLevel();
     mCameraDevice.common.tag = HARDWARE_DEVICE_TAG;
@@ -1074,6 +1092,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
     memset(&m_evtResult, 0, sizeof(qcamera_api_result_t));
 
     pthread_mutex_init(&m_parm_lock, NULL);
+    pthread_mutex_init(&m_thermalLock, NULL);
 
     memset(m_channels, 0, sizeof(m_channels));
 
@@ -1083,10 +1102,29 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
     }
 #endif
 
-    memset(mDeffOngoingJobs, 0, sizeof(mDeffOngoingJobs));
+    mDeffFreeJobs = (1U << MAX_ONGOING_JOBS) - 1;
+    for (int i = 0; i < MAX_ONGOING_JOBS; i++) {
+        mDeffJobIds[i] = -1;
+    }
+    mDeffJobGen = 0;
+    memset(mDeffStats, 0, sizeof(mDeffStats));
 
-    mDefferedWorkThread.launch(defferedWorkRoutine, this);
-    mDefferedWorkThread.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, FALSE, FALSE);
+    char value[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.deferred.workers", value, "3");
+    mDeffNumWorkers = atoi(value);
+    if (mDeffNumWorkers < 1) {
+        mDeffNumWorkers = 1;
+    } else if (mDeffNumWorkers > MAX_DEFF_WORKERS) {
+        mDeffNumWorkers = MAX_DEFF_WORKERS;
+    }
+
+    for (int i = 0; i < mDeffNumWorkers; i++) {
+        mDeffWorkers[i].hw = this;
+        mDeffWorkers[i].busy = false;
+        mDeffWorkers[i].thread.launch(defferedWorkRoutine, &mDeffWorkers[i]);
+        mDeffWorkers[i].thread.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC,
+                FALSE, FALSE);
+    }
 }
 
 /*===========================================================================
@@ -1100,8 +1138,17 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(int cameraId)
  *==========================================================================*/
 QCamera2HardwareInterface::~QCamera2HardwareInterface()
 {
-    mDefferedWorkThread.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
-    mDefferedWorkThread.exit();
+    cancelPrewarm();
+    for (int i = 0; i < mDeffNumWorkers; i++) {
+        mDeffWorkers[i].thread.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC,
+                TRUE, TRUE);
+        mDeffWorkers[i].thread.exit();
+    }
+    // jobs that never got ready
+    while (!mDeffPending.empty()) {
+        delete *mDeffPending.begin();
+        mDeffPending.erase(mDeffPending.begin());
+    }
 
     closeCamera();
     pthread_mutex_destroy(&m_lock);
@@ -1109,6 +1156,7 @@ QCamera2HardwareInterface::~QCamera2HardwareInterface()
     pthread_mutex_destroy(&m_evtLock);
     pthread_cond_destroy(&m_evtCond);
     pthread_mutex_destroy(&m_parm_lock);
+    pthread_mutex_destroy(&m_thermalLock);
 }
 
 /*===========================================================================
@@ -1134,10 +1182,12 @@ int QCamera2HardwareInterface::openCamera(struct hw_device_t **hw_device)
         __func__,mCameraId);
     rc = openCamera();
     if (rc == NO_ERROR){
+        QCameraDebugConfig::refresh();
         *hw_device = &mCameraDevice.common;
         if (m_thermalAdapter.init(this) != 0) {
           ALOGE("Init thermal adapter failed");
         }
+        initThermalController();
     }
     else
         *hw_device = NULL;
@@ -1269,6 +1319,7 @@ int QCamera2HardwareInterface::closeCamera()
     }
 
     m_thermalAdapter.deinit();
+    deinitThermalController();
 
     // delete all channels if not already deleted
     for (i = 0; i < QCAMERA_CH_TYPE_MAX; i++) {
@@ -1699,19 +1750,30 @@ QCameraMemory *QCamera2HardwareInterface::allocateStreamBuf(cam_stream_type_t st
     }
 
     if (bufferCnt > 0) {
+        uint32_t isSecure = NON_SECURE;
         if (mParameters.isSecureMode() &&
             (stream_type == CAM_STREAM_TYPE_RAW) &&
             (mParameters.isRdiMode())) {
             ALOGD("%s: Allocating %d secure buffers of size %d ", __func__, bufferCnt, size);
-            rc = mem->allocate(bufferCnt, size, SECURE);
-        } else {
-            rc = mem->allocate(bufferCnt, size, NON_SECURE);
+            isSecure = SECURE;
         }
+        rc = mem->allocate(bufferCnt, size, isSecure);
         if (rc < 0) {
             delete mem;
             return NULL;
         }
         bufferCnt = mem->getCnt();
+
+        // remember the buffers of regular captures for prewarming
+        if (bPoolMem && (isSecure == NON_SECURE) &&
+            ((stream_type == CAM_STREAM_TYPE_SNAPSHOT) ||
+             (stream_type == CAM_STREAM_TYPE_RAW) ||
+             (stream_type == CAM_STREAM_TYPE_METADATA)) &&
+            !isZSLMode() &&
+            !isLongshotEnabled() &&
+            !mParameters.getRecordingHintValue()) {
+            recordBufConfig(stream_type, size, bufferCnt, bCachedMem);
+        }
     }
     return mem;
 }
@@ -2020,12 +2082,26 @@ int QCamera2HardwareInterface::msgTypeEnabledWithLock(int32_t msg_type)
 int QCamera2HardwareInterface::startPreview()
 {
     int32_t rc = NO_ERROR;
+    char value[PROPERTY_VALUE_MAX];
     CDBG_HIGH("%s: E", __func__);
+
+    // copy the padded preview frames into packed callback buffers
+    property_get("persist.camera.preview.cb_compact", value, "0");
+    mPreviewCbCompact = (atoi(value) > 0);
+    // log the average preview callback time every 300 frames
+    property_get("persist.camera.preview.cb_kpi", value, "0");
+    mPreviewCbKpi = (atoi(value) > 0);
+    mPreviewCbCount = 0;
+    mPreviewCbTime = 0;
+
     // start preview stream
     if (mParameters.isZSLMode() && mParameters.getRecordingHintValue() !=true) {
         rc = startChannel(QCAMERA_CH_TYPE_ZSL);
     } else {
         rc = startChannel(QCAMERA_CH_TYPE_PREVIEW);
+        if ((NO_ERROR == rc) && !mParameters.isZSLMode()) {
+            queuePrewarm();
+        }
     }
     CDBG_HIGH("%s: X", __func__);
     return rc;
@@ -2045,6 +2121,9 @@ int QCamera2HardwareInterface::startPreview()
 int QCamera2HardwareInterface::stopPreview()
 {
     CDBG_HIGH("%s: E", __func__);
+    // buffers of the old configuration are not needed anymore
+    cancelPrewarm();
+
     // stop preview stream
     stopChannel(QCAMERA_CH_TYPE_ZSL);
     stopChannel(QCAMERA_CH_TYPE_PREVIEW);
@@ -2652,10 +2731,6 @@ int QCamera2HardwareInterface::takePicture()
                     return rc;
                 }
 
-                waitDefferedWork(mSnapshotJob);
-                waitDefferedWork(mMetadataJob);
-                waitDefferedWork(mRawdataJob);
-
                 {
                     DefferWorkArgs args;
                     DefferAllocBuffArgs allocArgs;
@@ -2667,6 +2742,8 @@ int QCamera2HardwareInterface::takePicture()
                     allocArgs.type = CAM_STREAM_TYPE_POSTVIEW;
                     args.allocArgs = allocArgs;
 
+                    // postview buffers are allocated along with the
+                    // snapshot, metadata and raw ones
                     mPostviewJob = queueDefferedWork(CMD_DEFF_ALLOCATE_BUFF,
                             args);
 
@@ -2674,6 +2751,9 @@ int QCamera2HardwareInterface::takePicture()
                         rc = UNKNOWN_ERROR;
                 }
 
+                waitDefferedWork(mSnapshotJob);
+                waitDefferedWork(mMetadataJob);
+                waitDefferedWork(mRawdataJob);
                 waitDefferedWork(mPostviewJob);
             } else {
                 // normal capture case
@@ -2704,6 +2784,7 @@ int QCamera2HardwareInterface::takePicture()
                 memset(&args, 0, sizeof(DefferWorkArgs));
 
                 args.pprocArgs = m_channels[QCAMERA_CH_TYPE_CAPTURE];
+                // the capture buffers were waited on above
                 mReprocJob = queueDefferedWork(CMD_DEFF_PPROC_START,
                         args);
 
@@ -3282,6 +3363,12 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+    dprintf(fd, "\n Memory Pool: %s", m_memoryPool.dump().string());
+    dumpDefferedWork(fd);
+    // pick up debug properties changed since the last reload
+    QCameraDebugConfig::refresh();
+    QCameraDebugConfig::dump(fd);
+    QCameraDumpWriter::getInstance()->dump(fd);
     dprintf(fd, "\n Camera HAL information End \n");
     return NO_ERROR;
 }
@@ -3991,24 +4078,25 @@ int32_t QCamera2HardwareInterface::addStreamToChannel(QCameraChannel *pChannel,
             allocArgs.type = streamType;
             allocArgs.ch = pChannel;
             args.allocArgs = allocArgs;
-
+            // wait for the prewarm and take its buffers instead of
+            // allocating alongside it
             if (streamType == CAM_STREAM_TYPE_SNAPSHOT) {
                 mSnapshotJob = queueDefferedWork(CMD_DEFF_ALLOCATE_BUFF,
-                        args);
+                        args, &mPrewarmJob, 1);
 
                 if ( mSnapshotJob == -1) {
                     rc = UNKNOWN_ERROR;
                 }
             } else if (streamType == CAM_STREAM_TYPE_METADATA) {
                 mMetadataJob = queueDefferedWork(CMD_DEFF_ALLOCATE_BUFF,
-                        args);
+                        args, &mPrewarmJob, 1);
 
                 if ( mMetadataJob == -1) {
                     rc = UNKNOWN_ERROR;
                 }
             } else if (streamType == CAM_STREAM_TYPE_RAW) {
                 mRawdataJob = queueDefferedWork(CMD_DEFF_ALLOCATE_BUFF,
-                        args);
+                        args, &mPrewarmJob, 1);
 
                 if ( mRawdataJob == -1) {
                     rc = UNKNOWN_ERROR;
@@ -5443,6 +5531,27 @@ int QCamera2HardwareInterface::calcThermalLevel(
         }
         break;
     }
+    // The thermal controller may hold the fps below the level already
+    float levelScale = QCameraThermalController::levelFpsScale(level);
+    if (level != QCAMERA_THERMAL_SHUTDOWN && mThermalFpsScale < levelScale) {
+        float scale = mThermalFpsScale / levelScale;
+        adjustedRange.min_fps *= scale;
+        adjustedRange.max_fps *= scale;
+        adjustedRange.video_min_fps *= scale;
+        adjustedRange.video_max_fps *= scale;
+        if ( adjustedRange.min_fps < 1 ) {
+            adjustedRange.min_fps = 1;
+        }
+        if ( adjustedRange.max_fps < 1 ) {
+            adjustedRange.max_fps = 1;
+        }
+        if ( adjustedRange.video_min_fps < 1 ) {
+            adjustedRange.video_min_fps = 1;
+        }
+        if ( adjustedRange.video_max_fps < 1 ) {
+            adjustedRange.video_max_fps = 1;
+        }
+    }
     CDBG_HIGH("%s: Thermal level %d, FPS [%3.2f,%3.2f, %3.2f,%3.2f], frameskip %d",
           __func__, level, adjustedRange.min_fps, adjustedRange.max_fps,
           adjustedRange.video_min_fps, adjustedRange.video_max_fps, skipPattern);
@@ -5528,6 +5637,160 @@ int QCamera2HardwareInterface::updateThermalLevel(
 
 }
 
+/*===========================================================================
+ * FUNCTION   : initThermalController
+ *
+ * DESCRIPTION: open the temp node set by persist.camera.thermal.zone for
+ *              the thermal controller. The level temperatures can be set
+ *              with persist.camera.thermal.temps as "slight,big,shutdown".
+ *              Without a zone the fps follows the thermal levels only.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::initThermalController()
+{
+    char value[PROPERTY_VALUE_MAX];
+    char path[64];
+    qcamera_thermal_ctrl_config_t config;
+    float slight, big, shutdown;
+
+    property_get("persist.camera.thermal.zone", value, "-1");
+    int zone = atoi(value);
+    if (zone < 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", zone);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("%s: cannot open %s: %s", __func__, path, strerror(errno));
+        return;
+    }
+
+    QCameraThermalController::defaultConfig(config);
+    property_get("persist.camera.thermal.temps", value, "");
+    if (sscanf(value, "%f,%f,%f", &slight, &big, &shutdown) == 3) {
+        config.levelTemp[QCAMERA_THERMAL_SLIGHT_ADJUSTMENT] = slight;
+        config.levelTemp[QCAMERA_THERMAL_BIG_ADJUSTMENT] = big;
+        config.levelTemp[QCAMERA_THERMAL_SHUTDOWN] = shutdown;
+    }
+    pthread_mutex_lock(&m_thermalLock);
+    m_thermalCtrl.configure(config);
+    mThermalZoneFd = fd;
+    mThermalLastSampleTime = 0;
+    mThermalFrameCnt = 0;
+    pthread_mutex_unlock(&m_thermalLock);
+    CDBG_HIGH("%s: sampling %s, levels at %.1f %.1f %.1f", __func__, path,
+            config.levelTemp[QCAMERA_THERMAL_SLIGHT_ADJUSTMENT],
+            config.levelTemp[QCAMERA_THERMAL_BIG_ADJUSTMENT],
+            config.levelTemp[QCAMERA_THERMAL_SHUTDOWN]);
+}
+
+/*===========================================================================
+ * FUNCTION   : deinitThermalController
+ *
+ * DESCRIPTION: close the temp node and lift the controller fps scale.
+ *              Preview callbacks can still be running, so the node is
+ *              closed under m_thermalLock, which they read it under.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::deinitThermalController()
+{
+    pthread_mutex_lock(&m_thermalLock);
+    if (mThermalZoneFd >= 0) {
+        close(mThermalZoneFd);
+        mThermalZoneFd = -1;
+    }
+    pthread_mutex_lock(&m_parm_lock);
+    mThermalFpsScale = 1.0f;
+    pthread_mutex_unlock(&m_parm_lock);
+    pthread_mutex_unlock(&m_thermalLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : thermalPreviewTick
+ *
+ * DESCRIPTION: count a preview frame and, once per sample period, feed the
+ *              temperature and the share of the configured fps the preview
+ *              delivered to the thermal controller. A new fps scale goes
+ *              through the state machine like a thermal level.
+ *              Called from the preview stream callback. Everything up to
+ *              the notify runs under m_thermalLock, so deinit cannot close
+ *              the node in between; m_parm_lock nests inside it.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::thermalPreviewTick()
+{
+    char buf[16];
+    int minFPS, maxFPS;
+
+    pthread_mutex_lock(&m_thermalLock);
+    if (mThermalZoneFd < 0) {
+        pthread_mutex_unlock(&m_thermalLock);
+        return;
+    }
+
+    mThermalFrameCnt++;
+    nsecs_t now = systemTime();
+    nsecs_t diff = now - mThermalLastSampleTime;
+    if (mThermalLastSampleTime == 0 ||
+            diff > ms2ns(QCAMERA_THERMAL_CTRL_SAMPLE_MS * 4)) {
+        // First frame, or preview was stopped in between
+        mThermalLastSampleTime = now;
+        mThermalFrameCnt = 0;
+        pthread_mutex_unlock(&m_thermalLock);
+        return;
+    }
+    if (diff < ms2ns(QCAMERA_THERMAL_CTRL_SAMPLE_MS)) {
+        pthread_mutex_unlock(&m_thermalLock);
+        return;
+    }
+
+    float fps = (mThermalFrameCnt * float(s2ns(1))) / diff;
+    mThermalLastSampleTime = now;
+    mThermalFrameCnt = 0;
+
+    ssize_t len = pread(mThermalZoneFd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        ALOGE("%s: cannot read thermal zone: %s", __func__,
+                len < 0 ? strerror(errno) : "empty");
+        pthread_mutex_unlock(&m_thermalLock);
+        return;
+    }
+    buf[len] = '\0';
+    // Zones report millidegrees, older ones whole degrees
+    int raw = atoi(buf);
+    float tempC = (raw > 1000 || raw < -1000) ? raw / 1000.0f : raw;
+
+    pthread_mutex_lock(&m_parm_lock);
+    mParameters.getPreviewFpsRange(&minFPS, &maxFPS);
+    pthread_mutex_unlock(&m_parm_lock);
+    float load = maxFPS > 0 ? fps * 1000.0f / maxFPS : 1.0f;
+
+    qcamera_thermal_level_enum_t level = mThermalLevel;
+    if (!m_thermalCtrl.update(now, tempC, load, level)) {
+        pthread_mutex_unlock(&m_thermalLock);
+        return;
+    }
+
+    pthread_mutex_lock(&m_parm_lock);
+    mThermalFpsScale = m_thermalCtrl.getFpsScale();
+    pthread_mutex_unlock(&m_parm_lock);
+    CDBG_HIGH("%s: %.1fC, %.3fC/s, next level in %.0fs, load %.2f, fps scale %.2f",
+            __func__, tempC, m_thermalCtrl.getSlope(),
+            m_thermalCtrl.getSecondsToNextLevel(), load, m_thermalCtrl.getFpsScale());
+    pthread_mutex_unlock(&m_thermalLock);
+    processAPI(QCAMERA_SM_EVT_THERMAL_NOTIFY, (void *)level);
+}
+
 /*===========================================================================
  * FUNCTION   : updateParameters
  *
@@ -6162,13 +6425,141 @@ bool QCamera2HardwareInterface::needFDMetadata(qcamera_ch_type_enum_t channel_ty
     return value;
 }
 
+/*===========================================================================
+ * FUNCTION   : runDefferedWork
+ *
+ * DESCRIPTION: executes one deferred task
+ *
+ * PARAMETERS :
+ *   @dw      : deferred task
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::runDefferedWork(DeffWork *dw)
+{
+    switch( dw->cmd ) {
+    case CMD_DEFF_ALLOCATE_BUFF:
+        {
+            QCameraChannel * pChannel = dw->args.allocArgs.ch;
+
+            if ( NULL == pChannel ) {
+                ALOGE("%s : Invalid deferred work channel",
+                        __func__);
+                break;
+            }
+
+            cam_stream_type_t streamType = dw->args.allocArgs.type;
+
+            uint32_t iNumOfStreams = pChannel->getNumOfStreams();
+            QCameraStream *pStream = NULL;
+            for ( uint32_t i = 0; i < iNumOfStreams; ++i) {
+                pStream = pChannel->getStreamByIndex(i);
+
+                if ( NULL == pStream ) {
+                    break;
+                }
+
+                if ( pStream->isTypeOf(streamType)) {
+                    nsecs_t start = systemTime();
+                    if ( pStream->allocateBuffers() ) {
+                        ALOGE("%s: Error allocating buffers !!!",
+                                __func__);
+                    }
+                    CDBG_HIGH("[KPI Perf] %s: stream %d buffers allocated in %lld us",
+                            __func__, streamType,
+                            (long long)((systemTime() - start) / 1000));
+                    break;
+                }
+            }
+        }
+        break;
+    case CMD_DEFF_PPROC_START:
+        {
+            QCameraChannel * pChannel = dw->args.pprocArgs;
+            assert(pChannel);
+
+            if (m_postprocessor.start(pChannel) != NO_ERROR) {
+                ALOGE("%s: cannot start postprocessor", __func__);
+                delChannel(QCAMERA_CH_TYPE_CAPTURE);
+            }
+        }
+        break;
+    case CMD_DEFF_PREWARM_BUFF:
+        prewarmStreamBufs(dw->args.prewarmArgs);
+        break;
+    default:
+        ALOGE("%s[%d]:  Incorrect command : %d",
+                __func__,
+                __LINE__,
+                dw->cmd);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : takeDefferedWorkLocked
+ *
+ * DESCRIPTION: takes the oldest pending task whose dependencies finished.
+ *              Called with mDeffLock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : deferred task, NULL if none is ready
+ *==========================================================================*/
+QCamera2HardwareInterface::DeffWork *
+QCamera2HardwareInterface::takeDefferedWorkLocked()
+{
+    android::List<DeffWork *>::iterator it;
+
+    for (it = mDeffPending.begin(); it != mDeffPending.end(); it++) {
+        if ((*it)->deps == 0) {
+            DeffWork *dw = *it;
+            mDeffPending.erase(it);
+            return dw;
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : dispatchDefferedWorkLocked
+ *
+ * DESCRIPTION: wakes up an idle worker for each ready task. Busy workers
+ *              look for ready tasks before going idle, so no task is left
+ *              behind if all workers are busy. Called with mDeffLock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::dispatchDefferedWorkLocked()
+{
+    android::List<DeffWork *>::iterator it;
+    int ready = 0;
+
+    for (it = mDeffPending.begin(); it != mDeffPending.end(); it++) {
+        if ((*it)->deps == 0) {
+            ready++;
+        }
+    }
+
+    for (int i = 0; (i < mDeffNumWorkers) && (ready > 0); i++) {
+        if (!mDeffWorkers[i].busy) {
+            mDeffWorkers[i].busy = true;
+            mDeffWorkers[i].thread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB,
+                    FALSE,
+                    FALSE);
+            ready--;
+        }
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : defferedWorkRoutine
  *
- * DESCRIPTION: data process routine that executes deffered tasks
+ * DESCRIPTION: worker routine that executes deffered tasks
  *
  * PARAMETERS :
- *   @data    : user data ptr (QCamera2HardwareInterface)
+ *   @data    : user data ptr (DeffWorker)
  *
  * RETURN     : None
  *==========================================================================*/
@@ -6177,8 +6568,9 @@ void *QCamera2HardwareInterface::defferedWorkRoutine(void *obj)
     int running = 1;
     int ret;
 
-    QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)obj;
-    QCameraCmdThread *cmdThread = &pme->mDefferedWorkThread;
+    DeffWorker *worker = (DeffWorker *)obj;
+    QCamera2HardwareInterface *pme = worker->hw;
+    QCameraCmdThread *cmdThread = &worker->thread;
 
     do {
         do {
@@ -6203,76 +6595,43 @@ void *QCamera2HardwareInterface::defferedWorkRoutine(void *obj)
             break;
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
-                DeffWork *dw =
-                    reinterpret_cast<DeffWork *>(pme->mCmdQueue.dequeue());
+                DeffWork *dw = NULL;
 
-                if ( NULL == dw ) {
-                    ALOGE("%s : Invalid deferred work", __func__);
-                    break;
-                }
+                // run ready tasks until there is none left
+                pme->mDeffLock.lock();
+                while ((dw = pme->takeDefferedWorkLocked()) != NULL) {
+                    nsecs_t start = systemTime();
+                    pme->mDeffLock.unlock();
 
-                switch( dw->cmd ) {
-                case CMD_DEFF_ALLOCATE_BUFF:
-                    {
-                        QCameraChannel * pChannel = dw->args.allocArgs.ch;
-
-                        if ( NULL == pChannel ) {
-                            ALOGE("%s : Invalid deferred work channel",
-                                    __func__);
-                            break;
-                        }
+                    pme->runDefferedWork(dw);
 
-                        cam_stream_type_t streamType = dw->args.allocArgs.type;
-
-                        uint32_t iNumOfStreams = pChannel->getNumOfStreams();
-                        QCameraStream *pStream = NULL;
-                        for ( uint32_t i = 0; i < iNumOfStreams; ++i) {
-                            pStream = pChannel->getStreamByIndex(i);
-
-                            if ( NULL == pStream ) {
-                                break;
-                            }
-
-                            if ( pStream->isTypeOf(streamType)) {
-                                if ( pStream->allocateBuffers() ) {
-                                    ALOGE("%s: Error allocating buffers !!!",
-                                            __func__);
-                                }
-                                break;
-                            }
-                        }
-                        {
-                            Mutex::Autolock l(pme->mDeffLock);
-                            pme->mDeffOngoingJobs[dw->id] = false;
-                            delete dw;
-                            pme->mDeffCond.signal();
-                        }
+                    nsecs_t end = systemTime();
+                    pme->mDeffLock.lock();
 
+                    DeffWorkStats &stats = pme->mDeffStats[dw->cmd];
+                    stats.count++;
+                    stats.totalWait += start - dw->queued;
+                    stats.totalRun += end - start;
+                    if (end - start > stats.maxRun) {
+                        stats.maxRun = end - start;
                     }
-                    break;
-                case CMD_DEFF_PPROC_START:
-                    {
-                        QCameraChannel * pChannel = dw->args.pprocArgs;
-                        assert(pChannel);
-
-                        if (pme->m_postprocessor.start(pChannel) != NO_ERROR) {
-                            ALOGE("%s: cannot start postprocessor", __func__);
-                            pme->delChannel(QCAMERA_CH_TYPE_CAPTURE);
-                        }
-                        {
-                            Mutex::Autolock l(pme->mDeffLock);
-                            pme->mDeffOngoingJobs[dw->id] = false;
-                            delete dw;
-                            pme->mDeffCond.signal();
-                        }
+
+                    // release the dependents of the task
+                    int32_t slot = dw->id & DEFF_JOB_SLOT_MASK;
+                    uint32_t mask = 1U << slot;
+                    android::List<DeffWork *>::iterator it;
+                    for (it = pme->mDeffPending.begin();
+                            it != pme->mDeffPending.end(); it++) {
+                        (*it)->deps &= ~mask;
                     }
-                    break;
-                default:
-                    ALOGE("%s[%d]:  Incorrect command : %d",
-                            __func__,
-                            __LINE__,
-                            dw->cmd);
+                    pme->mDeffFreeJobs |= mask;
+                    pme->mDeffJobIds[slot] = -1;
+                    delete dw;
+                    pme->dispatchDefferedWorkLocked();
+                    pme->mDeffCond.broadcast();
                 }
+                worker->busy = false;
+                pme->mDeffLock.unlock();
             }
             break;
         case CAMERA_CMD_TYPE_EXIT:
@@ -6286,34 +6645,76 @@ void *QCamera2HardwareInterface::defferedWorkRoutine(void *obj)
     return NULL;
 }
 
+/*===========================================================================
+ * FUNCTION   : isDefferedWorkPendingLocked
+ *
+ * DESCRIPTION: checks whether a deferred task is queued or running. Called
+ *              with mDeffLock held.
+ *
+ * PARAMETERS :
+ *   @job_id  : deferred task id
+ *
+ * RETURN     : true if the task has not finished yet
+ *              false if it finished or the id is invalid
+ *==========================================================================*/
+bool QCamera2HardwareInterface::isDefferedWorkPendingLocked(int32_t job_id)
+{
+    if (0 > job_id) {
+        return false;
+    }
+    int32_t slot = job_id & DEFF_JOB_SLOT_MASK;
+    if (MAX_ONGOING_JOBS <= slot) {
+        return false;
+    }
+    // the slot is reused once the task finishes, the id is not
+    return mDeffJobIds[slot] == job_id;
+}
+
 /*===========================================================================
  * FUNCTION   : queueDefferedWork
  *
- * DESCRIPTION: function which queues deferred tasks
+ * DESCRIPTION: function which queues deferred tasks. Tasks without
+ *              dependencies between them may run concurrently.
  *
  * PARAMETERS :
  *   @cmd     : deferred task
  *   @args    : deffered task arguments
+ *   @deps    : ids of the tasks to finish first, finished or invalid
+ *              ids are ignored. May be NULL.
+ *   @numDeps : number of ids in deps
  *
- * RETURN     : int32_t type of status
- *              NO_ERROR  -- success
- *              none-zero failure code
+ * RETURN     : id of the deferred task, unique among the tasks
+ *              -1 if too many tasks are ongoing
  *==========================================================================*/
 int32_t QCamera2HardwareInterface::queueDefferedWork(DefferedWorkCmd cmd,
-                                                     DefferWorkArgs args)
+                                                     DefferWorkArgs args,
+                                                     const int32_t *deps,
+                                                     int numDeps)
 {
     Mutex::Autolock l(mDeffLock);
-    for (int i = 0; i < MAX_ONGOING_JOBS; ++i) {
-        if (!mDeffOngoingJobs[i]) {
-            mCmdQueue.enqueue(new DeffWork(cmd, i, args));
-            mDeffOngoingJobs[i] = true;
-            mDefferedWorkThread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB,
-                    FALSE,
-                    FALSE);
-            return i;
+
+    if (0 == mDeffFreeJobs) {
+        return -1;
+    }
+
+    uint32_t depMask = 0;
+    for (int i = 0; i < numDeps; i++) {
+        if (isDefferedWorkPendingLocked(deps[i])) {
+            depMask |= 1U << (deps[i] & DEFF_JOB_SLOT_MASK);
         }
     }
-    return -1;
+
+    int32_t slot = __builtin_ctz(mDeffFreeJobs);
+    int32_t id = (int32_t)(((mDeffJobGen++ << DEFF_JOB_SLOT_BITS) | slot) &
+            0x7fffffff);
+    DeffWork *dw = new DeffWork(cmd, id, args, depMask);
+    dw->queued = systemTime();
+    mDeffFreeJobs &= ~(1U << slot);
+    mDeffJobIds[slot] = id;
+    mDeffPending.push_back(dw);
+    dispatchDefferedWorkLocked();
+
+    return id;
 }
 
 /*===========================================================================
@@ -6322,7 +6723,7 @@ int32_t QCamera2HardwareInterface::queueDefferedWork(DefferedWorkCmd cmd,
  * DESCRIPTION: waits for a deffered task to finish
  *
  * PARAMETERS :
- *   @job_id  : deferred task id
+ *   @job_id  : deferred task id, set to -1 on return
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -6332,18 +6733,203 @@ int32_t QCamera2HardwareInterface::waitDefferedWork(int32_t &job_id)
 {
     Mutex::Autolock l(mDeffLock);
 
-    if ((MAX_ONGOING_JOBS <= job_id) || (0 > job_id)) {
-        return NO_ERROR;
-    }
-
-    while ( mDeffOngoingJobs[job_id] == true ) {
+    while (isDefferedWorkPendingLocked(job_id)) {
         mDeffCond.wait(mDeffLock);
     }
 
-    job_id = MAX_ONGOING_JOBS;
+    job_id = -1;
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : dumpDefferedWork
+ *
+ * DESCRIPTION: dumps the timing of the deferred tasks per type
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::dumpDefferedWork(int fd)
+{
+    static const char *names[CMD_DEFF_MAX] = {
+        "allocate buffers",
+        "pproc start",
+        "prewarm buffers",
+    };
+    Mutex::Autolock l(mDeffLock);
+
+    dprintf(fd, "\n Deferred Work: %d workers, %d pending\n",
+            mDeffNumWorkers, (int)mDeffPending.size());
+    for (int i = 0; i < CMD_DEFF_MAX; i++) {
+        const DeffWorkStats &stats = mDeffStats[i];
+        if (0 == stats.count) {
+            continue;
+        }
+        dprintf(fd, "  %s: %u jobs, avg wait %lld us, avg run %lld us, "
+                "max run %lld us\n", names[i], stats.count,
+                (long long)(stats.totalWait / stats.count / 1000),
+                (long long)(stats.totalRun / stats.count / 1000),
+                (long long)(stats.maxRun / 1000));
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : recordBufConfig
+ *
+ * DESCRIPTION: remembers the buffer configuration of a capture stream. The
+ *              least recently used configuration of the camera is replaced.
+ *
+ * PARAMETERS :
+ *   @stream_type : type of stream
+ *   @size        : size of buffer
+ *   @count       : number of buffers
+ *   @cached      : whether the buffers are cached
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::recordBufConfig(cam_stream_type_t stream_type,
+                                                int size,
+                                                uint8_t count,
+                                                bool cached)
+{
+    qcamera_buf_config_t *configs = g_bufConfigs[mCameraId];
+    int slot = 0;
+
+    pthread_mutex_lock(&g_bufConfigLock);
+    for (int i = 0; i < QCAMERA_PREWARM_MAX_CONFIGS; i++) {
+        if ((configs[i].last_use != 0) &&
+            (configs[i].stream_type == stream_type) &&
+            (configs[i].size == size) &&
+            (configs[i].cached == cached)) {
+            slot = i;
+            break;
+        }
+        if (configs[i].last_use < configs[slot].last_use) {
+            slot = i;
+        }
+    }
+    configs[slot].stream_type = stream_type;
+    configs[slot].size = size;
+    configs[slot].count = count;
+    configs[slot].cached = cached;
+    configs[slot].last_use = ++g_bufConfigSeq;
+    pthread_mutex_unlock(&g_bufConfigLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : queuePrewarm
+ *
+ * DESCRIPTION: queues the allocation of the buffers of the last captures
+ *              into the memory pool. Capture buffer allocations queued
+ *              later depend on it and find them in the pool.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::queuePrewarm()
+{
+    char value[PROPERTY_VALUE_MAX];
+    DefferWorkArgs args;
+    int numConfigs;
+
+    property_get("persist.camera.mem.usepool", value, "1");
+    if (atoi(value) != 1) {
+        return;
+    }
+    // number of most recent configurations to prewarm, 0 to disable
+    property_get("persist.camera.mem.prewarm", value, "3");
+    numConfigs = atoi(value);
+    if ((numConfigs <= 0) ||
+        isLongshotEnabled() ||
+        mParameters.getRecordingHintValue()) {
+        return;
+    }
+    if (numConfigs > QCAMERA_PREWARM_MAX_CONFIGS) {
+        numConfigs = QCAMERA_PREWARM_MAX_CONFIGS;
+    }
+
+    memset(&args, 0, sizeof(DefferWorkArgs));
+    args.prewarmArgs = numConfigs;
+    mPrewarmAbort = false;
+    mPrewarmJob = queueDefferedWork(CMD_DEFF_PREWARM_BUFF, args);
+}
+
+/*===========================================================================
+ * FUNCTION   : cancelPrewarm
+ *
+ * DESCRIPTION: stops an ongoing prewarm and waits for it to return
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::cancelPrewarm()
+{
+    mPrewarmAbort = true;
+    waitDefferedWork(mPrewarmJob);
+    mPrewarmAbort = false;
+}
+
+/*===========================================================================
+ * FUNCTION   : prewarmStreamBufs
+ *
+ * DESCRIPTION: allocates the buffers of the most recent capture
+ *              configurations into the memory pool. Runs on a
+ *              deferred work thread.
+ *
+ * PARAMETERS :
+ *   @numConfigs : number of configurations to prewarm
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera2HardwareInterface::prewarmStreamBufs(int numConfigs)
+{
+    qcamera_buf_config_t configs[QCAMERA_PREWARM_MAX_CONFIGS];
+    nsecs_t start = systemTime();
+    int32_t rc = NO_ERROR;
+    int total = 0;
+
+    pthread_mutex_lock(&g_bufConfigLock);
+    memcpy(configs, g_bufConfigs[mCameraId], sizeof(configs));
+    pthread_mutex_unlock(&g_bufConfigLock);
+
+    for (int n = 0; (n < numConfigs) && !mPrewarmAbort && (NO_ERROR == rc); n++) {
+        int newest = -1;
+        for (int i = 0; i < QCAMERA_PREWARM_MAX_CONFIGS; i++) {
+            if ((configs[i].last_use != 0) && ((newest < 0) ||
+                    (configs[i].last_use > configs[newest].last_use))) {
+                newest = i;
+            }
+        }
+        if (newest < 0) {
+            break;
+        }
+
+        // one buffer at a time so that a preview stop is not held back
+        for (int i = 1; (i <= configs[newest].count) && !mPrewarmAbort; i++) {
+            // same heap as QCameraStreamMemory
+            int cnt = m_memoryPool.prewarm(0x1 << ION_IOMMU_HEAP_ID,
+                    configs[newest].size, configs[newest].cached, i);
+            if (cnt < 0) {
+                rc = cnt;
+                break;
+            }
+            total += cnt;
+        }
+        configs[newest].last_use = 0;
+    }
+
+    CDBG_HIGH("[KPI Perf] %s: %d buffers prewarmed in %lld us%s", __func__,
+            total, (long long)((systemTime() - start) / 1000),
+            mPrewarmAbort ? ", cancelled" : "");
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : isRegularCapture
  *
@@ -39,12 +39,15 @@
 
 #include "QCameraQueue.h"
 #include "QCameraCmdThread.h"
+#include "QCameraDebugConfig.h"
+#include "QCameraDumpWriter.h"
 #include "QCameraChannel.h"
 #include "QCameraStream.h"
 #include "QCameraStateMachine.h"
 #include "QCameraAllocator.h"
 #include "QCameraPostProc.h"
 #include "QCameraThermalAdapter.h"
+#include "QCameraThermalController.h"
 #include "QCameraMem.h"
 
 extern "C" {
@@ -125,6 +128,21 @@ typedef struct {
 #define QCAMERA_ION_USE_CACHE   true
 #define QCAMERA_ION_USE_NOCACHE false
 #define MAX_ONGOING_JOBS 25
+// Deferred job ids are the slot in the low bits and a generation above
+#define DEFF_JOB_SLOT_BITS 5
+#define DEFF_JOB_SLOT_MASK ((1 << DEFF_JOB_SLOT_BITS) - 1)
+// Threads executing the deferred jobs
+#define MAX_DEFF_WORKERS 3
+// Number of capture buffer configurations remembered per camera
+#define QCAMERA_PREWARM_MAX_CONFIGS 4
+
+typedef struct {
+    cam_stream_type_t stream_type;
+    int size;
+    uint8_t count;
+    bool cached;
+    uint32_t last_use;   // 0 for an unused slot
+} qcamera_buf_config_t;
 
 extern volatile uint32_t gCamHalLogLevel;
 
@@ -324,6 +342,9 @@ private:
                 cam_fps_range_t &adjustedRange,
                 enum msm_vfe_frame_skip_pattern &skipPattern);
     int updateThermalLevel(qcamera_thermal_level_enum_t level);
+    void initThermalController();
+    void deinitThermalController();
+    void thermalPreviewTick();
 
     // update entris to set parameters and check if restart is needed
     int updateParameters(const char *parms, bool &needRestart);
@@ -372,6 +393,10 @@ private:
 
     int32_t sendPreviewCallback(QCameraStream *stream,
             QCameraGrallocMemory *memory, int32_t idx);
+    int32_t compactPreviewFrame(QCameraStream *stream,
+            QCameraGrallocMemory *memory, int32_t idx,
+            cam_format_t fmt, const cam_dimension_t &dim,
+            camera_memory_t **data);
     int32_t selectScene(QCameraChannel *pChannel,
             mm_camera_super_buf_t *recvd_frame);
 
@@ -553,6 +578,12 @@ private:
     int mDumpSkipCnt; // frame skip count
     mm_jpeg_exif_params_t mExifParams;
     qcamera_thermal_level_enum_t mThermalLevel;
+    QCameraThermalController m_thermalCtrl;
+    pthread_mutex_t m_thermalLock;    // controller, zone fd and sample state
+    int mThermalZoneFd;               // temp node sampled for the controller, -1 if off
+    nsecs_t mThermalLastSampleTime;
+    int mThermalFrameCnt;             // preview frames since the last sample
+    float mThermalFpsScale;           // controller fps scale, under m_parm_lock
     bool m_HDRSceneEnabled;
     bool mLongshotEnabled;
 
@@ -566,10 +597,15 @@ private:
     int32_t mFlashPresence;
     bool mIs3ALocked;
     int32_t mZoomLevel;
+    bool mPreviewCbCompact;      // send tightly packed preview callbacks
+    bool mPreviewCbKpi;          // time the preview callbacks
+    uint32_t mPreviewCbCount;
+    nsecs_t mPreviewCbTime;
 
     enum DefferedWorkCmd {
         CMD_DEFF_ALLOCATE_BUFF,
         CMD_DEFF_PPROC_START,
+        CMD_DEFF_PREWARM_BUFF,
         CMD_DEFF_MAX
     };
 
@@ -581,40 +617,80 @@ private:
     typedef union {
         DefferAllocBuffArgs allocArgs;
         QCameraChannel *pprocArgs;
+        int prewarmArgs;
     } DefferWorkArgs;
 
-    bool mDeffOngoingJobs[MAX_ONGOING_JOBS];
-
     struct DeffWork
     {
         DeffWork(DefferedWorkCmd cmd,
-                 uint32_t id,
-                 DefferWorkArgs args)
+                 int32_t id,
+                 DefferWorkArgs args,
+                 uint32_t deps)
             : cmd(cmd),
               id(id),
-              args(args){};
+              args(args),
+              deps(deps),
+              queued(0){};
 
         DefferedWorkCmd cmd;
-        uint32_t id;
+        int32_t id;
         DefferWorkArgs args;
+        uint32_t deps;    // mask of the job slots that have to finish first
+        nsecs_t queued;
+    };
+
+    struct DeffWorker
+    {
+        QCameraCmdThread thread;
+        QCamera2HardwareInterface *hw;
+        bool busy;        // woken up or running a job
     };
 
-    QCameraCmdThread      mDefferedWorkThread;
-    QCameraQueue          mCmdQueue;
+    typedef struct {
+        uint32_t count;
+        nsecs_t totalWait;
+        nsecs_t totalRun;
+        nsecs_t maxRun;
+    } DeffWorkStats;
+
+    DeffWorker            mDeffWorkers[MAX_DEFF_WORKERS];
+    int                   mDeffNumWorkers;
+    android::List<DeffWork *> mDeffPending;
+    uint32_t              mDeffFreeJobs;  // mask of the free job slots
+    int32_t               mDeffJobIds[MAX_ONGOING_JOBS]; // id per busy slot
+    uint32_t              mDeffJobGen;    // generation of the next job id
+    DeffWorkStats         mDeffStats[CMD_DEFF_MAX];
 
     Mutex                 mDeffLock;
     Condition             mDeffCond;
 
+    bool isDefferedWorkPendingLocked(int32_t job_id);
     int32_t queueDefferedWork(DefferedWorkCmd cmd,
-                              DefferWorkArgs args);
+                              DefferWorkArgs args,
+                              const int32_t *deps = NULL,
+                              int numDeps = 0);
     int32_t waitDefferedWork(int32_t &job_id);
+    void dispatchDefferedWorkLocked();
+    DeffWork *takeDefferedWorkLocked();
+    void runDefferedWork(DeffWork *dw);
+    void dumpDefferedWork(int fd);
     static void *defferedWorkRoutine(void *obj);
 
+    void recordBufConfig(cam_stream_type_t stream_type,
+                         int size,
+                         uint8_t count,
+                         bool cached);
+    void queuePrewarm();
+    void cancelPrewarm();
+    int32_t prewarmStreamBufs(int numConfigs);
+
     int32_t mSnapshotJob;
     int32_t mPostviewJob;
     int32_t mMetadataJob;
     int32_t mReprocJob;
     int32_t mRawdataJob;
+    int32_t mPrewarmJob;
+    volatile bool mPrewarmAbort;
     int32_t mOutputCount;
 };
 
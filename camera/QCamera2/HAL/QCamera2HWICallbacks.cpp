@@ -34,6 +34,7 @@
 #include <utils/Errors.h>
 #include <utils/Timers.h>
 #include "QCamera2HWI.h"
+#include "QCameraPlaneCopy.h"
 
 namespace qcamera {
 
@@ -57,7 +58,6 @@ void QCamera2HardwareInterface::zsl_channel_cb(mm_camera_super_buf_t *recvd_fram
                                                void *userdata)
 {
     CDBG_HIGH("[KPI Perf] %s: E",__func__);
-    char value[PROPERTY_VALUE_MAX];
     bool dump_raw = false;
     bool dump_yuv = false;
     bool log_matching = false;
@@ -130,8 +130,7 @@ void QCamera2HardwareInterface::zsl_channel_cb(mm_camera_super_buf_t *recvd_fram
     }
 
     // DUMP RAW if available
-    property_get("persist.camera.zsl_raw", value, "0");
-    dump_raw = atoi(value) > 0 ? true : false;
+    dump_raw = QCameraDebugConfig::get().zsl_raw > 0 ? true : false;
     if ( dump_raw ) {
         for ( int i= 0 ; i < recvd_frame->num_bufs ; i++ ) {
             if ( recvd_frame->bufs[i]->stream_type == CAM_STREAM_TYPE_RAW ) {
@@ -146,8 +145,7 @@ void QCamera2HardwareInterface::zsl_channel_cb(mm_camera_super_buf_t *recvd_fram
     }
 
     // DUMP YUV before reprocess if needed
-    property_get("persist.camera.zsl_yuv", value, "0");
-    dump_yuv = atoi(value) > 0 ? true : false;
+    dump_yuv = QCameraDebugConfig::get().zsl_yuv > 0 ? true : false;
     if ( dump_yuv ) {
         for ( int i= 0 ; i < recvd_frame->num_bufs ; i++ ) {
             if ( recvd_frame->bufs[i]->stream_type == CAM_STREAM_TYPE_SNAPSHOT ) {
@@ -211,8 +209,7 @@ void QCamera2HardwareInterface::zsl_channel_cb(mm_camera_super_buf_t *recvd_fram
         }
     }
 
-    property_get("persist.camera.dumpmetadata", value, "0");
-    int32_t enabled = atoi(value);
+    int32_t enabled = QCameraDebugConfig::get().dump_metadata;
     if (enabled) {
         mm_camera_buf_def_t *pMetaFrame = NULL;
         QCameraStream *pStream = NULL;
@@ -231,8 +228,7 @@ void QCamera2HardwareInterface::zsl_channel_cb(mm_camera_super_buf_t *recvd_fram
         }
     }
 
-    property_get("persist.camera.zsl_matching", value, "0");
-    log_matching = atoi(value) > 0 ? true : false;
+    log_matching = QCameraDebugConfig::get().zsl_matching > 0 ? true : false;
     if (log_matching) {
         CDBG_HIGH("%s : ZSL super buffer contains:", __func__);
         QCameraStream *pStream = NULL;
@@ -365,7 +361,6 @@ int32_t QCamera2HardwareInterface::selectScene(QCameraChannel *pChannel,
 void QCamera2HardwareInterface::capture_channel_cb_routine(mm_camera_super_buf_t *recvd_frame,
                                                            void *userdata)
 {
-    char value[PROPERTY_VALUE_MAX];
     CDBG_HIGH("[KPI Perf] %s: E PROFILE_YUV_CB_TO_HAL", __func__);
     QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)userdata;
     if (pme == NULL ||
@@ -392,8 +387,7 @@ void QCamera2HardwareInterface::capture_channel_cb_routine(mm_camera_super_buf_t
     }
     *frame = *recvd_frame;
 
-    property_get("persist.camera.dumpmetadata", value, "0");
-    int32_t enabled = atoi(value);
+    int32_t enabled = QCameraDebugConfig::get().dump_metadata;
     if (enabled) {
         mm_camera_buf_def_t *pMetaFrame = NULL;
         QCameraStream *pStream = NULL;
@@ -557,6 +551,7 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
     if (pme->needDebugFps()) {
         pme->debugShowPreviewFPS();
     }
+    pme->thermalPreviewTick();
 
     int idx = frame->buf_idx;
     pme->dumpFrameToFile(stream, frame, QCAMERA_DUMP_FRM_PREVIEW);
@@ -612,12 +607,12 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
 int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
         QCameraGrallocMemory *memory, int32_t idx)
 {
-    camera_memory_t *previewMem = NULL;
     camera_memory_t *data = NULL;
     int previewBufSize;
     cam_dimension_t preview_dim;
     cam_format_t previewFmt;
     int32_t rc = NO_ERROR;
+    nsecs_t start = mPreviewCbKpi ? systemTime() : 0;
 
     if ((NULL == stream) || (NULL == memory)) {
         ALOGE("%s: Invalid preview callback input", __func__);
@@ -634,23 +629,31 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     if ((previewFmt == CAM_FORMAT_YUV_420_NV21) ||
         (previewFmt == CAM_FORMAT_YUV_420_NV12) ||
         (previewFmt == CAM_FORMAT_YUV_420_YV12)) {
-        if(previewFmt == CAM_FORMAT_YUV_420_YV12) {
-            previewBufSize = ((preview_dim.width+15)/16) * 16 * preview_dim.height +
-                             ((preview_dim.width/2+15)/16) * 16* preview_dim.height;
-            } else {
-                previewBufSize = preview_dim.width * preview_dim.height * 3/2;
+        if (mPreviewCbCompact) {
+            rc = compactPreviewFrame(stream, memory, idx, previewFmt,
+                    preview_dim, &data);
+            if (NO_ERROR != rc) {
+                return rc;
             }
-        if(previewBufSize != memory->getSize(idx)) {
-            previewMem = mGetMemory(memory->getFd(idx),
-                       previewBufSize, 1, mCallbackCookie);
-            if (!previewMem || !previewMem->data) {
-                ALOGE("%s: mGetMemory failed.\n", __func__);
-                return NO_MEMORY;
+        }
+        if (NULL == data) {
+            if(previewFmt == CAM_FORMAT_YUV_420_YV12) {
+                previewBufSize = ((preview_dim.width+15)/16) * 16 * preview_dim.height +
+                                 ((preview_dim.width/2+15)/16) * 16* preview_dim.height;
             } else {
-                data = previewMem;
+                previewBufSize = preview_dim.width * preview_dim.height * 3/2;
             }
-        } else
-            data = memory->getMemory(idx, false);
+            if(previewBufSize != memory->getSize(idx)) {
+                // the wrapper is kept with the buffer for the next frames
+                data = memory->getCallbackMemory(idx, previewBufSize,
+                        mCallbackCookie);
+                if (!data) {
+                    ALOGE("%s: mGetMemory failed.\n", __func__);
+                    return NO_MEMORY;
+                }
+            } else
+                data = memory->getMemory(idx, false);
+        }
     } else {
         data = memory->getMemory(idx, false);
         ALOGE("%s: Invalid preview format, buffer size in preview callback may be wrong.",
@@ -661,22 +664,112 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
     cbArg.cb_type = QCAMERA_DATA_CALLBACK;
     cbArg.msg_type = CAMERA_MSG_PREVIEW_FRAME;
     cbArg.data = data;
-    if ( previewMem ) {
-        cbArg.user_data = previewMem;
-        cbArg.release_cb = releaseCameraMemory;
-    }
     cbArg.cookie = this;
     rc = m_cbNotifier.notifyCallback(cbArg);
     if (rc != NO_ERROR) {
         ALOGE("%s: fail sending notification", __func__);
-        if (previewMem) {
-            previewMem->release(previewMem);
-        }
+    }
+
+    if (!mPreviewCbKpi) {
+        return rc;
+    }
+    mPreviewCbTime += systemTime() - start;
+    if ((++mPreviewCbCount % 300) == 0) {
+        CDBG_HIGH("[KPI Perf] %s: %dx%d %s, avg %lld us per frame", __func__,
+                preview_dim.width, preview_dim.height,
+                mPreviewCbCompact ? "compact" : "wrapped",
+                (long long)(mPreviewCbTime / mPreviewCbCount / 1000));
     }
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : compactPreviewFrame
+ *
+ * DESCRIPTION: copies a padded preview frame into tightly packed callback
+ *              memory. Planes without padding are copied at once, the
+ *              others row by row.
+ *
+ * PARAMETERS :
+ *   @stream    : stream object
+ *   @memory    : Gralloc memory allocator
+ *   @idx       : buffer index
+ *   @fmt       : preview format, NV21, NV12 or YV12
+ *   @dim       : preview dimension
+ *   @data      : [output] packed callback memory, NULL if the frame
+ *                is packed already
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera2HardwareInterface::compactPreviewFrame(QCameraStream *stream,
+        QCameraGrallocMemory *memory, int32_t idx,
+        cam_format_t fmt, const cam_dimension_t &dim,
+        camera_memory_t **data)
+{
+    cam_frame_len_offset_t offset;
+    int numPlanes, size = 0;
+    int dstStride[3], dstWidth[3], dstHeight[3];
+    qcamera_plane_copy_t planes[3];
+    bool packed = true;
+
+    *data = NULL;
+
+    // android layout of the callback formats
+    dstStride[0] = dstWidth[0] = dim.width;
+    dstHeight[0] = dim.height;
+    if (fmt == CAM_FORMAT_YUV_420_YV12) {
+        numPlanes = 3;
+        dstStride[0] = (dim.width + 15) & ~15;
+        dstStride[1] = dstStride[2] = (dim.width / 2 + 15) & ~15;
+        dstWidth[1] = dstWidth[2] = dim.width / 2;
+        dstHeight[1] = dstHeight[2] = dim.height / 2;
+    } else {
+        numPlanes = 2;
+        dstStride[1] = dstWidth[1] = dim.width;
+        dstHeight[1] = dim.height / 2;
+    }
+
+    memset(&offset, 0, sizeof(cam_frame_len_offset_t));
+    stream->getFrameOffset(offset);
+    if (offset.num_planes != numPlanes) {
+        return NO_ERROR;
+    }
+
+    int start = 0;
+    for (int i = 0; i < numPlanes; i++) {
+        planes[i].src_offset = start + offset.mp[i].offset;
+        planes[i].src_stride = offset.mp[i].stride;
+        planes[i].dst_offset = size;
+        planes[i].dst_stride = dstStride[i];
+        planes[i].width = dstWidth[i];
+        planes[i].height = dstHeight[i];
+        size += dstStride[i] * dstHeight[i];
+        start += offset.mp[i].len;
+        if ((planes[i].src_offset != planes[i].dst_offset) ||
+            (planes[i].src_stride != planes[i].dst_stride)) {
+            packed = false;
+        }
+    }
+    if (packed) {
+        return NO_ERROR;
+    }
+
+    camera_memory_t *mem = memory->getCompactMemory(idx, size, mCallbackCookie);
+    if (!mem) {
+        return NO_MEMORY;
+    }
+
+    memory->invalidateCache(idx);
+    QCameraPlaneCopy::copy((uint8_t *)mem->data,
+            (const uint8_t *)memory->getPtr(idx), planes, numPlanes);
+
+    *data = mem;
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : nodisplay_preview_stream_cb_routine
  *
@@ -1040,7 +1133,6 @@ void QCamera2HardwareInterface::snapshot_stream_cb_routine(mm_camera_super_buf_t
                                                            QCameraStream * /*stream*/,
                                                            void *userdata)
 {
-    char value[PROPERTY_VALUE_MAX];
 
     CDBG_HIGH("[KPI Perf] %s: E", __func__);
     QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)userdata;
@@ -1053,8 +1145,7 @@ void QCamera2HardwareInterface::snapshot_stream_cb_routine(mm_camera_super_buf_t
         return;
     }
 
-    property_get("persist.camera.dumpmetadata", value, "0");
-    int32_t enabled = atoi(value);
+    int32_t enabled = QCameraDebugConfig::get().dump_metadata;
     if (enabled) {
         QCameraChannel *pChannel = pme->m_channels[QCAMERA_CH_TYPE_SNAPSHOT];
         if (pChannel == NULL ||
@@ -1143,7 +1234,6 @@ void QCamera2HardwareInterface::preview_raw_stream_cb_routine(mm_camera_super_bu
 {
     CDBG_HIGH("[KPI Perf] %s : BEGIN", __func__);
     int i = -1;
-    char value[PROPERTY_VALUE_MAX];
     bool dump_raw = false;
 
     QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)userdata;
@@ -1156,8 +1246,7 @@ void QCamera2HardwareInterface::preview_raw_stream_cb_routine(mm_camera_super_bu
         return;
     }
 
-    property_get("persist.camera.preview_raw", value, "0");
-    dump_raw = atoi(value) > 0 ? true : false;
+    dump_raw = QCameraDebugConfig::get().preview_raw > 0 ? true : false;
 
     for ( i= 0 ; i < super_frame->num_bufs ; i++ ) {
         if ( super_frame->bufs[i]->stream_type == CAM_STREAM_TYPE_RAW ) {
@@ -1196,7 +1285,6 @@ void QCamera2HardwareInterface::snapshot_raw_stream_cb_routine(mm_camera_super_b
 {
     CDBG_HIGH("[KPI Perf] %s : BEGIN", __func__);
     int i = -1;
-    char value[PROPERTY_VALUE_MAX];
     bool dump_raw = false;
 
     QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)userdata;
@@ -1209,8 +1297,7 @@ void QCamera2HardwareInterface::snapshot_raw_stream_cb_routine(mm_camera_super_b
         return;
     }
 
-    property_get("persist.camera.snapshot_raw", value, "0");
-    dump_raw = atoi(value) > 0 ? true : false;
+    dump_raw = QCameraDebugConfig::get().snapshot_raw > 0 ? true : false;
 
     for ( i= 0 ; i < super_frame->num_bufs ; i++ ) {
         if ( super_frame->bufs[i]->stream_type == CAM_STREAM_TYPE_RAW ) {
@@ -1511,9 +1598,7 @@ void QCamera2HardwareInterface::dumpJpegToFile(const void *data,
                                                uint32_t size,
                                                int index)
 {
-    char value[PROPERTY_VALUE_MAX];
-    property_get("persist.camera.dumpimg", value, "0");
-    int32_t enabled = atoi(value);
+    int32_t enabled = QCameraDebugConfig::get().dump_img;
     int frm_num = 0;
     uint32_t skip_mode = 0;
 
@@ -1543,14 +1628,11 @@ void QCamera2HardwareInterface::dumpJpegToFile(const void *data,
             if (mDumpFrmCnt >= 0 && mDumpFrmCnt <= frm_num) {
                 snprintf(buf, sizeof(buf), "/data/%d_%d.jpg", mDumpFrmCnt, index);
 
-                int file_fd = open(buf, O_RDWR | O_CREAT, 0777);
-                if (file_fd > 0) {
-                    int written_len = write(file_fd, data, size);
-                    CDBG_HIGH("%s: written number of bytes %d\n",
-                        __func__, written_len);
-                    close(file_fd);
-                } else {
-                    ALOGE("%s: fail t open file for image dumping", __func__);
+                QCameraDumpWriter *writer = QCameraDumpWriter::getInstance();
+                uint8_t *dumpBuf = writer->reserve(size);
+                if (dumpBuf) {
+                    memcpy(dumpBuf, data, size);
+                    writer->submit(buf, dumpBuf, size);
                 }
                 mDumpFrmCnt++;
             }
@@ -1563,11 +1645,9 @@ void QCamera2HardwareInterface::dumpJpegToFile(const void *data,
 void QCamera2HardwareInterface::dumpMetadataToFile(QCameraStream *stream,
                                                    mm_camera_buf_def_t *frame,char *type)
 {
-    char value[PROPERTY_VALUE_MAX];
     int frm_num = 0;
     metadata_buffer_t *metadata = (metadata_buffer_t *)frame->buffer;
-    property_get("persist.camera.dumpmetadata", value, "0");
-    int32_t enabled = atoi(value);
+    int32_t enabled = QCameraDebugConfig::get().dump_metadata;
     if (stream == NULL) {
         CDBG_HIGH("No op");
         return;
@@ -1601,39 +1681,43 @@ void QCamera2HardwareInterface::dumpMetadataToFile(QCameraStream *stream,
             snprintf(buf, sizeof(buf), "%dm_%s_%d.bin",
                                          mDumpFrmCnt,type,frame->frame_idx);
             filePath.append(buf);
-            int file_fd = open(filePath.string(), O_RDWR | O_CREAT, 0777);
-            if (file_fd > 0) {
-                int written_len = 0;
-                metadata->tuning_params.tuning_data_version = TUNING_DATA_VERSION;
-                void *data = (void *)((uint8_t *)&metadata->tuning_params.tuning_data_version);
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_sensor_data_size);
-                CDBG_HIGH("tuning_sensor_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_vfe_data_size);
-                CDBG_HIGH("tuning_vfe_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_cpp_data_size);
-                CDBG_HIGH("tuning_cpp_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                data = (void *)((uint8_t *)&metadata->tuning_params.tuning_cac_data_size);
-                CDBG_HIGH("tuning_cac_data_size %d",(int)(*(int *)data));
-                written_len += write(file_fd, data, sizeof(uint32_t));
-                int total_size = metadata->tuning_params.tuning_sensor_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data);
-                written_len += write(file_fd, data, total_size);
-                total_size = metadata->tuning_params.tuning_vfe_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data[TUNING_VFE_DATA_OFFSET]);
-                written_len += write(file_fd, data, total_size);
-                total_size = metadata->tuning_params.tuning_cpp_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data[TUNING_CPP_DATA_OFFSET]);
-                written_len += write(file_fd, data, total_size);
-                total_size = metadata->tuning_params.tuning_cac_data_size;
-                data = (void *)((uint8_t *)&metadata->tuning_params.data[TUNING_CAC_DATA_OFFSET]);
-                written_len += write(file_fd, data, total_size);
-                close(file_fd);
-            }else {
-                ALOGE("%s: fail t open file for image dumping", __func__);
+            tuning_params_t &tuning = metadata->tuning_params;
+            tuning.tuning_data_version = TUNING_DATA_VERSION;
+            CDBG_HIGH("tuning data size sensor %d vfe %d cpp %d cac %d",
+                    tuning.tuning_sensor_data_size,
+                    tuning.tuning_vfe_data_size,
+                    tuning.tuning_cpp_data_size,
+                    tuning.tuning_cac_data_size);
+            size_t len = 5 * sizeof(uint32_t) +
+                    tuning.tuning_sensor_data_size +
+                    tuning.tuning_vfe_data_size +
+                    tuning.tuning_cpp_data_size +
+                    tuning.tuning_cac_data_size;
+            QCameraDumpWriter *writer = QCameraDumpWriter::getInstance();
+            uint8_t *dumpBuf = writer->reserve(len);
+            if (dumpBuf) {
+                uint8_t *p = dumpBuf;
+                memcpy(p, &tuning.tuning_data_version, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                memcpy(p, &tuning.tuning_sensor_data_size, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                memcpy(p, &tuning.tuning_vfe_data_size, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                memcpy(p, &tuning.tuning_cpp_data_size, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                memcpy(p, &tuning.tuning_cac_data_size, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                memcpy(p, &tuning.data[0], tuning.tuning_sensor_data_size);
+                p += tuning.tuning_sensor_data_size;
+                memcpy(p, &tuning.data[TUNING_VFE_DATA_OFFSET],
+                        tuning.tuning_vfe_data_size);
+                p += tuning.tuning_vfe_data_size;
+                memcpy(p, &tuning.data[TUNING_CPP_DATA_OFFSET],
+                        tuning.tuning_cpp_data_size);
+                p += tuning.tuning_cpp_data_size;
+                memcpy(p, &tuning.data[TUNING_CAC_DATA_OFFSET],
+                        tuning.tuning_cac_data_size);
+                writer->submit(filePath.string(), dumpBuf, len);
             }
             mDumpFrmCnt++;
         }
@@ -1659,9 +1743,7 @@ void QCamera2HardwareInterface::dumpFrameToFile(QCameraStream *stream,
                                                 mm_camera_buf_def_t *frame,
                                                 int dump_type)
 {
-    char value[PROPERTY_VALUE_MAX];
-    property_get("persist.camera.dumpimg", value, "0");
-    int32_t enabled = atoi(value);
+    int32_t enabled = QCameraDebugConfig::get().dump_img;
     int frm_num = 0;
     uint32_t skip_mode = 0;
     int mDumpFrmCnt = stream->mDumpFrame;
@@ -1764,28 +1846,29 @@ void QCamera2HardwareInterface::dumpFrameToFile(QCameraStream *stream,
                     }
 
                     filePath.append(buf);
-                    int file_fd = open(filePath.string(), O_RDWR | O_CREAT, 0777);
-                    if (file_fd > 0) {
-                        void *data = NULL;
-                        int written_len = 0;
 
+                    // the rows are packed so the dump thread writes the
+                    // frame at once
+                    size_t len = 0;
+                    for (int i = 0; i < offset.num_planes; i++) {
+                        len += offset.mp[i].width * offset.mp[i].height;
+                    }
+                    QCameraDumpWriter *writer = QCameraDumpWriter::getInstance();
+                    uint8_t *dumpBuf = writer->reserve(len);
+                    if (dumpBuf) {
+                        uint8_t *dst = dumpBuf;
+                        uint32_t planeStart = 0;
                         for (int i = 0; i < offset.num_planes; i++) {
-                            uint32_t index = offset.mp[i].offset;
-                            if (i > 0) {
-                                index += offset.mp[i-1].len;
-                            }
+                            const uint8_t *src = (const uint8_t *)frame->buffer +
+                                    planeStart + offset.mp[i].offset;
                             for (int j = 0; j < offset.mp[i].height; j++) {
-                                data = (void *)((uint8_t *)frame->buffer + index);
-                                written_len += write(file_fd, data, offset.mp[i].width);
-                                index += offset.mp[i].stride;
+                                memcpy(dst, src, offset.mp[i].width);
+                                dst += offset.mp[i].width;
+                                src += offset.mp[i].stride;
                             }
+                            planeStart += offset.mp[i].len;
                         }
-
-                        CDBG_HIGH("%s: written number of bytes %d\n",
-                            __func__, written_len);
-                        close(file_fd);
-                    } else {
-                        ALOGE("%s: fail t open file for image dumping", __func__);
+                        writer->submit(filePath.string(), dumpBuf, len);
                     }
                     mDumpFrmCnt++;
                 }
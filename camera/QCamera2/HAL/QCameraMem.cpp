@@ -374,6 +374,7 @@ int QCameraMemory::allocOneBuffer(QCameraMemInfo &memInfo,
     memInfo.handle = ion_info_fd.handle;
     memInfo.size = alloc.len;
     memInfo.cached = cached;
+    memInfo.secure = (secure_mode == SECURE);
     memInfo.heap_id = heap_id;
 
     ALOGD("%s : ION buffer %lx with size %d allocated",
@@ -430,8 +431,25 @@ void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
  * RETURN     : None
  *==========================================================================*/
 QCameraMemoryPool::QCameraMemoryPool()
+    : mBudget(0),
+      mCachedBytes(0),
+      mCachedCnt(0),
+      mReleaseSeq(0),
+      mHits(0),
+      mMisses(0),
+      mEvictions(0),
+      mHitBytes(0),
+      mWasteBytes(0),
+      mPrewarmed(0),
+      mPrewarmHits(0)
 {
+    char value[PROPERTY_VALUE_MAX];
+
     pthread_mutex_init(&mLock, NULL);
+
+    // budget of the cached buffers in MB, 0 for no limit
+    property_get("persist.camera.mem.pool_budget", value, "0");
+    mBudget = (uint64_t)atoi(value) * 1024 * 1024;
 }
 
 
@@ -450,6 +468,92 @@ QCameraMemoryPool::~QCameraMemoryPool()
     pthread_mutex_destroy(&mLock);
 }
 
+/*===========================================================================
+ * FUNCTION   : sizeClass
+ *
+ * DESCRIPTION: size class of a page aligned buffer size
+ *
+ * PARAMETERS :
+ *   @size    : buffer size in bytes
+ *
+ * RETURN     : index of the size class
+ *==========================================================================*/
+int QCameraMemoryPool::sizeClass(uint32_t size)
+{
+    uint32_t pages = size >> 12;
+    int cls;
+
+    if (pages == 0) {
+        return 0;
+    }
+    cls = 31 - __builtin_clz(pages);
+    if (cls >= MEMORY_POOL_NUM_SIZE_CLASSES) {
+        cls = MEMORY_POOL_NUM_SIZE_CLASSES - 1;
+    }
+    return cls;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocSize
+ *
+ * DESCRIPTION: size allocOneBuffer allocates for a request
+ *
+ * PARAMETERS :
+ *   @size    : requested size
+ *   @secure  : whether the buffer is secure
+ *
+ * RETURN     : aligned size
+ *==========================================================================*/
+uint32_t QCameraMemoryPool::allocSize(int size, bool secure)
+{
+    uint32_t len = ((uint32_t)size + 4095) & (~4095);
+
+    if (secure) {
+        len = (len + (1024 * 1024 - 1)) & (~(1024 * 1024 - 1));
+    }
+    return len;
+}
+
+/*===========================================================================
+ * FUNCTION   : putBuffer
+ *
+ * DESCRIPTION: adds one buffer to the pool. The least recently released
+ *              buffers are freed if the pool goes over its budget.
+ *
+ * PARAMETERS :
+ *   @memInfo : reference to struct that stores additional memory allocation info
+ *   @prewarmed: whether the buffer was allocated ahead of use
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::putBuffer(
+        struct QCameraMemory::QCameraMemInfo &memInfo,
+        bool prewarmed)
+{
+    List<struct QCameraMemory::QCameraMemInfo> evicted;
+    QCameraPoolEntry entry;
+
+    entry.memInfo = memInfo;
+    entry.prewarmed = prewarmed;
+
+    pthread_mutex_lock(&mLock);
+
+    entry.releaseSeq = ++mReleaseSeq;
+    mPools[sizeClass(memInfo.size)].push_back(entry);
+    mCachedBytes += memInfo.size;
+    mCachedCnt++;
+    if (prewarmed) {
+        mPrewarmed++;
+    }
+    if ((mBudget > 0) && (mCachedBytes > mBudget)) {
+        trimLocked(mBudget, evicted);
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    deallocEvicted(evicted);
+}
+
 /*===========================================================================
  * FUNCTION   : releaseBuffer
  *
@@ -463,13 +567,91 @@ QCameraMemoryPool::~QCameraMemoryPool()
  *==========================================================================*/
 void QCameraMemoryPool::releaseBuffer(
         struct QCameraMemory::QCameraMemInfo &memInfo,
-        cam_stream_type_t streamType)
+        cam_stream_type_t /*streamType*/)
 {
-    pthread_mutex_lock(&mLock);
+    putBuffer(memInfo, false);
+}
+
+/*===========================================================================
+ * FUNCTION   : trimLocked
+ *
+ * DESCRIPTION: takes the least recently released buffers out of the pool
+ *              until at most maxBytes are cached. Called with mLock held.
+ *
+ * PARAMETERS :
+ *   @maxBytes: bytes to keep cached
+ *   @evicted : [output] buffers to be freed once mLock is dropped
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trimLocked(uint64_t maxBytes,
+        List<struct QCameraMemory::QCameraMemInfo> &evicted)
+{
+    while (mCachedBytes > maxBytes) {
+        int oldest = -1;
+        for (int i = 0; i < MEMORY_POOL_NUM_SIZE_CLASSES; i++) {
+            if (mPools[i].empty()) {
+                continue;
+            }
+            // each list is in release order
+            if ((oldest < 0) || ((*mPools[i].begin()).releaseSeq <
+                    (*mPools[oldest].begin()).releaseSeq)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+
+        List<QCameraPoolEntry>::iterator it = mPools[oldest].begin();
+        evicted.push_back((*it).memInfo);
+        mCachedBytes -= (*it).memInfo.size;
+        mCachedCnt--;
+        mEvictions++;
+        mPools[oldest].erase(it);
+    }
+}
 
-    mPools[streamType].push_back(memInfo);
+/*===========================================================================
+ * FUNCTION   : deallocEvicted
+ *
+ * DESCRIPTION: frees the buffers taken out of the pool
+ *
+ * PARAMETERS :
+ *   @evicted : buffers to be freed
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::deallocEvicted(
+        List<struct QCameraMemory::QCameraMemInfo> &evicted)
+{
+    List<struct QCameraMemory::QCameraMemInfo>::iterator it;
+    for (it = evicted.begin(); it != evicted.end(); it++) {
+        QCameraMemory::deallocOneBuffer(*it);
+    }
+    evicted.clear();
+}
 
+/*===========================================================================
+ * FUNCTION   : trim
+ *
+ * DESCRIPTION: frees the least recently released buffers until at most
+ *              maxBytes are cached
+ *
+ * PARAMETERS :
+ *   @maxBytes: bytes to keep cached
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trim(uint64_t maxBytes)
+{
+    List<struct QCameraMemory::QCameraMemInfo> evicted;
+
+    pthread_mutex_lock(&mLock);
+    trimLocked(maxBytes, evicted);
     pthread_mutex_unlock(&mLock);
+
+    deallocEvicted(evicted);
 }
 
 /*===========================================================================
@@ -483,32 +665,48 @@ void QCameraMemoryPool::releaseBuffer(
  *==========================================================================*/
 void QCameraMemoryPool::clear()
 {
-    pthread_mutex_lock(&mLock);
-
-    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++ ) {
-        List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-        it = mPools[i].begin();
-        for( ; it != mPools[i].end() ; it++) {
-            QCameraMemory::deallocOneBuffer(*it);
-        }
+    trim(0);
+}
 
-        mPools[i].clear();
-    }
+/*===========================================================================
+ * FUNCTION   : fits
+ *
+ * DESCRIPTION: whether a cached buffer can serve a request. Buffers with
+ *              more than 1/4 of the requested size as slack are not reused.
+ *
+ * PARAMETERS :
+ *   @info    : cached buffer
+ *   @heap_id : type of heap
+ *   @size    : aligned size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *   @secure  : whether the buffer should be secure
+ *
+ * RETURN     : true if the buffer fits
+ *==========================================================================*/
+bool QCameraMemoryPool::fits(const QCameraMemory::QCameraMemInfo &info,
+        int heap_id,
+        uint32_t size,
+        bool cached,
+        bool secure)
+{
+    uint32_t maxSize = size + (size >> MEMORY_POOL_MAX_WASTE_SHIFT);
 
-    pthread_mutex_unlock(&mLock);
+    return (info.size >= size) && (info.size <= maxSize) &&
+           (info.heap_id == heap_id) && (info.cached == cached) &&
+           (info.secure == secure);
 }
 
 /*===========================================================================
  * FUNCTION   : findBufferLocked
  *
- * DESCRIPTION: search for a appropriate cached buffer
+ * DESCRIPTION: search for the best fitting cached buffer
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
  *   @heap_id : type of heap
- *   @size    : size of the buffer
+ *   @size    : aligned size of the buffer
  *   @cached  : whether the buffer should be cached
- *   @streaType: type of stream this buffer belongs to
+ *   @secure  : whether the buffer should be secure
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -519,35 +717,84 @@ int QCameraMemoryPool::findBufferLocked(
         int heap_id,
         uint32_t size,
         bool cached,
-        cam_stream_type_t streamType)
+        bool secure)
 {
-    int rc = NAME_NOT_FOUND;
+    uint32_t maxSize = size + (size >> MEMORY_POOL_MAX_WASTE_SHIFT);
+    int lastClass = sizeClass(maxSize);
+    List<QCameraPoolEntry>::iterator it, best;
+    bool found = false;
+    int cls;
+
+    // all buffers of a class are larger than the ones of lower classes,
+    // so the first class with a fitting buffer has the best fit
+    for (cls = sizeClass(size); (cls <= lastClass) && !found; cls++) {
+        for (it = mPools[cls].begin(); it != mPools[cls].end(); it++) {
+            const QCameraMemory::QCameraMemInfo &info = (*it).memInfo;
+            if (!fits(info, heap_id, size, cached, secure)) {
+                continue;
+            }
+            if (!found || (info.size < (*best).memInfo.size)) {
+                best = it;
+                found = true;
+                if (info.size == size) {
+                    break;
+                }
+            }
+        }
+        if (found) {
+            memInfo = (*best).memInfo;
+            if ((*best).prewarmed) {
+                mPrewarmHits++;
+            }
+            mPools[cls].erase(best);
+        }
+    }
 
-    if (mPools[streamType].empty()) {
+    if (!found) {
         return NAME_NOT_FOUND;
     }
+    mCachedBytes -= memInfo.size;
+    mCachedCnt--;
+    return NO_ERROR;
+}
 
-    List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-    it = mPools[streamType].begin();
-    for ( ; it != mPools[streamType].end() ; it++) {
-        if ( ((*it).size >= size) &&
-            ((*it).heap_id == heap_id) &&
-            ((*it).cached == cached) ) {
-            memInfo = *it;
-            mPools[streamType].erase(it);
-            rc = NO_ERROR;
-            break;
+/*===========================================================================
+ * FUNCTION   : countBuffersLocked
+ *
+ * DESCRIPTION: number of cached non-secure buffers that can serve a request
+ *
+ * PARAMETERS :
+ *   @heap_id : type of heap
+ *   @size    : aligned size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *
+ * RETURN     : number of fitting buffers
+ *==========================================================================*/
+int QCameraMemoryPool::countBuffersLocked(int heap_id,
+        uint32_t size,
+        bool cached)
+{
+    uint32_t maxSize = size + (size >> MEMORY_POOL_MAX_WASTE_SHIFT);
+    int lastClass = sizeClass(maxSize);
+    List<QCameraPoolEntry>::iterator it;
+    int count = 0;
+
+    for (int cls = sizeClass(size); cls <= lastClass; cls++) {
+        for (it = mPools[cls].begin(); it != mPools[cls].end(); it++) {
+            if (fits((*it).memInfo, heap_id, size, cached, false)) {
+                count++;
+            }
         }
     }
-
-    return rc;
+    return count;
 }
 
 /*===========================================================================
  * FUNCTION   : allocateBuffer
  *
  * DESCRIPTION: allocates a buffer from the memory pool,
- *              it will re-use cached buffers if possible
+ *              it will re-use cached buffers if possible. New ion
+ *              buffers are allocated without holding the pool lock.
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
@@ -569,19 +816,126 @@ int QCameraMemoryPool::allocateBuffer(
         int secure_mode)
 {
     int rc = NO_ERROR;
+    bool secure = (secure_mode == SECURE);
+    uint32_t len = allocSize(size, secure);
 
     pthread_mutex_lock(&mLock);
 
-    rc = findBufferLocked(memInfo, heap_id, size, cached, streamType);
-    if (NAME_NOT_FOUND == rc ) {
-        ALOGE("%s : Buffer not found!", __func__);
+    rc = findBufferLocked(memInfo, heap_id, len, cached, secure);
+    if (NO_ERROR == rc) {
+        mHits++;
+        mHitBytes += memInfo.size;
+        mWasteBytes += memInfo.size - len;
+    } else {
+        mMisses++;
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    if (NAME_NOT_FOUND == rc) {
+        CDBG_HIGH("%s : Buffer of %d bytes for stream %d not found",
+                __func__, size, streamType);
         rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
                  secure_mode);
+        if (NO_ERROR != rc) {
+            // low on memory, give the cached buffers back and retry
+            ALOGE("%s : Allocation failed, dropping cached buffers", __func__);
+            trim(0);
+            rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size,
+                     cached, secure_mode);
+        }
     }
 
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : prewarm
+ *
+ * DESCRIPTION: allocates non-secure buffers ahead of use until the pool
+ *              holds count buffers fitting the request. The buffers are
+ *              allocated without holding the pool lock.
+ *
+ * PARAMETERS :
+ *   @heap_id : type of heap
+ *   @size    : size of the buffer
+ *   @cached  : whether the buffer should be cached
+ *   @count   : number of buffers wanted in the pool
+ *
+ * RETURN     : number of buffers allocated, negative on failure
+ *==========================================================================*/
+int QCameraMemoryPool::prewarm(int heap_id, int size, bool cached, int count)
+{
+    uint32_t len = allocSize(size, false);
+    int allocated = 0;
+    int cnt;
+
+    pthread_mutex_lock(&mLock);
+    cnt = countBuffersLocked(heap_id, len, cached);
     pthread_mutex_unlock(&mLock);
 
-    return rc;
+    for (; cnt < count; cnt++) {
+        QCameraMemory::QCameraMemInfo memInfo;
+        memset(&memInfo, 0, sizeof(memInfo));
+        if (NO_ERROR != QCameraMemory::allocOneBuffer(memInfo, heap_id, size,
+                cached, NON_SECURE)) {
+            ALOGE("%s : Prewarm of %d bytes failed", __func__, size);
+            return allocated ? allocated : NO_MEMORY;
+        }
+        putBuffer(memInfo, true);
+        allocated++;
+    }
+
+    return allocated;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: Composes a string with the pool statistics
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : Formatted string
+ *==========================================================================*/
+String8 QCameraMemoryPool::dump()
+{
+    String8 str("\n");
+    char s[128];
+
+    pthread_mutex_lock(&mLock);
+
+    snprintf(s, 128, "Hits: %u Misses: %u Evictions: %u\n",
+            mHits, mMisses, mEvictions);
+    str += s;
+
+    snprintf(s, 128, "Prewarmed: %u buffers, %u hits (%u%%)\n",
+            mPrewarmed, mPrewarmHits,
+            mPrewarmed ? mPrewarmHits * 100 / mPrewarmed : 0);
+    str += s;
+
+    snprintf(s, 128, "Cached: %u buffers %llu bytes, budget %llu bytes\n",
+            mCachedCnt, (unsigned long long)mCachedBytes,
+            (unsigned long long)mBudget);
+    str += s;
+
+    snprintf(s, 128, "Fragmentation: %llu of %llu reused bytes (%llu%%)\n",
+            (unsigned long long)mWasteBytes, (unsigned long long)mHitBytes,
+            (unsigned long long)(mHitBytes ?
+                mWasteBytes * 100 / mHitBytes : 0));
+    str += s;
+
+    for (int i = 0; i < MEMORY_POOL_NUM_SIZE_CLASSES; i++) {
+        if (!mPools[i].empty()) {
+            snprintf(s, 128, "  %u+ pages: %u buffers\n", 1U << i,
+                    (unsigned int)mPools[i].size());
+            str += s;
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    return str;
 }
 
 /*===========================================================================
@@ -1281,6 +1635,8 @@ QCameraGrallocMemory::QCameraGrallocMemory(camera_request_memory getMemory)
         mBufferHandle[i] = NULL;
         mLocalFlag[i] = BUFFER_NOT_OWNED;
         mPrivateHandle[i] = NULL;
+        mCallbackMemory[i] = NULL;
+        mCompactMemory[i] = NULL;
     }
 }
 
@@ -1589,6 +1945,14 @@ void QCameraGrallocMemory::deallocate()
     CDBG("%s: E ", __FUNCTION__);
 
     for (int cnt = 0; cnt < mBufferCount; cnt++) {
+        if (mCallbackMemory[cnt]) {
+            mCallbackMemory[cnt]->release(mCallbackMemory[cnt]);
+            mCallbackMemory[cnt] = NULL;
+        }
+        if (mCompactMemory[cnt]) {
+            mCompactMemory[cnt]->release(mCompactMemory[cnt]);
+            mCompactMemory[cnt] = NULL;
+        }
         mCameraMemory[cnt]->release(mCameraMemory[cnt]);
         struct ion_handle_data ion_handle;
         memset(&ion_handle, 0, sizeof(ion_handle));
@@ -1674,6 +2038,88 @@ camera_memory_t *QCameraGrallocMemory::getMemory(int index, bool metadata) const
     return mCameraMemory[index];
 }
 
+/*===========================================================================
+ * FUNCTION   : requestMemory
+ *
+ * DESCRIPTION: gets camera memory from the framework unless the cached one
+ *              has the requested size already
+ *
+ * PARAMETERS :
+ *   @mem     : [IN/OUT] cached camera memory
+ *   @fd      : fd to wrap, -1 for new memory
+ *   @size    : size of the memory
+ *   @cookie  : callback cookie of the framework
+ *
+ * RETURN     : camera memory ptr
+ *              NULL if failed
+ *==========================================================================*/
+camera_memory_t *QCameraGrallocMemory::requestMemory(camera_memory_t *&mem,
+        int fd, int size, void *cookie)
+{
+    if (mem && (mem->size == (size_t)size)) {
+        return mem;
+    }
+    if (mem) {
+        mem->release(mem);
+        mem = NULL;
+    }
+
+    mem = mGetMemory(fd, size, 1, cookie);
+    if (mem && !mem->data) {
+        mem->release(mem);
+        mem = NULL;
+    }
+    if (!mem) {
+        ALOGE("%s: getMemory of %d bytes failed", __func__, size);
+    }
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : getCallbackMemory
+ *
+ * DESCRIPTION: camera memory wrapping the first size bytes of a buffer
+ *
+ * PARAMETERS :
+ *   @index   : buffer index
+ *   @size    : size of the callback data
+ *   @cookie  : callback cookie of the framework
+ *
+ * RETURN     : camera memory ptr
+ *              NULL if failed
+ *==========================================================================*/
+camera_memory_t *QCameraGrallocMemory::getCallbackMemory(int index, int size,
+        void *cookie)
+{
+    if (index >= mBufferCount) {
+        return NULL;
+    }
+    return requestMemory(mCallbackMemory[index], mMemInfo[index].fd, size,
+            cookie);
+}
+
+/*===========================================================================
+ * FUNCTION   : getCompactMemory
+ *
+ * DESCRIPTION: camera memory to hold a packed copy of a buffer
+ *
+ * PARAMETERS :
+ *   @index   : buffer index
+ *   @size    : size of the callback data
+ *   @cookie  : callback cookie of the framework
+ *
+ * RETURN     : camera memory ptr
+ *              NULL if failed
+ *==========================================================================*/
+camera_memory_t *QCameraGrallocMemory::getCompactMemory(int index, int size,
+        void *cookie)
+{
+    if (index >= mBufferCount) {
+        return NULL;
+    }
+    return requestMemory(mCompactMemory[index], -1, size, cookie);
+}
+
 /*===========================================================================
  * FUNCTION   : getMatchBufIndex
  *
@@ -33,6 +33,7 @@
 #include <hardware/camera.h>
 #include <utils/Mutex.h>
 #include <utils/List.h>
+#include <utils/String8.h>
 #include <qdMetaData.h>
 
 extern "C" {
@@ -83,6 +84,7 @@ protected:
         ion_user_handle_t handle;
         uint32_t size;
         bool cached;
+        bool secure;
         int heap_id;
     };
 
@@ -103,6 +105,12 @@ protected:
     cam_stream_type_t mStreamType;
 };
 
+// Cached ion buffers are binned by size class, a class holds the buffers
+// of 2^n to 2^(n+1) - 1 pages. The pool is shared by all stream types.
+#define MEMORY_POOL_NUM_SIZE_CLASSES 20
+// Max slack of a reused buffer is 1/4 of the requested size
+#define MEMORY_POOL_MAX_WASTE_SHIFT  2
+
 class QCameraMemoryPool {
 
 public:
@@ -118,17 +126,52 @@ public:
                        int is_secure);
     void releaseBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
                        cam_stream_type_t streamType);
+    int prewarm(int heap_id, int size, bool cached, int count);
     void clear();
+    void trim(uint64_t maxBytes);
+    android::String8 dump();
 
 protected:
 
+    struct QCameraPoolEntry {
+        QCameraMemory::QCameraMemInfo memInfo;
+        uint64_t releaseSeq; // for LRU trimming
+        bool prewarmed;      // allocated ahead of use, not reused yet
+    };
+
+    static int sizeClass(uint32_t size);
+    static uint32_t allocSize(int size, bool secure);
+    static bool fits(const QCameraMemory::QCameraMemInfo &info,
+                     int heap_id,
+                     uint32_t size,
+                     bool cached,
+                     bool secure);
     int findBufferLocked(struct QCameraMemory::QCameraMemInfo &memInfo,
                          int heap_id,
                          uint32_t size,
                          bool cached,
-                         cam_stream_type_t streamType);
-
-    android::List<QCameraMemory::QCameraMemInfo> mPools[CAM_STREAM_TYPE_MAX];
+                         bool secure);
+    int countBuffersLocked(int heap_id, uint32_t size, bool cached);
+    void putBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
+                   bool prewarmed);
+    void trimLocked(uint64_t maxBytes,
+                    android::List<QCameraMemory::QCameraMemInfo> &evicted);
+    static void deallocEvicted(
+            android::List<QCameraMemory::QCameraMemInfo> &evicted);
+
+    android::List<QCameraPoolEntry> mPools[MEMORY_POOL_NUM_SIZE_CLASSES];
+    uint64_t mBudget;          // max bytes cached, 0 for no limit
+    uint64_t mCachedBytes;
+    uint32_t mCachedCnt;
+    uint64_t mReleaseSeq;
+    // statistics
+    uint32_t mHits;
+    uint32_t mMisses;
+    uint32_t mEvictions;
+    uint64_t mHitBytes;        // size of the reused buffers
+    uint64_t mWasteBytes;      // slack of the reused buffers
+    uint32_t mPrewarmed;       // buffers allocated by prewarm
+    uint32_t mPrewarmHits;     // prewarmed buffers handed out
     pthread_mutex_t mLock;
 };
 
@@ -220,8 +263,15 @@ public:
     // and dequeue one buffer from it.
     // Returns the buffer index of the dequeued buffer.
     int displayBuffer(int index);
+    // Memory for the preview data callback of buffer[index]. It is
+    // created on first use and released along with the buffers.
+    camera_memory_t *getCallbackMemory(int index, int size, void *cookie);
+    camera_memory_t *getCompactMemory(int index, int size, void *cookie);
 
 private:
+    camera_memory_t *requestMemory(camera_memory_t *&mem, int fd, int size,
+                                   void *cookie);
+
     buffer_handle_t *mBufferHandle[MM_CAMERA_MAX_NUM_FRAMES];
     int mLocalFlag[MM_CAMERA_MAX_NUM_FRAMES];
     struct private_handle_t *mPrivateHandle[MM_CAMERA_MAX_NUM_FRAMES];
@@ -229,6 +279,8 @@ private:
     int mWidth, mHeight, mFormat, mStride, mScanline;
     camera_request_memory mGetMemory;
     camera_memory_t *mCameraMemory[MM_CAMERA_MAX_NUM_FRAMES];
+    camera_memory_t *mCallbackMemory[MM_CAMERA_MAX_NUM_FRAMES];
+    camera_memory_t *mCompactMemory[MM_CAMERA_MAX_NUM_FRAMES];
     int mMinUndequeuedBuffers;
     enum ColorSpace_t mColorSpace;
 };
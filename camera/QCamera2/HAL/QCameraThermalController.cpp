@@ -0,0 +1,243 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define LOG_TAG "QCameraThermalController"
+
+#include <math.h>
+
+#include "QCameraThermalController.h"
+
+namespace qcamera {
+
+// Time constants of the temperature and slope filters, in seconds
+#define THERMAL_CTRL_TEMP_TAU_SEC   3.0f
+#define THERMAL_CTRL_SLOPE_TAU_SEC  10.0f
+// Samples further apart than this start the filters over
+#define THERMAL_CTRL_MAX_GAP_SEC    10.0f
+// Slopes below this, in degrees per second, count as flat
+#define THERMAL_CTRL_MIN_SLOPE      0.001f
+
+/*===========================================================================
+ * FUNCTION   : QCameraThermalController
+ *
+ * DESCRIPTION: constructor of QCameraThermalController
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraThermalController::QCameraThermalController()
+{
+    defaultConfig(mConfig);
+    reset();
+}
+
+/*===========================================================================
+ * FUNCTION   : defaultConfig
+ *
+ * DESCRIPTION: fill in the default level temperatures and rates
+ *
+ * PARAMETERS :
+ *   @config  : config to fill in
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThermalController::defaultConfig(qcamera_thermal_ctrl_config_t &config)
+{
+    config.levelTemp[QCAMERA_THERMAL_NO_ADJUSTMENT] = -INFINITY;
+    config.levelTemp[QCAMERA_THERMAL_SLIGHT_ADJUSTMENT] = QCAMERA_THERMAL_CTRL_SLIGHT_TEMP;
+    config.levelTemp[QCAMERA_THERMAL_BIG_ADJUSTMENT] = QCAMERA_THERMAL_CTRL_BIG_TEMP;
+    config.levelTemp[QCAMERA_THERMAL_SHUTDOWN] = QCAMERA_THERMAL_CTRL_SHUTDOWN_TEMP;
+    config.horizonSec = QCAMERA_THERMAL_CTRL_HORIZON_SEC;
+    config.maxStepPerSec = QCAMERA_THERMAL_CTRL_MAX_STEP;
+}
+
+/*===========================================================================
+ * FUNCTION   : configure
+ *
+ * DESCRIPTION: set level temperatures and rates, and start over
+ *
+ * PARAMETERS :
+ *   @config  : new config
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThermalController::configure(const qcamera_thermal_ctrl_config_t &config)
+{
+    mConfig = config;
+    reset();
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: forget the temperature history and lift the fps scale
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThermalController::reset()
+{
+    mLastNs = 0;
+    mTemp = 0;
+    mSlope = 0;
+    mSecondsToNext = -1;
+    mFpsScale = 1.0f;
+    mAppliedScale = 1.0f;
+    mPredicted = QCAMERA_THERMAL_NO_ADJUSTMENT;
+}
+
+/*===========================================================================
+ * FUNCTION   : levelFpsScale
+ *
+ * DESCRIPTION: fps scale calcThermalLevel applies for a level. Shutdown
+ *              gets the lowest fps supported there, the controller only
+ *              goes down to half of the fps ahead of it.
+ *
+ * PARAMETERS :
+ *   @level   : thermal level
+ *
+ * RETURN     : fps scale
+ *==========================================================================*/
+float QCameraThermalController::levelFpsScale(qcamera_thermal_level_enum_t level)
+{
+    switch (level) {
+    case QCAMERA_THERMAL_NO_ADJUSTMENT:
+        return 1.0f;
+    case QCAMERA_THERMAL_SLIGHT_ADJUSTMENT:
+        return 0.9f;
+    case QCAMERA_THERMAL_BIG_ADJUSTMENT:
+        return 0.8f;
+    case QCAMERA_THERMAL_SHUTDOWN:
+    default:
+        return 0.5f;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : tempLevel
+ *
+ * DESCRIPTION: level the thermal engine is expected to report at a
+ *              temperature
+ *
+ * PARAMETERS :
+ *   @tempC   : temperature in degrees Celsius
+ *
+ * RETURN     : thermal level
+ *==========================================================================*/
+qcamera_thermal_level_enum_t QCameraThermalController::tempLevel(float tempC) const
+{
+    int level = QCAMERA_THERMAL_NO_ADJUSTMENT;
+
+    while (level < QCAMERA_THERMAL_SHUTDOWN && tempC >= mConfig.levelTemp[level + 1]) {
+        level++;
+    }
+    return (qcamera_thermal_level_enum_t)level;
+}
+
+/*===========================================================================
+ * FUNCTION   : update
+ *
+ * DESCRIPTION: feed a temperature sample and move the fps scale towards
+ *              the scale for the predicted level
+ *
+ * PARAMETERS :
+ *   @nowNs   : sample time in nanoseconds
+ *   @tempC   : temperature in degrees Celsius
+ *   @load    : share of the configured frame rate the pipeline delivers,
+ *              0 to 1
+ *   @level   : level last reported by the thermal engine
+ *
+ * RETURN     : true when the fps scale should be applied
+ *==========================================================================*/
+bool QCameraThermalController::update(int64_t nowNs, float tempC, float load,
+        qcamera_thermal_level_enum_t level)
+{
+    float dt = (nowNs - mLastNs) / 1e9f;
+
+    if (mLastNs == 0 || dt <= 0 || dt > THERMAL_CTRL_MAX_GAP_SEC) {
+        mTemp = tempC;
+        mSlope = 0;
+        dt = 0;
+    } else {
+        float temp = mTemp + (tempC - mTemp) * dt / (THERMAL_CTRL_TEMP_TAU_SEC + dt);
+        float slope = (temp - mTemp) / dt;
+        mSlope += (slope - mSlope) * dt / (THERMAL_CTRL_SLOPE_TAU_SEC + dt);
+        mTemp = temp;
+    }
+    mLastNs = nowNs;
+
+    if (load < 0) {
+        load = 0;
+    } else if (load > 1) {
+        load = 1;
+    }
+
+    int current = tempLevel(mTemp);
+    if (level > current) {
+        current = level;
+    }
+
+    float base = levelFpsScale((qcamera_thermal_level_enum_t)current);
+    float target = base;
+    mSecondsToNext = -1;
+    mPredicted = (qcamera_thermal_level_enum_t)current;
+
+    if (current < QCAMERA_THERMAL_SHUTDOWN && mSlope > THERMAL_CTRL_MIN_SLOPE) {
+        qcamera_thermal_level_enum_t next = (qcamera_thermal_level_enum_t)(current + 1);
+        float urgency;
+
+        mSecondsToNext = (mConfig.levelTemp[next] - mTemp) / mSlope;
+        if (mSecondsToNext < 0) {
+            mSecondsToNext = 0;
+        }
+        urgency = 1.0f - mSecondsToNext / mConfig.horizonSec;
+        if (urgency > 0) {
+            mPredicted = next;
+            target = base - (base - levelFpsScale(next)) * urgency * (0.5f + 0.5f * load);
+        }
+    }
+
+    float step = mConfig.maxStepPerSec * dt;
+    if (mFpsScale > target) {
+        mFpsScale = (mFpsScale - target > step) ? mFpsScale - step : target;
+    } else {
+        mFpsScale = (target - mFpsScale > step) ? mFpsScale + step : target;
+    }
+
+    if (fabsf(mFpsScale - mAppliedScale) >= QCAMERA_THERMAL_CTRL_APPLY_DELTA ||
+            (mFpsScale == target && mFpsScale != mAppliedScale)) {
+        mAppliedScale = mFpsScale;
+        return true;
+    }
+    return false;
+}
+
+}; // namespace qcamera
@@ -0,0 +1,104 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_THERMAL_CONTROLLER_H__
+#define __QCAMERA_THERMAL_CONTROLLER_H__
+
+#include <stdint.h>
+
+#include "QCameraThermalAdapter.h"
+
+namespace qcamera {
+
+// Temperatures in degrees Celsius at which the thermal engine is expected
+// to step to the slight, big and shutdown levels.
+#define QCAMERA_THERMAL_CTRL_SLIGHT_TEMP    45.0f
+#define QCAMERA_THERMAL_CTRL_BIG_TEMP       55.0f
+#define QCAMERA_THERMAL_CTRL_SHUTDOWN_TEMP  65.0f
+// Seconds ahead of a predicted level the fps starts to come down
+#define QCAMERA_THERMAL_CTRL_HORIZON_SEC    60.0f
+// Largest change of the fps scale per second
+#define QCAMERA_THERMAL_CTRL_MAX_STEP       0.01f
+// Period of the temperature samples
+#define QCAMERA_THERMAL_CTRL_SAMPLE_MS      1000
+// Smallest change of the fps scale worth a parameter update
+#define QCAMERA_THERMAL_CTRL_APPLY_DELTA    0.02f
+
+typedef struct {
+    float levelTemp[QCAMERA_THERMAL_SHUTDOWN + 1];
+    float horizonSec;
+    float maxStepPerSec;
+} qcamera_thermal_ctrl_config_t;
+
+/******************************************************************************
+ * Predicts the next thermal level from the temperature trend and brings the
+ * fps scale down smoothly ahead of it, instead of the fixed step that comes
+ * with the level. The closer the predicted level and the busier the frame
+ * pipeline, the further the scale goes towards the next level's scale.
+ * The scale only ever restricts; calcThermalLevel still applies the level
+ * the thermal engine reports. Not thread safe, fed from one thread.
+ *****************************************************************************/
+class QCameraThermalController
+{
+public:
+    QCameraThermalController();
+
+    void configure(const qcamera_thermal_ctrl_config_t &config);
+    void reset();
+
+    // Returns true when the fps scale moved enough to be applied
+    bool update(int64_t nowNs, float tempC, float load,
+            qcamera_thermal_level_enum_t level);
+
+    float getFpsScale() const { return mFpsScale; }
+    float getSlope() const { return mSlope; }
+    float getTemperature() const { return mTemp; }
+    // Seconds until the next level is reached, negative when not rising
+    float getSecondsToNextLevel() const { return mSecondsToNext; }
+    qcamera_thermal_level_enum_t getPredictedLevel() const { return mPredicted; }
+
+    static float levelFpsScale(qcamera_thermal_level_enum_t level);
+    static void defaultConfig(qcamera_thermal_ctrl_config_t &config);
+
+private:
+    qcamera_thermal_level_enum_t tempLevel(float tempC) const;
+
+    qcamera_thermal_ctrl_config_t mConfig;
+    int64_t mLastNs;
+    float mTemp;
+    float mSlope;
+    float mSecondsToNext;
+    float mFpsScale;
+    float mAppliedScale;
+    qcamera_thermal_level_enum_t mPredicted;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_THERMAL_CONTROLLER_H__ */
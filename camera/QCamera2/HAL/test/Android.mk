@@ -50,3 +50,136 @@ LOCAL_32_BIT_ONLY := true
 include $(BUILD_EXECUTABLE)
 
 endif
+
+# thermal controller simulation, host only
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    qcamera_thermal_sim.cpp \
+    ../QCameraThermalController.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+LOCAL_MODULE := qcamera-thermal-sim
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# preview callback compaction benchmark, host only
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    qcamera_preview_cb_bench.cpp \
+    ../../util/QCameraPlaneCopy.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../util
+
+LOCAL_MODULE := qcamera-preview-cb-bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror
+
+include $(BUILD_HOST_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
+
+# memory pool prewarm benchmark, needs /dev/ion
+OLD_LOCAL_PATH := $(LOCAL_PATH)
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    qcamera_prewarm_bench.cpp \
+    ../QCameraMem.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/.. \
+    $(LOCAL_PATH)/../../stack/common \
+    $(LOCAL_PATH)/../../util \
+    $(LOCAL_PATH)/../../../mm-image-codec/qexif \
+    $(LOCAL_PATH)/../../../mm-image-codec/qomx_core \
+    frameworks/native/include/media/hardware \
+    frameworks/native/include/media/openmax \
+    $(call project-path-for,qcom-media)/libstagefrighthw \
+    $(call project-path-for,qcom-display)/libgralloc \
+    $(call project-path-for,qcom-display)/libqdutils \
+    system/media/camera/include \
+    $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libui libqdMetaData
+
+LOCAL_MODULE := qcamera-prewarm-bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_32_BIT_ONLY := true
+include $(BUILD_EXECUTABLE)
+
+LOCAL_PATH := $(OLD_LOCAL_PATH)
+
+# debug config snapshot benchmark, host and device
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    qcamera_debug_config_bench.cpp \
+    ../../util/QCameraDebugConfig.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := libcutils
+
+LOCAL_MODULE := qcamera-debug-config-bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    qcamera_debug_config_bench.cpp \
+    ../../util/QCameraDebugConfig.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := libcutils
+
+LOCAL_MODULE := qcamera-debug-config-bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror
+
+LOCAL_32_BIT_ONLY := true
+include $(BUILD_EXECUTABLE)
+
+# dump writer test, host only
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    qcamera_dump_writer_test.cpp \
+    ../../util/QCameraDumpWriter.cpp \
+    ../../util/QCameraCmdThread.cpp \
+    ../../util/QCameraQueue.cpp
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../../util \
+    $(LOCAL_PATH)/../../stack/common
+
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils
+
+LOCAL_MODULE := qcamera-dump-writer-test
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror
+
+include $(BUILD_HOST_EXECUTABLE)
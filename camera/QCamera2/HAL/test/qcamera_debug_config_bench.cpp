@@ -0,0 +1,192 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Debug config benchmark. Compares what a frame path pays to check a debug
+ * property through the QCameraDebugConfig snapshot with the property_get
+ * it replaced, and what a reload of the snapshot costs. Also reads the
+ * snapshot from several threads while it is reloaded and checks that the
+ * readers always see the property values. Builds for the host and the
+ * device; only the device has the real property area behind property_get.
+ */
+
+#include <cutils/properties.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "QCameraDebugConfig.h"
+
+using namespace qcamera;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+#define BENCH_LOOKUPS 200000
+#define BENCH_RELOADS 1000
+#define BENCH_READERS 4
+
+typedef struct {
+    qcamera_debug_config_t expected;
+    bool done;
+    uint64_t reads;
+    uint64_t failures;
+} bench_reader_t;
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int32_t getIntProperty(const char *key)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get(key, value, "0");
+    return atoi(value);
+}
+
+/* What the snapshot holds, read the way the frame paths used to */
+static void bench_expected(qcamera_debug_config_t &cfg)
+{
+    cfg.dump_img = getIntProperty("persist.camera.dumpimg");
+    cfg.dump_metadata = getIntProperty("persist.camera.dumpmetadata");
+    cfg.zsl_raw = getIntProperty("persist.camera.zsl_raw");
+    cfg.zsl_yuv = getIntProperty("persist.camera.zsl_yuv");
+    cfg.zsl_matching = getIntProperty("persist.camera.zsl_matching");
+    cfg.preview_raw = getIntProperty("persist.camera.preview_raw");
+    cfg.snapshot_raw = getIntProperty("persist.camera.snapshot_raw");
+}
+
+static bool bench_equal(const qcamera_debug_config_t &a, const qcamera_debug_config_t &b)
+{
+    return a.dump_img == b.dump_img && a.dump_metadata == b.dump_metadata &&
+           a.zsl_raw == b.zsl_raw && a.zsl_yuv == b.zsl_yuv &&
+           a.zsl_matching == b.zsl_matching && a.preview_raw == b.preview_raw &&
+           a.snapshot_raw == b.snapshot_raw;
+}
+
+static void *bench_reader(void *data)
+{
+    bench_reader_t *reader = (bench_reader_t *)data;
+
+    while (!__atomic_load_n(&reader->done, __ATOMIC_ACQUIRE)) {
+        qcamera_debug_config_t cfg = QCameraDebugConfig::get();
+        if (!bench_equal(cfg, reader->expected)) {
+            reader->failures++;
+        }
+        reader->reads++;
+    }
+    return NULL;
+}
+
+static int test_lookup(void)
+{
+    qcamera_debug_config_t expected;
+    int64_t start, snapshotNs, propertyNs, reloadNs;
+    int32_t sum = 0;
+
+    bench_expected(expected);
+    QCameraDebugConfig::refresh();
+    CHECK(bench_equal(QCameraDebugConfig::get(), expected));
+
+    start = nowNs();
+    for (int n = 0; n < BENCH_LOOKUPS; n++) {
+        sum += QCameraDebugConfig::get().dump_metadata;
+    }
+    snapshotNs = nowNs() - start;
+
+    start = nowNs();
+    for (int n = 0; n < BENCH_LOOKUPS; n++) {
+        sum -= getIntProperty("persist.camera.dumpmetadata");
+    }
+    propertyNs = nowNs() - start;
+    CHECK(sum == 0);
+
+    start = nowNs();
+    for (int n = 0; n < BENCH_RELOADS; n++) {
+        QCameraDebugConfig::refresh();
+    }
+    reloadNs = nowNs() - start;
+
+    fprintf(stderr, "%-25s%.1f ns snapshot, %.1f ns property_get\n", "Lookup: ",
+            (double)snapshotNs / BENCH_LOOKUPS, (double)propertyNs / BENCH_LOOKUPS);
+    fprintf(stderr, "%-25s%.2f us for %d properties\n", "Reload: ",
+            reloadNs / 1000.0 / BENCH_RELOADS,
+            (int)(sizeof(qcamera_debug_config_t) / sizeof(int32_t)));
+    return 0;
+}
+
+static int test_concurrent(void)
+{
+    bench_reader_t readers[BENCH_READERS];
+    pthread_t threads[BENCH_READERS];
+    uint64_t reads = 0, failures = 0;
+
+    for (int i = 0; i < BENCH_READERS; i++) {
+        bench_expected(readers[i].expected);
+        readers[i].done = false;
+        readers[i].reads = 0;
+        readers[i].failures = 0;
+        CHECK(pthread_create(&threads[i], NULL, bench_reader, &readers[i]) == 0);
+    }
+    for (int n = 0; n < BENCH_RELOADS; n++) {
+        QCameraDebugConfig::refresh();
+    }
+    for (int i = 0; i < BENCH_READERS; i++) {
+        __atomic_store_n(&readers[i].done, true, __ATOMIC_RELEASE);
+        pthread_join(threads[i], NULL);
+        reads += readers[i].reads;
+        failures += readers[i].failures;
+    }
+
+    CHECK(failures == 0);
+    fprintf(stderr, "%-25s%llu reads by %d readers over %d reloads\n", "Concurrent: ",
+            (unsigned long long)reads, BENCH_READERS, BENCH_RELOADS);
+    return 0;
+}
+
+int main(void)
+{
+    int ret = -1;
+
+    if (test_lookup() || test_concurrent())
+        goto exit;
+    ret = 0;
+
+exit:
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
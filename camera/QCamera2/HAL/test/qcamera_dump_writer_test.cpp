@@ -0,0 +1,202 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Dump writer test. Reserves dumps past QCAMERA_DUMP_QUEUE_MAX_BYTES and
+ * checks which ones are dropped, that cancelled dumps give their room
+ * back, and that the dumps submitted before the writer is destroyed all
+ * end up in their files with the right content.
+ *
+ * Usage: qcamera-dump-writer-test [directory]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "QCameraDumpWriter.h"
+
+using namespace qcamera;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+#define TEST_DUMP_SIZE  (4 * 1024 * 1024)
+#define TEST_NUM_DUMPS  (QCAMERA_DUMP_QUEUE_MAX_BYTES / TEST_DUMP_SIZE)
+
+/* Statistics line of QCameraDumpWriter::dump */
+static int test_stats(QCameraDumpWriter *writer, const char *dir, char *out,
+        size_t len)
+{
+    char path[QCAMERA_DUMP_PATH_MAX];
+    ssize_t rc;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/stats.txt", dir);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    CHECK(fd >= 0);
+    writer->dump(fd);
+    rc = pread(fd, out, len - 1, 0);
+    close(fd);
+    unlink(path);
+    CHECK(rc > 0);
+    out[rc] = '\0';
+    return 0;
+}
+
+/* The queue holds QCAMERA_DUMP_QUEUE_MAX_BYTES of reserved dumps */
+static int test_limit(const char *dir)
+{
+    QCameraDumpWriter writer;
+    uint8_t *bufs[TEST_NUM_DUMPS];
+    char stats[512];
+
+    for (int i = 0; i < TEST_NUM_DUMPS; i++) {
+        bufs[i] = writer.reserve(TEST_DUMP_SIZE);
+        CHECK(bufs[i] != NULL);
+    }
+    // full, the dump thread has nothing to write yet
+    CHECK(writer.reserve(TEST_DUMP_SIZE) == NULL);
+    CHECK(writer.reserve(1) == NULL);
+    CHECK(test_stats(&writer, dir, stats, sizeof(stats)) == 0);
+    CHECK(strstr(stats, "2 dropped (4194305 bytes)") != NULL);
+
+    // a cancelled dump gives its room back
+    writer.cancel(bufs[0], TEST_DUMP_SIZE);
+    bufs[0] = writer.reserve(TEST_DUMP_SIZE);
+    CHECK(bufs[0] != NULL);
+
+    for (int i = 0; i < TEST_NUM_DUMPS; i++) {
+        writer.cancel(bufs[i], TEST_DUMP_SIZE);
+    }
+    CHECK(test_stats(&writer, dir, stats, sizeof(stats)) == 0);
+    CHECK(strstr(stats, "queued 0 bytes") != NULL);
+    CHECK(strstr(stats, "0 files 0 bytes written") != NULL);
+
+    fprintf(stderr, "%-25s%d x %d bytes queued, 2 dropped\n", "Limit: ",
+            TEST_NUM_DUMPS, TEST_DUMP_SIZE);
+    return 0;
+}
+
+static int test_check_file(const char *path, int pattern)
+{
+    uint8_t *buf = (uint8_t *)malloc(TEST_DUMP_SIZE);
+    struct stat st;
+    ssize_t rc;
+    int fd;
+
+    CHECK(buf != NULL);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(buf);
+    }
+    CHECK(fd >= 0);
+    rc = (fstat(fd, &st) == 0 && st.st_size == TEST_DUMP_SIZE) ?
+            read(fd, buf, TEST_DUMP_SIZE) : -1;
+    close(fd);
+    unlink(path);
+
+    bool ok = (rc == TEST_DUMP_SIZE);
+    for (int i = 0; ok && i < TEST_DUMP_SIZE; i++) {
+        ok = (buf[i] == (uint8_t)(pattern + i));
+    }
+    free(buf);
+    CHECK(ok);
+    return 0;
+}
+
+/*
+ * Submits a full queue and destroys the writer right away. Every submitted
+ * dump has to be written on shutdown. A reservation made while the dump
+ * thread writes races with it, so its drop is only reported.
+ */
+static int test_shutdown(const char *dir)
+{
+    QCameraDumpWriter *writer = new QCameraDumpWriter();
+    char path[QCAMERA_DUMP_PATH_MAX];
+    int dropped = 0;
+
+    CHECK(writer != NULL);
+    for (int n = 0; n < TEST_NUM_DUMPS; n++) {
+        uint8_t *buf = writer->reserve(TEST_DUMP_SIZE);
+        CHECK(buf != NULL);
+        for (int i = 0; i < TEST_DUMP_SIZE; i++) {
+            buf[i] = (uint8_t)(n + i);
+        }
+        snprintf(path, sizeof(path), "%s/dump_%d.bin", dir, n);
+        writer->submit(path, buf, TEST_DUMP_SIZE);
+    }
+    // the dump thread may not have written a single dump yet
+    uint8_t *buf = writer->reserve(TEST_DUMP_SIZE);
+    if (buf == NULL) {
+        dropped++;
+    } else {
+        writer->cancel(buf, TEST_DUMP_SIZE);
+    }
+    delete writer;
+
+    for (int n = 0; n < TEST_NUM_DUMPS; n++) {
+        snprintf(path, sizeof(path), "%s/dump_%d.bin", dir, n);
+        CHECK(test_check_file(path, n) == 0);
+    }
+
+    fprintf(stderr, "%-25s%d dumps written, %d dropped while writing\n",
+            "Shutdown: ", TEST_NUM_DUMPS, dropped);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char dir[QCAMERA_DUMP_PATH_MAX / 2];
+    int ret = -1;
+
+    snprintf(dir, sizeof(dir), "%s/qcamera-dump-XXXXXX",
+            argc >= 2 ? argv[1] : "/tmp");
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "cannot create a directory in %s\n",
+                argc >= 2 ? argv[1] : "/tmp");
+        return 1;
+    }
+
+    if (test_limit(dir) || test_shutdown(dir))
+        goto exit;
+    ret = 0;
+
+exit:
+    rmdir(dir);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
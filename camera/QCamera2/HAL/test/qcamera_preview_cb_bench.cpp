@@ -0,0 +1,214 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Preview callback compaction benchmark. Times the stride removal copy
+ * compactPreviewFrame does for padded NV21 and YV12 frames, and what a
+ * consumer pays for reading the frame from the packed copy and, as with
+ * the wrapper path, straight from the padded buffer. Frames rotate
+ * through a set of buffers like the preview stream's, so the copies go
+ * to memory rather than staying in the cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "QCameraPlaneCopy.h"
+
+using namespace qcamera;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+#define BENCH_BUFFERS 8
+#define BENCH_FRAMES  240
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+    bool yv12;
+    int stride;      // padded luma stride of the stream
+    int scanline;    // padded luma rows of the stream
+} bench_frame_t;
+
+static const bench_frame_t kFrames[] = {
+    { "1080p NV21", 1920, 1080, false, 1920, 1088 },
+    { "1440x1080 NV21", 1440, 1080, false, 1472, 1088 },
+    { "720p NV21", 1280, 720, false, 1280, 736 },
+    { "800x480 NV21", 800, 480, false, 832, 480 },
+    { "1080p YV12", 1920, 1080, true, 1984, 1088 },
+};
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Stream layout as the padded planes of the preview buffer, and the
+ * android callback layout compactPreviewFrame packs them into.
+ */
+static int bench_layout(const bench_frame_t &f, qcamera_plane_copy_t *planes,
+        int *srcSize, int *dstSize)
+{
+    int numPlanes = f.yv12 ? 3 : 2;
+    int src = 0, dst = 0;
+
+    for (int i = 0; i < numPlanes; i++) {
+        qcamera_plane_copy_t &p = planes[i];
+        if (i == 0) {
+            p.src_stride = f.stride;
+            p.dst_stride = f.yv12 ? (f.width + 15) & ~15 : f.width;
+            p.width = f.width;
+            p.height = f.height;
+        } else if (f.yv12) {
+            p.src_stride = f.stride / 2;
+            p.dst_stride = (f.width / 2 + 15) & ~15;
+            p.width = f.width / 2;
+            p.height = f.height / 2;
+        } else {
+            p.src_stride = f.stride;
+            p.dst_stride = f.width;
+            p.width = f.width;
+            p.height = f.height / 2;
+        }
+        p.src_offset = src;
+        p.dst_offset = dst;
+        src += p.src_stride * (i == 0 ? f.scanline : f.scanline / 2);
+        dst += p.dst_stride * p.height;
+    }
+    *srcSize = src;
+    *dstSize = dst;
+    return numPlanes;
+}
+
+/* Sums the visible bytes of a frame, like a consumer looking at each pixel */
+static uint32_t bench_read(const uint8_t *buf, const qcamera_plane_copy_t *planes,
+        int numPlanes, bool packed)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < numPlanes; i++) {
+        const qcamera_plane_copy_t &p = planes[i];
+        const uint8_t *row = buf + (packed ? p.dst_offset : p.src_offset);
+        uint32_t stride = packed ? p.dst_stride : p.src_stride;
+        for (uint32_t j = 0; j < p.height; j++, row += stride) {
+            for (uint32_t k = 0; k < p.width; k++) {
+                sum += row[k];
+            }
+        }
+    }
+    return sum;
+}
+
+static int bench_frame(const bench_frame_t &f)
+{
+    qcamera_plane_copy_t planes[3];
+    uint8_t *src[BENCH_BUFFERS], *dst[BENCH_BUFFERS];
+    int srcSize, dstSize;
+    int64_t start, copyNs, packedNs, paddedNs;
+    uint32_t packedSum = 0, paddedSum = 0;
+
+    int numPlanes = bench_layout(f, planes, &srcSize, &dstSize);
+    for (int b = 0; b < BENCH_BUFFERS; b++) {
+        src[b] = (uint8_t *)malloc(srcSize);
+        dst[b] = (uint8_t *)malloc(dstSize);
+        CHECK(src[b] != NULL && dst[b] != NULL);
+        for (int n = 0; n < srcSize; n++) {
+            src[b][n] = (uint8_t)(n * 7 + b);
+        }
+        memset(dst[b], 0, dstSize);
+    }
+
+    start = nowNs();
+    for (int n = 0; n < BENCH_FRAMES; n++) {
+        int b = n % BENCH_BUFFERS;
+        QCameraPlaneCopy::copy(dst[b], src[b], planes, numPlanes);
+    }
+    copyNs = nowNs() - start;
+
+    start = nowNs();
+    for (int n = 0; n < BENCH_FRAMES; n++) {
+        int b = n % BENCH_BUFFERS;
+        packedSum += bench_read(dst[b], planes, numPlanes, true);
+    }
+    packedNs = nowNs() - start;
+
+    start = nowNs();
+    for (int n = 0; n < BENCH_FRAMES; n++) {
+        int b = n % BENCH_BUFFERS;
+        paddedSum += bench_read(src[b], planes, numPlanes, false);
+    }
+    paddedNs = nowNs() - start;
+
+    // the packed copy holds exactly the visible bytes
+    CHECK(packedSum == paddedSum);
+    for (int i = 0; i < numPlanes; i++) {
+        const qcamera_plane_copy_t &p = planes[i];
+        for (uint32_t j = 0; j < p.height; j++) {
+            CHECK(memcmp(dst[0] + p.dst_offset + j * p.dst_stride,
+                    src[0] + p.src_offset + j * p.src_stride, p.width) == 0);
+        }
+    }
+
+    fprintf(stderr, "%-25s%d -> %d bytes: copy %.0f us, read packed %.0f us, "
+            "read padded %.0f us\n", f.name, srcSize, dstSize,
+            copyNs / 1000.0 / BENCH_FRAMES, packedNs / 1000.0 / BENCH_FRAMES,
+            paddedNs / 1000.0 / BENCH_FRAMES);
+
+    for (int b = 0; b < BENCH_BUFFERS; b++) {
+        free(src[b]);
+        free(dst[b]);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int ret = -1;
+
+    for (size_t i = 0; i < sizeof(kFrames) / sizeof(kFrames[0]); i++) {
+        if (bench_frame(kFrames[i]))
+            goto exit;
+    }
+    ret = 0;
+
+exit:
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
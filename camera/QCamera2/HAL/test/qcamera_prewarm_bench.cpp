@@ -0,0 +1,208 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Memory pool prewarm benchmark. Times the buffer allocation of the first
+ * regular capture of a session the way allocateStreamBuf does it, with
+ * QCameraStreamMemory objects on a QCameraMemoryPool: once from an empty
+ * pool, and once after prewarming the pool the way prewarmStreamBufs does
+ * while the preview runs. Needs /dev/ion, so it runs on the device.
+ *
+ * Usage: qcamera-prewarm-bench [width height [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/Timers.h>
+
+#include "QCameraMem.h"
+
+using namespace qcamera;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+#define BENCH_WIDTH       4208
+#define BENCH_HEIGHT      3120
+#define BENCH_ITERATIONS  10
+#define BENCH_MAX_CONFIGS 3
+// Stream buffers are cached and come from the iommu heap
+#define BENCH_HEAP_ID     (0x1 << ION_IOMMU_HEAP_ID)
+
+typedef struct {
+    cam_stream_type_t type;
+    int size;
+    int count;
+} bench_buf_config_t;
+
+typedef struct {
+    nsecs_t min;
+    nsecs_t max;
+    nsecs_t total;
+} bench_stats_t;
+
+/* The framework would map the fd, not needed to time the allocation */
+static void bench_release_memory(camera_memory_t *mem)
+{
+    free(mem);
+}
+
+static camera_memory_t *bench_get_memory(int /*fd*/, size_t buf_size,
+        unsigned int num_bufs, void * /*user*/)
+{
+    camera_memory_t *mem = (camera_memory_t *)calloc(1, sizeof(camera_memory_t));
+
+    if (mem) {
+        mem->size = buf_size * num_bufs;
+        mem->release = bench_release_memory;
+    }
+    return mem;
+}
+
+static void bench_add(bench_stats_t &stats, nsecs_t ns)
+{
+    if (stats.total == 0 || ns < stats.min)
+        stats.min = ns;
+    if (ns > stats.max)
+        stats.max = ns;
+    stats.total += ns;
+}
+
+static void bench_print(const char *name, const bench_stats_t &stats, int iterations)
+{
+    fprintf(stderr, "%-25s%.2f ms avg, %.2f ms min, %.2f ms max\n", name,
+            stats.total / 1000000.0 / iterations, stats.min / 1000000.0,
+            stats.max / 1000000.0);
+}
+
+/* Allocates the capture streams and frees them again into the pool */
+static int bench_capture(QCameraMemoryPool &pool, const bench_buf_config_t *configs,
+        int numConfigs, nsecs_t &ns)
+{
+    QCameraStreamMemory *mems[BENCH_MAX_CONFIGS];
+    nsecs_t start = systemTime();
+
+    for (int i = 0; i < numConfigs; i++) {
+        mems[i] = new QCameraStreamMemory(bench_get_memory, true, &pool,
+                configs[i].type);
+        CHECK(mems[i] != NULL);
+        CHECK(mems[i]->allocate(configs[i].count, configs[i].size, NON_SECURE) == 0);
+    }
+    ns = systemTime() - start;
+
+    for (int i = 0; i < numConfigs; i++) {
+        mems[i]->deallocate();
+        delete mems[i];
+    }
+    return 0;
+}
+
+static int bench_prewarm(QCameraMemoryPool &pool, const bench_buf_config_t *configs,
+        int numConfigs, nsecs_t &ns)
+{
+    nsecs_t start = systemTime();
+
+    for (int i = 0; i < numConfigs; i++) {
+        for (int cnt = 1; cnt <= configs[i].count; cnt++) {
+            CHECK(pool.prewarm(BENCH_HEAP_ID, configs[i].size, true, cnt) >= 0);
+        }
+    }
+    ns = systemTime() - start;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int width = BENCH_WIDTH, height = BENCH_HEIGHT;
+    int iterations = BENCH_ITERATIONS;
+    bench_stats_t cold, warm, prewarm;
+    nsecs_t ns;
+    int ret = -1;
+
+    if (argc >= 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    }
+    if (argc >= 4) {
+        iterations = atoi(argv[3]);
+    }
+    if (width <= 0 || height <= 0 || iterations <= 0) {
+        fprintf(stderr, "Usage: %s [width height [iterations]]\n", argv[0]);
+        return 1;
+    }
+
+    // One regular capture: NV21 snapshot, RAW10 and the metadata buffer
+    const bench_buf_config_t configs[BENCH_MAX_CONFIGS] = {
+        { CAM_STREAM_TYPE_SNAPSHOT, width * height * 3 / 2, 1 },
+        { CAM_STREAM_TYPE_RAW, width * height * 5 / 4, 1 },
+        { CAM_STREAM_TYPE_METADATA, (int)sizeof(metadata_buffer_t), 1 },
+    };
+    int numConfigs = sizeof(configs) / sizeof(configs[0]);
+
+    memset(&cold, 0, sizeof(cold));
+    memset(&warm, 0, sizeof(warm));
+    memset(&prewarm, 0, sizeof(prewarm));
+
+    for (int n = 0; n < iterations; n++) {
+        // a new pool is what the first shot of a session sees
+        {
+            QCameraMemoryPool pool;
+            if (bench_capture(pool, configs, numConfigs, ns))
+                goto exit;
+            bench_add(cold, ns);
+        }
+        {
+            QCameraMemoryPool pool;
+            if (bench_prewarm(pool, configs, numConfigs, ns))
+                goto exit;
+            bench_add(prewarm, ns);
+            if (bench_capture(pool, configs, numConfigs, ns))
+                goto exit;
+            bench_add(warm, ns);
+            if (n == iterations - 1)
+                fprintf(stderr, "%s", pool.dump().string());
+        }
+    }
+
+    fprintf(stderr, "%-25s%dx%d, %d iterations\n", "Capture: ", width, height,
+            iterations);
+    bench_print("Cold first shot: ", cold, iterations);
+    bench_print("Prewarmed first shot: ", warm, iterations);
+    bench_print("Prewarm (preview): ", prewarm, iterations);
+    ret = 0;
+
+exit:
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,260 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Thermal controller simulation. Runs a camera session against a simple
+ * thermal model of the device under a few ambient traces, once with only
+ * the level steps the thermal engine reports, as calcThermalLevel applies
+ * them, and once with the controller scaling the fps ahead of the levels.
+ * Reports peak temperature, dropped frames, sudden fps steps and time
+ * spent at the shutdown level, and checks the controller on its own.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "QCameraThermalController.h"
+
+using namespace qcamera;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+#define SIM_STEP_SEC        0.1f
+#define SIM_SAMPLE_SEC      1.0f
+#define SIM_REQUESTED_FPS   30.0f
+#define SIM_SHUTDOWN_FPS    7.5f
+// Device heats towards ambient + power * R with time constant TAU
+#define SIM_TAU_SEC         120.0f
+#define SIM_R_C_PER_W       14.0f
+#define SIM_IDLE_W          0.8f
+#define SIM_W_PER_FPS       0.075f
+// The thermal engine steps down a level only this far below its threshold
+#define SIM_ENGINE_HYST_C   3.0f
+// and reports every this many seconds
+#define SIM_ENGINE_POLL_SEC 2.0f
+// fps changes bigger than this within one step show as a stutter
+#define SIM_STUTTER_FPS     2.0f
+
+typedef struct {
+    const char *name;
+    float durationSec;
+    // ambient temperature at (sec) points, linear in between
+    int numPoints;
+    float points[6][2];
+} sim_trace_t;
+
+static const sim_trace_t gTraces[] = {
+    { "indoor", 900, 1, {{0, 25}} },
+    { "warm", 900, 1, {{0, 30}} },
+    { "sun", 1200, 4, {{0, 24}, {300, 32}, {800, 32}, {1100, 25}} },
+    { "short", 180, 1, {{0, 28}} },
+};
+
+typedef struct {
+    float peakTemp;
+    float droppedFrames;
+    int stutters;
+    float shutdownSec;
+    float endTemp;
+} sim_result_t;
+
+static float ambientAt(const sim_trace_t &trace, float t)
+{
+    if (t <= trace.points[0][0])
+        return trace.points[0][1];
+    for (int i = 1; i < trace.numPoints; i++) {
+        if (t <= trace.points[i][0]) {
+            float f = (t - trace.points[i - 1][0]) /
+                    (trace.points[i][0] - trace.points[i - 1][0]);
+            return trace.points[i - 1][1] +
+                    f * (trace.points[i][1] - trace.points[i - 1][1]);
+        }
+    }
+    return trace.points[trace.numPoints - 1][1];
+}
+
+/* Level steps the way the thermal engine reports them, with hysteresis */
+static qcamera_thermal_level_enum_t engineLevel(const qcamera_thermal_ctrl_config_t &config,
+        qcamera_thermal_level_enum_t level, float temp)
+{
+    int l = level;
+
+    while (l < QCAMERA_THERMAL_SHUTDOWN && temp >= config.levelTemp[l + 1])
+        l++;
+    while (l > QCAMERA_THERMAL_NO_ADJUSTMENT &&
+            temp < config.levelTemp[l] - SIM_ENGINE_HYST_C)
+        l--;
+    return (qcamera_thermal_level_enum_t)l;
+}
+
+static float levelFps(qcamera_thermal_level_enum_t level)
+{
+    if (level == QCAMERA_THERMAL_SHUTDOWN)
+        return SIM_SHUTDOWN_FPS;
+    return SIM_REQUESTED_FPS * QCameraThermalController::levelFpsScale(level);
+}
+
+static void simulate(const sim_trace_t &trace, bool predictive, sim_result_t &result)
+{
+    qcamera_thermal_ctrl_config_t config;
+    QCameraThermalController controller;
+    qcamera_thermal_level_enum_t level = QCAMERA_THERMAL_NO_ADJUSTMENT;
+    float temp = ambientAt(trace, 0) + SIM_IDLE_W * SIM_R_C_PER_W;
+    float fps = SIM_REQUESTED_FPS, scale = 1.0f;
+    float nextPoll = 0, nextSample = 0;
+    unsigned int noise = 1;
+
+    QCameraThermalController::defaultConfig(config);
+    result.peakTemp = temp;
+    result.droppedFrames = 0;
+    result.stutters = 0;
+    result.shutdownSec = 0;
+
+    for (float t = 0; t < trace.durationSec; t += SIM_STEP_SEC) {
+        if (t >= nextPoll) {
+            level = engineLevel(config, level, temp);
+            nextPoll += SIM_ENGINE_POLL_SEC;
+        }
+        if (predictive && t >= nextSample) {
+            // Sensor reads in millidegrees with a bit of noise
+            noise = noise * 1103515245 + 12345;
+            float sensed = temp + ((int)((noise >> 16) % 200) - 100) / 1000.0f;
+            if (controller.update((int64_t)(t * 1e9) + 1, sensed,
+                    fps / SIM_REQUESTED_FPS, level))
+                scale = controller.getFpsScale();
+            nextSample += SIM_SAMPLE_SEC;
+        }
+
+        float newFps = levelFps(level);
+        if (level != QCAMERA_THERMAL_SHUTDOWN && SIM_REQUESTED_FPS * scale < newFps)
+            newFps = SIM_REQUESTED_FPS * scale;
+        if (fabsf(newFps - fps) > SIM_STUTTER_FPS)
+            result.stutters++;
+        fps = newFps;
+
+        float power = SIM_IDLE_W + SIM_W_PER_FPS * fps;
+        float target = ambientAt(trace, t) + power * SIM_R_C_PER_W;
+        temp += (target - temp) * SIM_STEP_SEC / SIM_TAU_SEC;
+
+        result.droppedFrames += (SIM_REQUESTED_FPS - fps) * SIM_STEP_SEC;
+        if (temp > result.peakTemp)
+            result.peakTemp = temp;
+        if (level == QCAMERA_THERMAL_SHUTDOWN)
+            result.shutdownSec += SIM_STEP_SEC;
+    }
+    result.endTemp = temp;
+}
+
+static int test_controller(void)
+{
+    QCameraThermalController controller;
+    int64_t ns = 1;
+    int sec;
+
+    // Flat temperature leaves the fps alone
+    for (sec = 0; sec < 60; sec++, ns += 1000000000LL)
+        CHECK(!controller.update(ns, 40.0f, 1.0f, QCAMERA_THERMAL_NO_ADJUSTMENT));
+    CHECK(controller.getFpsScale() == 1.0f);
+    CHECK(controller.getSecondsToNextLevel() < 0);
+
+    // Rising towards the slight level, scale comes down before it is hit
+    float temp = 40.0f;
+    for (sec = 0; sec < 60; sec++, ns += 1000000000LL) {
+        temp += 0.05f;
+        controller.update(ns, temp, 1.0f, QCAMERA_THERMAL_NO_ADJUSTMENT);
+    }
+    CHECK(temp < QCAMERA_THERMAL_CTRL_SLIGHT_TEMP);
+    CHECK(controller.getPredictedLevel() == QCAMERA_THERMAL_SLIGHT_ADJUSTMENT);
+    CHECK(controller.getSlope() > 0.03f && controller.getSlope() < 0.07f);
+    CHECK(controller.getFpsScale() < 1.0f);
+    CHECK(controller.getFpsScale() >= QCameraThermalController::levelFpsScale(
+            QCAMERA_THERMAL_SLIGHT_ADJUSTMENT));
+
+    // Never moves faster than the max step
+    float last = controller.getFpsScale();
+    for (sec = 0; sec < 30; sec++, ns += 1000000000LL) {
+        temp += 0.5f;
+        controller.update(ns, temp, 1.0f, QCAMERA_THERMAL_NO_ADJUSTMENT);
+        CHECK(fabsf(controller.getFpsScale() - last) <= QCAMERA_THERMAL_CTRL_MAX_STEP + 1e-5f);
+        last = controller.getFpsScale();
+    }
+
+    // Cooling down lifts it back to no adjustment
+    for (sec = 0; sec < 300; sec++, ns += 1000000000LL)
+        controller.update(ns, 30.0f, 1.0f, QCAMERA_THERMAL_NO_ADJUSTMENT);
+    CHECK(controller.getFpsScale() == 1.0f);
+
+    // A gap starts over without a slope
+    ns += 60 * 1000000000LL;
+    controller.update(ns, 50.0f, 1.0f, QCAMERA_THERMAL_NO_ADJUSTMENT);
+    CHECK(controller.getSlope() == 0);
+
+    fprintf(stderr, "%-25s%s\n", "Controller: ", "ok");
+    return 0;
+}
+
+static int test_traces(void)
+{
+    for (size_t i = 0; i < sizeof(gTraces) / sizeof(gTraces[0]); i++) {
+        sim_result_t step, pred;
+
+        simulate(gTraces[i], false, step);
+        simulate(gTraces[i], true, pred);
+
+        fprintf(stderr, "%-8s step: peak %.1fC, dropped %6.0f, stutters %2d, shutdown %4.0fs\n",
+                gTraces[i].name, step.peakTemp, step.droppedFrames, step.stutters,
+                step.shutdownSec);
+        fprintf(stderr, "%-8s pred: peak %.1fC, dropped %6.0f, stutters %2d, shutdown %4.0fs\n",
+                "", pred.peakTemp, pred.droppedFrames, pred.stutters, pred.shutdownSec);
+
+        CHECK(pred.peakTemp <= step.peakTemp + 0.05f);
+        CHECK(pred.stutters <= step.stutters);
+        CHECK(pred.shutdownSec <= step.shutdownSec);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int ret = -1;
+
+    if (test_controller() || test_traces())
+        goto exit;
+    ret = 0;
+
+exit:
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
@@ -45,6 +45,8 @@
 #include <sync/sync.h>
 #include <gralloc_priv.h>
 #include "util/QCameraFlash.h"
+#include "util/QCameraDebugConfig.h"
+#include "util/QCameraDumpWriter.h"
 #include "QCamera3HWI.h"
 #include "QCamera3Mem.h"
 #include "QCamera3Channel.h"
@@ -485,6 +487,7 @@ int QCamera3HardwareInterface::openCamera(struct hw_device_t **hw_device)
 
     rc = openCamera();
     if (rc == 0) {
+        QCameraDebugConfig::refresh();
         *hw_device = &mCameraDevice.common;
     } else
         *hw_device = NULL;
@@ -1845,10 +1848,8 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             if (i->blob_request) {
                 {
                     //Dump tuning metadata if enabled and available
-                    char prop[PROPERTY_VALUE_MAX];
-                    memset(prop, 0, sizeof(prop));
-                    property_get("persist.camera.dumpmetadata", prop, "0");
-                    int32_t enabled = atoi(prop);
+                    int32_t enabled =
+                            QCameraDebugConfig::get().dump_metadata;
                     if (enabled && metadata->is_tuning_params_valid) {
                         dumpMetadataToFile(metadata->tuning_params,
                                mMetaFrameCount,
@@ -2615,6 +2616,7 @@ void QCamera3HardwareInterface::dump(int fd)
     }
     dprintf(fd, "-------+-----------\n");
 
+    QCameraDumpWriter::getInstance()->dump(fd);
     dprintf(fd, "\n Camera HAL3 information End \n");
     pthread_mutex_unlock(&mMutex);
     return;
@@ -3775,43 +3777,43 @@ void QCamera3HardwareInterface::dumpMetadataToFile(tuning_params_t &meta,
                 type,
                 frameNumber);
         filePath.append(buf);
-        int file_fd = open(filePath.string(), O_RDWR | O_CREAT, 0777);
-        if (file_fd >= 0) {
-            int written_len = 0;
-            meta.tuning_data_version = TUNING_DATA_VERSION;
-            void *data = (void *)((uint8_t *)&meta.tuning_data_version);
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_sensor_data_size);
-            CDBG("tuning_sensor_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_vfe_data_size);
-            CDBG("tuning_vfe_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_cpp_data_size);
-            CDBG("tuning_cpp_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            data = (void *)((uint8_t *)&meta.tuning_cac_data_size);
-            CDBG("tuning_cac_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            meta.tuning_mod3_data_size = 0;
-            data = (void *)((uint8_t *)&meta.tuning_mod3_data_size);
-            CDBG("tuning_mod3_data_size %d",(int)(*(int *)data));
-            written_len += write(file_fd, data, sizeof(uint32_t));
-            int total_size = meta.tuning_sensor_data_size;
-            data = (void *)((uint8_t *)&meta.data);
-            written_len += write(file_fd, data, total_size);
-            total_size = meta.tuning_vfe_data_size;
-            data = (void *)((uint8_t *)&meta.data[TUNING_VFE_DATA_OFFSET]);
-            written_len += write(file_fd, data, total_size);
-            total_size = meta.tuning_cpp_data_size;
-            data = (void *)((uint8_t *)&meta.data[TUNING_CPP_DATA_OFFSET]);
-            written_len += write(file_fd, data, total_size);
-            total_size = meta.tuning_cac_data_size;
-            data = (void *)((uint8_t *)&meta.data[TUNING_CAC_DATA_OFFSET]);
-            written_len += write(file_fd, data, total_size);
-            close(file_fd);
-        }else {
-            ALOGE("%s: fail to open file for metadata dumping", __func__);
+        meta.tuning_data_version = TUNING_DATA_VERSION;
+        meta.tuning_mod3_data_size = 0;
+        CDBG("%s: tuning data size sensor %d vfe %d cpp %d cac %d", __func__,
+                meta.tuning_sensor_data_size, meta.tuning_vfe_data_size,
+                meta.tuning_cpp_data_size, meta.tuning_cac_data_size);
+        size_t len = 6 * sizeof(uint32_t) +
+                meta.tuning_sensor_data_size +
+                meta.tuning_vfe_data_size +
+                meta.tuning_cpp_data_size +
+                meta.tuning_cac_data_size;
+        QCameraDumpWriter *writer = QCameraDumpWriter::getInstance();
+        uint8_t *dumpBuf = writer->reserve(len);
+        if (dumpBuf) {
+            uint8_t *p = dumpBuf;
+            memcpy(p, &meta.tuning_data_version, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            memcpy(p, &meta.tuning_sensor_data_size, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            memcpy(p, &meta.tuning_vfe_data_size, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            memcpy(p, &meta.tuning_cpp_data_size, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            memcpy(p, &meta.tuning_cac_data_size, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            memcpy(p, &meta.tuning_mod3_data_size, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            memcpy(p, &meta.data[0], meta.tuning_sensor_data_size);
+            p += meta.tuning_sensor_data_size;
+            memcpy(p, &meta.data[TUNING_VFE_DATA_OFFSET],
+                    meta.tuning_vfe_data_size);
+            p += meta.tuning_vfe_data_size;
+            memcpy(p, &meta.data[TUNING_CPP_DATA_OFFSET],
+                    meta.tuning_cpp_data_size);
+            p += meta.tuning_cpp_data_size;
+            memcpy(p, &meta.data[TUNING_CAC_DATA_OFFSET],
+                    meta.tuning_cac_data_size);
+            writer->submit(filePath.string(), dumpBuf, len);
         }
     }
 }
@@ -6997,6 +6999,7 @@ void QCamera3HardwareInterface::dump(
        called so that the log level can be controlled without restarting
        the media server */
     getLogLevel();
+    QCameraDebugConfig::refresh();
 
     CDBG("%s: E", __func__);
     QCamera3HardwareInterface *hw =
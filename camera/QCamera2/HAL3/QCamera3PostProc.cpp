@@ -1046,6 +1046,9 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
     jpg_job.encode_job.session_id = mJpegSessionId;
     jpg_job.encode_job.src_index = 0;
     jpg_job.encode_job.dst_index = 0;
+    // Buffers of a stream go back to the framework in request order, so
+    // all the jobs of a session share one scheduling class
+    jpg_job.encode_job.prio = MM_JPEG_JOB_PRIO_MAIN;
 
     cam_rect_t crop;
     memset(&crop, 0, sizeof(cam_rect_t));
@@ -1649,12 +1652,14 @@ QCamera3Exif::QCamera3Exif()
     : m_nNumEntries(0)
 {
     memset(m_Entries, 0, sizeof(m_Entries));
+    memset(&m_Arena, 0, sizeof(m_Arena));
 }
 
 /*===========================================================================
  * FUNCTION   : ~QCamera3Exif
  *
- * DESCRIPTION: deconstructor of QCamera3Exif. Will release internal memory ptr.
+ * DESCRIPTION: deconstructor of QCamera3Exif. Tag payloads live in the
+ *              embedded arena, nothing to release per entry.
  *
  * PARAMETERS : None
  *
@@ -1662,83 +1667,6 @@ QCamera3Exif::QCamera3Exif()
  *==========================================================================*/
 QCamera3Exif::~QCamera3Exif()
 {
-    for (uint32_t i = 0; i < m_nNumEntries; i++) {
-        switch (m_Entries[i].tag_entry.type) {
-            case EXIF_BYTE:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._bytes != NULL) {
-                        free(m_Entries[i].tag_entry.data._bytes);
-                        m_Entries[i].tag_entry.data._bytes = NULL;
-                    }
-                }
-                break;
-            case EXIF_ASCII:
-                {
-                    if (m_Entries[i].tag_entry.data._ascii != NULL) {
-                        free(m_Entries[i].tag_entry.data._ascii);
-                        m_Entries[i].tag_entry.data._ascii = NULL;
-                    }
-                }
-                break;
-            case EXIF_SHORT:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._shorts != NULL) {
-                        free(m_Entries[i].tag_entry.data._shorts);
-                        m_Entries[i].tag_entry.data._shorts = NULL;
-                    }
-                }
-                break;
-            case EXIF_LONG:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._longs != NULL) {
-                        free(m_Entries[i].tag_entry.data._longs);
-                        m_Entries[i].tag_entry.data._longs = NULL;
-                    }
-                }
-                break;
-            case EXIF_RATIONAL:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._rats != NULL) {
-                        free(m_Entries[i].tag_entry.data._rats);
-                        m_Entries[i].tag_entry.data._rats = NULL;
-                    }
-                }
-                break;
-            case EXIF_UNDEFINED:
-                {
-                    if (m_Entries[i].tag_entry.data._undefined != NULL) {
-                        free(m_Entries[i].tag_entry.data._undefined);
-                        m_Entries[i].tag_entry.data._undefined = NULL;
-                    }
-                }
-                break;
-            case EXIF_SLONG:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._slongs != NULL) {
-                        free(m_Entries[i].tag_entry.data._slongs);
-                        m_Entries[i].tag_entry.data._slongs = NULL;
-                    }
-                }
-                break;
-            case EXIF_SRATIONAL:
-                {
-                    if (m_Entries[i].tag_entry.count > 1 &&
-                            m_Entries[i].tag_entry.data._srats != NULL) {
-                        free(m_Entries[i].tag_entry.data._srats);
-                        m_Entries[i].tag_entry.data._srats = NULL;
-                    }
-                }
-                break;
-            default:
-                ALOGE("%s: Error, Unknown type",__func__);
-                break;
-        }
-    }
 }
 
 /*===========================================================================
@@ -1767,145 +1695,9 @@ int32_t QCamera3Exif::addEntry(exif_tag_id_t tagid,
         return NO_MEMORY;
     }
 
-    m_Entries[m_nNumEntries].tag_id = tagid;
-    m_Entries[m_nNumEntries].tag_entry.type = type;
-    m_Entries[m_nNumEntries].tag_entry.count = count;
-    m_Entries[m_nNumEntries].tag_entry.copy = 1;
-    switch (type) {
-        case EXIF_BYTE:
-            {
-                if (count > 1) {
-                    uint8_t *values = (uint8_t *)malloc(count);
-                    if (values == NULL) {
-                        ALOGE("%s: No memory for byte array", __func__);
-                        rc = NO_MEMORY;
-                    } else {
-                        memcpy(values, data, count);
-                        m_Entries[m_nNumEntries].tag_entry.data._bytes = values;
-                    }
-                } else {
-                    m_Entries[m_nNumEntries].tag_entry.data._byte =
-                        *(uint8_t *)data;
-                }
-            }
-            break;
-        case EXIF_ASCII:
-            {
-                char *str = NULL;
-                str = (char *)malloc(count + 1);
-                if (str == NULL) {
-                    ALOGE("%s: No memory for ascii string", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memset(str, 0, count + 1);
-                    memcpy(str, data, count);
-                    m_Entries[m_nNumEntries].tag_entry.data._ascii = str;
-                }
-            }
-            break;
-        case EXIF_SHORT:
-            {
-                if (count > 1) {
-                    uint16_t *values =
-                        (uint16_t *)malloc(count * sizeof(uint16_t));
-                    if (values == NULL) {
-                        ALOGE("%s: No memory for short array", __func__);
-                        rc = NO_MEMORY;
-                    } else {
-                        memcpy(values, data, count * sizeof(uint16_t));
-                        m_Entries[m_nNumEntries].tag_entry.data._shorts =values;
-                    }
-                } else {
-                    m_Entries[m_nNumEntries].tag_entry.data._short =
-                        *(uint16_t *)data;
-                }
-            }
-            break;
-        case EXIF_LONG:
-            {
-                if (count > 1) {
-                    uint32_t *values =
-                        (uint32_t *)malloc(count * sizeof(uint32_t));
-                    if (values == NULL) {
-                        ALOGE("%s: No memory for long array", __func__);
-                        rc = NO_MEMORY;
-                    } else {
-                        memcpy(values, data, count * sizeof(uint32_t));
-                        m_Entries[m_nNumEntries].tag_entry.data._longs = values;
-                    }
-                } else {
-                    m_Entries[m_nNumEntries].tag_entry.data._long =
-                        *(uint32_t *)data;
-                }
-            }
-            break;
-        case EXIF_RATIONAL:
-            {
-                if (count > 1) {
-                    rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
-                    if (values == NULL) {
-                        ALOGE("%s: No memory for rational array", __func__);
-                        rc = NO_MEMORY;
-                    } else {
-                        memcpy(values, data, count * sizeof(rat_t));
-                        m_Entries[m_nNumEntries].tag_entry.data._rats = values;
-                    }
-                } else {
-                    m_Entries[m_nNumEntries].tag_entry.data._rat =
-                        *(rat_t *)data;
-                }
-            }
-            break;
-        case EXIF_UNDEFINED:
-            {
-                uint8_t *values = (uint8_t *)malloc(count);
-                if (values == NULL) {
-                    ALOGE("%s: No memory for undefined array", __func__);
-                    rc = NO_MEMORY;
-                } else {
-                    memcpy(values, data, count);
-                    m_Entries[m_nNumEntries].tag_entry.data._undefined = values;
-                }
-            }
-            break;
-        case EXIF_SLONG:
-            {
-                if (count > 1) {
-                    int32_t *values =
-                        (int32_t *)malloc(count * sizeof(int32_t));
-                    if (values == NULL) {
-                        ALOGE("%s: No memory for signed long array", __func__);
-                        rc = NO_MEMORY;
-                    } else {
-                        memcpy(values, data, count * sizeof(int32_t));
-                        m_Entries[m_nNumEntries].tag_entry.data._slongs =values;
-                    }
-                } else {
-                    m_Entries[m_nNumEntries].tag_entry.data._slong =
-                        *(int32_t *)data;
-                }
-            }
-            break;
-        case EXIF_SRATIONAL:
-            {
-                if (count > 1) {
-                    srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
-                    if (values == NULL) {
-                        ALOGE("%s: No memory for sign rational array",__func__);
-                        rc = NO_MEMORY;
-                    } else {
-                        memcpy(values, data, count * sizeof(srat_t));
-                        m_Entries[m_nNumEntries].tag_entry.data._srats = values;
-                    }
-                } else {
-                    m_Entries[m_nNumEntries].tag_entry.data._srat =
-                        *(srat_t *)data;
-                }
-            }
-            break;
-        default:
-            ALOGE("%s: Error, Unknown type",__func__);
-            break;
+    if (mm_jpeg_exif_set_entry(&m_Entries[m_nNumEntries], &m_Arena,
+            tagid, type, count, data) != 0) {
+        rc = NO_MEMORY;
     }
 
     // Increase number of entries
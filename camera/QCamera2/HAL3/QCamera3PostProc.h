@@ -95,6 +95,7 @@ public:
 private:
     QEXIF_INFO_DATA m_Entries[MAX_HAL3_EXIF_TABLE_ENTRIES];  // exif tags for JPEG encoder
     uint32_t  m_nNumEntries;                            // number of valid entries
+    mm_jpeg_exif_arena_t m_Arena;                       // payload of multi-value tags
 };
 
 class QCamera3PostProcessor
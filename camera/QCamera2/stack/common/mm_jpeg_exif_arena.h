@@ -0,0 +1,77 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef MM_JPEG_EXIF_ARENA_H_
+#define MM_JPEG_EXIF_ARENA_H_
+
+#include <stdint.h>
+#include "QOMX_JpegExtensions.h"
+
+/* exif arena sizing: worst case tag table with an average payload of
+ * MM_JPEG_EXIF_ENTRY_PAYLOAD bytes per multi-value/ascii tag, plus room
+ * for a maker note blob */
+#define MM_JPEG_EXIF_MAX_ENTRIES 50
+#define MM_JPEG_EXIF_ENTRY_PAYLOAD 64
+#define MM_JPEG_EXIF_MAKERNOTE_SIZE 1024
+#define MM_JPEG_EXIF_ARENA_SIZE \
+  (MM_JPEG_EXIF_MAX_ENTRIES * MM_JPEG_EXIF_ENTRY_PAYLOAD + \
+  MM_JPEG_EXIF_MAKERNOTE_SIZE)
+
+/** mm_jpeg_exif_arena_t:
+ *  @buf: backing storage for the exif tag payloads
+ *  @offset: current bump offset into @buf
+ *  @high_water: max offset reached since the arena was created
+ *  @num_allocs: number of allocations since the last reset
+ *
+ *  Bump allocator holding the payload of all exif tags of one job.
+ *  Tags are never freed individually, the whole arena is reset
+ *  once the job is done.
+ **/
+typedef struct {
+  uint8_t buf[MM_JPEG_EXIF_ARENA_SIZE] __attribute__((aligned(8)));
+  uint32_t offset;
+  uint32_t high_water;
+  uint32_t num_allocs;
+} mm_jpeg_exif_arena_t;
+
+/* exif arena helpers shared by all the exif builders */
+void mm_jpeg_exif_arena_reset(mm_jpeg_exif_arena_t *p_arena);
+void *mm_jpeg_exif_arena_alloc(mm_jpeg_exif_arena_t *p_arena, uint32_t size);
+
+/* fill one exif tag, payload is copied into the arena */
+int32_t mm_jpeg_exif_set_entry(QEXIF_INFO_DATA *p_entry,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
+  exif_tag_type_t type, uint32_t count, void *data);
+
+/* append one exif tag to the table, payload is copied into the arena */
+int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
+  exif_tag_type_t type, uint32_t count, void *data);
+
+#endif /* MM_JPEG_EXIF_ARENA_H_ */
@@ -31,6 +31,7 @@
 #define MM_JPEG_INTERFACE_H_
 #include "QOMX_JpegExtensions.h"
 #include "cam_intf.h"
+#include "mm_jpeg_exif_arena.h"
 
 #define MM_JPEG_MAX_PLANES 3
 #define MM_JPEG_MAX_BUF CAM_MAX_NUM_BUFS_PER_STREAM
@@ -80,6 +81,19 @@ typedef enum {
   MM_JPEG_COLOR_FORMAT_MAX
 } mm_jpeg_color_format;
 
+/** mm_jpeg_job_prio_t:
+ *  @MM_JPEG_JOB_PRIO_MAIN: regular capture, default
+ *  @MM_JPEG_JOB_PRIO_BURST: burst/longshot frame, scheduled after
+ *    the regular captures
+ *
+ *  Scheduling class of a jpeg job
+ **/
+typedef enum {
+  MM_JPEG_JOB_PRIO_MAIN = 0,
+  MM_JPEG_JOB_PRIO_BURST,
+  MM_JPEG_JOB_PRIO_MAX
+} mm_jpeg_job_prio_t;
+
 typedef enum {
   JPEG_JOB_STATUS_DONE = 0,
   JPEG_JOB_STATUS_ERROR
@@ -220,6 +234,9 @@ typedef struct {
   /* jpeg encoder QTable */
   uint8_t qtable_set[QTABLE_MAX];
   OMX_IMAGE_PARAM_QUANTIZATIONTABLETYPE qtable[QTABLE_MAX];
+
+  /* scheduling class of the job */
+  mm_jpeg_job_prio_t prio;
 } mm_jpeg_encode_job_t;
 
 typedef struct {
@@ -236,6 +253,9 @@ typedef struct {
 
   /*session id*/
   uint32_t session_id;
+
+  /* scheduling class of the job */
+  mm_jpeg_job_prio_t prio;
 } mm_jpeg_decode_job_t;
 
 typedef enum {
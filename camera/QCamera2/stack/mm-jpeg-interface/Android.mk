@@ -35,6 +35,10 @@ endif
 LOCAL_SRC_FILES := \
     src/mm_jpeg_queue.c \
     src/mm_jpeg_exif.c \
+    src/mm_jpeg_exif_arena.c \
+    src/mm_jpeg_exif_app1.c \
+    src/mm_jpeg_swenc.c \
+    src/mm_jpeg_swdec.c \
     src/mm_jpeg.c \
     src/mm_jpeg_interface.c \
     src/mm_jpeg_ionbuf.c \
@@ -30,6 +30,7 @@
 #ifndef MM_JPEG_H_
 #define MM_JPEG_H_
 
+#include <time.h>
 #include <cam_semaphore.h>
 #include "mm_jpeg_interface.h"
 #include "cam_list.h"
@@ -39,11 +40,13 @@
 #include "OMX_Component.h"
 #include "QOMX_JpegExtensions.h"
 #include "mm_jpeg_ionbuf.h"
+#include "mm_jpeg_swenc.h"
+#include "mm_jpeg_swdec.h"
 
 #define MM_JPEG_MAX_THREADS 30
 #define MM_JPEG_CIRQ_SIZE 30
 #define MM_JPEG_MAX_SESSION 10
-#define MAX_EXIF_TABLE_ENTRIES 50
+#define MAX_EXIF_TABLE_ENTRIES MM_JPEG_EXIF_MAX_ENTRIES
 #define MAX_JPEG_SIZE 20000000
 #define MAX_OMX_HANDLES (5)
 
@@ -62,10 +65,13 @@ typedef enum {
 } mm_jpeg_abort_state_t;
 
 
-/* define max num of supported concurrent jpeg jobs by OMX engine.
- * Current, only one per time */
+/* define default max num of concurrent jpeg jobs dispatched to the
+ * OMX engine, can be overridden by persist.camera.jpeg.max_jobs */
 #define NUM_MAX_JPEG_CNCURRENT_JOBS 2
 
+/* upper bound of the job manager dispatcher threads */
+#define MM_JPEG_MAX_DISPATCH_THREADS 4
+
 #define JOB_ID_MAGICVAL 0x1
 #define JOB_HIST_MAX 10000
 
@@ -244,6 +250,7 @@ static inline void cirq_reset(mm_jpeg_cirq_t *q)
 typedef struct {
   struct cam_list list;
   void* data;
+  uint32_t prio; /* rank for the sorted enqueue, lower first */
 } mm_jpeg_q_node_t;
 
 typedef struct {
@@ -259,6 +266,31 @@ typedef enum {
   MM_JPEG_CMD_TYPE_MAX
 } mm_jpeg_cmd_type_t;
 
+/** mm_jpeg_omx_ctx_t:
+ *  @p_session: session owning the handle, NULL while the handle
+ *    is parked in the session pool
+ *  @callbacks: callbacks registered with the handle
+ *
+ *  App data of an encoder OMX handle. It lives as long as the
+ *  handle so that a pooled handle can move to a new session.
+ **/
+typedef struct {
+  struct mm_jpeg_job_session *p_session;
+  OMX_CALLBACKTYPE callbacks;
+} mm_jpeg_omx_ctx_t;
+
+/** mm_jpeg_pool_result_t:
+ *  @MM_JPEG_POOL_MISS: new OMX handle
+ *  @MM_JPEG_POOL_HIT: pooled handle, configured again
+ *
+ *  How the OMX handle of an encode session was obtained
+ **/
+typedef enum {
+  MM_JPEG_POOL_MISS,
+  MM_JPEG_POOL_HIT,
+  MM_JPEG_POOL_RESULT_MAX
+} mm_jpeg_pool_result_t;
+
 typedef struct mm_jpeg_job_session {
   uint32_t client_hdl;           /* client handler */
   uint32_t jobId;                /* job ID */
@@ -267,6 +299,7 @@ typedef struct mm_jpeg_job_session {
   mm_jpeg_decode_params_t dec_params; /* encode params */
   mm_jpeg_encode_job_t encode_job;             /* job description */
   mm_jpeg_decode_job_t decode_job;
+  cam_dimension_t swdec_dim;     /* output size of the software decoder */
   pthread_t encode_pid;          /* encode thread handler*/
 
   void *jpeg_obj;                /* ptr to mm_jpeg_obj */
@@ -279,6 +312,8 @@ typedef struct mm_jpeg_job_session {
   /* OMX related */
   OMX_HANDLETYPE omx_handle;                      /* handle to omx engine */
   OMX_CALLBACKTYPE omx_callbacks;                 /* callbacks to omx engine */
+  mm_jpeg_omx_ctx_t *p_omx_ctx;                   /* app data of encoder handle */
+  mm_jpeg_pool_result_t pool_result;              /* origin of encoder handle */
 
   /* buffer headers */
   OMX_BUFFERHEADERTYPE *p_in_omx_buf[MM_JPEG_MAX_BUF];
@@ -295,6 +330,7 @@ typedef struct mm_jpeg_job_session {
 
   QEXIF_INFO_DATA exif_info_local[MAX_EXIF_TABLE_ENTRIES];  //all exif tags for JPEG encoder
   int exif_count_local;
+  mm_jpeg_exif_arena_t exif_arena; /* payload of exif_info_local tags */
 
   mm_jpeg_cirq_t cb_q;
   int32_t ebd_count;
@@ -309,6 +345,10 @@ typedef struct mm_jpeg_job_session {
   /* job history count to generate unique id */
   int job_hist;
 
+  /* num of dispatcher threads programming this session with the
+   * job_lock dropped, protected by job_lock */
+  uint32_t dispatch_cnt;
+
   OMX_BOOL encoding;
 
   buffer_t work_buffer;
@@ -348,6 +388,10 @@ typedef struct {
     mm_jpeg_encode_job_info_t enc_info;
     mm_jpeg_decode_job_info_t dec_info;
   };
+  mm_jpeg_job_prio_t prio;   /* scheduling class */
+  struct timespec enq_ts;    /* time the job entered the todo queue */
+  struct timespec start_ts;  /* time the job was dispatched */
+  OMX_BOOL sw_backend;       /* run by a software backend */
 } mm_jpeg_job_q_node_t;
 
 typedef struct {
@@ -357,12 +401,110 @@ typedef struct {
   pthread_mutex_t lock;           /* job lock */
 } mm_jpeg_client_t;
 
+/** mm_jpeg_job_stats_t:
+ *  @num_jobs: num of completed jobs
+ *  @total_queue_us: sum of the time spent in the todo queue
+ *  @max_queue_us: max time spent in the todo queue
+ *  @total_proc_us: sum of the dispatch to completion time
+ *  @max_proc_us: max dispatch to completion time
+ *
+ *  Per scheduling class latency statistics
+ **/
+typedef struct {
+  uint32_t num_jobs;
+  uint64_t total_queue_us;
+  uint64_t max_queue_us;
+  uint64_t total_proc_us;
+  uint64_t max_proc_us;
+} mm_jpeg_job_stats_t;
+
 typedef struct {
-  pthread_t pid;                  /* job cmd thread ID */
+  pthread_t pid[MM_JPEG_MAX_DISPATCH_THREADS]; /* dispatcher thread IDs */
+  uint32_t num_threads;           /* num of dispatcher threads */
+  uint32_t max_ongoing_jobs;      /* max num of jobs in the ongoing queue */
   cam_semaphore_t job_sem;        /* semaphore for job cmd thread */
-  mm_jpeg_queue_t job_queue;      /* queue for job to do */
+  mm_jpeg_queue_t job_queue;      /* queue for job to do, sorted by prio */
+
+  /* slot release notification */
+  pthread_mutex_t slot_lock;
+  pthread_cond_t slot_cond;
+  uint32_t slot_gen;              /* bumped whenever a job slot frees up */
+
+  pthread_cond_t dispatch_cond;   /* dispatch done, waited with job_lock */
+
+  pthread_mutex_t stats_lock;
+  mm_jpeg_job_stats_t stats[MM_JPEG_JOB_PRIO_MAX];
 } mm_jpeg_job_cmd_thread_t;
 
+/* max num of encoder handles parked in the session pool */
+#define MM_JPEG_SESSION_POOL_MAX MAX_OMX_HANDLES
+
+/** mm_jpeg_pool_entry_t:
+ *  @omx_handle: parked encoder handle, in loaded state
+ *  @p_omx_ctx: app data of the handle
+ *  @params: session params the handle was last configured with
+ *  @last_use: pool sequence number of the park, for LRU eviction
+ *
+ *  Encoder handle kept after its session is destroyed. Its
+ *  buffers are freed when it is parked, the camera buffers may
+ *  be freed and the fd numbers and mappings reused for new ones.
+ **/
+typedef struct {
+  OMX_HANDLETYPE omx_handle;
+  mm_jpeg_omx_ctx_t *p_omx_ctx;
+  mm_jpeg_encode_params_t params;
+  uint32_t last_use;
+} mm_jpeg_pool_entry_t;
+
+/** mm_jpeg_pool_stats_t:
+ *  @num_setups: num of session setups per pool result
+ *  @total_setup_us: sum of the handle setup time per pool result
+ *  @max_setup_us: max handle setup time per pool result
+ *  @num_evictions: num of parked handles released to make room
+ *
+ *  Session pool statistics
+ **/
+typedef struct {
+  uint32_t num_setups[MM_JPEG_POOL_RESULT_MAX];
+  uint64_t total_setup_us[MM_JPEG_POOL_RESULT_MAX];
+  uint64_t max_setup_us[MM_JPEG_POOL_RESULT_MAX];
+  uint32_t num_evictions;
+} mm_jpeg_pool_stats_t;
+
+/** mm_jpeg_session_pool_t:
+ *  @lock: protects the pool
+ *  @max_entries: pool size, 0 disables the pool
+ *  @num_entries: num of parked handles
+ *  @seq: park sequence counter
+ *  @entry: parked handles
+ *  @stats: pool statistics
+ *
+ *  Encoder handles kept warm between sessions
+ **/
+typedef struct {
+  pthread_mutex_t lock;
+  uint32_t max_entries;
+  uint32_t num_entries;
+  uint32_t seq;
+  mm_jpeg_pool_entry_t entry[MM_JPEG_SESSION_POOL_MAX];
+  mm_jpeg_pool_stats_t stats;
+} mm_jpeg_session_pool_t;
+
+/** mm_jpeg_swenc_mode_t:
+ *  @MM_JPEG_SWENC_MODE_OFF: every job goes to the OMX encoder
+ *  @MM_JPEG_SWENC_MODE_OVERFLOW: burst jobs are encoded in software
+ *    when all the OMX handles of the session are busy
+ *  @MM_JPEG_SWENC_MODE_ALWAYS: every job the software encoder
+ *    supports is encoded in software
+ *
+ *  Use of the software encoder backend
+ **/
+typedef enum {
+  MM_JPEG_SWENC_MODE_OFF,
+  MM_JPEG_SWENC_MODE_OVERFLOW,
+  MM_JPEG_SWENC_MODE_ALWAYS,
+} mm_jpeg_swenc_mode_t;
+
 #define MAX_JPEG_CLIENT_NUM 8
 typedef struct mm_jpeg_obj_t {
   /* ClientMgr */
@@ -387,8 +529,47 @@ typedef struct mm_jpeg_obj_t {
 
   int num_sessions;
 
+  /* encoder handles parked for reuse */
+  mm_jpeg_session_pool_t session_pool;
+
+  /* software encoder backend */
+  mm_jpeg_swenc_mode_t swenc_mode;
+  mm_jpeg_swenc_t *p_swenc;
+  uint32_t swenc_jobs;            /* ongoing software jobs, job_lock */
+
+  /* software decoder backend, NULL if disabled */
+  mm_jpeg_swdec_t *p_swdec;
+
 } mm_jpeg_obj;
 
+/** mm_jpeg_enc_backend_t:
+ *  @name: backend name for the logs
+ *  @encode: encodes the job. Called by the dispatcher with the
+ *    job_lock released, the result is delivered through the
+ *    jpeg_cb of the session
+ *
+ *  Encoder backend behind mm_jpeg_process_encoding_job
+ **/
+typedef struct {
+  const char *name;
+  int32_t (*encode)(mm_jpeg_obj *my_obj, mm_jpeg_job_session_t *p_session,
+    mm_jpeg_job_q_node_t *job_node);
+} mm_jpeg_enc_backend_t;
+
+/** mm_jpeg_dec_backend_t:
+ *  @name: backend name for the logs
+ *  @decode: decodes the job. Called by the dispatcher with the
+ *    job_lock released, the result is delivered through the
+ *    jpeg_cb of the session
+ *
+ *  Decoder backend behind mm_jpegdec_process_decoding_job
+ **/
+typedef struct {
+  const char *name;
+  int32_t (*decode)(mm_jpeg_obj *my_obj, mm_jpeg_job_session_t *p_session,
+    mm_jpeg_job_q_node_t *job_node);
+} mm_jpeg_dec_backend_t;
+
 /** mm_jpeg_pending_func_t:
  *
  * Intermediate function for transition change
@@ -416,6 +597,13 @@ extern int32_t mm_jpegdec_init(mm_jpeg_obj *my_obj);
 extern int32_t mm_jpegdec_deinit(mm_jpeg_obj *my_obj);
 extern int32_t mm_jpeg_jobmgr_thread_release(mm_jpeg_obj * my_obj);
 extern int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj);
+extern int32_t mm_jpeg_jobmgr_enqueue(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *node);
+extern void mm_jpeg_jobmgr_job_stats(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *node);
+extern void mm_jpeg_jobmgr_release_slot(mm_jpeg_obj *my_obj);
+extern void mm_jpeg_jobmgr_wait_dispatch(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session);
 extern int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   mm_jpeg_job_t* job,
   uint32_t* jobId);
@@ -443,17 +631,16 @@ uint8_t mm_jpeg_util_get_index_by_handler(uint32_t handler);
 extern int32_t mm_jpeg_queue_init(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_enq(mm_jpeg_queue_t* queue, void* node);
 extern int32_t mm_jpeg_queue_enq_head(mm_jpeg_queue_t* queue, void* node);
+extern int32_t mm_jpeg_queue_enq_prio(mm_jpeg_queue_t* queue, void* node,
+  uint32_t prio);
 extern void* mm_jpeg_queue_deq(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_deinit(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_flush(mm_jpeg_queue_t* queue);
 extern uint32_t mm_jpeg_queue_get_size(mm_jpeg_queue_t* queue);
 extern void* mm_jpeg_queue_peek(mm_jpeg_queue_t* queue);
-extern int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
-  exif_tag_type_t type, uint32_t count, void *data);
-extern int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data);
 extern int process_meta_data(metadata_buffer_t *p_meta,
-  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_params_t *p_cam3a_params,
-  cam_hal_version_t hal_version);
+  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_arena_t *p_arena,
+  mm_jpeg_exif_params_t *p_cam3a_params, cam_hal_version_t hal_version);
 
 OMX_ERRORTYPE mm_jpeg_session_change_state(mm_jpeg_job_session_t* p_session,
   OMX_STATETYPE new_state,
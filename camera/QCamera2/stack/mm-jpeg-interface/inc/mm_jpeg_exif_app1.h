@@ -1,10 +1,9 @@
-/*
- * Copyright (c) 2012, The Linux Foundation. All rights reserved.
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions are
  * met:
- * *    * Redistributions of source code must retain the above copyright
+ *     * Redistributions of source code must retain the above copyright
  *       notice, this list of conditions and the following disclaimer.
  *     * Redistributions in binary form must reproduce the above
  *       copyright notice, this list of conditions and the following
@@ -25,15 +24,23 @@
  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
  * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
  */
 
-struct list_node {
-    struct list_node *next;
-    void *data;
-    int (*compare)(void *data1, void *data2);
-    void (*dump)(void *data);
-};
+#ifndef MM_JPEG_EXIF_APP1_H_
+#define MM_JPEG_EXIF_APP1_H_
+
+#include <stdint.h>
+#include "QOMX_JpegExtensions.h"
+
+/* Minimal Exif APP1 writer for the encoders which do not come with
+ * their own exif support. It lays out IFD0 with pointers to the Exif
+ * and GPS IFDs, thumbnail (IFD1) tags are dropped. */
+
+/* largest segment the 16 bit length field can describe */
+#define MM_JPEG_EXIF_APP1_MAX_SIZE (65535 + 2)
+
+int32_t mm_jpeg_exif_write_app1(const QOMX_EXIF_INFO *p_info,
+  uint32_t num_info, uint8_t *p_buf, uint32_t buf_size, uint32_t *p_len);
 
-struct list_node * add_list_node(struct list_node *head, void *data);
-int remove_list_node(struct list_node *head, struct list_node *del_node);
-struct list_node *find_node(struct list_node *head, void *comparison_data);
+#endif /* MM_JPEG_EXIF_APP1_H_ */
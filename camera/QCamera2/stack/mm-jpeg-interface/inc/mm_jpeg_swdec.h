@@ -0,0 +1,91 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef MM_JPEG_SWDEC_H_
+#define MM_JPEG_SWDEC_H_
+
+#include <stdint.h>
+
+/* Baseline software JPEG decoder. The entropy coded data is split at
+ * the restart markers and the restart intervals are decoded by
+ * different worker threads. Streams without restart markers are
+ * decoded by the calling thread alone. It has no dependency on OMX
+ * and builds for the host as well. */
+
+#define MM_JPEG_SWDEC_MAX_THREADS 4
+
+/** mm_jpeg_swdec_output_t:
+ *  @p_y: luma plane
+ *  @p_cbcr: interleaved chroma plane
+ *  @y_stride: luma line stride in bytes
+ *  @cbcr_stride: chroma line stride in bytes
+ *  @width: max width the planes can hold
+ *  @height: max height the planes can hold
+ *  @cbcr_swap: 1 for CrCb (NV21), 0 for CbCr (NV12)
+ *
+ *  4:2:0 semi planar output image
+ **/
+typedef struct {
+  uint8_t *p_y;
+  uint8_t *p_cbcr;
+  uint32_t y_stride;
+  uint32_t cbcr_stride;
+  uint32_t width;
+  uint32_t height;
+  int cbcr_swap;
+} mm_jpeg_swdec_output_t;
+
+/** mm_jpeg_swdec_stats_t:
+ *  @width: decoded width
+ *  @height: decoded height
+ *  @num_slices: number of restart intervals
+ *  @decode_us: wall time of the last decode
+ *
+ *  statistics of the last decode
+ **/
+typedef struct {
+  uint32_t width;
+  uint32_t height;
+  uint32_t num_slices;
+  uint64_t decode_us;
+} mm_jpeg_swdec_stats_t;
+
+typedef struct mm_jpeg_swdec mm_jpeg_swdec_t;
+
+mm_jpeg_swdec_t *mm_jpeg_swdec_create(uint32_t num_threads);
+void mm_jpeg_swdec_destroy(mm_jpeg_swdec_t *p_dec);
+int32_t mm_jpeg_swdec_get_info(const uint8_t *p_jpeg, uint32_t size,
+  uint32_t *p_width, uint32_t *p_height);
+int32_t mm_jpeg_swdec_decode(mm_jpeg_swdec_t *p_dec,
+  const uint8_t *p_jpeg,
+  uint32_t size,
+  const mm_jpeg_swdec_output_t *p_out,
+  mm_jpeg_swdec_stats_t *p_stats);
+
+#endif /* MM_JPEG_SWDEC_H_ */
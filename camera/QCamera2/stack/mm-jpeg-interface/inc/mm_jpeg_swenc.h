@@ -0,0 +1,107 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef MM_JPEG_SWENC_H_
+#define MM_JPEG_SWENC_H_
+
+#include <stdint.h>
+
+/* Baseline software JPEG encoder. The image is cut into slices of
+ * whole MCU rows separated by restart markers, so that every slice
+ * can be entropy coded by a different worker thread. It has no
+ * dependency on OMX and builds for the host as well. */
+
+#define MM_JPEG_SWENC_MAX_THREADS 4
+
+/** mm_jpeg_swenc_image_t:
+ *  @p_y: first luma sample of the encoded area
+ *  @p_cbcr: first chroma pair of the encoded area
+ *  @width: width of the encoded area
+ *  @height: height of the encoded area
+ *  @y_stride: luma line stride in bytes
+ *  @cbcr_stride: chroma line stride in bytes
+ *  @cbcr_swap: 1 if the chroma plane is CrCb (NV21), 0 for
+ *    CbCr (NV12)
+ *
+ *  4:2:0 semi planar input image
+ **/
+typedef struct {
+  const uint8_t *p_y;
+  const uint8_t *p_cbcr;
+  uint32_t width;
+  uint32_t height;
+  uint32_t y_stride;
+  uint32_t cbcr_stride;
+  int cbcr_swap;
+} mm_jpeg_swenc_image_t;
+
+/** mm_jpeg_swenc_params_t:
+ *  @quality: jpeg quality 1~100
+ *  @slice_mcu_rows: MCU rows per slice, 0 to derive it from the
+ *    number of threads
+ *  @p_app1: complete APP1 segment written after SOI in place of
+ *    the JFIF APP0, NULL for none
+ *  @app1_len: length of @p_app1 including its marker
+ *
+ *  encode parameters
+ **/
+typedef struct {
+  uint32_t quality;
+  uint32_t slice_mcu_rows;
+  const uint8_t *p_app1;
+  uint32_t app1_len;
+} mm_jpeg_swenc_params_t;
+
+/** mm_jpeg_swenc_stats_t:
+ *  @num_slices: number of restart intervals written
+ *  @slice_mcus: MCUs per restart interval
+ *  @encode_us: wall time of the last encode
+ *
+ *  statistics of the last encode
+ **/
+typedef struct {
+  uint32_t num_slices;
+  uint32_t slice_mcus;
+  uint64_t encode_us;
+} mm_jpeg_swenc_stats_t;
+
+typedef struct mm_jpeg_swenc mm_jpeg_swenc_t;
+
+mm_jpeg_swenc_t *mm_jpeg_swenc_create(uint32_t num_threads);
+void mm_jpeg_swenc_destroy(mm_jpeg_swenc_t *p_enc);
+uint32_t mm_jpeg_swenc_max_size(uint32_t width, uint32_t height);
+int32_t mm_jpeg_swenc_encode(mm_jpeg_swenc_t *p_enc,
+  const mm_jpeg_swenc_image_t *p_img,
+  const mm_jpeg_swenc_params_t *p_params,
+  uint8_t *p_out,
+  uint32_t out_size,
+  uint32_t *p_out_len,
+  mm_jpeg_swenc_stats_t *p_stats);
+
+#endif /* MM_JPEG_SWENC_H_ */
@@ -36,11 +36,13 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <stdlib.h>
+#include <cutils/properties.h>
 
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg.h"
 #include "mm_jpeg_inlines.h"
+#include "mm_jpeg_exif_app1.h"
 
 #ifdef LOAD_ADSP_RPC_LIB
 #include <dlfcn.h>
@@ -71,6 +73,13 @@ static void mm_jpegenc_job_done(mm_jpeg_job_session_t *p_session);
 mm_jpeg_job_q_node_t* mm_jpeg_queue_remove_job_by_dst_ptr(
   mm_jpeg_queue_t* queue, void * dst_ptr);
 static OMX_ERRORTYPE mm_jpeg_session_configure(mm_jpeg_job_session_t *p_session);
+static uint32_t mm_jpeg_jobmgr_prio_rank(mm_jpeg_job_q_node_t *node);
+static mm_jpeg_pool_result_t mm_jpeg_session_pool_get(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session);
+static OMX_BOOL mm_jpeg_session_pool_put(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session);
+static uint32_t mm_jpeg_session_pool_trim(mm_jpeg_obj *my_obj,
+  uint32_t max_entries);
 
 /** mm_jpeg_session_send_buffers:
  *
@@ -270,7 +279,9 @@ OMX_ERRORTYPE mm_jpeg_session_change_state(mm_jpeg_job_session_t* p_session,
  *       OMX error types
  *
  *  Description:
- *       Create a jpeg encode session
+ *       Create a jpeg encode session. A parked handle of the
+ *       session pool is used if one matches the session params,
+ *       which have to be set by the caller.
  *
  **/
 OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
@@ -278,6 +289,8 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   OMX_ERRORTYPE rc = OMX_ErrorNone;
   mm_jpeg_cirq_t *p_cirq = NULL;
   mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
+  mm_jpeg_omx_ctx_t *p_omx_ctx = NULL;
+  int max_parked;
   int i = 0;
 
   pthread_mutex_init(&p_session->lock, NULL);
@@ -291,30 +304,55 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   p_session->encode_pid = -1;
   p_session->config = OMX_FALSE;
   p_session->exif_count_local = 0;
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   p_session->auto_out_buf = OMX_FALSE;
+  p_session->encoding = OMX_FALSE;
+  p_session->omx_handle = NULL;
+  p_session->p_omx_ctx = NULL;
+
+  p_session->pool_result = mm_jpeg_session_pool_get(my_obj, p_session);
+  if (MM_JPEG_POOL_MISS != p_session->pool_result) {
+    my_obj->num_sessions++;
+    return rc;
+  }
 
-  p_session->omx_callbacks.EmptyBufferDone = mm_jpeg_ebd;
-  p_session->omx_callbacks.FillBufferDone = mm_jpeg_fbd;
-  p_session->omx_callbacks.EventHandler = mm_jpeg_event_handler;
+  p_omx_ctx = (mm_jpeg_omx_ctx_t *)malloc(sizeof(*p_omx_ctx));
+  if (NULL == p_omx_ctx) {
+    CDBG_ERROR("%s:%d] no memory", __func__, __LINE__);
+    return OMX_ErrorInsufficientResources;
+  }
+  p_omx_ctx->p_session = p_session;
+  p_omx_ctx->callbacks.EmptyBufferDone = mm_jpeg_ebd;
+  p_omx_ctx->callbacks.FillBufferDone = mm_jpeg_fbd;
+  p_omx_ctx->callbacks.EventHandler = mm_jpeg_event_handler;
 
+  /* parked handles count against MAX_OMX_HANDLES as well */
+  max_parked = MAX_OMX_HANDLES - my_obj->num_sessions - 1;
+  mm_jpeg_session_pool_trim(my_obj, (max_parked > 0) ? max_parked : 0);
 
   rc = OMX_GetHandle(&p_session->omx_handle,
       "OMX.qcom.image.jpeg.encoder",
-      (void *)p_session,
-      &p_session->omx_callbacks);
+      (void *)p_omx_ctx,
+      &p_omx_ctx->callbacks);
+  if ((OMX_ErrorNone != rc) && mm_jpeg_session_pool_trim(my_obj, 0)) {
+    rc = OMX_GetHandle(&p_session->omx_handle,
+        "OMX.qcom.image.jpeg.encoder",
+        (void *)p_omx_ctx,
+        &p_omx_ctx->callbacks);
+  }
   if (OMX_ErrorNone != rc) {
     CDBG_ERROR("%s:%d] OMX_GetHandle failed (%d)", __func__, __LINE__, rc);
+    free(p_omx_ctx);
     return rc;
   }
+  p_session->p_omx_ctx = p_omx_ctx;
 
   my_obj->num_sessions++;
 
   return rc;
 }
 
-
-
-/** mm_jpeg_session_destroy:
+/** mm_jpeg_session_release_handle:
  *
  *  Arguments:
  *    @p_session: job session
@@ -323,20 +361,14 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
  *       none
  *
  *  Description:
- *       Destroy a jpeg encode session
+ *       Moves the OMX handle of the session to loaded state,
+ *       freeing the buffers, and releases it
  *
  **/
-void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
+static void mm_jpeg_session_release_handle(mm_jpeg_job_session_t *p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
   OMX_STATETYPE state;
-  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
-
-  CDBG("%s:%d] E", __func__, __LINE__);
-  if (NULL == p_session->omx_handle) {
-    CDBG_ERROR("%s:%d] invalid handle", __func__, __LINE__);
-    return;
-  }
 
   rc = OMX_GetState(p_session->omx_handle, &state);
 
@@ -364,6 +396,39 @@ void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
   }
   p_session->omx_handle = NULL;
 
+  free(p_session->p_omx_ctx);
+  p_session->p_omx_ctx = NULL;
+}
+
+/** mm_jpeg_session_destroy:
+ *
+ *  Arguments:
+ *    @p_session: job session
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Destroy a jpeg encode session. The OMX handle is parked in
+ *       the session pool if the pool takes it.
+ *
+ **/
+void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
+{
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
+
+  CDBG("%s:%d] E", __func__, __LINE__);
+  if (NULL == p_session->omx_handle) {
+    CDBG_ERROR("%s:%d] invalid handle", __func__, __LINE__);
+    return;
+  }
+
+  if (OMX_FALSE == mm_jpeg_session_pool_put(my_obj, p_session)) {
+    mm_jpeg_session_release_handle(p_session);
+  }
+  p_session->omx_handle = NULL;
+  p_session->p_omx_ctx = NULL;
+
   pthread_mutex_destroy(&p_session->lock);
   pthread_cond_destroy(&p_session->cond);
 
@@ -1153,8 +1218,10 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
   if (NULL != p_jobparams->p_metadata) {
     exif_info.numOfEntries = 0;
     exif_info.exif_data = &p_session->exif_info_local[0];
+    mm_jpeg_exif_arena_reset(&p_session->exif_arena);
     process_meta_data(p_jobparams->p_metadata, &exif_info,
-      &p_jobparams->cam_exif_params, p_jobparams->hal_version);
+      &p_session->exif_arena, &p_jobparams->cam_exif_params,
+      p_jobparams->hal_version);
     /* After Parse metadata */
     p_session->exif_count_local = exif_info.numOfEntries;
 
@@ -1493,6 +1560,441 @@ error:
   return ret;
 }
 
+/** mm_jpeg_omx_backend_encode:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session owning the OMX handle
+ *    @job_node: job node
+ *
+ *  Return:
+ *       OMX error values
+ *
+ *  Description:
+ *       Programs the OMX component, the result is delivered by
+ *       mm_jpeg_fbd
+ *
+ **/
+static int32_t mm_jpeg_omx_backend_encode(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, mm_jpeg_job_q_node_t *job_node)
+{
+  return (int32_t)mm_jpeg_session_encode(p_session);
+}
+
+/** mm_jpeg_swenc_exif_t:
+ *  @meta_entries: exif tags parsed from the job metadata
+ *  @meta_arena: payload of @meta_entries
+ *  @app1: Exif APP1 segment
+ *
+ *  exif scratch of one software encode, the session copies
+ *  belong to the OMX path
+ **/
+typedef struct {
+  QEXIF_INFO_DATA meta_entries[MAX_EXIF_TABLE_ENTRIES];
+  mm_jpeg_exif_arena_t meta_arena;
+  uint8_t app1[MM_JPEG_EXIF_APP1_MAX_SIZE];
+} mm_jpeg_swenc_exif_t;
+
+/** mm_jpeg_swenc_job_crop:
+ *
+ *  Arguments:
+ *    @dim: main image dimensions of the job
+ *    @p_crop: effective crop
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       An empty crop encodes the whole source image
+ *
+ **/
+static void mm_jpeg_swenc_job_crop(const mm_jpeg_dim_t *dim,
+  cam_rect_t *p_crop)
+{
+  *p_crop = dim->crop;
+  if ((p_crop->width == 0) || (p_crop->height == 0)) {
+    p_crop->width = dim->src_dim.width;
+    p_crop->height = dim->src_dim.height;
+  }
+}
+
+/** mm_jpeg_swenc_build_app1:
+ *
+ *  Arguments:
+ *    @p_job: encode job
+ *    @p_exif: exif scratch
+ *    @p_len: length of the APP1 segment, 0 if the job has no exif
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Writes the exif tags of the job followed by the ones
+ *       parsed from the metadata, in the same order they are
+ *       given to the OMX component.
+ *
+ **/
+static int32_t mm_jpeg_swenc_build_app1(mm_jpeg_encode_job_t *p_job,
+  mm_jpeg_swenc_exif_t *p_exif, uint32_t *p_len)
+{
+  QOMX_EXIF_INFO info[2];
+  uint32_t num_info = 0;
+
+  if (p_job->exif_info.numOfEntries > 0) {
+    info[num_info++] = p_job->exif_info;
+  }
+  if (NULL != p_job->p_metadata) {
+    info[num_info].numOfEntries = 0;
+    info[num_info].exif_data = &p_exif->meta_entries[0];
+    mm_jpeg_exif_arena_reset(&p_exif->meta_arena);
+    process_meta_data(p_job->p_metadata, &info[num_info],
+      &p_exif->meta_arena, &p_job->cam_exif_params, p_job->hal_version);
+    num_info++;
+  }
+
+  return mm_jpeg_exif_write_app1(info, num_info, p_exif->app1,
+    sizeof(p_exif->app1), p_len);
+}
+
+/** mm_jpeg_swenc_backend_encode:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session of the job
+ *    @job_node: job node
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Encodes the job with the software encoder and sends the
+ *       jpeg callback. Only the session params are read, the
+ *       per job state of the session belongs to the OMX path.
+ *       The exif tags are written, the thumbnail is not.
+ *
+ **/
+static int32_t mm_jpeg_swenc_backend_encode(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, mm_jpeg_job_q_node_t *job_node)
+{
+  mm_jpeg_encode_params_t *p_params = &p_session->params;
+  mm_jpeg_encode_job_t *p_job = &job_node->enc_info.encode_job;
+  mm_jpeg_buf_t *p_src = &p_params->src_main_buf[p_job->src_index];
+  mm_jpeg_buf_t *p_dst = &p_params->dest_buf[p_job->dst_index];
+  mm_jpeg_swenc_exif_t *p_exif = NULL;
+  mm_jpeg_swenc_image_t img;
+  mm_jpeg_swenc_params_t params;
+  mm_jpeg_swenc_stats_t stats;
+  mm_jpeg_output_t output_buf;
+  jpeg_job_status_t status = JPEG_JOB_STATUS_DONE;
+  cam_rect_t crop;
+  int32_t rc;
+
+  mm_jpeg_swenc_job_crop(&p_job->main_dim, &crop);
+
+  memset(&img, 0, sizeof(img));
+  img.y_stride = (uint32_t)p_src->offset.mp[0].stride;
+  img.cbcr_stride = (uint32_t)p_src->offset.mp[1].stride;
+  img.width = (uint32_t)crop.width;
+  img.height = (uint32_t)crop.height;
+  img.p_y = p_src->buf_vaddr + p_src->offset.mp[0].offset +
+    crop.top * img.y_stride + crop.left;
+  img.p_cbcr = p_src->buf_vaddr + p_src->offset.mp[0].len +
+    p_src->offset.mp[1].offset + (crop.top / 2) * img.cbcr_stride +
+    crop.left;
+  img.cbcr_swap =
+    (MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2 == p_params->color_format) ? 1 : 0;
+
+  memset(&params, 0, sizeof(params));
+  params.quality = p_params->quality;
+
+  memset(&output_buf, 0, sizeof(output_buf));
+  p_exif = (mm_jpeg_swenc_exif_t *)malloc(sizeof(*p_exif));
+  if (NULL == p_exif) {
+    CDBG_ERROR("%s:%d] no memory for the exif of job %x", __func__,
+      __LINE__, job_node->enc_info.job_id);
+    rc = -1;
+  } else {
+    rc = mm_jpeg_swenc_build_app1(p_job, p_exif, &params.app1_len);
+    params.p_app1 = p_exif->app1;
+  }
+  if (0 == rc) {
+    rc = mm_jpeg_swenc_encode(my_obj->p_swenc, &img, &params,
+      p_dst->buf_vaddr, p_dst->buf_size, &output_buf.buf_filled_len, &stats);
+  }
+  free(p_exif);
+  if (rc) {
+    CDBG_ERROR("%s:%d] software encode of job %x failed", __func__, __LINE__,
+      job_node->enc_info.job_id);
+    status = JPEG_JOB_STATUS_ERROR;
+  } else {
+    CDBG_HIGH("%s:%d] job %x %dx%d %d bytes in %lld us, %d slices",
+      __func__, __LINE__, job_node->enc_info.job_id, img.width, img.height,
+      output_buf.buf_filled_len, (long long)stats.encode_us,
+      stats.num_slices);
+  }
+
+  if (NULL != p_params->jpeg_cb) {
+    output_buf.buf_vaddr = p_dst->buf_vaddr;
+    output_buf.fd = 0;
+    p_params->jpeg_cb(status,
+      p_session->client_hdl,
+      job_node->enc_info.job_id,
+      rc ? NULL : &output_buf,
+      p_params->userdata);
+  }
+
+  return rc;
+}
+
+static const mm_jpeg_enc_backend_t mm_jpeg_omx_backend = {
+  "omx",
+  mm_jpeg_omx_backend_encode,
+};
+
+static const mm_jpeg_enc_backend_t mm_jpeg_swenc_backend = {
+  "sw",
+  mm_jpeg_swenc_backend_encode,
+};
+
+/** mm_jpeg_swenc_job_supported:
+ *
+ *  Arguments:
+ *    @p_session: session of the job
+ *    @p_job: encode job
+ *
+ *  Return:
+ *       OMX_TRUE if the software encoder can take the job
+ *
+ *  Description:
+ *       The software encoder handles 4:2:0 semi planar input
+ *       without rotation and scaling. It writes the exif tags
+ *       but no thumbnail. The job is not modified, this is also
+ *       called to pick runnable jobs.
+ *
+ **/
+static OMX_BOOL mm_jpeg_swenc_job_supported(mm_jpeg_job_session_t *p_session,
+  mm_jpeg_encode_job_t *p_job)
+{
+  mm_jpeg_dim_t *dim = &p_job->main_dim;
+  cam_rect_t crop;
+
+  if ((MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2 != p_session->params.color_format) &&
+    (MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V2 != p_session->params.color_format)) {
+    return OMX_FALSE;
+  }
+  if ((p_job->rotation != 0) || (p_job->src_index < 0) ||
+    ((uint32_t)p_job->src_index >= p_session->params.num_src_bufs)) {
+    return OMX_FALSE;
+  }
+  mm_jpeg_swenc_job_crop(dim, &crop);
+  if ((crop.left & 1) || (crop.top & 1) ||
+    (crop.width + crop.left > dim->src_dim.width) ||
+    (crop.height + crop.top > dim->src_dim.height)) {
+    return OMX_FALSE;
+  }
+  if ((dim->dst_dim.width && (dim->dst_dim.width != crop.width)) ||
+    (dim->dst_dim.height && (dim->dst_dim.height != crop.height))) {
+    return OMX_FALSE;
+  }
+  return OMX_TRUE;
+}
+
+/** mm_jpeg_swenc_take_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session of the job
+ *    @job_node: job node
+ *
+ *  Return:
+ *       OMX_TRUE if the job goes to the software encoder
+ *
+ *  Description:
+ *       In overflow mode only burst jobs finding all the OMX
+ *       handles busy are taken, one at a time. Must be called
+ *       with the job_lock held.
+ *
+ **/
+static OMX_BOOL mm_jpeg_swenc_take_job(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, mm_jpeg_job_q_node_t *job_node)
+{
+  if ((NULL == my_obj->p_swenc) ||
+    (MM_JPEG_CMD_TYPE_JOB != job_node->type)) {
+    return OMX_FALSE;
+  }
+
+  switch (my_obj->swenc_mode) {
+  case MM_JPEG_SWENC_MODE_ALWAYS:
+    break;
+  case MM_JPEG_SWENC_MODE_OVERFLOW:
+    if ((MM_JPEG_JOB_PRIO_BURST != job_node->prio) ||
+      (my_obj->swenc_jobs > 0) ||
+      (mm_jpeg_queue_get_size(p_session->session_handle_q) > 0)) {
+      return OMX_FALSE;
+    }
+    break;
+  case MM_JPEG_SWENC_MODE_OFF:
+  default:
+    return OMX_FALSE;
+  }
+
+  return mm_jpeg_swenc_job_supported(p_session,
+    &job_node->enc_info.encode_job);
+}
+
+/** mm_jpeg_swenc_process_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session of the job
+ *    @job_node: job node
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Runs the job on the software backend. Called with the
+ *       job_lock held, the lock is dropped while encoding. The job
+ *       stays in the ongoing queue meanwhile so that abort and
+ *       session destroy wait for it.
+ *
+ **/
+static int32_t mm_jpeg_swenc_process_job(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, mm_jpeg_job_q_node_t *job_node)
+{
+  int32_t rc = 0;
+  mm_jpeg_job_q_node_t *node = NULL;
+  uint32_t job_id = job_node->enc_info.job_id;
+  OMX_BOOL auto_out_buf = OMX_FALSE;
+  uint32_t buf_idx;
+  int32_t dst_index;
+
+  if (job_node->enc_info.encode_job.dst_index < 0) {
+    /* dequeue available output buffer idx */
+    buf_idx = (uint32_t)mm_jpeg_queue_deq(p_session->out_buf_q);
+    if (NULL == (void*)buf_idx) {
+      CDBG_ERROR("%s:%d] No available output buffers", __func__, __LINE__);
+      rc = -1;
+      goto error;
+    }
+    job_node->enc_info.encode_job.dst_index = (int32_t)buf_idx - 1;
+    auto_out_buf = OMX_TRUE;
+  }
+  dst_index = job_node->enc_info.encode_job.dst_index;
+  if ((uint32_t)dst_index >= p_session->params.num_dst_bufs) {
+    CDBG_ERROR("%s:%d] invalid output buffer %d", __func__, __LINE__,
+      dst_index);
+    rc = -1;
+    goto error;
+  }
+
+  job_node->sw_backend = OMX_TRUE;
+  rc = mm_jpeg_queue_enq(&my_obj->ongoing_job_q, job_node);
+  if (rc) {
+    CDBG_ERROR("%s:%d] jpeg enqueue failed", __func__, __LINE__);
+    if (auto_out_buf) {
+      mm_jpeg_queue_enq(p_session->out_buf_q, (void*)(dst_index + 1));
+    }
+    goto error;
+  }
+
+  CDBG_HIGH("%s:%d] job %x on backend %s", __func__, __LINE__, job_id,
+    mm_jpeg_swenc_backend.name);
+
+  my_obj->swenc_jobs++;
+  p_session->dispatch_cnt++;
+  pthread_mutex_unlock(&my_obj->job_lock);
+  rc = mm_jpeg_swenc_backend.encode(my_obj, p_session, job_node);
+  pthread_mutex_lock(&my_obj->job_lock);
+  p_session->dispatch_cnt--;
+  my_obj->swenc_jobs--;
+  pthread_cond_broadcast(&my_obj->job_mgr.dispatch_cond);
+
+  /* the node is gone already if the job was aborted meanwhile */
+  node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q, job_id);
+  if (node) {
+    mm_jpeg_jobmgr_job_stats(my_obj, node);
+    free(node);
+  }
+  if (auto_out_buf) {
+    mm_jpeg_queue_enq(p_session->out_buf_q, (void*)(dst_index + 1));
+  }
+  mm_jpeg_jobmgr_release_slot(my_obj);
+  return rc;
+
+error:
+  if (NULL != p_session->params.jpeg_cb) {
+    p_session->params.jpeg_cb(JPEG_JOB_STATUS_ERROR,
+      p_session->client_hdl,
+      job_id,
+      NULL,
+      p_session->params.userdata);
+  }
+  free(job_node);
+  mm_jpeg_jobmgr_release_slot(my_obj);
+  return rc;
+}
+
+/** mm_jpeg_swenc_backend_init:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Creates the software encoder if enabled through
+ *       persist.camera.jpeg.swenc, 1 for burst overflow and 2 for
+ *       every job. The OMX encoder stays the only backend if the
+ *       software encoder can not be created.
+ *
+ **/
+static void mm_jpeg_swenc_backend_init(mm_jpeg_obj *my_obj)
+{
+  char prop[PROPERTY_VALUE_MAX];
+  int mode;
+
+  my_obj->swenc_mode = MM_JPEG_SWENC_MODE_OFF;
+  my_obj->p_swenc = NULL;
+  my_obj->swenc_jobs = 0;
+
+  property_get("persist.camera.jpeg.swenc", prop, "0");
+  mode = atoi(prop);
+  if ((mode <= MM_JPEG_SWENC_MODE_OFF) || (mode > MM_JPEG_SWENC_MODE_ALWAYS)) {
+    return;
+  }
+
+  property_get("persist.camera.jpeg.swenc_threads", prop, "0");
+  my_obj->p_swenc = mm_jpeg_swenc_create((uint32_t)atoi(prop));
+  if (NULL == my_obj->p_swenc) {
+    CDBG_ERROR("%s:%d] software encoder not available", __func__, __LINE__);
+    return;
+  }
+  my_obj->swenc_mode = (mm_jpeg_swenc_mode_t)mode;
+  CDBG_HIGH("%s:%d] software encoder mode %d", __func__, __LINE__, mode);
+}
+
+/** mm_jpeg_swenc_backend_deinit:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Destroys the software encoder, the dispatchers must be
+ *       stopped already
+ *
+ **/
+static void mm_jpeg_swenc_backend_deinit(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_swenc_destroy(my_obj->p_swenc);
+  my_obj->p_swenc = NULL;
+  my_obj->swenc_mode = MM_JPEG_SWENC_MODE_OFF;
+}
+
 /** mm_jpeg_process_encoding_job:
  *
  *  Arguments:
@@ -1503,7 +2005,8 @@ error:
  *       0 for success -1 otherwise
  *
  *  Description:
- *       Start the encoding job
+ *       Start the encoding job. Called with the job_lock held, the
+ *       lock is dropped while the OMX component is programmed.
  *
  **/
 int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
@@ -1523,6 +2026,10 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
     return -1;
   }
 
+  if (mm_jpeg_swenc_take_job(my_obj, p_session, job_node)) {
+    return mm_jpeg_swenc_process_job(my_obj, p_session, job_node);
+  }
+
   CDBG_HIGH("%s:%d] before dequeue session %d",
                 __func__, __LINE__, ret);
 
@@ -1532,8 +2039,10 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
   if (NULL == p_session) {
     CDBG_HIGH("%s:%d] No available sessions %d",
           __func__, __LINE__, ret);
-    /* No available handles */
-    mm_jpeg_queue_enq_head(&my_obj->job_mgr.job_queue, job_node);
+    /* No available handles, requeue and keep the wake up around */
+    mm_jpeg_queue_enq_prio(&my_obj->job_mgr.job_queue, job_node,
+      mm_jpeg_jobmgr_prio_rank(job_node));
+    cam_sem_post(&my_obj->job_mgr.job_sem);
 
     CDBG_HIGH("%s:%d]end enqueue %d",
               __func__, __LINE__, ret);
@@ -1568,7 +2077,16 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
 
   p_session->encode_job = job_node->enc_info.encode_job;
   p_session->jobId = job_node->enc_info.job_id;
-  ret = mm_jpeg_session_encode(p_session);
+
+  /* program the OMX component without holding the job lock so that
+   * jobs of other sessions can be dispatched meanwhile */
+  p_session->dispatch_cnt++;
+  pthread_mutex_unlock(&my_obj->job_lock);
+  ret = (OMX_ERRORTYPE)mm_jpeg_omx_backend.encode(my_obj, p_session,
+    job_node);
+  pthread_mutex_lock(&my_obj->job_lock);
+  p_session->dispatch_cnt--;
+  pthread_cond_broadcast(&my_obj->job_mgr.dispatch_cond);
   if (ret) {
     CDBG_ERROR("%s:%d] encode session failed", __func__, __LINE__);
     goto error;
@@ -1600,49 +2118,429 @@ error:
 
 
 
-/** mm_jpeg_jobmgr_thread:
+/** mm_jpeg_time_diff_us:
  *
  *  Arguments:
- *    @my_obj: jpeg object
+ *    @p_start: start time
+ *    @p_end: end time
  *
  *  Return:
- *       0 for success else failure
+ *       elapsed time in microseconds
  *
  *  Description:
- *       job manager thread main function
+ *       Computes the elapsed time between two timestamps
  *
  **/
-static void *mm_jpeg_jobmgr_thread(void *data)
+static inline uint64_t mm_jpeg_time_diff_us(struct timespec *p_start,
+  struct timespec *p_end)
 {
-  int rc = 0;
-  int running = 1;
-  uint32_t num_ongoing_jobs = 0;
-  mm_jpeg_obj *my_obj = (mm_jpeg_obj*)data;
-  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
-  mm_jpeg_job_q_node_t* node = NULL;
-  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_thread", 0, 0, 0);
+  int64_t diff = (int64_t)(p_end->tv_sec - p_start->tv_sec) * 1000000LL +
+    (p_end->tv_nsec - p_start->tv_nsec) / 1000;
+  return (diff > 0) ? (uint64_t)diff : 0;
+}
 
-  do {
-    do {
-      rc = cam_sem_wait(&cmd_thread->job_sem);
-      if (rc != 0 && errno != EINVAL) {
-        CDBG_ERROR("%s: cam_sem_wait error (%s)",
+/** mm_jpeg_jobmgr_prio_rank:
+ *
+ *  Arguments:
+ *    @node: job node
+ *
+ *  Return:
+ *       rank of the job in the todo queue, lower is scheduled first
+ *
+ *  Description:
+ *       Maps the scheduling class of a job to its queue rank. The
+ *       exit command goes last so that pending jobs are not starved.
+ *
+ **/
+static uint32_t mm_jpeg_jobmgr_prio_rank(mm_jpeg_job_q_node_t *node)
+{
+  if (MM_JPEG_CMD_TYPE_EXIT == node->type) {
+    return MM_JPEG_JOB_PRIO_MAX;
+  }
+
+  switch (node->prio) {
+  case MM_JPEG_JOB_PRIO_BURST:
+    return 1;
+  case MM_JPEG_JOB_PRIO_MAIN:
+  default:
+    return 0;
+  }
+}
+
+/** mm_jpeg_jobmgr_enqueue:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @node: job node
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Queues a job in the todo queue according to its priority
+ *       and wakes up a dispatcher
+ *
+ **/
+int32_t mm_jpeg_jobmgr_enqueue(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *node)
+{
+  int32_t rc;
+
+  if (node->prio >= MM_JPEG_JOB_PRIO_MAX) {
+    node->prio = MM_JPEG_JOB_PRIO_MAIN;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &node->enq_ts);
+
+  rc = mm_jpeg_queue_enq_prio(&my_obj->job_mgr.job_queue, node,
+    mm_jpeg_jobmgr_prio_rank(node));
+  if (0 == rc) {
+    cam_sem_post(&my_obj->job_mgr.job_sem);
+  }
+  return rc;
+}
+
+/** mm_jpeg_jobmgr_job_stats:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @node: completed job node
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Accounts the queueing and processing latency of a
+ *       completed job
+ *
+ **/
+void mm_jpeg_jobmgr_job_stats(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *node)
+{
+  struct timespec now;
+  uint64_t queue_us, proc_us;
+  mm_jpeg_job_stats_t *p_stats;
+
+  if ((NULL == node) || (node->prio >= MM_JPEG_JOB_PRIO_MAX)) {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  queue_us = mm_jpeg_time_diff_us(&node->enq_ts, &node->start_ts);
+  proc_us = mm_jpeg_time_diff_us(&node->start_ts, &now);
+
+  pthread_mutex_lock(&my_obj->job_mgr.stats_lock);
+  p_stats = &my_obj->job_mgr.stats[node->prio];
+  p_stats->num_jobs++;
+  p_stats->total_queue_us += queue_us;
+  p_stats->total_proc_us += proc_us;
+  if (queue_us > p_stats->max_queue_us) {
+    p_stats->max_queue_us = queue_us;
+  }
+  if (proc_us > p_stats->max_proc_us) {
+    p_stats->max_proc_us = proc_us;
+  }
+  pthread_mutex_unlock(&my_obj->job_mgr.stats_lock);
+
+  CDBG("%s:%d] prio %d queued %llu us processed %llu us", __func__, __LINE__,
+    node->prio, (unsigned long long)queue_us, (unsigned long long)proc_us);
+}
+
+/** mm_jpeg_jobmgr_dump_stats:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Logs the per priority latency statistics
+ *
+ **/
+static void mm_jpeg_jobmgr_dump_stats(mm_jpeg_obj *my_obj)
+{
+  int i;
+  mm_jpeg_job_stats_t *p_stats;
+
+  pthread_mutex_lock(&my_obj->job_mgr.stats_lock);
+  for (i = 0; i < MM_JPEG_JOB_PRIO_MAX; i++) {
+    p_stats = &my_obj->job_mgr.stats[i];
+    if (0 == p_stats->num_jobs) {
+      continue;
+    }
+    CDBG_HIGH("%s:%d] prio %d jobs %u queue avg %llu max %llu us "
+      "proc avg %llu max %llu us", __func__, __LINE__, i,
+      p_stats->num_jobs,
+      (unsigned long long)(p_stats->total_queue_us / p_stats->num_jobs),
+      (unsigned long long)p_stats->max_queue_us,
+      (unsigned long long)(p_stats->total_proc_us / p_stats->num_jobs),
+      (unsigned long long)p_stats->max_proc_us);
+  }
+  pthread_mutex_unlock(&my_obj->job_mgr.stats_lock);
+}
+
+/** mm_jpeg_jobmgr_release_slot:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Notifies the dispatchers waiting for a free job slot. Must
+ *       be called after a job leaves the ongoing queue or after
+ *       jobs are removed from the todo queue.
+ *
+ **/
+void mm_jpeg_jobmgr_release_slot(mm_jpeg_obj *my_obj)
+{
+  pthread_mutex_lock(&my_obj->job_mgr.slot_lock);
+  my_obj->job_mgr.slot_gen++;
+  pthread_cond_broadcast(&my_obj->job_mgr.slot_cond);
+  pthread_mutex_unlock(&my_obj->job_mgr.slot_lock);
+}
+
+/** mm_jpeg_jobmgr_wait_dispatch:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Waits until no dispatcher is programming the session.
+ *       Must be called with the job_lock held.
+ *
+ **/
+void mm_jpeg_jobmgr_wait_dispatch(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session)
+{
+  while (p_session->dispatch_cnt > 0) {
+    pthread_cond_wait(&my_obj->job_mgr.dispatch_cond, &my_obj->job_lock);
+  }
+}
+
+/** mm_jpeg_jobmgr_session_busy:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @job_id: job id identifying the session
+ *
+ *  Return:
+ *       OMX_TRUE if a job of the same session is ongoing
+ *
+ *  Description:
+ *       Decode sessions own a single OMX handle, only one of their
+ *       jobs can be ongoing at a time
+ *
+ **/
+static OMX_BOOL mm_jpeg_jobmgr_session_busy(mm_jpeg_obj *my_obj,
+  uint32_t job_id)
+{
+  mm_jpeg_queue_t *queue = &my_obj->ongoing_job_q;
+  mm_jpeg_q_node_t *node = NULL;
+  mm_jpeg_job_q_node_t *data = NULL;
+  struct cam_list *head = NULL;
+  struct cam_list *pos = NULL;
+  uint32_t lq_job_id;
+  OMX_BOOL busy = OMX_FALSE;
+
+  pthread_mutex_lock(&queue->lock);
+  head = &queue->head.list;
+  pos = head->next;
+  while (pos != head) {
+    node = member_of(pos, mm_jpeg_q_node_t, list);
+    data = (mm_jpeg_job_q_node_t *)node->data;
+    if (data) {
+      lq_job_id = (data->type == MM_JPEG_CMD_TYPE_DECODE_JOB) ?
+        data->dec_info.job_id : data->enc_info.job_id;
+      if ((lq_job_id & 0xffff) == (job_id & 0xffff)) {
+        busy = OMX_TRUE;
+        break;
+      }
+    }
+    pos = pos->next;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return busy;
+}
+
+/** mm_jpeg_jobmgr_job_runnable:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @job: job node
+ *
+ *  Return:
+ *       OMX_TRUE if the job can be dispatched now
+ *
+ *  Description:
+ *       Checks if the session of the job has an OMX handle available
+ *       or the job can go to the software encoder
+ *
+ **/
+static OMX_BOOL mm_jpeg_jobmgr_job_runnable(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *job)
+{
+  mm_jpeg_job_session_t *p_session = NULL;
+
+  switch (job->type) {
+  case MM_JPEG_CMD_TYPE_JOB:
+    p_session = mm_jpeg_get_session(my_obj, job->enc_info.job_id);
+    if ((NULL == p_session) || (NULL == p_session->session_handle_q)) {
+      /* let the process function fail the job */
+      return OMX_TRUE;
+    }
+    if (mm_jpeg_queue_get_size(p_session->session_handle_q) > 0) {
+      return OMX_TRUE;
+    }
+    /* no OMX handle, the software encoder may take it */
+    return mm_jpeg_swenc_take_job(my_obj, p_session, job);
+  case MM_JPEG_CMD_TYPE_DECODE_JOB:
+    return mm_jpeg_jobmgr_session_busy(my_obj, job->dec_info.job_id) ?
+      OMX_FALSE : OMX_TRUE;
+  case MM_JPEG_CMD_TYPE_EXIT:
+  default:
+    return OMX_TRUE;
+  }
+}
+
+/** mm_jpeg_jobmgr_pick_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       job node removed from the todo queue, NULL if none can run
+ *
+ *  Description:
+ *       Picks the highest priority job which can be dispatched.
+ *       Only the exit command is picked when the ongoing queue is
+ *       full. Must be called with the job_lock held.
+ *
+ **/
+static mm_jpeg_job_q_node_t *mm_jpeg_jobmgr_pick_job(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_queue_t *queue = &my_obj->job_mgr.job_queue;
+  mm_jpeg_q_node_t *node = NULL;
+  mm_jpeg_job_q_node_t *data = NULL;
+  mm_jpeg_job_q_node_t *job_node = NULL;
+  struct cam_list *head = NULL;
+  struct cam_list *pos = NULL;
+  OMX_BOOL saturated;
+
+  saturated = (mm_jpeg_queue_get_size(&my_obj->ongoing_job_q) >=
+    my_obj->job_mgr.max_ongoing_jobs) ? OMX_TRUE : OMX_FALSE;
+
+  pthread_mutex_lock(&queue->lock);
+  head = &queue->head.list;
+  pos = head->next;
+  while (pos != head) {
+    node = member_of(pos, mm_jpeg_q_node_t, list);
+    data = (mm_jpeg_job_q_node_t *)node->data;
+
+    if (data && ((MM_JPEG_CMD_TYPE_EXIT == data->type) ||
+      (!saturated && mm_jpeg_jobmgr_job_runnable(my_obj, data)))) {
+      job_node = data;
+      cam_list_del_node(&node->list);
+      queue->size--;
+      free(node);
+      break;
+    }
+    pos = pos->next;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  if (job_node) {
+    clock_gettime(CLOCK_MONOTONIC, &job_node->start_ts);
+  }
+  return job_node;
+}
+
+/** mm_jpeg_jobmgr_wait_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       job node to be processed, NULL if the todo queue is empty
+ *
+ *  Description:
+ *       Waits until one of the pending jobs can be dispatched. The
+ *       wake up is kept while the ongoing queue is saturated instead
+ *       of being dropped. Must be called with the job_lock held.
+ *
+ **/
+static mm_jpeg_job_q_node_t *mm_jpeg_jobmgr_wait_job(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+  mm_jpeg_job_q_node_t *node = NULL;
+  uint32_t slot_gen;
+
+  while (1) {
+    pthread_mutex_lock(&cmd_thread->slot_lock);
+    slot_gen = cmd_thread->slot_gen;
+    pthread_mutex_unlock(&cmd_thread->slot_lock);
+
+    node = mm_jpeg_jobmgr_pick_job(my_obj);
+    if ((NULL != node) ||
+      (0 == mm_jpeg_queue_get_size(&cmd_thread->job_queue))) {
+      break;
+    }
+
+    CDBG("%s:%d] no job can be dispatched, ongoing %d", __func__, __LINE__,
+      mm_jpeg_queue_get_size(&my_obj->ongoing_job_q));
+
+    pthread_mutex_unlock(&my_obj->job_lock);
+    pthread_mutex_lock(&cmd_thread->slot_lock);
+    while (slot_gen == cmd_thread->slot_gen) {
+      pthread_cond_wait(&cmd_thread->slot_cond, &cmd_thread->slot_lock);
+    }
+    pthread_mutex_unlock(&cmd_thread->slot_lock);
+    pthread_mutex_lock(&my_obj->job_lock);
+  }
+
+  return node;
+}
+
+/** mm_jpeg_jobmgr_thread:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       job manager dispatcher thread main function
+ *
+ **/
+static void *mm_jpeg_jobmgr_thread(void *data)
+{
+  int rc = 0;
+  int running = 1;
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj*)data;
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+  mm_jpeg_job_q_node_t* node = NULL;
+  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_thread", 0, 0, 0);
+
+  do {
+    do {
+      rc = cam_sem_wait(&cmd_thread->job_sem);
+      if (rc != 0 && errno != EINVAL) {
+        CDBG_ERROR("%s: cam_sem_wait error (%s)",
           __func__, strerror(errno));
         return NULL;
       }
     } while (rc != 0);
 
-    /* check ongoing q size */
-    num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
-    if (num_ongoing_jobs >= NUM_MAX_JPEG_CNCURRENT_JOBS) {
-      CDBG("%s:%d] ongoing job already reach max %d", __func__,
-        __LINE__, num_ongoing_jobs);
-      continue;
-    }
-
     pthread_mutex_lock(&my_obj->job_lock);
-    /* can go ahead with new work */
-    node = (mm_jpeg_job_q_node_t*)mm_jpeg_queue_deq(&cmd_thread->job_queue);
+    /* wait until a job can go ahead */
+    node = mm_jpeg_jobmgr_wait_job(my_obj);
     if (node != NULL) {
       switch (node->type) {
       case MM_JPEG_CMD_TYPE_JOB:
@@ -1675,22 +2573,59 @@ static void *mm_jpeg_jobmgr_thread(void *data)
  *       0 for success else failure
  *
  *  Description:
- *       launches the job manager thread
+ *       launches the job manager dispatcher threads
  *
  **/
 int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
 {
   int32_t rc = 0;
+  uint32_t i;
+  int max_jobs;
+  char prop[PROPERTY_VALUE_MAX];
   mm_jpeg_job_cmd_thread_t *job_mgr = &my_obj->job_mgr;
 
+  property_get("persist.camera.jpeg.max_jobs", prop, "0");
+  max_jobs = atoi(prop);
+  if (max_jobs <= 0) {
+    max_jobs = NUM_MAX_JPEG_CNCURRENT_JOBS;
+  } else if (max_jobs > MM_JPEG_MAX_DISPATCH_THREADS) {
+    max_jobs = MM_JPEG_MAX_DISPATCH_THREADS;
+  }
+  /* room for the overflow job next to the OMX ones */
+  if ((MM_JPEG_SWENC_MODE_OVERFLOW == my_obj->swenc_mode) &&
+    (max_jobs < MM_JPEG_MAX_DISPATCH_THREADS)) {
+    max_jobs++;
+  }
+  job_mgr->max_ongoing_jobs = (uint32_t)max_jobs;
+
   cam_sem_init(&job_mgr->job_sem, 0);
   mm_jpeg_queue_init(&job_mgr->job_queue);
+  pthread_mutex_init(&job_mgr->slot_lock, NULL);
+  pthread_cond_init(&job_mgr->slot_cond, NULL);
+  job_mgr->slot_gen = 0;
+  pthread_cond_init(&job_mgr->dispatch_cond, NULL);
+  pthread_mutex_init(&job_mgr->stats_lock, NULL);
+  memset(job_mgr->stats, 0, sizeof(job_mgr->stats));
+
+  /* launch one dispatcher per concurrent job */
+  job_mgr->num_threads = 0;
+  for (i = 0; i < job_mgr->max_ongoing_jobs; i++) {
+    if (pthread_create(&job_mgr->pid[i],
+      NULL,
+      mm_jpeg_jobmgr_thread,
+      (void *)my_obj) != 0) {
+      CDBG_ERROR("%s:%d] failed to create dispatcher %d", __func__,
+        __LINE__, i);
+      break;
+    }
+    job_mgr->num_threads++;
+  }
+  CDBG_HIGH("%s:%d] max concurrent jobs %d dispatchers %d", __func__,
+    __LINE__, job_mgr->max_ongoing_jobs, job_mgr->num_threads);
 
-  /* launch the thread */
-  pthread_create(&job_mgr->pid,
-    NULL,
-    mm_jpeg_jobmgr_thread,
-    (void *)my_obj);
+  if (0 == job_mgr->num_threads) {
+    rc = -1;
+  }
   return rc;
 }
 
@@ -1703,37 +2638,419 @@ int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
  *       0 for success else failure
  *
  *  Description:
- *       Releases the job manager thread
+ *       Releases the job manager dispatcher threads
  *
  **/
 int32_t mm_jpeg_jobmgr_thread_release(mm_jpeg_obj * my_obj)
 {
   int32_t rc = 0;
+  uint32_t i;
   mm_jpeg_job_cmd_thread_t * cmd_thread = &my_obj->job_mgr;
-  mm_jpeg_job_q_node_t* node =
-    (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
-  if (NULL == node) {
-    CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
-    return -1;
-  }
+  mm_jpeg_job_q_node_t* node = NULL;
 
-  memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
-  node->type = MM_JPEG_CMD_TYPE_EXIT;
+  /* one exit command per dispatcher */
+  for (i = 0; i < cmd_thread->num_threads; i++) {
+    node = (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
+    if (NULL == node) {
+      CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
+      return -1;
+    }
 
-  mm_jpeg_queue_enq(&cmd_thread->job_queue, node);
-  cam_sem_post(&cmd_thread->job_sem);
+    memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
+    node->type = MM_JPEG_CMD_TYPE_EXIT;
+    mm_jpeg_jobmgr_enqueue(my_obj, node);
+  }
+  /* dispatchers waiting for a free slot pick up the exit command */
+  mm_jpeg_jobmgr_release_slot(my_obj);
 
-  /* wait until cmd thread exits */
-  if (pthread_join(cmd_thread->pid, NULL) != 0) {
-    CDBG("%s: pthread dead already", __func__);
+  /* wait until cmd threads exit */
+  for (i = 0; i < cmd_thread->num_threads; i++) {
+    if (pthread_join(cmd_thread->pid[i], NULL) != 0) {
+      CDBG("%s: pthread dead already", __func__);
+    }
   }
   mm_jpeg_queue_deinit(&cmd_thread->job_queue);
 
+  mm_jpeg_jobmgr_dump_stats(my_obj);
+
   cam_sem_destroy(&cmd_thread->job_sem);
+  pthread_mutex_destroy(&cmd_thread->slot_lock);
+  pthread_cond_destroy(&cmd_thread->slot_cond);
+  pthread_cond_destroy(&cmd_thread->dispatch_cond);
+  pthread_mutex_destroy(&cmd_thread->stats_lock);
   memset(cmd_thread, 0, sizeof(mm_jpeg_job_cmd_thread_t));
   return rc;
 }
 
+/* names of mm_jpeg_pool_result_t for the logs */
+static const char *mm_jpeg_pool_result_name[MM_JPEG_POOL_RESULT_MAX] = {
+  "miss",
+  "hit",
+};
+
+/** mm_jpeg_session_pool_key_match:
+ *
+ *  Arguments:
+ *    @p_a: params of the parked handle
+ *    @p_b: params of the new session
+ *
+ *  Return:
+ *       OMX_TRUE if the handle can be used by the new session
+ *
+ *  Description:
+ *       Compares the image dimensions, the color formats and the
+ *       thumbnail config, the pool is keyed by them
+ *
+ **/
+static OMX_BOOL mm_jpeg_session_pool_key_match(
+  const mm_jpeg_encode_params_t *p_a,
+  const mm_jpeg_encode_params_t *p_b)
+{
+  if ((p_a->main_dim.src_dim.width != p_b->main_dim.src_dim.width) ||
+    (p_a->main_dim.src_dim.height != p_b->main_dim.src_dim.height) ||
+    (p_a->color_format != p_b->color_format) ||
+    (p_a->encode_thumbnail != p_b->encode_thumbnail)) {
+    return OMX_FALSE;
+  }
+  if (p_a->encode_thumbnail &&
+    ((p_a->thumb_dim.src_dim.width != p_b->thumb_dim.src_dim.width) ||
+    (p_a->thumb_dim.src_dim.height != p_b->thumb_dim.src_dim.height) ||
+    (p_a->thumb_color_format != p_b->thumb_color_format))) {
+    return OMX_FALSE;
+  }
+  return OMX_TRUE;
+}
+
+/** mm_jpeg_session_pool_trim:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @max_entries: num of parked handles to keep
+ *
+ *  Return:
+ *       num of released handles
+ *
+ *  Description:
+ *       Releases the least recently parked handles until at most
+ *       @max_entries are left. The handles are released outside
+ *       the pool lock.
+ *
+ **/
+static uint32_t mm_jpeg_session_pool_trim(mm_jpeg_obj *my_obj,
+  uint32_t max_entries)
+{
+  mm_jpeg_session_pool_t *p_pool = &my_obj->session_pool;
+  mm_jpeg_pool_entry_t entry;
+  uint32_t num_released = 0;
+  uint32_t i, lru;
+  OMX_ERRORTYPE rc;
+
+  while (1) {
+    pthread_mutex_lock(&p_pool->lock);
+    if (p_pool->num_entries <= max_entries) {
+      pthread_mutex_unlock(&p_pool->lock);
+      break;
+    }
+    lru = 0;
+    for (i = 1; i < p_pool->num_entries; i++) {
+      if (p_pool->entry[i].last_use < p_pool->entry[lru].last_use) {
+        lru = i;
+      }
+    }
+    entry = p_pool->entry[lru];
+    p_pool->num_entries--;
+    if (lru != p_pool->num_entries) {
+      p_pool->entry[lru] = p_pool->entry[p_pool->num_entries];
+    }
+    p_pool->stats.num_evictions++;
+    pthread_mutex_unlock(&p_pool->lock);
+
+    /* parked handles are in loaded state, no buffers to free */
+    CDBG("%s:%d] release parked handle %p", __func__, __LINE__,
+      entry.omx_handle);
+    rc = OMX_FreeHandle(entry.omx_handle);
+    if (0 != rc) {
+      CDBG_ERROR("%s:%d] OMX_FreeHandle failed (%d)", __func__, __LINE__, rc);
+    }
+    free(entry.p_omx_ctx);
+    num_released++;
+  }
+
+  return num_released;
+}
+
+/** mm_jpeg_session_pool_put:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session being destroyed
+ *
+ *  Return:
+ *       OMX_TRUE if the pool took the OMX handle of the session
+ *
+ *  Description:
+ *       Parks the OMX handle of an idle session in the pool
+ *       instead of releasing it. Only healthy handles in executing
+ *       state are kept, they are moved to loaded state freeing the
+ *       buffers of the session. The least recently parked handle
+ *       is released if the pool is full.
+ *
+ **/
+static OMX_BOOL mm_jpeg_session_pool_put(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session)
+{
+  mm_jpeg_session_pool_t *p_pool = &my_obj->session_pool;
+  mm_jpeg_pool_entry_t *p_entry;
+  OMX_STATETYPE state;
+  OMX_BOOL idle;
+
+  if ((0 == p_pool->max_entries) || (OMX_FALSE == p_session->config) ||
+    (NULL == p_session->p_omx_ctx) || (NULL != p_session->meta_enc_key)) {
+    return OMX_FALSE;
+  }
+
+  pthread_mutex_lock(&p_session->lock);
+  idle = (OMX_ErrorNone == p_session->error_flag) &&
+    (OMX_FALSE == p_session->encoding) &&
+    (OMX_FALSE == p_session->state_change_pending);
+  pthread_mutex_unlock(&p_session->lock);
+  if (OMX_FALSE == idle) {
+    return OMX_FALSE;
+  }
+
+  if ((OMX_ErrorNone != OMX_GetState(p_session->omx_handle, &state)) ||
+    (OMX_StateExecuting != state)) {
+    return OMX_FALSE;
+  }
+
+  /* the buffers are registered again by the next session, the
+   * camera may reuse their fd numbers and mappings for new buffers */
+  if ((OMX_ErrorNone != mm_jpeg_session_change_state(p_session,
+      OMX_StateIdle, NULL)) ||
+    (OMX_ErrorNone != mm_jpeg_session_change_state(p_session,
+      OMX_StateLoaded, mm_jpeg_session_free_buffers))) {
+    CDBG_ERROR("%s:%d] cannot park handle %p", __func__, __LINE__,
+      p_session->omx_handle);
+    return OMX_FALSE;
+  }
+
+  mm_jpeg_session_pool_trim(my_obj, p_pool->max_entries - 1);
+
+  pthread_mutex_lock(&p_pool->lock);
+  if (p_pool->num_entries >= p_pool->max_entries) {
+    pthread_mutex_unlock(&p_pool->lock);
+    return OMX_FALSE;
+  }
+  p_entry = &p_pool->entry[p_pool->num_entries++];
+  p_entry->omx_handle = p_session->omx_handle;
+  p_entry->p_omx_ctx = p_session->p_omx_ctx;
+  p_entry->params = p_session->params;
+  p_entry->last_use = ++p_pool->seq;
+  p_entry->p_omx_ctx->p_session = NULL;
+  CDBG("%s:%d] parked handle %p, %d parked", __func__, __LINE__,
+    p_entry->omx_handle, p_pool->num_entries);
+  pthread_mutex_unlock(&p_pool->lock);
+
+  return OMX_TRUE;
+}
+
+/** mm_jpeg_session_pool_get:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: new session, params already set
+ *
+ *  Return:
+ *       MM_JPEG_POOL_HIT if the session got a parked handle, it is
+ *         in loaded state and has to be configured
+ *       MM_JPEG_POOL_MISS if no handle matched
+ *
+ *  Description:
+ *       Hands the most recently parked OMX handle with a matching
+ *       key over to a new session. The buffers of the session are
+ *       always registered again, a matching fd or address does not
+ *       mean it is the same buffer.
+ *
+ **/
+static mm_jpeg_pool_result_t mm_jpeg_session_pool_get(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session)
+{
+  mm_jpeg_session_pool_t *p_pool = &my_obj->session_pool;
+  mm_jpeg_pool_entry_t *p_entry;
+  int found = -1;
+  uint32_t i;
+
+  if ((0 == p_pool->max_entries) || (NULL != p_session->meta_enc_key)) {
+    return MM_JPEG_POOL_MISS;
+  }
+
+  pthread_mutex_lock(&p_pool->lock);
+  for (i = 0; i < p_pool->num_entries; i++) {
+    p_entry = &p_pool->entry[i];
+    if (!mm_jpeg_session_pool_key_match(&p_entry->params,
+      &p_session->params)) {
+      continue;
+    }
+    if ((found < 0) ||
+      (p_entry->last_use > p_pool->entry[found].last_use)) {
+      found = i;
+    }
+  }
+  if (found < 0) {
+    pthread_mutex_unlock(&p_pool->lock);
+    return MM_JPEG_POOL_MISS;
+  }
+
+  p_entry = &p_pool->entry[found];
+  p_session->omx_handle = p_entry->omx_handle;
+  p_session->p_omx_ctx = p_entry->p_omx_ctx;
+  p_pool->num_entries--;
+  if ((uint32_t)found != p_pool->num_entries) {
+    *p_entry = p_pool->entry[p_pool->num_entries];
+  }
+  p_session->p_omx_ctx->p_session = p_session;
+  pthread_mutex_unlock(&p_pool->lock);
+
+  CDBG("%s:%d] pool hit handle %p", __func__, __LINE__,
+    p_session->omx_handle);
+
+  return MM_JPEG_POOL_HIT;
+}
+
+/** mm_jpeg_session_pool_setup_done:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session whose OMX handle is ready
+ *    @p_start: time the handle setup started
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Accounts the handle setup time of the session
+ *
+ **/
+static void mm_jpeg_session_pool_setup_done(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, struct timespec *p_start)
+{
+  mm_jpeg_pool_stats_t *p_stats = &my_obj->session_pool.stats;
+  mm_jpeg_pool_result_t result = p_session->pool_result;
+  struct timespec now;
+  uint64_t setup_us;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  setup_us = mm_jpeg_time_diff_us(p_start, &now);
+
+  pthread_mutex_lock(&my_obj->session_pool.lock);
+  p_stats->num_setups[result]++;
+  p_stats->total_setup_us[result] += setup_us;
+  if (setup_us > p_stats->max_setup_us[result]) {
+    p_stats->max_setup_us[result] = setup_us;
+  }
+  pthread_mutex_unlock(&my_obj->session_pool.lock);
+
+  CDBG_HIGH("%s:%d] session %x pool %s setup %llu us", __func__, __LINE__,
+    p_session->sessionId, mm_jpeg_pool_result_name[result],
+    (unsigned long long)setup_us);
+}
+
+/** mm_jpeg_session_pool_dump_stats:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Logs the hit rate and the handle setup time of the pool
+ *
+ **/
+static void mm_jpeg_session_pool_dump_stats(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_pool_stats_t *p_stats = &my_obj->session_pool.stats;
+  uint32_t num_setups = 0;
+  int i;
+
+  pthread_mutex_lock(&my_obj->session_pool.lock);
+  for (i = 0; i < MM_JPEG_POOL_RESULT_MAX; i++) {
+    num_setups += p_stats->num_setups[i];
+    if (0 == p_stats->num_setups[i]) {
+      continue;
+    }
+    CDBG_HIGH("%s:%d] %s setups %u avg %llu max %llu us", __func__, __LINE__,
+      mm_jpeg_pool_result_name[i], p_stats->num_setups[i],
+      (unsigned long long)(p_stats->total_setup_us[i] /
+        p_stats->num_setups[i]),
+      (unsigned long long)p_stats->max_setup_us[i]);
+  }
+  if (num_setups) {
+    CDBG_HIGH("%s:%d] pool hit rate %u%% (%u of %u) evictions %u",
+      __func__, __LINE__,
+      p_stats->num_setups[MM_JPEG_POOL_HIT] * 100 / num_setups,
+      p_stats->num_setups[MM_JPEG_POOL_HIT],
+      num_setups, p_stats->num_evictions);
+  }
+  pthread_mutex_unlock(&my_obj->session_pool.lock);
+}
+
+/** mm_jpeg_session_pool_init:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Initializes the session pool. Its size defaults to the
+ *       num of OMX sessions of a burst session and can be set
+ *       through persist.camera.jpeg.session_pool, 0 disables it.
+ *
+ **/
+static void mm_jpeg_session_pool_init(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_session_pool_t *p_pool = &my_obj->session_pool;
+  char prop[PROPERTY_VALUE_MAX];
+  int size;
+
+  memset(p_pool, 0, sizeof(*p_pool));
+  pthread_mutex_init(&p_pool->lock, NULL);
+
+  property_get("persist.camera.jpeg.session_pool", prop, "-1");
+  size = atoi(prop);
+  if (size < 0) {
+    size = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
+  }
+  if (size > MM_JPEG_SESSION_POOL_MAX) {
+    size = MM_JPEG_SESSION_POOL_MAX;
+  }
+  p_pool->max_entries = (uint32_t)size;
+  CDBG_HIGH("%s:%d] session pool size %d", __func__, __LINE__, size);
+}
+
+/** mm_jpeg_session_pool_deinit:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Releases the parked handles, must be called before
+ *       OMX_Deinit
+ *
+ **/
+static void mm_jpeg_session_pool_deinit(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_session_pool_trim(my_obj, 0);
+  mm_jpeg_session_pool_dump_stats(my_obj);
+  my_obj->session_pool.max_entries = 0;
+  pthread_mutex_destroy(&my_obj->session_pool.lock);
+}
+
 /** mm_jpeg_init:
  *
  *  Arguments:
@@ -1764,11 +3081,14 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
   }
 
 
+  mm_jpeg_swenc_backend_init(my_obj);
+
   /* init job semaphore and launch jobmgr thread */
   CDBG("%s:%d] Launch jobmgr thread rc %d", __func__, __LINE__, rc);
   rc = mm_jpeg_jobmgr_thread_launch(my_obj);
   if (0 != rc) {
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    mm_jpeg_swenc_backend_deinit(my_obj);
     return -1;
   }
 
@@ -1791,6 +3111,7 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
         buffer_deallocate(&my_obj->ionBuffer[i]);
       }
       mm_jpeg_jobmgr_thread_release(my_obj);
+      mm_jpeg_swenc_backend_deinit(my_obj);
       mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
       pthread_mutex_destroy(&my_obj->job_lock);
       CDBG_ERROR("%s:%d] Ion allocation failed",__func__, __LINE__);
@@ -1800,14 +3121,18 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
 
   my_obj->work_buf_cnt = i;
 
+  mm_jpeg_session_pool_init(my_obj);
+
   /* load OMX */
   if (OMX_ErrorNone != OMX_Init()) {
     /* roll back in error case */
     CDBG_ERROR("%s:%d] OMX_Init failed (%d)", __func__, __LINE__, rc);
+    mm_jpeg_session_pool_deinit(my_obj);
     for (i = 0; i < initial_workbufs_cnt; i++) {
       buffer_deallocate(&my_obj->ionBuffer[i]);
     }
     mm_jpeg_jobmgr_thread_release(my_obj);
+    mm_jpeg_swenc_backend_deinit(my_obj);
     mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
     pthread_mutex_destroy(&my_obj->job_lock);
   }
@@ -1847,6 +3172,11 @@ int32_t mm_jpeg_deinit(mm_jpeg_obj *my_obj)
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
   }
 
+  mm_jpeg_swenc_backend_deinit(my_obj);
+
+  /* parked handles have to go before the OMX core */
+  mm_jpeg_session_pool_deinit(my_obj);
+
   /* unload OMX engine */
   OMX_Deinit();
 
@@ -1990,13 +3320,9 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
   node->enc_info.job_id = *job_id;
   node->enc_info.client_handle = p_session->client_hdl;
   node->type = MM_JPEG_CMD_TYPE_JOB;
+  node->prio = job->encode_job.prio;
 
-
-
-  rc = mm_jpeg_queue_enq(&my_obj->job_mgr.job_queue, node);
-  if (0 == rc) {
-      cam_sem_post(&my_obj->job_mgr.job_sem);
-  }
+  rc = mm_jpeg_jobmgr_enqueue(my_obj, node);
 
   CDBG_ERROR("%s:%d] X", __func__, __LINE__);
 
@@ -2044,7 +3370,11 @@ int32_t mm_jpeg_abort_job(mm_jpeg_obj *my_obj,
     /* find job that is OMX ongoing, ask OMX to abort the job */
     p_session = mm_jpeg_get_session(my_obj, node->enc_info.job_id);
     if (p_session) {
-      mm_jpeg_session_abort(p_session);
+      mm_jpeg_jobmgr_wait_dispatch(my_obj, p_session);
+      /* a software job is complete once the dispatch is over */
+      if (!node->sw_backend) {
+        mm_jpeg_session_abort(p_session);
+      }
     } else {
       CDBG_ERROR("%s:%d] Invalid job id 0x%x", __func__, __LINE__,
         node->enc_info.job_id);
@@ -2055,6 +3385,7 @@ int32_t mm_jpeg_abort_job(mm_jpeg_obj *my_obj,
 
 abort_done:
   pthread_mutex_unlock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_release_slot(my_obj);
 
   return rc;
 }
@@ -2122,6 +3453,7 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   uint32_t work_buf_size;
   mm_jpeg_queue_t *p_session_handle_q, *p_out_buf_q;
   unsigned int work_bufs_need;
+  struct timespec setup_start;
 
   /* validate the parameters */
   if ((p_params->num_src_bufs > MM_JPEG_MAX_BUF)
@@ -2217,6 +3549,17 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
 
     p_session->jpeg_obj = (void*)my_obj; /* save a ptr to jpeg_obj */
 
+    /* the session pool matches parked handles against the params */
+    p_session->params = *p_params;
+
+    p_session->meta_enc_key = NULL;
+    p_session->meta_enc_keylen = 0;
+
+#ifdef MM_JPEG_READ_META_KEYFILE
+    mm_jpeg_read_meta_keyfile(p_session, META_KEYFILE);
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &setup_start);
     ret = mm_jpeg_session_create(p_session);
     if (OMX_ErrorNone != ret) {
       p_session->active = OMX_FALSE;
@@ -2230,8 +3573,6 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
       *p_session_id = session_id;
     }
 
-    /*copy the params*/
-    p_session->params = *p_params;
     p_session->client_hdl = client_hdl;
     p_session->sessionId = session_id;
     p_session->session_handle_q = p_session_handle_q;
@@ -2239,13 +3580,6 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
 
     mm_jpeg_queue_enq(p_session_handle_q, p_session);
 
-    p_session->meta_enc_key = NULL;
-    p_session->meta_enc_keylen = 0;
-
-#ifdef MM_JPEG_READ_META_KEYFILE
-    mm_jpeg_read_meta_keyfile(p_session, META_KEYFILE);
-#endif
-
     if (OMX_FALSE == p_session->config) {
       rc = mm_jpeg_session_configure(p_session);
       if (rc) {
@@ -2254,6 +3588,7 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
       }
       p_session->config = OMX_TRUE;
     }
+    mm_jpeg_session_pool_setup_done(my_obj, p_session, &setup_start);
     p_session->num_omx_sessions = num_omx_sessions;
 
     CDBG("%s:%d] session id %x", __func__, __LINE__, session_id);
@@ -2282,20 +3617,19 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
 static int32_t mm_jpegenc_destroy_job(mm_jpeg_job_session_t *p_session)
 {
   mm_jpeg_encode_job_t *p_jobparams = &p_session->encode_job;
-  int i = 0, rc = 0;
 
-  CDBG_HIGH("%s:%d] Exif entry count %d %d", __func__, __LINE__,
+  CDBG_HIGH("%s:%d] Exif entry count %d %d arena allocs %d high water %d",
+    __func__, __LINE__,
     (int)p_jobparams->exif_info.numOfEntries,
-    (int)p_session->exif_count_local);
-  for (i = 0; i < p_session->exif_count_local; i++) {
-    rc = releaseExifEntry(&p_session->exif_info_local[i]);
-    if (rc) {
-      CDBG_ERROR("%s:%d] Exif release failed (%d)", __func__, __LINE__, rc);
-    }
-  }
+    (int)p_session->exif_count_local,
+    (int)p_session->exif_arena.num_allocs,
+    (int)p_session->exif_arena.high_water);
+
+  /* the tags only point into the arena, drop them all at once */
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   p_session->exif_count_local = 0;
 
-  return rc;
+  return 0;
 }
 
 /** mm_jpeg_session_encode:
@@ -2322,6 +3656,7 @@ static void mm_jpegenc_job_done(mm_jpeg_job_session_t *p_session)
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
     p_session->jobId);
   if (node) {
+    mm_jpeg_jobmgr_job_stats(my_obj, node);
     free(node);
   }
   p_session->encoding = OMX_FALSE;
@@ -2335,7 +3670,7 @@ static void mm_jpegenc_job_done(mm_jpeg_job_session_t *p_session)
   }
 
   /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
+  mm_jpeg_jobmgr_release_slot(my_obj);
 }
 
 /** mm_jpeg_destroy_session:
@@ -2370,6 +3705,12 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
 
   pthread_mutex_lock(&my_obj->job_lock);
 
+  /* let the dispatchers programming this session finish first */
+  p_cur_sess = p_session;
+  do {
+    mm_jpeg_jobmgr_wait_dispatch(my_obj, p_cur_sess);
+  } while (NULL != (p_cur_sess = p_cur_sess->next_session));
+
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
   node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.job_queue, session_id);
@@ -2413,7 +3754,7 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
 
 
   /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
+  mm_jpeg_jobmgr_release_slot(my_obj);
 
   CDBG("%s:%d] X", __func__, __LINE__);
 
@@ -2452,6 +3793,8 @@ int32_t mm_jpeg_destroy_session_unlocked(mm_jpeg_obj *my_obj,
 
   session_id = p_session->sessionId;
 
+  mm_jpeg_jobmgr_wait_dispatch(my_obj, p_session);
+
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
   node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.job_queue, session_id);
@@ -2548,6 +3891,7 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
 #endif
 
   pthread_mutex_unlock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_release_slot(my_obj);
   CDBG("%s:%d] ", __func__, __LINE__);
 
   /* invalidate client session */
@@ -2564,7 +3908,13 @@ OMX_ERRORTYPE mm_jpeg_ebd(OMX_HANDLETYPE hComponent,
   OMX_BUFFERHEADERTYPE *pBuffer)
 {
   OMX_ERRORTYPE ret = OMX_ErrorNone;
-  mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *) pAppData;
+  mm_jpeg_job_session_t *p_session =
+    ((mm_jpeg_omx_ctx_t *) pAppData)->p_session;
+
+  if (NULL == p_session) {
+    CDBG_ERROR("%s:%d] handle is parked", __func__, __LINE__);
+    return OMX_ErrorNone;
+  }
 
   CDBG("%s:%d] count %d ", __func__, __LINE__, p_session->ebd_count);
   pthread_mutex_lock(&p_session->lock);
@@ -2578,10 +3928,16 @@ OMX_ERRORTYPE mm_jpeg_fbd(OMX_HANDLETYPE hComponent,
   OMX_BUFFERHEADERTYPE *pBuffer)
 {
   OMX_ERRORTYPE ret = OMX_ErrorNone;
-  mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *) pAppData;
+  mm_jpeg_job_session_t *p_session =
+    ((mm_jpeg_omx_ctx_t *) pAppData)->p_session;
   uint32_t i = 0;
   int rc = 0;
   mm_jpeg_output_t output_buf;
+
+  if (NULL == p_session) {
+    CDBG_ERROR("%s:%d] handle is parked", __func__, __LINE__);
+    return OMX_ErrorNone;
+  }
   CDBG("%s:%d] count %d ", __func__, __LINE__, p_session->fbd_count);
   CDBG_HIGH("[KPI Perf] : PROFILE_JPEG_FBD");
 
@@ -2625,7 +3981,14 @@ OMX_ERRORTYPE mm_jpeg_event_handler(OMX_HANDLETYPE hComponent,
   OMX_U32 nData2,
   OMX_PTR pEventData)
 {
-  mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *) pAppData;
+  mm_jpeg_job_session_t *p_session =
+    ((mm_jpeg_omx_ctx_t *) pAppData)->p_session;
+
+  if (NULL == p_session) {
+    CDBG_ERROR("%s:%d] event %d on a parked handle", __func__, __LINE__,
+      eEvent);
+    return OMX_ErrorNone;
+  }
 
   CDBG("%s:%d] %d %d %d state %d", __func__, __LINE__, eEvent, (int)nData1,
     (int)nData2, p_session->abort_state);
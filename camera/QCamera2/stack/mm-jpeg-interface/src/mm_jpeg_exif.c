@@ -41,248 +41,12 @@
 #define ROUND(a)((a >= 0) ? (long)(a + 0.5) : (long)(a - 0.5))
 
 
-/** addExifEntry:
- *
- *  Arguments:
- *   @exif_info : Exif info struct
- *   @p_session: job session
- *   @tagid   : exif tag ID
- *   @type    : data type
- *   @count   : number of data in uint of its type
- *   @data    : input data ptr
- *
- *  Retrun     : int32_t type of status
- *               0  -- success
- *              none-zero failure code
- *
- *  Description:
- *       Function to add an entry to exif data
- *
- **/
-int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
-  exif_tag_type_t type, uint32_t count, void *data)
-{
-    int32_t rc = 0;
-    int32_t numOfEntries = p_exif_info->numOfEntries;
-    QEXIF_INFO_DATA *p_info_data = p_exif_info->exif_data;
-    if(numOfEntries >= MAX_EXIF_TABLE_ENTRIES) {
-        ALOGE("%s: Number of entries exceeded limit", __func__);
-        return -1;
-    }
-
-    p_info_data[numOfEntries].tag_id = tagid;
-    p_info_data[numOfEntries].tag_entry.type = type;
-    p_info_data[numOfEntries].tag_entry.count = count;
-    p_info_data[numOfEntries].tag_entry.copy = 1;
-    switch (type) {
-    case EXIF_BYTE: {
-      if (count > 1) {
-        uint8_t *values = (uint8_t *)malloc(count);
-        if (values == NULL) {
-          ALOGE("%s: No memory for byte array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count);
-          p_info_data[numOfEntries].tag_entry.data._bytes = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._byte = *(uint8_t *)data;
-      }
-    }
-    break;
-    case EXIF_ASCII: {
-      char *str = NULL;
-      str = (char *)malloc(count + 1);
-      if (str == NULL) {
-        ALOGE("%s: No memory for ascii string", __func__);
-        rc = -1;
-      } else {
-        memset(str, 0, count + 1);
-        memcpy(str, data, count);
-        p_info_data[numOfEntries].tag_entry.data._ascii = str;
-      }
-    }
-    break;
-    case EXIF_SHORT: {
-      if (count > 1) {
-        uint16_t *values = (uint16_t *)malloc(count * sizeof(uint16_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for short array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(uint16_t));
-          p_info_data[numOfEntries].tag_entry.data._shorts = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._short = *(uint16_t *)data;
-      }
-    }
-    break;
-    case EXIF_LONG: {
-      if (count > 1) {
-        uint32_t *values = (uint32_t *)malloc(count * sizeof(uint32_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for long array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(uint32_t));
-          p_info_data[numOfEntries].tag_entry.data._longs = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._long = *(uint32_t *)data;
-      }
-    }
-    break;
-    case EXIF_RATIONAL: {
-      if (count > 1) {
-        rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for rational array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(rat_t));
-          p_info_data[numOfEntries].tag_entry.data._rats = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._rat = *(rat_t *)data;
-      }
-    }
-    break;
-    case EXIF_UNDEFINED: {
-      uint8_t *values = (uint8_t *)malloc(count);
-      if (values == NULL) {
-        ALOGE("%s: No memory for undefined array", __func__);
-        rc = -1;
-      } else {
-        memcpy(values, data, count);
-        p_info_data[numOfEntries].tag_entry.data._undefined = values;
-      }
-    }
-    break;
-    case EXIF_SLONG: {
-      if (count > 1) {
-        int32_t *values = (int32_t *)malloc(count * sizeof(int32_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for signed long array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(int32_t));
-          p_info_data[numOfEntries].tag_entry.data._slongs = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._slong = *(int32_t *)data;
-      }
-    }
-    break;
-    case EXIF_SRATIONAL: {
-      if (count > 1) {
-        srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for signed rational array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(srat_t));
-          p_info_data[numOfEntries].tag_entry.data._srats = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._srat = *(srat_t *)data;
-      }
-    }
-    break;
-    }
-
-    // Increase number of entries
-    p_exif_info->numOfEntries++;
-    return rc;
-}
-
-/** releaseExifEntry
- *
- *  Arguments:
- *   @p_exif_data : Exif info struct
- *
- *  Retrun     : int32_t type of status
- *               0  -- success
- *              none-zero failure code
- *
- *  Description:
- *       Function to release an entry from exif data
- *
- **/
-int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data)
-{
- switch (p_exif_data->tag_entry.type) {
-  case EXIF_BYTE: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._bytes != NULL) {
-      free(p_exif_data->tag_entry.data._bytes);
-      p_exif_data->tag_entry.data._bytes = NULL;
-    }
-  }
-  break;
-  case EXIF_ASCII: {
-    if (p_exif_data->tag_entry.data._ascii != NULL) {
-      free(p_exif_data->tag_entry.data._ascii);
-      p_exif_data->tag_entry.data._ascii = NULL;
-    }
-  }
-  break;
-  case EXIF_SHORT: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._shorts != NULL) {
-      free(p_exif_data->tag_entry.data._shorts);
-      p_exif_data->tag_entry.data._shorts = NULL;
-    }
-  }
-  break;
-  case EXIF_LONG: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._longs != NULL) {
-      free(p_exif_data->tag_entry.data._longs);
-      p_exif_data->tag_entry.data._longs = NULL;
-    }
-  }
-  break;
-  case EXIF_RATIONAL: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._rats != NULL) {
-      free(p_exif_data->tag_entry.data._rats);
-      p_exif_data->tag_entry.data._rats = NULL;
-    }
-  }
-  break;
-  case EXIF_UNDEFINED: {
-    if (p_exif_data->tag_entry.data._undefined != NULL) {
-      free(p_exif_data->tag_entry.data._undefined);
-      p_exif_data->tag_entry.data._undefined = NULL;
-    }
-  }
-  break;
-  case EXIF_SLONG: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._slongs != NULL) {
-      free(p_exif_data->tag_entry.data._slongs);
-      p_exif_data->tag_entry.data._slongs = NULL;
-    }
-  }
-  break;
-  case EXIF_SRATIONAL: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._srats != NULL) {
-      free(p_exif_data->tag_entry.data._srats);
-      p_exif_data->tag_entry.data._srats = NULL;
-    }
-  }
-  break;
-  } /*end of switch*/
-
-  return 0;
-}
-
 /** process_sensor_data:
  *
  *  Arguments:
  *   @p_sensor_params : ptr to sensor data
+ *   @exif_info : Exif info struct
+ *   @p_arena : arena holding the tag payloads
  *
  *  Return     : int32_t type of status
  *               NO_ERROR  -- success
@@ -294,7 +58,7 @@ int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data)
  *  Notes: this needs to be filled for the metadata
  **/
 int process_sensor_data(cam_sensor_params_t *p_sensor_params,
-  QOMX_EXIF_INFO *exif_info)
+  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_arena_t *p_arena)
 {
   int rc = 0;
   rat_t val_rat;
@@ -311,14 +75,14 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
   if (p_sensor_params->aperture_value >= 1.0) {
     val_rat.num = (uint32_t)(p_sensor_params->aperture_value * 100);
     val_rat.denom = 100;
-    rc = addExifEntry(exif_info, EXIFTAGID_APERTURE, EXIF_RATIONAL, 1, &val_rat);
+    rc = addExifEntry(exif_info, p_arena, EXIFTAGID_APERTURE, EXIF_RATIONAL, 1, &val_rat);
     if (rc) {
       ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
     }
 
     val_rat.num = (uint32_t)(p_sensor_params->aperture_value * 100);
     val_rat.denom = 100;
-    rc = addExifEntry(exif_info, EXIFTAGID_F_NUMBER, EXIF_RATIONAL, 1, &val_rat);
+    rc = addExifEntry(exif_info, p_arena, EXIFTAGID_F_NUMBER, EXIF_RATIONAL, 1, &val_rat);
     if (rc) {
       ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
     }
@@ -333,13 +97,13 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
   }
   CDBG_HIGH("%s: Flash value %d flash mode %d flash state %d", __func__, val_short,
     p_sensor_params->flash_mode, p_sensor_params->flash_state);
-  rc = addExifEntry(exif_info, EXIFTAGID_FLASH, EXIF_SHORT, 1, &val_short);
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_FLASH, EXIF_SHORT, 1, &val_short);
   if (rc) {
     ALOGE("%s %d]: Error adding flash exif entry", __func__, __LINE__);
   }
   /* Sensing Method */
   val_short = p_sensor_params->sensing_method;
-  rc = addExifEntry(exif_info, EXIFTAGID_SENSING_METHOD, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SENSING_METHOD, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding flash Exif Entry", __func__, __LINE__);
@@ -347,7 +111,7 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
 
   /*Focal Length in 35 MM Film */
   val_short = (short) p_sensor_params->focal_length*p_sensor_params->crop_factor;
-  rc = addExifEntry(exif_info, EXIFTAGID_FOCAL_LENGTH_35MM, EXIF_SHORT, 1, &val_short);
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_FOCAL_LENGTH_35MM, EXIF_SHORT, 1, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
   }
@@ -360,6 +124,8 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
  *
  *  Arguments:
  *   @p_3a_params : ptr to 3a data
+ *   @exif_info : Exif info struct
+ *   @p_arena : arena holding the tag payloads
  *
  *  Return     : int32_t type of status
  *               NO_ERROR  -- success
@@ -370,7 +136,8 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
  *
  *  Notes: this needs to be filled for the metadata
  **/
-int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
+int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info,
+  mm_jpeg_exif_arena_t *p_arena)
 {
   int rc = 0;
   srat_t val_srat;
@@ -395,7 +162,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
   }
   CDBG_HIGH("%s: numer %d denom %d %d", __func__, val_rat.num, val_rat.denom, sizeof(val_rat)/(8));
 
-  rc = addExifEntry(exif_info, EXIFTAGID_EXPOSURE_TIME, EXIF_RATIONAL,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_EXPOSURE_TIME, EXIF_RATIONAL,
     (sizeof(val_rat)/(8)), &val_rat);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry Exposure time",
@@ -411,7 +178,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     val_srat.num = 0;
     val_srat.denom = 0;
   }
-  rc = addExifEntry(exif_info, EXIFTAGID_SHUTTER_SPEED, EXIF_SRATIONAL,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SHUTTER_SPEED, EXIF_SRATIONAL,
     (sizeof(val_srat)/(8)), &val_srat);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -420,7 +187,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
   /*ISO*/
   short val_short;
   val_short = p_3a_params->iso_value;
-  rc = addExifEntry(exif_info, EXIFTAGID_ISO_SPEED_RATING, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_ISO_SPEED_RATING, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -431,7 +198,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     val_short = 0;
   else
     val_short = 1;
-  rc = addExifEntry(exif_info, EXIFTAGID_WHITE_BALANCE, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_WHITE_BALANCE, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -439,7 +206,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
 
   /* Metering Mode   */
   val_short = (unsigned short) p_3a_params->metering_mode;
-  rc = addExifEntry(exif_info,EXIFTAGID_METERING_MODE, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_METERING_MODE, EXIF_SHORT,
      sizeof(val_short)/2, &val_short);
   if (rc) {
      ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -447,7 +214,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
 
   /*Exposure Program*/
    val_short = (unsigned short) p_3a_params->exposure_program;
-   rc = addExifEntry(exif_info,EXIFTAGID_EXPOSURE_PROGRAM, EXIF_SHORT,
+   rc = addExifEntry(exif_info, p_arena, EXIFTAGID_EXPOSURE_PROGRAM, EXIF_SHORT,
       sizeof(val_short)/2, &val_short);
    if (rc) {
       ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -455,7 +222,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
 
    /*Exposure Mode */
     val_short = (unsigned short) p_3a_params->exposure_mode;
-    rc = addExifEntry(exif_info,EXIFTAGID_EXPOSURE_MODE, EXIF_SHORT,
+    rc = addExifEntry(exif_info, p_arena, EXIFTAGID_EXPOSURE_MODE, EXIF_SHORT,
        sizeof(val_short)/2, &val_short);
     if (rc) {
        ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -464,7 +231,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     /*Scenetype*/
      uint8_t val_undef;
      val_undef = (uint8_t) p_3a_params->scenetype;
-     rc = addExifEntry(exif_info,EXIFTAGID_SCENE_TYPE, EXIF_UNDEFINED,
+     rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SCENE_TYPE, EXIF_UNDEFINED,
         sizeof(val_undef), &val_undef);
      if (rc) {
         ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -473,7 +240,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
     /* Brightness Value*/
      val_srat.num = p_3a_params->brightness*100;
      val_srat.denom = 100;
-     rc = addExifEntry(exif_info,EXIFTAGID_BRIGHTNESS, EXIF_SRATIONAL,
+     rc = addExifEntry(exif_info, p_arena, EXIFTAGID_BRIGHTNESS, EXIF_SRATIONAL,
                  (sizeof(val_srat)/(8)), &val_srat);
      if (rc) {
         ALOGE("%s:%d]: Error adding Exif Entry", __func__, __LINE__);
@@ -487,6 +254,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
  *  Arguments:
  *   @p_meta : ptr to metadata
  *   @exif_info: Exif info struct
+ *   @p_arena: arena holding the tag payloads
  *   @mm_jpeg_exif_params: exif params
  *
  *  Return     : int32_t type of status
@@ -497,7 +265,8 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
  *       Extract exif data from the metadata
  **/
 int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
-  mm_jpeg_exif_params_t *p_cam_exif_params, cam_hal_version_t hal_version)
+  mm_jpeg_exif_arena_t *p_arena, mm_jpeg_exif_params_t *p_cam_exif_params,
+  cam_hal_version_t hal_version)
 {
   int rc = 0;
   cam_sensor_params_t p_sensor_params;
@@ -579,12 +348,12 @@ int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
       ALOGE("%s: Cannot extract flash state value", __func__);
     }
   }
-  rc = process_3a_data(&p_3a_params, exif_info);
+  rc = process_3a_data(&p_3a_params, exif_info, p_arena);
   if (rc) {
     ALOGE("%s %d: Failed to add 3a exif params", __func__, __LINE__);
   }
 
-  rc = process_sensor_data(&p_sensor_params, exif_info);
+  rc = process_sensor_data(&p_sensor_params, exif_info, p_arena);
   if (rc) {
       ALOGE("%s %d: Failed to extract sensor params", __func__, __LINE__);
   }
@@ -594,7 +363,7 @@ int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
   if(scene_cap_type != NULL)
   val_short = (short) *scene_cap_type;
   else val_short = 0;
-  rc = addExifEntry(exif_info, EXIFTAGID_SCENE_CAPTURE_TYPE, EXIF_SHORT,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_SCENE_CAPTURE_TYPE, EXIF_SHORT,
     sizeof(val_short)/2, &val_short);
   if (rc) {
     ALOGE("%s:%d]: Error adding ASD Exif Entry", __func__, __LINE__);
@@ -602,7 +371,7 @@ int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
 
   /* set orientation to ORIENTATION_UNDEFINED */
   int16_t orientation = 0;
-  rc = addExifEntry(exif_info, EXIFTAGID_ORIENTATION,
+  rc = addExifEntry(exif_info, p_arena, EXIFTAGID_ORIENTATION,
                     EXIF_SHORT,
                     1,
                     (void *)&orientation);
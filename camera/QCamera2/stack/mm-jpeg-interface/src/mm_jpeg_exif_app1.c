@@ -0,0 +1,465 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <string.h>
+#include "mm_jpeg_exif_app1.h"
+#include "mm_jpeg_exif_arena.h"
+#include "mm_jpeg_dbg.h"
+
+/* tags of one IFD, job and metadata tables together */
+#define MM_JPEG_EXIF_APP1_MAX_TAGS (2 * MM_JPEG_EXIF_MAX_ENTRIES)
+
+/* APP1 marker, length and the "Exif\0\0" identifier */
+#define MM_JPEG_EXIF_APP1_HDR_SIZE 10
+#define MM_JPEG_EXIF_TIFF_HDR_SIZE 8
+#define MM_JPEG_EXIF_IFD_ENTRY_SIZE 12
+
+typedef enum {
+  MM_JPEG_EXIF_IFD_0,
+  MM_JPEG_EXIF_IFD_EXIF,
+  MM_JPEG_EXIF_IFD_GPS,
+  MM_JPEG_EXIF_IFD_MAX
+} mm_jpeg_exif_ifd_type_t;
+
+/** mm_jpeg_exif_app1_ifd_t:
+ *  @p_tags: tags sorted by tag number
+ *  @num_tags: number of valid entries in @p_tags
+ *  @offset: offset of the IFD from the TIFF header
+ *  @size: size of the IFD including the values not fitting
+ *    into the entries
+ *
+ *  one image file directory of the APP1 segment
+ **/
+typedef struct {
+  const QEXIF_INFO_DATA *p_tags[MM_JPEG_EXIF_APP1_MAX_TAGS];
+  uint32_t num_tags;
+  uint32_t offset;
+  uint32_t size;
+} mm_jpeg_exif_app1_ifd_t;
+
+static inline uint8_t *mm_jpeg_exif_put16(uint8_t *p, uint16_t val)
+{
+  *p++ = (uint8_t)(val >> 8);
+  *p++ = (uint8_t)val;
+  return p;
+}
+
+static inline uint8_t *mm_jpeg_exif_put32(uint8_t *p, uint32_t val)
+{
+  *p++ = (uint8_t)(val >> 24);
+  *p++ = (uint8_t)(val >> 16);
+  *p++ = (uint8_t)(val >> 8);
+  *p++ = (uint8_t)val;
+  return p;
+}
+
+/** mm_jpeg_exif_app1_ifd_of:
+ *
+ *  Arguments:
+ *    @tag_id: exif tag ID
+ *
+ *  Return:
+ *       IFD of the tag, -1 if the tag is not written
+ *
+ *  Description:
+ *       The IFD pointers are generated by the writer. Thumbnail
+ *       and jpeg interchange tags refer to data which is not
+ *       written, they are dropped.
+ *
+ **/
+static int mm_jpeg_exif_app1_ifd_of(exif_tag_id_t tag_id)
+{
+  uint32_t offset = tag_id >> 16;
+
+  switch (offset) {
+  case EXIF_IFD:
+  case GPS_IFD:
+  case INTEROP:
+  case JPEG_INTERCHANGE_FORMAT:
+  case JPEG_INTERCHANGE_FORMAT_LENGTH:
+    return -1;
+  default:
+    break;
+  }
+
+  if (offset < NEW_SUBFILE_TYPE)
+    return MM_JPEG_EXIF_IFD_GPS;
+  if (offset < TN_IMAGE_WIDTH)
+    return MM_JPEG_EXIF_IFD_0;
+  if (offset < EXPOSURE_TIME)
+    return -1;
+  if (offset < EXIF_TAG_MAX_OFFSET)
+    return MM_JPEG_EXIF_IFD_EXIF;
+  return -1;
+}
+
+/** mm_jpeg_exif_app1_elem_size:
+ *
+ *  Arguments:
+ *    @type: exif data type
+ *
+ *  Return:
+ *       size of one element in the file, 0 for unknown types
+ *
+ **/
+static uint32_t mm_jpeg_exif_app1_elem_size(exif_tag_type_t type)
+{
+  switch (type) {
+  case EXIF_BYTE:
+  case EXIF_ASCII:
+  case EXIF_UNDEFINED:
+    return 1;
+  case EXIF_SHORT:
+    return 2;
+  case EXIF_LONG:
+  case EXIF_SLONG:
+    return 4;
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/** mm_jpeg_exif_app1_count:
+ *
+ *  Arguments:
+ *    @p_entry: exif tag
+ *
+ *  Return:
+ *       number of elements written, ascii strings get their
+ *       null terminator if the HAL left it out
+ *
+ **/
+static uint32_t mm_jpeg_exif_app1_count(const exif_tag_entry_t *p_entry)
+{
+  if ((EXIF_ASCII == p_entry->type) && ((0 == p_entry->count) ||
+    (0 != p_entry->data._ascii[p_entry->count - 1]))) {
+    return p_entry->count + 1;
+  }
+  return p_entry->count;
+}
+
+/** mm_jpeg_exif_app1_value_size:
+ *
+ *  Arguments:
+ *    @p_entry: exif tag
+ *
+ *  Return:
+ *       size of the tag value, values up to 4 bytes live in the
+ *       IFD entry itself
+ *
+ **/
+static uint32_t mm_jpeg_exif_app1_value_size(const exif_tag_entry_t *p_entry)
+{
+  return mm_jpeg_exif_app1_elem_size(p_entry->type) *
+    mm_jpeg_exif_app1_count(p_entry);
+}
+
+/** mm_jpeg_exif_app1_add_tag:
+ *
+ *  Arguments:
+ *    @p_ifd: IFD
+ *    @p_tag: tag to add
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Inserts the tag in tag number order. A tag already in the
+ *       IFD is replaced, so that the later table wins.
+ *
+ **/
+static void mm_jpeg_exif_app1_add_tag(mm_jpeg_exif_app1_ifd_t *p_ifd,
+  const QEXIF_INFO_DATA *p_tag)
+{
+  uint16_t id = (uint16_t)(p_tag->tag_id & 0xFFFF);
+  uint32_t i = 0;
+
+  while ((i < p_ifd->num_tags) &&
+    ((uint16_t)(p_ifd->p_tags[i]->tag_id & 0xFFFF) < id)) {
+    i++;
+  }
+  if ((i < p_ifd->num_tags) &&
+    ((uint16_t)(p_ifd->p_tags[i]->tag_id & 0xFFFF) == id)) {
+    p_ifd->p_tags[i] = p_tag;
+    return;
+  }
+  if (p_ifd->num_tags >= MM_JPEG_EXIF_APP1_MAX_TAGS) {
+    CDBG_ERROR("%s:%d] too many exif tags, dropping 0x%x", __func__,
+      __LINE__, p_tag->tag_id);
+    return;
+  }
+  memmove(&p_ifd->p_tags[i + 1], &p_ifd->p_tags[i],
+    (p_ifd->num_tags - i) * sizeof(p_ifd->p_tags[0]));
+  p_ifd->p_tags[i] = p_tag;
+  p_ifd->num_tags++;
+}
+
+/** mm_jpeg_exif_app1_ifd_size:
+ *
+ *  Arguments:
+ *    @p_ifd: IFD
+ *
+ *  Return:
+ *       size of the IFD with its out of line values, each value
+ *       starting on a word boundary
+ *
+ **/
+static uint32_t mm_jpeg_exif_app1_ifd_size(const mm_jpeg_exif_app1_ifd_t *p_ifd)
+{
+  uint32_t size = 2 + p_ifd->num_tags * MM_JPEG_EXIF_IFD_ENTRY_SIZE + 4;
+  uint32_t value_size;
+  uint32_t i;
+
+  for (i = 0; i < p_ifd->num_tags; i++) {
+    value_size = mm_jpeg_exif_app1_value_size(&p_ifd->p_tags[i]->tag_entry);
+    if (value_size > 4) {
+      size += (value_size + 1) & ~1U;
+    }
+  }
+  return size;
+}
+
+/** mm_jpeg_exif_app1_write_value:
+ *
+ *  Arguments:
+ *    @p: output
+ *    @p_entry: exif tag
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Writes the tag value big endian. Single values are stored
+ *       inline in the tag, the others behind the data pointer.
+ *       The output is expected to be zeroed, which also provides
+ *       a missing ascii terminator.
+ *
+ **/
+static void mm_jpeg_exif_app1_write_value(uint8_t *p,
+  const exif_tag_entry_t *p_entry)
+{
+  const void *p_values = &p_entry->data;
+  uint32_t i;
+
+  if ((EXIF_ASCII == p_entry->type) || (EXIF_UNDEFINED == p_entry->type) ||
+    (p_entry->count > 1)) {
+    p_values = p_entry->data._bytes;
+  }
+
+  switch (p_entry->type) {
+  case EXIF_BYTE:
+  case EXIF_ASCII:
+  case EXIF_UNDEFINED:
+    memcpy(p, p_values, p_entry->count);
+    break;
+  case EXIF_SHORT:
+    for (i = 0; i < p_entry->count; i++)
+      p = mm_jpeg_exif_put16(p, ((const uint16_t *)p_values)[i]);
+    break;
+  case EXIF_LONG:
+  case EXIF_SLONG:
+    for (i = 0; i < p_entry->count; i++)
+      p = mm_jpeg_exif_put32(p, ((const uint32_t *)p_values)[i]);
+    break;
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    for (i = 0; i < p_entry->count; i++) {
+      p = mm_jpeg_exif_put32(p, ((const rat_t *)p_values)[i].num);
+      p = mm_jpeg_exif_put32(p, ((const rat_t *)p_values)[i].denom);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/** mm_jpeg_exif_app1_write_ifd:
+ *
+ *  Arguments:
+ *    @p_tiff: TIFF header
+ *    @p_ifd: IFD
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Writes the IFD at its offset followed by the values not
+ *       fitting into the entries. There is no next IFD.
+ *
+ **/
+static void mm_jpeg_exif_app1_write_ifd(uint8_t *p_tiff,
+  const mm_jpeg_exif_app1_ifd_t *p_ifd)
+{
+  const exif_tag_entry_t *p_entry;
+  uint8_t *p = p_tiff + p_ifd->offset;
+  uint32_t data_offset = p_ifd->offset + 2 +
+    p_ifd->num_tags * MM_JPEG_EXIF_IFD_ENTRY_SIZE + 4;
+  uint32_t value_size;
+  uint32_t i;
+
+  p = mm_jpeg_exif_put16(p, (uint16_t)p_ifd->num_tags);
+  for (i = 0; i < p_ifd->num_tags; i++) {
+    p_entry = &p_ifd->p_tags[i]->tag_entry;
+    p = mm_jpeg_exif_put16(p, (uint16_t)(p_ifd->p_tags[i]->tag_id & 0xFFFF));
+    p = mm_jpeg_exif_put16(p, (uint16_t)p_entry->type);
+    p = mm_jpeg_exif_put32(p, mm_jpeg_exif_app1_count(p_entry));
+    value_size = mm_jpeg_exif_app1_value_size(p_entry);
+    if (value_size <= 4) {
+      mm_jpeg_exif_app1_write_value(p, p_entry);
+    } else {
+      mm_jpeg_exif_put32(p, data_offset);
+      mm_jpeg_exif_app1_write_value(p_tiff + data_offset, p_entry);
+      data_offset += (value_size + 1) & ~1U;
+    }
+    p += 4;
+  }
+  mm_jpeg_exif_put32(p, 0);
+}
+
+/** mm_jpeg_exif_write_app1:
+ *
+ *  Arguments:
+ *    @p_info: exif tag tables, a tag in a later table replaces
+ *      the same tag of an earlier one
+ *    @num_info: number of tables
+ *    @p_buf: output
+ *    @buf_size: size of the output
+ *    @p_len: length of the segment, 0 if there is no tag to write
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Writes a complete big endian Exif APP1 segment starting
+ *       with its marker.
+ *
+ **/
+int32_t mm_jpeg_exif_write_app1(const QOMX_EXIF_INFO *p_info,
+  uint32_t num_info, uint8_t *p_buf, uint32_t buf_size, uint32_t *p_len)
+{
+  mm_jpeg_exif_app1_ifd_t ifds[MM_JPEG_EXIF_IFD_MAX];
+  mm_jpeg_exif_app1_ifd_t *p_ifd0 = &ifds[MM_JPEG_EXIF_IFD_0];
+  mm_jpeg_exif_app1_ifd_t *p_exif = &ifds[MM_JPEG_EXIF_IFD_EXIF];
+  mm_jpeg_exif_app1_ifd_t *p_gps = &ifds[MM_JPEG_EXIF_IFD_GPS];
+  QEXIF_INFO_DATA ptrs[2];
+  const QEXIF_INFO_DATA *p_tag;
+  uint32_t num_ptrs = 0;
+  uint32_t total;
+  uint32_t i, j;
+  uint8_t *p;
+  int ifd;
+
+  if (!p_info || !p_buf || !p_len) {
+    CDBG_ERROR("%s:%d] invalid params", __func__, __LINE__);
+    return -1;
+  }
+  *p_len = 0;
+
+  for (i = 0; i < MM_JPEG_EXIF_IFD_MAX; i++) {
+    ifds[i].num_tags = 0;
+  }
+  for (i = 0; i < num_info; i++) {
+    for (j = 0; j < p_info[i].numOfEntries; j++) {
+      p_tag = &p_info[i].exif_data[j];
+      ifd = mm_jpeg_exif_app1_ifd_of(p_tag->tag_id);
+      if ((ifd < 0) || (0 == p_tag->tag_entry.count) ||
+        (0 == mm_jpeg_exif_app1_elem_size(p_tag->tag_entry.type))) {
+        CDBG("%s:%d] skipping exif tag 0x%x", __func__, __LINE__,
+          p_tag->tag_id);
+        continue;
+      }
+      mm_jpeg_exif_app1_add_tag(&ifds[ifd], p_tag);
+    }
+  }
+  if ((0 == p_ifd0->num_tags) && (0 == p_exif->num_tags) &&
+    (0 == p_gps->num_tags)) {
+    return 0;
+  }
+
+  /* the pointer tags are single longs, the IFD0 size is known before
+   * their values are */
+  memset(ptrs, 0, sizeof(ptrs));
+  if (p_exif->num_tags) {
+    ptrs[num_ptrs].tag_id = EXIFTAGID_EXIF_IFD_PTR;
+    ptrs[num_ptrs].tag_entry.type = EXIF_LONG;
+    ptrs[num_ptrs].tag_entry.count = 1;
+    mm_jpeg_exif_app1_add_tag(p_ifd0, &ptrs[num_ptrs++]);
+  }
+  if (p_gps->num_tags) {
+    ptrs[num_ptrs].tag_id = EXIFTAGID_GPS_IFD_PTR;
+    ptrs[num_ptrs].tag_entry.type = EXIF_LONG;
+    ptrs[num_ptrs].tag_entry.count = 1;
+    mm_jpeg_exif_app1_add_tag(p_ifd0, &ptrs[num_ptrs++]);
+  }
+
+  total = MM_JPEG_EXIF_TIFF_HDR_SIZE;
+  for (i = 0; i < MM_JPEG_EXIF_IFD_MAX; i++) {
+    ifds[i].offset = total;
+    ifds[i].size = ifds[i].num_tags ? mm_jpeg_exif_app1_ifd_size(&ifds[i]) : 0;
+    total += ifds[i].size;
+  }
+  for (i = 0; i < num_ptrs; i++) {
+    ptrs[i].tag_entry.data._long = (EXIFTAGID_EXIF_IFD_PTR == ptrs[i].tag_id) ?
+      p_exif->offset : p_gps->offset;
+  }
+
+  total += MM_JPEG_EXIF_APP1_HDR_SIZE;
+  if ((total > MM_JPEG_EXIF_APP1_MAX_SIZE) || (total > buf_size)) {
+    CDBG_ERROR("%s:%d] exif segment %d bytes does not fit %d", __func__,
+      __LINE__, total, buf_size);
+    return -1;
+  }
+
+  memset(p_buf, 0, total);
+  p = p_buf;
+  *p++ = 0xFF;
+  *p++ = 0xE1;
+  p = mm_jpeg_exif_put16(p, (uint16_t)(total - 2));
+  memcpy(p, "Exif\0\0", 6);
+  p += 6;
+
+  /* TIFF header, IFD0 follows right after it */
+  *p++ = 'M';
+  *p++ = 'M';
+  mm_jpeg_exif_put16(p, 0x002A);
+  mm_jpeg_exif_put32(p + 2, MM_JPEG_EXIF_TIFF_HDR_SIZE);
+  p -= 2;
+
+  for (i = 0; i < MM_JPEG_EXIF_IFD_MAX; i++) {
+    if (ifds[i].num_tags) {
+      mm_jpeg_exif_app1_write_ifd(p, &ifds[i]);
+    }
+  }
+
+  *p_len = total;
+  return 0;
+}
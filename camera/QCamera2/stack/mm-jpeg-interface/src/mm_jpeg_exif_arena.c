@@ -0,0 +1,228 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <string.h>
+#include "mm_jpeg_exif_arena.h"
+#include "mm_jpeg_dbg.h"
+
+/** mm_jpeg_exif_arena_reset:
+ *
+ *  Arguments:
+ *   @p_arena : exif arena
+ *
+ *  Return     : none
+ *
+ *  Description:
+ *       Drops all the allocations of the arena. Entries pointing
+ *       into the arena must not be used after this call.
+ *
+ **/
+void mm_jpeg_exif_arena_reset(mm_jpeg_exif_arena_t *p_arena)
+{
+  p_arena->offset = 0;
+  p_arena->num_allocs = 0;
+}
+
+/** mm_jpeg_exif_arena_alloc:
+ *
+ *  Arguments:
+ *   @p_arena : exif arena
+ *   @size    : number of bytes requested
+ *
+ *  Return     : ptr to zeroed memory, NULL if the arena is exhausted
+ *
+ *  Description:
+ *       Bump allocates 8 byte aligned memory from the arena
+ *
+ **/
+void *mm_jpeg_exif_arena_alloc(mm_jpeg_exif_arena_t *p_arena, uint32_t size)
+{
+  uint32_t aligned_size = (size + 7) & ~7U;
+  uint8_t *p_mem;
+
+  if ((aligned_size < size) ||
+    (aligned_size > MM_JPEG_EXIF_ARENA_SIZE - p_arena->offset)) {
+    ALOGE("%s: Exif arena exhausted used %d requested %d", __func__,
+      p_arena->offset, size);
+    return NULL;
+  }
+
+  p_mem = &p_arena->buf[p_arena->offset];
+  p_arena->offset += aligned_size;
+  p_arena->num_allocs++;
+  if (p_arena->offset > p_arena->high_water) {
+    p_arena->high_water = p_arena->offset;
+  }
+  memset(p_mem, 0, aligned_size);
+  return p_mem;
+}
+
+/** mm_jpeg_exif_set_entry:
+ *
+ *  Arguments:
+ *   @p_entry : exif entry to be filled
+ *   @p_arena : arena holding the payload of multi-value tags
+ *   @tagid   : exif tag ID
+ *   @type    : data type
+ *   @count   : number of data in uint of its type
+ *   @data    : input data ptr
+ *
+ *  Retrun     : int32_t type of status
+ *               0  -- success
+ *              none-zero failure code
+ *
+ *  Description:
+ *       Function to fill an exif entry. Single value tags are
+ *       stored inline, the others are copied into the arena.
+ *
+ **/
+int32_t mm_jpeg_exif_set_entry(QEXIF_INFO_DATA *p_entry,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
+  exif_tag_type_t type, uint32_t count, void *data)
+{
+  uint32_t elem_size = 0;
+  uint32_t alloc_size;
+  void *values;
+
+  p_entry->tag_id = tagid;
+  p_entry->tag_entry.type = type;
+  p_entry->tag_entry.count = count;
+  p_entry->tag_entry.copy = 1;
+
+  switch (type) {
+  case EXIF_BYTE:
+    if (count == 1) {
+      p_entry->tag_entry.data._byte = *(uint8_t *)data;
+      return 0;
+    }
+    elem_size = sizeof(uint8_t);
+    break;
+  case EXIF_ASCII:
+  case EXIF_UNDEFINED:
+    elem_size = sizeof(uint8_t);
+    break;
+  case EXIF_SHORT:
+    if (count == 1) {
+      p_entry->tag_entry.data._short = *(uint16_t *)data;
+      return 0;
+    }
+    elem_size = sizeof(uint16_t);
+    break;
+  case EXIF_LONG:
+    if (count == 1) {
+      p_entry->tag_entry.data._long = *(uint32_t *)data;
+      return 0;
+    }
+    elem_size = sizeof(uint32_t);
+    break;
+  case EXIF_RATIONAL:
+    if (count == 1) {
+      p_entry->tag_entry.data._rat = *(rat_t *)data;
+      return 0;
+    }
+    elem_size = sizeof(rat_t);
+    break;
+  case EXIF_SLONG:
+    if (count == 1) {
+      p_entry->tag_entry.data._slong = *(int32_t *)data;
+      return 0;
+    }
+    elem_size = sizeof(int32_t);
+    break;
+  case EXIF_SRATIONAL:
+    if (count == 1) {
+      p_entry->tag_entry.data._srat = *(srat_t *)data;
+      return 0;
+    }
+    elem_size = sizeof(srat_t);
+    break;
+  default:
+    ALOGE("%s: Invalid exif type %d", __func__, type);
+    return -1;
+  }
+
+  if (count > MM_JPEG_EXIF_ARENA_SIZE / elem_size) {
+    ALOGE("%s: Exif tag 0x%x too large count %d", __func__, tagid, count);
+    return -1;
+  }
+  alloc_size = count * elem_size;
+  /* ascii strings are kept null terminated */
+  if (EXIF_ASCII == type) {
+    alloc_size++;
+  }
+
+  values = mm_jpeg_exif_arena_alloc(p_arena, alloc_size);
+  if (values == NULL) {
+    ALOGE("%s: No memory for exif tag 0x%x", __func__, tagid);
+    return -1;
+  }
+  memcpy(values, data, count * elem_size);
+
+  /* all the pointer members of the union alias the same storage */
+  p_entry->tag_entry.data._bytes = (uint8_t *)values;
+  return 0;
+}
+
+/** addExifEntry:
+ *
+ *  Arguments:
+ *   @exif_info : Exif info struct
+ *   @p_arena : arena holding the tag payloads
+ *   @tagid   : exif tag ID
+ *   @type    : data type
+ *   @count   : number of data in uint of its type
+ *   @data    : input data ptr
+ *
+ *  Retrun     : int32_t type of status
+ *               0  -- success
+ *              none-zero failure code
+ *
+ *  Description:
+ *       Function to add an entry to exif data
+ *
+ **/
+int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info,
+  mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
+  exif_tag_type_t type, uint32_t count, void *data)
+{
+    int32_t rc = 0;
+    uint32_t numOfEntries = p_exif_info->numOfEntries;
+    QEXIF_INFO_DATA *p_info_data = p_exif_info->exif_data;
+    if(numOfEntries >= MM_JPEG_EXIF_MAX_ENTRIES) {
+        ALOGE("%s: Number of entries exceeded limit", __func__);
+        return -1;
+    }
+
+    rc = mm_jpeg_exif_set_entry(&p_info_data[numOfEntries], p_arena,
+      tagid, type, count, data);
+
+    // Increase number of entries
+    p_exif_info->numOfEntries++;
+    return rc;
+}
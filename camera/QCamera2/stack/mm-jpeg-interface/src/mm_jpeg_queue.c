@@ -86,6 +86,42 @@ int32_t mm_jpeg_queue_enq_head(mm_jpeg_queue_t* queue, void* data)
     return 0;
 }
 
+/* insert after all the nodes with a rank lower or equal to prio,
+ * so that the queue stays sorted and FIFO within a rank */
+int32_t mm_jpeg_queue_enq_prio(mm_jpeg_queue_t* queue, void* data,
+  uint32_t prio)
+{
+    struct cam_list *head = NULL;
+    struct cam_list *pos = NULL;
+    mm_jpeg_q_node_t* curr = NULL;
+    mm_jpeg_q_node_t* node =
+        (mm_jpeg_q_node_t *)malloc(sizeof(mm_jpeg_q_node_t));
+    if (NULL == node) {
+        CDBG_ERROR("%s: No memory for mm_jpeg_q_node_t", __func__);
+        return -1;
+    }
+
+    memset(node, 0, sizeof(mm_jpeg_q_node_t));
+    node->data = data;
+    node->prio = prio;
+
+    pthread_mutex_lock(&queue->lock);
+    head = &queue->head.list;
+    pos = head->next;
+    while (pos != head) {
+        curr = member_of(pos, mm_jpeg_q_node_t, list);
+        if (curr->prio > prio) {
+            break;
+        }
+        pos = pos->next;
+    }
+    cam_list_insert_before_node(&node->list, pos);
+    queue->size++;
+    pthread_mutex_unlock(&queue->lock);
+
+    return 0;
+}
+
 void* mm_jpeg_queue_deq(mm_jpeg_queue_t* queue)
 {
     mm_jpeg_q_node_t* node = NULL;
@@ -0,0 +1,1252 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include "mm_jpeg_swdec.h"
+#include "mm_jpeg_dbg.h"
+
+/* huffman codes up to this length are decoded with one table lookup */
+#define MM_JPEG_SWDEC_LOOKAHEAD 9
+
+#define MM_JPEG_SWDEC_MAX_COMPS 3
+
+/* jpeg marker codes */
+#define M_SOF0 0xC0
+#define M_SOF1 0xC1
+#define M_DHT  0xC4
+#define M_SOI  0xD8
+#define M_EOI  0xD9
+#define M_SOS  0xDA
+#define M_DQT  0xDB
+#define M_DRI  0xDD
+#define M_RST0 0xD0
+#define M_RST7 0xD7
+
+/* zigzag index to natural index, padded for corrupt run lengths */
+static const uint8_t mm_jpeg_swdec_natural_order[64 + 16] = {
+   0,  1,  8, 16,  9,  2,  3, 10,
+  17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34,
+  27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36,
+  29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46,
+  53, 60, 61, 54, 47, 55, 62, 63,
+  63, 63, 63, 63, 63, 63, 63, 63,
+  63, 63, 63, 63, 63, 63, 63, 63
+};
+
+/* AAN scale factors, cos(k*PI/16) * sqrt(2) for k > 0 */
+static const float mm_jpeg_swdec_aan_scale[8] = {
+  1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+  1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+/** mm_jpeg_swdec_huff_t:
+ *  @maxcode: largest code of every length, -1 if none
+ *  @valoffset: symbol index minus code of every length
+ *  @vals: symbols
+ *  @look: (length << 8) | symbol for every LOOKAHEAD bit prefix,
+ *    0 if the code is longer
+ *  @valid: table has been defined
+ *
+ *  derived huffman decoding table
+ **/
+typedef struct {
+  int32_t maxcode[18];
+  int32_t valoffset[18];
+  uint8_t vals[256];
+  uint16_t look[1 << MM_JPEG_SWDEC_LOOKAHEAD];
+  int valid;
+} mm_jpeg_swdec_huff_t;
+
+/** mm_jpeg_swdec_comp_t:
+ *  @id: component identifier
+ *  @h: horizontal sampling factor
+ *  @v: vertical sampling factor
+ *  @tq: quantization table index
+ *  @td: dc huffman table index
+ *  @ta: ac huffman table index
+ *
+ *  frame component
+ **/
+typedef struct {
+  uint8_t id;
+  uint8_t h;
+  uint8_t v;
+  uint8_t tq;
+  uint8_t td;
+  uint8_t ta;
+} mm_jpeg_swdec_comp_t;
+
+/** mm_jpeg_swdec_frame_t:
+ *  @width: image width
+ *  @height: image height
+ *  @num_comps: number of components
+ *  @comps: components in frame order
+ *  @scan_order: frame index of every component of the scan
+ *  @restart: restart interval in MCUs, 0 if none
+ *  @qt_mask: defined quantization tables
+ *  @qtbl: quantization tables, natural order
+ *  @p_scan: first byte of the entropy coded data
+ *  @p_end: end of the input
+ *
+ *  parsed headers of a baseline image
+ **/
+typedef struct {
+  uint32_t width;
+  uint32_t height;
+  uint32_t num_comps;
+  mm_jpeg_swdec_comp_t comps[MM_JPEG_SWDEC_MAX_COMPS];
+  uint32_t scan_order[MM_JPEG_SWDEC_MAX_COMPS];
+  uint32_t restart;
+  uint32_t qt_mask;
+  uint16_t qtbl[4][64];
+  const uint8_t *p_scan;
+  const uint8_t *p_end;
+} mm_jpeg_swdec_frame_t;
+
+/** mm_jpeg_swdec_seg_t:
+ *  @p_start: first byte of the restart interval
+ *  @p_end: marker ending the restart interval
+ *
+ *  entropy coded data of one restart interval
+ **/
+typedef struct {
+  const uint8_t *p_start;
+  const uint8_t *p_end;
+} mm_jpeg_swdec_seg_t;
+
+/** mm_jpeg_swdec_bits_t:
+ *  @p: next byte
+ *  @p_end: end of the restart interval
+ *  @acc: bit accumulator, left aligned
+ *  @nbits: valid bits in acc
+ *  @err: a corrupt code has been met
+ *
+ *  bit reader of a restart interval
+ **/
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *p_end;
+  uint32_t acc;
+  int nbits;
+  int err;
+} mm_jpeg_swdec_bits_t;
+
+struct mm_jpeg_swdec {
+  pthread_t pid[MM_JPEG_SWDEC_MAX_THREADS];
+  uint32_t num_workers;
+
+  /* serializes the decode calls */
+  pthread_mutex_t dec_lock;
+
+  /* protects the work distribution below */
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  uint32_t work_gen;
+  int exit;
+  uint32_t next_task;
+  uint32_t tasks_done;
+  uint32_t num_tasks;
+  int32_t rc;
+
+  /* image being decoded */
+  const mm_jpeg_swdec_output_t *p_out;
+  mm_jpeg_swdec_frame_t frame;
+  uint32_t hmax;
+  uint32_t vmax;
+  uint32_t mcu_w;
+  uint32_t mcu_h;
+  uint32_t mcus_x;
+  uint32_t total_mcus;
+  uint32_t num_segs;
+  uint32_t segs_per_task;
+  mm_jpeg_swdec_seg_t *segs;
+  uint32_t segs_alloc;
+
+  float dequant[4][64];
+  mm_jpeg_swdec_huff_t dc_huff[4];
+  mm_jpeg_swdec_huff_t ac_huff[4];
+};
+
+/** mm_jpeg_swdec_build_huff:
+ *
+ *  Arguments:
+ *    @p_huff: derived table
+ *    @bits: code counts per length
+ *    @vals: symbols
+ *
+ *  Return:
+ *       0 for success -1 for an invalid table
+ *
+ *  Description:
+ *       Derives the decoding tables (ITU T.81 Annex F.2.2.3) and
+ *       the lookahead table of the short codes
+ *
+ **/
+static int32_t mm_jpeg_swdec_build_huff(mm_jpeg_swdec_huff_t *p_huff,
+  const uint8_t *bits, const uint8_t *vals)
+{
+  uint32_t code = 0;
+  uint32_t len, i, j, k = 0, shift;
+
+  memset(p_huff, 0, sizeof(*p_huff));
+  for (len = 1; len <= 16; len++) {
+    p_huff->maxcode[len] = -1;
+    if (bits[len - 1]) {
+      p_huff->valoffset[len] = (int32_t)k - (int32_t)code;
+      for (i = 0; i < bits[len - 1]; i++, k++, code++) {
+        p_huff->vals[k] = vals[k];
+        if (len <= MM_JPEG_SWDEC_LOOKAHEAD) {
+          shift = MM_JPEG_SWDEC_LOOKAHEAD - len;
+          for (j = 0; j < (1U << shift); j++) {
+            p_huff->look[(code << shift) | j] =
+              (uint16_t)((len << 8) | vals[k]);
+          }
+        }
+      }
+      p_huff->maxcode[len] = (int32_t)code - 1;
+    }
+    if (code > (1U << len)) {
+      return -1;
+    }
+    code <<= 1;
+  }
+  p_huff->maxcode[17] = 0x7FFFFFFF;
+  p_huff->valid = 1;
+  return 0;
+}
+
+/** mm_jpeg_swdec_parse:
+ *
+ *  Arguments:
+ *    @p_jpeg: jpeg image
+ *    @size: size of the image
+ *    @p_frame: parsed headers
+ *    @p_dec: decoder receiving the huffman tables, NULL to only
+ *      check the headers
+ *
+ *  Return:
+ *       0 if the image can be decoded, -1 otherwise
+ *
+ *  Description:
+ *       Parses the markers up to the first SOS. Only single scan
+ *       baseline images with 1 or 3 components, luma sampled at
+ *       most 2x2 and chroma sampled 1x1, are accepted.
+ *
+ **/
+static int32_t mm_jpeg_swdec_parse(const uint8_t *p_jpeg, uint32_t size,
+  mm_jpeg_swdec_frame_t *p_frame, mm_jpeg_swdec_t *p_dec)
+{
+  const uint8_t *p = p_jpeg;
+  const uint8_t *p_end = p_jpeg + size;
+  const uint8_t *p_seg, *p_seg_end;
+  uint8_t bits[16];
+  uint32_t len, i, j, n, tc, th, count, marker;
+  uint32_t dht_mask = 0;
+  int have_sof = 0;
+
+  memset(p_frame, 0, sizeof(*p_frame));
+  if ((size < 4) || (p[0] != 0xFF) || (p[1] != M_SOI)) {
+    CDBG_ERROR("%s:%d] not a jpeg image", __func__, __LINE__);
+    return -1;
+  }
+  p += 2;
+
+  while (1) {
+    /* skip fill bytes in front of the marker */
+    while ((p < p_end) && (*p != 0xFF))
+      p++;
+    while ((p < p_end) && (*p == 0xFF))
+      p++;
+    if (p >= p_end) {
+      CDBG_ERROR("%s:%d] no scan found", __func__, __LINE__);
+      return -1;
+    }
+    marker = *p++;
+    if ((M_EOI == marker) || ((marker >= M_RST0) && (marker <= M_RST7))) {
+      CDBG_ERROR("%s:%d] unexpected marker 0x%x", __func__, __LINE__,
+        marker);
+      return -1;
+    }
+    if (p + 2 > p_end) {
+      return -1;
+    }
+    len = ((uint32_t)p[0] << 8) | p[1];
+    if ((len < 2) || (p + len > p_end)) {
+      CDBG_ERROR("%s:%d] truncated marker 0x%x", __func__, __LINE__, marker);
+      return -1;
+    }
+    p_seg = p + 2;
+    p_seg_end = p + len;
+    p = p_seg_end;
+
+    switch (marker) {
+    case M_SOF0:
+    case M_SOF1:
+      if ((p_seg_end - p_seg) < 6) {
+        return -1;
+      }
+      if (p_seg[0] != 8) {
+        CDBG_ERROR("%s:%d] %d bit precision not supported", __func__,
+          __LINE__, p_seg[0]);
+        return -1;
+      }
+      p_frame->height = ((uint32_t)p_seg[1] << 8) | p_seg[2];
+      p_frame->width = ((uint32_t)p_seg[3] << 8) | p_seg[4];
+      p_frame->num_comps = p_seg[5];
+      if ((1 != p_frame->num_comps) &&
+        (MM_JPEG_SWDEC_MAX_COMPS != p_frame->num_comps)) {
+        CDBG_ERROR("%s:%d] %d components not supported", __func__,
+          __LINE__, p_frame->num_comps);
+        return -1;
+      }
+      if ((p_seg_end - p_seg) < (long)(6 + p_frame->num_comps * 3)) {
+        return -1;
+      }
+      for (i = 0; i < p_frame->num_comps; i++) {
+        p_frame->comps[i].id = p_seg[6 + i * 3];
+        p_frame->comps[i].h = p_seg[7 + i * 3] >> 4;
+        p_frame->comps[i].v = p_seg[7 + i * 3] & 0xF;
+        p_frame->comps[i].tq = p_seg[8 + i * 3] & 0x3;
+      }
+      have_sof = 1;
+      break;
+
+    case M_DQT:
+      while (p_seg < p_seg_end) {
+        n = p_seg[0] & 0xF;
+        tc = p_seg[0] >> 4;
+        p_seg++;
+        if ((n > 3) || (p_seg + (tc ? 128 : 64) > p_seg_end)) {
+          return -1;
+        }
+        for (i = 0; i < 64; i++) {
+          p_frame->qtbl[n][mm_jpeg_swdec_natural_order[i]] = tc ?
+            (uint16_t)((p_seg[i * 2] << 8) | p_seg[i * 2 + 1]) : p_seg[i];
+        }
+        p_seg += tc ? 128 : 64;
+        p_frame->qt_mask |= 1U << n;
+      }
+      break;
+
+    case M_DHT:
+      while (p_seg < p_seg_end) {
+        if (p_seg + 17 > p_seg_end) {
+          return -1;
+        }
+        tc = p_seg[0] >> 4;
+        th = p_seg[0] & 0xF;
+        memcpy(bits, p_seg + 1, sizeof(bits));
+        p_seg += 17;
+        for (i = 0, count = 0; i < 16; i++)
+          count += bits[i];
+        if ((tc > 1) || (th > 3) || (count > 256) ||
+          (p_seg + count > p_seg_end)) {
+          return -1;
+        }
+        if (p_dec && mm_jpeg_swdec_build_huff(tc ? &p_dec->ac_huff[th] :
+          &p_dec->dc_huff[th], bits, p_seg)) {
+          CDBG_ERROR("%s:%d] invalid huffman table", __func__, __LINE__);
+          return -1;
+        }
+        dht_mask |= 1U << (tc * 4 + th);
+        p_seg += count;
+      }
+      break;
+
+    case M_DRI:
+      if ((p_seg_end - p_seg) < 2) {
+        return -1;
+      }
+      p_frame->restart = ((uint32_t)p_seg[0] << 8) | p_seg[1];
+      break;
+
+    case M_SOS:
+      if (!have_sof || (p_seg_end - p_seg) < 1) {
+        return -1;
+      }
+      n = p_seg[0];
+      if ((n != p_frame->num_comps) ||
+        ((p_seg_end - p_seg) < (long)(1 + n * 2 + 3))) {
+        CDBG_ERROR("%s:%d] multi scan image not supported", __func__,
+          __LINE__);
+        return -1;
+      }
+      for (i = 0; i < n; i++) {
+        for (j = 0; j < p_frame->num_comps; j++) {
+          if (p_frame->comps[j].id == p_seg[1 + i * 2])
+            break;
+        }
+        if (j == p_frame->num_comps) {
+          return -1;
+        }
+        p_frame->comps[j].td = p_seg[2 + i * 2] >> 4;
+        p_frame->comps[j].ta = p_seg[2 + i * 2] & 0xF;
+        p_frame->scan_order[i] = j;
+      }
+      p_frame->p_scan = p_seg_end;
+      p_frame->p_end = p_end;
+      goto scan;
+
+    default:
+      /* SOF2 and up are progressive, lossless or arithmetic coded */
+      if ((marker > M_SOF1) && (marker <= 0xCF) && (marker != M_DHT) &&
+        (marker != 0xC8) && (marker != 0xCC)) {
+        CDBG_HIGH("%s:%d] SOF 0x%x not supported", __func__, __LINE__,
+          marker);
+        return -1;
+      }
+      /* APPn, COM and the like */
+      break;
+    }
+  }
+
+scan:
+  if ((0 == p_frame->width) || (0 == p_frame->height)) {
+    CDBG_ERROR("%s:%d] invalid dimension %dx%d", __func__, __LINE__,
+      p_frame->width, p_frame->height);
+    return -1;
+  }
+  for (i = 0; i < p_frame->num_comps; i++) {
+    mm_jpeg_swdec_comp_t *p_comp = &p_frame->comps[i];
+    if (!(p_frame->qt_mask & (1U << p_comp->tq)) || (p_comp->td > 3) ||
+      (p_comp->ta > 3) || !(dht_mask & (1U << p_comp->td)) ||
+      !(dht_mask & (1U << (4 + p_comp->ta)))) {
+      CDBG_ERROR("%s:%d] missing table of component %d", __func__,
+        __LINE__, i);
+      return -1;
+    }
+    if (1 == p_frame->num_comps) {
+      /* a single component scan is not interleaved */
+      p_comp->h = p_comp->v = 1;
+    } else if (0 == i) {
+      if ((p_comp->h < 1) || (p_comp->h > 2) || (p_comp->v < 1) ||
+        (p_comp->v > 2)) {
+        CDBG_HIGH("%s:%d] luma sampling %dx%d not supported", __func__,
+          __LINE__, p_comp->h, p_comp->v);
+        return -1;
+      }
+    } else if ((p_comp->h != 1) || (p_comp->v != 1)) {
+      CDBG_HIGH("%s:%d] chroma sampling %dx%d not supported", __func__,
+        __LINE__, p_comp->h, p_comp->v);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** mm_jpeg_swdec_fill_bits:
+ *
+ *  Arguments:
+ *    @p_bits: bit reader
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Tops up the accumulator to more than 24 bits. Stuffed
+ *       zero bytes are dropped and zero bits are fed once the
+ *       end of the interval is reached.
+ *
+ **/
+static inline void mm_jpeg_swdec_fill_bits(mm_jpeg_swdec_bits_t *p_bits)
+{
+  uint32_t c;
+
+  while (p_bits->nbits <= 24) {
+    c = 0;
+    if (p_bits->p < p_bits->p_end) {
+      c = *p_bits->p++;
+      if (0xFF == c) {
+        if ((p_bits->p < p_bits->p_end) && (0 == *p_bits->p)) {
+          p_bits->p++;
+        } else {
+          /* fill bytes in front of the marker */
+          p_bits->p = p_bits->p_end;
+          c = 0;
+        }
+      }
+    }
+    p_bits->acc |= c << (24 - p_bits->nbits);
+    p_bits->nbits += 8;
+  }
+}
+
+/** mm_jpeg_swdec_get_bits:
+ *
+ *  Arguments:
+ *    @p_bits: bit reader
+ *    @n: number of bits, 1~16
+ *
+ *  Return:
+ *       next n bits, right aligned
+ *
+ **/
+static inline uint32_t mm_jpeg_swdec_get_bits(mm_jpeg_swdec_bits_t *p_bits,
+  int n)
+{
+  uint32_t val;
+
+  mm_jpeg_swdec_fill_bits(p_bits);
+  val = p_bits->acc >> (32 - n);
+  p_bits->acc <<= n;
+  p_bits->nbits -= n;
+  return val;
+}
+
+/** mm_jpeg_swdec_decode_huff:
+ *
+ *  Arguments:
+ *    @p_bits: bit reader
+ *    @p_huff: huffman table
+ *
+ *  Return:
+ *       decoded symbol
+ *
+ *  Description:
+ *       Short codes are resolved with the lookahead table, the
+ *       longer ones with the canonical code limits. An invalid
+ *       code sets the error flag of the reader.
+ *
+ **/
+static inline uint32_t mm_jpeg_swdec_decode_huff(mm_jpeg_swdec_bits_t *p_bits,
+  const mm_jpeg_swdec_huff_t *p_huff)
+{
+  uint32_t look, code;
+  int len;
+
+  mm_jpeg_swdec_fill_bits(p_bits);
+  look = p_huff->look[p_bits->acc >> (32 - MM_JPEG_SWDEC_LOOKAHEAD)];
+  if (look) {
+    len = (int)(look >> 8);
+    p_bits->acc <<= len;
+    p_bits->nbits -= len;
+    return look & 0xFF;
+  }
+
+  for (len = MM_JPEG_SWDEC_LOOKAHEAD + 1; len <= 16; len++) {
+    code = p_bits->acc >> (32 - len);
+    if ((int32_t)code <= p_huff->maxcode[len]) {
+      p_bits->acc <<= len;
+      p_bits->nbits -= len;
+      return p_huff->vals[(int32_t)code + p_huff->valoffset[len]];
+    }
+  }
+  p_bits->err = 1;
+  return 0;
+}
+
+/** mm_jpeg_swdec_extend:
+ *
+ *  Arguments:
+ *    @p_bits: bit reader
+ *    @s: magnitude category, 1~15
+ *
+ *  Return:
+ *       signed value of the following s bits
+ *
+ **/
+static inline int32_t mm_jpeg_swdec_extend(mm_jpeg_swdec_bits_t *p_bits,
+  int s)
+{
+  int32_t val = (int32_t)mm_jpeg_swdec_get_bits(p_bits, s);
+
+  return (val < (1 << (s - 1))) ? (val - (1 << s) + 1) : val;
+}
+
+/** mm_jpeg_swdec_idct:
+ *
+ *  Arguments:
+ *    @blk: dequantized coefficients, destroyed
+ *    @p_out: top left sample of the output block
+ *    @stride: output line stride
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Floating point AAN inverse DCT. The AAN scaling and the
+ *       final division by 8 are folded into the dequantization
+ *       multipliers.
+ *
+ **/
+static void mm_jpeg_swdec_idct(float *blk, uint8_t *p_out, uint32_t stride)
+{
+  float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  float tmp10, tmp11, tmp12, tmp13;
+  float z5, z10, z11, z12, z13;
+  float *p;
+  int i, val;
+
+  /* columns, then rows */
+  for (i = 0; i < 16; i++) {
+    int step = (i < 8) ? 8 : 1;
+    p = (i < 8) ? &blk[i] : &blk[(i - 8) * 8];
+
+    /* even part */
+    tmp10 = p[0 * step] + p[4 * step];
+    tmp11 = p[0 * step] - p[4 * step];
+    tmp13 = p[2 * step] + p[6 * step];
+    tmp12 = (p[2 * step] - p[6 * step]) * 1.414213562f - tmp13;
+
+    tmp0 = tmp10 + tmp13;
+    tmp3 = tmp10 - tmp13;
+    tmp1 = tmp11 + tmp12;
+    tmp2 = tmp11 - tmp12;
+
+    /* odd part */
+    z13 = p[5 * step] + p[3 * step];
+    z10 = p[5 * step] - p[3 * step];
+    z11 = p[1 * step] + p[7 * step];
+    z12 = p[1 * step] - p[7 * step];
+
+    tmp7 = z11 + z13;
+    tmp11 = (z11 - z13) * 1.414213562f;
+    z5 = (z10 + z12) * 1.847759065f;
+    tmp10 = 1.082392200f * z12 - z5;
+    tmp12 = -2.613125930f * z10 + z5;
+
+    tmp6 = tmp12 - tmp7;
+    tmp5 = tmp11 - tmp6;
+    tmp4 = tmp10 + tmp5;
+
+    p[0 * step] = tmp0 + tmp7;
+    p[7 * step] = tmp0 - tmp7;
+    p[1 * step] = tmp1 + tmp6;
+    p[6 * step] = tmp1 - tmp6;
+    p[2 * step] = tmp2 + tmp5;
+    p[5 * step] = tmp2 - tmp5;
+    p[4 * step] = tmp3 + tmp4;
+    p[3 * step] = tmp3 - tmp4;
+  }
+
+  for (i = 0; i < 64; i++) {
+    /* level shift and round, negative values clamp to 0 anyway */
+    val = (int)(blk[i] + 128.5f);
+    p_out[(i >> 3) * stride + (i & 7)] =
+      (uint8_t)((val < 0) ? 0 : ((val > 255) ? 255 : val));
+  }
+}
+
+/** mm_jpeg_swdec_decode_block:
+ *
+ *  Arguments:
+ *    @p_bits: bit reader
+ *    @p_dc: dc huffman table
+ *    @p_ac: ac huffman table
+ *    @p_dc_pred: dc predictor of the component
+ *    @dequant: dequantization multipliers
+ *    @blk: dequantized coefficients, natural order
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Huffman decodes and dequantizes one block
+ *
+ **/
+static void mm_jpeg_swdec_decode_block(mm_jpeg_swdec_bits_t *p_bits,
+  const mm_jpeg_swdec_huff_t *p_dc, const mm_jpeg_swdec_huff_t *p_ac,
+  int32_t *p_dc_pred, const float *dequant, float *blk)
+{
+  uint32_t rs;
+  int k, r, s, n;
+
+  memset(blk, 0, 64 * sizeof(float));
+
+  s = (int)mm_jpeg_swdec_decode_huff(p_bits, p_dc);
+  if (s > 15) {
+    p_bits->err = 1;
+    return;
+  }
+  if (s) {
+    *p_dc_pred += mm_jpeg_swdec_extend(p_bits, s);
+  }
+  blk[0] = (float)*p_dc_pred * dequant[0];
+
+  for (k = 1; k < 64; k++) {
+    rs = mm_jpeg_swdec_decode_huff(p_bits, p_ac);
+    r = (int)(rs >> 4);
+    s = (int)(rs & 15);
+    if (s) {
+      k += r;
+      n = mm_jpeg_swdec_natural_order[k];
+      blk[n] = (float)mm_jpeg_swdec_extend(p_bits, s) * dequant[n];
+    } else if (15 == r) {
+      k += 15;
+    } else {
+      break;
+    }
+  }
+}
+
+/** mm_jpeg_swdec_store_mcu:
+ *
+ *  Arguments:
+ *    @p_dec: decoder
+ *    @mcu: decoded samples of every component
+ *    @mx: MCU column
+ *    @my: MCU row
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Copies the luma of the MCU to the output and resamples
+ *       the chroma to interleaved 4:2:0. Samples beyond the image
+ *       edges are dropped.
+ *
+ **/
+static void mm_jpeg_swdec_store_mcu(mm_jpeg_swdec_t *p_dec,
+  uint8_t mcu[][256], uint32_t mx, uint32_t my)
+{
+  const mm_jpeg_swdec_output_t *p_out = p_dec->p_out;
+  const mm_jpeg_swdec_frame_t *p_frame = &p_dec->frame;
+  uint32_t x0 = mx * p_dec->mcu_w;
+  uint32_t y0 = my * p_dec->mcu_h;
+  uint32_t w = p_frame->width - x0;
+  uint32_t h = p_frame->height - y0;
+  uint32_t cw, ch, i, j, u, v;
+  uint32_t sx0, sx1, sy0, sy1, cstride;
+  const uint8_t *p_u, *p_v;
+  uint8_t *p_line;
+
+  if (w > p_dec->mcu_w)
+    w = p_dec->mcu_w;
+  if (h > p_dec->mcu_h)
+    h = p_dec->mcu_h;
+
+  for (j = 0; j < h; j++) {
+    memcpy(p_out->p_y + (y0 + j) * p_out->y_stride + x0,
+      &mcu[0][j * p_dec->mcu_w], w);
+  }
+
+  /* the MCU origin is even in both directions */
+  cw = (w + 1) >> 1;
+  ch = (h + 1) >> 1;
+  if (1 == p_frame->num_comps) {
+    for (j = 0; j < ch; j++) {
+      memset(p_out->p_cbcr + (y0 / 2 + j) * p_out->cbcr_stride + x0, 128,
+        cw * 2);
+    }
+    return;
+  }
+
+  /* the chroma blocks are 8x8, the luma area is 8h x 8v */
+  p_u = mcu[p_out->cbcr_swap ? 2 : 1];
+  p_v = mcu[p_out->cbcr_swap ? 1 : 2];
+  cstride = 8;
+  for (j = 0; j < ch; j++) {
+    p_line = p_out->p_cbcr + (y0 / 2 + j) * p_out->cbcr_stride + x0;
+    sy0 = (2 * j) / p_dec->vmax;
+    /* the last line/column of an odd sized image is not doubled */
+    sy1 = (2 * j + 1 < h) ? ((2 * j + 1) / p_dec->vmax) : sy0;
+    if ((2 == p_dec->hmax) && (sy0 == sy1)) {
+      /* 4:2:0, one to one */
+      for (i = 0; i < cw; i++) {
+        p_line[2 * i] = p_u[sy0 * cstride + i];
+        p_line[2 * i + 1] = p_v[sy0 * cstride + i];
+      }
+      continue;
+    }
+    for (i = 0; i < cw; i++) {
+      sx0 = (2 * i) / p_dec->hmax;
+      sx1 = (2 * i + 1 < w) ? ((2 * i + 1) / p_dec->hmax) : sx0;
+      u = (uint32_t)p_u[sy0 * cstride + sx0] + p_u[sy0 * cstride + sx1] +
+        p_u[sy1 * cstride + sx0] + p_u[sy1 * cstride + sx1];
+      v = (uint32_t)p_v[sy0 * cstride + sx0] + p_v[sy0 * cstride + sx1] +
+        p_v[sy1 * cstride + sx0] + p_v[sy1 * cstride + sx1];
+      p_line[2 * i] = (uint8_t)((u + 2) >> 2);
+      p_line[2 * i + 1] = (uint8_t)((v + 2) >> 2);
+    }
+  }
+}
+
+/** mm_jpeg_swdec_decode_seg:
+ *
+ *  Arguments:
+ *    @p_dec: decoder
+ *    @idx: restart interval index
+ *
+ *  Return:
+ *       0 for success -1 for corrupt data
+ *
+ *  Description:
+ *       Decodes the MCUs of one restart interval, the predictors
+ *       start from 0 at every interval
+ *
+ **/
+static int32_t mm_jpeg_swdec_decode_seg(mm_jpeg_swdec_t *p_dec, uint32_t idx)
+{
+  const mm_jpeg_swdec_frame_t *p_frame = &p_dec->frame;
+  const mm_jpeg_swdec_comp_t *p_comp;
+  mm_jpeg_swdec_bits_t bits;
+  int32_t dc_pred[MM_JPEG_SWDEC_MAX_COMPS];
+  uint8_t mcu[MM_JPEG_SWDEC_MAX_COMPS][256];
+  float blk[64];
+  uint32_t first, last, m, i, c, bx, by, stride;
+
+  if (p_frame->restart) {
+    first = idx * p_frame->restart;
+    last = first + p_frame->restart;
+    if (last > p_dec->total_mcus)
+      last = p_dec->total_mcus;
+  } else {
+    first = 0;
+    last = p_dec->total_mcus;
+  }
+
+  memset(&bits, 0, sizeof(bits));
+  bits.p = p_dec->segs[idx].p_start;
+  bits.p_end = p_dec->segs[idx].p_end;
+  memset(dc_pred, 0, sizeof(dc_pred));
+
+  for (m = first; m < last; m++) {
+    for (i = 0; i < p_frame->num_comps; i++) {
+      c = p_frame->scan_order[i];
+      p_comp = &p_frame->comps[c];
+      stride = p_comp->h * 8;
+      for (by = 0; by < p_comp->v; by++) {
+        for (bx = 0; bx < p_comp->h; bx++) {
+          mm_jpeg_swdec_decode_block(&bits, &p_dec->dc_huff[p_comp->td],
+            &p_dec->ac_huff[p_comp->ta], &dc_pred[i],
+            p_dec->dequant[p_comp->tq], blk);
+          mm_jpeg_swdec_idct(blk, &mcu[c][by * 8 * stride + bx * 8], stride);
+        }
+      }
+    }
+    if (bits.err) {
+      CDBG_ERROR("%s:%d] corrupt data in interval %d MCU %d", __func__,
+        __LINE__, idx, m);
+      return -1;
+    }
+    mm_jpeg_swdec_store_mcu(p_dec, mcu, m % p_dec->mcus_x, m / p_dec->mcus_x);
+  }
+  return 0;
+}
+
+/** mm_jpeg_swdec_run_tasks:
+ *
+ *  Arguments:
+ *    @p_dec: decoder
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Decodes groups of restart intervals until none is left,
+ *       shared by the workers and the calling thread
+ *
+ **/
+static void mm_jpeg_swdec_run_tasks(mm_jpeg_swdec_t *p_dec)
+{
+  uint32_t idx, seg, last;
+  int32_t rc;
+
+  while (1) {
+    pthread_mutex_lock(&p_dec->lock);
+    if (p_dec->next_task >= p_dec->num_tasks) {
+      pthread_mutex_unlock(&p_dec->lock);
+      break;
+    }
+    idx = p_dec->next_task++;
+    pthread_mutex_unlock(&p_dec->lock);
+
+    rc = 0;
+    seg = idx * p_dec->segs_per_task;
+    last = seg + p_dec->segs_per_task;
+    if (last > p_dec->num_segs)
+      last = p_dec->num_segs;
+    for (; (seg < last) && !rc; seg++) {
+      rc = mm_jpeg_swdec_decode_seg(p_dec, seg);
+    }
+
+    pthread_mutex_lock(&p_dec->lock);
+    if (rc)
+      p_dec->rc = rc;
+    p_dec->tasks_done++;
+    if (p_dec->tasks_done == p_dec->num_tasks) {
+      pthread_cond_signal(&p_dec->done_cond);
+    }
+    pthread_mutex_unlock(&p_dec->lock);
+  }
+}
+
+/** mm_jpeg_swdec_worker:
+ *
+ *  Arguments:
+ *    @data: decoder
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Worker thread, picks up restart intervals of every new
+ *       image
+ *
+ **/
+static void *mm_jpeg_swdec_worker(void *data)
+{
+  mm_jpeg_swdec_t *p_dec = (mm_jpeg_swdec_t *)data;
+  uint32_t seen_gen = 0;
+
+  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_swdec", 0, 0, 0);
+
+  pthread_mutex_lock(&p_dec->lock);
+  while (1) {
+    while (!p_dec->exit && (seen_gen == p_dec->work_gen)) {
+      pthread_cond_wait(&p_dec->work_cond, &p_dec->lock);
+    }
+    if (p_dec->exit)
+      break;
+    seen_gen = p_dec->work_gen;
+    pthread_mutex_unlock(&p_dec->lock);
+
+    mm_jpeg_swdec_run_tasks(p_dec);
+
+    pthread_mutex_lock(&p_dec->lock);
+  }
+  pthread_mutex_unlock(&p_dec->lock);
+  return NULL;
+}
+
+/** mm_jpeg_swdec_find_segs:
+ *
+ *  Arguments:
+ *    @p_dec: decoder
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Splits the entropy coded data at the RSTn markers. Only
+ *       0xFF bytes are looked at, so this is much cheaper than
+ *       the decode itself.
+ *
+ **/
+static int32_t mm_jpeg_swdec_find_segs(mm_jpeg_swdec_t *p_dec)
+{
+  const mm_jpeg_swdec_frame_t *p_frame = &p_dec->frame;
+  const uint8_t *p = p_frame->p_scan;
+  const uint8_t *q;
+  mm_jpeg_swdec_seg_t *p_segs;
+  uint32_t expected, k = 0, alloc;
+
+  expected = p_frame->restart ?
+    (p_dec->total_mcus + p_frame->restart - 1) / p_frame->restart : 1;
+  if (expected > p_dec->segs_alloc) {
+    alloc = expected;
+    p_segs = (mm_jpeg_swdec_seg_t *)realloc(p_dec->segs,
+      alloc * sizeof(*p_segs));
+    if (NULL == p_segs) {
+      CDBG_ERROR("%s:%d] no memory for %d intervals", __func__, __LINE__,
+        expected);
+      return -1;
+    }
+    p_dec->segs = p_segs;
+    p_dec->segs_alloc = alloc;
+  }
+
+  p_dec->segs[0].p_start = p;
+  while (1) {
+    q = (const uint8_t *)memchr(p, 0xFF, (size_t)(p_frame->p_end - p));
+    if ((NULL == q) || (q + 1 >= p_frame->p_end)) {
+      p_dec->segs[k].p_end = p_frame->p_end;
+      break;
+    }
+    if (0 == q[1]) {
+      p = q + 2;
+    } else if (0xFF == q[1]) {
+      p = q + 1;
+    } else if ((q[1] >= M_RST0) && (q[1] <= M_RST7) && p_frame->restart) {
+      p_dec->segs[k].p_end = q;
+      if (++k == expected) {
+        /* stray marker after the last interval */
+        break;
+      }
+      p = q + 2;
+      p_dec->segs[k].p_start = p;
+    } else {
+      p_dec->segs[k].p_end = q;
+      break;
+    }
+  }
+
+  p_dec->num_segs = (k == expected) ? k : (k + 1);
+  if (p_dec->num_segs != expected) {
+    CDBG_ERROR("%s:%d] found %d of %d restart intervals", __func__, __LINE__,
+      p_dec->num_segs, expected);
+    return -1;
+  }
+  return 0;
+}
+
+/** mm_jpeg_swdec_create:
+ *
+ *  Arguments:
+ *    @num_threads: number of threads decoding in parallel,
+ *      0 for the number of online cpus
+ *
+ *  Return:
+ *       decoder, NULL on failure
+ *
+ *  Description:
+ *       Creates the decoder and its worker threads. The thread
+ *       calling mm_jpeg_swdec_decode is one of the decoding threads.
+ *
+ **/
+mm_jpeg_swdec_t *mm_jpeg_swdec_create(uint32_t num_threads)
+{
+  mm_jpeg_swdec_t *p_dec;
+  long cpus;
+  uint32_t i;
+
+  if (0 == num_threads) {
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (cpus > 0) ? (uint32_t)cpus : 1;
+  }
+  if (num_threads > MM_JPEG_SWDEC_MAX_THREADS)
+    num_threads = MM_JPEG_SWDEC_MAX_THREADS;
+
+  p_dec = (mm_jpeg_swdec_t *)malloc(sizeof(*p_dec));
+  if (NULL == p_dec) {
+    CDBG_ERROR("%s:%d] no memory", __func__, __LINE__);
+    return NULL;
+  }
+  memset(p_dec, 0, sizeof(*p_dec));
+
+  pthread_mutex_init(&p_dec->dec_lock, NULL);
+  pthread_mutex_init(&p_dec->lock, NULL);
+  pthread_cond_init(&p_dec->work_cond, NULL);
+  pthread_cond_init(&p_dec->done_cond, NULL);
+
+  for (i = 0; i < num_threads - 1; i++) {
+    if (pthread_create(&p_dec->pid[i], NULL, mm_jpeg_swdec_worker, p_dec)) {
+      CDBG_ERROR("%s:%d] worker %d create failed", __func__, __LINE__, i);
+      break;
+    }
+    p_dec->num_workers++;
+  }
+
+  CDBG_HIGH("%s:%d] software decoder with %d threads", __func__, __LINE__,
+    p_dec->num_workers + 1);
+  return p_dec;
+}
+
+/** mm_jpeg_swdec_destroy:
+ *
+ *  Arguments:
+ *    @p_dec: decoder
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Stops the workers and frees the decoder
+ *
+ **/
+void mm_jpeg_swdec_destroy(mm_jpeg_swdec_t *p_dec)
+{
+  uint32_t i;
+
+  if (NULL == p_dec)
+    return;
+
+  pthread_mutex_lock(&p_dec->lock);
+  p_dec->exit = 1;
+  pthread_cond_broadcast(&p_dec->work_cond);
+  pthread_mutex_unlock(&p_dec->lock);
+
+  for (i = 0; i < p_dec->num_workers; i++) {
+    pthread_join(p_dec->pid[i], NULL);
+  }
+  free(p_dec->segs);
+
+  pthread_cond_destroy(&p_dec->done_cond);
+  pthread_cond_destroy(&p_dec->work_cond);
+  pthread_mutex_destroy(&p_dec->lock);
+  pthread_mutex_destroy(&p_dec->dec_lock);
+  free(p_dec);
+}
+
+/** mm_jpeg_swdec_get_info:
+ *
+ *  Arguments:
+ *    @p_jpeg: jpeg image
+ *    @size: size of the image
+ *    @p_width: image width
+ *    @p_height: image height
+ *
+ *  Return:
+ *       0 if the software decoder can decode the image, -1
+ *       otherwise
+ *
+ *  Description:
+ *       Checks the headers without decoding anything
+ *
+ **/
+int32_t mm_jpeg_swdec_get_info(const uint8_t *p_jpeg, uint32_t size,
+  uint32_t *p_width, uint32_t *p_height)
+{
+  mm_jpeg_swdec_frame_t frame;
+
+  if (!p_jpeg || mm_jpeg_swdec_parse(p_jpeg, size, &frame, NULL)) {
+    return -1;
+  }
+  if (p_width)
+    *p_width = frame.width;
+  if (p_height)
+    *p_height = frame.height;
+  return 0;
+}
+
+/** mm_jpeg_swdec_decode:
+ *
+ *  Arguments:
+ *    @p_dec: decoder
+ *    @p_jpeg: jpeg image
+ *    @size: size of the image
+ *    @p_out: output image
+ *    @p_stats: statistics of the decode, may be NULL
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Decodes a baseline image to 4:2:0 semi planar. The restart
+ *       intervals are decoded in parallel.
+ *
+ **/
+int32_t mm_jpeg_swdec_decode(mm_jpeg_swdec_t *p_dec,
+  const uint8_t *p_jpeg,
+  uint32_t size,
+  const mm_jpeg_swdec_output_t *p_out,
+  mm_jpeg_swdec_stats_t *p_stats)
+{
+  struct timespec start, end;
+  mm_jpeg_swdec_frame_t *p_frame;
+  uint32_t t, i, row, col, tasks;
+  int32_t rc = 0;
+
+  if (!p_dec || !p_jpeg || !p_out || !p_out->p_y || !p_out->p_cbcr) {
+    CDBG_ERROR("%s:%d] invalid params", __func__, __LINE__);
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_mutex_lock(&p_dec->dec_lock);
+
+  p_frame = &p_dec->frame;
+  if (mm_jpeg_swdec_parse(p_jpeg, size, p_frame, p_dec)) {
+    rc = -1;
+    goto done;
+  }
+  if ((p_frame->width > p_out->width) || (p_frame->height > p_out->height) ||
+    (p_out->y_stride < p_frame->width) ||
+    (p_out->cbcr_stride < ((p_frame->width + 1) & ~1U))) {
+    CDBG_ERROR("%s:%d] image %dx%d does not fit the output %dx%d",
+      __func__, __LINE__, p_frame->width, p_frame->height, p_out->width,
+      p_out->height);
+    rc = -1;
+    goto done;
+  }
+
+  p_dec->p_out = p_out;
+  p_dec->hmax = p_frame->comps[0].h;
+  p_dec->vmax = p_frame->comps[0].v;
+  p_dec->mcu_w = p_dec->hmax * 8;
+  p_dec->mcu_h = p_dec->vmax * 8;
+  p_dec->mcus_x = (p_frame->width + p_dec->mcu_w - 1) / p_dec->mcu_w;
+  p_dec->total_mcus = p_dec->mcus_x *
+    ((p_frame->height + p_dec->mcu_h - 1) / p_dec->mcu_h);
+
+  for (t = 0; t < 4; t++) {
+    if (!(p_frame->qt_mask & (1U << t)))
+      continue;
+    for (i = 0; i < 64; i++) {
+      row = i >> 3;
+      col = i & 7;
+      p_dec->dequant[t][i] = (float)p_frame->qtbl[t][i] *
+        mm_jpeg_swdec_aan_scale[row] * mm_jpeg_swdec_aan_scale[col] / 8.0f;
+    }
+  }
+
+  if (mm_jpeg_swdec_find_segs(p_dec)) {
+    rc = -1;
+    goto done;
+  }
+
+  /* a few tasks per thread keeps the threads balanced */
+  tasks = (p_dec->num_workers + 1) * 4;
+  p_dec->segs_per_task = (p_dec->num_segs + tasks - 1) / tasks;
+
+  /* kick the workers and take a share of the intervals */
+  pthread_mutex_lock(&p_dec->lock);
+  p_dec->num_tasks = (p_dec->num_segs + p_dec->segs_per_task - 1) /
+    p_dec->segs_per_task;
+  p_dec->next_task = 0;
+  p_dec->tasks_done = 0;
+  p_dec->rc = 0;
+  if (p_dec->num_tasks > 1) {
+    p_dec->work_gen++;
+    pthread_cond_broadcast(&p_dec->work_cond);
+  }
+  pthread_mutex_unlock(&p_dec->lock);
+
+  mm_jpeg_swdec_run_tasks(p_dec);
+
+  pthread_mutex_lock(&p_dec->lock);
+  while (p_dec->tasks_done < p_dec->num_tasks) {
+    pthread_cond_wait(&p_dec->done_cond, &p_dec->lock);
+  }
+  rc = p_dec->rc;
+  pthread_mutex_unlock(&p_dec->lock);
+
+  if (p_stats && !rc) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    p_stats->width = p_frame->width;
+    p_stats->height = p_frame->height;
+    p_stats->num_slices = p_dec->num_segs;
+    p_stats->decode_us = (uint64_t)((int64_t)(end.tv_sec - start.tv_sec) *
+      1000000LL + (end.tv_nsec - start.tv_nsec) / 1000);
+  }
+
+done:
+  p_dec->p_out = NULL;
+  pthread_mutex_unlock(&p_dec->dec_lock);
+  return rc;
+}
@@ -0,0 +1,1078 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include "mm_jpeg_swenc.h"
+#include "mm_jpeg_dbg.h"
+
+/* worst case size of one entropy coded MCU, 6 blocks with every
+ * coefficient coded and byte stuffed */
+#define MM_JPEG_SWENC_MCU_MAX_BYTES (6 * 64 * 2 * 4)
+
+/* jpeg marker codes */
+#define M_SOI  0xD8
+#define M_EOI  0xD9
+#define M_APP0 0xE0
+#define M_DQT  0xDB
+#define M_SOF0 0xC0
+#define M_DHT  0xC4
+#define M_DRI  0xDD
+#define M_SOS  0xDA
+#define M_RST0 0xD0
+
+/* zigzag index to natural index */
+static const uint8_t mm_jpeg_swenc_natural_order[64] = {
+   0,  1,  8, 16,  9,  2,  3, 10,
+  17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34,
+  27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36,
+  29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46,
+  53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* ITU T.81 Annex K.1 quantization tables, natural order */
+static const uint8_t mm_jpeg_swenc_std_luma_qtbl[64] = {
+  16,  11,  10,  16,  24,  40,  51,  61,
+  12,  12,  14,  19,  26,  58,  60,  55,
+  14,  13,  16,  24,  40,  57,  69,  56,
+  14,  17,  22,  29,  51,  87,  80,  62,
+  18,  22,  37,  56,  68, 109, 103,  77,
+  24,  35,  55,  64,  81, 104, 113,  92,
+  49,  64,  78,  87, 103, 121, 120, 101,
+  72,  92,  95,  98, 112, 100, 103,  99
+};
+
+static const uint8_t mm_jpeg_swenc_std_chroma_qtbl[64] = {
+  17,  18,  24,  47,  99,  99,  99,  99,
+  18,  21,  26,  66,  99,  99,  99,  99,
+  24,  26,  56,  99,  99,  99,  99,  99,
+  47,  66,  99,  99,  99,  99,  99,  99,
+  99,  99,  99,  99,  99,  99,  99,  99,
+  99,  99,  99,  99,  99,  99,  99,  99,
+  99,  99,  99,  99,  99,  99,  99,  99,
+  99,  99,  99,  99,  99,  99,  99,  99
+};
+
+/* ITU T.81 Annex K.3 huffman tables, code counts for the lengths
+ * 1~16 followed by the symbols */
+static const uint8_t mm_jpeg_swenc_dc_luma_bits[16] = {
+  0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0
+};
+static const uint8_t mm_jpeg_swenc_dc_chroma_bits[16] = {
+  0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
+};
+static const uint8_t mm_jpeg_swenc_dc_vals[12] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+
+static const uint8_t mm_jpeg_swenc_ac_luma_bits[16] = {
+  0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d
+};
+static const uint8_t mm_jpeg_swenc_ac_luma_vals[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+  0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+  0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+  0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+  0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+  0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+  0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+  0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+  0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+  0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+  0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t mm_jpeg_swenc_ac_chroma_bits[16] = {
+  0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77
+};
+static const uint8_t mm_jpeg_swenc_ac_chroma_vals[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+  0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+  0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+  0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+  0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+  0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+  0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+  0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+  0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+  0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+  0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+/* AAN scale factors, cos(k*PI/16) * sqrt(2) for k > 0 */
+static const float mm_jpeg_swenc_aan_scale[8] = {
+  1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+  1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+/** mm_jpeg_swenc_huff_t:
+ *  @code: code of every symbol
+ *  @size: code length of every symbol
+ *
+ *  derived huffman table
+ **/
+typedef struct {
+  uint16_t code[256];
+  uint8_t size[256];
+} mm_jpeg_swenc_huff_t;
+
+/** mm_jpeg_swenc_slice_t:
+ *  @buf: entropy coded data of the slice
+ *  @size: allocated size of buf
+ *  @len: filled length of buf
+ *  @rc: 0 on success
+ *
+ *  one restart interval
+ **/
+typedef struct {
+  uint8_t *buf;
+  uint32_t size;
+  uint32_t len;
+  int32_t rc;
+} mm_jpeg_swenc_slice_t;
+
+/** mm_jpeg_swenc_bits_t:
+ *  @p_slice: slice being written
+ *  @acc: bit accumulator
+ *  @nbits: valid bits in acc
+ *
+ *  bit writer of a slice
+ **/
+typedef struct {
+  mm_jpeg_swenc_slice_t *p_slice;
+  uint32_t acc;
+  int nbits;
+} mm_jpeg_swenc_bits_t;
+
+struct mm_jpeg_swenc {
+  pthread_t pid[MM_JPEG_SWENC_MAX_THREADS];
+  uint32_t num_workers;
+
+  /* serializes the encode calls */
+  pthread_mutex_t enc_lock;
+
+  /* protects the work distribution below */
+  pthread_mutex_t lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  uint32_t work_gen;
+  int exit;
+  uint32_t next_slice;
+  uint32_t slices_done;
+
+  /* image being encoded */
+  const mm_jpeg_swenc_image_t *p_img;
+  uint32_t mcus_x;
+  uint32_t mcus_y;
+  uint32_t slice_rows;
+  uint32_t num_slices;
+  mm_jpeg_swenc_slice_t *slices;
+  uint32_t slices_alloc;
+
+  uint8_t qtbl[2][64];
+  float fdiv[2][64];
+  mm_jpeg_swenc_huff_t dc_huff[2];
+  mm_jpeg_swenc_huff_t ac_huff[2];
+};
+
+/** mm_jpeg_swenc_build_huff:
+ *
+ *  Arguments:
+ *    @p_huff: derived table
+ *    @bits: code counts per length
+ *    @vals: symbols
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Generates the code of every symbol (ITU T.81 Annex C)
+ *
+ **/
+static void mm_jpeg_swenc_build_huff(mm_jpeg_swenc_huff_t *p_huff,
+  const uint8_t *bits, const uint8_t *vals)
+{
+  uint32_t code = 0;
+  uint32_t len, i, k = 0;
+
+  memset(p_huff, 0, sizeof(*p_huff));
+  for (len = 1; len <= 16; len++) {
+    for (i = 0; i < bits[len - 1]; i++, k++) {
+      p_huff->code[vals[k]] = (uint16_t)code++;
+      p_huff->size[vals[k]] = (uint8_t)len;
+    }
+    code <<= 1;
+  }
+}
+
+/** mm_jpeg_swenc_set_quality:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @quality: jpeg quality 1~100
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Scales the standard tables the same way libjpeg does and
+ *       folds the AAN output scaling into the divisors
+ *
+ **/
+static void mm_jpeg_swenc_set_quality(mm_jpeg_swenc_t *p_enc,
+  uint32_t quality)
+{
+  const uint8_t *base[2] = {mm_jpeg_swenc_std_luma_qtbl,
+    mm_jpeg_swenc_std_chroma_qtbl};
+  uint32_t scale;
+  uint32_t t, i, row, col;
+  int32_t q;
+
+  if (quality < 1)
+    quality = 1;
+  if (quality > 100)
+    quality = 100;
+  scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+
+  for (t = 0; t < 2; t++) {
+    for (i = 0; i < 64; i++) {
+      q = ((int32_t)base[t][i] * (int32_t)scale + 50) / 100;
+      if (q < 1)
+        q = 1;
+      if (q > 255)
+        q = 255;
+      p_enc->qtbl[t][i] = (uint8_t)q;
+      row = i >> 3;
+      col = i & 7;
+      p_enc->fdiv[t][i] = 1.0f / ((float)q * mm_jpeg_swenc_aan_scale[row] *
+        mm_jpeg_swenc_aan_scale[col] * 8.0f);
+    }
+  }
+}
+
+/** mm_jpeg_swenc_fdct:
+ *
+ *  Arguments:
+ *    @data: 8x8 block, level shifted samples in, scaled
+ *      coefficients out
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Floating point AAN forward DCT, the output is scaled by
+ *       the factors folded into the quantization divisors
+ *
+ **/
+static void mm_jpeg_swenc_fdct(float *data)
+{
+  float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  float tmp10, tmp11, tmp12, tmp13;
+  float z1, z2, z3, z4, z5, z11, z13;
+  float *p;
+  int i;
+
+  /* rows, then columns */
+  for (i = 0; i < 16; i++) {
+    int step = (i < 8) ? 1 : 8;
+    p = (i < 8) ? &data[i * 8] : &data[i - 8];
+
+    tmp0 = p[0 * step] + p[7 * step];
+    tmp7 = p[0 * step] - p[7 * step];
+    tmp1 = p[1 * step] + p[6 * step];
+    tmp6 = p[1 * step] - p[6 * step];
+    tmp2 = p[2 * step] + p[5 * step];
+    tmp5 = p[2 * step] - p[5 * step];
+    tmp3 = p[3 * step] + p[4 * step];
+    tmp4 = p[3 * step] - p[4 * step];
+
+    /* even part */
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    p[0 * step] = tmp10 + tmp11;
+    p[4 * step] = tmp10 - tmp11;
+
+    z1 = (tmp12 + tmp13) * 0.707106781f;
+    p[2 * step] = tmp13 + z1;
+    p[6 * step] = tmp13 - z1;
+
+    /* odd part */
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+
+    z5 = (tmp10 - tmp12) * 0.382683433f;
+    z2 = 0.541196100f * tmp10 + z5;
+    z4 = 1.306562965f * tmp12 + z5;
+    z3 = tmp11 * 0.707106781f;
+
+    z11 = tmp7 + z3;
+    z13 = tmp7 - z3;
+
+    p[5 * step] = z13 + z2;
+    p[3 * step] = z13 - z2;
+    p[1 * step] = z11 + z4;
+    p[7 * step] = z11 - z4;
+  }
+}
+
+/** mm_jpeg_swenc_put_bits:
+ *
+ *  Arguments:
+ *    @p_bits: bit writer
+ *    @code: bits to write, right aligned
+ *    @size: number of bits, at most 16
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Appends bits to the slice with 0xFF byte stuffing. The
+ *       caller makes sure that the slice has room for one MCU.
+ *
+ **/
+static inline void mm_jpeg_swenc_put_bits(mm_jpeg_swenc_bits_t *p_bits,
+  uint32_t code, int size)
+{
+  mm_jpeg_swenc_slice_t *p_slice = p_bits->p_slice;
+  uint8_t byte;
+
+  p_bits->acc = (p_bits->acc << size) | (code & ((1U << size) - 1));
+  p_bits->nbits += size;
+  while (p_bits->nbits >= 8) {
+    p_bits->nbits -= 8;
+    byte = (uint8_t)(p_bits->acc >> p_bits->nbits);
+    p_slice->buf[p_slice->len++] = byte;
+    if (0xFF == byte) {
+      p_slice->buf[p_slice->len++] = 0;
+    }
+  }
+}
+
+/** mm_jpeg_swenc_flush_bits:
+ *
+ *  Arguments:
+ *    @p_bits: bit writer
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Pads the last byte of the slice with 1 bits
+ *
+ **/
+static void mm_jpeg_swenc_flush_bits(mm_jpeg_swenc_bits_t *p_bits)
+{
+  if (p_bits->nbits > 0) {
+    mm_jpeg_swenc_put_bits(p_bits, 0x7F, 8 - p_bits->nbits);
+  }
+  p_bits->acc = 0;
+  p_bits->nbits = 0;
+}
+
+/** mm_jpeg_swenc_num_bits:
+ *
+ *  Arguments:
+ *    @val: absolute value
+ *
+ *  Return:
+ *       magnitude category of the value
+ *
+ **/
+static inline int mm_jpeg_swenc_num_bits(uint32_t val)
+{
+  return val ? (32 - __builtin_clz(val)) : 0;
+}
+
+/** mm_jpeg_swenc_encode_block:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @p_bits: bit writer
+ *    @tbl: 0 for luma, 1 for chroma
+ *    @p_dc_pred: dc predictor of the component
+ *    @blk: level shifted samples
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Transforms, quantizes and huffman codes one block
+ *
+ **/
+static void mm_jpeg_swenc_encode_block(mm_jpeg_swenc_t *p_enc,
+  mm_jpeg_swenc_bits_t *p_bits, int tbl, int32_t *p_dc_pred, float *blk)
+{
+  const float *fdiv = p_enc->fdiv[tbl];
+  const mm_jpeg_swenc_huff_t *dc = &p_enc->dc_huff[tbl];
+  const mm_jpeg_swenc_huff_t *ac = &p_enc->ac_huff[tbl];
+  int32_t coef[64];
+  int32_t diff, val;
+  uint32_t mag;
+  int i, nb, run = 0;
+
+  mm_jpeg_swenc_fdct(blk);
+  for (i = 0; i < 64; i++) {
+    int n = mm_jpeg_swenc_natural_order[i];
+    /* round to nearest without a libm call */
+    coef[i] = (int32_t)(blk[n] * fdiv[n] + 16384.5f) - 16384;
+  }
+
+  diff = coef[0] - *p_dc_pred;
+  *p_dc_pred = coef[0];
+  mag = (uint32_t)((diff < 0) ? -diff : diff);
+  nb = mm_jpeg_swenc_num_bits(mag);
+  mm_jpeg_swenc_put_bits(p_bits, dc->code[nb], dc->size[nb]);
+  if (nb) {
+    val = (diff < 0) ? (diff - 1) : diff;
+    mm_jpeg_swenc_put_bits(p_bits, (uint32_t)val, nb);
+  }
+
+  for (i = 1; i < 64; i++) {
+    if (0 == coef[i]) {
+      run++;
+      continue;
+    }
+    while (run > 15) {
+      mm_jpeg_swenc_put_bits(p_bits, ac->code[0xF0], ac->size[0xF0]);
+      run -= 16;
+    }
+    mag = (uint32_t)((coef[i] < 0) ? -coef[i] : coef[i]);
+    nb = mm_jpeg_swenc_num_bits(mag);
+    mm_jpeg_swenc_put_bits(p_bits, ac->code[(run << 4) | nb],
+      ac->size[(run << 4) | nb]);
+    val = (coef[i] < 0) ? (coef[i] - 1) : coef[i];
+    mm_jpeg_swenc_put_bits(p_bits, (uint32_t)val, nb);
+    run = 0;
+  }
+  if (run > 0) {
+    mm_jpeg_swenc_put_bits(p_bits, ac->code[0x00], ac->size[0x00]);
+  }
+}
+
+/** mm_jpeg_swenc_load_block:
+ *
+ *  Arguments:
+ *    @p_plane: plane base
+ *    @stride: line stride
+ *    @step: distance between two samples of the component
+ *    @width: component width in samples
+ *    @height: component height in lines
+ *    @x0: left sample of the block
+ *    @y0: top line of the block
+ *    @blk: level shifted samples
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Reads an 8x8 block, edges are padded by replicating the
+ *       last column/line
+ *
+ **/
+static void mm_jpeg_swenc_load_block(const uint8_t *p_plane,
+  uint32_t stride, uint32_t step, uint32_t width, uint32_t height,
+  uint32_t x0, uint32_t y0, float *blk)
+{
+  const uint8_t *p_line;
+  uint32_t r, c, x, y;
+
+  if ((x0 + 8 <= width) && (y0 + 8 <= height)) {
+    for (r = 0; r < 8; r++) {
+      p_line = p_plane + (y0 + r) * stride + x0 * step;
+      for (c = 0; c < 8; c++) {
+        blk[r * 8 + c] = (float)((int)p_line[c * step] - 128);
+      }
+    }
+    return;
+  }
+
+  for (r = 0; r < 8; r++) {
+    y = (y0 + r < height) ? (y0 + r) : (height - 1);
+    p_line = p_plane + y * stride;
+    for (c = 0; c < 8; c++) {
+      x = (x0 + c < width) ? (x0 + c) : (width - 1);
+      blk[r * 8 + c] = (float)((int)p_line[x * step] - 128);
+    }
+  }
+}
+
+/** mm_jpeg_swenc_encode_slice:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @idx: slice index
+ *
+ *  Return:
+ *       None, the result is stored in the slice
+ *
+ *  Description:
+ *       Entropy codes the MCU rows of one restart interval. The
+ *       DC predictors start from zero as mandated after a restart
+ *       marker, so slices are independent of each other.
+ *
+ **/
+static void mm_jpeg_swenc_encode_slice(mm_jpeg_swenc_t *p_enc, uint32_t idx)
+{
+  const mm_jpeg_swenc_image_t *p_img = p_enc->p_img;
+  mm_jpeg_swenc_slice_t *p_slice = &p_enc->slices[idx];
+  mm_jpeg_swenc_bits_t bits;
+  uint32_t cw = (p_img->width + 1) >> 1;
+  uint32_t ch = (p_img->height + 1) >> 1;
+  uint32_t cb_off = p_img->cbcr_swap ? 1 : 0;
+  uint32_t cr_off = p_img->cbcr_swap ? 0 : 1;
+  uint32_t row, row_end, mx, new_size;
+  int32_t dc_pred[3];
+  float blk[64];
+  uint8_t *p_buf;
+
+  memset(&bits, 0, sizeof(bits));
+  bits.p_slice = p_slice;
+  p_slice->len = 0;
+  p_slice->rc = 0;
+  dc_pred[0] = dc_pred[1] = dc_pred[2] = 0;
+
+  row = idx * p_enc->slice_rows;
+  row_end = row + p_enc->slice_rows;
+  if (row_end > p_enc->mcus_y)
+    row_end = p_enc->mcus_y;
+
+  for (; row < row_end; row++) {
+    for (mx = 0; mx < p_enc->mcus_x; mx++) {
+      if (p_slice->size - p_slice->len < MM_JPEG_SWENC_MCU_MAX_BYTES) {
+        new_size = p_slice->size * 2 + MM_JPEG_SWENC_MCU_MAX_BYTES;
+        p_buf = (uint8_t *)realloc(p_slice->buf, new_size);
+        if (NULL == p_buf) {
+          CDBG_ERROR("%s:%d] slice %d realloc %d failed", __func__, __LINE__,
+            idx, new_size);
+          p_slice->rc = -1;
+          return;
+        }
+        p_slice->buf = p_buf;
+        p_slice->size = new_size;
+      }
+
+      /* 4 luma blocks, then Cb and Cr */
+      mm_jpeg_swenc_load_block(p_img->p_y, p_img->y_stride, 1,
+        p_img->width, p_img->height, mx * 16, row * 16, blk);
+      mm_jpeg_swenc_encode_block(p_enc, &bits, 0, &dc_pred[0], blk);
+      mm_jpeg_swenc_load_block(p_img->p_y, p_img->y_stride, 1,
+        p_img->width, p_img->height, mx * 16 + 8, row * 16, blk);
+      mm_jpeg_swenc_encode_block(p_enc, &bits, 0, &dc_pred[0], blk);
+      mm_jpeg_swenc_load_block(p_img->p_y, p_img->y_stride, 1,
+        p_img->width, p_img->height, mx * 16, row * 16 + 8, blk);
+      mm_jpeg_swenc_encode_block(p_enc, &bits, 0, &dc_pred[0], blk);
+      mm_jpeg_swenc_load_block(p_img->p_y, p_img->y_stride, 1,
+        p_img->width, p_img->height, mx * 16 + 8, row * 16 + 8, blk);
+      mm_jpeg_swenc_encode_block(p_enc, &bits, 0, &dc_pred[0], blk);
+
+      mm_jpeg_swenc_load_block(p_img->p_cbcr + cb_off, p_img->cbcr_stride, 2,
+        cw, ch, mx * 8, row * 8, blk);
+      mm_jpeg_swenc_encode_block(p_enc, &bits, 1, &dc_pred[1], blk);
+      mm_jpeg_swenc_load_block(p_img->p_cbcr + cr_off, p_img->cbcr_stride, 2,
+        cw, ch, mx * 8, row * 8, blk);
+      mm_jpeg_swenc_encode_block(p_enc, &bits, 1, &dc_pred[2], blk);
+    }
+  }
+  mm_jpeg_swenc_flush_bits(&bits);
+}
+
+/** mm_jpeg_swenc_run_slices:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Encodes slices until none is left, shared by the workers
+ *       and the calling thread
+ *
+ **/
+static void mm_jpeg_swenc_run_slices(mm_jpeg_swenc_t *p_enc)
+{
+  uint32_t idx;
+
+  while (1) {
+    pthread_mutex_lock(&p_enc->lock);
+    if (p_enc->next_slice >= p_enc->num_slices) {
+      pthread_mutex_unlock(&p_enc->lock);
+      break;
+    }
+    idx = p_enc->next_slice++;
+    pthread_mutex_unlock(&p_enc->lock);
+
+    mm_jpeg_swenc_encode_slice(p_enc, idx);
+
+    pthread_mutex_lock(&p_enc->lock);
+    p_enc->slices_done++;
+    if (p_enc->slices_done == p_enc->num_slices) {
+      pthread_cond_signal(&p_enc->done_cond);
+    }
+    pthread_mutex_unlock(&p_enc->lock);
+  }
+}
+
+/** mm_jpeg_swenc_worker:
+ *
+ *  Arguments:
+ *    @data: encoder
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Worker thread, picks up slices of every new image
+ *
+ **/
+static void *mm_jpeg_swenc_worker(void *data)
+{
+  mm_jpeg_swenc_t *p_enc = (mm_jpeg_swenc_t *)data;
+  uint32_t seen_gen = 0;
+
+  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_swenc", 0, 0, 0);
+
+  pthread_mutex_lock(&p_enc->lock);
+  while (1) {
+    while (!p_enc->exit && (seen_gen == p_enc->work_gen)) {
+      pthread_cond_wait(&p_enc->work_cond, &p_enc->lock);
+    }
+    if (p_enc->exit)
+      break;
+    seen_gen = p_enc->work_gen;
+    pthread_mutex_unlock(&p_enc->lock);
+
+    mm_jpeg_swenc_run_slices(p_enc);
+
+    pthread_mutex_lock(&p_enc->lock);
+  }
+  pthread_mutex_unlock(&p_enc->lock);
+  return NULL;
+}
+
+/** mm_jpeg_swenc_create:
+ *
+ *  Arguments:
+ *    @num_threads: number of threads encoding in parallel,
+ *      0 for the number of online cpus
+ *
+ *  Return:
+ *       encoder, NULL on failure
+ *
+ *  Description:
+ *       Creates the encoder and its worker threads. The thread
+ *       calling mm_jpeg_swenc_encode is one of the encoding threads.
+ *
+ **/
+mm_jpeg_swenc_t *mm_jpeg_swenc_create(uint32_t num_threads)
+{
+  mm_jpeg_swenc_t *p_enc;
+  long cpus;
+  uint32_t i;
+
+  if (0 == num_threads) {
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (cpus > 0) ? (uint32_t)cpus : 1;
+  }
+  if (num_threads > MM_JPEG_SWENC_MAX_THREADS)
+    num_threads = MM_JPEG_SWENC_MAX_THREADS;
+
+  p_enc = (mm_jpeg_swenc_t *)malloc(sizeof(*p_enc));
+  if (NULL == p_enc) {
+    CDBG_ERROR("%s:%d] no memory", __func__, __LINE__);
+    return NULL;
+  }
+  memset(p_enc, 0, sizeof(*p_enc));
+
+  pthread_mutex_init(&p_enc->enc_lock, NULL);
+  pthread_mutex_init(&p_enc->lock, NULL);
+  pthread_cond_init(&p_enc->work_cond, NULL);
+  pthread_cond_init(&p_enc->done_cond, NULL);
+
+  mm_jpeg_swenc_build_huff(&p_enc->dc_huff[0], mm_jpeg_swenc_dc_luma_bits,
+    mm_jpeg_swenc_dc_vals);
+  mm_jpeg_swenc_build_huff(&p_enc->dc_huff[1], mm_jpeg_swenc_dc_chroma_bits,
+    mm_jpeg_swenc_dc_vals);
+  mm_jpeg_swenc_build_huff(&p_enc->ac_huff[0], mm_jpeg_swenc_ac_luma_bits,
+    mm_jpeg_swenc_ac_luma_vals);
+  mm_jpeg_swenc_build_huff(&p_enc->ac_huff[1], mm_jpeg_swenc_ac_chroma_bits,
+    mm_jpeg_swenc_ac_chroma_vals);
+
+  for (i = 0; i < num_threads - 1; i++) {
+    if (pthread_create(&p_enc->pid[i], NULL, mm_jpeg_swenc_worker, p_enc)) {
+      CDBG_ERROR("%s:%d] worker %d create failed", __func__, __LINE__, i);
+      break;
+    }
+    p_enc->num_workers++;
+  }
+
+  CDBG_HIGH("%s:%d] software encoder with %d threads", __func__, __LINE__,
+    p_enc->num_workers + 1);
+  return p_enc;
+}
+
+/** mm_jpeg_swenc_destroy:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Stops the workers and frees the encoder
+ *
+ **/
+void mm_jpeg_swenc_destroy(mm_jpeg_swenc_t *p_enc)
+{
+  uint32_t i;
+
+  if (NULL == p_enc)
+    return;
+
+  pthread_mutex_lock(&p_enc->lock);
+  p_enc->exit = 1;
+  pthread_cond_broadcast(&p_enc->work_cond);
+  pthread_mutex_unlock(&p_enc->lock);
+
+  for (i = 0; i < p_enc->num_workers; i++) {
+    pthread_join(p_enc->pid[i], NULL);
+  }
+
+  for (i = 0; i < p_enc->slices_alloc; i++) {
+    free(p_enc->slices[i].buf);
+  }
+  free(p_enc->slices);
+
+  pthread_cond_destroy(&p_enc->done_cond);
+  pthread_cond_destroy(&p_enc->work_cond);
+  pthread_mutex_destroy(&p_enc->lock);
+  pthread_mutex_destroy(&p_enc->enc_lock);
+  free(p_enc);
+}
+
+/** mm_jpeg_swenc_max_size:
+ *
+ *  Arguments:
+ *    @width: image width
+ *    @height: image height
+ *
+ *  Return:
+ *       output buffer size which fits any practical image
+ *
+ **/
+uint32_t mm_jpeg_swenc_max_size(uint32_t width, uint32_t height)
+{
+  /* headers plus twice the raw 4:2:0 size */
+  return width * height * 3 + 4096;
+}
+
+/** mm_jpeg_swenc_write_headers:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @p_params: encode parameters
+ *    @p: output
+ *    @restart: restart interval in MCUs
+ *
+ *  Return:
+ *       number of bytes written
+ *
+ *  Description:
+ *       Writes SOI, JFIF APP0 or the caller's APP1, DQT, SOF0,
+ *       DHT, DRI and SOS
+ *
+ **/
+static uint32_t mm_jpeg_swenc_write_headers(mm_jpeg_swenc_t *p_enc,
+  const mm_jpeg_swenc_params_t *p_params, uint8_t *p, uint32_t restart)
+{
+  static const uint8_t jfif[] = {
+    0xFF, M_APP0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+    0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+  };
+  const uint8_t *bits[4] = {mm_jpeg_swenc_dc_luma_bits,
+    mm_jpeg_swenc_ac_luma_bits, mm_jpeg_swenc_dc_chroma_bits,
+    mm_jpeg_swenc_ac_chroma_bits};
+  const uint8_t *vals[4] = {mm_jpeg_swenc_dc_vals,
+    mm_jpeg_swenc_ac_luma_vals, mm_jpeg_swenc_dc_vals,
+    mm_jpeg_swenc_ac_chroma_vals};
+  const uint8_t cls[4] = {0x00, 0x10, 0x01, 0x11};
+  const mm_jpeg_swenc_image_t *p_img = p_enc->p_img;
+  uint8_t *p_start = p;
+  uint32_t t, i, n;
+
+  *p++ = 0xFF;
+  *p++ = M_SOI;
+  if (p_params->p_app1 && p_params->app1_len) {
+    memcpy(p, p_params->p_app1, p_params->app1_len);
+    p += p_params->app1_len;
+  } else {
+    memcpy(p, jfif, sizeof(jfif));
+    p += sizeof(jfif);
+  }
+
+  /* DQT, both tables in zigzag order */
+  *p++ = 0xFF;
+  *p++ = M_DQT;
+  *p++ = 0x00;
+  *p++ = 2 + 2 * 65;
+  for (t = 0; t < 2; t++) {
+    *p++ = (uint8_t)t;
+    for (i = 0; i < 64; i++) {
+      *p++ = p_enc->qtbl[t][mm_jpeg_swenc_natural_order[i]];
+    }
+  }
+
+  /* SOF0, Y 2x2 with table 0, Cb/Cr 1x1 with table 1 */
+  *p++ = 0xFF;
+  *p++ = M_SOF0;
+  *p++ = 0x00;
+  *p++ = 17;
+  *p++ = 8;
+  *p++ = (uint8_t)(p_img->height >> 8);
+  *p++ = (uint8_t)p_img->height;
+  *p++ = (uint8_t)(p_img->width >> 8);
+  *p++ = (uint8_t)p_img->width;
+  *p++ = 3;
+  *p++ = 1; *p++ = 0x22; *p++ = 0;
+  *p++ = 2; *p++ = 0x11; *p++ = 1;
+  *p++ = 3; *p++ = 0x11; *p++ = 1;
+
+  /* DHT, all four tables in one segment */
+  n = 2;
+  for (t = 0; t < 4; t++) {
+    n += 17;
+    for (i = 0; i < 16; i++)
+      n += bits[t][i];
+  }
+  *p++ = 0xFF;
+  *p++ = M_DHT;
+  *p++ = (uint8_t)(n >> 8);
+  *p++ = (uint8_t)n;
+  for (t = 0; t < 4; t++) {
+    *p++ = cls[t];
+    memcpy(p, bits[t], 16);
+    p += 16;
+    for (n = 0, i = 0; i < 16; i++)
+      n += bits[t][i];
+    memcpy(p, vals[t], n);
+    p += n;
+  }
+
+  /* DRI */
+  *p++ = 0xFF;
+  *p++ = M_DRI;
+  *p++ = 0x00;
+  *p++ = 4;
+  *p++ = (uint8_t)(restart >> 8);
+  *p++ = (uint8_t)restart;
+
+  /* SOS, all components interleaved */
+  *p++ = 0xFF;
+  *p++ = M_SOS;
+  *p++ = 0x00;
+  *p++ = 12;
+  *p++ = 3;
+  *p++ = 1; *p++ = 0x00;
+  *p++ = 2; *p++ = 0x11;
+  *p++ = 3; *p++ = 0x11;
+  *p++ = 0;
+  *p++ = 63;
+  *p++ = 0;
+
+  return (uint32_t)(p - p_start);
+}
+
+/** mm_jpeg_swenc_encode:
+ *
+ *  Arguments:
+ *    @p_enc: encoder
+ *    @p_img: input image
+ *    @p_params: encode parameters
+ *    @p_out: output buffer
+ *    @out_size: size of the output buffer
+ *    @p_out_len: filled length of the output buffer
+ *    @p_stats: statistics of the encode, may be NULL
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Encodes a baseline JFIF image. The slices are coded in
+ *       parallel and concatenated with RSTn markers in between.
+ *
+ **/
+int32_t mm_jpeg_swenc_encode(mm_jpeg_swenc_t *p_enc,
+  const mm_jpeg_swenc_image_t *p_img,
+  const mm_jpeg_swenc_params_t *p_params,
+  uint8_t *p_out,
+  uint32_t out_size,
+  uint32_t *p_out_len,
+  mm_jpeg_swenc_stats_t *p_stats)
+{
+  struct timespec start, end;
+  mm_jpeg_swenc_slice_t *p_slices;
+  uint32_t i, len, restart;
+  int32_t rc = 0;
+
+  if (!p_enc || !p_img || !p_params || !p_out || !p_out_len ||
+    !p_img->p_y || !p_img->p_cbcr || (0 == p_img->width) ||
+    (0 == p_img->height) || (p_img->width > 65535) ||
+    (p_img->height > 65535)) {
+    CDBG_ERROR("%s:%d] invalid params", __func__, __LINE__);
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_mutex_lock(&p_enc->enc_lock);
+
+  p_enc->p_img = p_img;
+  p_enc->mcus_x = (p_img->width + 15) >> 4;
+  p_enc->mcus_y = (p_img->height + 15) >> 4;
+  p_enc->slice_rows = p_params->slice_mcu_rows;
+  if (0 == p_enc->slice_rows) {
+    /* a few slices per thread keeps the threads balanced */
+    p_enc->slice_rows = p_enc->mcus_y / ((p_enc->num_workers + 1) * 4);
+  }
+  if (0 == p_enc->slice_rows)
+    p_enc->slice_rows = 1;
+  if (p_enc->slice_rows > p_enc->mcus_y)
+    p_enc->slice_rows = p_enc->mcus_y;
+  /* the restart interval is a 16 bit field */
+  if (p_enc->slice_rows * p_enc->mcus_x > 65535)
+    p_enc->slice_rows = 65535 / p_enc->mcus_x;
+  restart = p_enc->slice_rows * p_enc->mcus_x;
+  p_enc->num_slices = (p_enc->mcus_y + p_enc->slice_rows - 1) /
+    p_enc->slice_rows;
+
+  if (p_enc->num_slices > p_enc->slices_alloc) {
+    p_slices = (mm_jpeg_swenc_slice_t *)realloc(p_enc->slices,
+      p_enc->num_slices * sizeof(*p_slices));
+    if (NULL == p_slices) {
+      CDBG_ERROR("%s:%d] no memory for %d slices", __func__, __LINE__,
+        p_enc->num_slices);
+      rc = -1;
+      goto done;
+    }
+    memset(&p_slices[p_enc->slices_alloc], 0,
+      (p_enc->num_slices - p_enc->slices_alloc) * sizeof(*p_slices));
+    p_enc->slices = p_slices;
+    p_enc->slices_alloc = p_enc->num_slices;
+  }
+
+  mm_jpeg_swenc_set_quality(p_enc, p_params->quality);
+
+  /* kick the workers and take a share of the slices */
+  pthread_mutex_lock(&p_enc->lock);
+  p_enc->next_slice = 0;
+  p_enc->slices_done = 0;
+  p_enc->work_gen++;
+  pthread_cond_broadcast(&p_enc->work_cond);
+  pthread_mutex_unlock(&p_enc->lock);
+
+  mm_jpeg_swenc_run_slices(p_enc);
+
+  pthread_mutex_lock(&p_enc->lock);
+  while (p_enc->slices_done < p_enc->num_slices) {
+    pthread_cond_wait(&p_enc->done_cond, &p_enc->lock);
+  }
+  pthread_mutex_unlock(&p_enc->lock);
+
+  /* headers are < 1KB plus the APP1 segment */
+  if (out_size < 1024 + (p_params->p_app1 ? p_params->app1_len : 0)) {
+    CDBG_ERROR("%s:%d] output buffer too small %d", __func__, __LINE__,
+      out_size);
+    rc = -1;
+    goto done;
+  }
+  len = mm_jpeg_swenc_write_headers(p_enc, p_params, p_out, restart);
+
+  for (i = 0; i < p_enc->num_slices; i++) {
+    if (p_enc->slices[i].rc) {
+      rc = -1;
+      goto done;
+    }
+    if (len + p_enc->slices[i].len + 2 > out_size) {
+      CDBG_ERROR("%s:%d] output buffer too small %d", __func__, __LINE__,
+        out_size);
+      rc = -1;
+      goto done;
+    }
+    memcpy(p_out + len, p_enc->slices[i].buf, p_enc->slices[i].len);
+    len += p_enc->slices[i].len;
+    p_out[len++] = 0xFF;
+    p_out[len++] = (i == p_enc->num_slices - 1) ?
+      M_EOI : (uint8_t)(M_RST0 + (i & 7));
+  }
+  *p_out_len = len;
+
+  if (p_stats) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    p_stats->num_slices = p_enc->num_slices;
+    p_stats->slice_mcus = restart;
+    p_stats->encode_us = (uint64_t)((int64_t)(end.tv_sec - start.tv_sec) *
+      1000000LL + (end.tv_nsec - start.tv_nsec) / 1000);
+  }
+
+done:
+  p_enc->p_img = NULL;
+  pthread_mutex_unlock(&p_enc->enc_lock);
+  return rc;
+}
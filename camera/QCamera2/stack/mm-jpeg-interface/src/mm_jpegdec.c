@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <stdlib.h>
+#include <cutils/properties.h>
 
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg_interface.h"
@@ -99,12 +100,13 @@ static void mm_jpegdec_job_done(mm_jpeg_job_session_t *p_session)
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
     p_session->jobId);
   if (node) {
+    mm_jpeg_jobmgr_job_stats(my_obj, node);
     free(node);
   }
   p_session->encoding = OMX_FALSE;
 
   /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
+  mm_jpeg_jobmgr_release_slot(my_obj);
 }
 
 
@@ -660,6 +662,177 @@ error:
   return ret;
 }
 
+/** mm_jpegdec_omx_backend_decode:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session owning the OMX handle
+ *    @job_node: job node
+ *
+ *  Return:
+ *       OMX error values
+ *
+ *  Description:
+ *       Programs the OMX component, the result is delivered by
+ *       mm_jpegdec_fbd
+ *
+ **/
+static int32_t mm_jpegdec_omx_backend_decode(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, mm_jpeg_job_q_node_t *job_node)
+{
+  return (int32_t)mm_jpegdec_session_decode(p_session);
+}
+
+/** mm_jpegdec_swdec_backend_decode:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session of the job
+ *    @job_node: job node
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Decodes the job with the software decoder and sends the
+ *       jpeg callback
+ *
+ **/
+static int32_t mm_jpegdec_swdec_backend_decode(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, mm_jpeg_job_q_node_t *job_node)
+{
+  mm_jpeg_decode_params_t *p_params = &p_session->dec_params;
+  mm_jpeg_decode_job_t *p_job = &job_node->dec_info.decode_job;
+  mm_jpeg_buf_t *p_src = &p_params->src_main_buf[p_job->src_index];
+  mm_jpeg_buf_t *p_dst = &p_params->dest_buf[p_job->dst_index];
+  mm_jpeg_swdec_output_t out;
+  mm_jpeg_swdec_stats_t stats;
+  mm_jpeg_output_t output_buf;
+  jpeg_job_status_t status = JPEG_JOB_STATUS_DONE;
+  int32_t rc;
+
+  memset(&out, 0, sizeof(out));
+  out.y_stride = (uint32_t)p_dst->offset.mp[0].stride;
+  out.cbcr_stride = (uint32_t)p_dst->offset.mp[1].stride;
+  out.p_y = p_dst->buf_vaddr + p_dst->offset.mp[0].offset;
+  out.p_cbcr = p_dst->buf_vaddr + p_dst->offset.mp[0].len +
+    p_dst->offset.mp[1].offset;
+  out.width = p_session->swdec_dim.width;
+  out.height = p_session->swdec_dim.height;
+  out.cbcr_swap =
+    (MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2 == p_params->color_format) ? 1 : 0;
+
+  memset(&stats, 0, sizeof(stats));
+  rc = mm_jpeg_swdec_decode(my_obj->p_swdec, p_src->buf_vaddr,
+    p_src->buf_size, &out, &stats);
+  if (rc) {
+    CDBG_ERROR("%s:%d] software decode of job %x failed", __func__, __LINE__,
+      job_node->dec_info.job_id);
+    status = JPEG_JOB_STATUS_ERROR;
+  } else {
+    CDBG_HIGH("%s:%d] job %x %dx%d in %lld us, %d slices", __func__,
+      __LINE__, job_node->dec_info.job_id, stats.width, stats.height,
+      (long long)stats.decode_us, stats.num_slices);
+  }
+
+  if (NULL != p_params->jpeg_cb) {
+    memset(&output_buf, 0, sizeof(output_buf));
+    output_buf.buf_filled_len = p_dst->offset.mp[0].len +
+      p_dst->offset.mp[1].len;
+    if (output_buf.buf_filled_len > p_dst->buf_size)
+      output_buf.buf_filled_len = p_dst->buf_size;
+    output_buf.buf_vaddr = p_dst->buf_vaddr;
+    output_buf.fd = 0;
+    p_params->jpeg_cb(status,
+      p_session->client_hdl,
+      job_node->dec_info.job_id,
+      rc ? NULL : &output_buf,
+      p_params->userdata);
+  }
+
+  return rc;
+}
+
+static const mm_jpeg_dec_backend_t mm_jpegdec_omx_backend = {
+  "omx",
+  mm_jpegdec_omx_backend_decode,
+};
+
+static const mm_jpeg_dec_backend_t mm_jpegdec_swdec_backend = {
+  "sw",
+  mm_jpegdec_swdec_backend_decode,
+};
+
+/** mm_jpegdec_swdec_take_job:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: session of the job
+ *    @p_job: decode job
+ *
+ *  Return:
+ *       OMX_TRUE if the job goes to the software decoder
+ *
+ *  Description:
+ *       The software decoder handles baseline images decoded to
+ *       4:2:0 semi planar without rotation and scaling. Anything
+ *       else stays with the OMX decoder. The output size is kept
+ *       in the session, the job is left as queued.
+ *
+ **/
+static OMX_BOOL mm_jpegdec_swdec_take_job(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t *p_session, const mm_jpeg_decode_job_t *p_job)
+{
+  mm_jpeg_decode_params_t *p_params = &p_session->dec_params;
+  const mm_jpeg_dim_t *dim = &p_job->main_dim;
+  mm_jpeg_buf_t *p_src, *p_dst;
+  uint32_t width, height, y_stride, cbcr_stride;
+
+  if (NULL == my_obj->p_swdec) {
+    return OMX_FALSE;
+  }
+  if ((MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2 != p_params->color_format) &&
+    (MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V2 != p_params->color_format)) {
+    return OMX_FALSE;
+  }
+  if ((p_job->rotation != 0) ||
+    (p_job->src_index >= p_params->num_src_bufs) ||
+    (p_job->dst_index >= p_params->num_dst_bufs)) {
+    return OMX_FALSE;
+  }
+
+  p_src = &p_params->src_main_buf[p_job->src_index];
+  p_dst = &p_params->dest_buf[p_job->dst_index];
+  if (mm_jpeg_swdec_get_info(p_src->buf_vaddr, p_src->buf_size, &width,
+    &height)) {
+    return OMX_FALSE;
+  }
+  /* no destination size decodes to the size of the image */
+  if (((dim->dst_dim.width != 0) && (dim->dst_dim.height != 0)) &&
+    (((uint32_t)dim->dst_dim.width != width) ||
+    ((uint32_t)dim->dst_dim.height != height))) {
+    return OMX_FALSE;
+  }
+
+  /* both planes must fit the destination buffer */
+  y_stride = (uint32_t)p_dst->offset.mp[0].stride;
+  cbcr_stride = (uint32_t)p_dst->offset.mp[1].stride;
+  if ((y_stride < width) || (cbcr_stride < ((width + 1) & ~1U)) ||
+    (p_dst->offset.mp[0].offset + y_stride * (height - 1) + width >
+      p_dst->offset.mp[0].len) ||
+    (p_dst->offset.mp[0].len + p_dst->offset.mp[1].offset +
+      cbcr_stride * ((height - 1) / 2) + ((width + 1) & ~1U) >
+      p_dst->buf_size)) {
+    CDBG_HIGH("%s:%d] destination layout does not fit %dx%d", __func__,
+      __LINE__, width, height);
+    return OMX_FALSE;
+  }
+
+  p_session->swdec_dim.width = (int32_t)width;
+  p_session->swdec_dim.height = (int32_t)height;
+  return OMX_TRUE;
+}
+
 /** mm_jpegdec_process_decoding_job:
  *
  *  Arguments:
@@ -670,7 +843,10 @@ error:
  *       0 for success -1 otherwise
  *
  *  Description:
- *       Start the encoding job
+ *       Start the decoding job. Called with the job_lock held, the
+ *       lock is dropped while the backend runs. The OMX backend
+ *       completes the job from mm_jpegdec_fbd, the software backend
+ *       before returning.
  *
  **/
 int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t* job_node)
@@ -679,6 +855,8 @@ int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_
   OMX_ERRORTYPE ret = OMX_ErrorNone;
   mm_jpeg_job_session_t *p_session = NULL;
   mm_jpeg_job_q_node_t *node = NULL;
+  const mm_jpeg_dec_backend_t *p_backend = &mm_jpegdec_omx_backend;
+  uint32_t job_id = job_node->dec_info.job_id;
 
   /* check if valid session */
   p_session = mm_jpeg_get_session(my_obj, job_node->dec_info.job_id);
@@ -688,6 +866,12 @@ int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_
     return -1;
   }
 
+  if (mm_jpegdec_swdec_take_job(my_obj, p_session,
+    &job_node->dec_info.decode_job)) {
+    p_backend = &mm_jpegdec_swdec_backend;
+    job_node->sw_backend = OMX_TRUE;
+  }
+
   /* sent encode cmd to OMX, queue job into ongoing queue */
   rc = mm_jpeg_queue_enq(&my_obj->ongoing_job_q, job_node);
   if (rc) {
@@ -697,8 +881,34 @@ int32_t mm_jpegdec_process_decoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_
   }
 
   p_session->decode_job = job_node->dec_info.decode_job;
-  p_session->jobId = job_node->dec_info.job_id;
-  ret = mm_jpegdec_session_decode(p_session);
+  p_session->jobId = job_id;
+  CDBG("%s:%d] job %x on backend %s", __func__, __LINE__, job_id,
+    p_backend->name);
+
+  /* run the backend without holding the job lock so that jobs of
+   * other sessions can be dispatched meanwhile */
+  p_session->dispatch_cnt++;
+  pthread_mutex_unlock(&my_obj->job_lock);
+  rc = p_backend->decode(my_obj, p_session, job_node);
+  pthread_mutex_lock(&my_obj->job_lock);
+  p_session->dispatch_cnt--;
+  pthread_cond_broadcast(&my_obj->job_mgr.dispatch_cond);
+
+  if (p_backend == &mm_jpegdec_swdec_backend) {
+    /* the callback is out already, the node is gone if the job was
+     * aborted meanwhile */
+    node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->ongoing_job_q,
+      job_id);
+    if (node) {
+      mm_jpeg_jobmgr_job_stats(my_obj, node);
+      free(node);
+    }
+    mm_jpeg_jobmgr_release_slot(my_obj);
+    return rc;
+  }
+
+  ret = (OMX_ERRORTYPE)rc;
+  rc = 0;
   if (ret) {
     CDBG_ERROR("%s:%d] encode session failed", __func__, __LINE__);
     goto error;
@@ -797,11 +1007,9 @@ int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   node->dec_info.job_id = *job_id;
   node->dec_info.client_handle = p_session->client_hdl;
   node->type = MM_JPEG_CMD_TYPE_DECODE_JOB;
+  node->prio = job->decode_job.prio;
 
-  rc = mm_jpeg_queue_enq(&my_obj->job_mgr.job_queue, node);
-  if (0 == rc) {
-    cam_sem_post(&my_obj->job_mgr.job_sem);
-  }
+  rc = mm_jpeg_jobmgr_enqueue(my_obj, node);
 
   return rc;
 }
@@ -900,6 +1108,9 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
   uint32_t session_id = p_session->sessionId;
   pthread_mutex_lock(&my_obj->job_lock);
 
+  /* let the dispatcher programming this session finish first */
+  mm_jpeg_jobmgr_wait_dispatch(my_obj, p_session);
+
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
   node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.job_queue, session_id);
@@ -923,7 +1134,7 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
   pthread_mutex_unlock(&my_obj->job_lock);
 
   /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
+  mm_jpeg_jobmgr_release_slot(my_obj);
   CDBG("%s:%d] X", __func__, __LINE__);
 
   return rc;
@@ -1109,7 +1320,11 @@ int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
     /* find job that is OMX ongoing, ask OMX to abort the job */
     p_session = mm_jpeg_get_session(my_obj, node->dec_info.job_id);
     if (p_session) {
-      mm_jpeg_session_abort(p_session);
+      mm_jpeg_jobmgr_wait_dispatch(my_obj, p_session);
+      /* a software job is complete once the dispatch is over */
+      if (!node->sw_backend) {
+        mm_jpeg_session_abort(p_session);
+      }
     } else {
       CDBG_ERROR("%s:%d] Invalid job id 0x%x", __func__, __LINE__,
         node->dec_info.job_id);
@@ -1120,9 +1335,44 @@ int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
 
 abort_done:
   pthread_mutex_unlock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_release_slot(my_obj);
 
   return rc;
 }
+/** mm_jpegdec_swdec_backend_init:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       None
+ *
+ *  Description:
+ *       Creates the software decoder if enabled through
+ *       persist.camera.jpeg.swdec. The OMX decoder stays the only
+ *       backend if the software decoder can not be created.
+ *
+ **/
+static void mm_jpegdec_swdec_backend_init(mm_jpeg_obj *my_obj)
+{
+  char prop[PROPERTY_VALUE_MAX];
+
+  my_obj->p_swdec = NULL;
+
+  property_get("persist.camera.jpeg.swdec", prop, "0");
+  if (atoi(prop) <= 0) {
+    return;
+  }
+
+  property_get("persist.camera.jpeg.swdec_threads", prop, "0");
+  my_obj->p_swdec = mm_jpeg_swdec_create((uint32_t)atoi(prop));
+  if (NULL == my_obj->p_swdec) {
+    CDBG_ERROR("%s:%d] software decoder not available", __func__, __LINE__);
+    return;
+  }
+  CDBG_HIGH("%s:%d] software decoder enabled", __func__, __LINE__);
+}
+
 /** mm_jpegdec_init:
  *
  *  Arguments:
@@ -1149,11 +1399,15 @@ int32_t mm_jpegdec_init(mm_jpeg_obj *my_obj)
     return -1;
   }
 
+  mm_jpegdec_swdec_backend_init(my_obj);
+
   /* init job semaphore and launch jobmgr thread */
   CDBG("%s:%d] Launch jobmgr thread rc %d", __func__, __LINE__, rc);
   rc = mm_jpeg_jobmgr_thread_launch(my_obj);
   if (0 != rc) {
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    mm_jpeg_swdec_destroy(my_obj->p_swdec);
+    my_obj->p_swdec = NULL;
     return -1;
   }
 
@@ -1162,6 +1416,8 @@ int32_t mm_jpegdec_init(mm_jpeg_obj *my_obj)
     /* roll back in error case */
     CDBG_ERROR("%s:%d] OMX_Init failed (%d)", __func__, __LINE__, rc);
     mm_jpeg_jobmgr_thread_release(my_obj);
+    mm_jpeg_swdec_destroy(my_obj->p_swdec);
+    my_obj->p_swdec = NULL;
     mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
     pthread_mutex_destroy(&my_obj->job_lock);
   }
@@ -1191,6 +1447,10 @@ int32_t mm_jpegdec_deinit(mm_jpeg_obj *my_obj)
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
   }
 
+  /* the dispatchers are gone, no software job can be running */
+  mm_jpeg_swdec_destroy(my_obj->p_swdec);
+  my_obj->p_swdec = NULL;
+
   /* unload OMX engine */
   OMX_Deinit();
 
@@ -73,4 +73,47 @@ LOCAL_SHARED_LIBRARIES := liblog libcutils libdl libmmjpeg_interface
 
 include $(BUILD_EXECUTABLE)
 
+#software encoder host benchmark
+
+include $(CLEAR_VARS)
+LOCAL_PATH := $(MM_JPEG_TEST_PATH)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Werror -Wno-unused-parameter
+
+LOCAL_C_INCLUDES := $(MM_JPEG_TEST_PATH)
+LOCAL_C_INCLUDES += $(MM_JPEG_TEST_PATH)/../inc
+
+LOCAL_SRC_FILES := mm_jpeg_swenc_test.c ../src/mm_jpeg_swenc.c \
+  ../src/mm_jpeg_swdec.c
+
+LOCAL_MODULE           := mm-jpeg-swenc-test
+LOCAL_LDLIBS := -lpthread -lm
+
+include $(BUILD_HOST_EXECUTABLE)
+
+#exif arena and APP1 host test
+
+include $(CLEAR_VARS)
+LOCAL_PATH := $(MM_JPEG_TEST_PATH)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Werror -Wno-unused-parameter
+
+LOCAL_C_INCLUDES := $(MM_JPEG_TEST_PATH)
+LOCAL_C_INCLUDES += $(MM_JPEG_TEST_PATH)/../inc
+LOCAL_C_INCLUDES += $(MM_JPEG_TEST_PATH)/../../common
+LOCAL_C_INCLUDES += $(OMX_HEADER_DIR)
+LOCAL_C_INCLUDES += $(OMX_CORE_DIR)/qexif
+LOCAL_C_INCLUDES += $(OMX_CORE_DIR)/qomx_core
+
+LOCAL_SRC_FILES := mm_jpeg_exif_test.c ../src/mm_jpeg_exif_arena.c \
+  ../src/mm_jpeg_exif_app1.c
+
+LOCAL_MODULE           := mm-jpeg-exif-test
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_LDFLAGS := -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+
+include $(BUILD_HOST_EXECUTABLE)
+
 LOCAL_PATH := $(OLD_LOCAL_PATH)
@@ -0,0 +1,527 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Host test of the exif arena. Builds the exif table of a capture the
+ * way the HAL and the jpeg session do, counts the heap and arena
+ * allocations of each build, and compares with the per tag malloc
+ * builder the arena replaced. Links with --wrap so that only the heap
+ * calls of the exif builders are counted. The table is then written
+ * as the APP1 segment of the software encoder and parsed back. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mm_jpeg_exif_arena.h"
+#include "mm_jpeg_exif_app1.h"
+
+volatile uint32_t gMmJpegIntfLogLevel = 1;
+
+#define EXIF_TEST_MAKERNOTE_SIZE 512
+
+static uint32_t g_heap_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  g_heap_allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  g_heap_allocs++;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  g_heap_allocs++;
+  return __real_realloc(ptr, size);
+}
+
+typedef struct {
+  exif_tag_id_t tagid;
+  exif_tag_type_t type;
+  uint32_t count;
+  const void *data;
+} exif_test_tag_t;
+
+static rat_t g_focal = { 397, 100 };
+static rat_t g_lat[3] = { { 37, 1 }, { 25, 1 }, { 1940, 100 } };
+static rat_t g_lon[3] = { { 122, 1 }, { 5, 1 }, { 3060, 100 } };
+static rat_t g_alt = { 120, 1 };
+static rat_t g_gps_time[3] = { { 17, 1 }, { 42, 1 }, { 5, 1 } };
+static rat_t g_aperture = { 200, 100 };
+static rat_t g_exposure = { 1, 120 };
+static srat_t g_shutter = { 691, 100 };
+static srat_t g_brightness = { 320, 100 };
+static uint16_t g_iso = 100;
+static uint16_t g_one = 1;
+static uint16_t g_zero = 0;
+static uint8_t g_alt_ref = 0;
+static uint8_t g_scene_type = 1;
+static uint8_t g_makernote[EXIF_TEST_MAKERNOTE_SIZE];
+
+/* tags of QCamera2HardwareInterface::getExifData followed by the tags
+ * process_sensor_data and process_3a_data add in the session */
+static const exif_test_tag_t g_tags[] = {
+  { EXIFTAGID_EXIF_DATE_TIME_ORIGINAL, EXIF_ASCII, 20, "2015:03:14 17:42:05" },
+  { EXIFTAGID_FOCAL_LENGTH, EXIF_RATIONAL, 1, &g_focal },
+  { EXIFTAGID_ISO_SPEED_RATING, EXIF_SHORT, 1, &g_iso },
+  { EXIFTAGID_GPS_PROCESSINGMETHOD, EXIF_ASCII, 12, "ASCII\0\0\0GPS" },
+  { EXIFTAGID_GPS_LATITUDE, EXIF_RATIONAL, 3, g_lat },
+  { EXIFTAGID_GPS_LATITUDE_REF, EXIF_ASCII, 2, "N" },
+  { EXIFTAGID_GPS_LONGITUDE, EXIF_RATIONAL, 3, g_lon },
+  { EXIFTAGID_GPS_LONGITUDE_REF, EXIF_ASCII, 2, "W" },
+  { EXIFTAGID_GPS_ALTITUDE, EXIF_RATIONAL, 1, &g_alt },
+  { EXIFTAGID_GPS_ALTITUDE_REF, EXIF_BYTE, 1, &g_alt_ref },
+  { EXIFTAGID_GPS_DATESTAMP, EXIF_ASCII, 11, "2015:03:14" },
+  { EXIFTAGID_GPS_TIMESTAMP, EXIF_RATIONAL, 3, g_gps_time },
+  { EXIFTAGID_MAKE, EXIF_ASCII, 9, "motorola" },
+  { EXIFTAGID_MODEL, EXIF_ASCII, 8, "Nexus 6" },
+  { EXIFTAGID_APERTURE, EXIF_RATIONAL, 1, &g_aperture },
+  { EXIFTAGID_F_NUMBER, EXIF_RATIONAL, 1, &g_aperture },
+  { EXIFTAGID_FLASH, EXIF_SHORT, 1, &g_zero },
+  { EXIFTAGID_SENSING_METHOD, EXIF_SHORT, 1, &g_one },
+  { EXIFTAGID_FOCAL_LENGTH_35MM, EXIF_SHORT, 1, &g_one },
+  { EXIFTAGID_EXPOSURE_TIME, EXIF_RATIONAL, 1, &g_exposure },
+  { EXIFTAGID_SHUTTER_SPEED, EXIF_SRATIONAL, 1, &g_shutter },
+  { EXIFTAGID_WHITE_BALANCE, EXIF_SHORT, 1, &g_zero },
+  { EXIFTAGID_METERING_MODE, EXIF_SHORT, 1, &g_one },
+  { EXIFTAGID_EXPOSURE_PROGRAM, EXIF_SHORT, 1, &g_one },
+  { EXIFTAGID_EXPOSURE_MODE, EXIF_SHORT, 1, &g_zero },
+  { EXIFTAGID_SCENE_TYPE, EXIF_UNDEFINED, 1, &g_scene_type },
+  { EXIFTAGID_BRIGHTNESS, EXIF_SRATIONAL, 1, &g_brightness },
+  { EXIFTAGID_SCENE_CAPTURE_TYPE, EXIF_SHORT, 1, &g_zero },
+  { EXIFTAGID_ORIENTATION, EXIF_SHORT, 1, &g_one },
+  { EXIFTAGID_EXIF_MAKER_NOTE, EXIF_UNDEFINED, EXIF_TEST_MAKERNOTE_SIZE,
+    g_makernote },
+};
+
+#define NUM_TAGS (sizeof(g_tags) / sizeof(g_tags[0]))
+
+static uint32_t exif_test_elem_size(exif_tag_type_t type)
+{
+  switch (type) {
+  case EXIF_SHORT:
+    return sizeof(uint16_t);
+  case EXIF_LONG:
+  case EXIF_SLONG:
+    return sizeof(uint32_t);
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    return sizeof(rat_t);
+  default:
+    return sizeof(uint8_t);
+  }
+}
+
+/* tags whose payload does not fit inline in the entry */
+static int exif_test_has_payload(const exif_test_tag_t *p_tag)
+{
+  return (p_tag->count > 1) || (EXIF_ASCII == p_tag->type) ||
+    (EXIF_UNDEFINED == p_tag->type);
+}
+
+/* the builder the arena replaced: one malloc per multi-value tag */
+static int exif_test_malloc_entry(QEXIF_INFO_DATA *p_entry,
+  const exif_test_tag_t *p_tag)
+{
+  uint32_t size = p_tag->count * exif_test_elem_size(p_tag->type);
+  void *values;
+
+  p_entry->tag_id = p_tag->tagid;
+  p_entry->tag_entry.type = p_tag->type;
+  p_entry->tag_entry.count = p_tag->count;
+  p_entry->tag_entry.copy = 1;
+  if (!exif_test_has_payload(p_tag)) {
+    memcpy(&p_entry->tag_entry.data, p_tag->data, size);
+    return 0;
+  }
+  values = malloc(EXIF_ASCII == p_tag->type ? size + 1 : size);
+  if (!values) {
+    return -1;
+  }
+  memcpy(values, p_tag->data, size);
+  if (EXIF_ASCII == p_tag->type) {
+    ((char *)values)[size] = '\0';
+  }
+  p_entry->tag_entry.data._bytes = (uint8_t *)values;
+  return 0;
+}
+
+static void exif_test_malloc_release(QEXIF_INFO_DATA *p_entries,
+  uint32_t num)
+{
+  uint32_t i;
+
+  for (i = 0; i < num; i++) {
+    if (exif_test_has_payload(&g_tags[i])) {
+      free(p_entries[i].tag_entry.data._bytes);
+    }
+  }
+}
+
+static int exif_test_build(QOMX_EXIF_INFO *p_info,
+  mm_jpeg_exif_arena_t *p_arena)
+{
+  uint32_t i;
+
+  p_info->numOfEntries = 0;
+  for (i = 0; i < NUM_TAGS; i++) {
+    if (addExifEntry(p_info, p_arena, g_tags[i].tagid, g_tags[i].type,
+      g_tags[i].count, (void *)g_tags[i].data)) {
+      fprintf(stderr, "tag 0x%x failed\n", g_tags[i].tagid);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int exif_test_verify(QOMX_EXIF_INFO *p_info)
+{
+  uint32_t i, size;
+  const exif_tag_entry_t *p_entry;
+
+  if (p_info->numOfEntries != NUM_TAGS) {
+    fprintf(stderr, "%d entries, expected %d\n",
+      (int)p_info->numOfEntries, (int)NUM_TAGS);
+    return -1;
+  }
+  for (i = 0; i < NUM_TAGS; i++) {
+    p_entry = &p_info->exif_data[i].tag_entry;
+    size = g_tags[i].count * exif_test_elem_size(g_tags[i].type);
+    if ((p_info->exif_data[i].tag_id != g_tags[i].tagid) ||
+      (p_entry->type != g_tags[i].type) ||
+      (p_entry->count != g_tags[i].count)) {
+      fprintf(stderr, "tag %d header mismatch\n", i);
+      return -1;
+    }
+    if (exif_test_has_payload(&g_tags[i])) {
+      if (((uintptr_t)p_entry->data._bytes & 7) ||
+        memcmp(p_entry->data._bytes, g_tags[i].data, size) ||
+        ((EXIF_ASCII == g_tags[i].type) &&
+        p_entry->data._ascii[size] != '\0')) {
+        fprintf(stderr, "tag %d payload mismatch\n", i);
+        return -1;
+      }
+    } else if (memcmp(&p_entry->data, g_tags[i].data, size)) {
+      fprintf(stderr, "tag %d value mismatch\n", i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static uint64_t exif_test_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int exif_test_limits(mm_jpeg_exif_arena_t *p_arena)
+{
+  QEXIF_INFO_DATA entries[MM_JPEG_EXIF_MAX_ENTRIES];
+  QOMX_EXIF_INFO info;
+  static uint8_t big[MM_JPEG_EXIF_ARENA_SIZE + 1];
+  uint16_t value = 1;
+  uint32_t i;
+
+  info.exif_data = entries;
+  info.numOfEntries = 0;
+
+  /* a payload larger than the arena is refused, the arena is intact */
+  mm_jpeg_exif_arena_reset(p_arena);
+  if (!addExifEntry(&info, p_arena, EXIFTAGID_EXIF_MAKER_NOTE,
+    EXIF_UNDEFINED, sizeof(big), big) || p_arena->offset != 0) {
+    fprintf(stderr, "oversized tag accepted\n");
+    return -1;
+  }
+  /* the arena runs out once it is full */
+  info.numOfEntries = 0;
+  if (addExifEntry(&info, p_arena, EXIFTAGID_EXIF_MAKER_NOTE,
+    EXIF_UNDEFINED, MM_JPEG_EXIF_ARENA_SIZE, big) ||
+    !addExifEntry(&info, p_arena, EXIFTAGID_MAKE, EXIF_ASCII, 2, "x")) {
+    fprintf(stderr, "full arena not detected\n");
+    return -1;
+  }
+  /* the table holds MM_JPEG_EXIF_MAX_ENTRIES tags */
+  mm_jpeg_exif_arena_reset(p_arena);
+  info.numOfEntries = 0;
+  for (i = 0; i < MM_JPEG_EXIF_MAX_ENTRIES; i++) {
+    if (addExifEntry(&info, p_arena, EXIFTAGID_FLASH, EXIF_SHORT, 1,
+      &value)) {
+      fprintf(stderr, "entry %d refused\n", i);
+      return -1;
+    }
+  }
+  if (!addExifEntry(&info, p_arena, EXIFTAGID_FLASH, EXIF_SHORT, 1,
+    &value)) {
+    fprintf(stderr, "table overflow not detected\n");
+    return -1;
+  }
+  return 0;
+}
+
+static uint32_t exif_test_get16(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t exif_test_get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+    ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* returns the entry of the tag in the IFD at ifd_off, NULL if absent or
+ * if the IFD is not sorted */
+static const uint8_t *exif_test_find(const uint8_t *p_tiff, uint32_t len,
+  uint32_t ifd_off, uint16_t tag)
+{
+  const uint8_t *p_entry;
+  uint32_t i, num, prev = 0;
+
+  if (ifd_off + 2 > len) {
+    return NULL;
+  }
+  num = exif_test_get16(p_tiff + ifd_off);
+  if (ifd_off + 2 + num * 12 + 4 > len) {
+    return NULL;
+  }
+  for (i = 0; i < num; i++) {
+    p_entry = p_tiff + ifd_off + 2 + i * 12;
+    if (i && exif_test_get16(p_entry) <= prev) {
+      return NULL;
+    }
+    prev = exif_test_get16(p_entry);
+    if (prev == tag) {
+      return p_entry;
+    }
+  }
+  return NULL;
+}
+
+static int exif_test_app1(QOMX_EXIF_INFO *p_info)
+{
+  static uint8_t app1[MM_JPEG_EXIF_APP1_MAX_SIZE];
+  QEXIF_INFO_DATA override;
+  QOMX_EXIF_INFO tables[2];
+  const uint8_t *p_tiff = app1 + 10;
+  const uint8_t *p_entry, *p_value;
+  uint32_t len, tiff_len, ifd_off, count, size, i;
+  uint16_t iso = 400;
+
+  /* the second table replaces the iso of the first one */
+  mm_jpeg_exif_set_entry(&override, NULL, EXIFTAGID_ISO_SPEED_RATING,
+    EXIF_SHORT, 1, &iso);
+  tables[0] = *p_info;
+  tables[1].exif_data = &override;
+  tables[1].numOfEntries = 1;
+  if (mm_jpeg_exif_write_app1(tables, 2, app1, sizeof(app1), &len) ||
+    (len < 10 + 8) || (app1[0] != 0xFF) || (app1[1] != 0xE1) ||
+    (exif_test_get16(app1 + 2) != len - 2) ||
+    memcmp(app1 + 4, "Exif\0\0MM\0\x2A\0\0\0\x08", 14)) {
+    fprintf(stderr, "bad APP1 header\n");
+    return -1;
+  }
+  tiff_len = len - 10;
+
+  for (i = 0; i < NUM_TAGS; i++) {
+    /* IFD0, then the Exif IFD, then the GPS IFD */
+    ifd_off = 8;
+    if ((g_tags[i].tagid >> 16) >= EXPOSURE_TIME) {
+      p_entry = exif_test_find(p_tiff, tiff_len, 8, 0x8769);
+      ifd_off = p_entry ? exif_test_get32(p_entry + 8) : tiff_len;
+    } else if ((g_tags[i].tagid >> 16) < NEW_SUBFILE_TYPE) {
+      p_entry = exif_test_find(p_tiff, tiff_len, 8, 0x8825);
+      ifd_off = p_entry ? exif_test_get32(p_entry + 8) : tiff_len;
+    }
+    p_entry = exif_test_find(p_tiff, tiff_len, ifd_off,
+      (uint16_t)(g_tags[i].tagid & 0xFFFF));
+    if (!p_entry || exif_test_get16(p_entry + 2) != g_tags[i].type) {
+      fprintf(stderr, "APP1 tag %d missing\n", i);
+      return -1;
+    }
+    count = exif_test_get32(p_entry + 4);
+    size = count * exif_test_elem_size(g_tags[i].type);
+    p_value = (size <= 4) ? p_entry + 8 :
+      p_tiff + exif_test_get32(p_entry + 8);
+    if ((p_value + size > p_tiff + tiff_len) ||
+      (count < g_tags[i].count) || (count > g_tags[i].count + 1)) {
+      fprintf(stderr, "APP1 tag %d bad count %d\n", i, count);
+      return -1;
+    }
+    /* byte data is copied as is, check a few of the others by value */
+    if (((EXIF_ASCII == g_tags[i].type) ||
+      (EXIF_UNDEFINED == g_tags[i].type)) &&
+      memcmp(p_value, g_tags[i].data, g_tags[i].count)) {
+      fprintf(stderr, "APP1 tag %d payload mismatch\n", i);
+      return -1;
+    }
+    if ((EXIFTAGID_ISO_SPEED_RATING == g_tags[i].tagid) &&
+      (exif_test_get16(p_value) != iso)) {
+      fprintf(stderr, "APP1 iso %d not replaced\n", exif_test_get16(p_value));
+      return -1;
+    }
+    if ((EXIFTAGID_GPS_LATITUDE == g_tags[i].tagid) &&
+      ((exif_test_get32(p_value + 16) != g_lat[2].num) ||
+      (exif_test_get32(p_value + 20) != g_lat[2].denom))) {
+      fprintf(stderr, "APP1 latitude mismatch\n");
+      return -1;
+    }
+  }
+  fprintf(stderr, "%-25s%d bytes\n", "APP1: ", len);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  static mm_jpeg_exif_arena_t arena;
+  QEXIF_INFO_DATA entries[MM_JPEG_EXIF_MAX_ENTRIES];
+  QOMX_EXIF_INFO info;
+  uint32_t expected_allocs = 0, heap_allocs, arena_allocs, high_water;
+  uint32_t iterations = 100000, i, j;
+  uint64_t start_us, arena_us, malloc_us;
+  int c, ret = -1;
+
+  while ((c = getopt(argc, argv, "n:")) != -1) {
+    switch (c) {
+    case 'n':
+      iterations = (uint32_t)atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: program_name [-n ITERATIONS]\n");
+      return 1;
+    }
+  }
+  if (!iterations) {
+    iterations = 1;
+  }
+
+  for (i = 0; i < NUM_TAGS; i++) {
+    if (exif_test_has_payload(&g_tags[i])) {
+      expected_allocs++;
+    }
+  }
+  for (i = 0; i < EXIF_TEST_MAKERNOTE_SIZE; i++) {
+    g_makernote[i] = (uint8_t)i;
+  }
+
+  info.exif_data = entries;
+  memset(&arena, 0, sizeof(arena));
+
+  /* one build: no heap allocation, one arena allocation per payload */
+  g_heap_allocs = 0;
+  if (exif_test_build(&info, &arena)) {
+    goto exit;
+  }
+  heap_allocs = g_heap_allocs;
+  arena_allocs = arena.num_allocs;
+  high_water = arena.high_water;
+  if (exif_test_verify(&info)) {
+    goto exit;
+  }
+  if (heap_allocs != 0 || arena_allocs != expected_allocs) {
+    fprintf(stderr, "%d heap and %d arena allocations, expected 0 and %d\n",
+      heap_allocs, arena_allocs, expected_allocs);
+    goto exit;
+  }
+
+  /* the next job reuses the same storage */
+  mm_jpeg_exif_arena_reset(&arena);
+  g_heap_allocs = 0;
+  if (exif_test_build(&info, &arena) || exif_test_verify(&info) ||
+    g_heap_allocs != 0 || arena.num_allocs != expected_allocs ||
+    arena.high_water != high_water) {
+    fprintf(stderr, "rebuild after reset differs\n");
+    goto exit;
+  }
+
+  /* the per tag malloc builder, for comparison */
+  g_heap_allocs = 0;
+  for (j = 0; j < NUM_TAGS; j++) {
+    if (exif_test_malloc_entry(&entries[j], &g_tags[j])) {
+      goto exit;
+    }
+  }
+  info.numOfEntries = NUM_TAGS;
+  if (exif_test_verify(&info) || g_heap_allocs != expected_allocs) {
+    fprintf(stderr, "malloc builder: %d heap allocations\n", g_heap_allocs);
+    exif_test_malloc_release(entries, NUM_TAGS);
+    goto exit;
+  }
+  exif_test_malloc_release(entries, NUM_TAGS);
+
+  start_us = exif_test_now_us();
+  for (i = 0; i < iterations; i++) {
+    mm_jpeg_exif_arena_reset(&arena);
+    exif_test_build(&info, &arena);
+  }
+  arena_us = exif_test_now_us() - start_us;
+
+  start_us = exif_test_now_us();
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < NUM_TAGS; j++) {
+      exif_test_malloc_entry(&entries[j], &g_tags[j]);
+    }
+    exif_test_malloc_release(entries, NUM_TAGS);
+  }
+  malloc_us = exif_test_now_us() - start_us;
+
+  if (exif_test_limits(&arena)) {
+    goto exit;
+  }
+
+  mm_jpeg_exif_arena_reset(&arena);
+  if (exif_test_build(&info, &arena) || exif_test_app1(&info)) {
+    goto exit;
+  }
+
+  fprintf(stderr, "%-25s%d tags, %d with payload\n", "Exif: ",
+    (int)NUM_TAGS, expected_allocs);
+  fprintf(stderr, "%-25s%d heap, %d arena, %d of %d bytes\n",
+    "Arena allocations: ", heap_allocs, arena_allocs, high_water,
+    MM_JPEG_EXIF_ARENA_SIZE);
+  fprintf(stderr, "%-25s%d heap\n", "Malloc allocations: ", expected_allocs);
+  fprintf(stderr, "%-25s%.3f us arena, %.3f us malloc\n", "Build time: ",
+    (double)arena_us / iterations, (double)malloc_us / iterations);
+  ret = 0;
+
+exit:
+  fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+  return ret;
+}
@@ -0,0 +1,333 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Host test and benchmark of the software jpeg encoder. Encodes a
+ * NV21/NV12 file, or a generated pattern when no input is given, and
+ * reports the throughput. The output is decoded again and fails the
+ * test if its PSNR against the input is below the limit. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mm_jpeg_swenc.h"
+#include "mm_jpeg_swdec.h"
+
+volatile uint32_t gMmJpegIntfLogLevel = 1;
+
+typedef struct {
+  char *filename;
+  char *out_filename;
+  uint32_t width;
+  uint32_t height;
+  uint32_t quality;
+  uint32_t threads;
+  uint32_t slice_rows;
+  uint32_t iterations;
+  double min_psnr;
+  int nv12;
+} swenc_test_input_t;
+
+static void mm_jpeg_swenc_test_print_usage()
+{
+  fprintf(stderr, "Usage: program_name [options]\n");
+  fprintf(stderr, "Mandatory options:\n");
+  fprintf(stderr, "  -W WIDTH\t\tinput image width\n");
+  fprintf(stderr, "  -H HEIGHT\t\tinput image height\n");
+  fprintf(stderr, "Optional:\n");
+  fprintf(stderr, "  -I FILE\t\tNV21 input, a pattern is generated if absent\n");
+  fprintf(stderr, "  -O FILE\t\tjpeg output of the last iteration\n");
+  fprintf(stderr, "  -Q QUALITY\t\tjpeg quality, default 85\n");
+  fprintf(stderr, "  -t THREADS\t\tencoding threads, default online cpus\n");
+  fprintf(stderr, "  -r ROWS\t\tMCU rows per restart interval\n");
+  fprintf(stderr, "  -n COUNT\t\tnumber of iterations, default 10\n");
+  fprintf(stderr, "  -P PSNR\t\tmin PSNR of the decoded image, default 30 dB\n");
+  fprintf(stderr, "  -C\t\t\tinput is NV12\n");
+  fprintf(stderr, "\n");
+}
+
+static int mm_jpeg_swenc_test_get_input(int argc, char *argv[],
+  swenc_test_input_t *p_test)
+{
+  int c;
+
+  while ((c = getopt(argc, argv, "I:O:W:H:Q:t:r:n:P:C")) != -1) {
+    switch (c) {
+    case 'I':
+      p_test->filename = optarg;
+      break;
+    case 'O':
+      p_test->out_filename = optarg;
+      break;
+    case 'W':
+      p_test->width = (uint32_t)atoi(optarg);
+      break;
+    case 'H':
+      p_test->height = (uint32_t)atoi(optarg);
+      break;
+    case 'Q':
+      p_test->quality = (uint32_t)atoi(optarg);
+      break;
+    case 't':
+      p_test->threads = (uint32_t)atoi(optarg);
+      break;
+    case 'r':
+      p_test->slice_rows = (uint32_t)atoi(optarg);
+      break;
+    case 'n':
+      p_test->iterations = (uint32_t)atoi(optarg);
+      break;
+    case 'P':
+      p_test->min_psnr = atof(optarg);
+      break;
+    case 'C':
+      p_test->nv12 = 1;
+      break;
+    default:
+      return 1;
+    }
+  }
+  if (!p_test->width || !p_test->height || !p_test->iterations) {
+    return 1;
+  }
+  return 0;
+}
+
+static int mm_jpeg_swenc_test_load(swenc_test_input_t *p_test, uint8_t *p_yuv,
+  uint32_t size)
+{
+  FILE *fp;
+  uint32_t x, y;
+  uint32_t cbcr_stride = (p_test->width + 1) & ~1U;
+  uint8_t *p_cbcr;
+
+  if (p_test->filename) {
+    fp = fopen(p_test->filename, "rb");
+    if (!fp) {
+      fprintf(stderr, "cannot open %s\n", p_test->filename);
+      return -1;
+    }
+    if (fread(p_yuv, 1, size, fp) != size) {
+      fprintf(stderr, "%s is shorter than %d bytes\n", p_test->filename, size);
+      fclose(fp);
+      return -1;
+    }
+    fclose(fp);
+    return 0;
+  }
+
+  /* gradients with some texture */
+  p_cbcr = p_yuv + p_test->width * p_test->height;
+  for (y = 0; y < p_test->height; y++) {
+    for (x = 0; x < p_test->width; x++) {
+      p_yuv[y * p_test->width + x] =
+        (uint8_t)((x + y) / 4 + (((x ^ y) & 8) ? 24 : 0));
+    }
+  }
+  for (y = 0; y < (p_test->height + 1) / 2; y++) {
+    for (x = 0; x < (p_test->width + 1) / 2; x++) {
+      p_cbcr[y * cbcr_stride + 2 * x] = (uint8_t)(x * 255 / p_test->width);
+      p_cbcr[y * cbcr_stride + 2 * x + 1] =
+        (uint8_t)(y * 255 / p_test->height);
+    }
+  }
+  return 0;
+}
+
+/* PSNR in dB of a plane, 99 dB if identical */
+static double mm_jpeg_swenc_test_psnr(const uint8_t *p_a, const uint8_t *p_b,
+  uint32_t width, uint32_t height, uint32_t stride)
+{
+  uint64_t sse = 0;
+  uint32_t x, y;
+  int d;
+
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      d = p_a[y * stride + x] - p_b[y * stride + x];
+      sse += (uint64_t)(d * d);
+    }
+  }
+  if (!sse) {
+    return 99.0;
+  }
+  return 10.0 * log10(255.0 * 255.0 * width * height / (double)sse);
+}
+
+/* Decodes the jpeg and compares it with the source image */
+static int mm_jpeg_swenc_test_verify(swenc_test_input_t *p_test,
+  const mm_jpeg_swenc_image_t *p_img, const uint8_t *p_jpeg, uint32_t len,
+  uint8_t *p_dec_yuv)
+{
+  mm_jpeg_swdec_t *p_dec;
+  mm_jpeg_swdec_output_t out;
+  mm_jpeg_swdec_stats_t stats;
+  double psnr_y, psnr_c;
+  int ret = -1;
+
+  p_dec = mm_jpeg_swdec_create(p_test->threads);
+  if (!p_dec) {
+    return -1;
+  }
+  memset(&out, 0, sizeof(out));
+  out.p_y = p_dec_yuv;
+  out.p_cbcr = p_dec_yuv + (p_img->p_cbcr - p_img->p_y);
+  out.y_stride = p_img->y_stride;
+  out.cbcr_stride = p_img->cbcr_stride;
+  out.width = p_img->width;
+  out.height = p_img->height;
+  out.cbcr_swap = p_img->cbcr_swap;
+  if (mm_jpeg_swdec_decode(p_dec, p_jpeg, len, &out, &stats)) {
+    fprintf(stderr, "decode failed\n");
+    goto exit;
+  }
+  if ((stats.width != p_img->width) || (stats.height != p_img->height)) {
+    fprintf(stderr, "decoded %dx%d, expected %dx%d\n", stats.width,
+      stats.height, p_img->width, p_img->height);
+    goto exit;
+  }
+
+  psnr_y = mm_jpeg_swenc_test_psnr(p_img->p_y, out.p_y, p_img->width,
+    p_img->height, p_img->y_stride);
+  psnr_c = mm_jpeg_swenc_test_psnr(p_img->p_cbcr, out.p_cbcr,
+    p_img->cbcr_stride, (p_img->height + 1) / 2, p_img->cbcr_stride);
+  fprintf(stderr, "%-25sY %.1f dB, CbCr %.1f dB (min %.1f dB)\n", "PSNR: ",
+    psnr_y, psnr_c, p_test->min_psnr);
+  if ((psnr_y < p_test->min_psnr) || (psnr_c < p_test->min_psnr)) {
+    goto exit;
+  }
+  ret = 0;
+
+exit:
+  mm_jpeg_swdec_destroy(p_dec);
+  return ret;
+}
+
+int main(int argc, char *argv[])
+{
+  swenc_test_input_t test;
+  mm_jpeg_swenc_t *p_enc = NULL;
+  mm_jpeg_swenc_image_t img;
+  mm_jpeg_swenc_params_t params;
+  mm_jpeg_swenc_stats_t stats;
+  uint8_t *p_yuv = NULL, *p_out = NULL, *p_dec_yuv = NULL;
+  uint32_t yuv_size, cbcr_stride, out_size, out_len = 0, i;
+  uint64_t total_us = 0, min_us = (uint64_t)-1;
+  FILE *fp;
+  int ret = -1;
+
+  memset(&test, 0, sizeof(test));
+  test.quality = 85;
+  test.iterations = 10;
+  test.min_psnr = 30.0;
+  if (mm_jpeg_swenc_test_get_input(argc, argv, &test)) {
+    mm_jpeg_swenc_test_print_usage();
+    return 1;
+  }
+
+  /* chroma lines hold whole CbCr pairs */
+  cbcr_stride = (test.width + 1) & ~1U;
+  yuv_size = test.width * test.height + cbcr_stride * ((test.height + 1) / 2);
+  out_size = mm_jpeg_swenc_max_size(test.width, test.height);
+  p_yuv = (uint8_t *)malloc(yuv_size);
+  p_out = (uint8_t *)malloc(out_size);
+  p_dec_yuv = (uint8_t *)malloc(yuv_size);
+  if (!p_yuv || !p_out || !p_dec_yuv) {
+    fprintf(stderr, "no memory\n");
+    goto exit;
+  }
+  if (mm_jpeg_swenc_test_load(&test, p_yuv, yuv_size)) {
+    goto exit;
+  }
+
+  p_enc = mm_jpeg_swenc_create(test.threads);
+  if (!p_enc) {
+    goto exit;
+  }
+
+  memset(&img, 0, sizeof(img));
+  img.p_y = p_yuv;
+  img.p_cbcr = p_yuv + test.width * test.height;
+  img.width = test.width;
+  img.height = test.height;
+  img.y_stride = test.width;
+  img.cbcr_stride = cbcr_stride;
+  img.cbcr_swap = test.nv12 ? 0 : 1;
+
+  memset(&params, 0, sizeof(params));
+  params.quality = test.quality;
+  params.slice_mcu_rows = test.slice_rows;
+
+  for (i = 0; i < test.iterations; i++) {
+    if (mm_jpeg_swenc_encode(p_enc, &img, &params, p_out, out_size,
+      &out_len, &stats)) {
+      fprintf(stderr, "encode %d failed\n", i);
+      goto exit;
+    }
+    total_us += stats.encode_us;
+    if (stats.encode_us < min_us)
+      min_us = stats.encode_us;
+  }
+
+  fprintf(stderr, "%-25s%dx%d q%d\n", "Image: ", test.width, test.height,
+    test.quality);
+  fprintf(stderr, "%-25s%d x %d MCUs\n", "Restart intervals: ",
+    stats.num_slices, stats.slice_mcus);
+  fprintf(stderr, "%-25s%d bytes\n", "Output size: ", out_len);
+  fprintf(stderr, "%-25s%llu us (min %llu us)\n", "Average encode: ",
+    (unsigned long long)(total_us / test.iterations),
+    (unsigned long long)min_us);
+  fprintf(stderr, "%-25s%.1f MP/s\n", "Throughput: ",
+    (double)test.width * test.height * test.iterations /
+    (total_us ? (double)total_us : 1.0));
+
+  if (mm_jpeg_swenc_test_verify(&test, &img, p_out, out_len, p_dec_yuv)) {
+    goto exit;
+  }
+
+  if (test.out_filename) {
+    fp = fopen(test.out_filename, "wb");
+    if (!fp) {
+      fprintf(stderr, "cannot open %s\n", test.out_filename);
+      goto exit;
+    }
+    fwrite(p_out, 1, out_len, fp);
+    fclose(fp);
+  }
+  ret = 0;
+
+exit:
+  mm_jpeg_swenc_destroy(p_enc);
+  free(p_dec_yuv);
+  free(p_out);
+  free(p_yuv);
+  fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+  return ret ? 1 : 0;
+}
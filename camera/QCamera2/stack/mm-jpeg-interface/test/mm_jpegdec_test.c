@@ -31,6 +31,9 @@
 #include "mm_jpeg_ionbuf.h"
 #include <sys/time.h>
 #include <stdlib.h>
+#include <dirent.h>
+#include <limits.h>
+#include <strings.h>
 
 #define MIN(a,b)  (((a) < (b)) ? (a) : (b))
 #define MAX(a,b)  (((a) > (b)) ? (a) : (b))
@@ -39,6 +42,8 @@
 #define TIME_IN_US(r) ((uint64_t)r.tv_sec * 1000000LL + r.tv_usec)
 struct timeval dtime[2];
 
+#define MAX_DEC_JOBS 32
+
 
 /** DUMP_TO_FILE:
  *  @filename: file name
@@ -65,6 +70,8 @@ typedef struct {
   int height;
   char *out_filename;
   int format;
+  char *dirname;
+  uint64_t decode_us;
 } jpeg_test_input_t;
 
 typedef struct {
@@ -79,7 +86,7 @@ typedef struct {
   int use_ion;
   uint32_t handle;
   mm_jpegdec_ops_t ops;
-  uint32_t job_id[5];
+  uint32_t job_id[MAX_DEC_JOBS];
   mm_jpeg_decode_params_t params;
   mm_jpeg_job_t job;
   uint32_t session_id;
@@ -122,13 +129,19 @@ static void mm_jpegdec_decode_callback(jpeg_job_status_t status,
     CDBG_ERROR("%s:%d] Decode success file%s addr %p len %d",
       __func__, __LINE__, p_obj->out_filename,
       p_output->buf_vaddr, p_output->buf_filled_len);
-    DUMP_TO_FILE(p_obj->out_filename, p_output->buf_vaddr, p_output->buf_filled_len);
+    if (p_obj->out_filename) {
+      DUMP_TO_FILE(p_obj->out_filename, p_output->buf_vaddr,
+        p_output->buf_filled_len);
+    }
   }
+  /* the callback may come before the test thread waits */
+  pthread_mutex_lock(&p_obj->lock);
   g_i++;
   if (g_i >= g_count) {
     CDBG_ERROR("%s:%d] Signal the thread", __func__, __LINE__);
     pthread_cond_signal(&p_obj->cond);
   }
+  pthread_mutex_unlock(&p_obj->lock);
 }
 
 int mm_jpegdec_test_alloc(buffer_t *p_buffer, int use_pmem)
@@ -315,6 +328,10 @@ void omx_test_dec_print_usage()
   fprintf(stderr, "  -W WIDTH\t\tOutput image width\n");
   fprintf(stderr, "  -H HEIGHT\t\tOutput image height\n");
   fprintf(stderr, "Optional:\n");
+  fprintf(stderr, "  -D DIR\t\tDecode every jpeg of DIR and report the\n"
+    "\t\t\tthroughput, replaces -I -O -W -H\n");
+  fprintf(stderr, "  -n COUNT\t\tDecode jobs per image, default 1, max %d\n",
+    MAX_DEC_JOBS);
   fprintf(stderr, "  -F FORMAT\t\tDefault image format:\n");
   fprintf(stderr, "\t\t\t\t%s (0), %s (1), %s (2) %s (3)\n"
     "%s (4), %s (5), %s (6) %s (7)\n",
@@ -332,7 +349,7 @@ static int mm_jpegdec_test_get_input(int argc, char *argv[],
 {
   int c;
 
-  while ((c = getopt(argc, argv, "I:O:W:H:F:")) != -1) {
+  while ((c = getopt(argc, argv, "I:O:W:H:F:D:n:")) != -1) {
     switch (c) {
     case 'O':
       p_test->out_filename = optarg;
@@ -361,10 +378,22 @@ static int mm_jpegdec_test_get_input(int argc, char *argv[],
         col_formats[format].format_str);
       break;
     }
+    case 'D':
+      p_test->dirname = optarg;
+      fprintf(stderr, "%-25s%s\n", "Input directory", p_test->dirname);
+      break;
+    case 'n':
+      g_count = atoi(optarg);
+      CLAMP(g_count, 1, MAX_DEC_JOBS);
+      fprintf(stderr, "%-25s%d\n", "Jobs per image", g_count);
+      break;
     default:;
     }
   }
-  if (!p_test->filename || !p_test->filename || !p_test->width ||
+  if (p_test->dirname) {
+    return 0;
+  }
+  if (!p_test->filename || !p_test->out_filename || !p_test->width ||
       !p_test->height) {
     fprintf(stderr, "Missing required arguments.\n");
     omx_test_dec_print_usage();
@@ -399,11 +428,13 @@ static int decode_test(jpeg_test_input_t *p_input)
     goto end;
   }
 
+  g_i = 0;
+  gettimeofday(&dtime[0], NULL);
+  dtime[1] = dtime[0];
   for (i = 0; i < g_count; i++) {
     jpeg_obj.job.job_type = JPEG_JOB_TYPE_DECODE;
 
     CDBG_ERROR("%s:%d] Starting decode job",__func__, __LINE__);
-    gettimeofday(&dtime[0], NULL);
 
     fprintf(stderr, "Starting decode of %s into %s outw %d outh %d\n\n",
         p_input->filename, p_input->out_filename,
@@ -420,11 +451,14 @@ static int decode_test(jpeg_test_input_t *p_input)
   jpeg_obj.ops.abort_job(jpeg_obj.job_id[0]);
   */
   pthread_mutex_lock(&jpeg_obj.lock);
-  pthread_cond_wait(&jpeg_obj.cond, &jpeg_obj.lock);
+  while (g_i < g_count) {
+    pthread_cond_wait(&jpeg_obj.cond, &jpeg_obj.lock);
+  }
   pthread_mutex_unlock(&jpeg_obj.lock);
 
+  p_input->decode_us = TIME_IN_US(dtime[1]) - TIME_IN_US(dtime[0]);
   fprintf(stderr, "Decode time %llu ms\n",
-      ((TIME_IN_US(dtime[1]) - TIME_IN_US(dtime[0]))/1000));
+      (unsigned long long)(p_input->decode_us / 1000));
 
 
   jpeg_obj.ops.destroy_session(jpeg_obj.job.decode_job.session_id);
@@ -438,6 +472,136 @@ end:
   return 0;
 }
 
+/** mm_jpegdec_test_get_dim:
+ *
+ *  Arguments:
+ *    @filename: jpeg file
+ *    @p_width: image width
+ *    @p_height: image height
+ *
+ *  Return:
+ *       0 for success -1 otherwise
+ *
+ *  Description:
+ *       Reads the image dimension from the SOFn marker
+ *
+ **/
+static int mm_jpegdec_test_get_dim(const char *filename, int *p_width,
+  int *p_height)
+{
+  FILE *fp;
+  int c, marker, len;
+  uint8_t hdr[7];
+
+  fp = fopen(filename, "rb");
+  if (!fp) {
+    return -1;
+  }
+  if ((fgetc(fp) != 0xFF) || (fgetc(fp) != 0xD8)) {
+    fclose(fp);
+    return -1;
+  }
+  while (1) {
+    while ((c = fgetc(fp)) != EOF && (c != 0xFF));
+    while ((c = fgetc(fp)) == 0xFF);
+    if (c == EOF) {
+      break;
+    }
+    marker = c;
+    if (fread(hdr, 1, 2, fp) != 2) {
+      break;
+    }
+    len = (hdr[0] << 8) | hdr[1];
+    /* SOF0 ~ SOF15 except DHT, JPG and DAC */
+    if ((marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) &&
+      (marker != 0xC8) && (marker != 0xCC)) {
+      if (fread(hdr, 1, 5, fp) != 5) {
+        break;
+      }
+      *p_height = (hdr[1] << 8) | hdr[2];
+      *p_width = (hdr[3] << 8) | hdr[4];
+      fclose(fp);
+      return 0;
+    }
+    if ((len < 2) || fseek(fp, len - 2, SEEK_CUR)) {
+      break;
+    }
+  }
+  fclose(fp);
+  return -1;
+}
+
+/** decode_dir_test:
+ *
+ *  Arguments:
+ *    @p_input: test input, dirname set
+ *
+ *  Return:
+ *       0 or -ve values
+ *
+ *  Description:
+ *       Decodes every jpeg of the directory g_count times and
+ *       reports the throughput per image and overall. Set
+ *       persist.camera.jpeg.swdec to compare the backends.
+ *
+ **/
+static int decode_dir_test(jpeg_test_input_t *p_input)
+{
+  DIR *dir;
+  struct dirent *entry;
+  jpeg_test_input_t file_input;
+  char path[PATH_MAX];
+  const char *ext;
+  uint64_t total_us = 0, total_pixels = 0, pixels;
+  int num_files = 0;
+
+  dir = opendir(p_input->dirname);
+  if (!dir) {
+    fprintf(stderr, "Cannot open %s\n", p_input->dirname);
+    return -1;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    ext = strrchr(entry->d_name, '.');
+    if (!ext || (strcasecmp(ext, ".jpg") && strcasecmp(ext, ".jpeg"))) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", p_input->dirname, entry->d_name);
+
+    file_input = *p_input;
+    file_input.filename = path;
+    file_input.out_filename = NULL;
+    file_input.decode_us = 0;
+    if (mm_jpegdec_test_get_dim(path, &file_input.width,
+      &file_input.height)) {
+      fprintf(stderr, "Skipping %s, no frame header\n", path);
+      continue;
+    }
+    if (decode_test(&file_input) || !file_input.decode_us) {
+      fprintf(stderr, "Skipping %s, decode failed\n", path);
+      continue;
+    }
+
+    pixels = (uint64_t)file_input.width * file_input.height * g_count;
+    fprintf(stderr, "%-40s%dx%d %llu us/image %.1f MP/s\n", entry->d_name,
+      file_input.width, file_input.height,
+      (unsigned long long)(file_input.decode_us / g_count),
+      (double)pixels / file_input.decode_us);
+    total_us += file_input.decode_us;
+    total_pixels += pixels;
+    num_files++;
+  }
+  closedir(dir);
+
+  if (!num_files) {
+    fprintf(stderr, "No jpeg decoded from %s\n", p_input->dirname);
+    return -1;
+  }
+  fprintf(stderr, "%-40s%d images %d jobs each %.1f MP/s\n", "Total",
+    num_files, g_count, (double)total_pixels / total_us);
+  return 0;
+}
+
 /** main:
  *
  *  Arguments:
@@ -463,6 +627,9 @@ int main(int argc, char* argv[])
     return -1;
   }
 
+  if (dec_test_input.dirname) {
+    return decode_dir_test(&dec_test_input);
+  }
   return decode_test(&dec_test_input);
 }
 
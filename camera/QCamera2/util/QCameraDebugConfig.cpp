@@ -0,0 +1,214 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <cutils/properties.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "QCameraDebugConfig.h"
+
+namespace qcamera {
+
+qcamera_debug_config_t QCameraDebugConfig::sConfig;
+uint32_t QCameraDebugConfig::sSeq = 0;
+int64_t QCameraDebugConfig::sLoadTimeMs = -QCAMERA_DEBUG_CONFIG_REFRESH_MS;
+int64_t QCameraDebugConfig::sLoadUs = 0;
+uint32_t QCameraDebugConfig::sGeneration = 0;
+uint64_t QCameraDebugConfig::sReads = 0;
+pthread_mutex_t QCameraDebugConfig::sLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*===========================================================================
+ * FUNCTION   : getIntProperty
+ *
+ * DESCRIPTION: reads an integer property
+ *
+ * PARAMETERS :
+ *   @key     : property name
+ *
+ * RETURN     : property value, 0 if not set
+ *==========================================================================*/
+static int32_t getIntProperty(const char *key)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get(key, value, "0");
+    return atoi(value);
+}
+
+/*===========================================================================
+ * FUNCTION   : nowUs
+ *
+ * DESCRIPTION: monotonic time in microseconds
+ *
+ * PARAMETERS :
+ *   @clock   : clock id
+ *
+ * RETURN     : time in microseconds
+ *==========================================================================*/
+static int64_t nowUs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*===========================================================================
+ * FUNCTION   : loadLocked
+ *
+ * DESCRIPTION: reads the properties and publishes them as the snapshot.
+ *              The properties are read first, so readers only retry over
+ *              the few stores. Called with sLock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDebugConfig::loadLocked()
+{
+    int64_t start = nowUs(CLOCK_MONOTONIC);
+    qcamera_debug_config_t cfg;
+    const int32_t *src = (const int32_t *)&cfg;
+    int32_t *dst = (int32_t *)&sConfig;
+    const int numProps = sizeof(qcamera_debug_config_t) / sizeof(int32_t);
+
+    cfg.dump_img = getIntProperty("persist.camera.dumpimg");
+    cfg.dump_metadata = getIntProperty("persist.camera.dumpmetadata");
+    cfg.zsl_raw = getIntProperty("persist.camera.zsl_raw");
+    cfg.zsl_yuv = getIntProperty("persist.camera.zsl_yuv");
+    cfg.zsl_matching = getIntProperty("persist.camera.zsl_matching");
+    cfg.preview_raw = getIntProperty("persist.camera.preview_raw");
+    cfg.snapshot_raw = getIntProperty("persist.camera.snapshot_raw");
+
+    // Readers retry while sSeq is odd or changed under them
+    uint32_t seq = __atomic_load_n(&sSeq, __ATOMIC_RELAXED);
+    __atomic_store_n(&sSeq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i = 0; i < numProps; i++) {
+        __atomic_store_n(&dst[i], src[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&sSeq, seq + 2, __ATOMIC_RELEASE);
+
+    sGeneration++;
+    sLoadUs = nowUs(CLOCK_MONOTONIC) - start;
+    __atomic_store_n(&sLoadTimeMs, nowUs(CLOCK_MONOTONIC_COARSE) / 1000,
+            __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : get
+ *
+ * DESCRIPTION: returns the current snapshot. A stale snapshot is reloaded
+ *              by the caller unless another thread is reloading already,
+ *              so frame paths never block on the lock.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : copy of the debug config
+ *==========================================================================*/
+qcamera_debug_config_t QCameraDebugConfig::get()
+{
+    int64_t now = nowUs(CLOCK_MONOTONIC_COARSE) / 1000;
+    qcamera_debug_config_t cfg;
+    const int32_t *src = (const int32_t *)&sConfig;
+    int32_t *dst = (int32_t *)&cfg;
+    const int numProps = sizeof(qcamera_debug_config_t) / sizeof(int32_t);
+    uint32_t begin, end;
+
+    if ((now - __atomic_load_n(&sLoadTimeMs, __ATOMIC_ACQUIRE)) >=
+            QCAMERA_DEBUG_CONFIG_REFRESH_MS) {
+        if (pthread_mutex_trylock(&sLock) == 0) {
+            if ((now - sLoadTimeMs) >= QCAMERA_DEBUG_CONFIG_REFRESH_MS) {
+                loadLocked();
+            }
+            pthread_mutex_unlock(&sLock);
+        }
+    }
+
+    __atomic_fetch_add(&sReads, 1, __ATOMIC_RELAXED);
+    do {
+        begin = __atomic_load_n(&sSeq, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < numProps; i++) {
+            dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&sSeq, __ATOMIC_RELAXED);
+    } while ((begin & 1) || (begin != end));
+
+    return cfg;
+}
+
+/*===========================================================================
+ * FUNCTION   : refresh
+ *
+ * DESCRIPTION: reloads the debug properties now
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDebugConfig::refresh()
+{
+    pthread_mutex_lock(&sLock);
+    loadLocked();
+    pthread_mutex_unlock(&sLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: dumps the snapshot and what reading it saved. Each read
+ *              would have cost one property_get, about the reload time
+ *              divided by the number of properties.
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDebugConfig::dump(int fd)
+{
+    const int numProps = sizeof(qcamera_debug_config_t) / sizeof(int32_t);
+
+    pthread_mutex_lock(&sLock);
+    const qcamera_debug_config_t &cfg = sConfig;
+    dprintf(fd, "\n Debug Config: generation %u\n", sGeneration);
+    dprintf(fd, "  dumpimg %d dumpmetadata %d zsl_raw %d zsl_yuv %d "
+            "zsl_matching %d preview_raw %d snapshot_raw %d\n",
+            cfg.dump_img, cfg.dump_metadata, cfg.zsl_raw, cfg.zsl_yuv,
+            cfg.zsl_matching, cfg.preview_raw, cfg.snapshot_raw);
+    dprintf(fd, "  %llu reads, reload of %d properties took %lld us, "
+            "about %lld us saved\n",
+            (unsigned long long)__atomic_load_n(&sReads, __ATOMIC_RELAXED),
+            numProps, (long long)sLoadUs,
+            (long long)(__atomic_load_n(&sReads, __ATOMIC_RELAXED) *
+                sLoadUs / numProps));
+    pthread_mutex_unlock(&sLock);
+}
+
+}; // namespace qcamera
@@ -0,0 +1,76 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __QCAMERA_DEBUG_CONFIG_H__
+#define __QCAMERA_DEBUG_CONFIG_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace qcamera {
+
+// Min time between two reloads of the debug properties
+#define QCAMERA_DEBUG_CONFIG_REFRESH_MS 1000
+
+typedef struct {
+    int32_t dump_img;        // persist.camera.dumpimg
+    int32_t dump_metadata;   // persist.camera.dumpmetadata
+    int32_t zsl_raw;         // persist.camera.zsl_raw
+    int32_t zsl_yuv;         // persist.camera.zsl_yuv
+    int32_t zsl_matching;    // persist.camera.zsl_matching
+    int32_t preview_raw;     // persist.camera.preview_raw
+    int32_t snapshot_raw;    // persist.camera.snapshot_raw
+} qcamera_debug_config_t;
+
+// Process wide snapshot of the debug properties checked on the frame
+// paths. Readers take no lock, they copy the snapshot under a sequence
+// count and retry if a reload overlapped. The snapshot is reloaded when it
+// is older than QCAMERA_DEBUG_CONFIG_REFRESH_MS or on refresh().
+class QCameraDebugConfig {
+public:
+    static qcamera_debug_config_t get();
+    static void refresh();
+    static void dump(int fd);
+
+private:
+    static void loadLocked();
+
+    static qcamera_debug_config_t sConfig;
+    static uint32_t sSeq;         // odd while sConfig is being written
+    static int64_t sLoadTimeMs;
+    static int64_t sLoadUs;       // cost of the last reload
+    static uint32_t sGeneration;
+    static uint64_t sReads;
+    static pthread_mutex_t sLock;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_DEBUG_CONFIG_H__ */
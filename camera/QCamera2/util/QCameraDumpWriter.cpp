@@ -0,0 +1,359 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include "QCameraDumpWriter.h"
+
+namespace qcamera {
+
+QCameraDumpWriter *QCameraDumpWriter::sInstance = NULL;
+pthread_mutex_t QCameraDumpWriter::sInstanceLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*===========================================================================
+ * FUNCTION   : getInstance
+ *
+ * DESCRIPTION: get the process wide dump writer, its thread is launched on
+ *              first use
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : dump writer
+ *==========================================================================*/
+QCameraDumpWriter *QCameraDumpWriter::getInstance()
+{
+    pthread_mutex_lock(&sInstanceLock);
+    if (NULL == sInstance) {
+        sInstance = new QCameraDumpWriter();
+    }
+    pthread_mutex_unlock(&sInstanceLock);
+    return sInstance;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraDumpWriter
+ *
+ * DESCRIPTION: constructor of QCameraDumpWriter
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDumpWriter::QCameraDumpWriter()
+    : mJobs(releaseJob, this),
+      mQueuedBytes(0),
+      mMaxQueuedBytes(0),
+      mWritten(0),
+      mWrittenBytes(0),
+      mFailed(0),
+      mDropped(0),
+      mDroppedBytes(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    mThread.launch(writerRoutine, this);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraDumpWriter
+ *
+ * DESCRIPTION: deconstructor of QCameraDumpWriter, the submitted dumps are
+ *              written before the thread exits
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraDumpWriter::~QCameraDumpWriter()
+{
+    mThread.exit();
+    mJobs.flush();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : reserve
+ *
+ * DESCRIPTION: allocates the buffer of a dump. The buffer counts against
+ *              QCAMERA_DUMP_QUEUE_MAX_BYTES from now until the dump thread
+ *              has written it or it is cancelled. A dump that does not fit,
+ *              because the dump thread lags behind, is dropped and counted
+ *              in the statistics, the frame path never waits for the disk.
+ *
+ * PARAMETERS :
+ *   @len     : size of the dump
+ *
+ * RETURN     : buffer to fill and submit or cancel
+ *              NULL if the dump is dropped
+ *==========================================================================*/
+uint8_t *QCameraDumpWriter::reserve(size_t len)
+{
+    uint8_t *buf = NULL;
+    bool full;
+
+    pthread_mutex_lock(&mLock);
+    full = (mQueuedBytes + len > QCAMERA_DUMP_QUEUE_MAX_BYTES);
+    if (!full) {
+        mQueuedBytes += len;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (!full) {
+        buf = (uint8_t *)malloc(len);
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (NULL == buf) {
+        if (!full) {
+            mQueuedBytes -= len;
+        }
+        mDropped++;
+        mDroppedBytes += len;
+    } else if (mQueuedBytes > mMaxQueuedBytes) {
+        mMaxQueuedBytes = mQueuedBytes;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (NULL == buf) {
+        ALOGV("%s: dump of %zu bytes dropped", __func__, len);
+    }
+    return buf;
+}
+
+/*===========================================================================
+ * FUNCTION   : submit
+ *
+ * DESCRIPTION: queues a reserved buffer to be written into a file
+ *
+ * PARAMETERS :
+ *   @path    : file path
+ *   @buf     : buffer from reserve
+ *   @len     : size of the dump
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::submit(const char *path, uint8_t *buf, size_t len)
+{
+    qcamera_dump_job_t *job =
+            (qcamera_dump_job_t *)malloc(sizeof(qcamera_dump_job_t));
+
+    if (NULL == job) {
+        cancel(buf, len);
+        return;
+    }
+    strlcpy(job->path, path, sizeof(job->path));
+    job->buf = buf;
+    job->len = len;
+
+    if (!mJobs.enqueue((void *)job)) {
+        releaseJob(job, this);
+        free(job);
+        return;
+    }
+    mThread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, 0, 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : cancel
+ *
+ * DESCRIPTION: gives back a reserved buffer that is not submitted
+ *
+ * PARAMETERS :
+ *   @buf     : buffer from reserve
+ *   @len     : size of the dump
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::cancel(uint8_t *buf, size_t len)
+{
+    free(buf);
+    pthread_mutex_lock(&mLock);
+    mQueuedBytes -= len;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseJob
+ *
+ * DESCRIPTION: frees the buffer of a job that is not written
+ *
+ * PARAMETERS :
+ *   @data      : job
+ *   @user_data : dump writer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::releaseJob(void *data, void *user_data)
+{
+    qcamera_dump_job_t *job = (qcamera_dump_job_t *)data;
+    QCameraDumpWriter *pme = (QCameraDumpWriter *)user_data;
+
+    // the queue frees the job itself
+    if ((NULL != job) && (NULL != pme)) {
+        pme->cancel(job->buf, job->len);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : writeJob
+ *
+ * DESCRIPTION: writes a dump into its file and frees it
+ *
+ * PARAMETERS :
+ *   @job     : dump job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::writeJob(qcamera_dump_job_t *job)
+{
+    size_t written = 0;
+    int err = 0;
+    int file_fd = open(job->path, O_RDWR | O_CREAT, 0777);
+
+    if (file_fd >= 0) {
+        while (written < job->len) {
+            ssize_t rc = write(file_fd, job->buf + written, job->len - written);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                err = errno;
+                break;
+            }
+            written += rc;
+        }
+        close(file_fd);
+    } else {
+        err = errno;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (written == job->len) {
+        mWritten++;
+        mWrittenBytes += written;
+    } else {
+        mFailed++;
+    }
+    mQueuedBytes -= job->len;
+    pthread_mutex_unlock(&mLock);
+
+    if (written != job->len) {
+        ALOGE("%s: fail to write %s: %s", __func__, job->path, strerror(err));
+    } else {
+        ALOGV("%s: written %zu bytes to %s", __func__, written, job->path);
+    }
+    free(job->buf);
+    free(job);
+}
+
+/*===========================================================================
+ * FUNCTION   : writerRoutine
+ *
+ * DESCRIPTION: thread routine writing the queued dumps
+ *
+ * PARAMETERS :
+ *   @data    : dump writer
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCameraDumpWriter::writerRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    QCameraDumpWriter *pme = (QCameraDumpWriter *)data;
+    QCameraCmdThread *cmdThread = &pme->mThread;
+
+    cmdThread->setName("CAM_dump");
+    do {
+        do {
+            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                ALOGE("%s: cam_sem_wait error (%s)",
+                           __func__, strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            {
+                qcamera_dump_job_t *job =
+                        (qcamera_dump_job_t *)pme->mJobs.dequeue();
+                if (NULL != job) {
+                    pme->writeJob(job);
+                }
+            }
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            {
+                // exit jumps the queue, write what was submitted before
+                qcamera_dump_job_t *job = NULL;
+                while (NULL !=
+                        (job = (qcamera_dump_job_t *)pme->mJobs.dequeue())) {
+                    pme->writeJob(job);
+                }
+            }
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: dumps the writer statistics
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to dump into
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDumpWriter::dump(int fd)
+{
+    pthread_mutex_lock(&mLock);
+    dprintf(fd, "\n Dump Writer: %u files %llu bytes written, %u failed\n",
+            mWritten, (unsigned long long)mWrittenBytes, mFailed);
+    dprintf(fd, "  %u dropped (%llu bytes), queued %zu bytes, max %zu of %d\n",
+            mDropped, (unsigned long long)mDroppedBytes, mQueuedBytes,
+            mMaxQueuedBytes, QCAMERA_DUMP_QUEUE_MAX_BYTES);
+    pthread_mutex_unlock(&mLock);
+}
+
+}; // namespace qcamera
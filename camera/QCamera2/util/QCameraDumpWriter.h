@@ -0,0 +1,92 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __QCAMERA_DUMP_WRITER_H__
+#define __QCAMERA_DUMP_WRITER_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "QCameraCmdThread.h"
+#include "QCameraQueue.h"
+
+namespace qcamera {
+
+// Max bytes of dumps waiting to be written, dumps beyond are dropped
+#define QCAMERA_DUMP_QUEUE_MAX_BYTES (64 * 1024 * 1024)
+#define QCAMERA_DUMP_PATH_MAX 128
+
+// Writes the debug dumps of the frame paths on a background thread. The
+// caller reserves a buffer, packs the data into it and submits it, so
+// each dump is written with a single write() away from the callback
+// thread. The HAL uses the process wide instance.
+class QCameraDumpWriter {
+public:
+    static QCameraDumpWriter *getInstance();
+
+    QCameraDumpWriter();
+    virtual ~QCameraDumpWriter();
+
+    uint8_t *reserve(size_t len);
+    void submit(const char *path, uint8_t *buf, size_t len);
+    void cancel(uint8_t *buf, size_t len);
+    void dump(int fd);
+
+private:
+    typedef struct {
+        char path[QCAMERA_DUMP_PATH_MAX];
+        uint8_t *buf;
+        size_t len;
+    } qcamera_dump_job_t;
+
+    void writeJob(qcamera_dump_job_t *job);
+    static void releaseJob(void *data, void *user_data);
+    static void *writerRoutine(void *data);
+
+    QCameraCmdThread mThread;
+    QCameraQueue mJobs;
+    pthread_mutex_t mLock;
+    size_t mQueuedBytes;
+    size_t mMaxQueuedBytes;
+    // statistics
+    uint32_t mWritten;
+    uint64_t mWrittenBytes;
+    uint32_t mFailed;
+    uint32_t mDropped;
+    uint64_t mDroppedBytes;
+
+    static QCameraDumpWriter *sInstance;
+    static pthread_mutex_t sInstanceLock;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_DUMP_WRITER_H__ */
@@ -0,0 +1,68 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <string.h>
+#include "QCameraPlaneCopy.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : copy
+ *
+ * DESCRIPTION: copies the planes of a frame from src into dst
+ *
+ * PARAMETERS :
+ *   @dst       : destination frame
+ *   @src       : source frame
+ *   @planes    : layout of each plane in both frames
+ *   @numPlanes : number of planes
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPlaneCopy::copy(uint8_t *dst, const uint8_t *src,
+        const qcamera_plane_copy_t *planes, int numPlanes)
+{
+    for (int i = 0; i < numPlanes; i++) {
+        const qcamera_plane_copy_t &p = planes[i];
+        const uint8_t *s = src + p.src_offset;
+        uint8_t *d = dst + p.dst_offset;
+
+        if (p.src_stride == p.dst_stride) {
+            memcpy(d, s, p.dst_stride * p.height);
+            continue;
+        }
+        for (uint32_t j = 0; j < p.height; j++) {
+            memcpy(d, s, p.width);
+            s += p.src_stride;
+            d += p.dst_stride;
+        }
+    }
+}
+
+}; // namespace qcamera
@@ -39,6 +39,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef LIBRMNETCTL_H
 #define LIBRMNETCTL_H
 
+#include <sys/types.h>
+
 /* RMNET API succeeded */
 #define RMNETCTL_SUCCESS 0
 /* RMNET API encountered an error while executing within the library. Check the
@@ -173,6 +175,25 @@ char rmnetctl_error_code_text
 ===========================================================================*/
 typedef struct rmnetctl_hndl_s rmnetctl_hndl_t;
 
+struct rmnet_nl_msg_s;
+
+/*!
+* @brief Transport carrying the netlink messages of a RmNet handle
+* @details send and recv move one whole netlink message, a nlmsghdr followed
+* by a rmnet_nl_msg_s, and return the number of bytes moved or -1 on error.
+* close is called from rmnetctl_cleanup and may be NULL.
+* @var ctx context passed to the callbacks
+*/
+struct rmnetctl_transport_s {
+	void *ctx;
+	ssize_t (*send)(void *ctx, const void *buf, size_t len);
+	ssize_t (*recv)(void *ctx, void *buf, size_t len);
+	void (*close)(void *ctx);
+};
+
+/* Requests a batch keeps in flight before waiting for their responses */
+#define RMNETCTL_BATCH_WINDOW 16
+
 /*!
 * @brief Public API to initialize the RMNET control driver
 * @details Allocates memory for the RmNet handle. Creates and binds to a   and
@@ -194,6 +215,44 @@ int rmnetctl_init(rmnetctl_hndl_t **hndl, uint16_t *error_code);
 */
 void rmnetctl_cleanup(rmnetctl_hndl_t *hndl);
 
+/*!
+* @brief Public API to initialize a RmNet handle on another transport
+* @details Allocates memory for the RmNet handle and uses the transport instead
+* of a netlink socket, e.g. to talk to a fake kernel in tests
+* @param **rmnetctl_hndl_t_val RmNet handle to be initialized
+* @param *transport Transport for the messages of this handle
+* @param *error_code Status code of this operation
+* @return RMNETCTL_SUCCESS if successful
+* @return RMNETCTL_LIB_ERR if there was a library error. Check error_code
+* @return RMNETCTL_INVALID_ARG if invalid arguments were passed to the API
+*/
+int rmnetctl_init_transport(rmnetctl_hndl_t **hndl,
+			    const struct rmnetctl_transport_s *transport,
+			    uint16_t *error_code);
+
+/*!
+* @brief Public API to send several requests without waiting for each response
+* @details Sends up to RMNETCTL_BATCH_WINDOW requests back to back, then sends
+* the next one as each response comes in. The responses are matched to the
+* requests by netlink sequence number, so responses[i] is the response to
+* requests[i] whatever the order they arrive in. Responses to requests that
+* are not part of the batch are dropped. The crd and return_code of each
+* response are left for the caller to check.
+* @param *rmnetctl_hndl_t_val RmNet handle for the Netlink messages
+* @param *requests Requests to be sent
+* @param *responses Receives one response per request
+* @param count Number of requests
+* @param *error_code Status code of this operation
+* @return RMNETCTL_SUCCESS if every request got a response of its type
+* @return RMNETCTL_LIB_ERR if there was a library error. Check error_code
+* @return RMNETCTL_INVALID_ARG if invalid arguments were passed to the API
+*/
+int rmnetctl_transact_batch(rmnetctl_hndl_t *hndl,
+			    const struct rmnet_nl_msg_s *requests,
+			    struct rmnet_nl_msg_s *responses,
+			    uint32_t count,
+			    uint16_t *error_code);
+
 /*!
 * @brief Public API to register/unregister a RMNET driver on a particular device
 * @details Message type is RMNET_NETLINK_ASSOCIATE_NETWORK_DEVICE or
@@ -43,6 +43,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 			 DEFINITIONS AND DECLARATIONS
 ===========================================================================*/
 
+/* Size of a netlink message carrying one rmnet_nl_msg_s */
+#define MAX_BUF_SIZE (sizeof(struct nlmsghdr) + sizeof(struct rmnet_nl_msg_s))
+
 /*!
 * @brief Structure for RMNET control handles. A rmnet hndl contains the caller
 * process id, the transaction id which is initialized to 0 for each new
@@ -52,6 +55,10 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 * @var netlink_fd netlink file descriptor to be used
 * @var src_addr source socket address properties for this message
 * @var dest_addr destination socket address properties for this message
+* @var transport carries the messages, the netlink socket unless the handle
+* was initialized with rmnetctl_init_transport
+* @var request_buf buffer the requests are built in
+* @var response_buf buffer the responses are received in
 */
 
 struct rmnetctl_hndl_s {
@@ -59,6 +66,9 @@ struct rmnetctl_hndl_s {
 	 uint32_t transaction_id;
 	 int netlink_fd;
 	 struct sockaddr_nl src_addr, dest_addr;
+	 struct rmnetctl_transport_s transport;
+	 uint8_t request_buf[MAX_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+	 uint8_t response_buf[MAX_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
 };
 
 #endif /* not defined LIBRMNETCTL_HNDL_H */
@@ -48,8 +48,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 #include <stdlib.h>
 #include <linux/rmnet_data.h>
-#include "librmnetctl_hndl.h"
 #include "librmnetctl.h"
+#include "librmnetctl_hndl.h"
 
 #ifdef USE_GLIB
 #include <glib.h>
@@ -62,7 +62,6 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MIN_VALID_SOCKET_FD 0
 #define KERNEL_PROCESS_ID 0
 #define UNICAST 0
-#define MAX_BUF_SIZE sizeof(struct nlmsghdr) + sizeof(struct rmnet_nl_msg_s)
 #define INGRESS_FLAGS_MASK   (RMNET_INGRESS_FIX_ETHERNET | \
 			      RMNET_INGRESS_FORMAT_MAP | \
 			      RMNET_INGRESS_FORMAT_DEAGGREGATION | \
@@ -77,6 +76,143 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /*===========================================================================
 			LOCAL FUNCTION DEFINITIONS
 ===========================================================================*/
+/*!
+* @brief Sends a message of a handle on its netlink socket
+* @param ctx RmNet handle the message is sent for
+* @param buf Netlink message
+* @param len Length of the netlink message
+* @return Number of bytes sent, -1 on error
+*/
+static ssize_t rmnetctl_netlink_send(void *ctx, const void *buf, size_t len)
+{
+	rmnetctl_hndl_t *hndl = (rmnetctl_hndl_t *)ctx;
+	struct sockaddr_nl* __attribute__((__may_alias__)) saddr_ptr;
+
+	saddr_ptr = &hndl->dest_addr;
+	return sendto(hndl->netlink_fd,
+		      buf,
+		      len,
+		      RMNETCTL_SOCK_FLAG,
+		      (struct sockaddr*)saddr_ptr,
+		      sizeof(struct sockaddr_nl));
+}
+
+/*!
+* @brief Receives a message of a handle from its netlink socket
+* @param ctx RmNet handle the message is received for
+* @param buf Buffer for the netlink message
+* @param len Size of the buffer
+* @return Number of bytes received, -1 on error
+*/
+static ssize_t rmnetctl_netlink_recv(void *ctx, void *buf, size_t len)
+{
+	rmnetctl_hndl_t *hndl = (rmnetctl_hndl_t *)ctx;
+	struct sockaddr_nl* __attribute__((__may_alias__)) saddr_ptr;
+	socklen_t addrlen = sizeof(struct sockaddr_nl);
+
+	saddr_ptr = &hndl->src_addr;
+	return recvfrom(hndl->netlink_fd,
+			buf,
+			len,
+			RMNETCTL_SOCK_FLAG,
+			(struct sockaddr*)saddr_ptr,
+			&addrlen);
+}
+
+/*!
+* @brief Closes the netlink socket of a handle
+* @param ctx RmNet handle to close the socket of
+*/
+static void rmnetctl_netlink_close(void *ctx)
+{
+	rmnetctl_hndl_t *hndl = (rmnetctl_hndl_t *)ctx;
+
+	close(hndl->netlink_fd);
+}
+
+/*!
+* @brief Builds a request in the request buffer of the handle and sends it
+* @details The request gets the current transaction id as sequence number and
+* the transaction id is incremented. The header and the message fill the whole
+* buffer, so the buffer is not cleared between requests.
+* @param *hndl RmNet handle for this transaction
+* @param request Message to be sent to the kernel
+* @return RMNETCTL_API_SUCCESS if successfully able to send the message
+* @return RMNETCTL_API_ERR_MESSAGE_SEND if could not send the message to kernel
+*/
+static uint16_t rmnetctl_send_request(rmnetctl_hndl_t *hndl,
+				      const struct rmnet_nl_msg_s *request)
+{
+	struct nlmsghdr *nlmsghdr_val;
+	struct rmnet_nl_msg_s *rmnet_nl_msg_s_val;
+
+	nlmsghdr_val = (struct nlmsghdr *)hndl->request_buf;
+	rmnet_nl_msg_s_val = (struct rmnet_nl_msg_s *)NLMSG_DATA(hndl->request_buf);
+
+	nlmsghdr_val->nlmsg_len = MAX_BUF_SIZE;
+	nlmsghdr_val->nlmsg_type = 0;
+	nlmsghdr_val->nlmsg_flags = 0;
+	nlmsghdr_val->nlmsg_seq = hndl->transaction_id;
+	nlmsghdr_val->nlmsg_pid = hndl->pid;
+
+	memcpy(rmnet_nl_msg_s_val, request, sizeof(struct rmnet_nl_msg_s));
+
+	rmnet_nl_msg_s_val->crd = RMNET_NETLINK_MSG_COMMAND;
+	hndl->transaction_id++;
+
+	if (hndl->transport.send(hndl->transport.ctx,
+				 hndl->request_buf,
+				 MAX_BUF_SIZE) < 0)
+		return RMNETCTL_API_ERR_MESSAGE_SEND;
+	return RMNETCTL_SUCCESS;
+}
+
+/*!
+* @brief Receives a message in the response buffer of the handle
+* @param *hndl RmNet handle for this transaction
+* @param *seq Sequence number of the message
+* @param *len Length of the rmnet message after the netlink header
+* @return RMNETCTL_API_SUCCESS if successfully able to receive a message
+* @return RMNETCTL_API_ERR_MESSAGE_RECEIVE if could not receive message from the
+* kernel
+*/
+static uint16_t rmnetctl_recv_response(rmnetctl_hndl_t *hndl,
+				       uint32_t *seq,
+				       size_t *len)
+{
+	struct nlmsghdr *nlmsghdr_val;
+	ssize_t bytes_read = -1;
+
+	bytes_read = hndl->transport.recv(hndl->transport.ctx,
+					  hndl->response_buf,
+					  MAX_BUF_SIZE);
+	if (bytes_read < (ssize_t)NLMSG_HDRLEN)
+		return RMNETCTL_API_ERR_MESSAGE_RECEIVE;
+
+	nlmsghdr_val = (struct nlmsghdr *)hndl->response_buf;
+	*seq = nlmsghdr_val->nlmsg_seq;
+	*len = min((size_t)bytes_read - NLMSG_HDRLEN,
+		   sizeof(struct rmnet_nl_msg_s));
+	return RMNETCTL_SUCCESS;
+}
+
+/*!
+* @brief Copies the received message out of the response buffer
+* @details The part of the response a short message did not cover is cleared,
+* as the buffer still holds the previous message there.
+* @param *hndl RmNet handle for this transaction
+* @param len Length of the rmnet message after the netlink header
+* @param response Message received from the kernel
+*/
+static inline void rmnetctl_get_response(rmnetctl_hndl_t *hndl,
+					 size_t len,
+					 struct rmnet_nl_msg_s *response)
+{
+	memcpy(response, NLMSG_DATA(hndl->response_buf), len);
+	memset((uint8_t *)response + len, 0,
+	       sizeof(struct rmnet_nl_msg_s) - len);
+}
+
 /*!
 * @brief Synchronous method to send and receive messages to and from the kernel
 * using  netlink sockets
@@ -90,8 +226,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 * from the kernel
 * @return RMNETCTL_API_ERR_HNDL_INVALID if RmNet handle for the transaction was
 * NULL
-* @return RMNETCTL_API_ERR_REQUEST_NULL not enough memory to create buffer for
-* sending the message
+* @return RMNETCTL_API_ERR_REQUEST_NULL if the request was NULL
+* @return RMNETCTL_API_ERR_RESPONSE_NULL if the response was NULL
 * @return RMNETCTL_API_ERR_MESSAGE_SEND if could not send the message to kernel
 * @return RMNETCTL_API_ERR_MESSAGE_RECEIVE if could not receive message from the
 * kernel
@@ -101,16 +237,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 static uint16_t rmnetctl_transact(rmnetctl_hndl_t *hndl,
 			struct rmnet_nl_msg_s *request,
 			struct rmnet_nl_msg_s *response) {
-	uint8_t *request_buf, *response_buf;
-	struct nlmsghdr *nlmsghdr_val;
-	struct rmnet_nl_msg_s *rmnet_nl_msg_s_val;
-	ssize_t bytes_read = -1;
+	uint32_t seq;
+	size_t len;
 	uint16_t return_code = RMNETCTL_API_ERR_HNDL_INVALID;
-	struct sockaddr_nl* __attribute__((__may_alias__)) saddr_ptr;
-	request_buf = NULL;
-	response_buf = NULL;
-	nlmsghdr_val = NULL;
-	rmnet_nl_msg_s_val = NULL;
 	do {
 	if (!hndl){
 		break;
@@ -123,64 +252,15 @@ static uint16_t rmnetctl_transact(rmnetctl_hndl_t *hndl,
 		return_code = RMNETCTL_API_ERR_RESPONSE_NULL;
 		break;
 	}
-	request_buf = (uint8_t *)malloc(MAX_BUF_SIZE * sizeof(uint8_t));
-	if (!request_buf){
-		return_code = RMNETCTL_API_ERR_REQUEST_NULL;
-		break;
-	}
-
-	response_buf = (uint8_t *)malloc(MAX_BUF_SIZE * sizeof(uint8_t));
-	if (!response_buf) {
-		return_code = RMNETCTL_API_ERR_RESPONSE_NULL;
-		break;
-	}
-
-	nlmsghdr_val = (struct nlmsghdr *)request_buf;
-	rmnet_nl_msg_s_val = (struct rmnet_nl_msg_s *)NLMSG_DATA(request_buf);
-
-	memset(request_buf, 0, MAX_BUF_SIZE*sizeof(uint8_t));
-	memset(response_buf, 0, MAX_BUF_SIZE*sizeof(uint8_t));
-
-	nlmsghdr_val->nlmsg_seq = hndl->transaction_id;
-	nlmsghdr_val->nlmsg_pid = hndl->pid;
-	nlmsghdr_val->nlmsg_len = MAX_BUF_SIZE;
-
-	memcpy((void *)NLMSG_DATA(request_buf), request,
-	sizeof(struct rmnet_nl_msg_s));
-
-	rmnet_nl_msg_s_val->crd = RMNET_NETLINK_MSG_COMMAND;
-	hndl->transaction_id++;
-
-	saddr_ptr = &hndl->dest_addr;
-	socklen_t addrlen = sizeof(struct sockaddr_nl);
-	if (sendto(hndl->netlink_fd,
-			request_buf,
-			MAX_BUF_SIZE,
-			RMNETCTL_SOCK_FLAG,
-			(struct sockaddr*)saddr_ptr,
-			sizeof(struct sockaddr_nl)) < 0) {
-		return_code = RMNETCTL_API_ERR_MESSAGE_SEND;
-		break;
-	}
 
-	saddr_ptr = &hndl->src_addr;
-	bytes_read = recvfrom(hndl->netlink_fd,
-			response_buf,
-			MAX_BUF_SIZE,
-			RMNETCTL_SOCK_FLAG,
-			(struct sockaddr*)saddr_ptr,
-			&addrlen);
-	if (bytes_read < 0) {
-		return_code = RMNETCTL_API_ERR_MESSAGE_RECEIVE;
+	return_code = rmnetctl_send_request(hndl, request);
+	if (return_code != RMNETCTL_SUCCESS)
 		break;
-	}
 
-	memcpy(response, (void *)NLMSG_DATA(response_buf),
-	sizeof(struct rmnet_nl_msg_s));
-	if (sizeof(*response) < sizeof(struct rmnet_nl_msg_s)) {
-		return_code = RMNETCTL_API_ERR_RESPONSE_NULL;
+	return_code = rmnetctl_recv_response(hndl, &seq, &len);
+	if (return_code != RMNETCTL_SUCCESS)
 		break;
-	}
+	rmnetctl_get_response(hndl, len, response);
 
 	if (request->message_type != response->message_type) {
 		return_code = RMNETCTL_API_ERR_MESSAGE_TYPE;
@@ -188,8 +268,6 @@ static uint16_t rmnetctl_transact(rmnetctl_hndl_t *hndl,
 	}
 	return_code = RMNETCTL_SUCCESS;
 	} while(0);
-	free(request_buf);
-	free(response_buf);
 	return return_code;
 }
 
@@ -353,6 +431,47 @@ int rmnetctl_init(rmnetctl_hndl_t **hndl, uint16_t *error_code)
 	(*hndl)->dest_addr.nl_pid = KERNEL_PROCESS_ID;
 	(*hndl)->dest_addr.nl_groups = UNICAST;
 
+	(*hndl)->transport.ctx = *hndl;
+	(*hndl)->transport.send = rmnetctl_netlink_send;
+	(*hndl)->transport.recv = rmnetctl_netlink_recv;
+	(*hndl)->transport.close = rmnetctl_netlink_close;
+
+	return_code = RMNETCTL_SUCCESS;
+	} while(0);
+	return return_code;
+}
+
+int rmnetctl_init_transport(rmnetctl_hndl_t **hndl,
+			    const struct rmnetctl_transport_s *transport,
+			    uint16_t *error_code)
+{
+	pid_t pid = 0;
+	int return_code = RMNETCTL_LIB_ERR;
+	do {
+	if ((!hndl) || (!transport) || (!transport->send) ||
+	    (!transport->recv) || (!error_code)) {
+		return_code = RMNETCTL_INVALID_ARG;
+		break;
+	}
+
+	*hndl = (rmnetctl_hndl_t *)malloc(sizeof(rmnetctl_hndl_t));
+	if (!*hndl) {
+		*error_code = RMNETCTL_API_ERR_HNDL_INVALID;
+		break;
+	}
+
+	memset(*hndl, 0, sizeof(rmnetctl_hndl_t));
+
+	pid = getpid();
+	if (pid  < MIN_VALID_PROCESS_ID) {
+		free(*hndl);
+		*error_code = RMNETCTL_INIT_ERR_PROCESS_ID;
+		break;
+	}
+	(*hndl)->pid = (uint32_t)pid;
+	(*hndl)->netlink_fd = -1;
+	(*hndl)->transport = *transport;
+
 	return_code = RMNETCTL_SUCCESS;
 	} while(0);
 	return return_code;
@@ -362,10 +481,79 @@ void rmnetctl_cleanup(rmnetctl_hndl_t *hndl)
 {
 	if (!hndl)
 		return;
-	close(hndl->netlink_fd);
+	if (hndl->transport.close)
+		hndl->transport.close(hndl->transport.ctx);
 	free(hndl);
 }
 
+int rmnetctl_transact_batch(rmnetctl_hndl_t *hndl,
+			    const struct rmnet_nl_msg_s *requests,
+			    struct rmnet_nl_msg_s *responses,
+			    uint32_t count,
+			    uint16_t *error_code)
+{
+	uint32_t first_seq, seq, index;
+	/* Requests below lowest have their response, bit n of received is set
+	 * once the response to request lowest + n is in */
+	uint32_t sent = 0, lowest = 0, received = 0;
+	uint16_t send_code = RMNETCTL_SUCCESS, recv_code = RMNETCTL_SUCCESS;
+	uint16_t type_code = RMNETCTL_SUCCESS;
+	size_t len;
+	int return_code = RMNETCTL_LIB_ERR;
+	do {
+	if ((!hndl) || (!requests) || (!responses) || (!error_code)) {
+		return_code = RMNETCTL_INVALID_ARG;
+		break;
+	}
+
+	first_seq = hndl->transaction_id;
+	while (lowest < count) {
+		while ((send_code == RMNETCTL_SUCCESS) && (sent < count) &&
+		       (sent - lowest < RMNETCTL_BATCH_WINDOW)) {
+			send_code = rmnetctl_send_request(hndl, &requests[sent]);
+			if (send_code == RMNETCTL_SUCCESS)
+				sent++;
+		}
+		/* A send failed and every request sent got its response */
+		if (lowest == sent)
+			break;
+
+		recv_code = rmnetctl_recv_response(hndl, &seq, &len);
+		if (recv_code != RMNETCTL_SUCCESS)
+			break;
+
+		/* Drop responses left over from an earlier transaction */
+		index = seq - first_seq;
+		if ((index < lowest) || (index >= sent) ||
+		    (received & (1U << (index - lowest))))
+			continue;
+
+		rmnetctl_get_response(hndl, len, &responses[index]);
+		if (responses[index].message_type !=
+		    requests[index].message_type)
+			type_code = RMNETCTL_API_ERR_MESSAGE_TYPE;
+
+		received |= 1U << (index - lowest);
+		while (received & 1U) {
+			received >>= 1;
+			lowest++;
+		}
+	}
+
+	if (recv_code != RMNETCTL_SUCCESS)
+		*error_code = recv_code;
+	else if (send_code != RMNETCTL_SUCCESS)
+		*error_code = send_code;
+	else
+		*error_code = type_code;
+	if (*error_code != RMNETCTL_SUCCESS)
+		break;
+
+	return_code = RMNETCTL_SUCCESS;
+	} while(0);
+	return return_code;
+}
+
 int rmnet_associate_network_device(rmnetctl_hndl_t *hndl,
 				   const char *dev_name,
 				   uint16_t *error_code,
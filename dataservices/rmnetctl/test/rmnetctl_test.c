@@ -0,0 +1,549 @@
+/******************************************************************************
+
+			R M N E T C T L _ T E S T . C
+
+Copyright (c) 2015, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+	* Redistributions of source code must retain the above copyright
+	  notice, this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above
+	  copyright notice, this list of conditions and the following
+	  disclaimer in the documentation and/or other materials provided
+	  with the distribution.
+	* Neither the name of The Linux Foundation nor the names of its
+	  contributors may be used to endorse or promote products derived
+	  from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+******************************************************************************/
+
+/******************************************************************************
+
+  @file    rmnetctl_test.c
+  @brief   test of the rmnet control API's against a fake kernel
+
+  DESCRIPTION
+  Runs the rmnet control API's on a socketpair whose other end is served by a
+  fake rmnet kernel module. Checks the single transactions, the batches with
+  the responses in and out of order, with stale and duplicate responses, and
+  compares the time of a batch to the time of as many single transactions.
+
+******************************************************************************/
+
+/*===========================================================================
+				INCLUDE FILES
+===========================================================================*/
+#include <sys/socket.h>
+#include <stdint.h>
+#include <linux/netlink.h>
+#include <linux/rmnet_data.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "librmnetctl.h"
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+			__func__, __LINE__, #cond); \
+		return -1; \
+	} \
+} while (0)
+
+#define MSG_SIZE (sizeof(struct nlmsghdr) + sizeof(struct rmnet_nl_msg_s))
+#define MAX_VNDS 128
+#define MAX_HELD 16
+#define BATCH_SIZE 100
+/* Time the fake kernel waits for more requests before it sends the
+ * responses it holds back */
+#define FLUSH_TIMEOUT_MS 10
+
+/*===========================================================================
+			FAKE KERNEL
+===========================================================================*/
+/*!
+* @brief Fake rmnet kernel module answering on one end of a socketpair
+* @var fd kernel end of the socketpair
+* @var app_fd library end of the socketpair
+* @var reorder number of responses held back and sent in reverse order
+* @var stale send a response to an old sequence number before the next one
+* @var duplicate send every response twice
+* @var wrong_type answer the next request with another message type
+* @var requests number of requests received
+* @var bad_requests number of requests with a bad header
+* @var vnd_names names of the virtual network devices
+*/
+struct fake_kernel {
+	int fd;
+	int app_fd;
+	pthread_t thread;
+	volatile int reorder;
+	volatile int stale;
+	volatile int duplicate;
+	volatile int wrong_type;
+	uint32_t requests;
+	uint32_t bad_requests;
+	char vnd_names[MAX_VNDS][RMNET_MAX_STR_LEN];
+};
+
+static void fake_kernel_set_code(struct rmnet_nl_msg_s *msg, uint16_t code)
+{
+	msg->crd = RMNET_NETLINK_MSG_RETURNCODE;
+	msg->return_code = code;
+}
+
+static void fake_kernel_handle(struct fake_kernel *kernel,
+			       const struct rmnet_nl_msg_s *request,
+			       struct rmnet_nl_msg_s *response)
+{
+	uint32_t id = request->vnd.id;
+	char name[2 * RMNET_MAX_STR_LEN];
+
+	memset(response, 0, sizeof(*response));
+	response->message_type = request->message_type;
+
+	switch (request->message_type) {
+	case RMNET_NETLINK_NEW_VND:
+	case RMNET_NETLINK_NEW_VND_WITH_PREFIX:
+		if (id >= MAX_VNDS) {
+			fake_kernel_set_code(response, RMNET_CONFIG_BAD_ARGUMENTS);
+		} else if (kernel->vnd_names[id][0]) {
+			fake_kernel_set_code(response, RMNET_CONFIG_DEVICE_IN_USE);
+		} else {
+			snprintf(name, sizeof(name), "%s%u",
+				 request->message_type == RMNET_NETLINK_NEW_VND ?
+				 "rmnet_data" : (const char *)request->vnd.vnd_name,
+				 id);
+			strlcpy(kernel->vnd_names[id], name, RMNET_MAX_STR_LEN);
+			fake_kernel_set_code(response, RMNET_CONFIG_OK);
+		}
+		break;
+	case RMNET_NETLINK_FREE_VND:
+		if ((id >= MAX_VNDS) || !kernel->vnd_names[id][0]) {
+			fake_kernel_set_code(response, RMNET_CONFIG_NO_SUCH_DEVICE);
+		} else {
+			kernel->vnd_names[id][0] = '\0';
+			fake_kernel_set_code(response, RMNET_CONFIG_OK);
+		}
+		break;
+	case RMNET_NETLINK_GET_VND_NAME:
+		if ((id >= MAX_VNDS) || !kernel->vnd_names[id][0]) {
+			fake_kernel_set_code(response, RMNET_CONFIG_NO_SUCH_DEVICE);
+		} else {
+			response->crd = RMNET_NETLINK_MSG_RETURNDATA;
+			response->vnd.id = id;
+			memcpy(response->vnd.vnd_name, kernel->vnd_names[id],
+			       RMNET_MAX_STR_LEN);
+		}
+		break;
+	case RMNET_NETLINK_SET_LOGICAL_EP_CONFIG:
+	case RMNET_NETLINK_UNSET_LOGICAL_EP_CONFIG:
+		fake_kernel_set_code(response, RMNET_CONFIG_OK);
+		break;
+	default:
+		fake_kernel_set_code(response, RMNET_CONFIG_UNKNOWN_MESSAGE);
+		break;
+	}
+}
+
+static void fake_kernel_send(struct fake_kernel *kernel, const uint8_t *msg)
+{
+	send(kernel->fd, msg, MSG_SIZE, 0);
+	if (kernel->duplicate)
+		send(kernel->fd, msg, MSG_SIZE, 0);
+}
+
+static void fake_kernel_flush(struct fake_kernel *kernel,
+			      uint8_t held[][MSG_SIZE], int *num_held)
+{
+	while (*num_held > 0) {
+		(*num_held)--;
+		fake_kernel_send(kernel, held[*num_held]);
+	}
+}
+
+static void *fake_kernel_thread(void *arg)
+{
+	struct fake_kernel *kernel = (struct fake_kernel *)arg;
+	uint8_t request_buf[MSG_SIZE + 16];
+	uint8_t held[MAX_HELD][MSG_SIZE];
+	int num_held = 0;
+
+	for (;;) {
+		struct pollfd pfd = { kernel->fd, POLLIN, 0 };
+		struct nlmsghdr *request_hdr = (struct nlmsghdr *)request_buf;
+		struct nlmsghdr *response_hdr;
+		struct rmnet_nl_msg_s *request, *response;
+		ssize_t len;
+
+		if (poll(&pfd, 1, num_held ? FLUSH_TIMEOUT_MS : -1) == 0) {
+			fake_kernel_flush(kernel, held, &num_held);
+			continue;
+		}
+		len = recv(kernel->fd, request_buf, sizeof(request_buf), 0);
+		if (len <= 0)
+			break;
+
+		kernel->requests++;
+		request = (struct rmnet_nl_msg_s *)NLMSG_DATA(request_buf);
+		if ((len != MSG_SIZE) || (request_hdr->nlmsg_len != MSG_SIZE) ||
+		    (request_hdr->nlmsg_pid != (uint32_t)getpid()) ||
+		    (request->crd != RMNET_NETLINK_MSG_COMMAND)) {
+			kernel->bad_requests++;
+			continue;
+		}
+
+		if (kernel->stale) {
+			uint8_t stale_buf[MSG_SIZE];
+
+			memset(stale_buf, 0, sizeof(stale_buf));
+			response_hdr = (struct nlmsghdr *)stale_buf;
+			response_hdr->nlmsg_len = MSG_SIZE;
+			response_hdr->nlmsg_seq = request_hdr->nlmsg_seq - 1000;
+			response = (struct rmnet_nl_msg_s *)NLMSG_DATA(stale_buf);
+			response->message_type = request->message_type;
+			fake_kernel_set_code(response, RMNET_CONFIG_UNKNOWN_ERROR);
+			send(kernel->fd, stale_buf, MSG_SIZE, 0);
+			kernel->stale = 0;
+		}
+
+		response_hdr = (struct nlmsghdr *)held[num_held];
+		memset(response_hdr, 0, sizeof(*response_hdr));
+		response_hdr->nlmsg_len = MSG_SIZE;
+		response_hdr->nlmsg_seq = request_hdr->nlmsg_seq;
+		response = (struct rmnet_nl_msg_s *)NLMSG_DATA(held[num_held]);
+		fake_kernel_handle(kernel, request, response);
+		if (kernel->wrong_type) {
+			response->message_type++;
+			kernel->wrong_type = 0;
+		}
+		num_held++;
+
+		if (num_held >= kernel->reorder)
+			fake_kernel_flush(kernel, held, &num_held);
+	}
+	return NULL;
+}
+
+static ssize_t fake_transport_send(void *ctx, const void *buf, size_t len)
+{
+	struct fake_kernel *kernel = (struct fake_kernel *)ctx;
+
+	return send(kernel->app_fd, buf, len, 0);
+}
+
+static ssize_t fake_transport_recv(void *ctx, void *buf, size_t len)
+{
+	struct fake_kernel *kernel = (struct fake_kernel *)ctx;
+
+	return recv(kernel->app_fd, buf, len, 0);
+}
+
+static void fake_transport_close(void *ctx)
+{
+	struct fake_kernel *kernel = (struct fake_kernel *)ctx;
+
+	shutdown(kernel->app_fd, SHUT_RDWR);
+	pthread_join(kernel->thread, NULL);
+	close(kernel->app_fd);
+	close(kernel->fd);
+}
+
+static int fake_kernel_start(struct fake_kernel *kernel, rmnetctl_hndl_t **hndl)
+{
+	struct rmnetctl_transport_s transport;
+	int fds[2];
+	uint16_t error_code = 0;
+
+	memset(kernel, 0, sizeof(*kernel));
+	CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+	kernel->app_fd = fds[0];
+	kernel->fd = fds[1];
+	kernel->reorder = 1;
+	CHECK(pthread_create(&kernel->thread, NULL, fake_kernel_thread,
+			     kernel) == 0);
+
+	transport.ctx = kernel;
+	transport.send = fake_transport_send;
+	transport.recv = fake_transport_recv;
+	transport.close = fake_transport_close;
+	CHECK(rmnetctl_init_transport(hndl, &transport, &error_code) ==
+	      RMNETCTL_SUCCESS);
+	return 0;
+}
+
+/*===========================================================================
+				TESTS
+===========================================================================*/
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void vnd_request(struct rmnet_nl_msg_s *request, uint16_t type,
+			uint32_t id)
+{
+	memset(request, 0, sizeof(*request));
+	request->message_type = type;
+	request->arg_length = sizeof(uint32_t);
+	request->vnd.id = id;
+}
+
+static int test_single(void)
+{
+	struct fake_kernel kernel;
+	rmnetctl_hndl_t *hndl = NULL;
+	uint16_t error_code = 0;
+	char name[RMNET_MAX_STR_LEN];
+	char *next_dev = name;
+	uint8_t mode;
+
+	CHECK(fake_kernel_start(&kernel, &hndl) == 0);
+
+	CHECK(rmnet_new_vnd(hndl, 3, &error_code, RMNETCTL_NEW_VND) ==
+	      RMNETCTL_SUCCESS);
+	CHECK(error_code == RMNETCTL_API_SUCCESS);
+	CHECK(rmnet_new_vnd(hndl, 3, &error_code, RMNETCTL_NEW_VND) ==
+	      RMNETCTL_KERNEL_ERR);
+	CHECK(error_code == RMETNCTL_KERNEL_ERR_DEVICE_IN_USE);
+	CHECK(rmnet_new_vnd_prefix(hndl, 4, &error_code, RMNETCTL_NEW_VND,
+				   "rev_rmnet") == RMNETCTL_SUCCESS);
+
+	CHECK(rmnet_get_vnd_name(hndl, 3, &error_code, name, sizeof(name)) ==
+	      RMNETCTL_SUCCESS);
+	CHECK(strcmp(name, "rmnet_data3") == 0);
+	CHECK(rmnet_get_vnd_name(hndl, 4, &error_code, name, sizeof(name)) ==
+	      RMNETCTL_SUCCESS);
+	CHECK(strcmp(name, "rev_rmnet4") == 0);
+	CHECK(rmnet_get_vnd_name(hndl, 5, &error_code, name, sizeof(name)) ==
+	      RMNETCTL_KERNEL_ERR);
+	CHECK(error_code == RMNETCTL_KERNEL_ERR_NO_SUCH_DEVICE);
+
+	CHECK(rmnet_get_logical_ep_config(hndl, 1, "rmnet_ipa0", &mode,
+					  &next_dev, sizeof(name),
+					  &error_code) == RMNETCTL_KERNEL_ERR);
+	CHECK(error_code == RMNETCTL_KERNEL_ERR_UNKNOWN_MESSAGE);
+
+	kernel.wrong_type = 1;
+	CHECK(rmnet_new_vnd(hndl, 3, &error_code, RMNETCTL_FREE_VND) ==
+	      RMNETCTL_LIB_ERR);
+	CHECK(error_code == RMNETCTL_API_ERR_MESSAGE_TYPE);
+
+	rmnetctl_cleanup(hndl);
+	CHECK(kernel.requests == 8);
+	CHECK(kernel.bad_requests == 0);
+	return 0;
+}
+
+static int run_batch(rmnetctl_hndl_t *hndl, uint16_t type,
+		     struct rmnet_nl_msg_s *requests,
+		     struct rmnet_nl_msg_s *responses)
+{
+	uint16_t error_code = 0;
+	uint32_t i;
+
+	for (i = 0; i < BATCH_SIZE; i++)
+		vnd_request(&requests[i], type, i);
+	CHECK(rmnetctl_transact_batch(hndl, requests, responses, BATCH_SIZE,
+				      &error_code) == RMNETCTL_SUCCESS);
+	CHECK(error_code == RMNETCTL_API_SUCCESS);
+	return 0;
+}
+
+static int test_batch(int reorder, int stale, int duplicate)
+{
+	static struct rmnet_nl_msg_s requests[BATCH_SIZE], responses[BATCH_SIZE];
+	struct fake_kernel kernel;
+	rmnetctl_hndl_t *hndl = NULL;
+	char name[RMNET_MAX_STR_LEN];
+	uint32_t i;
+
+	CHECK(fake_kernel_start(&kernel, &hndl) == 0);
+	kernel.reorder = reorder;
+	kernel.duplicate = duplicate;
+
+	kernel.stale = stale;
+	CHECK(run_batch(hndl, RMNET_NETLINK_NEW_VND, requests, responses) == 0);
+	for (i = 0; i < BATCH_SIZE; i++) {
+		CHECK(responses[i].crd == RMNET_NETLINK_MSG_RETURNCODE);
+		CHECK(responses[i].return_code == RMNET_CONFIG_OK);
+	}
+
+	kernel.stale = stale;
+	CHECK(run_batch(hndl, RMNET_NETLINK_GET_VND_NAME, requests,
+			responses) == 0);
+	for (i = 0; i < BATCH_SIZE; i++) {
+		snprintf(name, sizeof(name), "rmnet_data%u", i);
+		CHECK(responses[i].crd == RMNET_NETLINK_MSG_RETURNDATA);
+		CHECK(responses[i].vnd.id == i);
+		CHECK(strcmp((char *)responses[i].vnd.vnd_name, name) == 0);
+	}
+
+	kernel.stale = stale;
+	CHECK(run_batch(hndl, RMNET_NETLINK_FREE_VND, requests, responses) == 0);
+	for (i = 0; i < BATCH_SIZE; i++) {
+		CHECK(responses[i].crd == RMNET_NETLINK_MSG_RETURNCODE);
+		CHECK(responses[i].return_code == RMNET_CONFIG_OK);
+	}
+	for (i = 0; i < MAX_VNDS; i++)
+		CHECK(kernel.vnd_names[i][0] == '\0');
+
+	/* The handle still works one transaction at a time after a batch */
+	kernel.reorder = 1;
+	kernel.duplicate = 0;
+	CHECK(run_batch(hndl, RMNET_NETLINK_NEW_VND, requests, responses) == 0);
+	CHECK(rmnet_get_vnd_name(hndl, 7, &(uint16_t){0}, name,
+				 sizeof(name)) == RMNETCTL_SUCCESS);
+	CHECK(strcmp(name, "rmnet_data7") == 0);
+
+	rmnetctl_cleanup(hndl);
+	CHECK(kernel.requests == 4 * BATCH_SIZE + 1);
+	CHECK(kernel.bad_requests == 0);
+	return 0;
+}
+
+static int test_batch_errors(void)
+{
+	struct rmnet_nl_msg_s requests[4], responses[4];
+	struct fake_kernel kernel;
+	rmnetctl_hndl_t *hndl = NULL;
+	uint16_t error_code = 0;
+	uint32_t i;
+
+	memset(requests, 0, sizeof(requests));
+	CHECK(rmnetctl_transact_batch(NULL, requests, responses, 4,
+				      &error_code) == RMNETCTL_INVALID_ARG);
+
+	CHECK(fake_kernel_start(&kernel, &hndl) == 0);
+	CHECK(rmnetctl_transact_batch(hndl, NULL, responses, 4,
+				      &error_code) == RMNETCTL_INVALID_ARG);
+	CHECK(rmnetctl_transact_batch(hndl, requests, responses, 0,
+				      &error_code) == RMNETCTL_SUCCESS);
+
+	/* A response of the wrong type fails the batch but every request
+	 * still gets its response */
+	for (i = 0; i < 4; i++)
+		vnd_request(&requests[i], RMNET_NETLINK_NEW_VND, i);
+	kernel.wrong_type = 1;
+	CHECK(rmnetctl_transact_batch(hndl, requests, responses, 4,
+				      &error_code) == RMNETCTL_LIB_ERR);
+	CHECK(error_code == RMNETCTL_API_ERR_MESSAGE_TYPE);
+	CHECK(responses[0].message_type != requests[0].message_type);
+	for (i = 1; i < 4; i++)
+		CHECK(responses[i].return_code == RMNET_CONFIG_OK);
+
+	/* Kernel errors are left in the responses */
+	CHECK(rmnetctl_transact_batch(hndl, requests, responses, 4,
+				      &error_code) == RMNETCTL_SUCCESS);
+	for (i = 0; i < 4; i++)
+		CHECK(responses[i].return_code == RMNET_CONFIG_DEVICE_IN_USE);
+
+	rmnetctl_cleanup(hndl);
+	CHECK(kernel.bad_requests == 0);
+	return 0;
+}
+
+static int test_benchmark(int iterations)
+{
+	struct rmnet_nl_msg_s *requests, *responses;
+	struct fake_kernel kernel;
+	rmnetctl_hndl_t *hndl = NULL;
+	uint16_t error_code = 0;
+	char name[RMNET_MAX_STR_LEN];
+	uint64_t start, single_us, batch_us;
+	int i;
+
+	requests = calloc(iterations, sizeof(*requests));
+	responses = calloc(iterations, sizeof(*responses));
+	CHECK(requests && responses);
+	CHECK(fake_kernel_start(&kernel, &hndl) == 0);
+	CHECK(rmnet_new_vnd(hndl, 0, &error_code, RMNETCTL_NEW_VND) ==
+	      RMNETCTL_SUCCESS);
+
+	start = now_us();
+	for (i = 0; i < iterations; i++)
+		CHECK(rmnet_get_vnd_name(hndl, 0, &error_code, name,
+					 sizeof(name)) == RMNETCTL_SUCCESS);
+	single_us = now_us() - start;
+
+	for (i = 0; i < iterations; i++)
+		vnd_request(&requests[i], RMNET_NETLINK_GET_VND_NAME, 0);
+	start = now_us();
+	CHECK(rmnetctl_transact_batch(hndl, requests, responses, iterations,
+				      &error_code) == RMNETCTL_SUCCESS);
+	batch_us = now_us() - start;
+	for (i = 0; i < iterations; i++)
+		CHECK(responses[i].crd == RMNET_NETLINK_MSG_RETURNDATA);
+
+	rmnetctl_cleanup(hndl);
+	free(requests);
+	free(responses);
+
+	fprintf(stderr, "%-25s%.2f us single, %.2f us batch\n", "Transact: ",
+		(double)single_us / iterations, (double)batch_us / iterations);
+	return 0;
+}
+
+static void print_usage(void)
+{
+	fprintf(stderr, "Usage: program_name [options]\n");
+	fprintf(stderr, "Optional:\n");
+	fprintf(stderr, "  -n ITERATIONS\t\tbenchmark requests, default 20000\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 20000;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return -1;
+		}
+	}
+	if (iterations <= 0) {
+		print_usage();
+		return -1;
+	}
+
+	ret |= test_single();
+	fprintf(stderr, "%-25s%s\n", "Single: ", ret ? "failed" : "ok");
+	ret |= test_batch(1, 0, 0);
+	ret |= test_batch(5, 0, 0);
+	ret |= test_batch(MAX_HELD, 1, 1);
+	fprintf(stderr, "%-25s%s\n", "Batch: ", ret ? "failed" : "ok");
+	ret |= test_batch_errors();
+	fprintf(stderr, "%-25s%s\n", "Batch errors: ", ret ? "failed" : "ok");
+	ret |= test_benchmark(iterations);
+
+	fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+	return ret;
+}
@@ -32,10 +32,13 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_SRC_FILES := \
     service.cpp \
     Power.cpp \
+    hint-dispatcher.c \
+    interaction-boost.c \
     power-helper.c \
+    cpu-state.c \
+    stats-reader.c \
     metadata-parser.c \
     utils.c \
-    list.c \
     hint-data.c
 
 LOCAL_C_INCLUDES := external/libxml2/include \
@@ -99,3 +102,5 @@ LOCAL_MODULE_OWNER := qcom
 LOCAL_VENDOR_MODULE := true
 LOCAL_HEADER_LIBRARIES := libhardware_headers
 include $(BUILD_EXECUTABLE)
+
+include $(LOCAL_PATH)/test/Android.mk
@@ -25,6 +25,7 @@
 
 #include <log/log.h>
 #include "Power.h"
+#include "hint-dispatcher.h"
 #include "power-common.h"
 #include "power-helper.h"
 
@@ -56,16 +57,17 @@ using ::android::hardware::Void;
 
 Power::Power() {
     power_init();
+    hint_dispatcher_init();
 }
 
 // Methods from ::android::hardware::power::V1_0::IPower follow.
 Return<void> Power::setInteractive(bool interactive)  {
-    power_set_interactive(interactive ? 1 : 0);
+    hint_dispatcher_set_interactive(interactive ? 1 : 0);
     return Void();
 }
 
 Return<void> Power::powerHint(PowerHint hint, int32_t data) {
-    power_hint(static_cast<power_hint_t>(hint), &data);
+    hint_dispatcher_power_hint(static_cast<power_hint_t>(hint), data);
     return Void();
 }
 
@@ -237,6 +239,14 @@ Return<int32_t> Power::getFeature(LineageFeature feature)  {
     return -1;
 }
 
+Return<void> Power::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
+    if (handle != nullptr && handle->numFds >= 1) {
+        hint_dispatcher_dump(handle->data[0]);
+        power_dump(handle->data[0]);
+    }
+    return Void();
+}
+
 status_t Power::registerAsSystemService() {
     status_t ret = 0;
 
@@ -47,6 +47,9 @@ using ::android::hardware::power::V1_1::IPower;
 #endif
 using ::vendor::lineage::power::V1_0::ILineagePower;
 using ::vendor::lineage::power::V1_0::LineageFeature;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
 
@@ -71,6 +74,7 @@ struct Power : public IPower, public ILineagePower {
     Return<int32_t> getFeature(LineageFeature feature) override;
 
     // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& handle, const hidl_vec<hidl_string>& args) override;
 
 };
 
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NIDEBUG 0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "QCOM PowerHAL"
+#include <log/log.h>
+
+#include "cpu-state.h"
+
+#define USINSEC 1000000L
+#define NSINUS 1000L
+#define USINMS 1000L
+
+#define CPU_WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF)
+
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cpu_state state;
+/* Leaves room in PATH_MAX for the node names */
+static char cpu_root[PATH_MAX - 64];
+static uint64_t max_age_us;
+static uint64_t refreshed_us;
+static int initialized;
+static int stale;
+
+/* inotify on the governor and online nodes, -1 when unavailable */
+static int inotify_fd = -1;
+static int governor_wd[CPU_STATE_MAX_CPUS];
+static int online_wd = -1;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * USINSEC + ts.tv_nsec / NSINUS;
+}
+
+static int read_node(const char *path, char *buf, int size)
+{
+    int fd, count;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    count = read(fd, buf, size - 1);
+    close(fd);
+    if (count < 0)
+        return -1;
+
+    /* Strip newline at the end. */
+    while (count > 0 && (buf[count - 1] == '\n' || buf[count - 1] == '\r'))
+        count--;
+    buf[count] = '\0';
+
+    return 0;
+}
+
+/* Parses a cpu list like "0-1,3" */
+static uint32_t parse_cpu_list(const char *list)
+{
+    uint32_t mask = 0;
+    long first, last;
+    char *end;
+
+    while (*list) {
+        first = strtol(list, &end, 10);
+        if (end == list)
+            break;
+        last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        for (; first <= last && first < 32; first++)
+            mask |= 1U << first;
+        list = (*end == ',') ? end + 1 : end;
+    }
+
+    return mask;
+}
+
+static void governor_path(char *path, int size, int cpu)
+{
+    snprintf(path, size, "%s/cpu%d/cpufreq/scaling_governor", cpu_root, cpu);
+}
+
+/* Watches that failed, e.g. on an offline core, are retried every refresh */
+static void add_watches(void)
+{
+    char path[PATH_MAX];
+    int cpu;
+
+    if (inotify_fd < 0)
+        return;
+
+    for (cpu = 0; cpu < CPU_STATE_MAX_CPUS; cpu++) {
+        if (governor_wd[cpu] >= 0)
+            continue;
+        governor_path(path, sizeof(path), cpu);
+        governor_wd[cpu] = inotify_add_watch(inotify_fd, path, CPU_WATCH_MASK);
+    }
+    if (online_wd < 0) {
+        snprintf(path, sizeof(path), "%s/online", cpu_root);
+        online_wd = inotify_add_watch(inotify_fd, path, CPU_WATCH_MASK);
+    }
+}
+
+/* Drains pending events, returns whether any watched node changed */
+static int check_events(void)
+{
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *event;
+    int changed = 0, cpu;
+    ssize_t len, off;
+
+    if (inotify_fd < 0)
+        return 0;
+
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        changed = 1;
+        for (off = 0; off < len; off += sizeof(*event) + event->len) {
+            event = (struct inotify_event *)(buf + off);
+            if (!(event->mask & (IN_IGNORED | IN_DELETE_SELF)))
+                continue;
+            /* The node went away, watch it again once it's back */
+            for (cpu = 0; cpu < CPU_STATE_MAX_CPUS; cpu++)
+                if (governor_wd[cpu] == event->wd)
+                    governor_wd[cpu] = -1;
+            if (online_wd == event->wd)
+                online_wd = -1;
+        }
+    }
+
+    return changed;
+}
+
+static void refresh(uint64_t now)
+{
+    char path[PATH_MAX];
+    char online[64];
+    int cpu;
+
+    add_watches();
+
+    for (cpu = 0; cpu < CPU_STATE_MAX_CPUS; cpu++) {
+        governor_path(path, sizeof(path), cpu);
+        if (read_node(path, state.governor[cpu], CPU_GOVERNOR_LEN))
+            state.governor[cpu][0] = '\0';
+    }
+
+    snprintf(path, sizeof(path), "%s/online", cpu_root);
+    if (read_node(path, online, sizeof(online)) == 0)
+        state.online_mask = parse_cpu_list(online);
+    else
+        state.online_mask = 0;
+
+    state.generation++;
+    refreshed_us = now;
+    stale = 0;
+}
+
+int cpu_state_init(const char *root, int max_age_ms)
+{
+    int cpu;
+
+    pthread_mutex_lock(&state_lock);
+    if (initialized) {
+        pthread_mutex_unlock(&state_lock);
+        return 0;
+    }
+
+    strlcpy(cpu_root, root, sizeof(cpu_root));
+    max_age_us = (uint64_t)max_age_ms * USINMS;
+    for (cpu = 0; cpu < CPU_STATE_MAX_CPUS; cpu++)
+        governor_wd[cpu] = -1;
+    online_wd = -1;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0)
+        ALOGW("No inotify, cpu state refreshes every %d ms", max_age_ms);
+
+    memset(&state, 0, sizeof(state));
+    refresh(now_us());
+    initialized = 1;
+    pthread_mutex_unlock(&state_lock);
+
+    return 0;
+}
+
+void cpu_state_deinit(void)
+{
+    pthread_mutex_lock(&state_lock);
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    inotify_fd = -1;
+    initialized = 0;
+    pthread_mutex_unlock(&state_lock);
+}
+
+int cpu_state_get(struct cpu_state *out)
+{
+    uint64_t now;
+
+    if (!initialized)
+        cpu_state_init(CPU_SYSFS_ROOT, CPU_STATE_MAX_AGE_MS);
+
+    pthread_mutex_lock(&state_lock);
+    now = now_us();
+    if (check_events())
+        stale = 1;
+    if (stale || now - refreshed_us >= max_age_us)
+        refresh(now);
+    *out = state;
+    pthread_mutex_unlock(&state_lock);
+
+    return 0;
+}
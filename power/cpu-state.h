@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CPU_STATE_H__
+#define __CPU_STATE_H__
+
+#include <stdint.h>
+
+#define CPU_SYSFS_ROOT          "/sys/devices/system/cpu"
+#define CPU_STATE_MAX_CPUS      4
+#define CPU_GOVERNOR_LEN        32
+
+/* Longest a snapshot is served without looking at sysfs. Writes to the
+ * watched nodes refresh it earlier, but kernel side changes like hotplug
+ * don't notify. */
+#define CPU_STATE_MAX_AGE_MS    1000
+
+/*
+ * Governor and online cores as last read from sysfs. governor is empty
+ * for cores whose cpufreq node can't be read, e.g. while offline.
+ * generation goes up on every refresh.
+ */
+struct cpu_state {
+    char governor[CPU_STATE_MAX_CPUS][CPU_GOVERNOR_LEN];
+    uint32_t online_mask;
+    uint32_t generation;
+};
+
+int cpu_state_init(const char *root, int max_age_ms);
+void cpu_state_deinit(void);
+
+/* Copies the current snapshot, refreshing it first if it went stale */
+int cpu_state_get(struct cpu_state *state);
+
+#endif //__CPU_STATE_H__
@@ -27,23 +27,131 @@
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
+#include <stdio.h>
+
 #include <log/log.h>
 
 #include "hint-data.h"
 
-int hint_compare(struct hint_data *first_hint,
-        struct hint_data *other_hint) {
-    if (first_hint == other_hint) {
-        return 0;
-    } else if ((first_hint && other_hint) &&
-            (first_hint->hint_id == other_hint->hint_id)) {
-        return 0;
-    } else {
+#define HINT_TABLE_MASK (HINT_TABLE_SIZE - 1)
+#define USINMS 1000
+
+static unsigned int hint_slot(unsigned long hint_id)
+{
+    /* Fibonacci hashing spreads the 0x100 spaced IDs over the table */
+    return ((uint32_t)hint_id * 2654435761U) >> (32 - HINT_TABLE_BITS);
+}
+
+static struct hint_data *hint_lookup(struct hint_table *table,
+        unsigned long hint_id, struct hint_data **free_entry)
+{
+    struct hint_data *entry;
+    unsigned int slot = hint_slot(hint_id);
+    int n;
+
+    if (free_entry)
+        *free_entry = NULL;
+
+    for (n = 0; n < HINT_TABLE_SIZE; n++) {
+        entry = &table->entries[(slot + n) & HINT_TABLE_MASK];
+        if (!entry->in_use) {
+            if (free_entry)
+                *free_entry = entry;
+            return NULL;
+        }
+        if (entry->hint_id == hint_id)
+            return entry;
+    }
+
+    return NULL;
+}
+
+/*
+ * Stores the lock of a hint. A hint holds one lock at a time, so a lock
+ * already stored for the hint is replaced and handed back for release.
+ * Returns 1 when a lock was replaced, 0 when the hint was added, or
+ * -ENOSPC.
+ */
+int hint_table_add(struct hint_table *table, unsigned long hint_id,
+        unsigned long perflock_handle, uint64_t now_us,
+        unsigned long *replaced_handle)
+{
+    struct hint_data *entry, *free_entry;
+
+    entry = hint_lookup(table, hint_id, &free_entry);
+    if (entry) {
+        *replaced_handle = entry->perflock_handle;
+        entry->perflock_handle = perflock_handle;
+        entry->acquired_us = now_us;
         return 1;
     }
+
+    if (!free_entry)
+        return -ENOSPC;
+
+    free_entry->hint_id = hint_id;
+    free_entry->perflock_handle = perflock_handle;
+    free_entry->acquired_us = now_us;
+    free_entry->in_use = 1;
+    table->count++;
+
+    return 0;
+}
+
+/*
+ * Takes the lock of a hint out of the table. The entries after it move
+ * back, so lookups never need tombstones. Returns -ENOENT when the hint
+ * holds no lock.
+ */
+int hint_table_remove(struct hint_table *table, unsigned long hint_id,
+        unsigned long *perflock_handle)
+{
+    struct hint_data *entry;
+    unsigned int hole, next, home;
+    int n;
+
+    entry = hint_lookup(table, hint_id, NULL);
+    if (!entry)
+        return -ENOENT;
+
+    *perflock_handle = entry->perflock_handle;
+    entry->in_use = 0;
+    table->count--;
+
+    hole = entry - table->entries;
+    next = hole;
+    for (n = 1; n < HINT_TABLE_SIZE; n++) {
+        next = (next + 1) & HINT_TABLE_MASK;
+        entry = &table->entries[next];
+        if (!entry->in_use)
+            break;
+
+        /* Entries whose home slot lies after the hole stay reachable */
+        home = hint_slot(entry->hint_id);
+        if (((next - home) & HINT_TABLE_MASK) < ((next - hole) & HINT_TABLE_MASK))
+            continue;
+
+        table->entries[hole] = *entry;
+        entry->in_use = 0;
+        hole = next;
+    }
+
+    return 0;
 }
 
-void hint_dump(struct hint_data *hint)
+void hint_table_dump(struct hint_table *table, int fd, uint64_t now_us)
 {
-    ALOGV("hint_id: %lu", hint->hint_id);
+    struct hint_data *entry;
+    int i;
+
+    dprintf(fd, "Active hint locks: %d\n", table->count);
+    for (i = 0; i < HINT_TABLE_SIZE; i++) {
+        entry = &table->entries[i];
+        if (!entry->in_use)
+            continue;
+        dprintf(fd, "  hint 0x%lx: handle %lu, held %llu ms\n",
+                entry->hint_id, entry->perflock_handle,
+                (unsigned long long)((now_us - entry->acquired_us) / USINMS));
+    }
 }
@@ -28,6 +28,8 @@
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdint.h>
+
 /* Default use-case hint IDs */
 #define DEFAULT_VIDEO_ENCODE_HINT_ID    (0x0A00)
 #define DEFAULT_VIDEO_DECODE_HINT_ID    (0x0B00)
@@ -54,11 +56,26 @@
 
 #define DEFAULT_PROFILE_HINT_ID         (0xFF00)
 
+/* Active perf locks, by hint ID. Must be a power of two. */
+#define HINT_TABLE_BITS                 5
+#define HINT_TABLE_SIZE                 (1 << HINT_TABLE_BITS)
+
 struct hint_data {
     unsigned long hint_id; /* This is our key. */
     unsigned long perflock_handle;
+    uint64_t acquired_us;
+    int in_use;
+};
+
+/* Open addressed with linear probing, no allocation */
+struct hint_table {
+    struct hint_data entries[HINT_TABLE_SIZE];
+    int count;
 };
 
-int hint_compare(struct hint_data *first_hint,
-        struct hint_data *other_hint);
-void hint_dump(struct hint_data *hint);
+int hint_table_add(struct hint_table *table, unsigned long hint_id,
+        unsigned long perflock_handle, uint64_t now_us,
+        unsigned long *replaced_handle);
+int hint_table_remove(struct hint_table *table, unsigned long hint_id,
+        unsigned long *perflock_handle);
+void hint_table_dump(struct hint_table *table, int fd, uint64_t now_us);
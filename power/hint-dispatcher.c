@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NIDEBUG 0
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+#define LOG_TAG "QCOM PowerHAL"
+#include <log/log.h>
+
+#include "hint-dispatcher.h"
+#include "power-common.h"
+#include "power-helper.h"
+
+#define USINSEC 1000000L
+#define NSINUS 1000L
+
+/* One slot per hint type: AOSP hints, Lineage hints and set_interactive */
+#define AOSP_HINT_SLOTS         0x20
+#define LINEAGE_HINT_BASE       0x100
+#define LINEAGE_HINT_SLOTS      0x20
+#define INTERACTIVE_SLOT        (AOSP_HINT_SLOTS + LINEAGE_HINT_SLOTS)
+#define NUM_SLOTS               (INTERACTIVE_SLOT + 1)
+#define EXIT_SLOT               (-1)
+
+/* A slot is queued at most once at a time, so the queue can't overflow */
+#define QUEUE_SIZE              128
+
+/* Bucket n counts latencies below 2^(n+1) us, the last one the rest */
+#define LATENCY_BUCKETS         16
+
+/* Set in a slot state while its hint waits for the dispatcher */
+#define SLOT_PENDING            (1ULL << 32)
+
+struct hint_slot {
+    /* SLOT_PENDING | data of the latest hint */
+    _Atomic uint64_t state;
+    /* time the hint got pending */
+    _Atomic uint64_t submit_us;
+    _Atomic uint32_t coalesced;
+
+    /* Updated by the dispatcher under stats_lock */
+    uint32_t handled;
+    uint64_t latency_sum_us;
+    uint64_t latency_max_us;
+    uint32_t latency_hist[LATENCY_BUCKETS];
+};
+
+struct queue_cell {
+    /* position + 1 once the cell is filled for that position */
+    _Atomic uint32_t seq;
+    int slot;
+};
+
+static struct hint_slot slots[NUM_SLOTS];
+
+static struct queue_cell queue[QUEUE_SIZE];
+static _Atomic uint32_t queue_head;
+/* Only touched by the dispatcher */
+static uint32_t queue_tail;
+static sem_t queue_sem;
+
+/* Hints submitted and not handled yet */
+static _Atomic int queued;
+
+static pthread_t dispatcher_thread;
+static _Atomic int dispatcher_running;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * USINSEC + ts.tv_nsec / NSINUS;
+}
+
+static int hint_to_slot(power_hint_t hint)
+{
+    int value = (int)hint;
+
+    if (value >= 0 && value < AOSP_HINT_SLOTS)
+        return value;
+    if (value >= LINEAGE_HINT_BASE &&
+            value < LINEAGE_HINT_BASE + LINEAGE_HINT_SLOTS)
+        return AOSP_HINT_SLOTS + value - LINEAGE_HINT_BASE;
+    return -1;
+}
+
+static power_hint_t slot_to_hint(int slot)
+{
+    if (slot < AOSP_HINT_SLOTS)
+        return (power_hint_t)slot;
+    return (power_hint_t)(LINEAGE_HINT_BASE + slot - AOSP_HINT_SLOTS);
+}
+
+static void queue_push(int slot)
+{
+    uint32_t pos = atomic_fetch_add(&queue_head, 1);
+    struct queue_cell *cell = &queue[pos % QUEUE_SIZE];
+
+    cell->slot = slot;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    sem_post(&queue_sem);
+}
+
+static int queue_pop(void)
+{
+    struct queue_cell *cell;
+
+    while (sem_wait(&queue_sem) == -1 && errno == EINTR)
+        ;
+
+    /* The cell may be claimed by a producer that hasn't filled it yet */
+    cell = &queue[queue_tail % QUEUE_SIZE];
+    while (atomic_load_explicit(&cell->seq, memory_order_acquire) !=
+            queue_tail + 1)
+        sched_yield();
+    queue_tail++;
+
+    return cell->slot;
+}
+
+static void submit(int slot, int32_t data)
+{
+    struct hint_slot *s = &slots[slot];
+    uint64_t old;
+
+    /* A hint still waiting for the dispatcher just takes the new data */
+    old = atomic_exchange(&s->state, SLOT_PENDING | (uint32_t)data);
+    if (old & SLOT_PENDING) {
+        atomic_fetch_add_explicit(&s->coalesced, 1, memory_order_relaxed);
+        return;
+    }
+
+    atomic_store_explicit(&s->submit_us, now_us(), memory_order_relaxed);
+    atomic_fetch_add(&queued, 1);
+    queue_push(slot);
+}
+
+static void update_stats(struct hint_slot *s, uint64_t latency_us)
+{
+    uint64_t v = latency_us;
+    int bucket = 0;
+
+    while (v > 1 && bucket < LATENCY_BUCKETS - 1) {
+        v >>= 1;
+        bucket++;
+    }
+
+    s->handled++;
+    s->latency_sum_us += latency_us;
+    if (latency_us > s->latency_max_us)
+        s->latency_max_us = latency_us;
+    s->latency_hist[bucket]++;
+}
+
+static void *dispatcher_loop(void *UNUSED(arg))
+{
+    struct hint_slot *s;
+    uint64_t state, submit_us;
+    int32_t data;
+    int slot;
+
+    prctl(PR_SET_NAME, (unsigned long)"power-hints", 0, 0, 0);
+
+    while ((slot = queue_pop()) != EXIT_SLOT) {
+        s = &slots[slot];
+        state = atomic_exchange(&s->state, 0);
+        submit_us = atomic_load_explicit(&s->submit_us, memory_order_relaxed);
+        data = (int32_t)(uint32_t)state;
+
+        if (slot == INTERACTIVE_SLOT)
+            power_set_interactive(data);
+        else
+            power_hint(slot_to_hint(slot), &data);
+
+        pthread_mutex_lock(&stats_lock);
+        update_stats(s, now_us() - submit_us);
+        if (atomic_fetch_sub(&queued, 1) == 1)
+            pthread_cond_broadcast(&idle_cond);
+        pthread_mutex_unlock(&stats_lock);
+    }
+
+    return NULL;
+}
+
+int hint_dispatcher_init(void)
+{
+    if (atomic_load(&dispatcher_running))
+        return 0;
+
+    if (sem_init(&queue_sem, 0, 0)) {
+        ALOGE("Failed to init hint queue: %s", strerror(errno));
+        return -1;
+    }
+
+    if (pthread_create(&dispatcher_thread, NULL, dispatcher_loop, NULL)) {
+        ALOGE("Failed to start hint dispatcher, handling hints inline");
+        sem_destroy(&queue_sem);
+        return -1;
+    }
+    atomic_store(&dispatcher_running, 1);
+
+    return 0;
+}
+
+void hint_dispatcher_deinit(void)
+{
+    if (!atomic_load(&dispatcher_running))
+        return;
+
+    queue_push(EXIT_SLOT);
+    pthread_join(dispatcher_thread, NULL);
+    atomic_store(&dispatcher_running, 0);
+    sem_destroy(&queue_sem);
+}
+
+void hint_dispatcher_power_hint(power_hint_t hint, int32_t data)
+{
+    int slot;
+
+    if (!atomic_load(&dispatcher_running)) {
+        power_hint(hint, &data);
+        return;
+    }
+
+    slot = hint_to_slot(hint);
+    if (slot < 0) {
+        ALOGW("Dropping unknown power hint 0x%x", hint);
+        return;
+    }
+    submit(slot, data);
+}
+
+void hint_dispatcher_set_interactive(int on)
+{
+    if (!atomic_load(&dispatcher_running)) {
+        power_set_interactive(on);
+        return;
+    }
+    submit(INTERACTIVE_SLOT, on);
+}
+
+void hint_dispatcher_wait_idle(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    while (atomic_load(&queued) > 0)
+        pthread_cond_wait(&idle_cond, &stats_lock);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void hint_dispatcher_dump(int fd)
+{
+    struct hint_slot *s;
+    uint32_t coalesced;
+    int i, b;
+
+    dprintf(fd, "Hint dispatcher: %s, %d queued\n",
+            atomic_load(&dispatcher_running) ? "running" : "stopped",
+            atomic_load(&queued));
+
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i < NUM_SLOTS; i++) {
+        s = &slots[i];
+        coalesced = atomic_load_explicit(&s->coalesced, memory_order_relaxed);
+        if (!s->handled && !coalesced)
+            continue;
+
+        if (i == INTERACTIVE_SLOT)
+            dprintf(fd, "  interactive:");
+        else
+            dprintf(fd, "  hint 0x%x:", slot_to_hint(i));
+        dprintf(fd, " handled %u, coalesced %u, latency avg %llu us,"
+                " max %llu us\n", s->handled, coalesced,
+                (unsigned long long)(s->handled ?
+                        s->latency_sum_us / s->handled : 0),
+                (unsigned long long)s->latency_max_us);
+
+        dprintf(fd, "    histogram:");
+        for (b = 0; b < LATENCY_BUCKETS; b++) {
+            if (!s->latency_hist[b])
+                continue;
+            if (b < LATENCY_BUCKETS - 1)
+                dprintf(fd, " <%uus:%u", 2U << b, s->latency_hist[b]);
+            else
+                dprintf(fd, " >=%uus:%u", 1U << b, s->latency_hist[b]);
+        }
+        dprintf(fd, "\n");
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HINT_DISPATCHER_H__
+#define __HINT_DISPATCHER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "hardware/power.h"
+
+/*
+ * Hints and interactive changes are handed to a dispatcher thread, so the
+ * binder threads never wait on sysfs or the perf daemon. A hint that is
+ * still pending when the same hint comes in again is replaced by the newer
+ * one. Everything that touches perf locks runs on the dispatcher thread,
+ * in the order the hint types first got pending.
+ */
+
+int hint_dispatcher_init(void);
+void hint_dispatcher_deinit(void);
+
+void hint_dispatcher_power_hint(power_hint_t hint, int32_t data);
+void hint_dispatcher_set_interactive(int on);
+
+/* Waits until every hint submitted so far has been handled */
+void hint_dispatcher_wait_idle(void);
+
+void hint_dispatcher_dump(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__HINT_DISPATCHER_H__
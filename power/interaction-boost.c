@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NIDEBUG 0
+
+#include <stdio.h>
+
+#define LOG_TAG "QCOM PowerHAL"
+#include <log/log.h>
+
+#include "interaction-boost.h"
+#include "utils.h"
+
+#define USINMS 1000L
+
+enum boost_result boost_request(struct boost boosts[BOOST_TYPES],
+        enum boost_type type, uint64_t now_us, int duration_ms)
+{
+    struct boost *boost = &boosts[type];
+    uint64_t end_us = now_us + (uint64_t)duration_ms * USINMS;
+    uint64_t slack_us = (uint64_t)duration_ms * USINMS / BOOST_MIN_EXTENSION_DIV;
+    enum boost_result result;
+    int t, handle;
+
+    /* A stronger boost lasting past this one already covers it */
+    for (t = type + 1; t < BOOST_TYPES; t++) {
+        if (boosts[t].expiry_us >= end_us) {
+            boost->suppressed++;
+            return BOOST_SUPPRESSED;
+        }
+    }
+
+    if (boost->expiry_us > now_us) {
+        if (end_us <= boost->expiry_us + slack_us) {
+            boost->suppressed++;
+            return BOOST_SUPPRESSED;
+        }
+        result = BOOST_EXTENDED;
+    } else {
+        result = BOOST_ISSUED;
+    }
+
+    handle = interaction_with_handle(boost->lock_handle, duration_ms,
+            boost->num_resources, boost->resources);
+    if (handle <= 0) {
+        /* Nothing is known to be held, try again on the next request */
+        boost->expiry_us = 0;
+        return BOOST_SUPPRESSED;
+    }
+
+    boost->lock_handle = handle;
+    boost->expiry_us = end_us;
+    if (result == BOOST_EXTENDED)
+        boost->extended++;
+    else
+        boost->issued++;
+
+    ALOGV("%s boost %s for %d ms", boost->name,
+            result == BOOST_EXTENDED ? "extended" : "issued", duration_ms);
+    return result;
+}
+
+void boost_dump(struct boost boosts[BOOST_TYPES], int fd)
+{
+    int t;
+
+    dprintf(fd, "Interaction boosts:\n");
+    for (t = 0; t < BOOST_TYPES; t++) {
+        dprintf(fd, "  %s: issued %u, extended %u, suppressed %u\n",
+                boosts[t].name, boosts[t].issued, boosts[t].extended,
+                boosts[t].suppressed);
+    }
+}
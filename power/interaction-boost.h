@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __INTERACTION_BOOST_H__
+#define __INTERACTION_BOOST_H__
+
+#include <stdint.h>
+
+/*
+ * Interaction boosts, ordered by strength: a boost holds at least the
+ * resources of the weaker ones. Each boost keeps one perf lock whose
+ * handle is reused, so a new request extends the running lock instead of
+ * adding another one. Requests already covered by a running boost of the
+ * same or a stronger type are suppressed.
+ */
+enum boost_type {
+    BOOST_TOUCH = 0,
+    BOOST_FLING,
+
+    //Don't add any lines after this line
+    BOOST_TYPES
+};
+
+enum boost_result {
+    BOOST_ISSUED = 0,
+    BOOST_EXTENDED,
+    BOOST_SUPPRESSED,
+};
+
+/* A running boost is only extended when that adds a quarter of the
+ * requested duration */
+#define BOOST_MIN_EXTENSION_DIV 4
+
+struct boost {
+    const char *name;
+    int *resources;
+    int num_resources;
+
+    int lock_handle;
+    /* CLOCK_MONOTONIC time the lock runs out */
+    uint64_t expiry_us;
+
+    uint32_t issued;
+    uint32_t extended;
+    uint32_t suppressed;
+};
+
+enum boost_result boost_request(struct boost boosts[BOOST_TYPES],
+        enum boost_type type, uint64_t now_us, int duration_ms);
+void boost_dump(struct boost boosts[BOOST_TYPES], int fd);
+
+#endif //__INTERACTION_BOOST_H__
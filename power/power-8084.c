@@ -46,6 +46,7 @@
 #include "utils.h"
 #include "metadata-defs.h"
 #include "hint-data.h"
+#include "interaction-boost.h"
 #include "performance.h"
 #include "power-common.h"
 
@@ -164,16 +165,27 @@ static int resources_interaction_boost[] = {
     CPU3_MIN_FREQ_NONTURBO_MAX + 1
 };
 
+static struct boost interaction_boosts[BOOST_TYPES] = {
+    [BOOST_TOUCH] = {
+        .name = "touch",
+        .resources = resources_interaction_boost,
+        .num_resources = ARRAY_SIZE(resources_interaction_boost),
+    },
+    [BOOST_FLING] = {
+        .name = "fling",
+        .resources = resources_interaction_fling_boost,
+        .num_resources = ARRAY_SIZE(resources_interaction_fling_boost),
+    },
+};
+
 const int DEFAULT_INTERACTIVE_DURATION   =  200; /* ms */
 const int MIN_FLING_DURATION             = 1500; /* ms */
 const int MAX_INTERACTIVE_DURATION       = 5000; /* ms */
 
 int power_hint_override(power_hint_t hint, void *data)
 {
-    static struct timespec s_previous_boost_timespec;
     struct timespec cur_boost_timespec;
-    long long elapsed_time;
-    static int s_previous_duration = 0;
+    uint64_t now_us;
     int duration;
 
     if (hint == POWER_HINT_SET_PROFILE) {
@@ -200,22 +212,12 @@ int power_hint_override(power_hint_t hint, void *data)
             }
 
             clock_gettime(CLOCK_MONOTONIC, &cur_boost_timespec);
+            now_us = (uint64_t)cur_boost_timespec.tv_sec * 1000000 +
+                    cur_boost_timespec.tv_nsec / 1000;
 
-            elapsed_time = calc_timespan_us(s_previous_boost_timespec, cur_boost_timespec);
-            // don't hint if previous hint's duration covers this hint's duration
-            if ((s_previous_duration * 1000) > (elapsed_time + duration * 1000)) {
-                return HINT_HANDLED;
-            }
-            s_previous_boost_timespec = cur_boost_timespec;
-            s_previous_duration = duration;
-
-            if (duration >= MIN_FLING_DURATION) {
-                interaction(duration, ARRAY_SIZE(resources_interaction_fling_boost),
-                        resources_interaction_fling_boost);
-            } else {
-                interaction(duration, ARRAY_SIZE(resources_interaction_boost),
-                        resources_interaction_boost);
-            }
+            boost_request(interaction_boosts,
+                    duration >= MIN_FLING_DURATION ? BOOST_FLING : BOOST_TOUCH,
+                    now_us, duration);
             return HINT_HANDLED;
         default:
             break;
@@ -266,3 +268,8 @@ int set_interactive_override(int on)
     }
     return HINT_HANDLED;
 }
+
+void power_dump_override(int fd)
+{
+    boost_dump(interaction_boosts, fd);
+}
@@ -38,6 +38,7 @@
 #include <fcntl.h>
 #include <dlfcn.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -46,12 +47,14 @@
 #include <hardware/power.h>
 
 #include "utils.h"
+#include "cpu-state.h"
 #include "metadata-defs.h"
 #include "hint-data.h"
 #include "performance.h"
 #include "power-common.h"
 #include "power-feature.h"
 #include "power-helper.h"
+#include "stats-reader.h"
 
 #define USINSEC 1000000L
 #define NSINUS 1000L
@@ -81,8 +84,6 @@
 #endif
 #endif
 
-#define LINE_SIZE 128
-
 #ifdef LEGACY_STATS
 /* Use these stats on pre-nougat qualcomm kernels */
 static const char *rpm_param_names[] = {
@@ -151,6 +152,7 @@ static int display_hint_sent;
 void power_init(void)
 {
     ALOGI("QCOM power HAL initing.");
+    cpu_state_init(CPU_SYSFS_ROOT, CPU_STATE_MAX_AGE_MS);
 }
 
 static void process_video_decode_hint(void *metadata)
@@ -387,50 +389,62 @@ void set_feature(feature_t feature, int state)
     set_device_specific_feature(feature, state);
 }
 
+void __attribute__((weak)) power_dump_override(int UNUSED(fd))
+{
+}
+
+void power_dump(int fd)
+{
+    dump_hint_actions(fd);
+    power_dump_override(fd);
+}
+
 #ifdef LEGACY_STATS
-static int extract_stats(uint64_t *list, char *file, const char**param_names,
-                         unsigned int num_parameters, int isHex) {
-    FILE *fp;
-    ssize_t read;
-    size_t len;
+static struct stats_file rpm_stat_file = STATS_DEBUGFS_INITIALIZER(RPM_STAT);
+static struct stats_file rpm_master_stat_file =
+        STATS_DEBUGFS_INITIALIZER(RPM_MASTER_STAT);
+#ifndef V1_0_HAL
+static struct stats_file wlan_stat_file = STATS_DEBUGFS_INITIALIZER(WLAN_POWER_STAT);
+#endif
+
+/* The parameters come in order, so each line is only checked against the
+ * next one expected */
+static int extract_stats(uint64_t *list, struct stats_file *file,
+                         const char**param_names, unsigned int num_parameters,
+                         int isHex) {
+    char *line, *line_end, *end;
     size_t index = 0;
-    char *line;
-    int ret;
+    ssize_t len;
 
-    fp = fopen(file, "r");
-    if (fp == NULL) {
-        ret = -errno;
-        ALOGE("%s: failed to open: %s Error = %s", __func__, file, strerror(errno));
-        return ret;
-    }
+    len = stats_file_read(file);
+    if (len < 0)
+        return len;
 
-    for (line = NULL, len = 0;
-         ((read = getline(&line, &len, fp) != -1) && (index < num_parameters));
-         free(line), line = NULL, len = 0) {
-        uint64_t value;
+    end = file->buf + len;
+    for (line = file->buf; line < end && index < num_parameters;
+         line = line_end + 1) {
         char* offset;
 
+        line_end = memchr(line, '\n', end - line);
+        if (!line_end)
+            line_end = end;
+        *line_end = '\0';
+
         size_t begin = strspn(line, " \t");
         if (strncmp(line + begin, param_names[index], strlen(param_names[index]))) {
             continue;
         }
 
-        offset = memchr(line, ':', len);
+        offset = memchr(line, ':', line_end - line);
         if (!offset) {
             continue;
         }
 
-        if (isHex) {
-            sscanf(offset, ":%" SCNx64, &value);
-        } else {
-            sscanf(offset, ":%" SCNu64, &value);
-        }
-        list[index] = value;
+        list[index] = strtoull(offset + 1, NULL, isHex ? 16 : 10);
         index++;
     }
 
-    free(line);
-    fclose(fp);
+    stats_file_release(file);
 
     return 0;
 }
@@ -438,12 +452,12 @@ static int extract_stats(uint64_t *list, char *file, const char**param_names,
 int extract_platform_stats(uint64_t *list) {
     int ret;
     //Data is located in two files
-    ret = extract_stats(list, RPM_STAT, rpm_param_names, RPM_PARAM_COUNT, false);
+    ret = extract_stats(list, &rpm_stat_file, rpm_param_names, RPM_PARAM_COUNT, false);
     if (ret) {
         for (size_t i=0; i < RPM_PARAM_COUNT; i++)
             list[i] = 0;
     }
-    ret = extract_stats(list + RPM_PARAM_COUNT, RPM_MASTER_STAT,
+    ret = extract_stats(list + RPM_PARAM_COUNT, &rpm_master_stat_file,
                         rpm_master_param_names, PLATFORM_PARAM_COUNT - RPM_PARAM_COUNT, true);
     if (ret) {
         for (size_t i=RPM_PARAM_COUNT; i < PLATFORM_PARAM_COUNT; i++)
@@ -455,7 +469,7 @@ int extract_platform_stats(uint64_t *list) {
 #ifndef V1_0_HAL
 int extract_wlan_stats(uint64_t *list) {
     int ret;
-    ret = extract_stats(list, WLAN_POWER_STAT, wlan_param_names, WLAN_POWER_PARAMS_COUNT, false);
+    ret = extract_stats(list, &wlan_stat_file, wlan_param_names, WLAN_POWER_PARAMS_COUNT, false);
     if (ret) {
         for (size_t i=0; i < WLAN_POWER_PARAMS_COUNT; i++)
             list[i] = 0;
@@ -464,95 +478,54 @@ int extract_wlan_stats(uint64_t *list) {
 }
 #endif
 #else
+static struct stats_file rpm_system_stat_file =
+        STATS_DEBUGFS_INITIALIZER(RPM_SYSTEM_STAT);
+static pthread_once_t stats_index_once = PTHREAD_ONCE_INIT;
+static struct stats_index rpm_stat_index;
+static int rpm_stat_index_ready;
+#ifndef V1_0_HAL
+static struct stats_file wlan_stat_file = STATS_DEBUGFS_INITIALIZER(WLAN_POWER_STAT);
+static struct stats_index wlan_stat_index;
+static int wlan_stat_index_ready;
+#endif
 
-static int parse_stats(const char **params, size_t params_size,
-                       uint64_t *list, FILE *fp) {
-    ssize_t nread;
-    size_t len = LINE_SIZE;
-    char *line;
-    size_t params_read = 0;
-    size_t i;
-
-    line = malloc(len);
-    if (!line) {
-        ALOGE("%s: no memory to hold line", __func__);
-        return -ENOMEM;
-    }
-
-    while ((params_read < params_size) &&
-        (nread = getline(&line, &len, fp) > 0)) {
-        char *key = line + strspn(line, " \t");
-        char *value = strchr(key, ':');
-        if (!value || (value > (line + len)))
-            continue;
-        *value++ = '\0';
-
-        for (i = 0; i < params_size; i++) {
-            if (!strcmp(key, params[i])) {
-                list[i] = strtoull(value, NULL, 0);
-                params_read++;
-                break;
-            }
-        }
-    }
-    free(line);
-
-    return 0;
+static void init_stats_indexes(void)
+{
+    rpm_stat_index_ready = stats_index_init(&rpm_stat_index, rpm_stat_map,
+            ARRAY_SIZE(rpm_stat_map)) == 0;
+#ifndef V1_0_HAL
+    wlan_stat_index_ready = stats_index_init(&wlan_stat_index, wlan_stat_map,
+            ARRAY_SIZE(wlan_stat_map)) == 0;
+#endif
 }
 
-static int extract_stats(uint64_t *list, char *file,
-                         struct stat_pair *map, size_t map_size) {
-    FILE *fp;
-    ssize_t read;
-    size_t len = LINE_SIZE;
-    char *line;
-    size_t i, stats_read = 0;
-    int ret = 0;
-
-    fp = fopen(file, "re");
-    if (fp == NULL) {
-        ALOGE("%s: failed to open: %s Error = %s", __func__, file, strerror(errno));
-        return -errno;
-    }
-
-    line = malloc(len);
-    if (!line) {
-        ALOGE("%s: no memory to hold line", __func__);
-        fclose(fp);
-        return -ENOMEM;
-    }
+static int extract_stats(uint64_t *list, struct stats_file *file,
+                         struct stats_index *index, int *index_ready) {
+    ssize_t len;
 
-    while ((stats_read < map_size) && (read = getline(&line, &len, fp) != -1)) {
-        size_t begin = strspn(line, " \t");
+    pthread_once(&stats_index_once, init_stats_indexes);
+    if (!*index_ready)
+        return -EINVAL;
 
-        for (i = 0; i < map_size; i++) {
-            if (!strncmp(line + begin, map[i].label, strlen(map[i].label))) {
-                stats_read++;
-                break;
-            }
-        }
+    len = stats_file_read(file);
+    if (len < 0)
+        return len;
 
-        if (i == map_size)
-            continue;
+    stats_parse(index, file->buf, len, list);
+    stats_file_release(file);
 
-        ret = parse_stats(map[i].parameters, map[i].num_parameters,
-                          &list[map[i].stat * MAX_RPM_PARAMS], fp);
-        if (ret < 0)
-            break;
-    }
-    free(line);
-    fclose(fp);
-
-    return ret;
+    return 0;
 }
 
 int extract_platform_stats(uint64_t *list) {
-    return extract_stats(list, RPM_SYSTEM_STAT, rpm_stat_map, ARRAY_SIZE(rpm_stat_map));
+    return extract_stats(list, &rpm_system_stat_file, &rpm_stat_index,
+                         &rpm_stat_index_ready);
 }
 
 #ifndef V1_0_HAL
 int extract_wlan_stats(uint64_t *list) {
-    return extract_stats(list, WLAN_POWER_STAT, wlan_stat_map, ARRAY_SIZE(wlan_stat_map));
+    return extract_stats(list, &wlan_stat_file, &wlan_stat_index,
+                         &wlan_stat_index_ready);
 }
 #endif
 #endif
@@ -129,6 +129,7 @@ void power_init(void);
 void power_hint(power_hint_t hint, void *data);
 void power_set_interactive(int on);
 void set_feature(feature_t feature, int state);
+void power_dump(int fd);
 int extract_platform_stats(uint64_t *list);
 #ifndef V1_0_HAL
 int extract_wlan_stats(uint64_t *list);
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NIDEBUG 0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOG_TAG "QCOM PowerHAL"
+#include <log/log.h>
+
+#include "stats-reader.h"
+
+#define FNV_OFFSET      2166136261U
+#define FNV_PRIME       16777619U
+#define SECTION_MIX     0x9E3779B1U
+#define MAX_SEEDS       64
+
+/* Reads the node from a fresh open until EOF */
+static ssize_t read_sequential(struct stats_file *file)
+{
+    size_t len = 0;
+    ssize_t n;
+    int fd, ret;
+
+    fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ret = -errno;
+        ALOGE("%s: failed to open: %s Error = %s", __func__, file->path,
+                strerror(errno));
+        return ret;
+    }
+
+    while (len < sizeof(file->buf) - 1) {
+        n = read(fd, file->buf + len, sizeof(file->buf) - 1 - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            ret = -errno;
+            close(fd);
+            return ret;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    close(fd);
+
+    return len;
+}
+
+/* Reads the node kept open, reopening it once if the read fails */
+static ssize_t read_kept_open(struct stats_file *file)
+{
+    ssize_t len;
+    int ret = -EIO;
+    int attempt;
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        if (file->fd < 0) {
+            file->fd = open(file->path, O_RDONLY | O_CLOEXEC);
+            if (file->fd < 0) {
+                ret = -errno;
+                ALOGE("%s: failed to open: %s Error = %s", __func__,
+                        file->path, strerror(errno));
+                break;
+            }
+        }
+
+        len = pread(file->fd, file->buf, sizeof(file->buf) - 1, 0);
+        if (len >= 0)
+            return len;
+
+        ret = -errno;
+        close(file->fd);
+        file->fd = -1;
+    }
+
+    return ret;
+}
+
+ssize_t stats_file_read(struct stats_file *file)
+{
+    ssize_t len;
+
+    pthread_mutex_lock(&file->lock);
+
+    len = file->reopen ? read_sequential(file) : read_kept_open(file);
+    if (len < 0) {
+        pthread_mutex_unlock(&file->lock);
+        return len;
+    }
+
+    if (len == sizeof(file->buf) - 1)
+        ALOGW("%s: %s is larger than %zu bytes, stats truncated", __func__,
+                file->path, sizeof(file->buf));
+    file->buf[len] = '\0';
+
+    return len;
+}
+
+void stats_file_release(struct stats_file *file)
+{
+    pthread_mutex_unlock(&file->lock);
+}
+
+void stats_file_close(struct stats_file *file)
+{
+    pthread_mutex_lock(&file->lock);
+    if (file->fd >= 0)
+        close(file->fd);
+    file->fd = -1;
+    pthread_mutex_unlock(&file->lock);
+}
+
+static uint32_t stats_hash(uint32_t seed, const char *text, size_t len,
+        int section)
+{
+    uint32_t h = FNV_OFFSET ^ seed;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char)text[i];
+        h *= FNV_PRIME;
+    }
+    if (section >= 0)
+        h ^= (uint32_t)(section + 1) * SECTION_MIX;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static int add_key(struct stats_index *index, const char *text, int section,
+        int param)
+{
+    struct stats_key *key;
+
+    if (index->num_keys == STATS_MAX_KEYS)
+        return -ENOSPC;
+
+    key = &index->keys[index->num_keys++];
+    key->text = text;
+    key->len = strlen(text);
+    key->section = section;
+    key->param = param;
+
+    return 0;
+}
+
+static void add_label_len(struct stats_index *index, uint16_t len)
+{
+    int i, j;
+
+    for (i = 0; i < index->num_label_lens; i++) {
+        if (index->label_lens[i] == len)
+            return;
+        if (index->label_lens[i] < len)
+            break;
+    }
+    if (index->num_label_lens == STATS_MAX_LABEL_LENS)
+        return;
+
+    for (j = index->num_label_lens; j > i; j--)
+        index->label_lens[j] = index->label_lens[j - 1];
+    index->label_lens[i] = len;
+    index->num_label_lens++;
+}
+
+/* Tries to place every key in its own slot */
+static int place_keys(struct stats_index *index)
+{
+    struct stats_key *key;
+    uint32_t slot;
+    int k;
+
+    memset(index->slots, -1, sizeof(index->slots));
+    for (k = 0; k < index->num_keys; k++) {
+        key = &index->keys[k];
+        slot = stats_hash(index->seed, key->text, key->len,
+                key->param < 0 ? -1 : key->section) & index->mask;
+        if (index->slots[slot] >= 0)
+            return -1;
+        index->slots[slot] = k;
+    }
+
+    return 0;
+}
+
+int stats_index_init(struct stats_index *index, struct stat_pair *map,
+        size_t map_size)
+{
+    size_t s, p;
+    uint32_t size;
+
+    memset(index, 0, sizeof(*index));
+    index->map = map;
+    index->map_size = map_size;
+
+    for (s = 0; s < map_size; s++) {
+        if (add_key(index, map[s].label, s, -1))
+            return -ENOSPC;
+        add_label_len(index, strlen(map[s].label));
+        for (p = 0; p < map[s].num_parameters; p++) {
+            if (add_key(index, map[s].parameters[p], s, p))
+                return -ENOSPC;
+        }
+    }
+    if (index->num_label_lens == STATS_MAX_LABEL_LENS) {
+        ALOGE("%s: too many label lengths", __func__);
+        return -EINVAL;
+    }
+
+    for (size = 16; size <= STATS_HASH_MAX; size <<= 1) {
+        index->mask = size - 1;
+        for (index->seed = 0; index->seed < MAX_SEEDS; index->seed++) {
+            if (place_keys(index) == 0)
+                return 0;
+        }
+    }
+
+    ALOGE("%s: no perfect hash for %d keys", __func__, index->num_keys);
+    return -EINVAL;
+}
+
+static const struct stats_key *find_key(const struct stats_index *index,
+        const char *text, size_t len, int section, int param)
+{
+    const struct stats_key *key;
+    uint32_t slot;
+    int k;
+
+    slot = stats_hash(index->seed, text, len, param ? section : -1) & index->mask;
+    k = index->slots[slot];
+    if (k < 0)
+        return NULL;
+
+    key = &index->keys[k];
+    if (key->len != len || (key->param >= 0) != !!param ||
+            (param && key->section != section) || memcmp(key->text, text, len))
+        return NULL;
+
+    return key;
+}
+
+int stats_parse(const struct stats_index *index, char *buf, size_t len,
+        uint64_t *list)
+{
+    const struct stats_key *key;
+    char *line, *line_end, *colon;
+    char *end = buf + len;
+    size_t line_len;
+    int section = -1;
+    int values = 0;
+    int i;
+
+    for (line = buf; line < end; line = line_end + 1) {
+        line_end = memchr(line, '\n', end - line);
+        if (!line_end)
+            line_end = end;
+        *line_end = '\0';
+
+        line += strspn(line, " \t");
+        line_len = line_end - line;
+
+        /* Section labels match as prefixes */
+        key = NULL;
+        for (i = 0; i < index->num_label_lens && !key; i++) {
+            if (index->label_lens[i] <= line_len)
+                key = find_key(index, line, index->label_lens[i], -1, 0);
+        }
+        if (key) {
+            section = key->section;
+            continue;
+        }
+        if (section < 0)
+            continue;
+
+        colon = memchr(line, ':', line_len);
+        if (!colon)
+            continue;
+        key = find_key(index, line, colon - line, section, 1);
+        if (!key)
+            continue;
+
+        list[index->map[section].stat * MAX_RPM_PARAMS + key->param] =
+                strtoull(colon + 1, NULL, 0);
+        values++;
+    }
+
+    return values;
+}
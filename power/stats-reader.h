@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __STATS_READER_H__
+#define __STATS_READER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "power-helper.h"
+
+#define STATS_BUF_SIZE          8192
+#define STATS_MAX_KEYS          32
+#define STATS_MAX_LABEL_LENS    8
+#define STATS_HASH_MAX          256
+
+/*
+ * A stats node read into a fixed buffer. Sysfs nodes are kept open across
+ * calls and read with pread, and reopened once when a read fails. Debugfs
+ * stats may hand out one record per read and only rewind on open, so they
+ * are reopened on every call and read until EOF.
+ */
+struct stats_file {
+    const char *path;
+    int reopen;
+    int fd;
+    pthread_mutex_t lock;
+    char buf[STATS_BUF_SIZE];
+};
+
+#define STATS_FILE_INITIALIZER(file_path) \
+    { .path = (file_path), .reopen = 0, .fd = -1, \
+      .lock = PTHREAD_MUTEX_INITIALIZER }
+
+#define STATS_DEBUGFS_INITIALIZER(file_path) \
+    { .path = (file_path), .reopen = 1, .fd = -1, \
+      .lock = PTHREAD_MUTEX_INITIALIZER }
+
+/* Locks the file and reads it into buf, NUL terminated. Returns the length
+ * or -errno. On success, stats_file_release unlocks it after parsing. */
+ssize_t stats_file_read(struct stats_file *file);
+void stats_file_release(struct stats_file *file);
+void stats_file_close(struct stats_file *file);
+
+struct stats_key {
+    const char *text;
+    uint16_t len;
+    /* index in the map */
+    int16_t section;
+    /* index in the section parameters, -1 for section labels */
+    int16_t param;
+};
+
+/*
+ * Perfect hash of the section labels and parameter names of a stat map,
+ * built once. Parameters hash together with their section, so sections can
+ * share names.
+ */
+struct stats_index {
+    struct stat_pair *map;
+    size_t map_size;
+    struct stats_key keys[STATS_MAX_KEYS];
+    int num_keys;
+    /* distinct label lengths, longest first */
+    uint16_t label_lens[STATS_MAX_LABEL_LENS];
+    int num_label_lens;
+    uint32_t seed;
+    uint32_t mask;
+    int8_t slots[STATS_HASH_MAX];
+};
+
+int stats_index_init(struct stats_index *index, struct stat_pair *map,
+        size_t map_size);
+
+/*
+ * Parses "<label>" section lines followed by "<parameter>:<value>" lines
+ * into list[stat * MAX_RPM_PARAMS + parameter]. Leading blanks are
+ * skipped and labels match as prefixes. buf is modified and buf[len] must
+ * be writable. Returns the number of values read.
+ */
+int stats_parse(const struct stats_index *index, char *buf, size_t len,
+        uint64_t *list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__STATS_READER_H__
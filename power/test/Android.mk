@@ -0,0 +1,83 @@
+# Power HAL host tests
+
+LOCAL_PATH := $(call my-dir)
+
+# Stand-in for the perf daemon client library
+include $(CLEAR_VARS)
+LOCAL_MODULE := libqti-perfd-client-stub
+LOCAL_MODULE_STEM := libqti-perfd-client
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := perf-stub.c
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_SHARED_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := power-hint-dispatcher-test
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := \
+    hint_dispatcher_test.c \
+    ../hint-dispatcher.c \
+    ../interaction-boost.c \
+    ../power-helper.c \
+    ../cpu-state.c \
+    ../stats-reader.c \
+    ../power-8084.c \
+    ../utils.c \
+    ../hint-data.c \
+    ../metadata-parser.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_CFLAGS += -Wall -Wextra -Werror -DINTERACTION_BOOST
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_HEADER_LIBRARIES := libhardware_headers
+LOCAL_LDLIBS := -ldl -lpthread
+LOCAL_REQUIRED_MODULES := libqti-perfd-client-stub
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := power-boost-replay
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := \
+    boost_replay.c \
+    ../interaction-boost.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+LOCAL_STATIC_LIBRARIES := liblog
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := power-hint-table-test
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := \
+    hint_table_test.c \
+    ../hint-data.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+LOCAL_STATIC_LIBRARIES := liblog
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := power-cpu-state-test
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := \
+    cpu_state_test.c \
+    ../cpu-state.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := power-stats-reader-test
+LOCAL_MODULE_TAGS := optional
+LOCAL_SRC_FILES := \
+    stats_reader_test.c \
+    ../stats-reader.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_CFLAGS += -Wall -Wextra -Werror
+# The test interposes read and pread, keep the calls unchecked
+LOCAL_CFLAGS += -U_FORTIFY_SOURCE
+LOCAL_STATIC_LIBRARIES := liblog
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a trace of interaction hints through the boost logic of
+ * power-8084 and reports the perf lock calls it makes and how well the
+ * locks cover the requested boosts. The same trace also goes through the
+ * previous logic, one shared lock and a single previous boost, for
+ * comparison.
+ *
+ * Trace lines are "<time ms> <hint data>", '#' starts a comment. -g prints
+ * a generated trace of taps, scrolls and flings instead.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "interaction-boost.h"
+
+/* Same limits as power-8084 */
+#define DEFAULT_INTERACTIVE_DURATION    200
+#define MIN_FLING_DURATION              1500
+#define MAX_INTERACTIVE_DURATION        5000
+
+#define MAX_HINTS                       100000
+#define MAX_SEGMENTS                    (2 * MAX_HINTS)
+#define MAX_LOCKS                       8
+
+/* Boost level held or wanted, 0 is no boost */
+#define LEVEL_OF(type)                  ((type) + 1)
+
+struct hint {
+    uint64_t time_ms;
+    int duration_ms;
+    int level;
+};
+
+/* Time a perf lock was held with one resource list */
+struct segment {
+    uint64_t start_ms;
+    uint64_t end_ms;
+    int level;
+};
+
+struct fake_lock {
+    int level;
+    int segment;
+};
+
+struct replay_result {
+    int calls;
+    uint64_t under_ms;
+    uint64_t over_ms;
+    uint64_t boosted_ms;
+};
+
+static struct hint hints[MAX_HINTS];
+static int num_hints;
+
+/* Fake perf daemon, in ms */
+static struct segment segments[MAX_SEGMENTS];
+static int num_segments;
+static struct fake_lock locks[MAX_LOCKS];
+static int num_locks;
+static uint64_t fake_now_ms;
+static int fake_calls;
+
+static int touch_resources[] = { 1 };
+static int fling_resources[] = { 2 };
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: program_name [options] [trace]\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -g SECONDS\t\tprint a generated trace of that length\n");
+    fprintf(stderr, "  -s SEED\t\tseed of the generated trace, default 1\n");
+    fprintf(stderr, "\n");
+}
+
+/* Stands in for the perf lock call of utils.c */
+int interaction_with_handle(int lock_handle, int duration, int num_args,
+        int opt_list[])
+{
+    struct fake_lock *lock;
+    struct segment *seg;
+
+    if (duration < 0 || num_args < 1 || opt_list[0] == 0)
+        return 0;
+    if (num_segments == MAX_SEGMENTS)
+        return -1;
+
+    fake_calls++;
+    if (lock_handle <= 0 || lock_handle > num_locks) {
+        if (num_locks == MAX_LOCKS)
+            return -1;
+        lock_handle = ++num_locks;
+        locks[lock_handle - 1].segment = -1;
+    }
+    lock = &locks[lock_handle - 1];
+
+    /* The new request replaces what the lock held so far */
+    if (lock->segment >= 0 && segments[lock->segment].end_ms > fake_now_ms)
+        segments[lock->segment].end_ms = fake_now_ms;
+
+    seg = &segments[num_segments];
+    seg->start_ms = fake_now_ms;
+    seg->end_ms = fake_now_ms + duration;
+    seg->level = opt_list[0];
+    lock->level = opt_list[0];
+    lock->segment = num_segments++;
+
+    return lock_handle;
+}
+
+static void fake_perfd_reset(void)
+{
+    num_segments = 0;
+    num_locks = 0;
+    fake_calls = 0;
+}
+
+static int clamp_duration(int data)
+{
+    int duration = DEFAULT_INTERACTIVE_DURATION;
+
+    if (data > duration)
+        duration = data > MAX_INTERACTIVE_DURATION ?
+                MAX_INTERACTIVE_DURATION : data;
+    return duration;
+}
+
+/* power_hint_override before the boost manager */
+static void replay_legacy(void)
+{
+    uint64_t previous_ms = 0;
+    int previous_duration = 0;
+    int lock_handle = 0;
+    int i;
+
+    for (i = 0; i < num_hints; i++) {
+        struct hint *h = &hints[i];
+        long long elapsed_us = (long long)(h->time_ms - previous_ms) * 1000;
+
+        fake_now_ms = h->time_ms;
+        if ((previous_duration * 1000LL) > (elapsed_us + h->duration_ms * 1000LL))
+            continue;
+        previous_ms = h->time_ms;
+        previous_duration = h->duration_ms;
+
+        lock_handle = interaction_with_handle(lock_handle, h->duration_ms, 1,
+                h->level == LEVEL_OF(BOOST_FLING) ?
+                fling_resources : touch_resources);
+    }
+}
+
+static void replay_boosts(struct boost boosts[BOOST_TYPES])
+{
+    int i;
+
+    for (i = 0; i < num_hints; i++) {
+        struct hint *h = &hints[i];
+
+        fake_now_ms = h->time_ms;
+        boost_request(boosts, h->level == LEVEL_OF(BOOST_FLING) ?
+                BOOST_FLING : BOOST_TOUCH, h->time_ms * 1000, h->duration_ms);
+    }
+}
+
+/* Compares wanted and held boost level for every ms of the trace */
+static void measure(struct replay_result *r)
+{
+    uint64_t end_ms = 0, t;
+    int *wanted, *held;
+    int i;
+
+    for (i = 0; i < num_hints; i++)
+        if (hints[i].time_ms + hints[i].duration_ms > end_ms)
+            end_ms = hints[i].time_ms + hints[i].duration_ms;
+    for (i = 0; i < num_segments; i++)
+        if (segments[i].end_ms > end_ms)
+            end_ms = segments[i].end_ms;
+
+    wanted = calloc(end_ms + 1, sizeof(int));
+    held = calloc(end_ms + 1, sizeof(int));
+    if (!wanted || !held) {
+        free(wanted);
+        free(held);
+        return;
+    }
+
+    for (i = 0; i < num_hints; i++)
+        for (t = hints[i].time_ms; t < hints[i].time_ms + hints[i].duration_ms; t++)
+            if (wanted[t] < hints[i].level)
+                wanted[t] = hints[i].level;
+    for (i = 0; i < num_segments; i++)
+        for (t = segments[i].start_ms; t < segments[i].end_ms; t++)
+            if (held[t] < segments[i].level)
+                held[t] = segments[i].level;
+
+    memset(r, 0, sizeof(*r));
+    r->calls = fake_calls;
+    for (t = 0; t < end_ms; t++) {
+        if (held[t] < wanted[t])
+            r->under_ms++;
+        else if (held[t] > wanted[t])
+            r->over_ms++;
+        if (held[t])
+            r->boosted_ms++;
+    }
+
+    free(wanted);
+    free(held);
+}
+
+static int read_trace(FILE *fp)
+{
+    char line[128];
+    unsigned long long time_ms;
+    int data;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%llu %d", &time_ms, &data) != 2) {
+            fprintf(stderr, "bad trace line: %s", line);
+            return -1;
+        }
+        if (num_hints == MAX_HINTS) {
+            fprintf(stderr, "trace longer than %d hints\n", MAX_HINTS);
+            return -1;
+        }
+        if (num_hints && time_ms < hints[num_hints - 1].time_ms) {
+            fprintf(stderr, "trace goes back in time: %s", line);
+            return -1;
+        }
+        hints[num_hints].time_ms = time_ms;
+        hints[num_hints].duration_ms = clamp_duration(data);
+        hints[num_hints].level = hints[num_hints].duration_ms >= MIN_FLING_DURATION ?
+                LEVEL_OF(BOOST_FLING) : LEVEL_OF(BOOST_TOUCH);
+        num_hints++;
+    }
+    return 0;
+}
+
+/*
+ * Taps, scrolls sending a hint per frame, and scrolls ending in a fling
+ * that sends its duration, with idle gaps in between.
+ */
+static void generate_trace(int seconds)
+{
+    uint64_t t = 1000, end = (uint64_t)seconds * 1000;
+    int frames, i;
+
+    printf("# time_ms data\n");
+    while (t < end) {
+        switch (rand() % 3) {
+            case 0:
+                printf("%llu 0\n", (unsigned long long)t);
+                break;
+            case 1:
+                frames = 10 + rand() % 60;
+                for (i = 0; i < frames; i++)
+                    printf("%llu 0\n", (unsigned long long)(t + i * 16));
+                t += frames * 16;
+                break;
+            default:
+                frames = 5 + rand() % 20;
+                for (i = 0; i < frames; i++)
+                    printf("%llu 0\n", (unsigned long long)(t + i * 16));
+                t += frames * 16;
+                printf("%llu %d\n", (unsigned long long)t,
+                        MIN_FLING_DURATION + rand() % 2000);
+                /* scrolls of the fling itself */
+                frames = rand() % 30;
+                for (i = 1; i <= frames; i++)
+                    printf("%llu 0\n", (unsigned long long)(t + i * 50));
+                t += frames * 50;
+                break;
+        }
+        t += 100 + rand() % 3000;
+    }
+}
+
+static void print_result(const char *name, struct replay_result *r)
+{
+    fprintf(stderr, "%-25s%d perf lock calls, boosted %llu ms, "
+            "under-boosted %llu ms, over-boosted %llu ms\n", name, r->calls,
+            (unsigned long long)r->boosted_ms, (unsigned long long)r->under_ms,
+            (unsigned long long)r->over_ms);
+}
+
+int main(int argc, char *argv[])
+{
+    struct boost boosts[BOOST_TYPES] = {
+        [BOOST_TOUCH] = { .name = "touch", .resources = touch_resources,
+                          .num_resources = 1 },
+        [BOOST_FLING] = { .name = "fling", .resources = fling_resources,
+                          .num_resources = 1 },
+    };
+    struct replay_result legacy, managed;
+    FILE *fp = stdin;
+    int c, generate = 0, seed = 1, ret = -1;
+
+    while ((c = getopt(argc, argv, "g:s:")) != -1) {
+        switch (c) {
+            case 'g':
+                generate = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            default:
+                print_usage();
+                return 1;
+        }
+    }
+
+    if (generate > 0) {
+        srand(seed);
+        generate_trace(generate);
+        return 0;
+    }
+
+    if (optind < argc) {
+        fp = fopen(argv[optind], "r");
+        if (!fp) {
+            fprintf(stderr, "cannot open %s\n", argv[optind]);
+            goto exit;
+        }
+    }
+    if (read_trace(fp) || !num_hints)
+        goto exit;
+    fprintf(stderr, "%-25s%d\n", "Hints: ", num_hints);
+
+    fake_perfd_reset();
+    replay_legacy();
+    measure(&legacy);
+    print_result("Previous: ", &legacy);
+
+    fake_perfd_reset();
+    replay_boosts(boosts);
+    measure(&managed);
+    print_result("Boost manager: ", &managed);
+    boost_dump(boosts, STDERR_FILENO);
+
+    ret = 0;
+
+exit:
+    if (fp && fp != stdin)
+        fclose(fp);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret;
+}
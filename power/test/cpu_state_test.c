@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * cpu state cache test against a fake sysfs cpu tree in a temp directory.
+ * Also compares the cost of a cached lookup with reading the node.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu-state.h"
+
+#define TEST_MAX_AGE_MS 200
+#define TEST_LOOKUPS    10000
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+static char root[PATH_MAX - 128];
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int write_node(const char *node, const char *value)
+{
+    char path[PATH_MAX];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", root, node);
+    fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, "%s\n", value);
+    fclose(fp);
+    return 0;
+}
+
+static int make_tree(void)
+{
+    char path[PATH_MAX];
+    char node[64];
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_STATE_MAX_CPUS; cpu++) {
+        snprintf(path, sizeof(path), "%s/cpu%d", root, cpu);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/cpu%d/cpufreq", root, cpu);
+        mkdir(path, 0755);
+        snprintf(node, sizeof(node), "cpu%d/cpufreq/scaling_governor", cpu);
+        CHECK(write_node(node, "interactive") == 0);
+    }
+    CHECK(write_node("online", "0-3") == 0);
+    return 0;
+}
+
+static void remove_tree(void)
+{
+    char cmd[PATH_MAX + 16];
+
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd))
+        fprintf(stderr, "cannot remove %s\n", root);
+}
+
+static int test_cache(void)
+{
+    struct cpu_state state;
+    uint32_t generation;
+    uint64_t start, cached_us, direct_us;
+    char path[PATH_MAX], buf[64];
+    FILE *fp;
+    int i;
+
+    CHECK(cpu_state_get(&state) == 0);
+    CHECK(strcmp(state.governor[0], "interactive") == 0);
+    CHECK(strcmp(state.governor[3], "interactive") == 0);
+    CHECK(state.online_mask == 0xf);
+    generation = state.generation;
+
+    /* Served from the cache while nothing changes */
+    start = now_us();
+    for (i = 0; i < TEST_LOOKUPS; i++)
+        cpu_state_get(&state);
+    cached_us = now_us() - start;
+    CHECK(state.generation == generation ||
+            cached_us >= TEST_MAX_AGE_MS * 1000);
+
+    snprintf(path, sizeof(path), "%s/cpu0/cpufreq/scaling_governor", root);
+    start = now_us();
+    for (i = 0; i < TEST_LOOKUPS; i++) {
+        fp = fopen(path, "r");
+        if (fp) {
+            if (!fgets(buf, sizeof(buf), fp))
+                buf[0] = '\0';
+            fclose(fp);
+        }
+    }
+    direct_us = now_us() - start;
+    fprintf(stderr, "%-25s%.3f us cached, %.3f us reading the node\n",
+            "Lookup: ", (double)cached_us / TEST_LOOKUPS,
+            (double)direct_us / TEST_LOOKUPS);
+
+    /* A governor change is seen on the next lookup */
+    CHECK(write_node("cpu0/cpufreq/scaling_governor", "ondemand") == 0);
+    cpu_state_get(&state);
+    CHECK(strcmp(state.governor[0], "ondemand") == 0);
+    CHECK(state.generation != generation);
+
+    /* Offlining a core removes its cpufreq node */
+    CHECK(write_node("online", "0-1,3") == 0);
+    snprintf(path, sizeof(path), "%s/cpu2/cpufreq/scaling_governor", root);
+    CHECK(unlink(path) == 0);
+    cpu_state_get(&state);
+    CHECK(state.online_mask == 0xb);
+    CHECK(state.governor[2][0] == '\0');
+    CHECK(strcmp(state.governor[3], "interactive") == 0);
+
+    /* Back online, the node is watched again */
+    CHECK(write_node("cpu2/cpufreq/scaling_governor", "performance") == 0);
+    CHECK(write_node("online", "0-3") == 0);
+    cpu_state_get(&state);
+    CHECK(state.online_mask == 0xf);
+    CHECK(strcmp(state.governor[2], "performance") == 0);
+    CHECK(write_node("cpu2/cpufreq/scaling_governor", "interactive") == 0);
+    cpu_state_get(&state);
+    CHECK(strcmp(state.governor[2], "interactive") == 0);
+
+    /* Without any event the snapshot still refreshes once it's old */
+    generation = state.generation;
+    usleep((TEST_MAX_AGE_MS + 50) * 1000);
+    cpu_state_get(&state);
+    CHECK(state.generation != generation);
+
+    return 0;
+}
+
+int main(void)
+{
+    int ret = -1;
+
+    snprintf(root, sizeof(root), "%s/cpu-state-XXXXXX",
+            getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(root)) {
+        fprintf(stderr, "cannot create %s\n", root);
+        goto exit;
+    }
+
+    if (make_tree() == 0 && cpu_state_init(root, TEST_MAX_AGE_MS) == 0)
+        ret = test_cache();
+
+    cpu_state_deinit();
+    remove_tree();
+
+exit:
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Hint dispatcher test. The perf library is replaced by a stub whose lock
+ * calls take a few ms, so the cost seen by the binder thread can be
+ * compared between handling hints inline and through the dispatcher.
+ */
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hint-dispatcher.h"
+#include "interaction-boost.h"
+#include "power-common.h"
+#include "perf-stub.h"
+
+#define PERF_STUB_LIB "libqti-perfd-client.so"
+
+/* Touch boost length of the interaction hints sent below, see
+ * DEFAULT_INTERACTIVE_DURATION */
+#define TOUCH_BOOST_MS 200
+
+struct test_input {
+    int delay_us;
+    int hints;
+};
+
+static perf_stub_set_delay_us_t stub_set_delay;
+static perf_stub_get_stats_t stub_get_stats;
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: program_name [options]\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -d DELAY\t\tperf lock call time in us, default 5000\n");
+    fprintf(stderr, "  -n HINTS\t\tinteraction hints per run, default 1000\n");
+    fprintf(stderr, "\n");
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Sends interaction hints back to back, returns the worst call time */
+static uint64_t send_interactions(int count, uint64_t *avg_us)
+{
+    uint64_t start, elapsed, total = 0, max = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        start = now_us();
+        hint_dispatcher_power_hint(POWER_HINT_INTERACTION, 100 + i % 100);
+        elapsed = now_us() - start;
+        total += elapsed;
+        if (elapsed > max)
+            max = elapsed;
+    }
+    *avg_us = total / count;
+    return max;
+}
+
+static int test_input_get(int argc, char *argv[], struct test_input *input)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "d:n:")) != -1) {
+        switch (c) {
+            case 'd':
+                input->delay_us = atoi(optarg);
+                break;
+            case 'n':
+                input->hints = atoi(optarg);
+                break;
+            default:
+                return 1;
+        }
+    }
+    if (input->delay_us < 0 || input->hints <= 0)
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct test_input input = { 5000, 1000 };
+    struct perf_stub_stats before, after;
+    uint64_t inline_avg, inline_max, async_avg, async_max, start;
+    void *stub;
+    int inline_count, locks, max_locks, ret = -1;
+
+    if (test_input_get(argc, argv, &input)) {
+        print_usage();
+        return 1;
+    }
+
+    /* Already loaded by the power HAL, this just gets the same handle */
+    stub = dlopen(PERF_STUB_LIB, RTLD_NOW);
+    if (!stub) {
+        fprintf(stderr, "cannot load %s: %s\n", PERF_STUB_LIB, dlerror());
+        goto exit;
+    }
+    stub_set_delay = (perf_stub_set_delay_us_t)dlsym(stub, "perf_stub_set_delay_us");
+    stub_get_stats = (perf_stub_get_stats_t)dlsym(stub, "perf_stub_get_stats");
+    if (!stub_set_delay || !stub_get_stats) {
+        fprintf(stderr, "%s is not the perf stub\n", PERF_STUB_LIB);
+        goto exit;
+    }
+    stub_set_delay(input.delay_us);
+
+    /* Inline, as before the dispatcher. Few hints, each one blocks. */
+    inline_count = input.hints < 10 ? input.hints : 10;
+    stub_get_stats(&before);
+    inline_max = send_interactions(inline_count, &inline_avg);
+    stub_get_stats(&after);
+    fprintf(stderr, "%-25s%d hints, %d perf locks, avg %llu us, max %llu us\n",
+            "Inline: ", inline_count, after.acquires - before.acquires,
+            (unsigned long long)inline_avg, (unsigned long long)inline_max);
+
+    if (hint_dispatcher_init()) {
+        fprintf(stderr, "hint_dispatcher_init failed\n");
+        goto exit;
+    }
+
+    /* Let the inline boost run out, the next one has to take a lock */
+    usleep((TOUCH_BOOST_MS + 50) * 1000);
+
+    /* Repeated interactions coalesce while the dispatcher is busy, and the
+     * running boost is extended at most once per quarter of its length */
+    stub_get_stats(&before);
+    start = now_us();
+    async_max = send_interactions(input.hints, &async_avg);
+    hint_dispatcher_wait_idle();
+    max_locks = 1 + (int)((now_us() - start) /
+            (TOUCH_BOOST_MS * 1000 / BOOST_MIN_EXTENSION_DIV));
+    stub_get_stats(&after);
+    locks = after.acquires - before.acquires;
+    fprintf(stderr, "%-25s%d hints, %d perf locks (max %d), avg %llu us, "
+            "max %llu us\n", "Dispatched: ", input.hints, locks, max_locks,
+            (unsigned long long)async_avg, (unsigned long long)async_max);
+    if (input.delay_us && async_avg * 10 > (uint64_t)input.delay_us) {
+        fprintf(stderr, "dispatched hints block the caller\n");
+        goto exit;
+    }
+    if (locks < 1) {
+        fprintf(stderr, "interaction hints were dropped\n");
+        goto exit;
+    }
+    if (locks > max_locks || locks >= input.hints) {
+        fprintf(stderr, "interaction hints were not coalesced\n");
+        goto exit;
+    }
+
+    /* The latest profile wins, and the lock of the first one goes away */
+    hint_dispatcher_power_hint(POWER_HINT_SET_PROFILE, PROFILE_HIGH_PERFORMANCE);
+    hint_dispatcher_wait_idle();
+    stub_get_stats(&before);
+    hint_dispatcher_power_hint(POWER_HINT_SET_PROFILE, PROFILE_POWER_SAVE);
+    hint_dispatcher_power_hint(POWER_HINT_SET_PROFILE, PROFILE_BIAS_POWER);
+    hint_dispatcher_power_hint(POWER_HINT_SET_PROFILE, PROFILE_BALANCED);
+    hint_dispatcher_wait_idle();
+    stub_get_stats(&after);
+    fprintf(stderr, "%-25s%d held before, %d held after\n", "Profiles: ",
+            before.held, after.held);
+    if (before.held != 1 || after.held != 0) {
+        fprintf(stderr, "profile locks out of order\n");
+        goto exit;
+    }
+
+    /* Every interactive change gets its own display hint */
+    stub_get_stats(&before);
+    hint_dispatcher_set_interactive(0);
+    hint_dispatcher_wait_idle();
+    hint_dispatcher_set_interactive(1);
+    hint_dispatcher_wait_idle();
+    stub_get_stats(&after);
+    fprintf(stderr, "%-25s%d display hints\n", "Interactive: ",
+            after.hints - before.hints);
+    if (after.hints - before.hints != 2) {
+        fprintf(stderr, "interactive changes lost\n");
+        goto exit;
+    }
+
+    hint_dispatcher_dump(STDERR_FILENO);
+    ret = 0;
+
+exit:
+    hint_dispatcher_deinit();
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret;
+}
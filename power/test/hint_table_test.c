@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Unit tests of the active hint table, checked against a plain array
+ * through random adds and removes.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hint-data.h"
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+static int test_add_remove(void)
+{
+    struct hint_table table;
+    unsigned long handle = 0;
+
+    memset(&table, 0, sizeof(table));
+    CHECK(hint_table_add(&table, DEFAULT_VIDEO_ENCODE_HINT_ID, 11, 0, &handle) == 0);
+    CHECK(hint_table_add(&table, DEFAULT_VIDEO_DECODE_HINT_ID, 12, 0, &handle) == 0);
+    CHECK(hint_table_add(&table, DISPLAY_STATE_HINT_ID, 13, 0, &handle) == 0);
+    CHECK(hint_table_add(&table, DISPLAY_STATE_HINT_ID_2, 14, 0, &handle) == 0);
+    CHECK(hint_table_add(&table, DEFAULT_PROFILE_HINT_ID, 15, 0, &handle) == 0);
+    CHECK(table.count == 5);
+
+    CHECK(hint_table_remove(&table, DISPLAY_STATE_HINT_ID, &handle) == 0);
+    CHECK(handle == 13);
+    CHECK(hint_table_remove(&table, DISPLAY_STATE_HINT_ID, &handle) == -ENOENT);
+    CHECK(hint_table_remove(&table, DEFAULT_PROFILE_HINT_ID, &handle) == 0);
+    CHECK(handle == 15);
+    CHECK(hint_table_remove(&table, DEFAULT_VIDEO_ENCODE_HINT_ID, &handle) == 0);
+    CHECK(handle == 11);
+    CHECK(table.count == 2);
+
+    return 0;
+}
+
+/* A hint holds one lock, the earlier one comes back for release */
+static int test_replace(void)
+{
+    struct hint_table table;
+    unsigned long handle = 0;
+
+    memset(&table, 0, sizeof(table));
+    CHECK(hint_table_add(&table, DEFAULT_VIDEO_ENCODE_HINT_ID, 21, 0, &handle) == 0);
+    CHECK(hint_table_add(&table, DEFAULT_VIDEO_ENCODE_HINT_ID, 22, 0, &handle) == 1);
+    CHECK(handle == 21);
+    CHECK(table.count == 1);
+    CHECK(hint_table_remove(&table, DEFAULT_VIDEO_ENCODE_HINT_ID, &handle) == 0);
+    CHECK(handle == 22);
+    CHECK(table.count == 0);
+
+    return 0;
+}
+
+static int test_full(void)
+{
+    struct hint_table table;
+    unsigned long handle = 0;
+    int i;
+
+    memset(&table, 0, sizeof(table));
+    for (i = 0; i < HINT_TABLE_SIZE; i++)
+        CHECK(hint_table_add(&table, 0x100 * (i + 1), i, 0, &handle) == 0);
+    CHECK(hint_table_add(&table, 0x100 * (i + 1), i, 0, &handle) == -ENOSPC);
+    CHECK(hint_table_remove(&table, 0x7777, &handle) == -ENOENT);
+
+    /* Still replaces, and takes new hints once there is room */
+    CHECK(hint_table_add(&table, 0x100, 100, 0, &handle) == 1);
+    CHECK(hint_table_remove(&table, 0x200, &handle) == 0);
+    CHECK(hint_table_add(&table, 0x7777, 101, 0, &handle) == 0);
+    for (i = 0; i < HINT_TABLE_SIZE; i++) {
+        if (i == 1)
+            continue;
+        CHECK(hint_table_remove(&table, 0x100 * (i + 1), &handle) == 0);
+        CHECK(handle == (unsigned long)(i ? i : 100));
+    }
+    CHECK(hint_table_remove(&table, 0x7777, &handle) == 0);
+    CHECK(handle == 101);
+    CHECK(table.count == 0);
+
+    return 0;
+}
+
+/* Clustered IDs exercise the moves on removal */
+static int test_random(void)
+{
+    struct hint_table table;
+    unsigned long handles[HINT_TABLE_SIZE * 2];
+    unsigned long handle;
+    int held[HINT_TABLE_SIZE * 2];
+    int i, n, id, count = 0, ret;
+
+    memset(&table, 0, sizeof(table));
+    memset(held, 0, sizeof(held));
+    srand(1);
+
+    for (n = 0; n < 200000; n++) {
+        id = rand() % (HINT_TABLE_SIZE * 2);
+        if (rand() % 2) {
+            ret = hint_table_add(&table, id * HINT_TABLE_SIZE, n, 0, &handle);
+            if (held[id]) {
+                CHECK(ret == 1);
+                CHECK(handle == handles[id]);
+            } else if (count == HINT_TABLE_SIZE) {
+                CHECK(ret == -ENOSPC);
+                continue;
+            } else {
+                CHECK(ret == 0);
+                held[id] = 1;
+                count++;
+            }
+            handles[id] = n;
+        } else {
+            ret = hint_table_remove(&table, id * HINT_TABLE_SIZE, &handle);
+            if (held[id]) {
+                CHECK(ret == 0);
+                CHECK(handle == handles[id]);
+                held[id] = 0;
+                count--;
+            } else {
+                CHECK(ret == -ENOENT);
+            }
+        }
+        CHECK(table.count == count);
+    }
+
+    for (i = 0; i < HINT_TABLE_SIZE * 2; i++) {
+        if (!held[i])
+            continue;
+        CHECK(hint_table_remove(&table, i * HINT_TABLE_SIZE, &handle) == 0);
+        CHECK(handle == handles[i]);
+    }
+    CHECK(table.count == 0);
+
+    return 0;
+}
+
+int main(void)
+{
+    struct hint_table table;
+    unsigned long handle;
+    int ret = 0;
+
+    ret |= test_add_remove();
+    ret |= test_replace();
+    ret |= test_full();
+    ret |= test_random();
+
+    memset(&table, 0, sizeof(table));
+    hint_table_add(&table, DISPLAY_STATE_HINT_ID_2, 1, 0, &handle);
+    hint_table_add(&table, DEFAULT_VIDEO_DECODE_HINT_ID, 2, 2500000, &handle);
+    hint_table_dump(&table, STDERR_FILENO, 3000000);
+
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
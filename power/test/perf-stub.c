@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the perf daemon client library. Lock calls take a
+ * configurable time, like a busy perfd, and are counted for the tests.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perf-stub.h"
+
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct perf_stub_stats stub_stats;
+static int stub_delay_us;
+static int next_handle = 1;
+
+void perf_stub_set_delay_us(int delay_us)
+{
+    pthread_mutex_lock(&stub_lock);
+    stub_delay_us = delay_us;
+    pthread_mutex_unlock(&stub_lock);
+}
+
+void perf_stub_get_stats(struct perf_stub_stats *stats)
+{
+    pthread_mutex_lock(&stub_lock);
+    *stats = stub_stats;
+    pthread_mutex_unlock(&stub_lock);
+}
+
+static void stub_delay(void)
+{
+    int delay_us;
+
+    pthread_mutex_lock(&stub_lock);
+    delay_us = stub_delay_us;
+    pthread_mutex_unlock(&stub_lock);
+    if (delay_us)
+        usleep(delay_us);
+}
+
+int perf_lock_acq(unsigned long handle, int duration, int list[], int numArgs)
+{
+    int ret;
+
+    (void)list;
+    (void)numArgs;
+    stub_delay();
+
+    pthread_mutex_lock(&stub_lock);
+    stub_stats.acquires++;
+    if (!duration)
+        stub_stats.held++;
+    ret = handle ? (int)handle : next_handle++;
+    pthread_mutex_unlock(&stub_lock);
+
+    return ret;
+}
+
+int perf_lock_rel(unsigned long handle)
+{
+    (void)handle;
+    stub_delay();
+
+    pthread_mutex_lock(&stub_lock);
+    stub_stats.releases++;
+    stub_stats.held--;
+    pthread_mutex_unlock(&stub_lock);
+
+    return 0;
+}
+
+int perf_hint(int hint_id, char *pkg, int duration, int type)
+{
+    int ret;
+
+    (void)hint_id;
+    (void)pkg;
+    (void)duration;
+    (void)type;
+    stub_delay();
+
+    pthread_mutex_lock(&stub_lock);
+    stub_stats.hints++;
+    ret = next_handle++;
+    pthread_mutex_unlock(&stub_lock);
+
+    return ret;
+}
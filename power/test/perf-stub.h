@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PERF_STUB_H__
+#define __PERF_STUB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct perf_stub_stats {
+    int acquires;
+    int releases;
+    /* indefinite locks not released yet */
+    int held;
+    int hints;
+};
+
+typedef void (*perf_stub_set_delay_us_t)(int delay_us);
+typedef void (*perf_stub_get_stats_t)(struct perf_stub_stats *stats);
+
+void perf_stub_set_delay_us(int delay_us);
+void perf_stub_get_stats(struct perf_stub_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__PERF_STUB_H__
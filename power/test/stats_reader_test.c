@@ -0,0 +1,605 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stats reader test. Benchmarks the reader against the fopen/getline
+ * parser it replaced on a fake system_stats file, checks generated stats
+ * files parse to the values they were written with, reads a fake debugfs
+ * node handing out one record per read, and fuzzes the parser with
+ * mutated files.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "power-common.h"
+#include "stats-reader.h"
+
+#define LINE_SIZE 128
+#define NUM_STATS 6
+
+struct test_input {
+    int iterations;
+    int fuzz_runs;
+    unsigned int seed;
+};
+
+static const char *rpm_stat_params[MAX_RPM_PARAMS] = {
+    "count",
+    "actual last sleep(msec)",
+};
+
+static const char *master_stat_params[MAX_RPM_PARAMS] = {
+    "Accumulated XO duration",
+    "XO Count",
+};
+
+/* Same as the map of power-helper.c */
+static struct stat_pair test_stat_map[NUM_STATS] = {
+    { RPM_MODE_XO,   "RPM Mode:vlow", rpm_stat_params, ARRAY_SIZE(rpm_stat_params) },
+    { RPM_MODE_VMIN, "RPM Mode:vmin", rpm_stat_params, ARRAY_SIZE(rpm_stat_params) },
+    { VOTER_APSS,    "APSS",    master_stat_params, ARRAY_SIZE(master_stat_params) },
+    { VOTER_MPSS,    "MPSS",    master_stat_params, ARRAY_SIZE(master_stat_params) },
+    { VOTER_ADSP,    "ADSP",    master_stat_params, ARRAY_SIZE(master_stat_params) },
+    { VOTER_SLPI,    "SLPI",    master_stat_params, ARRAY_SIZE(master_stat_params) },
+};
+
+static char stats_path[PATH_MAX];
+
+/*
+ * Fake of the legacy rpm_stats debugfs nodes. A read returns what is left
+ * of the current record, the next record is only formatted once the file
+ * position reached the end of the current one, and only open goes back to
+ * the first record. The reader's syscalls are interposed below, anything
+ * but the fake path goes to the kernel.
+ */
+#define FAKE_MAX_RECORDS (NUM_STATS + 1)
+
+static const char fake_path[] = "/fake/rpm_stats";
+
+static struct {
+    char data[STATS_BUF_SIZE];
+    const char *records[FAKE_MAX_RECORDS];
+    size_t record_lens[FAKE_MAX_RECORDS];
+    int num_records;
+    int fd;
+    int read_idx;
+    const char *cur;
+    size_t len;
+    off_t pos;
+    int reads;
+} fake_node = { .fd = -1 };
+
+/* Records end with the blank line after each section, len < STATS_BUF_SIZE */
+static void fake_node_set(const char *buf, size_t len)
+{
+    const char *p, *end;
+
+    memcpy(fake_node.data, buf, len);
+    fake_node.data[len] = '\0';
+    fake_node.num_records = 0;
+    for (p = fake_node.data, end = p + len;
+            p < end && fake_node.num_records < FAKE_MAX_RECORDS; ) {
+        const char *sep = strstr(p, "\n\n");
+        const char *next = sep ? sep + 2 : end;
+
+        if (fake_node.num_records == FAKE_MAX_RECORDS - 1)
+            next = end;
+        fake_node.records[fake_node.num_records] = p;
+        fake_node.record_lens[fake_node.num_records++] = next - p;
+        p = next;
+    }
+}
+
+static ssize_t fake_node_read(void *buf, size_t count, off_t *ppos)
+{
+    size_t n;
+
+    fake_node.reads++;
+    if ((size_t)*ppos >= fake_node.len &&
+            fake_node.read_idx < fake_node.num_records) {
+        fake_node.cur = fake_node.records[fake_node.read_idx];
+        fake_node.len = fake_node.record_lens[fake_node.read_idx++];
+        *ppos = 0;
+    }
+    if ((size_t)*ppos >= fake_node.len)
+        return 0;
+
+    n = fake_node.len - *ppos;
+    if (n > count)
+        n = count;
+    memcpy(buf, fake_node.cur + *ppos, n);
+    *ppos += n;
+    return n;
+}
+
+int open(const char *path, int flags, ...)
+{
+    va_list ap;
+    int mode = 0;
+    int fd;
+
+    if (flags & O_CREAT) {
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    if (strcmp(path, fake_path))
+        return syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+
+    fd = syscall(SYS_openat, AT_FDCWD, "/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fake_node.fd = fd;
+        fake_node.read_idx = 0;
+        fake_node.len = 0;
+        fake_node.pos = 0;
+    }
+    return fd;
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    if (fd >= 0 && fd == fake_node.fd)
+        return fake_node_read(buf, count, &fake_node.pos);
+    return syscall(SYS_read, fd, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+    if (fd >= 0 && fd == fake_node.fd)
+        return fake_node_read(buf, count, &offset);
+    return syscall(SYS_pread64, fd, buf, count, offset);
+}
+
+int close(int fd)
+{
+    if (fd >= 0 && fd == fake_node.fd)
+        fake_node.fd = -1;
+    return syscall(SYS_close, fd);
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: program_name [options]\n");
+    fprintf(stderr, "Optional:\n");
+    fprintf(stderr, "  -n ITERATIONS\t\tbenchmark reads, default 20000\n");
+    fprintf(stderr, "  -f RUNS\t\tfuzz runs, default 20000\n");
+    fprintf(stderr, "  -s SEED\t\trandom seed, default 1\n");
+    fprintf(stderr, "\n");
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* The parser before the stats reader, for the benchmark */
+static int old_parse_stats(const char **params, size_t params_size,
+                           uint64_t *list, FILE *fp) {
+    ssize_t nread;
+    size_t len = LINE_SIZE;
+    char *line;
+    size_t params_read = 0;
+    size_t i;
+
+    line = malloc(len);
+    if (!line)
+        return -ENOMEM;
+
+    while ((params_read < params_size) &&
+        (nread = getline(&line, &len, fp) > 0)) {
+        char *key = line + strspn(line, " \t");
+        char *value = strchr(key, ':');
+        if (!value || (value > (line + len)))
+            continue;
+        *value++ = '\0';
+
+        for (i = 0; i < params_size; i++) {
+            if (!strcmp(key, params[i])) {
+                list[i] = strtoull(value, NULL, 0);
+                params_read++;
+                break;
+            }
+        }
+    }
+    free(line);
+
+    return 0;
+}
+
+static int old_extract_stats(uint64_t *list, const char *file,
+                             struct stat_pair *map, size_t map_size) {
+    FILE *fp;
+    ssize_t read;
+    size_t len = LINE_SIZE;
+    char *line;
+    size_t i, stats_read = 0;
+    int ret = 0;
+
+    fp = fopen(file, "re");
+    if (fp == NULL)
+        return -errno;
+
+    line = malloc(len);
+    if (!line) {
+        fclose(fp);
+        return -ENOMEM;
+    }
+
+    while ((stats_read < map_size) && (read = getline(&line, &len, fp) != -1)) {
+        size_t begin = strspn(line, " \t");
+
+        for (i = 0; i < map_size; i++) {
+            if (!strncmp(line + begin, map[i].label, strlen(map[i].label))) {
+                stats_read++;
+                break;
+            }
+        }
+
+        if (i == map_size)
+            continue;
+
+        ret = old_parse_stats(map[i].parameters, map[i].num_parameters,
+                              &list[map[i].stat * MAX_RPM_PARAMS], fp);
+        if (ret < 0)
+            break;
+    }
+    free(line);
+    fclose(fp);
+
+    return ret;
+}
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+}
+
+/*
+ * Writes every section with random values, random indentation, decimal or
+ * hex values and unrelated lines in between, in a random section order.
+ */
+static size_t generate_stats(char *buf, size_t size, uint64_t *expected)
+{
+    int order[NUM_STATS];
+    size_t len = 0;
+    int i, j, t;
+    size_t p;
+
+    for (i = 0; i < NUM_STATS; i++)
+        order[i] = i;
+    for (i = NUM_STATS - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    len += snprintf(buf + len, size - len, "RPM Stats\n");
+    for (i = 0; i < NUM_STATS; i++) {
+        struct stat_pair *pair = &test_stat_map[order[i]];
+
+        len += snprintf(buf + len, size - len, "%s\n", pair->label);
+        len += snprintf(buf + len, size - len, "\tActive Cores:0x%x\n", rand() % 16);
+        for (p = 0; p < pair->num_parameters; p++) {
+            uint64_t value = rand64();
+
+            expected[pair->stat * MAX_RPM_PARAMS + p] = value;
+            len += snprintf(buf + len, size - len,
+                    rand() % 2 ? "%s%s:0x%llx\n" : "%s%s:%llu\n",
+                    rand() % 2 ? "\t" : " ", pair->parameters[p],
+                    (unsigned long long)value);
+        }
+        len += snprintf(buf + len, size - len, "\n");
+    }
+
+    return len;
+}
+
+static int write_file(const char *path, const char *buf, size_t len)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (!fp)
+        return -1;
+    if (fwrite(buf, 1, len, fp) != len) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int run_benchmark(struct stats_index *index, int iterations)
+{
+    struct stats_file file = STATS_FILE_INITIALIZER(stats_path);
+    struct stats_file reopen_file = STATS_DEBUGFS_INITIALIZER(stats_path);
+    uint64_t old_list[NUM_STATS * MAX_RPM_PARAMS];
+    uint64_t new_list[NUM_STATS * MAX_RPM_PARAMS];
+    uint64_t reopen_list[NUM_STATS * MAX_RPM_PARAMS];
+    uint64_t expected[NUM_STATS * MAX_RPM_PARAMS];
+    char buf[STATS_BUF_SIZE];
+    uint64_t start, old_us, new_us, reopen_us;
+    size_t len;
+    ssize_t read_len;
+    int i;
+
+    len = generate_stats(buf, sizeof(buf), expected);
+    if (write_file(stats_path, buf, len)) {
+        fprintf(stderr, "cannot write %s\n", stats_path);
+        return -1;
+    }
+
+    memset(old_list, 0, sizeof(old_list));
+    start = now_us();
+    for (i = 0; i < iterations; i++)
+        old_extract_stats(old_list, stats_path, test_stat_map, NUM_STATS);
+    old_us = now_us() - start;
+
+    memset(new_list, 0, sizeof(new_list));
+    start = now_us();
+    for (i = 0; i < iterations; i++) {
+        read_len = stats_file_read(&file);
+        if (read_len < 0) {
+            fprintf(stderr, "stats_file_read failed: %zd\n", read_len);
+            return -1;
+        }
+        stats_parse(index, file.buf, read_len, new_list);
+        stats_file_release(&file);
+    }
+    new_us = now_us() - start;
+    stats_file_close(&file);
+
+    memset(reopen_list, 0, sizeof(reopen_list));
+    start = now_us();
+    for (i = 0; i < iterations; i++) {
+        read_len = stats_file_read(&reopen_file);
+        if (read_len < 0) {
+            fprintf(stderr, "stats_file_read failed: %zd\n", read_len);
+            return -1;
+        }
+        stats_parse(index, reopen_file.buf, read_len, reopen_list);
+        stats_file_release(&reopen_file);
+    }
+    reopen_us = now_us() - start;
+
+    fprintf(stderr, "%-25s%.2f us getline, %.2f us pread, %.2f us reopen\n",
+            "Read: ", (double)old_us / iterations, (double)new_us / iterations,
+            (double)reopen_us / iterations);
+
+    if (memcmp(old_list, expected, sizeof(expected)) ||
+            memcmp(new_list, expected, sizeof(expected)) ||
+            memcmp(reopen_list, expected, sizeof(expected))) {
+        fprintf(stderr, "parsers disagree on the fake stats file\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int run_generated(struct stats_index *index, int runs)
+{
+    uint64_t list[NUM_STATS * MAX_RPM_PARAMS];
+    uint64_t expected[NUM_STATS * MAX_RPM_PARAMS];
+    char buf[STATS_BUF_SIZE];
+    size_t len;
+    int i;
+
+    for (i = 0; i < runs; i++) {
+        len = generate_stats(buf, sizeof(buf), expected);
+        memset(list, 0, sizeof(list));
+        if (stats_parse(index, buf, len, list) != NUM_STATS * MAX_RPM_PARAMS ||
+                memcmp(list, expected, sizeof(expected))) {
+            fprintf(stderr, "generated stats file %d parsed wrong\n", i);
+            return -1;
+        }
+    }
+    fprintf(stderr, "%-25s%d files\n", "Generated: ", runs);
+    return 0;
+}
+
+/*
+ * Reads the fake record node a few times. Every read has to see all the
+ * records, while pread on a node kept open only ever gets the first one.
+ */
+static int run_debugfs(struct stats_index *index)
+{
+    struct stats_file debugfs_file = STATS_DEBUGFS_INITIALIZER(fake_path);
+    struct stats_file kept_open = STATS_FILE_INITIALIZER(fake_path);
+    uint64_t list[NUM_STATS * MAX_RPM_PARAMS];
+    uint64_t expected[NUM_STATS * MAX_RPM_PARAMS];
+    char buf[STATS_BUF_SIZE];
+    ssize_t read_len;
+    size_t len;
+    int i, values;
+
+    len = generate_stats(buf, sizeof(buf), expected);
+    fake_node_set(buf, len);
+    fake_node.reads = 0;
+
+    for (i = 0; i < 3; i++) {
+        read_len = stats_file_read(&debugfs_file);
+        if (read_len < 0) {
+            fprintf(stderr, "stats_file_read failed: %zd\n", read_len);
+            return -1;
+        }
+        memset(list, 0, sizeof(list));
+        values = stats_parse(index, debugfs_file.buf, read_len, list);
+        stats_file_release(&debugfs_file);
+        if (values != NUM_STATS * MAX_RPM_PARAMS ||
+                memcmp(list, expected, sizeof(expected))) {
+            fprintf(stderr, "record node read %d parsed %d values\n", i,
+                    values);
+            return -1;
+        }
+    }
+    fprintf(stderr, "%-25s%d records, %d reads per pass\n", "Debugfs: ",
+            fake_node.num_records, fake_node.reads / 3);
+
+    /* The fake has to reproduce what broke the kept open reader */
+    for (i = 0; i < 2; i++) {
+        read_len = stats_file_read(&kept_open);
+        if (read_len < 0) {
+            fprintf(stderr, "stats_file_read failed: %zd\n", read_len);
+            return -1;
+        }
+        values = stats_parse(index, kept_open.buf, read_len, list);
+        stats_file_release(&kept_open);
+    }
+    stats_file_close(&kept_open);
+    if (values >= NUM_STATS * MAX_RPM_PARAMS) {
+        fprintf(stderr, "fake node does not hand out records\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Flips, inserts and deletes bytes, cuts the file and drops newlines. The
+ * parser has to stay inside the buffer, which an ASan build checks, and
+ * only write values of known stats.
+ */
+static int run_fuzz(struct stats_index *index, int runs)
+{
+    uint64_t list[NUM_STATS * MAX_RPM_PARAMS + 1];
+    uint64_t expected[NUM_STATS * MAX_RPM_PARAMS];
+    char seed_buf[STATS_BUF_SIZE];
+    char *buf;
+    size_t len, seed_len, pos;
+    int i, m, mutations, values;
+
+    seed_len = generate_stats(seed_buf, sizeof(seed_buf), expected);
+
+    for (i = 0; i < runs; i++) {
+        len = seed_len;
+        /* Exactly sized, so reading past the end gets caught */
+        buf = malloc(seed_len * 2 + 1);
+        if (!buf)
+            return -1;
+        memcpy(buf, seed_buf, len);
+
+        mutations = 1 + rand() % 16;
+        for (m = 0; m < mutations && len; m++) {
+            pos = rand() % len;
+            switch (rand() % 5) {
+                case 0:
+                    buf[pos] = rand() % 256;
+                    break;
+                case 1:
+                    if (len < seed_len * 2) {
+                        memmove(buf + pos + 1, buf + pos, len - pos);
+                        buf[pos] = "\n\t :0x9"[rand() % 7];
+                        len++;
+                    }
+                    break;
+                case 2:
+                    memmove(buf + pos, buf + pos + 1, len - pos - 1);
+                    len--;
+                    break;
+                case 3:
+                    len = pos;
+                    break;
+                default:
+                    if (buf[pos] == '\n')
+                        buf[pos] = ' ';
+                    break;
+            }
+        }
+        buf = realloc(buf, len + 1);
+        if (!buf)
+            return -1;
+
+        list[NUM_STATS * MAX_RPM_PARAMS] = 0x5a5a5a5a5a5a5a5aULL;
+        values = stats_parse(index, buf, len, list);
+        free(buf);
+
+        if (values < 0 || list[NUM_STATS * MAX_RPM_PARAMS] != 0x5a5a5a5a5a5a5a5aULL) {
+            fprintf(stderr, "fuzz run %d wrote outside the stats\n", i);
+            return -1;
+        }
+    }
+    fprintf(stderr, "%-25s%d mutated files\n", "Fuzz: ", runs);
+    return 0;
+}
+
+static int test_input_get(int argc, char *argv[], struct test_input *input)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "n:f:s:")) != -1) {
+        switch (c) {
+            case 'n':
+                input->iterations = atoi(optarg);
+                break;
+            case 'f':
+                input->fuzz_runs = atoi(optarg);
+                break;
+            case 's':
+                input->seed = atoi(optarg);
+                break;
+            default:
+                return 1;
+        }
+    }
+    if (input->iterations <= 0 || input->fuzz_runs < 0)
+        return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct test_input input = { 20000, 20000, 1 };
+    struct stats_index index;
+    int ret = -1;
+
+    if (test_input_get(argc, argv, &input)) {
+        print_usage();
+        return 1;
+    }
+    srand(input.seed);
+
+    if (stats_index_init(&index, test_stat_map, NUM_STATS)) {
+        fprintf(stderr, "stats_index_init failed\n");
+        goto exit;
+    }
+    fprintf(stderr, "%-25s%d keys in %u slots, seed %u\n", "Index: ",
+            index.num_keys, index.mask + 1, index.seed);
+
+    snprintf(stats_path, sizeof(stats_path), "%s/system_stats-%d",
+            getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", getpid());
+
+    if (run_benchmark(&index, input.iterations) ||
+            run_generated(&index, input.fuzz_runs) ||
+            run_debugfs(&index) ||
+            run_fuzz(&index, input.fuzz_runs))
+        goto exit;
+    ret = 0;
+
+exit:
+    unlink(stats_path);
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
@@ -33,10 +33,11 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "utils.h"
-#include "list.h"
+#include "cpu-state.h"
 #include "hint-data.h"
 #include "power-common.h"
 #include "power-helper.h"
@@ -50,20 +51,13 @@
 #define SOC_ID_0 "/sys/devices/soc0/soc_id"
 #define SOC_ID_1 "/sys/devices/system/soc/soc0/id"
 
-const char *scaling_gov_path[4] = {
-    "/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
-    "/sys/devices/system/cpu/cpu1/cpufreq/scaling_governor",
-    "/sys/devices/system/cpu/cpu2/cpufreq/scaling_governor",
-    "/sys/devices/system/cpu/cpu3/cpufreq/scaling_governor"
-};
-
 #define PERF_HAL_PATH "libqti-perfd-client.so"
 static void *qcopt_handle;
 static int (*perf_lock_acq)(unsigned long handle, int duration,
     int list[], int numArgs);
 static int (*perf_lock_rel)(unsigned long handle);
 static int (*perf_hint)(int, char *, int, int);
-static struct list_node active_hint_list_head;
+static struct hint_table active_hints;
 
 static void *get_qcopt_handle()
 {
@@ -186,37 +180,22 @@ int sysfs_write(const char *path, char *s)
 
 int get_scaling_governor(char governor[], int size)
 {
-    if (sysfs_read(SCALING_GOVERNOR_PATH, governor,
-                size) == -1) {
-        // Can't obtain the scaling governor. Return.
-        return -1;
-    } else {
-        // Strip newline at the end.
-        int len = strlen(governor);
-
-        len--;
-
-        while (len >= 0 && (governor[len] == '\n' || governor[len] == '\r'))
-            governor[len--] = '\0';
-    }
-
-    return 0;
+    return get_scaling_governor_check_cores(governor, size, CPU0);
 }
 
 int get_scaling_governor_check_cores(char governor[], int size,int core_num)
 {
+    struct cpu_state state;
+
+    if (core_num < 0 || core_num >= CPU_STATE_MAX_CPUS)
+        return -1;
 
-    if (sysfs_read(scaling_gov_path[core_num], governor,
-                size) == -1) {
+    cpu_state_get(&state);
+    if (!state.governor[core_num][0]) {
         // Can't obtain the scaling governor. Return.
         return -1;
     }
-
-    // Strip newline at the end.
-    int len = strlen(governor);
-    len--;
-    while (len >= 0 && (governor[len] == '\n' || governor[len] == '\r'))
-        governor[len--] = '\0';
+    strlcpy(governor, state.governor[core_num], size);
 
     return 0;
 }
@@ -254,6 +233,29 @@ void interaction(int duration, int num_args, int opt_list[])
 #endif
 }
 
+#ifndef INTERACTION_BOOST
+int interaction_with_handle(int UNUSED(lock_handle), int UNUSED(duration),
+        int UNUSED(num_args), int UNUSED(opt_list[]))
+{
+    return 0;
+}
+#else
+int interaction_with_handle(int lock_handle, int duration, int num_args, int opt_list[])
+{
+    if (duration < 0 || num_args < 1 || opt_list[0] == 0)
+        return 0;
+
+    if (qcopt_handle) {
+        if (perf_lock_acq) {
+            lock_handle = perf_lock_acq(lock_handle, duration, opt_list, num_args);
+            if (lock_handle == -1)
+                ALOGE("Failed to acquire lock.");
+        }
+    }
+    return lock_handle;
+}
+#endif
+
 //this is interaction using perf_hint instead of
 //perf_lock_acq
 int perf_hint_enable(int hint_id , int duration)
@@ -279,9 +281,20 @@ void release_request(int lock_handle) {
         perf_lock_rel(lock_handle);
 }
 
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * USINSEC + ts.tv_nsec / NSINUS;
+}
+
 int perform_hint_action(int hint_id, int resource_values[], int num_resources)
 {
     if (qcopt_handle && perf_lock_acq) {
+        unsigned long replaced_handle;
+        int ret;
+
         /* Acquire an indefinite lock for the requested resources. */
         int lock_handle = perf_lock_acq(0, 0, resource_values,
                 num_resources);
@@ -291,11 +304,10 @@ int perform_hint_action(int hint_id, int resource_values[], int num_resources)
             return -EINVAL;
         }
 
-        /* Add this handle to our internal hint-list. */
-        struct hint_data *new_hint =
-            (struct hint_data *)malloc(sizeof(struct hint_data));
-
-        if (!new_hint) {
+        /* Add this handle to our internal hint table. */
+        ret = hint_table_add(&active_hints, hint_id, lock_handle, now_us(),
+                &replaced_handle);
+        if (ret < 0) {
             /* Can't keep track of this lock. Release it. */
             if (perf_lock_rel)
                 perf_lock_rel(lock_handle);
@@ -303,22 +315,10 @@ int perform_hint_action(int hint_id, int resource_values[], int num_resources)
             return -ENOMEM;
         }
 
-        if (!active_hint_list_head.compare) {
-            active_hint_list_head.compare =
-                (int (*)(void *, void *))hint_compare;
-            active_hint_list_head.dump = (void (*)(void *))hint_dump;
-        }
-
-        new_hint->hint_id = hint_id;
-        new_hint->perflock_handle = lock_handle;
-
-        if (add_list_node(&active_hint_list_head, new_hint) == NULL) {
-            free(new_hint);
-            /* Can't keep track of this lock. Release it. */
-            if (perf_lock_rel)
-                perf_lock_rel(lock_handle);
-            ALOGE("Failed to process hint.");
-            return -ENOMEM;
+        /* The new lock takes over from the one this hint held */
+        if (ret > 0 && perf_lock_rel) {
+            if (perf_lock_rel(replaced_handle) == -1)
+                ALOGE("Perflock release failed.");
         }
     }
     return 0;
@@ -328,31 +328,13 @@ void undo_hint_action(int hint_id)
 {
     if (qcopt_handle) {
         if (perf_lock_rel) {
-            /* Get hint-data associated with this hint-id */
-            struct list_node *found_node;
-            struct hint_data temp_hint_data = {
-                .hint_id = hint_id
-            };
-
-            found_node = find_node(&active_hint_list_head,
-                    &temp_hint_data);
+            unsigned long lock_handle;
 
-            if (found_node) {
+            /* Get the lock held for this hint-id */
+            if (hint_table_remove(&active_hints, hint_id, &lock_handle) == 0) {
                 /* Release this lock. */
-                struct hint_data *found_hint_data =
-                    (struct hint_data *)(found_node->data);
-
-                if (found_hint_data) {
-                    if (perf_lock_rel(found_hint_data->perflock_handle) == -1)
-                        ALOGE("Perflock release failed.");
-                }
-
-                if (found_node->data) {
-                    /* We can free the hint-data for this node. */
-                    free(found_node->data);
-                }
-
-                remove_list_node(&active_hint_list_head, found_node);
+                if (perf_lock_rel(lock_handle) == -1)
+                    ALOGE("Perflock release failed.");
             } else {
                 ALOGE("Invalid hint ID.");
             }
@@ -360,6 +342,11 @@ void undo_hint_action(int hint_id)
     }
 }
 
+void dump_hint_actions(int fd)
+{
+    hint_table_dump(&active_hints, fd, now_us());
+}
+
 /*
  * Used to release initial lock holding
  * two cores online when the display is on
@@ -38,9 +38,11 @@ int is_ondemand_governor(char*);
 
 int perform_hint_action(int hint_id, int resource_values[], int num_resources);
 void undo_hint_action(int hint_id);
+void dump_hint_actions(int fd);
 void undo_initial_hint_action();
 void release_request(int lock_handle);
 void interaction(int duration, int num_args, int opt_list[]);
+int interaction_with_handle(int lock_handle, int duration, int num_args, int opt_list[]);
 int perf_hint_enable(int hint_id, int duration);
 
 long long calc_timespan_us(struct timespec start, struct timespec end);
@@ -17,6 +17,7 @@
 #define LOG_TAG "Thermal"
 
 #include <cerrno>
+#include <mutex>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -30,17 +31,18 @@ namespace thermal {
 namespace V1_1 {
 namespace implementation {
 
-Thermal::Thermal() {}
-
 namespace {
 
 // Saves the IThermalCallback client object registered from the
 // framework for sending thermal events to the framework thermal event bus.
+// Guarded by gThermalCallbackLock, the event engine thread uses it too.
+std::mutex gThermalCallbackLock;
 sp<IThermalCallback> gThermalCallback;
 
 struct ThermalDeathRecipient : hidl_death_recipient {
     virtual void serviceDied(
         uint64_t cookie __unused, const wp<IBase>& who __unused) {
+        std::lock_guard<std::mutex> lock(gThermalCallbackLock);
         gThermalCallback = nullptr;
         LOG(ERROR) << "IThermalCallback HIDL service died";
     }
@@ -48,8 +50,30 @@ struct ThermalDeathRecipient : hidl_death_recipient {
 
 sp<ThermalDeathRecipient> gThermalCallbackDied = nullptr;
 
+void notifyThrottling(bool isThrottling, const Temperature &temperature) {
+    sp<IThermalCallback> callback;
+
+    {
+        std::lock_guard<std::mutex> lock(gThermalCallbackLock);
+        callback = gThermalCallback;
+    }
+    if (callback == nullptr) {
+        return;
+    }
+
+    Return<void> ret = callback->notifyThrottling(isThrottling, temperature);
+    if (!ret.isOk()) {
+        LOG(ERROR) << "notifyThrottling failed: " << ret.description();
+    }
+}
+
 } // anonymous namespace
 
+Thermal::Thermal() {
+    startThermalSampler();
+    startThermalEvents(notifyThrottling);
+}
+
 // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
 Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     ThermalStatus status;
@@ -61,6 +85,8 @@ Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     if (ret < 0) {
         status.code = ThermalStatusCode::FAILURE;
         status.debugMessage = strerror(-ret);
+    } else {
+        temperatures.resize(ret);
     }
     _hidl_cb(status, temperatures);
 
@@ -114,6 +140,7 @@ Return<void> Thermal::getCoolingDevices(getCoolingDevices_cb _hidl_cb) {
 // Methods from ::android::hardware::thermal::V1_1::IThermal follow.
 Return<void> Thermal::registerThermalCallback(
     const sp<IThermalCallback>& callback) {
+    std::lock_guard<std::mutex> lock(gThermalCallbackLock);
     gThermalCallback = callback;
 
     if (gThermalCallback != nullptr) {
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "cpu-usage-reader"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+#include "cpu-usage-reader.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V1_1 {
+namespace implementation {
+
+static const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    return p;
+}
+
+static const char *scanUint64(const char *p, const char *end, uint64_t *value) {
+    const char *start = p;
+    uint64_t v = 0;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p - '0');
+        p++;
+    }
+    *value = v;
+    return p == start ? nullptr : p;
+}
+
+int parseCpuStat(const char *buf, size_t len, CpuTimes *times, unsigned int num_cpus,
+                 uint32_t *seen) {
+    const char *p = buf;
+    const char *end = buf + len;
+
+    *seen = 0;
+    while (end - p > 3 && p[0] == 'c' && p[1] == 'p' && p[2] == 'u') {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        uint64_t cpu, fields[4];
+
+        // A line cut off by the end of the buffer
+        if (eol == nullptr) {
+            break;
+        }
+        p += 3;
+        // The "cpu " line sums up all cpus.
+        if (*p == ' ') {
+            p = eol + 1;
+            continue;
+        }
+
+        p = scanUint64(p, eol, &cpu);
+        if (p == nullptr || cpu >= num_cpus) {
+            return -EIO;
+        }
+        // user, nice, system, idle
+        for (uint64_t &field : fields) {
+            p = scanUint64(skipSpaces(p, eol), eol, &field);
+            if (p == nullptr) {
+                return -EIO;
+            }
+        }
+
+        times[cpu].active = fields[0] + fields[1] + fields[2];
+        times[cpu].total = times[cpu].active + fields[3];
+        *seen |= 1u << cpu;
+        p = eol + 1;
+    }
+
+    return 0;
+}
+
+CpuUsageReader::CpuUsageReader(const std::string &stat_path, const std::string &online_format,
+                               unsigned int num_cpus)
+    : num_cpus_(num_cpus),
+      stat_path_(stat_path),
+      stat_fd_(-1),
+      online_fds_(num_cpus, -1),
+      last_(num_cpus, CpuTimes{0, 0, false, -1}),
+      last_seen_(0) {
+    for (unsigned int cpu = 0; cpu < num_cpus; cpu++) {
+        online_paths_.push_back(android::base::StringPrintf(online_format.c_str(), cpu));
+    }
+}
+
+CpuUsageReader::~CpuUsageReader() {
+    if (stat_fd_ >= 0) {
+        close(stat_fd_);
+    }
+    for (int fd : online_fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+/**
+ * Reads the head of a file through its kept open fd, opening it on first
+ * use and reopening it once if the read fails.
+ *
+ * @return bytes read on success or negative value -errno on error.
+ */
+int CpuUsageReader::readFile(int *fd, const std::string &path, char *buf, size_t size) {
+    ssize_t len = -1;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (*fd < 0 || attempt > 0) {
+            if (*fd >= 0) {
+                close(*fd);
+            }
+            *fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (*fd < 0) {
+                PLOG(ERROR) << "CpuUsageReader: failed to open file (" << path << ")";
+                return -errno;
+            }
+        }
+        len = pread(*fd, buf, size, 0);
+        if (len > 0) {
+            return len;
+        }
+    }
+
+    if (len < 0) {
+        PLOG(ERROR) << "CpuUsageReader: failed to read file (" << path << ")";
+        return -errno;
+    }
+    LOG(ERROR) << "CpuUsageReader: empty file (" << path << ")";
+    return -EIO;
+}
+
+ssize_t CpuUsageReader::read(CpuTimes *times) {
+    std::lock_guard<std::mutex> lock(lock_);
+    uint32_t seen;
+    char online[4];
+    int len;
+
+    len = readFile(&stat_fd_, stat_path_, buf_, sizeof(buf_));
+    if (len < 0) {
+        return len;
+    }
+
+    for (unsigned int cpu = 0; cpu < num_cpus_; cpu++) {
+        times[cpu] = last_[cpu];
+    }
+    if (parseCpuStat(buf_, len, times, num_cpus_, &seen) < 0 || seen == 0) {
+        LOG(ERROR) << "CpuUsageReader: file has incorrect format (" << stat_path_ << ")";
+        return -EIO;
+    }
+
+    for (unsigned int cpu = 0; cpu < num_cpus_; cpu++) {
+        len = readFile(&online_fds_[cpu], online_paths_[cpu], online, sizeof(online));
+        if (len < 0) {
+            return len;
+        }
+        times[cpu].online = online[0] == '1';
+
+        uint64_t total = times[cpu].total - last_[cpu].total;
+        uint64_t active = times[cpu].active - last_[cpu].active;
+        uint32_t bit = 1u << cpu;
+        if ((seen & last_seen_ & bit) && total > 0 && active <= total) {
+            times[cpu].utilization = static_cast<int>(active * 1000 / total);
+        } else {
+            times[cpu].utilization = -1;
+        }
+        last_[cpu] = times[cpu];
+    }
+    last_seen_ = seen;
+
+    return num_cpus_;
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
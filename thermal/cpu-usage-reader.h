@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CPU_USAGE_READER_H__
+#define __CPU_USAGE_READER_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V1_1 {
+namespace implementation {
+
+// The cpuN lines come first in /proc/stat, ahead of the long intr line.
+constexpr size_t kCpuStatBufSize = 4096;
+
+struct CpuTimes {
+    uint64_t active;
+    uint64_t total;
+    bool online;
+    // Active share of the time since the previous read, in per mille, or -1
+    // when there is no previous read or the cpu was not listed in both.
+    int utilization;
+};
+
+/**
+ * Parses the cpuN lines at the head of /proc/stat in place. times[N] gets
+ * user + nice + system as active and that plus idle as total. The buffer
+ * does not need to be terminated and may end in the middle of a line.
+ *
+ * @param seen Bitmask of the cpus that had a line.
+ * @return 0 on success or -EIO if a cpuN line is malformed or N is not
+ *     below num_cpus.
+ */
+int parseCpuStat(const char *buf, size_t len, CpuTimes *times, unsigned int num_cpus,
+                 uint32_t *seen);
+
+/**
+ * Reads per cpu times from kept open /proc/stat and cpuN/online nodes into
+ * a fixed buffer, and works out each cpu's utilization since the previous
+ * read. Offline cpus have no line in /proc/stat and keep their last times.
+ */
+class CpuUsageReader {
+  public:
+    CpuUsageReader(const std::string &stat_path, const std::string &online_format,
+                   unsigned int num_cpus);
+    ~CpuUsageReader();
+
+    /**
+     * @return number of cpus on success or negative value -errno on error.
+     */
+    ssize_t read(CpuTimes *times);
+
+  private:
+    int readFile(int *fd, const std::string &path, char *buf, size_t size);
+
+    const unsigned int num_cpus_;
+    const std::string stat_path_;
+    int stat_fd_;
+    std::vector<std::string> online_paths_;
+    std::vector<int> online_fds_;
+
+    std::mutex lock_;
+    std::vector<CpuTimes> last_;
+    uint32_t last_seen_;
+    char buf_[kCpuStatBufSize];
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif //__CPU_USAGE_READER_H__
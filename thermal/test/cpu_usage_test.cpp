@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * /proc/stat cpu usage test on canned snapshots, and a fake stat file and
+ * cpu online nodes in a temp directory for the reader and its deltas. Also
+ * compares the parser with the getline and sscanf loop it replaced.
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu-usage-reader.h"
+
+using ::android::hardware::thermal::V1_1::implementation::CpuTimes;
+using ::android::hardware::thermal::V1_1::implementation::CpuUsageReader;
+using ::android::hardware::thermal::V1_1::implementation::parseCpuStat;
+
+#define TEST_CPUS    4
+#define TEST_LOOKUPS 20000
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+static const char kStatAllOnline[] =
+    "cpu  1053446 47389 717651 31358185 50453 65 12718 0 0 0\n"
+    "cpu0 349232 13040 273911 7648931 23914 64 10417 0 0 0\n"
+    "cpu1 243312 11546 153066 7899286 9158 0 1102 0 0 0\n"
+    "cpu2 236054 11440 147386 7906116 8710 0 604 0 0 0\n"
+    "cpu3 224848 11363 143288 7903852 8671 1 595 0 0 0\n"
+    "intr 65427911 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n"
+    "ctxt 124558193\n"
+    "btime 1539939521\n"
+    "processes 70214\n"
+    "procs_running 1\n"
+    "procs_blocked 0\n"
+    "softirq 30584621 2 7961245 31021 1237810 0 0 2133 8025497 0 13296913\n";
+
+// cpu2 and cpu3 hotplugged out
+static const char kStatTwoOffline[] =
+    "cpu  1053500 47389 717700 31358300 50453 65 12718 0 0 0\n"
+    "cpu0 349282 13040 273951 7648981 23914 64 10417 0 0 0\n"
+    "cpu1 243316 11546 153075 7899351 9158 0 1102 0 0 0\n"
+    "intr 65427911 0 0 0 0 0 0 0\n"
+    "ctxt 124558193\n";
+
+static char root[PATH_MAX - 128];
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int write_node(const char *node, const char *value) {
+    char path[PATH_MAX];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", root, node);
+    fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fputs(value, fp);
+    fclose(fp);
+    return 0;
+}
+
+static int write_online(const char *states) {
+    char node[64];
+
+    for (int cpu = 0; cpu < TEST_CPUS; cpu++) {
+        snprintf(node, sizeof(node), "cpu%d_online", cpu);
+        CHECK(write_node(node, states[cpu] == '1' ? "1\n" : "0\n") == 0);
+    }
+    return 0;
+}
+
+/* The loop fillCpuUsages used before the reader */
+static int old_parse(FILE *file, CpuTimes *times) {
+    int vals, cpu_num;
+    ssize_t read;
+    uint64_t user, nice, system, idle;
+    char *line = NULL;
+    size_t len = 0;
+    int size = 0;
+
+    while ((read = getline(&line, &len, file)) != -1) {
+        if (strnlen(line, read) < 4 || strncmp(line, "cpu", 3) != 0 || !isdigit(line[3])) {
+            free(line);
+            line = NULL;
+            len = 0;
+            continue;
+        }
+
+        vals = sscanf(line, "cpu%d %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+                &cpu_num, &user, &nice, &system, &idle);
+
+        free(line);
+        line = NULL;
+        len = 0;
+
+        if (vals != 5 || size == TEST_CPUS)
+            return -EIO;
+        times[size].active = user + nice + system;
+        times[size].total = times[size].active + idle;
+        size++;
+    }
+    free(line);
+    return size;
+}
+
+static int test_snapshots(void) {
+    CpuTimes times[TEST_CPUS];
+    uint32_t seen;
+
+    memset(times, 0, sizeof(times));
+    CHECK(parseCpuStat(kStatAllOnline, strlen(kStatAllOnline), times, TEST_CPUS, &seen) == 0);
+    CHECK(seen == 0xf);
+    CHECK(times[0].active == 349232 + 13040 + 273911);
+    CHECK(times[0].total == times[0].active + 7648931);
+    CHECK(times[3].active == 224848 + 11363 + 143288);
+    CHECK(times[3].total == times[3].active + 7903852);
+
+    memset(times, 0, sizeof(times));
+    CHECK(parseCpuStat(kStatTwoOffline, strlen(kStatTwoOffline), times, TEST_CPUS, &seen) == 0);
+    CHECK(seen == 0x3);
+    CHECK(times[1].active == 243316 + 11546 + 153075);
+    CHECK(times[2].total == 0);
+
+    // Cut off in the middle of cpu2, the complete lines still count
+    const char *cut = strstr(kStatAllOnline, "cpu2") + 10;
+    CHECK(parseCpuStat(kStatAllOnline, cut - kStatAllOnline, times, TEST_CPUS, &seen) == 0);
+    CHECK(seen == 0x3);
+
+    CHECK(parseCpuStat("", 0, times, TEST_CPUS, &seen) == 0 && seen == 0);
+    CHECK(parseCpuStat("cpu0 1 2 3\n", 11, times, TEST_CPUS, &seen) == -EIO);
+    CHECK(parseCpuStat("cpu0 1 2 x 4\n", 13, times, TEST_CPUS, &seen) == -EIO);
+    CHECK(parseCpuStat("cpu4 1 2 3 4\n", 13, times, TEST_CPUS, &seen) == -EIO);
+    CHECK(parseCpuStat("cpux 1 2 3 4\n", 13, times, TEST_CPUS, &seen) == -EIO);
+
+    fprintf(stderr, "%-25s%s\n", "Snapshots: ", "parsed");
+    return 0;
+}
+
+static int test_reader(void) {
+    std::string stat_path = std::string(root) + "/stat";
+    std::string online_format = std::string(root) + "/cpu%d_online";
+    CpuUsageReader reader(stat_path, online_format, TEST_CPUS);
+    CpuTimes times[TEST_CPUS];
+
+    CHECK(reader.read(times) == -ENOENT);
+
+    CHECK(write_node("stat", kStatAllOnline) == 0);
+    CHECK(write_online("1111") == 0);
+    CHECK(reader.read(times) == TEST_CPUS);
+    for (int cpu = 0; cpu < TEST_CPUS; cpu++) {
+        CHECK(times[cpu].online);
+        CHECK(times[cpu].utilization == -1);
+    }
+    CHECK(times[2].active == 236054 + 11440 + 147386);
+
+    // cpu0: 90 of 140 active, cpu1: 13 of 78
+    CHECK(write_node("stat", kStatTwoOffline) == 0);
+    CHECK(write_online("1100") == 0);
+    CHECK(reader.read(times) == TEST_CPUS);
+    CHECK(times[0].utilization == 90 * 1000 / 140);
+    CHECK(times[1].utilization == 13 * 1000 / 78);
+    CHECK(!times[2].online && times[2].utilization == -1);
+    CHECK(times[2].active == 236054 + 11440 + 147386);
+
+    // Nothing moved
+    CHECK(reader.read(times) == TEST_CPUS);
+    CHECK(times[0].utilization == -1);
+
+    CHECK(write_node("stat", "cpu0 1 2\n") == 0);
+    CHECK(reader.read(times) == -EIO);
+
+    fprintf(stderr, "%-25s%s\n", "Reader: ", "deltas match");
+    CHECK(write_node("stat", kStatAllOnline) == 0);
+    CHECK(write_online("1111") == 0);
+    return 0;
+}
+
+static int test_cost(void) {
+    std::string stat_path = std::string(root) + "/stat";
+    std::string online_format = std::string(root) + "/cpu%d_online";
+    CpuUsageReader reader(stat_path, online_format, TEST_CPUS);
+    CpuTimes times[TEST_CPUS];
+    uint64_t start, old_us, parse_us, read_us;
+    size_t len = strlen(kStatAllOnline);
+    uint32_t seen;
+    FILE *fp;
+    int n;
+
+    start = now_us();
+    for (n = 0; n < TEST_LOOKUPS; n++) {
+        fp = fmemopen((void *)kStatAllOnline, len, "r");
+        CHECK(fp != NULL);
+        CHECK(old_parse(fp, times) == TEST_CPUS);
+        fclose(fp);
+    }
+    old_us = now_us() - start;
+
+    start = now_us();
+    for (n = 0; n < TEST_LOOKUPS; n++)
+        CHECK(parseCpuStat(kStatAllOnline, len, times, TEST_CPUS, &seen) == 0);
+    parse_us = now_us() - start;
+
+    start = now_us();
+    for (n = 0; n < TEST_LOOKUPS; n++)
+        CHECK(reader.read(times) == TEST_CPUS);
+    read_us = now_us() - start;
+
+    fprintf(stderr, "%-25s%.3f us getline, %.3f us parser, %.2f us read with online\n",
+            "Cost: ", (double)old_us / TEST_LOOKUPS, (double)parse_us / TEST_LOOKUPS,
+            (double)read_us / TEST_LOOKUPS);
+    return 0;
+}
+
+static void remove_tree(void) {
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/stat", root);
+    unlink(path);
+    for (int cpu = 0; cpu < TEST_CPUS; cpu++) {
+        snprintf(path, sizeof(path), "%s/cpu%d_online", root, cpu);
+        unlink(path);
+    }
+    rmdir(root);
+}
+
+int main(void) {
+    int ret = -1;
+
+    snprintf(root, sizeof(root), "%s/cpu-usage-%d",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", getpid());
+    if (mkdir(root, 0755)) {
+        fprintf(stderr, "cannot create %s\n", root);
+        goto exit;
+    }
+
+    if (test_snapshots() || test_reader() || test_cost())
+        goto exit;
+    ret = 0;
+
+exit:
+    remove_tree();
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
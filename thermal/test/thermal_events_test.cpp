@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Thermal event engine test. Replays scripted temperature traces through a
+ * fake sensor source on a virtual clock, checks the transitions and the
+ * hysteresis, and compares the reads and reaction time of the adaptive
+ * interval with fixed rate polling. Also runs the engine thread against a
+ * source that notifies.
+ */
+
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+#include "thermal-events.h"
+
+using namespace ::android::hardware::thermal::V1_1::implementation;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+// Temperatures in degrees, raw values in millidegrees like sysfs.
+static const std::vector<ThermalEventSensor> kTestSensors = {
+    {0.001, 60, 115},   // cpu
+    {0.001, NAN, NAN},  // gpu, no thresholds
+};
+
+/* Returns trace(sensor, t) at the virtual time the test advances */
+class ScriptedSource : public ThermalEventSource {
+  public:
+    typedef std::function<float(size_t, int64_t)> Trace;
+
+    explicit ScriptedSource(const Trace &trace)
+        : trace_(trace), now_ms_(0), reads_(0), max_age_ns_(-1) {}
+
+    int64_t read(SensorSample *samples, size_t count, int64_t max_age_ns) override {
+        for (size_t i = 0; i < count; i++) {
+            float value = trace_(i, now_ms_);
+            samples[i].error = std::isnan(value) ? -EIO : 0;
+            samples[i].raw = std::isnan(value) ? 0 : static_cast<int>(lrintf(value * 1000));
+        }
+        reads_++;
+        max_age_ns_ = max_age_ns;
+        return now_ms_ * 1000000 + 1;
+    }
+    bool wait(unsigned int) override { return false; }
+    void wake() override {}
+
+    Trace trace_;
+    int64_t now_ms_;
+    uint64_t reads_;
+    int64_t max_age_ns_;
+};
+
+struct Recorder {
+    std::vector<ThermalEvent> events;
+    std::vector<int64_t> times_ms;
+    ScriptedSource *source;
+
+    ThermalEventEngine::Callback callback() {
+        return [this](const ThermalEvent &event) {
+            events.push_back(event);
+            times_ms.push_back(source->now_ms_);
+        };
+    }
+};
+
+// Steps the engine over [0, end_ms) on the virtual clock.
+static void replay(ThermalEventEngine *engine, ScriptedSource *source, int64_t end_ms) {
+    while (source->now_ms_ < end_ms) {
+        source->now_ms_ += engine->step();
+    }
+}
+
+// Linear ramps between (ms, degrees) points.
+static float ramp(const std::vector<std::pair<int64_t, float>> &points, int64_t t) {
+    if (t <= points.front().first)
+        return points.front().second;
+    for (size_t i = 1; i < points.size(); i++) {
+        if (t <= points[i].first) {
+            const auto &a = points[i - 1];
+            const auto &b = points[i];
+            return a.second + (b.second - a.second) * (t - a.first) / (b.first - a.first);
+        }
+    }
+    return points.back().second;
+}
+
+// Samples may be as old as the engine interval, the first ones not at all.
+static int test_max_age(void) {
+    ScriptedSource source([](size_t, int64_t t) { return ramp({{0, 40}, {60000, 59}}, t); });
+    ThermalEventEngine engine(&source, kTestSensors);
+
+    unsigned int interval_ms = engine.step();
+    CHECK(source.max_age_ns_ == 0);
+    while (source.now_ms_ < 60000) {
+        source.now_ms_ += interval_ms;
+        unsigned int next_ms = engine.step();
+        CHECK(source.max_age_ns_ == static_cast<int64_t>(interval_ms) * 1000000);
+        interval_ms = next_ms;
+    }
+    CHECK(interval_ms < kThermalEventMaxIntervalMs);
+
+    fprintf(stderr, "%-25s%" PRIu64 " steps\n", "Max age: ", engine.steps());
+    return 0;
+}
+
+static int test_crossing(void) {
+    ScriptedSource source([](size_t sensor, int64_t t) {
+        if (sensor == 1)
+            return 200.0f;
+        return ramp({{0, 40}, {60000, 70}, {120000, 50}}, t);
+    });
+    ThermalEventEngine engine(&source, kTestSensors);
+    Recorder recorder = {{}, {}, &source};
+
+    engine.registerCallback(recorder.callback());
+    replay(&engine, &source, 130000);
+
+    CHECK(recorder.events.size() == 2);
+    CHECK(recorder.events[0].sensor == 0);
+    CHECK(recorder.events[0].from == ThermalState::NORMAL);
+    CHECK(recorder.events[0].to == ThermalState::THROTTLING);
+    CHECK(recorder.events[0].value >= 60 && recorder.events[0].value < 60.2);
+    CHECK(recorder.events[1].to == ThermalState::NORMAL);
+    CHECK(recorder.events[1].value <= 58 && recorder.events[1].value > 57.8);
+    CHECK(engine.state(0) == ThermalState::NORMAL);
+    CHECK(engine.state(1) == ThermalState::NORMAL);
+
+    fprintf(stderr, "%-25s%zu events\n", "Crossing: ", recorder.events.size());
+    return 0;
+}
+
+static int test_hysteresis(void) {
+    // Hovers around the threshold, then cools below the hysteresis
+    ScriptedSource source([](size_t sensor, int64_t t) {
+        if (sensor == 1)
+            return 30.0f;
+        if (t < 60000)
+            return 60.0f + 0.8f * sinf(t / 700.0f);
+        return 57.0f;
+    });
+    ThermalEventEngine engine(&source, kTestSensors);
+    Recorder recorder = {{}, {}, &source};
+
+    engine.registerCallback(recorder.callback());
+    replay(&engine, &source, 59000);
+    CHECK(recorder.events.size() == 1);
+    CHECK(engine.state(0) == ThermalState::THROTTLING);
+
+    replay(&engine, &source, 70000);
+    CHECK(recorder.events.size() == 2);
+    CHECK(engine.state(0) == ThermalState::NORMAL);
+
+    fprintf(stderr, "%-25s%" PRIu64 " steps, %zu events\n", "Hysteresis: ", engine.steps(),
+            recorder.events.size());
+    return 0;
+}
+
+static int test_shutdown(void) {
+    ScriptedSource source([](size_t sensor, int64_t t) {
+        if (sensor == 1)
+            return NAN;
+        return ramp({{0, 100}, {10000, 116}, {20000, 114}, {30000, 114}, {40000, 112}}, t);
+    });
+    ThermalEventEngine engine(&source, kTestSensors);
+    Recorder recorder = {{}, {}, &source};
+
+    engine.registerCallback(recorder.callback());
+
+    // Starts above the throttling threshold
+    engine.step();
+    CHECK(recorder.events.size() == 1);
+    CHECK(recorder.events[0].to == ThermalState::THROTTLING);
+
+    replay(&engine, &source, 30000);
+    CHECK(recorder.events.size() == 2);
+    CHECK(recorder.events[1].from == ThermalState::THROTTLING);
+    CHECK(recorder.events[1].to == ThermalState::SHUTDOWN);
+    CHECK(engine.state(0) == ThermalState::SHUTDOWN);
+
+    replay(&engine, &source, 45000);
+    CHECK(recorder.events.size() == 3);
+    CHECK(recorder.events[2].to == ThermalState::THROTTLING);
+
+    fprintf(stderr, "%-25s%zu events\n", "Shutdown: ", recorder.events.size());
+    return 0;
+}
+
+/*
+ * Ten minutes mostly idle with one excursion over the threshold. Counts the
+ * reads and the delay from the crossing to its event for the adaptive
+ * interval and for fixed intervals at both ends of its range.
+ */
+static int test_adaptive(void) {
+    auto trace = [](size_t sensor, int64_t t) {
+        if (sensor == 1)
+            return 35.0f;
+        return ramp({{0, 35}, {300000, 38}, {330000, 61.5}, {360000, 45}, {600000, 35}}, t);
+    };
+    // 60 degrees is crossed at this time on the trace
+    const int64_t crossing_ms = 300000 + (60 - 38) * 30000 / 23.5;
+    struct {
+        const char *name;
+        unsigned int min_ms, max_ms;
+        uint64_t reads;
+        int64_t latency_ms;
+    } runs[] = {
+        {"adaptive", kThermalEventMinIntervalMs, kThermalEventMaxIntervalMs, 0, 0},
+        {"fixed min", kThermalEventMinIntervalMs, kThermalEventMinIntervalMs, 0, 0},
+        {"fixed max", kThermalEventMaxIntervalMs, kThermalEventMaxIntervalMs, 0, 0},
+    };
+
+    for (auto &run : runs) {
+        ScriptedSource source(trace);
+        ThermalEventEngine engine(&source, kTestSensors, run.min_ms, run.max_ms);
+        Recorder recorder = {{}, {}, &source};
+
+        engine.registerCallback(recorder.callback());
+        replay(&engine, &source, 600000);
+        CHECK(recorder.events.size() == 2);
+        run.reads = source.reads_;
+        run.latency_ms = recorder.times_ms[0] - crossing_ms;
+        fprintf(stderr, "%-25s%s: %" PRIu64 " reads, event %" PRId64 " ms after crossing\n",
+                "Adaptive: ", run.name, run.reads, run.latency_ms);
+    }
+
+    CHECK(runs[0].reads * 10 < runs[1].reads);
+    CHECK(runs[0].latency_ms <= runs[1].latency_ms + (int64_t)kThermalEventMinIntervalMs);
+    CHECK(runs[0].latency_ms < runs[2].latency_ms || runs[2].latency_ms < 200);
+    return 0;
+}
+
+/* Real time source that reports a change as soon as the test sets one */
+class NotifySource : public ThermalEventSource {
+  public:
+    NotifySource()
+        : value_(30000), notified_(false), woken_(false), reads_(0), fresh_reads_(0) {}
+
+    int64_t read(SensorSample *samples, size_t count, int64_t max_age_ns) override {
+        std::lock_guard<std::mutex> lock(lock_);
+        for (size_t i = 0; i < count; i++) {
+            samples[i].raw = value_;
+            samples[i].error = 0;
+        }
+        reads_++;
+        if (max_age_ns == 0)
+            fresh_reads_++;
+        return thermalNowNs();
+    }
+
+    bool wait(unsigned int timeout_ms) override {
+        std::unique_lock<std::mutex> lock(lock_);
+        cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                       [this] { return notified_ || woken_; });
+        bool notified = notified_ && !woken_;
+        notified_ = false;
+        woken_ = false;
+        return notified;
+    }
+
+    void wake() override {
+        std::lock_guard<std::mutex> lock(lock_);
+        woken_ = true;
+        cond_.notify_all();
+    }
+
+    void set(int value) {
+        std::lock_guard<std::mutex> lock(lock_);
+        value_ = value;
+        notified_ = true;
+        cond_.notify_all();
+    }
+
+    std::mutex lock_;
+    std::condition_variable cond_;
+    int value_;
+    bool notified_;
+    bool woken_;
+    uint64_t reads_;
+    uint64_t fresh_reads_;
+};
+
+static int test_thread(void) {
+    NotifySource source;
+    ThermalEventEngine engine(&source, {{0.001, 60, 115}}, 10, 2000);
+    std::mutex lock;
+    std::condition_variable cond;
+    int64_t event_ns = 0;
+
+    engine.registerCallback([&](const ThermalEvent &event) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (event.to == ThermalState::THROTTLING) {
+            event_ns = thermalNowNs();
+            cond.notify_all();
+        }
+    });
+    engine.start();
+    usleep(50000);
+
+    int64_t set_ns = thermalNowNs();
+    source.set(65000);
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        CHECK(cond.wait_for(guard, std::chrono::seconds(1), [&] { return event_ns != 0; }));
+    }
+
+    // Back to the max interval, stop must not wait it out
+    source.set(30000);
+    usleep(50000);
+    int64_t stop_ns = thermalNowNs();
+    engine.stop();
+    stop_ns = thermalNowNs() - stop_ns;
+
+    // Two seconds between steps without the notification, and the steps
+    // after a notification do not take the last samples
+    CHECK(event_ns - set_ns < 200000000LL);
+    CHECK(source.fresh_reads_ >= 3);
+    CHECK(stop_ns < 100000000LL);
+    fprintf(stderr, "%-25s%.1f ms from notify to event, %.1f ms to stop\n", "Thread: ",
+            (event_ns - set_ns) / 1000000.0, stop_ns / 1000000.0);
+    return 0;
+}
+
+int main(void) {
+    int ret = -1;
+
+    if (test_max_age() || test_crossing() || test_hysteresis() || test_shutdown() || test_adaptive() ||
+            test_thread())
+        goto exit;
+    ret = 0;
+
+exit:
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
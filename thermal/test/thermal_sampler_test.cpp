@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Thermal sampler test against a fake /sys/class/thermal tree in a temp
+ * directory. Also compares a snapshot read with reading the zones the way
+ * the HAL did before the sampler.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "thermal-sampler.h"
+
+using ::android::hardware::thermal::V1_1::implementation::SensorSample;
+using ::android::hardware::thermal::V1_1::implementation::ThermalSampler;
+using ::android::hardware::thermal::V1_1::implementation::thermalNowNs;
+
+#define TEST_LOOKUPS 20000
+#define TEST_READERS 4
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        return -1; \
+    } \
+} while (0)
+
+static const std::vector<unsigned int> kTestSensors = {17, 6, 11, 14};
+
+static char root[PATH_MAX - 128];
+
+/*
+ * Rewrites the node in place without truncating it first, so the sampler
+ * never sees an empty file, which sysfs would not show either.
+ */
+static int write_zone(unsigned int sensor, const char *value) {
+    char path[PATH_MAX];
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/thermal_zone%u/temp", root, sensor);
+    fp = fopen(path, "r+");
+    if (!fp)
+        fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, "%s\n", value);
+    fflush(fp);
+    if (ftruncate(fileno(fp), ftell(fp))) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int write_zones(int base) {
+    char value[32];
+
+    for (size_t i = 0; i < kTestSensors.size(); i++) {
+        snprintf(value, sizeof(value), "%d", base + static_cast<int>(i));
+        CHECK(write_zone(kTestSensors[i], value) == 0);
+    }
+    return 0;
+}
+
+static int make_tree(void) {
+    char path[PATH_MAX];
+
+    for (unsigned int sensor : kTestSensors) {
+        snprintf(path, sizeof(path), "%s/thermal_zone%u", root, sensor);
+        mkdir(path, 0755);
+    }
+    return write_zones(30000);
+}
+
+static void remove_tree(void) {
+    char path[PATH_MAX];
+
+    for (unsigned int sensor : kTestSensors) {
+        snprintf(path, sizeof(path), "%s/thermal_zone%u/temp", root, sensor);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/thermal_zone%u", root, sensor);
+        rmdir(path);
+    }
+    rmdir(root);
+}
+
+static int test_on_demand(void) {
+    ThermalSampler sampler(root, kTestSensors, 0);
+    SensorSample samples[4];
+    int64_t ts, ts2;
+
+    CHECK(sampler.size() == kTestSensors.size());
+    CHECK(sampler.peek(samples, 4) == 0);
+
+    ts = sampler.read(samples, 4, 0);
+    CHECK(ts > 0);
+    for (int i = 0; i < 4; i++) {
+        CHECK(samples[i].error == 0);
+        CHECK(samples[i].raw == 30000 + i);
+    }
+
+    // A fresh enough snapshot is served without reading the zones
+    CHECK(write_zones(40000) == 0);
+    ts2 = sampler.read(samples, 4, 60000000000LL);
+    CHECK(ts2 == ts);
+    CHECK(sampler.passes() == 1);
+    CHECK(samples[0].raw == 30000);
+
+    ts2 = sampler.read(samples, 4, 0);
+    CHECK(ts2 > ts);
+    CHECK(samples[3].raw == 40003);
+
+    // Bad values and negative temperatures
+    CHECK(write_zone(kTestSensors[1], "garbage") == 0);
+    CHECK(write_zone(kTestSensors[2], "-5000") == 0);
+    sampler.read(samples, 4, 0);
+    CHECK(samples[1].error == -EIO);
+    CHECK(samples[2].error == 0 && samples[2].raw == -5000);
+
+    CHECK(write_zones(30000) == 0);
+    sampler.read(samples, 4, 0);
+    CHECK(samples[1].error == 0 && samples[1].raw == 30001);
+
+    fprintf(stderr, "%-25s%" PRIu64 " passes\n", "On demand: ", sampler.passes());
+    return 0;
+}
+
+static int test_missing_zone(void) {
+    std::vector<unsigned int> sensors = kTestSensors;
+    SensorSample samples[5];
+
+    sensors.push_back(99);
+    ThermalSampler sampler(root, sensors, 0);
+    sampler.read(samples, 5, 0);
+    CHECK(samples[0].error == 0);
+    CHECK(samples[4].error == -ENOENT);
+
+    fprintf(stderr, "%-25s%s\n", "Missing zone: ", "reported");
+    return 0;
+}
+
+static int test_thread(void) {
+    ThermalSampler sampler(root, kTestSensors, 5);
+    SensorSample samples[4];
+    int64_t start, ts;
+
+    sampler.start();
+    CHECK(write_zones(50000) == 0);
+    start = thermalNowNs();
+    do {
+        usleep(1000);
+        ts = sampler.peek(samples, 4);
+        CHECK(thermalNowNs() - start < 2000000000LL);
+    } while (ts == 0 || samples[0].raw != 50000);
+    CHECK(samples[3].raw == 50003);
+    sampler.stop();
+
+    uint64_t passes = sampler.passes();
+    usleep(20000);
+    CHECK(sampler.passes() == passes);
+
+    fprintf(stderr, "%-25s%.1f ms to see an update\n", "Thread: ",
+            (thermalNowNs() - start) / 1000000.0);
+    CHECK(write_zones(30000) == 0);
+    return 0;
+}
+
+/*
+ * Readers hammer the snapshot while the sampler thread publishes new ones
+ * and the zones keep rising. Any torn copy shows up as a value or
+ * timestamp going backwards.
+ */
+/*
+ * Regular files never raise POLLPRI, so waits time out unless woken. A wake
+ * before the wait is not lost, and is only seen once.
+ */
+static int test_wake(void) {
+    ThermalSampler sampler(root, kTestSensors, 0);
+    int64_t start;
+
+    start = thermalNowNs();
+    CHECK(!sampler.waitNotify(20));
+    CHECK(thermalNowNs() - start >= 15000000LL);
+
+    std::thread waker([&] {
+        usleep(10000);
+        sampler.wakeNotify();
+    });
+    start = thermalNowNs();
+    CHECK(!sampler.waitNotify(5000));
+    int64_t woken_ns = thermalNowNs() - start;
+    waker.join();
+    CHECK(woken_ns < 1000000000LL);
+
+    sampler.wakeNotify();
+    start = thermalNowNs();
+    CHECK(!sampler.waitNotify(5000));
+    CHECK(thermalNowNs() - start < 1000000000LL);
+    start = thermalNowNs();
+    CHECK(!sampler.waitNotify(20));
+    CHECK(thermalNowNs() - start >= 15000000LL);
+
+    fprintf(stderr, "%-25s%.1f ms to wake a 5 s wait\n", "Wake: ", woken_ns / 1000000.0);
+    return 0;
+}
+
+static int test_concurrent(void) {
+    ThermalSampler sampler(root, kTestSensors, 1);
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> readers;
+    uint64_t reads = 0;
+
+    sampler.start();
+    for (int r = 0; r < TEST_READERS; r++) {
+        readers.emplace_back([&] {
+            SensorSample samples[4];
+            int last[4] = {0, 0, 0, 0};
+            int64_t last_ts = 0;
+
+            while (!done.load()) {
+                int64_t ts = sampler.peek(samples, 4);
+                if (ts < last_ts)
+                    failures++;
+                last_ts = ts;
+                for (int i = 0; i < 4; i++) {
+                    if (ts && (samples[i].error || samples[i].raw < last[i] ||
+                            samples[i].raw % 10 != i))
+                        failures++;
+                    last[i] = samples[i].raw;
+                }
+            }
+        });
+    }
+
+    for (int gen = 1; gen <= 200; gen++) {
+        CHECK(write_zones(30000 + gen * 10) == 0);
+        usleep(500);
+    }
+    done = true;
+    for (auto &reader : readers)
+        reader.join();
+    reads = sampler.passes();
+    sampler.stop();
+
+    CHECK(failures.load() == 0);
+    fprintf(stderr, "%-25s%" PRIu64 " passes, %d readers\n", "Concurrent: ", reads,
+            TEST_READERS);
+    CHECK(write_zones(30000) == 0);
+    return 0;
+}
+
+static int test_cost(void) {
+    ThermalSampler sampler(root, kTestSensors, 0);
+    SensorSample samples[4];
+    char path[PATH_MAX];
+    int64_t start, fopen_ns, pread_ns, peek_ns;
+    float temp;
+    FILE *fp;
+
+    start = thermalNowNs();
+    for (int n = 0; n < TEST_LOOKUPS; n++) {
+        for (unsigned int sensor : kTestSensors) {
+            snprintf(path, sizeof(path), "%s/thermal_zone%u/temp", root, sensor);
+            fp = fopen(path, "r");
+            CHECK(fp != NULL);
+            CHECK(fscanf(fp, "%f", &temp) == 1);
+            fclose(fp);
+        }
+    }
+    fopen_ns = thermalNowNs() - start;
+
+    start = thermalNowNs();
+    for (int n = 0; n < TEST_LOOKUPS; n++)
+        sampler.sample();
+    pread_ns = thermalNowNs() - start;
+
+    start = thermalNowNs();
+    for (int n = 0; n < TEST_LOOKUPS; n++)
+        sampler.peek(samples, 4);
+    peek_ns = thermalNowNs() - start;
+    CHECK(samples[0].raw == 30000);
+
+    fprintf(stderr, "%-25s%.2f us fopen, %.2f us pread, %.3f us snapshot\n", "Cost: ",
+            fopen_ns / 1000.0 / TEST_LOOKUPS, pread_ns / 1000.0 / TEST_LOOKUPS,
+            peek_ns / 1000.0 / TEST_LOOKUPS);
+    return 0;
+}
+
+int main(void) {
+    int ret = -1;
+
+    snprintf(root, sizeof(root), "%s/thermal-%d",
+             getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", getpid());
+    if (mkdir(root, 0755) || make_tree()) {
+        fprintf(stderr, "cannot create %s\n", root);
+        goto exit;
+    }
+
+    if (test_on_demand() || test_missing_zone() || test_thread() || test_wake() ||
+            test_concurrent() || test_cost())
+        goto exit;
+    ret = 0;
+
+exit:
+    remove_tree();
+    fprintf(stderr, "%-25s\n", ret ? "Fail!" : "Success!");
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "thermal-events"
+
+#include <algorithm>
+#include <cmath>
+
+#include <android-base/logging.h>
+
+#include "thermal-events.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V1_1 {
+namespace implementation {
+
+static const char *stateName(ThermalState state) {
+    switch (state) {
+        case ThermalState::NORMAL:
+            return "normal";
+        case ThermalState::THROTTLING:
+            return "throttling";
+        case ThermalState::SHUTDOWN:
+            return "shutdown";
+    }
+    return "unknown";
+}
+
+ThermalEventEngine::ThermalEventEngine(ThermalEventSource *source,
+                                       const std::vector<ThermalEventSensor> &sensors,
+                                       unsigned int min_interval_ms, unsigned int max_interval_ms)
+    : source_(source),
+      sensors_(sensors),
+      min_interval_ms_(min_interval_ms),
+      max_interval_ms_(std::max(min_interval_ms, max_interval_ms)),
+      states_(sensors.size(), ThermalState::NORMAL),
+      samples_(sensors.size()),
+      interval_ms_(0),
+      steps_(0),
+      events_(0),
+      running_(false) {}
+
+ThermalEventEngine::~ThermalEventEngine() {
+    stop();
+}
+
+void ThermalEventEngine::registerCallback(const Callback &callback) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    callbacks_.push_back(callback);
+}
+
+void ThermalEventEngine::start() {
+    std::lock_guard<std::mutex> lock(thread_lock_);
+
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&ThermalEventEngine::loop, this);
+}
+
+void ThermalEventEngine::stop() {
+    {
+        std::lock_guard<std::mutex> lock(thread_lock_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    source_->wake();
+    thread_.join();
+}
+
+ThermalState ThermalEventEngine::state(size_t sensor) const {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    return sensor < states_.size() ? states_[sensor] : ThermalState::NORMAL;
+}
+
+/*
+ * Thresholds are entered at their value and left kThermalEventHysteresis
+ * below it. NAN compares false, so a missing threshold is never crossed.
+ */
+ThermalState ThermalEventEngine::nextState(const ThermalEventSensor &sensor, ThermalState state,
+                                           float value) const {
+    if (value >= sensor.shutdown_threshold) {
+        return ThermalState::SHUTDOWN;
+    }
+    if (state == ThermalState::SHUTDOWN &&
+        value > sensor.shutdown_threshold - kThermalEventHysteresis) {
+        return ThermalState::SHUTDOWN;
+    }
+
+    if (value >= sensor.throttling_threshold) {
+        return ThermalState::THROTTLING;
+    }
+    if (state != ThermalState::NORMAL &&
+        value > sensor.throttling_threshold - kThermalEventHysteresis) {
+        return ThermalState::THROTTLING;
+    }
+    return ThermalState::NORMAL;
+}
+
+// Degrees until the sensor changes state, in either direction.
+float ThermalEventEngine::margin(const ThermalEventSensor &sensor, ThermalState state,
+                                 float value) const {
+    float margin = INFINITY;
+
+    if (!std::isnan(sensor.shutdown_threshold)) {
+        margin = std::min(margin, state == ThermalState::SHUTDOWN
+                              ? value - (sensor.shutdown_threshold - kThermalEventHysteresis)
+                              : sensor.shutdown_threshold - value);
+    }
+    if (!std::isnan(sensor.throttling_threshold) && state != ThermalState::SHUTDOWN) {
+        margin = std::min(margin, state == ThermalState::THROTTLING
+                              ? value - (sensor.throttling_threshold - kThermalEventHysteresis)
+                              : sensor.throttling_threshold - value);
+    }
+    return margin;
+}
+
+unsigned int ThermalEventEngine::step() {
+    std::vector<ThermalEvent> events;
+    std::vector<Callback> callbacks;
+    float closest = INFINITY;
+    unsigned int interval_ms;
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        int64_t timestamp_ns = source_->read(samples_.data(), samples_.size(),
+                                             static_cast<int64_t>(interval_ms_) * 1000000);
+
+        steps_++;
+        for (size_t i = 0; i < sensors_.size(); i++) {
+            if (samples_[i].error) {
+                continue;
+            }
+
+            float value = samples_[i].raw * sensors_[i].mult;
+            ThermalState next = nextState(sensors_[i], states_[i], value);
+            if (next != states_[i]) {
+                events.push_back({i, states_[i], next, value, timestamp_ns});
+                states_[i] = next;
+            }
+            closest = std::min(closest, margin(sensors_[i], states_[i], value));
+        }
+        events_ += events.size();
+        if (!events.empty()) {
+            callbacks = callbacks_;
+        }
+    }
+
+    // Callbacks run unlocked, they may well call back into the HAL.
+    for (const ThermalEvent &event : events) {
+        LOG(INFO) << "Sensor " << event.sensor << " " << stateName(event.from) << " -> "
+                  << stateName(event.to) << " at " << event.value;
+        for (const Callback &callback : callbacks) {
+            callback(event);
+        }
+    }
+
+    if (closest >= kThermalEventSlowMargin) {
+        interval_ms = max_interval_ms_;
+    } else if (closest <= 0) {
+        interval_ms = min_interval_ms_;
+    } else {
+        interval_ms = min_interval_ms_ +
+                      static_cast<unsigned int>((max_interval_ms_ - min_interval_ms_) *
+                                                closest / kThermalEventSlowMargin);
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    interval_ms_ = interval_ms;
+    return interval_ms;
+}
+
+void ThermalEventEngine::loop() {
+    std::unique_lock<std::mutex> lock(thread_lock_);
+
+    while (running_) {
+        lock.unlock();
+        unsigned int interval_ms = step();
+        int64_t deadline_ns = thermalNowNs() + static_cast<int64_t>(interval_ms) * 1000000;
+        lock.lock();
+
+        while (running_) {
+            int64_t remaining_ms = (deadline_ns - thermalNowNs()) / 1000000;
+            if (remaining_ms <= 0) {
+                break;
+            }
+            lock.unlock();
+            bool notified = source_->wait(remaining_ms);
+            lock.lock();
+            if (notified) {
+                std::lock_guard<std::mutex> guard(lock_);
+                interval_ms_ = 0;
+                break;
+            }
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __THERMAL_EVENTS_H__
+#define __THERMAL_EVENTS_H__
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thermal-sampler.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V1_1 {
+namespace implementation {
+
+constexpr unsigned int kThermalEventMinIntervalMs = 100;
+constexpr unsigned int kThermalEventMaxIntervalMs = 5000;
+// Sensors this far, in degrees Celsius, from their next threshold are
+// sampled at the max interval.
+constexpr float kThermalEventSlowMargin = 10;
+constexpr float kThermalEventHysteresis = 2;
+
+enum class ThermalState { NORMAL, THROTTLING, SHUTDOWN };
+
+struct ThermalEventSensor {
+    // Multiplier used to translate the raw value to Celsius.
+    float mult;
+    // NAN for none.
+    float throttling_threshold;
+    float shutdown_threshold;
+};
+
+struct ThermalEvent {
+    size_t sensor;
+    ThermalState from;
+    ThermalState to;
+    float value;
+    int64_t timestamp_ns;
+};
+
+/**
+ * Where the engine gets its samples from. read may return samples up to
+ * max_age_ns old, the engine passes its current interval so a source that
+ * is sampled elsewhere anyway is not read twice, and 0 after a notify.
+ * wait returns true early when a sensor reports a change itself, like a
+ * sysfs_notify on the temp node. wake makes the pending wait, or the next
+ * one, return false right away, it is how stop() gets the engine thread
+ * out of a long interval.
+ */
+class ThermalEventSource {
+  public:
+    virtual ~ThermalEventSource() {}
+    virtual int64_t read(SensorSample *samples, size_t count, int64_t max_age_ns) = 0;
+    virtual bool wait(unsigned int timeout_ms) = 0;
+    virtual void wake() = 0;
+};
+
+/**
+ * Tracks the throttling and shutdown state of each sensor and calls the
+ * registered callbacks on every transition. A sensor leaves a state only
+ * once it has cooled kThermalEventHysteresis below the threshold it
+ * crossed. The sampling interval shrinks from the max to the min interval
+ * as the sensors get close to a threshold, so idle devices are sampled
+ * rarely and a crossing is still seen quickly.
+ */
+class ThermalEventEngine {
+  public:
+    typedef std::function<void(const ThermalEvent &)> Callback;
+
+    ThermalEventEngine(ThermalEventSource *source, const std::vector<ThermalEventSensor> &sensors,
+                       unsigned int min_interval_ms = kThermalEventMinIntervalMs,
+                       unsigned int max_interval_ms = kThermalEventMaxIntervalMs);
+    ~ThermalEventEngine();
+
+    void registerCallback(const Callback &callback);
+
+    void start();
+    void stop();
+
+    /**
+     * Reads the sensors once and fires the transitions.
+     *
+     * @return interval in ms until the next step.
+     */
+    unsigned int step();
+
+    ThermalState state(size_t sensor) const;
+    uint64_t steps() const { return steps_; }
+    uint64_t events() const { return events_; }
+
+  private:
+    ThermalState nextState(const ThermalEventSensor &sensor, ThermalState state,
+                           float value) const;
+    float margin(const ThermalEventSensor &sensor, ThermalState state, float value) const;
+    void loop();
+
+    ThermalEventSource *source_;
+    const std::vector<ThermalEventSensor> sensors_;
+    const unsigned int min_interval_ms_;
+    const unsigned int max_interval_ms_;
+
+    mutable std::mutex lock_;
+    std::vector<ThermalState> states_;
+    std::vector<SensorSample> samples_;
+    std::vector<Callback> callbacks_;
+    // Interval of the last step, 0 when the next read has to be fresh.
+    unsigned int interval_ms_;
+    uint64_t steps_;
+    uint64_t events_;
+
+    std::mutex thread_lock_;
+    std::thread thread_;
+    bool running_;
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif //__THERMAL_EVENTS_H__
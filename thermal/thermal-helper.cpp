@@ -16,7 +16,6 @@
 
 #define LOG_TAG "thermal-helper"
 
-#include <cctype>
 #include <cerrno>
 #include <cinttypes>
 #include <cmath>
@@ -27,7 +26,10 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 
+#include "cpu-usage-reader.h"
+#include "thermal-events.h"
 #include "thermal-helper.h"
+#include "thermal-sampler.h"
 
 namespace android {
 namespace hardware {
@@ -37,214 +39,162 @@ namespace implementation {
 
 using ::android::hardware::thermal::V1_0::TemperatureType;
 
-/**
- * Reads device temperature.
- *
- * @param sensor_num Number of sensor file with temperature.
- * @param type Device temperature type.
- * @param name Device temperature name.
- * @param mult Multiplier used to translate temperature to Celsius.
- * @param throttling_threshold Throttling threshold for the temperature.
- * @param shutdown_threshold Shutdown threshold for the temperature.
- * @param out Pointer to temperature_t structure that will be filled with current
- *     values.
- *
- * @return 0 on success or negative value -errno on error.
- */
-static ssize_t readTemperature(int sensor_num, TemperatureType type, const char *name, float mult,
-                                float throttling_threshold, float shutdown_threshold,
-                                Temperature *out) {
-    FILE *file;
-    char file_name[PATH_MAX];
-    float temp;
+struct SensorInfo {
+    unsigned int sensor_num;
+    TemperatureType type;
+    const char *name;
+    // Multiplier used to translate temperature to Celsius.
+    float mult;
+    float throttling_threshold;
+    float shutdown_threshold;
+};
+
+// All temperatures are in millidegrees Celsius.
+static const SensorInfo kSensors[kTemperatureNum] = {
+    {kBatterySensorNum, TemperatureType::BATTERY, kBatteryLabel, 0.001,
+     UNKNOWN_TEMPERATURE, kBatteryShutdownThreshold},
+    {kCpuSensorNum, TemperatureType::CPU, kCpuLabel[0], 0.001,
+     kCpuThrottlingThreshold, kCpuShutdownThreshold},
+    {kGpuSensorNum, TemperatureType::GPU, kGpuLabel, 0.001,
+     UNKNOWN_TEMPERATURE, UNKNOWN_TEMPERATURE},
+};
+
+static ThermalSampler &getSampler() {
+    static ThermalSampler sampler(kThermalRoot, [] {
+        std::vector<unsigned int> sensors;
+        for (const SensorInfo &info : kSensors) {
+            sensors.push_back(info.sensor_num);
+        }
+        return sensors;
+    }(), android::base::GetUintProperty<unsigned int>(kThermalSamplePeriodProperty,
+                                                      kThermalSamplePeriodMs));
+    return sampler;
+}
 
-    sprintf(file_name, kTemperatureFileFormat, sensor_num);
-    file = fopen(file_name, "r");
-    if (file == NULL) {
-        PLOG(ERROR) << "readTemperature: failed to open file (" << file_name << ")";
-        return -errno;
+// Feeds the event engine from the sampler snapshot. The zones are only read
+// here when the engine steps faster than the sampler thread, and then the
+// refreshed snapshot is what getTemperatures serves too.
+class SamplerEventSource : public ThermalEventSource {
+  public:
+    int64_t read(SensorSample *samples, size_t count, int64_t max_age_ns) override {
+        return getSampler().read(samples, count, max_age_ns);
     }
-    if (1 != fscanf(file, "%f", &temp)) {
-        fclose(file);
-        PLOG(ERROR) << "readTemperature: failed to read a float";
-        return errno ? -errno : -EIO;
+    bool wait(unsigned int timeout_ms) override {
+        return getSampler().waitNotify(timeout_ms);
     }
+    void wake() override {
+        getSampler().wakeNotify();
+    }
+};
+
+static void fillTemperature(const SensorInfo &info, float value, Temperature *out) {
+    out->type = info.type;
+    out->name = info.name;
+    out->currentValue = value;
+    out->throttlingThreshold = info.throttling_threshold;
+    out->shutdownThreshold = info.shutdown_threshold;
+    out->vrThrottlingThreshold = UNKNOWN_TEMPERATURE;
+}
 
-    fclose(file);
+void startThermalEvents(const std::function<void(bool, const Temperature &)> &notify) {
+    static SamplerEventSource source;
+    static ThermalEventEngine engine(&source, [] {
+        std::vector<ThermalEventSensor> sensors;
+        for (const SensorInfo &info : kSensors) {
+            sensors.push_back({info.mult,
+                               info.throttling_threshold == UNKNOWN_TEMPERATURE
+                                   ? NAN : info.throttling_threshold,
+                               info.shutdown_threshold == UNKNOWN_TEMPERATURE
+                                   ? NAN : info.shutdown_threshold});
+        }
+        return sensors;
+    }());
 
-    (*out).type = type;
-    (*out).name = name;
-    (*out).currentValue = temp * mult;
-    (*out).throttlingThreshold = throttling_threshold;
-    (*out).shutdownThreshold = shutdown_threshold;
-    (*out).vrThrottlingThreshold = UNKNOWN_TEMPERATURE;
+    engine.registerCallback([notify](const ThermalEvent &event) {
+        Temperature temperature;
 
-    LOG(DEBUG) << android::base::StringPrintf(
-        "readTemperature: %d, %d, %s, %g, %g, %g",
-        sensor_num, type, name, temp * mult, throttling_threshold, shutdown_threshold);
+        fillTemperature(kSensors[event.sensor], event.value, &temperature);
+        notify(event.to != ThermalState::NORMAL, temperature);
+    });
+    engine.start();
+}
 
-    return 0;
+void startThermalSampler() {
+    ThermalSampler &sampler = getSampler();
+
+    sampler.start();
+    LOG(INFO) << "Sampling " << sampler.size() << " thermal zones every "
+              << sampler.periodMs() << " ms";
 }
 
 ssize_t fillTemperatures(hidl_vec<Temperature> *temperatures) {
-    ssize_t result = 0;
-    size_t current_index = 0;
+    SensorSample samples[kTemperatureNum];
+    ThermalSampler &sampler = getSampler();
 
     if (temperatures == NULL || temperatures->size() < kTemperatureNum) {
         LOG(ERROR) << "fillTemperatures: incorrect buffer";
         return -EINVAL;
     }
 
-    // Battery temperature.
-    if (current_index < temperatures->size()) {
-        // battery: temperature in millidegrees Celsius.
-        result = readTemperature(kBatterySensorNum, TemperatureType::BATTERY, kBatteryLabel,
-                                  0.001, UNKNOWN_TEMPERATURE, kBatteryShutdownThreshold,
-                                  &(*temperatures)[current_index]);
-        if (result < 0) {
-            return result;
-        }
-        current_index++;
-    }
-
-    // CPU temperature.
-    if (current_index < temperatures->size()) {
-        // CPU_therm: temperature in millidegrees Celsius.
-        result = readTemperature(kCpuSensorNum, TemperatureType::CPU, kCpuLabel[0],
-                                  0.001, kCpuThrottlingThreshold, kCpuShutdownThreshold,
-                                  &(*temperatures)[current_index]);
-        if (result < 0) {
-            return result;
+    // Samples older than two periods mean the sampler thread is stuck or
+    // not running, read the zones here then.
+    int64_t timestamp_ns = sampler.read(samples, kTemperatureNum,
+                                        2 * static_cast<int64_t>(sampler.periodMs()) * 1000000);
+
+    // A zone that fails to read is left out, so one broken sensor does not
+    // hide the others. The result is only an error when none could be read.
+    size_t count = 0;
+    int error = 0;
+    for (size_t i = 0; i < kTemperatureNum; i++) {
+        const SensorInfo &info = kSensors[i];
+        Temperature *out = &(*temperatures)[count];
+
+        if (samples[i].error) {
+            LOG(ERROR) << "fillTemperatures: failed to read sensor " << info.sensor_num
+                       << ", skipping it";
+            error = samples[i].error;
+            continue;
         }
-        current_index++;
-    }
 
-    // GPU temperature.
-    if (current_index < temperatures->size()) {
-        // GPU_therm: temperature in millidegrees Celsius.
-        result = readTemperature(kGpuSensorNum, TemperatureType::GPU, kGpuLabel,
-                                  0.001, UNKNOWN_TEMPERATURE, UNKNOWN_TEMPERATURE,
-                                  &(*temperatures)[current_index]);
-        if (result < 0) {
-            return result;
-        }
-        current_index++;
-    }
+        fillTemperature(info, samples[i].raw * info.mult, out);
 
-    // Battery temperature.
-    if (current_index < temperatures->size()) {
-        // battery: temperature in millidegrees Celsius.
-        result = readTemperature(kBatterySensorNum, TemperatureType::BATTERY, kBatteryLabel,
-                                  0.001, UNKNOWN_TEMPERATURE, kBatteryShutdownThreshold,
-                                  &(*temperatures)[current_index]);
-        if (result < 0) {
-            return result;
-        }
-        current_index++;
+        LOG(DEBUG) << android::base::StringPrintf(
+            "fillTemperatures: %u, %d, %s, %g, %g, %g, age %" PRId64 " us",
+            info.sensor_num, info.type, info.name, out->currentValue,
+            info.throttling_threshold, info.shutdown_threshold,
+            (thermalNowNs() - timestamp_ns) / 1000);
+        count++;
     }
 
-    return kTemperatureNum;
-
-    // Skin temperature.
-    if (current_index < temperatures->size()) {
-        // battery: temperature in millidegrees Celsius.
-        result = readTemperature(kSkinSensorNum, TemperatureType::SKIN, kSkinLabel,
-                                  0.001, kSkinTrottlingThreshold, UNKNOWN_TEMPERATURE,
-                                  &(*temperatures)[current_index]);
-        if (result < 0) {
-            return result;
-        }
-        current_index++;
+    if (count == 0) {
+        return error;
     }
-
-    return kTemperatureNum;
+    return count;
 }
 
 ssize_t fillCpuUsages(hidl_vec<CpuUsage> *cpuUsages) {
-    int vals, cpu_num, online;
-    ssize_t read;
-    uint64_t user, nice, system, idle, active, total;
-    char *line = NULL;
-    size_t len = 0;
-    size_t size = 0;
-    char file_name[PATH_MAX];
-    FILE *file;
-    FILE *cpu_file;
+    static CpuUsageReader reader(kCpuUsageFile, kCpuOnlineFileFormat, kCpuNum);
+    CpuTimes times[kCpuNum];
 
     if (cpuUsages == NULL || cpuUsages->size() < kCpuNum ) {
         LOG(ERROR) << "fillCpuUsages: incorrect buffer";
         return -EINVAL;
     }
 
-    file = fopen(kCpuUsageFile, "r");
-    if (file == NULL) {
-        PLOG(ERROR) << "fillCpuUsages: failed to open file (" << kCpuUsageFile << ")";
-        return -errno;
+    ssize_t result = reader.read(times);
+    if (result < 0) {
+        return result;
     }
 
-    while ((read = getline(&line, &len, file)) != -1) {
-        // Skip non "cpu[0-9]" lines.
-        if (strnlen(line, read) < 4 || strncmp(line, "cpu", 3) != 0 || !isdigit(line[3])) {
-            free(line);
-            line = NULL;
-            len = 0;
-            continue;
-        }
-
-        vals = sscanf(line, "cpu%d %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
-                &cpu_num, &user, &nice, &system, &idle);
-
-        free(line);
-        line = NULL;
-        len = 0;
-
-        if (vals != 5 || size == kCpuNum) {
-            if (vals != 5) {
-                PLOG(ERROR) << "fillCpuUsages: failed to read CPU information from file ("
-                            << kCpuUsageFile << ")";
-            } else {
-                PLOG(ERROR) << "fillCpuUsages: file has incorrect format ("
-                            << kCpuUsageFile << ")";
-            }
-            fclose(file);
-            return errno ? -errno : -EIO;
-        }
-
-        active = user + nice + system;
-        total = active + idle;
-
-        // Read online CPU information.
-        snprintf(file_name, PATH_MAX, kCpuOnlineFileFormat, cpu_num);
-        cpu_file = fopen(file_name, "r");
-        online = 0;
-        if (cpu_file == NULL) {
-            PLOG(ERROR) << "fillCpuUsages: failed to open file (" << file_name << ")";
-            fclose(file);
-            return -errno;
-        }
-        if (1 != fscanf(cpu_file, "%d", &online)) {
-            PLOG(ERROR) << "fillCpuUsages: failed to read CPU online information from file ("
-                        << file_name << ")";
-            fclose(file);
-            fclose(cpu_file);
-            return errno ? -errno : -EIO;
-        }
-        fclose(cpu_file);
-
-        (*cpuUsages)[size].name = kCpuLabel[size];
-        (*cpuUsages)[size].active = active;
-        (*cpuUsages)[size].total = total;
-        (*cpuUsages)[size].isOnline = static_cast<bool>(online);
-
-        LOG(DEBUG) << "fillCpuUsages: "<< kCpuLabel[size] << ": "
-                   << active << " " << total << " " <<  online;
-        size++;
-    }
-    fclose(file);
+    for (size_t i = 0; i < kCpuNum; i++) {
+        (*cpuUsages)[i].name = kCpuLabel[i];
+        (*cpuUsages)[i].active = times[i].active;
+        (*cpuUsages)[i].total = times[i].total;
+        (*cpuUsages)[i].isOnline = times[i].online;
 
-    if (size != kCpuNum) {
-        PLOG(ERROR) << "fillCpuUsages: file has incorrect format (" << kCpuUsageFile << ")";
-        return -EIO;
+        LOG(DEBUG) << "fillCpuUsages: "<< kCpuLabel[i] << ": "
+                   << times[i].active << " " << times[i].total << " " << times[i].online
+                   << " " << times[i].utilization;
     }
     return kCpuNum;
 }
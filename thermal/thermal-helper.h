@@ -1,6 +1,8 @@
 #ifndef __THERMAL_HELPER_H__
 #define __THERMAL_HELPER_H__
 
+#include <functional>
+
 #include <android/hardware/thermal/1.1/IThermal.h>
 #include <hardware/thermal.h>
 
@@ -15,7 +17,6 @@ using ::android::hardware::thermal::V1_0::Temperature;
 
 constexpr const char *kCpuUsageFile = "/proc/stat";
 constexpr const char *kCpuOnlineFileFormat = "/sys/devices/system/cpu/cpu%d/online";
-constexpr const char *kTemperatureFileFormat = "/sys/class/thermal/thermal_zone%d/temp";
 
 constexpr unsigned int kBatterySensorNum = 17;
 constexpr unsigned int kCpuSensorNum = 6;
@@ -23,7 +24,9 @@ constexpr unsigned int kGpuSensorNum = 11;
 constexpr unsigned int kSkinSensorNum = 14;
 
 constexpr unsigned int kCpuNum = 4;
-constexpr unsigned int kTemperatureNum = 7;
+// The skin zone is not reported, its throttling threshold would make the
+// framework throttle at 40C skin temperature.
+constexpr unsigned int kTemperatureNum = 3;
 
 constexpr const char *kBatteryLabel = "battery";
 constexpr const char *kCpuLabel[kCpuNum] = {"CPU0", "CPU1", "CPU2", "CPU3"};
@@ -35,6 +38,9 @@ constexpr unsigned int kCpuShutdownThreshold = 115;
 constexpr unsigned int kCpuThrottlingThreshold = 60;
 constexpr unsigned int kSkinTrottlingThreshold = 40;
 
+void startThermalSampler();
+// Calls notify on every throttling or shutdown transition of a sensor.
+void startThermalEvents(const std::function<void(bool, const Temperature &)> &notify);
 ssize_t fillTemperatures(hidl_vec<Temperature> *temperatures);
 ssize_t fillCpuUsages(hidl_vec<CpuUsage> *cpuUsages);
 
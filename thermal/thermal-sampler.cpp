@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "thermal-sampler"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+#include "thermal-sampler.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V1_1 {
+namespace implementation {
+
+int64_t thermalNowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+ThermalSampler::ThermalSampler(const std::string &root, const std::vector<unsigned int> &sensors,
+                               unsigned int period_ms)
+    : period_ms_(period_ms),
+      wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      poll_fds_(sensors.size() + 1),
+      samples_(sensors.size()),
+      seq_(0),
+      raw_(new std::atomic<int>[sensors.size()]),
+      error_(new std::atomic<int>[sensors.size()]),
+      timestamp_ns_(0),
+      passes_(0),
+      running_(false) {
+    for (size_t i = 0; i < sensors.size(); i++) {
+        paths_.push_back(android::base::StringPrintf("%s/thermal_zone%u/temp", root.c_str(),
+                                                     sensors[i]));
+        fds_.push_back(open(paths_[i].c_str(), O_RDONLY | O_CLOEXEC));
+        if (fds_[i] < 0) {
+            PLOG(ERROR) << "ThermalSampler: failed to open file (" << paths_[i] << ")";
+        }
+        raw_[i].store(0, std::memory_order_relaxed);
+        error_[i].store(-EAGAIN, std::memory_order_relaxed);
+    }
+    if (wake_fd_ < 0) {
+        PLOG(ERROR) << "ThermalSampler: failed to create eventfd";
+    }
+}
+
+ThermalSampler::~ThermalSampler() {
+    stop();
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    if (wake_fd_ >= 0) {
+        close(wake_fd_);
+    }
+}
+
+void ThermalSampler::start() {
+    std::lock_guard<std::mutex> lock(thread_lock_);
+
+    if (running_ || period_ms_ == 0) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&ThermalSampler::loop, this);
+}
+
+void ThermalSampler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(thread_lock_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    thread_cond_.notify_all();
+    thread_.join();
+}
+
+void ThermalSampler::loop() {
+    std::unique_lock<std::mutex> lock(thread_lock_);
+
+    while (running_) {
+        lock.unlock();
+        sample();
+        lock.lock();
+        thread_cond_.wait_for(lock, std::chrono::milliseconds(period_ms_),
+                              [this] { return !running_; });
+    }
+}
+
+/**
+ * Reads one temp node from its kept open fd. A failed read reopens the node
+ * once, in case the zone went away and came back. The new file is dup3()ed
+ * onto the old fd, and the old one is kept if the open fails, so a fd
+ * waitNotify may be polling is never closed.
+ *
+ * @return 0 on success or negative value -errno on error.
+ */
+int ThermalSampler::readSensor(size_t index, int *raw) {
+    char buf[16];
+    char *end;
+    ssize_t len = -1;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (fds_[index] < 0 || attempt > 0) {
+            int fd = open(paths_[index].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return -errno;
+            }
+            if (fds_[index] < 0) {
+                fds_[index] = fd;
+            } else {
+                int ret = dup3(fd, fds_[index], O_CLOEXEC);
+                int err = errno;
+                close(fd);
+                if (ret < 0) {
+                    return -err;
+                }
+            }
+        }
+        len = pread(fds_[index], buf, sizeof(buf) - 1, 0);
+        if (len > 0) {
+            break;
+        }
+    }
+    if (len <= 0) {
+        return len < 0 ? -errno : -EIO;
+    }
+
+    buf[len] = '\0';
+    errno = 0;
+    long value = strtol(buf, &end, 10);
+    if (end == buf || errno) {
+        return errno ? -errno : -EIO;
+    }
+    *raw = static_cast<int>(value);
+    return 0;
+}
+
+void ThermalSampler::sample() {
+    std::lock_guard<std::mutex> lock(sample_lock_);
+
+    for (size_t i = 0; i < paths_.size(); i++) {
+        samples_[i].raw = 0;
+        samples_[i].error = readSensor(i, &samples_[i].raw);
+        if (samples_[i].error && error_[i].load(std::memory_order_relaxed) == 0) {
+            LOG(ERROR) << "ThermalSampler: failed to read file (" << paths_[i] << "): "
+                       << strerror(-samples_[i].error);
+        }
+    }
+
+    // Readers retry while seq_ is odd or changed under them.
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < paths_.size(); i++) {
+        raw_[i].store(samples_[i].raw, std::memory_order_relaxed);
+        error_[i].store(samples_[i].error, std::memory_order_relaxed);
+    }
+    timestamp_ns_.store(thermalNowNs(), std::memory_order_relaxed);
+    seq_.store(seq + 2, std::memory_order_release);
+    passes_.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t ThermalSampler::peek(SensorSample *samples, size_t count) const {
+    uint32_t begin, end;
+    int64_t timestamp_ns;
+
+    if (count > paths_.size()) {
+        count = paths_.size();
+    }
+    do {
+        begin = seq_.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            samples[i].raw = raw_[i].load(std::memory_order_relaxed);
+            samples[i].error = error_[i].load(std::memory_order_relaxed);
+        }
+        timestamp_ns = timestamp_ns_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = seq_.load(std::memory_order_relaxed);
+    } while ((begin & 1) || begin != end);
+
+    return timestamp_ns;
+}
+
+bool ThermalSampler::waitNotify(unsigned int timeout_ms) {
+    size_t count = paths_.size();
+    bool notified = false;
+
+    // poll skips the negative fds of zones that never opened.
+    {
+        std::lock_guard<std::mutex> lock(sample_lock_);
+        for (size_t i = 0; i < count; i++) {
+            poll_fds_[i] = {fds_[i], POLLPRI, 0};
+        }
+    }
+    poll_fds_[count] = {wake_fd_, POLLIN, 0};
+
+    int ret = poll(poll_fds_.data(), poll_fds_.size(), timeout_ms);
+    if (ret < 0) {
+        if (errno != EINTR) {
+            PLOG(ERROR) << "ThermalSampler: poll failed";
+        }
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        notified = notified || poll_fds_[i].revents != 0;
+    }
+    if (poll_fds_[count].revents & POLLIN) {
+        uint64_t value;
+        if (::read(wake_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            PLOG(ERROR) << "ThermalSampler: failed to read eventfd";
+        }
+        return false;
+    }
+    return notified;
+}
+
+void ThermalSampler::wakeNotify() {
+    uint64_t value = 1;
+
+    if (write(wake_fd_, &value, sizeof(value)) < 0) {
+        PLOG(ERROR) << "ThermalSampler: failed to write eventfd";
+    }
+}
+
+int64_t ThermalSampler::read(SensorSample *samples, size_t count, int64_t max_age_ns) {
+    int64_t timestamp_ns = peek(samples, count);
+
+    if (timestamp_ns == 0 || thermalNowNs() - timestamp_ns > max_age_ns) {
+        sample();
+        timestamp_ns = peek(samples, count);
+    }
+    return timestamp_ns;
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
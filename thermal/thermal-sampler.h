@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __THERMAL_SAMPLER_H__
+#define __THERMAL_SAMPLER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V1_1 {
+namespace implementation {
+
+constexpr const char *kThermalRoot = "/sys/class/thermal";
+constexpr const char *kThermalSamplePeriodProperty = "ro.vendor.thermal.sample_period_ms";
+constexpr unsigned int kThermalSamplePeriodMs = 1000;
+
+struct SensorSample {
+    // Raw value of the temp node, usually millidegrees Celsius.
+    int raw;
+    // 0, or -errno of the last read.
+    int error;
+};
+
+/**
+ * Keeps the temp nodes of a set of thermal zones open and reads all of them
+ * with pread in one pass, every period_ms on a sampler thread. Readers copy
+ * the last pass out of a seqlocked snapshot without taking a lock, so
+ * frequent callers never touch sysfs. With a period of 0 there is no thread
+ * and every stale read samples on the calling thread.
+ */
+class ThermalSampler {
+  public:
+    ThermalSampler(const std::string &root, const std::vector<unsigned int> &sensors,
+                   unsigned int period_ms);
+    ~ThermalSampler();
+
+    void start();
+    void stop();
+
+    // Reads all sensors and publishes them as the new snapshot.
+    void sample();
+
+    /**
+     * Copies the last snapshot, sampling first when there is none yet or it
+     * is older than max_age_ns.
+     *
+     * @return CLOCK_MONOTONIC time of the snapshot in nanoseconds.
+     */
+    int64_t read(SensorSample *samples, size_t count, int64_t max_age_ns);
+
+    // Copies the last snapshot as is. Returns 0 if there is none yet.
+    int64_t peek(SensorSample *samples, size_t count) const;
+
+    /**
+     * Waits up to timeout_ms for a sysfs_notify on any of the zones. Zones
+     * whose driver never notifies just time out. Only one thread may wait
+     * at a time.
+     *
+     * @return true if a zone was notified.
+     */
+    bool waitNotify(unsigned int timeout_ms);
+
+    // Makes the pending waitNotify, or the next one, return false now.
+    void wakeNotify();
+
+    size_t size() const { return paths_.size(); }
+    unsigned int periodMs() const { return period_ms_; }
+    uint64_t passes() const { return passes_.load(std::memory_order_relaxed); }
+
+  private:
+    int readSensor(size_t index, int *raw);
+    void loop();
+
+    const unsigned int period_ms_;
+    std::vector<std::string> paths_;
+    // A temp fd keeps its number once open, a reopen dup3()s over it, so
+    // waitNotify can poll a copy of them without the lock.
+    std::vector<int> fds_;
+    int wake_fd_;
+    // The zones and then wake_fd_, used by the waiting thread only.
+    std::vector<struct pollfd> poll_fds_;
+
+    // Snapshot, written by sample() under sample_lock_ only.
+    std::mutex sample_lock_;
+    std::vector<SensorSample> samples_;
+    std::atomic<uint32_t> seq_;
+    std::unique_ptr<std::atomic<int>[]> raw_;
+    std::unique_ptr<std::atomic<int>[]> error_;
+    std::atomic<int64_t> timestamp_ns_;
+    std::atomic<uint64_t> passes_;
+
+    std::mutex thread_lock_;
+    std::condition_variable thread_cond_;
+    std::thread thread_;
+    bool running_;
+};
+
+int64_t thermalNowNs();
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif //__THERMAL_SAMPLER_H__